@@ -31,6 +31,7 @@ All rights reserved.
 #include "antdefines.h"
 #include "usb_device_handle.hpp"
 #include "dsi_serial_generic.hpp"
+#include "dsi_serial_emulator.hpp"
 #if defined(DSI_TYPES_WINDOWS)
    #include "dsi_serial_vcp.hpp"
 #endif
@@ -43,6 +44,10 @@ All rights reserved.
 
 #define MAX_CHANNELS ((UCHAR) 8)
 
+#define RECONNECT_POLL_MS                    1000  // Open() retried at least this often while the stick is gone
+#define RECONNECT_SETTLE_MS                  100   // A stick that just arrived may not open straight away
+#define RECONNECT_SETTLE_TRIES               10
+
 #define MESG_CHANNEL_OFFSET                  0
 #define MESG_EVENT_ID_OFFSET                 1
 #define MESG_EVENT_CODE_OFFSET               2
@@ -55,51 +60,116 @@ typedef struct
 {
    CHANNEL_EVENT_FUNC pfLinkEvent;
    UCHAR *pucRxBuffer;
+   CHANNEL_EVENT_CALLBACK pfLinkCallback;   // takes the place of pfLinkEvent when assigned
+   void *pvLinkContext;
 } CHANNEL_LINK;
 
 
 
-// Local variables.
-static DSISerial* pclSerialObject = NULL;
-static DSIFramerANT* pclMessageObject = NULL;
-static DSI_THREAD_ID uiDSIThread;
-static DSI_CONDITION_VAR condTestDone;
-static DSI_MUTEX mutexTestDone;
+// Everything one stick needs, see ANT_CreateContext.
+struct ANTContext
+{
+   DSISerial* pclSerialObject = NULL;
+   DSISerialEmulator* pclEmulatorObject = NULL;   // Same object as pclSerialObject when PORT_TYPE_EMULATOR
+   DSIFramerANT* pclMessageObject = NULL;
+   DSI_THREAD_ID uiDSIThread = 0;
+   DSI_CONDITION_VAR condTestDone;
+   DSI_MUTEX mutexTestDone;
+
+   RESPONSE_FUNC pfResponseFunc = NULL;  //pointer to main response callback function
+   UCHAR *pucResponseBuffer = NULL;            //pointer to buffer used to hold data from the response message
+   RESPONSE_CALLBACK pfResponseCallback = NULL;  //takes the place of pfResponseFunc when assigned
+   void *pvResponseContext = NULL;
+   CHANNEL_LINK sLink[MAX_CHANNELS] = {};             //array of pointer for each channel
+   BOOL bInitialized = FALSE;
+   UCHAR ucAutoTransferChannel = 0xFF;
+   USHORT usNumDataPackets = 0;
+   BOOL bGoThread = FALSE;
+   BOOL bDirectDispatch = FALSE;
+   DSI_THREAD_IDNUM eTheThread = 0;
 
+   STICK_CALLBACK pfStickCallback = NULL;   //see ANT_AssignStickCallback
+   void *pvStickContext = NULL;
+   DSI_THREAD_ID uiReconnectThread = 0;
+   DSI_CONDITION_VAR condReconnect;
+   DSI_MUTEX mutexReconnect;
+   BOOL bGoReconnect = FALSE;
+   BOOL bReconnectRunning = FALSE;
+   BOOL bStickGone = FALSE;                 //set from the serial receive context
 
+   DSI_MUTEX mutexEventLoop;                //held by ANT_EventLoopHandle, and to take the port away from it
+   BOOL bEventLoop = FALSE;                 //see ANT_EventLoopAttach
 
-// Local Data
-static RESPONSE_FUNC pfResponseFunc = NULL;  //pointer to main response callback function
-static UCHAR *pucResponseBuffer = NULL;            //pointer to buffer used to hold data from the response message
-static CHANNEL_LINK sLink[MAX_CHANNELS];             //array of pointer for each channel
-static BOOL bInitialized = FALSE;
-static UCHAR ucAutoTransferChannel = 0xFF;
-static USHORT usNumDataPackets = 0;
-static BOOL bGoThread = FALSE;
-static DSI_THREAD_IDNUM eTheThread;
+   ANT_STATS stStats = {};                  //counted by every layer of this stick, see ANT_GetStats
+};
+
+
+
+// Local variables.
+static ANTContext stDefaultContext;            // the one the ANT_ calls without Ctx go to
 
 
 
 // Local funcs
 static DSI_THREAD_RETURN MessageThread(void *pvParameter_);
-static void SerialHaveMessage(ANT_MESSAGE& stMessage_, USHORT usSize_);
-static void MemoryCleanup(); //Deletes internal objects from memory
+static void SerialHaveMessage(ANTContext* pstContext_, ANT_MESSAGE& stMessage_, USHORT usSize_);
+static void HaveChannelEvent(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR ucEvent_, ANT_MESSAGE& stMessage_, USHORT usSize_, USHORT usCopySize_);
+static void HaveResponse(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR ucMessageID_, ANT_MESSAGE& stMessage_, USHORT usSize_, USHORT usCopySize_);
+static BOOL IsChannelEvent(ANT_MESSAGE& stMessage_);
+static void DirectHaveMessage(ANT_MESSAGE* pstMessage_, USHORT usSize_, void* pvParameter_);
+static void MemoryCleanup(ANTContext* pstContext_); //Deletes internal objects from memory
+static DSI_THREAD_RETURN ReconnectThread(void *pvParameter_);
+static void SerialError(UCHAR ucSerialError_, void* pvParameter_);
+static void StopReconnect(ANTContext* pstContext_);
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// A context is one stick: its serial port, framer, message thread and
+// callbacks.  The ANT_*Ctx calls take the context they work on, the
+// plain ANT_ calls go to the default one, so a process with one stick
+// never needs these.
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+ANTContext* ANT_CreateContext(void)
+{
+   return new ANTContext();
+}
+
+///////////////////////////////////////////////////////////////////////
+// Closes the context's stick if it is still open.  Not the default one.
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+void ANT_DestroyContext(ANTContext* pstContext_)
+{
+   if (pstContext_ == NULL || pstContext_ == &stDefaultContext)
+      return;
+
+   ANT_CloseCtx(pstContext_);
+   delete pstContext_;
+}
+
+extern "C" EXPORT
+BOOL ANT_InitCtx(ANTContext* pstContext_, UCHAR ucUSBDeviceNum, ULONG ulBaudrate)
+{
+    return ANT_InitExtCtx(pstContext_, ucUSBDeviceNum, ulBaudrate, PORT_TYPE_USB, FRAMER_TYPE_BASIC);
+}
 
 extern "C" EXPORT
 BOOL ANT_Init(UCHAR ucUSBDeviceNum, ULONG ulBaudrate)
 {
-    return ANT_InitExt(ucUSBDeviceNum, ulBaudrate, PORT_TYPE_USB, FRAMER_TYPE_BASIC);
+   return ANT_InitCtx(&stDefaultContext, ucUSBDeviceNum, ulBaudrate);
 }
 
 //Initializes and opens USB connection to the module
 extern "C" EXPORT
-BOOL ANT_InitExt(UCHAR ucUSBDeviceNum, ULONG ulBaudrate, UCHAR ucPortType_, UCHAR ucSerialFrameType_)
+BOOL ANT_InitExtCtx(ANTContext* pstContext_, UCHAR ucUSBDeviceNum, ULONG ulBaudrate, UCHAR ucPortType_, UCHAR ucSerialFrameType_)
 {
    DSI_THREAD_IDNUM eThread = DSIThread_GetCurrentThreadIDNum();
 
-   assert(eTheThread != eThread); // CANNOT CALL THIS FUNCTION FROM DLL THREAD (INSIDE DLL CALLBACK ROUTINES).
+   assert(pstContext_->eTheThread != eThread); // CANNOT CALL THIS FUNCTION FROM DLL THREAD (INSIDE DLL CALLBACK ROUTINES).
 
-   assert(!bInitialized);         // IF ANT WAS ALREADY INITIALIZED, DO NOT CALL THIS FUNCTION BEFORE CALLING ANT_Close();
+   assert(!pstContext_->bInitialized);         // IF ANT WAS ALREADY INITIALIZED, DO NOT CALL THIS FUNCTION BEFORE CALLING ANT_CloseCtx(pstContext_);
 
 
 #if defined(DEBUG_FILE)
@@ -107,92 +177,132 @@ BOOL ANT_InitExt(UCHAR ucUSBDeviceNum, ULONG ulBaudrate, UCHAR ucPortType_, UCHA
    DSIDebug::SetDebug(TRUE);
 #endif
 
+   DSIStats_Reset(&pstContext_->stStats);
+
    //Create Serial object.
-   pclSerialObject = NULL;
+   pstContext_->pclSerialObject = NULL;
 
    switch(ucPortType_)
    {
       case PORT_TYPE_USB:
-        pclSerialObject = new DSISerialGeneric();
+        pstContext_->pclSerialObject = new DSISerialGeneric();
         break;
 #if defined(DSI_TYPES_WINDOWS)
       case PORT_TYPE_COM:
-        pclSerialObject = new DSISerialVCP();
+        pstContext_->pclSerialObject = new DSISerialVCP();
         break;
 #endif
+      case PORT_TYPE_EMULATOR:
+        pstContext_->pclEmulatorObject = new DSISerialEmulator();
+        pstContext_->pclSerialObject = pstContext_->pclEmulatorObject;
+        break;
       default: //Invalid port type selection
          return(FALSE);
    }
 
-   if(!pclSerialObject)
+   if(!pstContext_->pclSerialObject)
       return(FALSE);
 
+   pstContext_->pclSerialObject->SetStats(&pstContext_->stStats);
+
    //Initialize Serial object.
    //NOTE: Will fail if the module is not available.
-   if(!pclSerialObject->Init(ulBaudrate, ucUSBDeviceNum))
+   if(!pstContext_->pclSerialObject->Init(ulBaudrate, ucUSBDeviceNum))
    {
-      MemoryCleanup();
+      MemoryCleanup(pstContext_);
       return(FALSE);
    }
 
    //Create Framer object.
-   pclMessageObject = NULL;
+   pstContext_->pclMessageObject = NULL;
    switch(ucSerialFrameType_)
    {
       case FRAMER_TYPE_BASIC:
-         pclMessageObject = new DSIFramerANT(pclSerialObject);
+      case FRAMER_TYPE_DIRECT:
+         pstContext_->pclMessageObject = new DSIFramerANT(pstContext_->pclSerialObject);
          break;
 
 
       default:
-         MemoryCleanup();
+         MemoryCleanup(pstContext_);
          return(FALSE);
    }
 
-   if(!pclMessageObject)
+   if(!pstContext_->pclMessageObject)
    {
-      MemoryCleanup();
+      MemoryCleanup(pstContext_);
       return(FALSE);
    }
 
+   pstContext_->pclMessageObject->SetStats(&pstContext_->stStats);
+
    //Initialize Framer object.
-   if(!pclMessageObject->Init())
+   if(!pstContext_->pclMessageObject->Init())
    {
-      MemoryCleanup();
+      MemoryCleanup(pstContext_);
       return(FALSE);
    }
 
    //Let Serial know about Framer.
-   pclSerialObject->SetCallback(pclMessageObject);
+   pstContext_->pclSerialObject->SetCallback(pstContext_->pclMessageObject);
+
+   //In direct mode messages go straight from the receive thread to the callbacks.
+   pstContext_->bDirectDispatch = (ucSerialFrameType_ == FRAMER_TYPE_DIRECT);
+   if(pstContext_->bDirectDispatch)
+   {
+      if(DSIThread_MutexInit(&pstContext_->mutexEventLoop) != DSI_THREAD_ENONE)
+      {
+         MemoryCleanup(pstContext_);
+         return(FALSE);
+      }
+      pstContext_->bEventLoop = FALSE;
+      pstContext_->pclMessageObject->SetMessageCallback(DirectHaveMessage, pstContext_);
+      pstContext_->pclSerialObject->SetDirectReceive(TRUE);
+   }
 
    //Open Serial.
-   if(!pclSerialObject->Open())
+   if(!pstContext_->pclSerialObject->Open())
    {
-      MemoryCleanup();
+      MemoryCleanup(pstContext_);
+      if(pstContext_->bDirectDispatch)
+         DSIThread_MutexDestroy(&pstContext_->mutexEventLoop);
+      pstContext_->bDirectDispatch = FALSE;
       return(FALSE);
    }
 
+   if(pstContext_->bDirectDispatch)
+   {
+      pstContext_->bInitialized = TRUE;
+      return(TRUE);
+   }
+
    //Create message thread.
-   UCHAR ucCondInit= DSIThread_CondInit(&condTestDone);
+   UCHAR ucCondInit= DSIThread_CondInit(&pstContext_->condTestDone);
    assert(ucCondInit == DSI_THREAD_ENONE);
 
-   UCHAR ucMutexInit = DSIThread_MutexInit(&mutexTestDone);
+   UCHAR ucMutexInit = DSIThread_MutexInit(&pstContext_->mutexTestDone);
    assert(ucMutexInit == DSI_THREAD_ENONE);
 
-   bGoThread = TRUE;
-   uiDSIThread = DSIThread_CreateThread(MessageThread, NULL);
-   if(!uiDSIThread)
+   pstContext_->bGoThread = TRUE;
+   pstContext_->uiDSIThread = DSIThread_CreateThread(MessageThread, pstContext_);
+   if(!pstContext_->uiDSIThread)
    {
-      MemoryCleanup();
-      bGoThread = FALSE;
+      MemoryCleanup(pstContext_);
+      pstContext_->bGoThread = FALSE;
       return(FALSE);
    }
 
-   bInitialized = TRUE;
+   pstContext_->bInitialized = TRUE;
    return(TRUE);
 
 }
 
+extern "C" EXPORT
+BOOL ANT_InitExt(UCHAR ucUSBDeviceNum, ULONG ulBaudrate, UCHAR ucPortType_, UCHAR ucSerialFrameType_)
+{
+   return ANT_InitExtCtx(&stDefaultContext, ucUSBDeviceNum, ulBaudrate, ucPortType_, ucSerialFrameType_);
+}
+
 ///////////////////////////////////////////////////////////////////////
 // Called by the application to close the usb connection
 // MUST NOT BE CALLED IN THE CONTEXT OF THE MessageThread. That is,
@@ -200,35 +310,58 @@ BOOL ANT_InitExt(UCHAR ucUSBDeviceNum, ULONG ulBaudrate, UCHAR ucPortType_, UCHA
 // callback functions into this library.
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-void ANT_Close(void)
+void ANT_CloseCtx(ANTContext* pstContext_)
 {
    DSI_THREAD_IDNUM eThread = DSIThread_GetCurrentThreadIDNum();
 
-   assert(eTheThread != eThread); // CANNOT CALL THIS FUNCTION FROM DLL THREAD (INSIDE DLL CALLBACK ROUTINES).
+   assert(pstContext_->eTheThread != eThread); // CANNOT CALL THIS FUNCTION FROM DLL THREAD (INSIDE DLL CALLBACK ROUTINES).
 
-   if (!bInitialized)
+   if (!pstContext_->bInitialized)
       return;
 
-   bInitialized = FALSE;
+   pstContext_->bInitialized = FALSE;
+   StopReconnect(pstContext_);
 
-   DSIThread_MutexLock(&mutexTestDone);
-   bGoThread = FALSE;
+   if(pstContext_->bDirectDispatch)
+   {
+      //No message thread to stop, closing the serial stops the receive thread.
+      DSIThread_MutexLock(&pstContext_->mutexEventLoop);
+      pstContext_->bEventLoop = FALSE;
+      DSIThread_MutexUnlock(&pstContext_->mutexEventLoop);
+      MemoryCleanup(pstContext_);
+      DSIThread_MutexDestroy(&pstContext_->mutexEventLoop);
+      pstContext_->bDirectDispatch = FALSE;
+#if defined(DEBUG_FILE)
+      DSIDebug::Close();
+#endif
+      return;
+   }
+
+   DSIThread_MutexLock(&pstContext_->mutexTestDone);
+   pstContext_->bGoThread = FALSE;
+   pstContext_->pclMessageObject->CancelWait();   //Rather than waiting out its WaitForMessage() timeout
 
-   UCHAR ucWaitResult = DSIThread_CondTimedWait(&condTestDone, &mutexTestDone, DSI_THREAD_INFINITE);
+   UCHAR ucWaitResult = DSIThread_CondTimedWait(&pstContext_->condTestDone, &pstContext_->mutexTestDone, DSI_THREAD_INFINITE);
    assert(ucWaitResult == DSI_THREAD_ENONE);
-   DSIThread_MutexUnlock(&mutexTestDone);
+   DSIThread_MutexUnlock(&pstContext_->mutexTestDone);
 
    //Destroy mutex and condition var
-   DSIThread_MutexDestroy(&mutexTestDone);
-   DSIThread_CondDestroy(&condTestDone);
+   DSIThread_MutexDestroy(&pstContext_->mutexTestDone);
+   DSIThread_CondDestroy(&pstContext_->condTestDone);
 
-   MemoryCleanup();
+   MemoryCleanup(pstContext_);
 
 #if defined(DEBUG_FILE)
    DSIDebug::Close();
 #endif
 }
 
+extern "C" EXPORT
+void ANT_Close(void)
+{
+   ANT_CloseCtx(&stDefaultContext);
+}
+
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
@@ -236,11 +369,17 @@ void ANT_Close(void)
 // the main callback funcation must be initialized before the application
 // can receive any reponse messages.
 ///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+void ANT_AssignResponseFunctionCtx(ANTContext* pstContext_, RESPONSE_FUNC pfResponse_, UCHAR* pucResponseBuffer_)
+{
+   pstContext_->pfResponseFunc = pfResponse_;
+   pstContext_->pucResponseBuffer = pucResponseBuffer_;
+}
+
 extern "C" EXPORT
 void ANT_AssignResponseFunction(RESPONSE_FUNC pfResponse_, UCHAR* pucResponseBuffer_)
 {
-   pfResponseFunc = pfResponse_;
-   pucResponseBuffer = pucResponseBuffer_;
+   ANT_AssignResponseFunctionCtx(&stDefaultContext, pfResponse_, pucResponseBuffer_);
 }
 
 
@@ -251,14 +390,126 @@ void ANT_AssignResponseFunction(RESPONSE_FUNC pfResponse_, UCHAR* pucResponseBuf
 // data buffers for a particular channel.  This must be done in order
 // for a channel to function properly.
 ///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+void ANT_AssignChannelEventFunctionCtx(ANTContext* pstContext_, UCHAR ucLink, CHANNEL_EVENT_FUNC pfLinkEvent, UCHAR *pucRxBuffer)
+{
+   if(ucLink < MAX_CHANNELS)
+   {
+      pstContext_->sLink[ucLink].pfLinkEvent = pfLinkEvent;
+      pstContext_->sLink[ucLink].pucRxBuffer = pucRxBuffer;
+   }
+}
+
 extern "C" EXPORT
 void ANT_AssignChannelEventFunction(UCHAR ucLink, CHANNEL_EVENT_FUNC pfLinkEvent, UCHAR *pucRxBuffer)
+{
+   ANT_AssignChannelEventFunctionCtx(&stDefaultContext, ucLink, pfLinkEvent, pucRxBuffer);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Like ANT_AssignResponseFunction, but the callback is handed the
+// message where the framer received it instead of a copy, with the
+// context pointer given here.  Used instead of a response function
+// while assigned, NULL goes back to it.
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+void ANT_AssignResponseCallbackCtx(ANTContext* pstContext_, RESPONSE_CALLBACK pfResponse_, void* pvContext_)
+{
+   pstContext_->pfResponseCallback = pfResponse_;
+   pstContext_->pvResponseContext = pvContext_;
+}
+
+extern "C" EXPORT
+void ANT_AssignResponseCallback(RESPONSE_CALLBACK pfResponse_, void* pvContext_)
+{
+   ANT_AssignResponseCallbackCtx(&stDefaultContext, pfResponse_, pvContext_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Like ANT_AssignChannelEventFunction, without a receive buffer, see
+// ANT_AssignResponseCallback.  Each channel has its own context.
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+void ANT_AssignChannelEventCallbackCtx(ANTContext* pstContext_, UCHAR ucLink, CHANNEL_EVENT_CALLBACK pfLinkEvent, void* pvContext)
 {
    if(ucLink < MAX_CHANNELS)
    {
-      sLink[ucLink].pfLinkEvent = pfLinkEvent;
-      sLink[ucLink].pucRxBuffer = pucRxBuffer;
+      pstContext_->sLink[ucLink].pfLinkCallback = pfLinkEvent;
+      pstContext_->sLink[ucLink].pvLinkContext = pvContext;
+   }
+}
+
+extern "C" EXPORT
+void ANT_AssignChannelEventCallback(UCHAR ucLink, CHANNEL_EVENT_CALLBACK pfLinkEvent, void* pvContext)
+{
+   ANT_AssignChannelEventCallbackCtx(&stDefaultContext, ucLink, pfLinkEvent, pvContext);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Once assigned, a stick that goes away (unplugged, or its USB reads
+// fail) is closed and opened again by a thread of the context's own, as
+// soon as the serial layer sees a device arrive, and at least once every
+// RECONNECT_POLL_MS.  pfStick_ is called from that thread with
+// ANT_STICK_GONE before the port is closed, so the application can stop
+// writing, and with ANT_STICK_BACK once it is open again.  The stick
+// comes back reset: the application sets its channels up again from the
+// ANT_STICK_BACK call, where it may wait for responses.
+// Only valid after ANT_InitExt().  NULL stops reconnecting.
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_AssignStickCallbackCtx(ANTContext* pstContext_, STICK_CALLBACK pfStick_, void* pvContext_)
+{
+   if(!pstContext_->bInitialized)
+      return(FALSE);
+
+   if(pfStick_ == NULL)
+   {
+      StopReconnect(pstContext_);
+      pstContext_->pfStickCallback = NULL;
+      pstContext_->pvStickContext = NULL;
+      return(TRUE);
+   }
+
+   pstContext_->pfStickCallback = pfStick_;
+   pstContext_->pvStickContext = pvContext_;
+   if(pstContext_->uiReconnectThread)
+      return(TRUE);
+
+   if(DSIThread_MutexInit(&pstContext_->mutexReconnect) != DSI_THREAD_ENONE)
+      return(FALSE);
+   if(DSIThread_CondInit(&pstContext_->condReconnect) != DSI_THREAD_ENONE)
+   {
+      DSIThread_MutexDestroy(&pstContext_->mutexReconnect);
+      return(FALSE);
+   }
+
+   pstContext_->bStickGone = FALSE;
+   pstContext_->bGoReconnect = TRUE;
+   pstContext_->bReconnectRunning = TRUE;
+   pstContext_->uiReconnectThread = DSIThread_CreateThread(ReconnectThread, pstContext_);
+   if(!pstContext_->uiReconnectThread)
+   {
+      pstContext_->bGoReconnect = FALSE;
+      pstContext_->bReconnectRunning = FALSE;
+      DSIThread_CondDestroy(&pstContext_->condReconnect);
+      DSIThread_MutexDestroy(&pstContext_->mutexReconnect);
+      return(FALSE);
    }
+
+   pstContext_->pclMessageObject->SetErrorCallback(SerialError, pstContext_);
+   return(TRUE);
+}
+
+extern "C" EXPORT
+BOOL ANT_AssignStickCallback(STICK_CALLBACK pfStick_, void* pvContext_)
+{
+   return ANT_AssignStickCallbackCtx(&stDefaultContext, pfStick_, pvContext_);
 }
 
 ///////////////////////////////////////////////////////////////////////
@@ -268,15 +519,27 @@ void ANT_AssignChannelEventFunction(UCHAR ucLink, CHANNEL_EVENT_FUNC pfLinkEvent
 // higher layer applications to avoid this library calling invalid pointers
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-void ANT_UnassignAllResponseFunctions()
+void ANT_UnassignAllResponseFunctionsCtx(ANTContext* pstContext_)
 {
-   pfResponseFunc = NULL;
-   pucResponseBuffer = NULL;
+   pstContext_->pfResponseFunc = NULL;
+   pstContext_->pucResponseBuffer = NULL;
+   pstContext_->pfResponseCallback = NULL;
+   pstContext_->pvResponseContext = NULL;
    for(int i=0; i< MAX_CHANNELS; ++i)
    {
-      sLink[i].pfLinkEvent = NULL;
-      sLink[i].pucRxBuffer = NULL;
+      pstContext_->sLink[i].pfLinkEvent = NULL;
+      pstContext_->sLink[i].pucRxBuffer = NULL;
+      pstContext_->sLink[i].pfLinkCallback = NULL;
+      pstContext_->sLink[i].pvLinkContext = NULL;
    }
+   pstContext_->pfStickCallback = NULL;   //still reconnects until ANT_CloseCtx(pstContext_)
+   pstContext_->pvStickContext = NULL;
+}
+
+extern "C" EXPORT
+void ANT_UnassignAllResponseFunctions()
+{
+   ANT_UnassignAllResponseFunctionsCtx(&stDefaultContext);
 }
 
 
@@ -299,14 +562,20 @@ const char* ANT_LibVersion(void)
 // Called by the application to restart ANT on the module
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_ResetSystem(void)
+BOOL ANT_ResetSystemCtx(ANTContext* pstContext_)
 {
-   if(pclMessageObject)
-      return(pclMessageObject->ResetSystem());
+   if(pstContext_->pclMessageObject)
+      return(pstContext_->pclMessageObject->ResetSystem());
 
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_ResetSystem(void)
+{
+   return ANT_ResetSystemCtx(&stDefaultContext);
+}
+
 
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
@@ -315,75 +584,111 @@ BOOL ANT_ResetSystem(void)
 // module channel
 //!! This is (should be) a private network function
 ///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_SetNetworkKeyCtx(ANTContext* pstContext_, UCHAR ucNetNumber, UCHAR *pucKey)
+{
+   return ANT_SetNetworkKeyCtx_RTO(pstContext_, ucNetNumber, pucKey, 0);
+}
+
 extern "C" EXPORT
 BOOL ANT_SetNetworkKey(UCHAR ucNetNumber, UCHAR *pucKey)
 {
-   return ANT_SetNetworkKey_RTO(ucNetNumber, pucKey, 0);
+   return ANT_SetNetworkKeyCtx(&stDefaultContext, ucNetNumber, pucKey);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SetNetworkKey_RTO(UCHAR ucNetNumber, UCHAR *pucKey, ULONG ulResponseTime_)
+BOOL ANT_SetNetworkKeyCtx_RTO(ANTContext* pstContext_, UCHAR ucNetNumber, UCHAR *pucKey, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->SetNetworkKey(ucNetNumber, pucKey, ulResponseTime_));
+      return(pstContext_->pclMessageObject->SetNetworkKey(ucNetNumber, pucKey, ulResponseTime_));
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_SetNetworkKey_RTO(UCHAR ucNetNumber, UCHAR *pucKey, ULONG ulResponseTime_)
+{
+   return ANT_SetNetworkKeyCtx_RTO(&stDefaultContext, ucNetNumber, pucKey, ulResponseTime_);
+}
+
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
 // Called by the application to assign a channel
 ///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_AssignChannelCtx(ANTContext* pstContext_, UCHAR ucANTChannel, UCHAR ucChannelType_, UCHAR ucNetNumber)
+{
+   return ANT_AssignChannelCtx_RTO(pstContext_, ucANTChannel, ucChannelType_, ucNetNumber, 0);
+}
+
 extern "C" EXPORT
 BOOL ANT_AssignChannel(UCHAR ucANTChannel, UCHAR ucChannelType_, UCHAR ucNetNumber)
 {
-   return ANT_AssignChannel_RTO(ucANTChannel, ucChannelType_, ucNetNumber, 0);
+   return ANT_AssignChannelCtx(&stDefaultContext, ucANTChannel, ucChannelType_, ucNetNumber);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_AssignChannel_RTO(UCHAR ucANTChannel, UCHAR ucChannelType_, UCHAR ucNetNumber, ULONG ulResponseTime_)
+BOOL ANT_AssignChannelCtx_RTO(ANTContext* pstContext_, UCHAR ucANTChannel, UCHAR ucChannelType_, UCHAR ucNetNumber, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->AssignChannel(ucANTChannel, ucChannelType_, ucNetNumber, ulResponseTime_));
+      return(pstContext_->pclMessageObject->AssignChannel(ucANTChannel, ucChannelType_, ucNetNumber, ulResponseTime_));
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_AssignChannel_RTO(UCHAR ucANTChannel, UCHAR ucChannelType_, UCHAR ucNetNumber, ULONG ulResponseTime_)
+{
+   return ANT_AssignChannelCtx_RTO(&stDefaultContext, ucANTChannel, ucChannelType_, ucNetNumber, ulResponseTime_);
+}
+
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
 // Called by the application to assign a channel using extended assignment
 ///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_AssignChannelExtCtx(ANTContext* pstContext_, UCHAR ucANTChannel, UCHAR ucChannelType_, UCHAR ucNetNumber, UCHAR ucExtFlags_)
+{
+   return ANT_AssignChannelExtCtx_RTO(pstContext_, ucANTChannel, ucChannelType_, ucNetNumber, ucExtFlags_, 0);
+}
+
 extern "C" EXPORT
 BOOL ANT_AssignChannelExt(UCHAR ucANTChannel, UCHAR ucChannelType_, UCHAR ucNetNumber, UCHAR ucExtFlags_)
 {
-   return ANT_AssignChannelExt_RTO(ucANTChannel, ucChannelType_, ucNetNumber, ucExtFlags_, 0);
+   return ANT_AssignChannelExtCtx(&stDefaultContext, ucANTChannel, ucChannelType_, ucNetNumber, ucExtFlags_);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_AssignChannelExt_RTO(UCHAR ucANTChannel, UCHAR ucChannelType_, UCHAR ucNetNumber, UCHAR ucExtFlags_, ULONG ulResponseTime_)
+BOOL ANT_AssignChannelExtCtx_RTO(ANTContext* pstContext_, UCHAR ucANTChannel, UCHAR ucChannelType_, UCHAR ucNetNumber, UCHAR ucExtFlags_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
       UCHAR aucChannelType[] = {ucChannelType_, ucExtFlags_};  // Channel Type + Extended Assignment Byte
 
-      return(pclMessageObject->AssignChannelExt(ucANTChannel, aucChannelType, 2, ucNetNumber, ulResponseTime_));
+      return(pstContext_->pclMessageObject->AssignChannelExt(ucANTChannel, aucChannelType, 2, ucNetNumber, ulResponseTime_));
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_AssignChannelExt_RTO(UCHAR ucANTChannel, UCHAR ucChannelType_, UCHAR ucNetNumber, UCHAR ucExtFlags_, ULONG ulResponseTime_)
+{
+   return ANT_AssignChannelExtCtx_RTO(&stDefaultContext, ucANTChannel, ucChannelType_, ucNetNumber, ucExtFlags_, ulResponseTime_);
+}
+
 
 
 ///////////////////////////////////////////////////////////////////////
@@ -391,25 +696,37 @@ BOOL ANT_AssignChannelExt_RTO(UCHAR ucANTChannel, UCHAR ucChannelType_, UCHAR uc
 //
 // Called by the application to unassign a channel
 ///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_UnAssignChannelCtx(ANTContext* pstContext_, UCHAR ucANTChannel)
+{
+   return ANT_UnAssignChannelCtx_RTO(pstContext_, ucANTChannel, 0);
+}
+
 extern "C" EXPORT
 BOOL ANT_UnAssignChannel(UCHAR ucANTChannel)
 {
-   return ANT_UnAssignChannel_RTO(ucANTChannel, 0);
+   return ANT_UnAssignChannelCtx(&stDefaultContext, ucANTChannel);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_UnAssignChannel_RTO(UCHAR ucANTChannel, ULONG ulResponseTime_)
+BOOL ANT_UnAssignChannelCtx_RTO(ANTContext* pstContext_, UCHAR ucANTChannel, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->UnAssignChannel(ucANTChannel, ulResponseTime_));
+      return(pstContext_->pclMessageObject->UnAssignChannel(ucANTChannel, ulResponseTime_));
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_UnAssignChannel_RTO(UCHAR ucANTChannel, ULONG ulResponseTime_)
+{
+   return ANT_UnAssignChannelCtx_RTO(&stDefaultContext, ucANTChannel, ulResponseTime_);
+}
+
 
 
 ///////////////////////////////////////////////////////////////////////
@@ -417,100 +734,148 @@ BOOL ANT_UnAssignChannel_RTO(UCHAR ucANTChannel, ULONG ulResponseTime_)
 //
 // Called by the application to set the channel ID
 ///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_SetChannelIdCtx(ANTContext* pstContext_, UCHAR ucANTChannel_, USHORT usDeviceNumber_, UCHAR ucDeviceType_, UCHAR ucTransmissionType_)
+{
+   return ANT_SetChannelIdCtx_RTO(pstContext_, ucANTChannel_, usDeviceNumber_, ucDeviceType_, ucTransmissionType_, 0);
+}
+
 extern "C" EXPORT
 BOOL ANT_SetChannelId(UCHAR ucANTChannel_, USHORT usDeviceNumber_, UCHAR ucDeviceType_, UCHAR ucTransmissionType_)
 {
-   return ANT_SetChannelId_RTO(ucANTChannel_, usDeviceNumber_, ucDeviceType_, ucTransmissionType_, 0);
+   return ANT_SetChannelIdCtx(&stDefaultContext, ucANTChannel_, usDeviceNumber_, ucDeviceType_, ucTransmissionType_);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SetChannelId_RTO(UCHAR ucANTChannel_, USHORT usDeviceNumber_, UCHAR ucDeviceType_, UCHAR ucTransmissionType_, ULONG ulResponseTime_)
+BOOL ANT_SetChannelIdCtx_RTO(ANTContext* pstContext_, UCHAR ucANTChannel_, USHORT usDeviceNumber_, UCHAR ucDeviceType_, UCHAR ucTransmissionType_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->SetChannelID(ucANTChannel_, usDeviceNumber_, ucDeviceType_, ucTransmissionType_, ulResponseTime_));
+      return(pstContext_->pclMessageObject->SetChannelID(ucANTChannel_, usDeviceNumber_, ucDeviceType_, ucTransmissionType_, ulResponseTime_));
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_SetChannelId_RTO(UCHAR ucANTChannel_, USHORT usDeviceNumber_, UCHAR ucDeviceType_, UCHAR ucTransmissionType_, ULONG ulResponseTime_)
+{
+   return ANT_SetChannelIdCtx_RTO(&stDefaultContext, ucANTChannel_, usDeviceNumber_, ucDeviceType_, ucTransmissionType_, ulResponseTime_);
+}
+
 
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
 // Called by the application to set the messaging period
 ///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_SetChannelPeriodCtx(ANTContext* pstContext_, UCHAR ucANTChannel_, USHORT usMesgPeriod_)
+{
+   return ANT_SetChannelPeriodCtx_RTO(pstContext_, ucANTChannel_, usMesgPeriod_, 0);
+}
+
 extern "C" EXPORT
 BOOL ANT_SetChannelPeriod(UCHAR ucANTChannel_, USHORT usMesgPeriod_)
 {
-   return ANT_SetChannelPeriod_RTO(ucANTChannel_, usMesgPeriod_, 0);
+   return ANT_SetChannelPeriodCtx(&stDefaultContext, ucANTChannel_, usMesgPeriod_);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SetChannelPeriod_RTO(UCHAR ucANTChannel_, USHORT usMesgPeriod_, ULONG ulResponseTime_)
+BOOL ANT_SetChannelPeriodCtx_RTO(ANTContext* pstContext_, UCHAR ucANTChannel_, USHORT usMesgPeriod_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->SetChannelPeriod(ucANTChannel_, usMesgPeriod_, ulResponseTime_));
+      return(pstContext_->pclMessageObject->SetChannelPeriod(ucANTChannel_, usMesgPeriod_, ulResponseTime_));
    }
    return(FALSE);
 
 }
 
+extern "C" EXPORT
+BOOL ANT_SetChannelPeriod_RTO(UCHAR ucANTChannel_, USHORT usMesgPeriod_, ULONG ulResponseTime_)
+{
+   return ANT_SetChannelPeriodCtx_RTO(&stDefaultContext, ucANTChannel_, usMesgPeriod_, ulResponseTime_);
+}
+
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
 // Called by the application to set the messaging period
 ///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_RSSI_SetSearchThresholdCtx(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR ucThreshold_)
+{
+   return ANT_RSSI_SetSearchThresholdCtx_RTO(pstContext_, ucANTChannel_, ucThreshold_, 0);
+}
+
 extern "C" EXPORT
 BOOL ANT_RSSI_SetSearchThreshold(UCHAR ucANTChannel_, UCHAR ucThreshold_)
 {
-   return ANT_RSSI_SetSearchThreshold_RTO(ucANTChannel_, ucThreshold_, 0);
+   return ANT_RSSI_SetSearchThresholdCtx(&stDefaultContext, ucANTChannel_, ucThreshold_);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_RSSI_SetSearchThreshold_RTO(UCHAR ucANTChannel_, UCHAR ucThreshold_, ULONG ulResponseTime_)
+BOOL ANT_RSSI_SetSearchThresholdCtx_RTO(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR ucThreshold_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->SetRSSISearchThreshold(ucANTChannel_, ucThreshold_, ulResponseTime_));
+      return(pstContext_->pclMessageObject->SetRSSISearchThreshold(ucANTChannel_, ucThreshold_, ulResponseTime_));
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_RSSI_SetSearchThreshold_RTO(UCHAR ucANTChannel_, UCHAR ucThreshold_, ULONG ulResponseTime_)
+{
+   return ANT_RSSI_SetSearchThresholdCtx_RTO(&stDefaultContext, ucANTChannel_, ucThreshold_, ulResponseTime_);
+}
+
 
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
 // Used to set Low Priority Search Timeout. Not available on AP1
 ///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_SetLowPriorityChannelSearchTimeoutCtx(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR ucSearchTimeout_)
+{
+   return ANT_SetLowPriorityChannelSearchTimeoutCtx_RTO(pstContext_, ucANTChannel_, ucSearchTimeout_, 0);
+}
+
 extern "C" EXPORT
 BOOL ANT_SetLowPriorityChannelSearchTimeout(UCHAR ucANTChannel_, UCHAR ucSearchTimeout_)
 {
-   return ANT_SetLowPriorityChannelSearchTimeout_RTO(ucANTChannel_, ucSearchTimeout_, 0);
+   return ANT_SetLowPriorityChannelSearchTimeoutCtx(&stDefaultContext, ucANTChannel_, ucSearchTimeout_);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SetLowPriorityChannelSearchTimeout_RTO(UCHAR ucANTChannel_, UCHAR ucSearchTimeout_, ULONG ulResponseTime_)
+BOOL ANT_SetLowPriorityChannelSearchTimeoutCtx_RTO(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR ucSearchTimeout_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->SetLowPriorityChannelSearchTimeout(ucANTChannel_, ucSearchTimeout_, ulResponseTime_));
+      return(pstContext_->pclMessageObject->SetLowPriorityChannelSearchTimeout(ucANTChannel_, ucSearchTimeout_, ulResponseTime_));
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_SetLowPriorityChannelSearchTimeout_RTO(UCHAR ucANTChannel_, UCHAR ucSearchTimeout_, ULONG ulResponseTime_)
+{
+   return ANT_SetLowPriorityChannelSearchTimeoutCtx_RTO(&stDefaultContext, ucANTChannel_, ucSearchTimeout_, ulResponseTime_);
+}
+
 
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
@@ -518,25 +883,37 @@ BOOL ANT_SetLowPriorityChannelSearchTimeout_RTO(UCHAR ucANTChannel_, UCHAR ucSea
 // Called by the application to set the search timeout for a particular
 // channel on the module
 ///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_SetChannelSearchTimeoutCtx(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR ucSearchTimeout_)
+{
+   return ANT_SetChannelSearchTimeoutCtx_RTO(pstContext_, ucANTChannel_, ucSearchTimeout_, 0);
+}
+
 extern "C" EXPORT
 BOOL ANT_SetChannelSearchTimeout(UCHAR ucANTChannel_, UCHAR ucSearchTimeout_)
 {
-   return ANT_SetChannelSearchTimeout_RTO(ucANTChannel_, ucSearchTimeout_, 0);
+   return ANT_SetChannelSearchTimeoutCtx(&stDefaultContext, ucANTChannel_, ucSearchTimeout_);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SetChannelSearchTimeout_RTO(UCHAR ucANTChannel_, UCHAR ucSearchTimeout_, ULONG ulResponseTime_)
+BOOL ANT_SetChannelSearchTimeoutCtx_RTO(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR ucSearchTimeout_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->SetChannelSearchTimeout(ucANTChannel_, ucSearchTimeout_, ulResponseTime_));
+      return(pstContext_->pclMessageObject->SetChannelSearchTimeout(ucANTChannel_, ucSearchTimeout_, ulResponseTime_));
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_SetChannelSearchTimeout_RTO(UCHAR ucANTChannel_, UCHAR ucSearchTimeout_, ULONG ulResponseTime_)
+{
+   return ANT_SetChannelSearchTimeoutCtx_RTO(&stDefaultContext, ucANTChannel_, ucSearchTimeout_, ulResponseTime_);
+}
+
 
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
@@ -544,1346 +921,2619 @@ BOOL ANT_SetChannelSearchTimeout_RTO(UCHAR ucANTChannel_, UCHAR ucSearchTimeout_
 // Called by the application to set the RF frequency for a given channel
 //!! This is (should be) a private network function
 ///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_SetChannelRFFreqCtx(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR ucRFFreq_)
+{
+   return ANT_SetChannelRFFreqCtx_RTO(pstContext_, ucANTChannel_, ucRFFreq_, 0);
+}
+
 extern "C" EXPORT
 BOOL ANT_SetChannelRFFreq(UCHAR ucANTChannel_, UCHAR ucRFFreq_)
 {
-   return ANT_SetChannelRFFreq_RTO(ucANTChannel_, ucRFFreq_, 0);
+   return ANT_SetChannelRFFreqCtx(&stDefaultContext, ucANTChannel_, ucRFFreq_);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SetChannelRFFreq_RTO(UCHAR ucANTChannel_, UCHAR ucRFFreq_, ULONG ulResponseTime_)
+BOOL ANT_SetChannelRFFreqCtx_RTO(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR ucRFFreq_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->SetChannelRFFrequency(ucANTChannel_, ucRFFreq_, ulResponseTime_));
+      return(pstContext_->pclMessageObject->SetChannelRFFrequency(ucANTChannel_, ucRFFreq_, ulResponseTime_));
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_SetChannelRFFreq_RTO(UCHAR ucANTChannel_, UCHAR ucRFFreq_, ULONG ulResponseTime_)
+{
+   return ANT_SetChannelRFFreqCtx_RTO(&stDefaultContext, ucANTChannel_, ucRFFreq_, ulResponseTime_);
+}
+
 
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
 // Called by the application to set the transmit power for the module
 ///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_SetTransmitPowerCtx(ANTContext* pstContext_, UCHAR ucTransmitPower_)
+{
+   return ANT_SetTransmitPowerCtx_RTO(pstContext_, ucTransmitPower_, 0);
+}
+
 extern "C" EXPORT
 BOOL ANT_SetTransmitPower(UCHAR ucTransmitPower_)
 {
-   return ANT_SetTransmitPower_RTO(ucTransmitPower_, 0);
+   return ANT_SetTransmitPowerCtx(&stDefaultContext, ucTransmitPower_);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SetTransmitPower_RTO(UCHAR ucTransmitPower_, ULONG ulResponseTime_)
+BOOL ANT_SetTransmitPowerCtx_RTO(ANTContext* pstContext_, UCHAR ucTransmitPower_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->SetAllChannelsTransmitPower(ucTransmitPower_, ulResponseTime_));
+      return(pstContext_->pclMessageObject->SetAllChannelsTransmitPower(ucTransmitPower_, ulResponseTime_));
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_SetTransmitPower_RTO(UCHAR ucTransmitPower_, ULONG ulResponseTime_)
+{
+   return ANT_SetTransmitPowerCtx_RTO(&stDefaultContext, ucTransmitPower_, ulResponseTime_);
+}
+
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
 // Called by the application to configure advanced bursting
 ///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_ConfigureAdvancedBurstCtx(ANTContext* pstContext_, BOOL bEnable_, UCHAR ucMaxPacketLength_, ULONG ulRequiredFields_, ULONG ulOptionalFields_)
+{
+   return ANT_ConfigureAdvancedBurstCtx_RTO(pstContext_, bEnable_, ucMaxPacketLength_, ulRequiredFields_, ulOptionalFields_, 0);
+}
+
 extern "C" EXPORT
 BOOL ANT_ConfigureAdvancedBurst(BOOL bEnable_, UCHAR ucMaxPacketLength_, ULONG ulRequiredFields_, ULONG ulOptionalFields_)
 {
-   return ANT_ConfigureAdvancedBurst_RTO(bEnable_, ucMaxPacketLength_, ulRequiredFields_, ulOptionalFields_, 0);
+   return ANT_ConfigureAdvancedBurstCtx(&stDefaultContext, bEnable_, ucMaxPacketLength_, ulRequiredFields_, ulOptionalFields_);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_ConfigureAdvancedBurst_RTO(BOOL bEnable_, UCHAR ucMaxPacketLength_, ULONG ulRequiredFields_, ULONG ulOptionalFields_, ULONG ulResponseTime_)
+BOOL ANT_ConfigureAdvancedBurstCtx_RTO(ANTContext* pstContext_, BOOL bEnable_, UCHAR ucMaxPacketLength_, ULONG ulRequiredFields_, ULONG ulOptionalFields_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->ConfigAdvancedBurst(bEnable_, ucMaxPacketLength_, ulRequiredFields_, ulOptionalFields_, ulResponseTime_));
+      return(pstContext_->pclMessageObject->ConfigAdvancedBurst(bEnable_, ucMaxPacketLength_, ulRequiredFields_, ulOptionalFields_, ulResponseTime_));
    }
    return(FALSE);
 }
 
-///////////////////////////////////////////////////////////////////////
-// Stall count version
-///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_ConfigureAdvancedBurst_ext(BOOL bEnable_, UCHAR ucMaxPacketLength_, ULONG ulRequiredFields_, ULONG ulOptionalFields_, USHORT usStallCount_, UCHAR ucRetryCount_)
+BOOL ANT_ConfigureAdvancedBurst_RTO(BOOL bEnable_, UCHAR ucMaxPacketLength_, ULONG ulRequiredFields_, ULONG ulOptionalFields_, ULONG ulResponseTime_)
 {
-   return ANT_ConfigureAdvancedBurst_ext_RTO(bEnable_, ucMaxPacketLength_, ulRequiredFields_, ulOptionalFields_, usStallCount_, ucRetryCount_, 0);
+   return ANT_ConfigureAdvancedBurstCtx_RTO(&stDefaultContext, bEnable_, ucMaxPacketLength_, ulRequiredFields_, ulOptionalFields_, ulResponseTime_);
 }
 
 ///////////////////////////////////////////////////////////////////////
-// Stall count version with response timeout
+// Stall count version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_ConfigureAdvancedBurst_ext_RTO(BOOL bEnable_, UCHAR ucMaxPacketLength_, ULONG ulRequiredFields_, ULONG ulOptionalFields_, USHORT usStallCount_, UCHAR ucRetryCount_, ULONG ulResponseTime_)
+BOOL ANT_ConfigureAdvancedBurst_extCtx(ANTContext* pstContext_, BOOL bEnable_, UCHAR ucMaxPacketLength_, ULONG ulRequiredFields_, ULONG ulOptionalFields_, USHORT usStallCount_, UCHAR ucRetryCount_)
+{
+   return ANT_ConfigureAdvancedBurst_extCtx_RTO(pstContext_, bEnable_, ucMaxPacketLength_, ulRequiredFields_, ulOptionalFields_, usStallCount_, ucRetryCount_, 0);
+}
+
+extern "C" EXPORT
+BOOL ANT_ConfigureAdvancedBurst_ext(BOOL bEnable_, UCHAR ucMaxPacketLength_, ULONG ulRequiredFields_, ULONG ulOptionalFields_, USHORT usStallCount_, UCHAR ucRetryCount_)
+{
+   return ANT_ConfigureAdvancedBurst_extCtx(&stDefaultContext, bEnable_, ucMaxPacketLength_, ulRequiredFields_, ulOptionalFields_, usStallCount_, ucRetryCount_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Stall count version with response timeout
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_ConfigureAdvancedBurst_extCtx_RTO(ANTContext* pstContext_, BOOL bEnable_, UCHAR ucMaxPacketLength_, ULONG ulRequiredFields_, ULONG ulOptionalFields_, USHORT usStallCount_, UCHAR ucRetryCount_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->ConfigAdvancedBurst_ext(bEnable_, ucMaxPacketLength_, ulRequiredFields_, ulOptionalFields_, usStallCount_, ucRetryCount_, ulResponseTime_));
+      return(pstContext_->pclMessageObject->ConfigAdvancedBurst_ext(bEnable_, ucMaxPacketLength_, ulRequiredFields_, ulOptionalFields_, usStallCount_, ucRetryCount_, ulResponseTime_));
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_ConfigureAdvancedBurst_ext_RTO(BOOL bEnable_, UCHAR ucMaxPacketLength_, ULONG ulRequiredFields_, ULONG ulOptionalFields_, USHORT usStallCount_, UCHAR ucRetryCount_, ULONG ulResponseTime_)
+{
+   return ANT_ConfigureAdvancedBurst_extCtx_RTO(&stDefaultContext, bEnable_, ucMaxPacketLength_, ulRequiredFields_, ulOptionalFields_, usStallCount_, ucRetryCount_, ulResponseTime_);
+}
+
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
 // Called by the application to set the transmit power for the module
 ///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_SetChannelTxPowerCtx(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR ucTransmitPower_)
+{
+   return ANT_SetChannelTxPowerCtx_RTO(pstContext_, ucANTChannel_, ucTransmitPower_, 0);
+}
+
 extern "C" EXPORT
 BOOL ANT_SetChannelTxPower(UCHAR ucANTChannel_, UCHAR ucTransmitPower_)
 {
-   return ANT_SetChannelTxPower_RTO(ucANTChannel_, ucTransmitPower_, 0);
+   return ANT_SetChannelTxPowerCtx(&stDefaultContext, ucANTChannel_, ucTransmitPower_);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SetChannelTxPower_RTO(UCHAR ucANTChannel_, UCHAR ucTransmitPower_, ULONG ulResponseTime_)
+BOOL ANT_SetChannelTxPowerCtx_RTO(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR ucTransmitPower_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->SetChannelTransmitPower(ucANTChannel_, ucTransmitPower_, ulResponseTime_));
+      return(pstContext_->pclMessageObject->SetChannelTransmitPower(ucANTChannel_, ucTransmitPower_, ulResponseTime_));
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_SetChannelTxPower_RTO(UCHAR ucANTChannel_, UCHAR ucTransmitPower_, ULONG ulResponseTime_)
+{
+   return ANT_SetChannelTxPowerCtx_RTO(&stDefaultContext, ucANTChannel_, ucTransmitPower_, ulResponseTime_);
+}
+
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
 // Called by the application to request a generic message
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_RequestMessage(UCHAR ucANTChannel_, UCHAR ucMessageID_)
+BOOL ANT_RequestMessageCtx(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR ucMessageID_)
 {
-   if(pclMessageObject){
+   if(pstContext_->pclMessageObject){
       ANT_MESSAGE_ITEM stResponse;
-      return pclMessageObject->SendRequest(ucMessageID_, ucANTChannel_, &stResponse, 0);
+      return pstContext_->pclMessageObject->SendRequest(ucMessageID_, ucANTChannel_, &stResponse, 0);
    }
    return FALSE;
 }
 
+extern "C" EXPORT
+BOOL ANT_RequestMessage(UCHAR ucANTChannel_, UCHAR ucMessageID_)
+{
+   return ANT_RequestMessageCtx(&stDefaultContext, ucANTChannel_, ucMessageID_);
+}
+
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
 // Called by the application to send a generic message
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_WriteMessage(UCHAR ucMessageID, UCHAR* aucData, USHORT usMessageSize)
+BOOL ANT_WriteMessageCtx(ANTContext* pstContext_, UCHAR ucMessageID, UCHAR* aucData, USHORT usMessageSize)
 {
-   if(pclMessageObject){
+   if(pstContext_->pclMessageObject){
       ANT_MESSAGE pstTempANTMessage;
       pstTempANTMessage.ucMessageID = ucMessageID;
       memcpy(pstTempANTMessage.aucData, aucData, MIN(usMessageSize, MESG_MAX_SIZE_VALUE));
-      return pclMessageObject->WriteMessage(&pstTempANTMessage, usMessageSize);
+      return pstContext_->pclMessageObject->WriteMessage(&pstTempANTMessage, usMessageSize);
    }
    return FALSE;
 }
 
-///////////////////////////////////////////////////////////////////////
-// Priority: Any
-//
-// Called by the application to open an assigned channel
-///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_OpenChannel(UCHAR ucANTChannel_)
+BOOL ANT_WriteMessage(UCHAR ucMessageID, UCHAR* aucData, USHORT usMessageSize)
 {
-   return ANT_OpenChannel_RTO(ucANTChannel_, 0);
+   return ANT_WriteMessageCtx(&stDefaultContext, ucMessageID, aucData, usMessageSize);
 }
 
 ///////////////////////////////////////////////////////////////////////
-// Response TimeOut Version
+// Priority: Any
+//
+// Called by the application to start queueing commands into a group
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_OpenChannel_RTO(UCHAR ucANTChannel_, ULONG ulResponseTime_)
+UCHAR ANT_BeginCommandGroupCtx(ANTContext* pstContext_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->OpenChannel(ucANTChannel_, ulResponseTime_));
+      return(pstContext_->pclMessageObject->BeginCommandGroup());
    }
-   return(FALSE);
+   return(COMMAND_GROUP_NONE);
 }
 
-
-///////////////////////////////////////////////////////////////////////
-// Priority: Any
-//
-// Called by the application to close an opend channel
-///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_CloseChannel(UCHAR ucANTChannel_)
+UCHAR ANT_BeginCommandGroup(void)
 {
-   return ANT_CloseChannel_RTO(ucANTChannel_, 0);
+   return ANT_BeginCommandGroupCtx(&stDefaultContext);
 }
 
 ///////////////////////////////////////////////////////////////////////
-// Response TimeOut Version
+// Priority: Any
+//
+// Called by the application to send the queued commands of a group
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_CloseChannel_RTO(UCHAR ucANTChannel_, ULONG ulResponseTime_)
+BOOL ANT_SubmitCommandGroupCtx(ANTContext* pstContext_, UCHAR ucGroup_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->CloseChannel(ucANTChannel_, ulResponseTime_));
+      return(pstContext_->pclMessageObject->SubmitCommandGroup(ucGroup_));
    }
    return(FALSE);
 }
 
-
+extern "C" EXPORT
+BOOL ANT_SubmitCommandGroup(UCHAR ucGroup_)
+{
+   return ANT_SubmitCommandGroupCtx(&stDefaultContext, ucGroup_);
+}
 
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
-// Called by the application to construct and send a broadcast data message.
-// This message will be broadcast on the next synchronous channel period.
+// Called by the application to poll a submitted group
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SendBroadcastData(UCHAR ucANTChannel_, UCHAR *pucData_)
+BOOL ANT_CommandGroupDoneCtx(ANTContext* pstContext_, UCHAR ucGroup_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->SendBroadcastData(ucANTChannel_, pucData_));
+      return(pstContext_->pclMessageObject->IsCommandGroupDone(ucGroup_));
    }
    return(FALSE);
 }
 
-///////////////////////////////////////////////////////////////////////
-// Priority: Any
-//
-// Called by the application to construct and send an acknowledged data
-// mesg.  This message will be transmitted on the next synchronous channel
-// period.
-///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SendAcknowledgedData(UCHAR ucANTChannel_, UCHAR *pucData_)
+BOOL ANT_CommandGroupDone(UCHAR ucGroup_)
 {
-   return ANT_SendAcknowledgedData_RTO(ucANTChannel_, pucData_, 0);
+   return ANT_CommandGroupDoneCtx(&stDefaultContext, ucGroup_);
 }
 
 ///////////////////////////////////////////////////////////////////////
-// Response TimeOut Version
+// Priority: Any
+//
+// Called by the application to wait for all responses of a group.
+// A wait of 0 never releases it, a poll ends with one that is not.
+// Must not be called from inside the library callbacks.
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SendAcknowledgedData_RTO(UCHAR ucANTChannel_, UCHAR *pucData_, ULONG ulResponseTime_)
+BOOL ANT_WaitCommandGroupCtx(ANTContext* pstContext_, UCHAR ucGroup_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->SendAcknowledgedData( ucANTChannel_, pucData_, ulResponseTime_));
+      return(pstContext_->pclMessageObject->WaitForCommandGroup(ucGroup_, ulResponseTime_) == ANTFRAMER_PASS);
    }
    return(FALSE);
 }
 
-
-///////////////////////////////////////////////////////////////////////
-// Used to send burst data using a block of data.  Proper sequence number
-// of packet is maintained by the function.  Useful for testing purposes.
-///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SendBurstTransfer(UCHAR ucANTChannel_, UCHAR *pucData_, USHORT usNumDataPackets_)
+BOOL ANT_WaitCommandGroup(UCHAR ucGroup_, ULONG ulResponseTime_)
 {
-   return ANT_SendBurstTransfer_RTO(ucANTChannel_, pucData_, usNumDataPackets_, 0);
+   return ANT_WaitCommandGroupCtx(&stDefaultContext, ucGroup_, ulResponseTime_);
 }
 
 ///////////////////////////////////////////////////////////////////////
-// Response TimeOut Version
+// Priority: Any
+//
+// Called by the application to receive on its own thread, see ant.h.
+// Must not be called from inside the library callbacks.
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SendBurstTransfer_RTO(UCHAR ucANTChannel_, UCHAR *pucData_, USHORT usNumDataPackets_, ULONG ulResponseTime_)
+BOOL ANT_EventLoopAttachCtx(ANTContext* pstContext_)
 {
-   ULONG ulSize = usNumDataPackets_*8;   // Pass the number of bytes.
-   ANTFRAMER_RETURN eStatus;
+   BOOL bAttached;
 
-   if(pclMessageObject)
-   {
-      eStatus = pclMessageObject->SendTransfer( ucANTChannel_, pucData_, ulSize, ulResponseTime_);
+   if(!pstContext_->bInitialized || !pstContext_->bDirectDispatch)
+      return(FALSE);
 
-      if( eStatus == ANTFRAMER_PASS )
-         return(TRUE);
-   }
-   return(FALSE);
+   DSIThread_MutexLock(&pstContext_->mutexEventLoop);
+   if(!pstContext_->bEventLoop)
+      pstContext_->bEventLoop = pstContext_->pclSerialObject->SetExternalReceive(TRUE);
+   bAttached = pstContext_->bEventLoop;
+   pstContext_->eTheThread = 0;  //whatever came in during the switch was handled here
+   DSIThread_MutexUnlock(&pstContext_->mutexEventLoop);
+   return(bAttached);
 }
 
-
-
-
-//////////////////////////////////////////////////////////////////////
-// Priority: Any
-//
-// Called by the application to configure and start CW test mode.
-// There is no way to turn off CW mode other than to do a reset on the module.
-/////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_InitCWTestMode(void)
+BOOL ANT_EventLoopAttach(void)
 {
-   return ANT_InitCWTestMode_RTO(0);
+   return ANT_EventLoopAttachCtx(&stDefaultContext);
 }
 
 ///////////////////////////////////////////////////////////////////////
-// Response TimeOut Version
+// Priority: Any
+//
+// The descriptors can change whenever the stick is reopened.
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_InitCWTestMode_RTO(ULONG ulResponseTime_)
+UCHAR ANT_EventLoopGetFdsCtx(ANTContext* pstContext_, ANT_POLLFD* pastFds_, UCHAR ucMax_)
 {
-   if(pclMessageObject)
+   DSI_POLLFD astFds[ANT_EVENT_LOOP_MAX_FDS];
+   UCHAR ucCount = 0;
+
+   if(pastFds_ == NULL || !pstContext_->bInitialized || !pstContext_->bDirectDispatch)
+      return(0);
+
+   if(ucMax_ > ANT_EVENT_LOOP_MAX_FDS)
+      ucMax_ = ANT_EVENT_LOOP_MAX_FDS;
+
+   DSIThread_MutexLock(&pstContext_->mutexEventLoop);
+   if(pstContext_->bEventLoop)
+      ucCount = pstContext_->pclSerialObject->GetPollFds(astFds, ucMax_);
+   DSIThread_MutexUnlock(&pstContext_->mutexEventLoop);
+
+   for(UCHAR i = 0; i < ucCount; i++)
    {
-      return(pclMessageObject->InitCWTestMode(ulResponseTime_));
+      pastFds_[i].iFd = astFds[i].iFd;
+      pastFds_[i].sEvents = astFds[i].sEvents;
    }
-   return(FALSE);
+   return(ucCount);
 }
 
-
-//////////////////////////////////////////////////////////////////////
-// Priority: Any
-//
-// Called by the application to configure and start CW test mode.
-// There is no way to turn off CW mode other than to do a reset on the module.
-/////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SetCWTestMode(UCHAR ucTransmitPower_, UCHAR ucRFChannel_)
+UCHAR ANT_EventLoopGetFds(ANT_POLLFD* pastFds_, UCHAR ucMax_)
 {
-   return ANT_SetCWTestMode_RTO(ucTransmitPower_, ucRFChannel_, 0);
+   return ANT_EventLoopGetFdsCtx(&stDefaultContext, pastFds_, ucMax_);
 }
 
 ///////////////////////////////////////////////////////////////////////
-// Response TimeOut Version
+// Priority: Any
+//
+// Callbacks run from here, on the calling thread.  Does nothing while
+// detached, or while the stick is away.
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SetCWTestMode_RTO(UCHAR ucTransmitPower_, UCHAR ucRFChannel_, ULONG ulResponseTime_)
+void ANT_EventLoopHandleCtx(ANTContext* pstContext_)
 {
-   if(pclMessageObject)
+   if(!pstContext_->bInitialized || !pstContext_->bDirectDispatch)
+      return;
+
+   DSIThread_MutexLock(&pstContext_->mutexEventLoop);
+   if(pstContext_->bEventLoop)
    {
-      return(pclMessageObject->SetCWTestMode(ucTransmitPower_, ucRFChannel_, ulResponseTime_));
+      pstContext_->pclSerialObject->ReceivePoll();
+      pstContext_->eTheThread = 0;  //the application's own thread again
    }
-   return(FALSE);
+   DSIThread_MutexUnlock(&pstContext_->mutexEventLoop);
 }
 
-///////////////////////////////////////////////////////////////////////
-// Priority: Any
-//
-// Add a channel ID to a channel's include/exclude ID list
-///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_AddChannelID(UCHAR ucANTChannel_, USHORT usDeviceNumber_, UCHAR ucDeviceType_, UCHAR ucTransmissionType_, UCHAR ucListIndex_)
+void ANT_EventLoopHandle(void)
 {
-   return ANT_AddChannelID_RTO(ucANTChannel_, usDeviceNumber_, ucDeviceType_, ucTransmissionType_, ucListIndex_, 0);
+   ANT_EventLoopHandleCtx(&stDefaultContext);
 }
 
 ///////////////////////////////////////////////////////////////////////
-// Response TimeOut Version
+// Priority: Any
+//
+// Must not be called from inside the library callbacks.
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_AddChannelID_RTO(UCHAR ucANTChannel_, USHORT usDeviceNumber_, UCHAR ucDeviceType_, UCHAR ucTransmissionType_, UCHAR ucListIndex_, ULONG ulResponseTime_)
+void ANT_EventLoopDetachCtx(ANTContext* pstContext_)
 {
-   if(pclMessageObject)
+   if(!pstContext_->bInitialized || !pstContext_->bDirectDispatch)
+      return;
+
+   DSIThread_MutexLock(&pstContext_->mutexEventLoop);
+   if(pstContext_->bEventLoop)
    {
-      return(pclMessageObject->AddChannelID(ucANTChannel_, usDeviceNumber_, ucDeviceType_, ucTransmissionType_, ucListIndex_, ulResponseTime_));
+      pstContext_->pclSerialObject->SetExternalReceive(FALSE);
+      pstContext_->bEventLoop = FALSE;
    }
-   return(FALSE);
+   DSIThread_MutexUnlock(&pstContext_->mutexEventLoop);
 }
 
+extern "C" EXPORT
+void ANT_EventLoopDetach(void)
+{
+   ANT_EventLoopDetachCtx(&stDefaultContext);
+}
 
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
-// Configure the size and type of a channel's include/exclude ID list
+// Called by the application to read the counters kept by each layer
+// of the library for this stick.  Safe to call from any thread,
+// including the library callbacks.
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_ConfigList(UCHAR ucANTChannel_, UCHAR ucListSize_, UCHAR ucExclude_)
+BOOL ANT_GetStatsCtx(ANTContext* pstContext_, ANT_STATS* pstStats_)
 {
-   return ANT_ConfigList_RTO(ucANTChannel_, ucListSize_, ucExclude_, 0);
+   if(pstStats_ == NULL)
+      return(FALSE);
+
+   DSIStats_Get(&pstContext_->stStats, pstStats_);
+   return(TRUE);
 }
 
-///////////////////////////////////////////////////////////////////////
-// Response TimeOut Version
-///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_ConfigList_RTO(UCHAR ucANTChannel_, UCHAR ucListSize_, UCHAR ucExclude_, ULONG ulResponseTime_)
+BOOL ANT_GetStats(ANT_STATS* pstStats_)
 {
-   if(pclMessageObject)
-   {
-      return(pclMessageObject->ConfigList(ucANTChannel_, ucListSize_, ucExclude_, ulResponseTime_));
-   }
-   return(FALSE);
+   return ANT_GetStatsCtx(&stDefaultContext, pstStats_);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
-// Open Scan Mode
+// Called by the application to start the counters again from zero.
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_OpenRxScanMode()
+void ANT_ResetStatsCtx(ANTContext* pstContext_)
+{
+   DSIStats_Reset(&pstContext_->stStats);
+}
+
+extern "C" EXPORT
+void ANT_ResetStats(void)
 {
-   return ANT_OpenRxScanMode_RTO(0);
+   ANT_ResetStatsCtx(&stDefaultContext);
 }
 
 ///////////////////////////////////////////////////////////////////////
-// Response TimeOut Version
+// Priority: Any
+//
+// Called by the application to play back acknowledged data from a
+// remote device on the emulated stick
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_OpenRxScanMode_RTO(ULONG ulResponseTime_)
+BOOL ANT_EmulatorInjectAcknowledgedCtx(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR* pucData_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclEmulatorObject)
    {
-      return(pclMessageObject->OpenRxScanMode(ulResponseTime_));
+      return(pstContext_->pclEmulatorObject->InjectAcknowledgedData(ucANTChannel_, pucData_));
    }
    return(FALSE);
 }
 
-
-///////////////////////////////////////////////////////////////////////
-// Priority: Any
-//
-// Configure ANT Frequency Agility Functionality (not on AP1 or AT3)
-///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_ConfigFrequencyAgility(UCHAR ucANTChannel_, UCHAR ucFreq1_, UCHAR ucFreq2_, UCHAR ucFreq3_)
+BOOL ANT_EmulatorInjectAcknowledged(UCHAR ucANTChannel_, UCHAR* pucData_)
 {
-   return(ANT_ConfigFrequencyAgility_RTO(ucANTChannel_, ucFreq1_, ucFreq2_, ucFreq3_, 0));
+   return ANT_EmulatorInjectAcknowledgedCtx(&stDefaultContext, ucANTChannel_, pucData_);
 }
 
 ///////////////////////////////////////////////////////////////////////
-// Response TimeOut Version
+// Priority: Any
+//
+// Called by the application to replay a byte stream from the emulated
+// stick
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_ConfigFrequencyAgility_RTO(UCHAR ucANTChannel_, UCHAR ucFreq1_, UCHAR ucFreq2_, UCHAR ucFreq3_, ULONG ulResponseTime_)
+BOOL ANT_EmulatorInjectBytesCtx(ANTContext* pstContext_, UCHAR* pucData_, USHORT usSize_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclEmulatorObject)
    {
-      return(pclMessageObject->ConfigFrequencyAgility(ucANTChannel_, ucFreq1_, ucFreq2_, ucFreq3_, ulResponseTime_));
+      return(pstContext_->pclEmulatorObject->InjectBytes(pucData_, usSize_));
    }
    return(FALSE);
 }
 
-///////////////////////////////////////////////////////////////////////
-// Priority: Any
-//
-// Configure proximity search (not on AP1 or AT3)
-///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SetProximitySearch(UCHAR ucANTChannel_, UCHAR ucSearchThreshold_)
+BOOL ANT_EmulatorInjectBytes(UCHAR* pucData_, USHORT usSize_)
 {
-   return(ANT_SetProximitySearch_RTO(ucANTChannel_, ucSearchThreshold_, 0));
+   return ANT_EmulatorInjectBytesCtx(&stDefaultContext, pucData_, usSize_);
 }
 
 ///////////////////////////////////////////////////////////////////////
-// Response TimeOut Version
+// Priority: Any
+//
+// Called by the application to put line noise on the emulated stick
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SetProximitySearch_RTO(UCHAR ucANTChannel_, UCHAR ucSearchThreshold_, ULONG ulResponseTime_)
+BOOL ANT_EmulatorInjectNoiseCtx(ANTContext* pstContext_, USHORT usBytes_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclEmulatorObject)
    {
-      return(pclMessageObject->SetProximitySearch(ucANTChannel_, ucSearchThreshold_, ulResponseTime_));
+      pstContext_->pclEmulatorObject->InjectNoise(usBytes_);
+      return(TRUE);
    }
    return(FALSE);
 }
 
-///////////////////////////////////////////////////////////////////////
-// Priority: Any
-//
-// Configure Event Filter (USBm and nRF5 only)
-///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_ConfigEventFilter(USHORT usEventFilter_)
+BOOL ANT_EmulatorInjectNoise(USHORT usBytes_)
 {
-   return(ANT_ConfigEventFilter_RTO(usEventFilter_, 0));
+   return ANT_EmulatorInjectNoiseCtx(&stDefaultContext, usBytes_);
 }
 
 ///////////////////////////////////////////////////////////////////////
-// Response TimeOut Version
+// Priority: Any
+//
+// Called by the application to corrupt the next frame from the
+// emulated stick
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_ConfigEventFilter_RTO(USHORT usEventFilter_, ULONG ulResponseTime_)
+BOOL ANT_EmulatorInjectChecksumErrorCtx(ANTContext* pstContext_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclEmulatorObject)
    {
-      return(pclMessageObject->ConfigEventFilter(usEventFilter_, ulResponseTime_));
+      pstContext_->pclEmulatorObject->InjectChecksumError();
+      return(TRUE);
    }
    return(FALSE);
 }
 
-///////////////////////////////////////////////////////////////////////
-// Priority: Any
-//
-// Configure Event Buffer (USBm only)
-///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_ConfigEventBuffer(UCHAR ucConfig_, USHORT usSize_, USHORT usTime_)
+BOOL ANT_EmulatorInjectChecksumError(void)
 {
-   return(ANT_ConfigEventBuffer_RTO(ucConfig_, usSize_, usTime_, 0));
+   return ANT_EmulatorInjectChecksumErrorCtx(&stDefaultContext);
 }
 
 ///////////////////////////////////////////////////////////////////////
-// Response TimeOut Version
+// Priority: Any
+//
+// Called by the application to overflow the receive buffer of the
+// emulated stick
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_ConfigEventBuffer_RTO(UCHAR ucConfig_, USHORT usSize_, USHORT usTime_, ULONG ulResponseTime_)
+BOOL ANT_EmulatorInjectOverrunCtx(ANTContext* pstContext_, USHORT usFrames_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclEmulatorObject)
    {
-      return(pclMessageObject->ConfigEventBuffer(ucConfig_, usSize_, usTime_, ulResponseTime_));
+      pstContext_->pclEmulatorObject->InjectOverrun(usFrames_);
+      return(TRUE);
    }
    return(FALSE);
 }
 
-///////////////////////////////////////////////////////////////////////
-// Priority: Any
-//
-// Configure High Duty Search (USBm only)
-///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_ConfigHighDutySearch(UCHAR ucEnable_, UCHAR ucSuppressionCycles_)
+BOOL ANT_EmulatorInjectOverrun(USHORT usFrames_)
 {
-   return(ANT_ConfigHighDutySearch_RTO(ucEnable_, ucSuppressionCycles_, 0));
+   return ANT_EmulatorInjectOverrunCtx(&stDefaultContext, usFrames_);
 }
 
 ///////////////////////////////////////////////////////////////////////
-// Response TimeOut Version
+// Priority: Any
+//
+// Called by the application to lose transmit events from the emulated
+// stick
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_ConfigHighDutySearch_RTO(UCHAR ucEnable_, UCHAR ucSuppressionCycles_, ULONG ulResponseTime_)
+BOOL ANT_EmulatorDropTxEventsCtx(ANTContext* pstContext_, USHORT usEvents_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclEmulatorObject)
    {
-      return(pclMessageObject->ConfigHighDutySearch(ucEnable_, ucSuppressionCycles_, ulResponseTime_));
+      pstContext_->pclEmulatorObject->DropTxEvents(usEvents_);
+      return(TRUE);
    }
    return(FALSE);
 }
 
-///////////////////////////////////////////////////////////////////////
-// Priority: Any
-//
-// Configure Selective Data Update (USBm only)
-///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_ConfigSelectiveDataUpdate(UCHAR ucChannel_, UCHAR ucSduConfig_)
+BOOL ANT_EmulatorDropTxEvents(USHORT usEvents_)
 {
-   return(ANT_ConfigSelectiveDataUpdate_RTO(ucChannel_, ucSduConfig_, 0));
+   return ANT_EmulatorDropTxEventsCtx(&stDefaultContext, usEvents_);
 }
 
 ///////////////////////////////////////////////////////////////////////
-// Response TimeOut Version
+// Priority: Any
+//
+// Called by the application to pull the emulated stick out and plug it
+// back in ulMilliseconds_ later
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_ConfigSelectiveDataUpdate_RTO(UCHAR ucChannel_, UCHAR ucSduConfig_, ULONG ulResponseTime_)
+BOOL ANT_EmulatorUnplugCtx(ANTContext* pstContext_, ULONG ulMilliseconds_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclEmulatorObject)
    {
-      return(pclMessageObject->ConfigSelectiveDataUpdate(ucChannel_, ucSduConfig_, ulResponseTime_));
+      pstContext_->pclEmulatorObject->Unplug(ulMilliseconds_);
+      return(TRUE);
    }
    return(FALSE);
 }
 
-///////////////////////////////////////////////////////////////////////
-// Priority: Any
-//
-// Set Selective Data Update Mask (USBm only)
-///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SetSelectiveDataUpdateMask(UCHAR ucMaskNumber_, UCHAR* pucSduMask_)
+BOOL ANT_EmulatorUnplug(ULONG ulMilliseconds_)
 {
-   return(ANT_SetSelectiveDataUpdateMask_RTO(ucMaskNumber_, pucSduMask_, 0));
+   return ANT_EmulatorUnplugCtx(&stDefaultContext, ulMilliseconds_);
 }
 
 ///////////////////////////////////////////////////////////////////////
-// Response TimeOut Version
+// Priority: Any
+//
+// Called by the application to see whether the injected faults are
+// over
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SetSelectiveDataUpdateMask_RTO(UCHAR ucMaskNumber_, UCHAR* pucSduMask_, ULONG ulResponseTime_)
+BOOL ANT_EmulatorGetFaultsPendingCtx(ANTContext* pstContext_, ULONG* pulFaults_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclEmulatorObject && pulFaults_)
    {
-      return(pclMessageObject->SetSelectiveDataUpdateMask(ucMaskNumber_, pucSduMask_, ulResponseTime_));
+      *pulFaults_ = pstContext_->pclEmulatorObject->GetFaultsPending();
+      return(TRUE);
    }
    return(FALSE);
 }
 
-///////////////////////////////////////////////////////////////////////
-// Priority: Any
-//
-// Configure User NVM (USBm only)
-///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_ConfigUserNVM(USHORT usAddress_, UCHAR* pucData_, UCHAR ucSize_)
+BOOL ANT_EmulatorGetFaultsPending(ULONG* pulFaults_)
 {
-   return(ANT_ConfigUserNVM_RTO(usAddress_, pucData_, ucSize_, 0));
+   return ANT_EmulatorGetFaultsPendingCtx(&stDefaultContext, pulFaults_);
 }
 
 ///////////////////////////////////////////////////////////////////////
-// Response TimeOut Version
+// Priority: Any
+//
+// Called by the application to see how many of the channel's transmit
+// slots the host filled on the emulated stick
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_ConfigUserNVM_RTO(USHORT usAddress_, UCHAR* pucData_, UCHAR ucSize_, ULONG ulResponseTime_)
+BOOL ANT_EmulatorGetCountsCtx(ANTContext* pstContext_, UCHAR ucANTChannel_, ULONG* pulBroadcasts_, ULONG* pulTxEvents_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclEmulatorObject)
    {
-      return(pclMessageObject->ConfigUserNVM(usAddress_, pucData_, ucSize_, ulResponseTime_));
+      if(pulBroadcasts_)
+         *pulBroadcasts_ = pstContext_->pclEmulatorObject->GetBroadcastCount(ucANTChannel_);
+      if(pulTxEvents_)
+         *pulTxEvents_ = pstContext_->pclEmulatorObject->GetTxEventCount(ucANTChannel_);
+      return(TRUE);
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_EmulatorGetCounts(UCHAR ucANTChannel_, ULONG* pulBroadcasts_, ULONG* pulTxEvents_)
+{
+   return ANT_EmulatorGetCountsCtx(&stDefaultContext, ucANTChannel_, pulBroadcasts_, pulTxEvents_);
+}
+
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
-// Message to put into DEEP SLEEP (not on AP1 or AT3)
+// Called by the application to see how many of the channel's transmit
+// slots went out with data the host had not sent before
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SleepMessage()
+BOOL ANT_EmulatorGetFreshSlotsCtx(ANTContext* pstContext_, UCHAR ucANTChannel_, ULONG* pulFreshSlots_)
 {
-   return(ANT_SleepMessage_RTO(0));
-}
-
-///////////////////////////////////////////////////////////////////////
-// Response TimeOut Version
-///////////////////////////////////////////////////////////////////////
-extern "C" EXPORT
-BOOL ANT_SleepMessage_RTO(ULONG ulResponseTime_)
-{
-   if(pclMessageObject)
+   if(pstContext_->pclEmulatorObject && pulFreshSlots_)
    {
-      return(pclMessageObject->SleepMessage(ulResponseTime_));
+      *pulFreshSlots_ = pstContext_->pclEmulatorObject->GetFreshSlotCount(ucANTChannel_);
+      return(TRUE);
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_EmulatorGetFreshSlots(UCHAR ucANTChannel_, ULONG* pulFreshSlots_)
+{
+   return ANT_EmulatorGetFreshSlotsCtx(&stDefaultContext, ucANTChannel_, pulFreshSlots_);
+}
 
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
-// Message to put into DEEP SLEEP (not on AP1 or AT3)
+// Called by the application to open an assigned channel
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_CrystalEnable()
+BOOL ANT_OpenChannelCtx(ANTContext* pstContext_, UCHAR ucANTChannel_)
+{
+   return ANT_OpenChannelCtx_RTO(pstContext_, ucANTChannel_, 0);
+}
+
+extern "C" EXPORT
+BOOL ANT_OpenChannel(UCHAR ucANTChannel_)
 {
-   return(ANT_CrystalEnable_RTO(0));
+   return ANT_OpenChannelCtx(&stDefaultContext, ucANTChannel_);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_CrystalEnable_RTO(ULONG ulResponseTime_)
+BOOL ANT_OpenChannelCtx_RTO(ANTContext* pstContext_, UCHAR ucANTChannel_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->CrystalEnable(ulResponseTime_));
+      return(pstContext_->pclMessageObject->OpenChannel(ucANTChannel_, ulResponseTime_));
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_OpenChannel_RTO(UCHAR ucANTChannel_, ULONG ulResponseTime_)
+{
+   return ANT_OpenChannelCtx_RTO(&stDefaultContext, ucANTChannel_, ulResponseTime_);
+}
+
+
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
-// Called by the application to write NVM data
+// Called by the application to close an opend channel
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_NVM_Write(UCHAR ucSize_, UCHAR *pucData_)
+BOOL ANT_CloseChannelCtx(ANTContext* pstContext_, UCHAR ucANTChannel_)
+{
+   return ANT_CloseChannelCtx_RTO(pstContext_, ucANTChannel_, 0);
+}
+
+extern "C" EXPORT
+BOOL ANT_CloseChannel(UCHAR ucANTChannel_)
 {
-   return ANT_NVM_Write_RTO(ucSize_, pucData_ , 0);
+   return ANT_CloseChannelCtx(&stDefaultContext, ucANTChannel_);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_NVM_Write_RTO(UCHAR ucSize_, UCHAR *pucData_, ULONG ulResponseTime_)
+BOOL ANT_CloseChannelCtx_RTO(ANTContext* pstContext_, UCHAR ucANTChannel_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->ScriptWrite(ucSize_,pucData_, ulResponseTime_ ));
+      return(pstContext_->pclMessageObject->CloseChannel(ucANTChannel_, ulResponseTime_));
    }
    return(FALSE);
 }
 
-
-
-///////////////////////////////////////////////////////////////////////
-// Priority: Any
-//
-// Called by the application to clear NVM data
-///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_NVM_Clear(UCHAR ucSectNumber_)
+BOOL ANT_CloseChannel_RTO(UCHAR ucANTChannel_, ULONG ulResponseTime_)
 {
-   return ANT_NVM_Clear_RTO(ucSectNumber_, 0);
+   return ANT_CloseChannelCtx_RTO(&stDefaultContext, ucANTChannel_, ulResponseTime_);
 }
 
+
+
 ///////////////////////////////////////////////////////////////////////
-// Response TimeOut Version
+// Priority: Any
+//
+// Called by the application to construct and send a broadcast data message.
+// This message will be broadcast on the next synchronous channel period.
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_NVM_Clear_RTO(UCHAR ucSectNumber_, ULONG ulResponseTime_)
-//Sector number is useless here, but is still here for backwards compatibility
+BOOL ANT_SendBroadcastDataCtx(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR *pucData_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->ScriptClear(ulResponseTime_));
+      if(!pstContext_->pclMessageObject->SendBroadcastData(ucANTChannel_, pucData_))
+         return(FALSE);
+
+      if(ucANTChannel_ < ANT_STATS_CHANNELS)
+         DSI_STATS_INC(&pstContext_->stStats, aulBroadcastsSent[ucANTChannel_]);
+      return(TRUE);
    }
    return(FALSE);
 }
 
-
+extern "C" EXPORT
+BOOL ANT_SendBroadcastData(UCHAR ucANTChannel_, UCHAR *pucData_)
+{
+   return ANT_SendBroadcastDataCtx(&stDefaultContext, ucANTChannel_, pucData_);
+}
 
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
-// Called by the application to set default NVM sector
+// Called by the application to construct and send an acknowledged data
+// mesg.  This message will be transmitted on the next synchronous channel
+// period.
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_NVM_SetDefaultSector(UCHAR ucSectNumber_)
+BOOL ANT_SendAcknowledgedDataCtx(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR *pucData_)
+{
+   return ANT_SendAcknowledgedDataCtx_RTO(pstContext_, ucANTChannel_, pucData_, 0);
+}
+
+extern "C" EXPORT
+BOOL ANT_SendAcknowledgedData(UCHAR ucANTChannel_, UCHAR *pucData_)
 {
-   return ANT_NVM_SetDefaultSector_RTO(ucSectNumber_, 0);
+   return ANT_SendAcknowledgedDataCtx(&stDefaultContext, ucANTChannel_, pucData_);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_NVM_SetDefaultSector_RTO(UCHAR ucSectNumber_, ULONG ulResponseTime_)
+BOOL ANT_SendAcknowledgedDataCtx_RTO(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR *pucData_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->ScriptSetDefaultSector(ucSectNumber_, ulResponseTime_));
+      return(pstContext_->pclMessageObject->SendAcknowledgedData( ucANTChannel_, pucData_, ulResponseTime_));
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_SendAcknowledgedData_RTO(UCHAR ucANTChannel_, UCHAR *pucData_, ULONG ulResponseTime_)
+{
+   return ANT_SendAcknowledgedDataCtx_RTO(&stDefaultContext, ucANTChannel_, pucData_, ulResponseTime_);
+}
 
 
 ///////////////////////////////////////////////////////////////////////
-// Priority: Any
-//
-// Called by the application to end NVM sector
+// Used to send burst data using a block of data.  Proper sequence number
+// of packet is maintained by the function.  Useful for testing purposes.
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_NVM_EndSector()
+BOOL ANT_SendBurstTransferCtx(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR *pucData_, USHORT usNumDataPackets_)
+{
+   return ANT_SendBurstTransferCtx_RTO(pstContext_, ucANTChannel_, pucData_, usNumDataPackets_, 0);
+}
+
+extern "C" EXPORT
+BOOL ANT_SendBurstTransfer(UCHAR ucANTChannel_, UCHAR *pucData_, USHORT usNumDataPackets_)
 {
-   return ANT_NVM_EndSector_RTO(0);
+   return ANT_SendBurstTransferCtx(&stDefaultContext, ucANTChannel_, pucData_, usNumDataPackets_);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_NVM_EndSector_RTO(ULONG ulResponseTime_)
+BOOL ANT_SendBurstTransferCtx_RTO(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR *pucData_, USHORT usNumDataPackets_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   ULONG ulSize = usNumDataPackets_*8;   // Pass the number of bytes.
+   ANTFRAMER_RETURN eStatus;
+
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->ScriptEndSector(ulResponseTime_));
+      eStatus = pstContext_->pclMessageObject->SendTransfer( ucANTChannel_, pucData_, ulSize, ulResponseTime_);
+
+      if( eStatus == ANTFRAMER_PASS )
+         return(TRUE);
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_SendBurstTransfer_RTO(UCHAR ucANTChannel_, UCHAR *pucData_, USHORT usNumDataPackets_, ULONG ulResponseTime_)
+{
+   return ANT_SendBurstTransferCtx_RTO(&stDefaultContext, ucANTChannel_, pucData_, usNumDataPackets_, ulResponseTime_);
+}
 
 
-///////////////////////////////////////////////////////////////////////
+
+
+//////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
-// Called by the application to dump the contents of the NVM
-///////////////////////////////////////////////////////////////////////
+// Called by the application to configure and start CW test mode.
+// There is no way to turn off CW mode other than to do a reset on the module.
+/////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_NVM_Dump()
+BOOL ANT_InitCWTestModeCtx(ANTContext* pstContext_)
+{
+   return ANT_InitCWTestModeCtx_RTO(pstContext_, 0);
+}
+
+extern "C" EXPORT
+BOOL ANT_InitCWTestMode(void)
 {
-   return ANT_NVM_Dump_RTO(0);
+   return ANT_InitCWTestModeCtx(&stDefaultContext);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_NVM_Dump_RTO(ULONG ulResponseTime_)
-//Response time is useless here, but is kept for backwards compatibility
+BOOL ANT_InitCWTestModeCtx_RTO(ANTContext* pstContext_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      pclMessageObject->ScriptDump();
-     return TRUE;
+      return(pstContext_->pclMessageObject->InitCWTestMode(ulResponseTime_));
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_InitCWTestMode_RTO(ULONG ulResponseTime_)
+{
+   return ANT_InitCWTestModeCtx_RTO(&stDefaultContext, ulResponseTime_);
+}
 
 
-///////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
-// Called by the application to lock the contents of the NVM
-///////////////////////////////////////////////////////////////////////
+// Called by the application to configure and start CW test mode.
+// There is no way to turn off CW mode other than to do a reset on the module.
+/////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_NVM_Lock()
+BOOL ANT_SetCWTestModeCtx(ANTContext* pstContext_, UCHAR ucTransmitPower_, UCHAR ucRFChannel_)
+{
+   return ANT_SetCWTestModeCtx_RTO(pstContext_, ucTransmitPower_, ucRFChannel_, 0);
+}
+
+extern "C" EXPORT
+BOOL ANT_SetCWTestMode(UCHAR ucTransmitPower_, UCHAR ucRFChannel_)
 {
-   return ANT_NVM_Lock_RTO(0);
+   return ANT_SetCWTestModeCtx(&stDefaultContext, ucTransmitPower_, ucRFChannel_);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_NVM_Lock_RTO(ULONG ulResponseTimeout_)
+BOOL ANT_SetCWTestModeCtx_RTO(ANTContext* pstContext_, UCHAR ucTransmitPower_, UCHAR ucRFChannel_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->ScriptLock(ulResponseTimeout_));
+      return(pstContext_->pclMessageObject->SetCWTestMode(ucTransmitPower_, ucRFChannel_, ulResponseTime_));
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_SetCWTestMode_RTO(UCHAR ucTransmitPower_, UCHAR ucRFChannel_, ULONG ulResponseTime_)
+{
+   return ANT_SetCWTestModeCtx_RTO(&stDefaultContext, ucTransmitPower_, ucRFChannel_, ulResponseTime_);
+}
 
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
-// Called by the application to set the state of the FE (FIT1e)
+// Add a channel ID to a channel's include/exclude ID list
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL FIT_SetFEState(UCHAR ucFEState_)
+BOOL ANT_AddChannelIDCtx(ANTContext* pstContext_, UCHAR ucANTChannel_, USHORT usDeviceNumber_, UCHAR ucDeviceType_, UCHAR ucTransmissionType_, UCHAR ucListIndex_)
+{
+   return ANT_AddChannelIDCtx_RTO(pstContext_, ucANTChannel_, usDeviceNumber_, ucDeviceType_, ucTransmissionType_, ucListIndex_, 0);
+}
+
+extern "C" EXPORT
+BOOL ANT_AddChannelID(UCHAR ucANTChannel_, USHORT usDeviceNumber_, UCHAR ucDeviceType_, UCHAR ucTransmissionType_, UCHAR ucListIndex_)
 {
-   return FIT_SetFEState_RTO(ucFEState_, 0);
+   return ANT_AddChannelIDCtx(&stDefaultContext, ucANTChannel_, usDeviceNumber_, ucDeviceType_, ucTransmissionType_, ucListIndex_);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL FIT_SetFEState_RTO(UCHAR ucFEState_, ULONG ulResponseTime_)
+BOOL ANT_AddChannelIDCtx_RTO(ANTContext* pstContext_, UCHAR ucANTChannel_, USHORT usDeviceNumber_, UCHAR ucDeviceType_, UCHAR ucTransmissionType_, UCHAR ucListIndex_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->FITSetFEState(ucFEState_, ulResponseTime_));
+      return(pstContext_->pclMessageObject->AddChannelID(ucANTChannel_, usDeviceNumber_, ucDeviceType_, ucTransmissionType_, ucListIndex_, ulResponseTime_));
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_AddChannelID_RTO(UCHAR ucANTChannel_, USHORT usDeviceNumber_, UCHAR ucDeviceType_, UCHAR ucTransmissionType_, UCHAR ucListIndex_, ULONG ulResponseTime_)
+{
+   return ANT_AddChannelIDCtx_RTO(&stDefaultContext, ucANTChannel_, usDeviceNumber_, ucDeviceType_, ucTransmissionType_, ucListIndex_, ulResponseTime_);
+}
+
+
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
-// Called by the application to set the pairing distance (FIT1e)
+// Configure the size and type of a channel's include/exclude ID list
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL FIT_AdjustPairingSettings(UCHAR ucSearchLv_, UCHAR ucPairLv_, UCHAR ucTrackLv_)
+BOOL ANT_ConfigListCtx(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR ucListSize_, UCHAR ucExclude_)
+{
+   return ANT_ConfigListCtx_RTO(pstContext_, ucANTChannel_, ucListSize_, ucExclude_, 0);
+}
+
+extern "C" EXPORT
+BOOL ANT_ConfigList(UCHAR ucANTChannel_, UCHAR ucListSize_, UCHAR ucExclude_)
 {
-   return FIT_AdjustPairingSettings_RTO(ucSearchLv_, ucPairLv_, ucTrackLv_, 0);
+   return ANT_ConfigListCtx(&stDefaultContext, ucANTChannel_, ucListSize_, ucExclude_);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL FIT_AdjustPairingSettings_RTO(UCHAR ucSearchLv_, UCHAR ucPairLv_, UCHAR ucTrackLv_, ULONG ulResponseTime_)
+BOOL ANT_ConfigListCtx_RTO(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR ucListSize_, UCHAR ucExclude_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->FITAdjustPairingSettings(ucSearchLv_, ucPairLv_, ucTrackLv_, ulResponseTime_));
+      return(pstContext_->pclMessageObject->ConfigList(ucANTChannel_, ucListSize_, ucExclude_, ulResponseTime_));
    }
    return(FALSE);
 }
 
-///////////////////////////////////////////////////////////////////////
-// Priority: Any
-//
-// Called by the application to construct and send an extended broadcast data message.
-// This message will be broadcast on the next synchronous channel period.
-///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SendExtBroadcastData(UCHAR ucANTChannel_, UCHAR *pucData_)
+BOOL ANT_ConfigList_RTO(UCHAR ucANTChannel_, UCHAR ucListSize_, UCHAR ucExclude_, ULONG ulResponseTime_)
 {
-   if(!pclMessageObject)
-      return FALSE;
-   return pclMessageObject->SendExtBroadcastData(ucANTChannel_, pucData_);
+   return ANT_ConfigListCtx_RTO(&stDefaultContext, ucANTChannel_, ucListSize_, ucExclude_, ulResponseTime_);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
-// Called by the application to construct and send an extended acknowledged data
-// mesg.  This message will be transmitted on the next synchronous channel
-// period.
+// Open Scan Mode
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SendExtAcknowledgedData(UCHAR ucANTChannel_, UCHAR *pucData_)
+BOOL ANT_OpenRxScanModeCtx(ANTContext* pstContext_)
 {
-   return ANT_SendExtAcknowledgedData_RTO(ucANTChannel_, pucData_, 0);
+   return ANT_OpenRxScanModeCtx_RTO(pstContext_, 0);
 }
 
-///////////////////////////////////////////////////////////////////////
-// Response TimeOut Version
-///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SendExtAcknowledgedData_RTO(UCHAR ucANTChannel_, UCHAR *pucData_, ULONG ulResponseTime_)
+BOOL ANT_OpenRxScanMode()
 {
-   if(!pclMessageObject)
-      return FALSE;
-
-   return (ANTFRAMER_PASS == pclMessageObject->SendExtAcknowledgedData(ucANTChannel_, pucData_, ulResponseTime_));
+   return ANT_OpenRxScanModeCtx(&stDefaultContext);
 }
 
-
-///////////////////////////////////////////////////////////////////////
-// Priority: Any
-//
-// Called by the application to construct and send extended burst data
-// mesg.
-///////////////////////////////////////////////////////////////////////
-
 ///////////////////////////////////////////////////////////////////////
-// Priority: Any
-//
-// Used to send extended burst data with individual packets.  Proper sequence number
-// of packet is maintained by the application.
+// Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SendExtBurstTransferPacket(UCHAR ucANTChannelSeq_, UCHAR *pucData_)
+BOOL ANT_OpenRxScanModeCtx_RTO(ANTContext* pstContext_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      ANT_MESSAGE stMessage;
-
-      stMessage.ucMessageID = MESG_EXT_BURST_DATA_ID;
-      stMessage.aucData[0] = ucANTChannelSeq_;
-      memcpy(&stMessage.aucData[1],pucData_, MESG_EXT_DATA_SIZE-1);
-
-      return pclMessageObject->WriteMessage(&stMessage, MESG_EXT_DATA_SIZE);
+      return(pstContext_->pclMessageObject->OpenRxScanMode(ulResponseTime_));
    }
    return(FALSE);
 }
-///////////////////////////////////////////////////////////////////////
-// Priority: Any
-//
-// Used to send extended burst data using a block of data.  Proper sequence number
-// of packet is maintained by the function.  Useful for testing purposes.
-///////////////////////////////////////////////////////////////////////
-extern "C" EXPORT
-USHORT ANT_SendExtBurstTransfer(UCHAR ucANTChannel_, UCHAR *pucData_, USHORT usDataPackets_)
-{
-   return ANT_SendExtBurstTransfer_RTO(ucANTChannel_, pucData_, usDataPackets_, 0);
-}
 
-///////////////////////////////////////////////////////////////////////
-// Response TimeOut Version
-///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-USHORT ANT_SendExtBurstTransfer_RTO(UCHAR ucANTChannel_, UCHAR *pucData_, USHORT usDataPackets_, ULONG ulResponseTime_)
+BOOL ANT_OpenRxScanMode_RTO(ULONG ulResponseTime_)
 {
-   if(!pclMessageObject)
-      return FALSE;
-
-   return (ANTFRAMER_PASS == pclMessageObject->SendExtBurstTransfer(ucANTChannel_, pucData_, usDataPackets_*8, ulResponseTime_));
+   return ANT_OpenRxScanModeCtx_RTO(&stDefaultContext, ulResponseTime_);
 }
 
 
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
-// Used to force the module to use extended rx messages all the time
+// Configure ANT Frequency Agility Functionality (not on AP1 or AT3)
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_RxExtMesgsEnable(UCHAR ucEnable_)
+BOOL ANT_ConfigFrequencyAgilityCtx(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR ucFreq1_, UCHAR ucFreq2_, UCHAR ucFreq3_)
+{
+   return(ANT_ConfigFrequencyAgilityCtx_RTO(pstContext_, ucANTChannel_, ucFreq1_, ucFreq2_, ucFreq3_, 0));
+}
+
+extern "C" EXPORT
+BOOL ANT_ConfigFrequencyAgility(UCHAR ucANTChannel_, UCHAR ucFreq1_, UCHAR ucFreq2_, UCHAR ucFreq3_)
 {
-   return ANT_RxExtMesgsEnable_RTO(ucEnable_, 0);
+   return ANT_ConfigFrequencyAgilityCtx(&stDefaultContext, ucANTChannel_, ucFreq1_, ucFreq2_, ucFreq3_);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_RxExtMesgsEnable_RTO(UCHAR ucEnable_, ULONG ulResponseTimeout_)
+BOOL ANT_ConfigFrequencyAgilityCtx_RTO(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR ucFreq1_, UCHAR ucFreq2_, UCHAR ucFreq3_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->RxExtMesgsEnable(ucEnable_, ulResponseTimeout_));
+      return(pstContext_->pclMessageObject->ConfigFrequencyAgility(ucANTChannel_, ucFreq1_, ucFreq2_, ucFreq3_, ulResponseTime_));
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_ConfigFrequencyAgility_RTO(UCHAR ucANTChannel_, UCHAR ucFreq1_, UCHAR ucFreq2_, UCHAR ucFreq3_, ULONG ulResponseTime_)
+{
+   return ANT_ConfigFrequencyAgilityCtx_RTO(&stDefaultContext, ucANTChannel_, ucFreq1_, ucFreq2_, ucFreq3_, ulResponseTime_);
+}
+
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
-// Used to set a channel device ID to the module serial number
+// Configure proximity search (not on AP1 or AT3)
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SetSerialNumChannelId(UCHAR ucANTChannel_, UCHAR ucDeviceType_, UCHAR ucTransmissionType_)
+BOOL ANT_SetProximitySearchCtx(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR ucSearchThreshold_)
 {
-   return ANT_SetSerialNumChannelId_RTO(ucANTChannel_, ucDeviceType_, ucTransmissionType_, 0);
+   return(ANT_SetProximitySearchCtx_RTO(pstContext_, ucANTChannel_, ucSearchThreshold_, 0));
 }
 
+extern "C" EXPORT
+BOOL ANT_SetProximitySearch(UCHAR ucANTChannel_, UCHAR ucSearchThreshold_)
+{
+   return ANT_SetProximitySearchCtx(&stDefaultContext, ucANTChannel_, ucSearchThreshold_);
+}
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_SetSerialNumChannelId_RTO(UCHAR ucANTChannel_, UCHAR ucDeviceType_, UCHAR ucTransmissionType_, ULONG ulResponseTime_)
+BOOL ANT_SetProximitySearchCtx_RTO(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR ucSearchThreshold_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->SetSerialNumChannelId(ucANTChannel_, ucDeviceType_, ucTransmissionType_, ulResponseTime_));
+      return(pstContext_->pclMessageObject->SetProximitySearch(ucANTChannel_, ucSearchThreshold_, ulResponseTime_));
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_SetProximitySearch_RTO(UCHAR ucANTChannel_, UCHAR ucSearchThreshold_, ULONG ulResponseTime_)
+{
+   return ANT_SetProximitySearchCtx_RTO(&stDefaultContext, ucANTChannel_, ucSearchThreshold_, ulResponseTime_);
+}
 
 ///////////////////////////////////////////////////////////////////////
 // Priority: Any
 //
-// Enables the module LED to flash on RF activity
+// Configure Event Filter (USBm and nRF5 only)
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_EnableLED(UCHAR ucEnable_)
+BOOL ANT_ConfigEventFilterCtx(ANTContext* pstContext_, USHORT usEventFilter_)
+{
+   return(ANT_ConfigEventFilterCtx_RTO(pstContext_, usEventFilter_, 0));
+}
+
+extern "C" EXPORT
+BOOL ANT_ConfigEventFilter(USHORT usEventFilter_)
 {
-   return ANT_EnableLED_RTO(ucEnable_, 0);
+   return ANT_ConfigEventFilterCtx(&stDefaultContext, usEventFilter_);
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Response TimeOut Version
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_EnableLED_RTO(UCHAR ucEnable_, ULONG ulResponseTime_)
+BOOL ANT_ConfigEventFilterCtx_RTO(ANTContext* pstContext_, USHORT usEventFilter_, ULONG ulResponseTime_)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->EnableLED(ucEnable_, ulResponseTime_));
+      return(pstContext_->pclMessageObject->ConfigEventFilter(usEventFilter_, ulResponseTime_));
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_ConfigEventFilter_RTO(USHORT usEventFilter_, ULONG ulResponseTime_)
+{
+   return ANT_ConfigEventFilterCtx_RTO(&stDefaultContext, usEventFilter_, ulResponseTime_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Configure Event Buffer (USBm only)
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_ConfigEventBufferCtx(ANTContext* pstContext_, UCHAR ucConfig_, USHORT usSize_, USHORT usTime_)
+{
+   return(ANT_ConfigEventBufferCtx_RTO(pstContext_, ucConfig_, usSize_, usTime_, 0));
+}
+
+extern "C" EXPORT
+BOOL ANT_ConfigEventBuffer(UCHAR ucConfig_, USHORT usSize_, USHORT usTime_)
+{
+   return ANT_ConfigEventBufferCtx(&stDefaultContext, ucConfig_, usSize_, usTime_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Response TimeOut Version
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_ConfigEventBufferCtx_RTO(ANTContext* pstContext_, UCHAR ucConfig_, USHORT usSize_, USHORT usTime_, ULONG ulResponseTime_)
+{
+   if(pstContext_->pclMessageObject)
+   {
+      return(pstContext_->pclMessageObject->ConfigEventBuffer(ucConfig_, usSize_, usTime_, ulResponseTime_));
+   }
+   return(FALSE);
+}
+
+extern "C" EXPORT
+BOOL ANT_ConfigEventBuffer_RTO(UCHAR ucConfig_, USHORT usSize_, USHORT usTime_, ULONG ulResponseTime_)
+{
+   return ANT_ConfigEventBufferCtx_RTO(&stDefaultContext, ucConfig_, usSize_, usTime_, ulResponseTime_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Configure High Duty Search (USBm only)
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_ConfigHighDutySearchCtx(ANTContext* pstContext_, UCHAR ucEnable_, UCHAR ucSuppressionCycles_)
+{
+   return(ANT_ConfigHighDutySearchCtx_RTO(pstContext_, ucEnable_, ucSuppressionCycles_, 0));
+}
+
+extern "C" EXPORT
+BOOL ANT_ConfigHighDutySearch(UCHAR ucEnable_, UCHAR ucSuppressionCycles_)
+{
+   return ANT_ConfigHighDutySearchCtx(&stDefaultContext, ucEnable_, ucSuppressionCycles_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Response TimeOut Version
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_ConfigHighDutySearchCtx_RTO(ANTContext* pstContext_, UCHAR ucEnable_, UCHAR ucSuppressionCycles_, ULONG ulResponseTime_)
+{
+   if(pstContext_->pclMessageObject)
+   {
+      return(pstContext_->pclMessageObject->ConfigHighDutySearch(ucEnable_, ucSuppressionCycles_, ulResponseTime_));
+   }
+   return(FALSE);
+}
+
+extern "C" EXPORT
+BOOL ANT_ConfigHighDutySearch_RTO(UCHAR ucEnable_, UCHAR ucSuppressionCycles_, ULONG ulResponseTime_)
+{
+   return ANT_ConfigHighDutySearchCtx_RTO(&stDefaultContext, ucEnable_, ucSuppressionCycles_, ulResponseTime_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Configure Selective Data Update (USBm only)
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_ConfigSelectiveDataUpdateCtx(ANTContext* pstContext_, UCHAR ucChannel_, UCHAR ucSduConfig_)
+{
+   return(ANT_ConfigSelectiveDataUpdateCtx_RTO(pstContext_, ucChannel_, ucSduConfig_, 0));
+}
+
+extern "C" EXPORT
+BOOL ANT_ConfigSelectiveDataUpdate(UCHAR ucChannel_, UCHAR ucSduConfig_)
+{
+   return ANT_ConfigSelectiveDataUpdateCtx(&stDefaultContext, ucChannel_, ucSduConfig_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Response TimeOut Version
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_ConfigSelectiveDataUpdateCtx_RTO(ANTContext* pstContext_, UCHAR ucChannel_, UCHAR ucSduConfig_, ULONG ulResponseTime_)
+{
+   if(pstContext_->pclMessageObject)
+   {
+      return(pstContext_->pclMessageObject->ConfigSelectiveDataUpdate(ucChannel_, ucSduConfig_, ulResponseTime_));
+   }
+   return(FALSE);
+}
+
+extern "C" EXPORT
+BOOL ANT_ConfigSelectiveDataUpdate_RTO(UCHAR ucChannel_, UCHAR ucSduConfig_, ULONG ulResponseTime_)
+{
+   return ANT_ConfigSelectiveDataUpdateCtx_RTO(&stDefaultContext, ucChannel_, ucSduConfig_, ulResponseTime_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Set Selective Data Update Mask (USBm only)
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_SetSelectiveDataUpdateMaskCtx(ANTContext* pstContext_, UCHAR ucMaskNumber_, UCHAR* pucSduMask_)
+{
+   return(ANT_SetSelectiveDataUpdateMaskCtx_RTO(pstContext_, ucMaskNumber_, pucSduMask_, 0));
+}
+
+extern "C" EXPORT
+BOOL ANT_SetSelectiveDataUpdateMask(UCHAR ucMaskNumber_, UCHAR* pucSduMask_)
+{
+   return ANT_SetSelectiveDataUpdateMaskCtx(&stDefaultContext, ucMaskNumber_, pucSduMask_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Response TimeOut Version
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_SetSelectiveDataUpdateMaskCtx_RTO(ANTContext* pstContext_, UCHAR ucMaskNumber_, UCHAR* pucSduMask_, ULONG ulResponseTime_)
+{
+   if(pstContext_->pclMessageObject)
+   {
+      return(pstContext_->pclMessageObject->SetSelectiveDataUpdateMask(ucMaskNumber_, pucSduMask_, ulResponseTime_));
+   }
+   return(FALSE);
+}
+
+extern "C" EXPORT
+BOOL ANT_SetSelectiveDataUpdateMask_RTO(UCHAR ucMaskNumber_, UCHAR* pucSduMask_, ULONG ulResponseTime_)
+{
+   return ANT_SetSelectiveDataUpdateMaskCtx_RTO(&stDefaultContext, ucMaskNumber_, pucSduMask_, ulResponseTime_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Configure User NVM (USBm only)
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_ConfigUserNVMCtx(ANTContext* pstContext_, USHORT usAddress_, UCHAR* pucData_, UCHAR ucSize_)
+{
+   return(ANT_ConfigUserNVMCtx_RTO(pstContext_, usAddress_, pucData_, ucSize_, 0));
+}
+
+extern "C" EXPORT
+BOOL ANT_ConfigUserNVM(USHORT usAddress_, UCHAR* pucData_, UCHAR ucSize_)
+{
+   return ANT_ConfigUserNVMCtx(&stDefaultContext, usAddress_, pucData_, ucSize_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Response TimeOut Version
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_ConfigUserNVMCtx_RTO(ANTContext* pstContext_, USHORT usAddress_, UCHAR* pucData_, UCHAR ucSize_, ULONG ulResponseTime_)
+{
+   if(pstContext_->pclMessageObject)
+   {
+      return(pstContext_->pclMessageObject->ConfigUserNVM(usAddress_, pucData_, ucSize_, ulResponseTime_));
+   }
+   return(FALSE);
+}
+
+extern "C" EXPORT
+BOOL ANT_ConfigUserNVM_RTO(USHORT usAddress_, UCHAR* pucData_, UCHAR ucSize_, ULONG ulResponseTime_)
+{
+   return ANT_ConfigUserNVMCtx_RTO(&stDefaultContext, usAddress_, pucData_, ucSize_, ulResponseTime_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Message to put into DEEP SLEEP (not on AP1 or AT3)
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_SleepMessageCtx(ANTContext* pstContext_)
+{
+   return(ANT_SleepMessageCtx_RTO(pstContext_, 0));
+}
+
+extern "C" EXPORT
+BOOL ANT_SleepMessage()
+{
+   return ANT_SleepMessageCtx(&stDefaultContext);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Response TimeOut Version
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_SleepMessageCtx_RTO(ANTContext* pstContext_, ULONG ulResponseTime_)
+{
+   if(pstContext_->pclMessageObject)
+   {
+      return(pstContext_->pclMessageObject->SleepMessage(ulResponseTime_));
+   }
+   return(FALSE);
+}
+
+extern "C" EXPORT
+BOOL ANT_SleepMessage_RTO(ULONG ulResponseTime_)
+{
+   return ANT_SleepMessageCtx_RTO(&stDefaultContext, ulResponseTime_);
+}
+
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Message to put into DEEP SLEEP (not on AP1 or AT3)
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_CrystalEnableCtx(ANTContext* pstContext_)
+{
+   return(ANT_CrystalEnableCtx_RTO(pstContext_, 0));
+}
+
+extern "C" EXPORT
+BOOL ANT_CrystalEnable()
+{
+   return ANT_CrystalEnableCtx(&stDefaultContext);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Response TimeOut Version
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_CrystalEnableCtx_RTO(ANTContext* pstContext_, ULONG ulResponseTime_)
+{
+   if(pstContext_->pclMessageObject)
+   {
+      return(pstContext_->pclMessageObject->CrystalEnable(ulResponseTime_));
+   }
+   return(FALSE);
+}
+
+extern "C" EXPORT
+BOOL ANT_CrystalEnable_RTO(ULONG ulResponseTime_)
+{
+   return ANT_CrystalEnableCtx_RTO(&stDefaultContext, ulResponseTime_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Called by the application to write NVM data
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_NVM_WriteCtx(ANTContext* pstContext_, UCHAR ucSize_, UCHAR *pucData_)
+{
+   return ANT_NVM_WriteCtx_RTO(pstContext_, ucSize_, pucData_ , 0);
+}
+
+extern "C" EXPORT
+BOOL ANT_NVM_Write(UCHAR ucSize_, UCHAR *pucData_)
+{
+   return ANT_NVM_WriteCtx(&stDefaultContext, ucSize_, pucData_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Response TimeOut Version
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_NVM_WriteCtx_RTO(ANTContext* pstContext_, UCHAR ucSize_, UCHAR *pucData_, ULONG ulResponseTime_)
+{
+   if(pstContext_->pclMessageObject)
+   {
+      return(pstContext_->pclMessageObject->ScriptWrite(ucSize_,pucData_, ulResponseTime_ ));
+   }
+   return(FALSE);
+}
+
+extern "C" EXPORT
+BOOL ANT_NVM_Write_RTO(UCHAR ucSize_, UCHAR *pucData_, ULONG ulResponseTime_)
+{
+   return ANT_NVM_WriteCtx_RTO(&stDefaultContext, ucSize_, pucData_, ulResponseTime_);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Called by the application to clear NVM data
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_NVM_ClearCtx(ANTContext* pstContext_, UCHAR ucSectNumber_)
+{
+   return ANT_NVM_ClearCtx_RTO(pstContext_, ucSectNumber_, 0);
+}
+
+extern "C" EXPORT
+BOOL ANT_NVM_Clear(UCHAR ucSectNumber_)
+{
+   return ANT_NVM_ClearCtx(&stDefaultContext, ucSectNumber_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Response TimeOut Version
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_NVM_ClearCtx_RTO(ANTContext* pstContext_, UCHAR ucSectNumber_, ULONG ulResponseTime_)
+//Sector number is useless here, but is still here for backwards compatibility
+{
+   if(pstContext_->pclMessageObject)
+   {
+      return(pstContext_->pclMessageObject->ScriptClear(ulResponseTime_));
+   }
+   return(FALSE);
+}
+
+extern "C" EXPORT
+BOOL ANT_NVM_Clear_RTO(UCHAR ucSectNumber_, ULONG ulResponseTime_)
+{
+   return ANT_NVM_ClearCtx_RTO(&stDefaultContext, ucSectNumber_, ulResponseTime_);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Called by the application to set default NVM sector
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_NVM_SetDefaultSectorCtx(ANTContext* pstContext_, UCHAR ucSectNumber_)
+{
+   return ANT_NVM_SetDefaultSectorCtx_RTO(pstContext_, ucSectNumber_, 0);
+}
+
+extern "C" EXPORT
+BOOL ANT_NVM_SetDefaultSector(UCHAR ucSectNumber_)
+{
+   return ANT_NVM_SetDefaultSectorCtx(&stDefaultContext, ucSectNumber_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Response TimeOut Version
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_NVM_SetDefaultSectorCtx_RTO(ANTContext* pstContext_, UCHAR ucSectNumber_, ULONG ulResponseTime_)
+{
+   if(pstContext_->pclMessageObject)
+   {
+      return(pstContext_->pclMessageObject->ScriptSetDefaultSector(ucSectNumber_, ulResponseTime_));
+   }
+   return(FALSE);
+}
+
+extern "C" EXPORT
+BOOL ANT_NVM_SetDefaultSector_RTO(UCHAR ucSectNumber_, ULONG ulResponseTime_)
+{
+   return ANT_NVM_SetDefaultSectorCtx_RTO(&stDefaultContext, ucSectNumber_, ulResponseTime_);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Called by the application to end NVM sector
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_NVM_EndSectorCtx(ANTContext* pstContext_)
+{
+   return ANT_NVM_EndSectorCtx_RTO(pstContext_, 0);
+}
+
+extern "C" EXPORT
+BOOL ANT_NVM_EndSector()
+{
+   return ANT_NVM_EndSectorCtx(&stDefaultContext);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Response TimeOut Version
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_NVM_EndSectorCtx_RTO(ANTContext* pstContext_, ULONG ulResponseTime_)
+{
+   if(pstContext_->pclMessageObject)
+   {
+      return(pstContext_->pclMessageObject->ScriptEndSector(ulResponseTime_));
+   }
+   return(FALSE);
+}
+
+extern "C" EXPORT
+BOOL ANT_NVM_EndSector_RTO(ULONG ulResponseTime_)
+{
+   return ANT_NVM_EndSectorCtx_RTO(&stDefaultContext, ulResponseTime_);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Called by the application to dump the contents of the NVM
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_NVM_DumpCtx(ANTContext* pstContext_)
+{
+   return ANT_NVM_DumpCtx_RTO(pstContext_, 0);
+}
+
+extern "C" EXPORT
+BOOL ANT_NVM_Dump()
+{
+   return ANT_NVM_DumpCtx(&stDefaultContext);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Response TimeOut Version
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_NVM_DumpCtx_RTO(ANTContext* pstContext_, ULONG ulResponseTime_)
+//Response time is useless here, but is kept for backwards compatibility
+{
+   if(pstContext_->pclMessageObject)
+   {
+      pstContext_->pclMessageObject->ScriptDump();
+     return TRUE;
+   }
+   return(FALSE);
+}
+
+extern "C" EXPORT
+BOOL ANT_NVM_Dump_RTO(ULONG ulResponseTime_)
+{
+   return ANT_NVM_DumpCtx_RTO(&stDefaultContext, ulResponseTime_);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Called by the application to lock the contents of the NVM
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_NVM_LockCtx(ANTContext* pstContext_)
+{
+   return ANT_NVM_LockCtx_RTO(pstContext_, 0);
+}
+
+extern "C" EXPORT
+BOOL ANT_NVM_Lock()
+{
+   return ANT_NVM_LockCtx(&stDefaultContext);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Response TimeOut Version
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_NVM_LockCtx_RTO(ANTContext* pstContext_, ULONG ulResponseTimeout_)
+{
+   if(pstContext_->pclMessageObject)
+   {
+      return(pstContext_->pclMessageObject->ScriptLock(ulResponseTimeout_));
+   }
+   return(FALSE);
+}
+
+extern "C" EXPORT
+BOOL ANT_NVM_Lock_RTO(ULONG ulResponseTimeout_)
+{
+   return ANT_NVM_LockCtx_RTO(&stDefaultContext, ulResponseTimeout_);
+}
+
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Called by the application to set the state of the FE (FIT1e)
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL FIT_SetFEStateCtx(ANTContext* pstContext_, UCHAR ucFEState_)
+{
+   return FIT_SetFEStateCtx_RTO(pstContext_, ucFEState_, 0);
+}
+
+extern "C" EXPORT
+BOOL FIT_SetFEState(UCHAR ucFEState_)
+{
+   return FIT_SetFEStateCtx(&stDefaultContext, ucFEState_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Response TimeOut Version
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL FIT_SetFEStateCtx_RTO(ANTContext* pstContext_, UCHAR ucFEState_, ULONG ulResponseTime_)
+{
+   if(pstContext_->pclMessageObject)
+   {
+      return(pstContext_->pclMessageObject->FITSetFEState(ucFEState_, ulResponseTime_));
+   }
+   return(FALSE);
+}
+
+extern "C" EXPORT
+BOOL FIT_SetFEState_RTO(UCHAR ucFEState_, ULONG ulResponseTime_)
+{
+   return FIT_SetFEStateCtx_RTO(&stDefaultContext, ucFEState_, ulResponseTime_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Called by the application to set the pairing distance (FIT1e)
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL FIT_AdjustPairingSettingsCtx(ANTContext* pstContext_, UCHAR ucSearchLv_, UCHAR ucPairLv_, UCHAR ucTrackLv_)
+{
+   return FIT_AdjustPairingSettingsCtx_RTO(pstContext_, ucSearchLv_, ucPairLv_, ucTrackLv_, 0);
+}
+
+extern "C" EXPORT
+BOOL FIT_AdjustPairingSettings(UCHAR ucSearchLv_, UCHAR ucPairLv_, UCHAR ucTrackLv_)
+{
+   return FIT_AdjustPairingSettingsCtx(&stDefaultContext, ucSearchLv_, ucPairLv_, ucTrackLv_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Response TimeOut Version
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL FIT_AdjustPairingSettingsCtx_RTO(ANTContext* pstContext_, UCHAR ucSearchLv_, UCHAR ucPairLv_, UCHAR ucTrackLv_, ULONG ulResponseTime_)
+{
+   if(pstContext_->pclMessageObject)
+   {
+      return(pstContext_->pclMessageObject->FITAdjustPairingSettings(ucSearchLv_, ucPairLv_, ucTrackLv_, ulResponseTime_));
+   }
+   return(FALSE);
+}
+
+extern "C" EXPORT
+BOOL FIT_AdjustPairingSettings_RTO(UCHAR ucSearchLv_, UCHAR ucPairLv_, UCHAR ucTrackLv_, ULONG ulResponseTime_)
+{
+   return FIT_AdjustPairingSettingsCtx_RTO(&stDefaultContext, ucSearchLv_, ucPairLv_, ucTrackLv_, ulResponseTime_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Called by the application to construct and send an extended broadcast data message.
+// This message will be broadcast on the next synchronous channel period.
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_SendExtBroadcastDataCtx(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR *pucData_)
+{
+   if(!pstContext_->pclMessageObject)
+      return FALSE;
+   return pstContext_->pclMessageObject->SendExtBroadcastData(ucANTChannel_, pucData_);
+}
+
+extern "C" EXPORT
+BOOL ANT_SendExtBroadcastData(UCHAR ucANTChannel_, UCHAR *pucData_)
+{
+   return ANT_SendExtBroadcastDataCtx(&stDefaultContext, ucANTChannel_, pucData_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Called by the application to construct and send an extended acknowledged data
+// mesg.  This message will be transmitted on the next synchronous channel
+// period.
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_SendExtAcknowledgedDataCtx(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR *pucData_)
+{
+   return ANT_SendExtAcknowledgedDataCtx_RTO(pstContext_, ucANTChannel_, pucData_, 0);
+}
+
+extern "C" EXPORT
+BOOL ANT_SendExtAcknowledgedData(UCHAR ucANTChannel_, UCHAR *pucData_)
+{
+   return ANT_SendExtAcknowledgedDataCtx(&stDefaultContext, ucANTChannel_, pucData_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Response TimeOut Version
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_SendExtAcknowledgedDataCtx_RTO(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR *pucData_, ULONG ulResponseTime_)
+{
+   if(!pstContext_->pclMessageObject)
+      return FALSE;
+
+   return (ANTFRAMER_PASS == pstContext_->pclMessageObject->SendExtAcknowledgedData(ucANTChannel_, pucData_, ulResponseTime_));
+}
+
+extern "C" EXPORT
+BOOL ANT_SendExtAcknowledgedData_RTO(UCHAR ucANTChannel_, UCHAR *pucData_, ULONG ulResponseTime_)
+{
+   return ANT_SendExtAcknowledgedDataCtx_RTO(&stDefaultContext, ucANTChannel_, pucData_, ulResponseTime_);
+}
+
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Called by the application to construct and send extended burst data
+// mesg.
+///////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Used to send extended burst data with individual packets.  Proper sequence number
+// of packet is maintained by the application.
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_SendExtBurstTransferPacketCtx(ANTContext* pstContext_, UCHAR ucANTChannelSeq_, UCHAR *pucData_)
+{
+   if(pstContext_->pclMessageObject)
+   {
+      ANT_MESSAGE stMessage;
+
+      stMessage.ucMessageID = MESG_EXT_BURST_DATA_ID;
+      stMessage.aucData[0] = ucANTChannelSeq_;
+      memcpy(&stMessage.aucData[1],pucData_, MESG_EXT_DATA_SIZE-1);
+
+      return pstContext_->pclMessageObject->WriteMessage(&stMessage, MESG_EXT_DATA_SIZE);
+   }
+   return(FALSE);
+}
+
+extern "C" EXPORT
+BOOL ANT_SendExtBurstTransferPacket(UCHAR ucANTChannelSeq_, UCHAR *pucData_)
+{
+   return ANT_SendExtBurstTransferPacketCtx(&stDefaultContext, ucANTChannelSeq_, pucData_);
+}
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Used to send extended burst data using a block of data.  Proper sequence number
+// of packet is maintained by the function.  Useful for testing purposes.
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+USHORT ANT_SendExtBurstTransferCtx(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR *pucData_, USHORT usDataPackets_)
+{
+   return ANT_SendExtBurstTransferCtx_RTO(pstContext_, ucANTChannel_, pucData_, usDataPackets_, 0);
+}
+
+extern "C" EXPORT
+USHORT ANT_SendExtBurstTransfer(UCHAR ucANTChannel_, UCHAR *pucData_, USHORT usDataPackets_)
+{
+   return ANT_SendExtBurstTransferCtx(&stDefaultContext, ucANTChannel_, pucData_, usDataPackets_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Response TimeOut Version
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+USHORT ANT_SendExtBurstTransferCtx_RTO(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR *pucData_, USHORT usDataPackets_, ULONG ulResponseTime_)
+{
+   if(!pstContext_->pclMessageObject)
+      return FALSE;
+
+   return (ANTFRAMER_PASS == pstContext_->pclMessageObject->SendExtBurstTransfer(ucANTChannel_, pucData_, usDataPackets_*8, ulResponseTime_));
+}
+
+extern "C" EXPORT
+USHORT ANT_SendExtBurstTransfer_RTO(UCHAR ucANTChannel_, UCHAR *pucData_, USHORT usDataPackets_, ULONG ulResponseTime_)
+{
+   return ANT_SendExtBurstTransferCtx_RTO(&stDefaultContext, ucANTChannel_, pucData_, usDataPackets_, ulResponseTime_);
+}
+
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Used to force the module to use extended rx messages all the time
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_RxExtMesgsEnableCtx(ANTContext* pstContext_, UCHAR ucEnable_)
+{
+   return ANT_RxExtMesgsEnableCtx_RTO(pstContext_, ucEnable_, 0);
+}
+
+extern "C" EXPORT
+BOOL ANT_RxExtMesgsEnable(UCHAR ucEnable_)
+{
+   return ANT_RxExtMesgsEnableCtx(&stDefaultContext, ucEnable_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Response TimeOut Version
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_RxExtMesgsEnableCtx_RTO(ANTContext* pstContext_, UCHAR ucEnable_, ULONG ulResponseTimeout_)
+{
+   if(pstContext_->pclMessageObject)
+   {
+      return(pstContext_->pclMessageObject->RxExtMesgsEnable(ucEnable_, ulResponseTimeout_));
+   }
+   return(FALSE);
+}
+
+extern "C" EXPORT
+BOOL ANT_RxExtMesgsEnable_RTO(UCHAR ucEnable_, ULONG ulResponseTimeout_)
+{
+   return ANT_RxExtMesgsEnableCtx_RTO(&stDefaultContext, ucEnable_, ulResponseTimeout_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Has the module add the channel ID, RSSI and/or receive time stamp to
+// every data message it receives.  They arrive as EVENT_RX_FLAG_xxx
+// with the flag byte after the payload and the fields in that order.
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_SetLibConfigCtx(ANTContext* pstContext_, UCHAR ucLibConfigFlags_)
+{
+   return ANT_SetLibConfigCtx_RTO(pstContext_, ucLibConfigFlags_, 0);
+}
+
+extern "C" EXPORT
+BOOL ANT_SetLibConfig(UCHAR ucLibConfigFlags_)
+{
+   return ANT_SetLibConfigCtx(&stDefaultContext, ucLibConfigFlags_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Response TimeOut Version
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_SetLibConfigCtx_RTO(ANTContext* pstContext_, UCHAR ucLibConfigFlags_, ULONG ulResponseTime_)
+{
+   if(pstContext_->pclMessageObject)
+   {
+      return(pstContext_->pclMessageObject->SetLibConfig(ucLibConfigFlags_, ulResponseTime_));
+   }
+   return(FALSE);
+}
+
+extern "C" EXPORT
+BOOL ANT_SetLibConfig_RTO(UCHAR ucLibConfigFlags_, ULONG ulResponseTime_)
+{
+   return ANT_SetLibConfigCtx_RTO(&stDefaultContext, ucLibConfigFlags_, ulResponseTime_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Used to set a channel device ID to the module serial number
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_SetSerialNumChannelIdCtx(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR ucDeviceType_, UCHAR ucTransmissionType_)
+{
+   return ANT_SetSerialNumChannelIdCtx_RTO(pstContext_, ucANTChannel_, ucDeviceType_, ucTransmissionType_, 0);
+}
+
+extern "C" EXPORT
+BOOL ANT_SetSerialNumChannelId(UCHAR ucANTChannel_, UCHAR ucDeviceType_, UCHAR ucTransmissionType_)
+{
+   return ANT_SetSerialNumChannelIdCtx(&stDefaultContext, ucANTChannel_, ucDeviceType_, ucTransmissionType_);
+}
+
+
+///////////////////////////////////////////////////////////////////////
+// Response TimeOut Version
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_SetSerialNumChannelIdCtx_RTO(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR ucDeviceType_, UCHAR ucTransmissionType_, ULONG ulResponseTime_)
+{
+   if(pstContext_->pclMessageObject)
+   {
+      return(pstContext_->pclMessageObject->SetSerialNumChannelId(ucANTChannel_, ucDeviceType_, ucTransmissionType_, ulResponseTime_));
+   }
+   return(FALSE);
+}
+
+extern "C" EXPORT
+BOOL ANT_SetSerialNumChannelId_RTO(UCHAR ucANTChannel_, UCHAR ucDeviceType_, UCHAR ucTransmissionType_, ULONG ulResponseTime_)
+{
+   return ANT_SetSerialNumChannelIdCtx_RTO(&stDefaultContext, ucANTChannel_, ucDeviceType_, ucTransmissionType_, ulResponseTime_);
+}
+
+
+///////////////////////////////////////////////////////////////////////
+// Priority: Any
+//
+// Enables the module LED to flash on RF activity
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_EnableLEDCtx(ANTContext* pstContext_, UCHAR ucEnable_)
+{
+   return ANT_EnableLEDCtx_RTO(pstContext_, ucEnable_, 0);
+}
+
+extern "C" EXPORT
+BOOL ANT_EnableLED(UCHAR ucEnable_)
+{
+   return ANT_EnableLEDCtx(&stDefaultContext, ucEnable_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Response TimeOut Version
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_EnableLEDCtx_RTO(ANTContext* pstContext_, UCHAR ucEnable_, ULONG ulResponseTime_)
+{
+   if(pstContext_->pclMessageObject)
+   {
+      return(pstContext_->pclMessageObject->EnableLED(ucEnable_, ulResponseTime_));
+   }
+   return(FALSE);
+}
+
+extern "C" EXPORT
+BOOL ANT_EnableLED_RTO(UCHAR ucEnable_, ULONG ulResponseTime_)
+{
+   return ANT_EnableLEDCtx_RTO(&stDefaultContext, ucEnable_, ulResponseTime_);
+}
+
 
 
 ///////////////////////////////////////////////////////////////////////
 // Called by the application to get the product string and serial number string (four bytes) of a particular device
 ///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_GetDeviceUSBInfo(UCHAR ucDeviceNum, UCHAR* pucProductString, UCHAR* pucSerialString)
+BOOL ANT_GetDeviceUSBInfoCtx(ANTContext* pstContext_, UCHAR ucDeviceNum, UCHAR* pucProductString, UCHAR* pucSerialString)
 {
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->GetDeviceUSBInfo(ucDeviceNum, pucProductString, pucSerialString, USB_MAX_STRLEN));
+      return(pstContext_->pclMessageObject->GetDeviceUSBInfo(ucDeviceNum, pucProductString, pucSerialString, USB_MAX_STRLEN));
    }
    return(FALSE);
 }
 
+extern "C" EXPORT
+BOOL ANT_GetDeviceUSBInfo(UCHAR ucDeviceNum, UCHAR* pucProductString, UCHAR* pucSerialString)
+{
+   return ANT_GetDeviceUSBInfoCtx(&stDefaultContext, ucDeviceNum, pucProductString, pucSerialString);
+}
+
 ///////////////////////////////////////////////////////////////////////
 // Called by the application to get the USB PID
 ///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_GetDeviceUSBPIDCtx(ANTContext* pstContext_, USHORT* pusPID_)
+{
+   if(pstContext_->pclMessageObject)
+   {
+      return(pstContext_->pclMessageObject->GetDeviceUSBPID(*pusPID_));
+   }
+   return (FALSE);
+}
+
 extern "C" EXPORT
 BOOL ANT_GetDeviceUSBPID(USHORT* pusPID_)
 {
-   if(pclMessageObject)
+   return ANT_GetDeviceUSBPIDCtx(&stDefaultContext, pusPID_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Called by the application to get the USB VID
+///////////////////////////////////////////////////////////////////////
+extern "C" EXPORT
+BOOL ANT_GetDeviceUSBVIDCtx(ANTContext* pstContext_, USHORT* pusVID_)
+{
+   if(pstContext_->pclMessageObject)
    {
-      return(pclMessageObject->GetDeviceUSBPID(*pusPID_));
+      return(pstContext_->pclMessageObject->GetDeviceUSBVID(*pusVID_));
    }
    return (FALSE);
 }
 
-///////////////////////////////////////////////////////////////////////
-// Called by the application to get the USB VID
-///////////////////////////////////////////////////////////////////////
 extern "C" EXPORT
-BOOL ANT_GetDeviceUSBVID(USHORT* pusVID_)
+BOOL ANT_GetDeviceUSBVID(USHORT* pusVID_)
+{
+   return ANT_GetDeviceUSBVIDCtx(&stDefaultContext, pusVID_);
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////
+// The following are the Integrated ANTFS_Client functions
+////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////
+
+//Memory Device Commands/////////////
+extern "C" EXPORT
+BOOL ANTFS_InitEEPROMDeviceCtx(ANTContext* pstContext_, USHORT usPageSize_, UCHAR ucAddressConfig_)
+{
+   return (pstContext_->pclMessageObject->InitEEPROMDevice(usPageSize_, ucAddressConfig_, 3000));
+}
+
+extern "C" EXPORT
+BOOL ANTFS_InitEEPROMDevice(USHORT usPageSize_, UCHAR ucAddressConfig_)
+{
+   return ANTFS_InitEEPROMDeviceCtx(&stDefaultContext, usPageSize_, ucAddressConfig_);
+}
+
+//File System Commands//////////////
+extern "C" EXPORT
+BOOL ANTFS_InitFSMemoryCtx(ANTContext* pstContext_)
+{
+   return (pstContext_->pclMessageObject->InitFSMemory(3000));
+}
+
+extern "C" EXPORT
+BOOL ANTFS_InitFSMemory()
+{
+   return ANTFS_InitFSMemoryCtx(&stDefaultContext);
+}
+
+extern "C" EXPORT
+BOOL ANTFS_FormatFSMemoryCtx(ANTContext* pstContext_, USHORT usNumberOfSectors_, USHORT usPagesPerSector_)
+{
+   return (pstContext_->pclMessageObject->FormatFSMemory(usNumberOfSectors_, usPagesPerSector_, 3000));
+}
+
+extern "C" EXPORT
+BOOL ANTFS_FormatFSMemory(USHORT usNumberOfSectors_, USHORT usPagesPerSector_)
+{
+   return ANTFS_FormatFSMemoryCtx(&stDefaultContext, usNumberOfSectors_, usPagesPerSector_);
+}
+
+extern "C" EXPORT
+BOOL ANTFS_SaveDirectoryCtx(ANTContext* pstContext_)
+{
+   return (pstContext_->pclMessageObject->SaveDirectory(3000));
+}
+
+extern "C" EXPORT
+BOOL ANTFS_SaveDirectory()
+{
+   return ANTFS_SaveDirectoryCtx(&stDefaultContext);
+}
+
+extern "C" EXPORT
+BOOL ANTFS_DirectoryRebuildCtx(ANTContext* pstContext_)
+{
+   return (pstContext_->pclMessageObject->DirectoryRebuild(3000));
+}
+
+extern "C" EXPORT
+BOOL ANTFS_DirectoryRebuild()
+{
+   return ANTFS_DirectoryRebuildCtx(&stDefaultContext);
+}
+
+extern "C" EXPORT
+BOOL ANTFS_FileDeleteCtx(ANTContext* pstContext_, UCHAR ucFileHandle_)
+{
+   return (pstContext_->pclMessageObject->FileDelete(ucFileHandle_, 3000));
+}
+
+extern "C" EXPORT
+BOOL ANTFS_FileDelete(UCHAR ucFileHandle_)
+{
+   return ANTFS_FileDeleteCtx(&stDefaultContext, ucFileHandle_);
+}
+
+extern "C" EXPORT
+BOOL ANTFS_FileCloseCtx(ANTContext* pstContext_, UCHAR ucFileHandle_)
+{
+   return (pstContext_->pclMessageObject->FileClose(ucFileHandle_, 3000));
+}
+
+extern "C" EXPORT
+BOOL ANTFS_FileClose(UCHAR ucFileHandle_)
+{
+   return ANTFS_FileCloseCtx(&stDefaultContext, ucFileHandle_);
+}
+
+extern "C" EXPORT
+BOOL ANTFS_SetFileSpecificFlagsCtx(ANTContext* pstContext_, UCHAR ucFileHandle_, UCHAR ucFlags_)
+{
+   return (pstContext_->pclMessageObject->SetFileSpecificFlags(ucFileHandle_, ucFlags_, 3000));
+}
+
+extern "C" EXPORT
+BOOL ANTFS_SetFileSpecificFlags(UCHAR ucFileHandle_, UCHAR ucFlags_)
+{
+   return ANTFS_SetFileSpecificFlagsCtx(&stDefaultContext, ucFileHandle_, ucFlags_);
+}
+
+extern "C" EXPORT
+UCHAR ANTFS_DirectoryReadLockCtx(ANTContext* pstContext_, BOOL bLock_)
+{
+   return (pstContext_->pclMessageObject->DirectoryReadLock(bLock_, 3000));
+}
+
+extern "C" EXPORT
+UCHAR ANTFS_DirectoryReadLock(BOOL bLock_)
+{
+   return ANTFS_DirectoryReadLockCtx(&stDefaultContext, bLock_);
+}
+
+extern "C" EXPORT
+BOOL ANTFS_SetSystemTimeCtx(ANTContext* pstContext_, ULONG ulTime_)
+{
+   return (pstContext_->pclMessageObject->SetSystemTime(ulTime_, 3000));
+}
+
+extern "C" EXPORT
+BOOL ANTFS_SetSystemTime(ULONG ulTime_)
+{
+   return ANTFS_SetSystemTimeCtx(&stDefaultContext, ulTime_);
+}
+
+
+
+//File System Requests////////////
+extern "C" EXPORT
+ULONG ANTFS_GetUsedSpaceCtx(ANTContext* pstContext_)
+{
+   return (pstContext_->pclMessageObject->GetUsedSpace(3000));
+}
+
+extern "C" EXPORT
+ULONG ANTFS_GetUsedSpace()
+{
+   return ANTFS_GetUsedSpaceCtx(&stDefaultContext);
+}
+
+extern "C" EXPORT
+ULONG ANTFS_GetFreeSpaceCtx(ANTContext* pstContext_)
+{
+   return (pstContext_->pclMessageObject->GetFreeFSSpace(3000));
+}
+
+extern "C" EXPORT
+ULONG ANTFS_GetFreeSpace()
+{
+   return ANTFS_GetFreeSpaceCtx(&stDefaultContext);
+}
+
+extern "C" EXPORT
+USHORT ANTFS_FindFileIndexCtx(ANTContext* pstContext_, UCHAR ucFileDataType_, UCHAR ucFileSubType_, USHORT usFileNumber_)
+{
+   return (pstContext_->pclMessageObject->FindFileIndex(ucFileDataType_, ucFileSubType_, usFileNumber_, 3000));
+}
+
+extern "C" EXPORT
+USHORT ANTFS_FindFileIndex(UCHAR ucFileDataType_, UCHAR ucFileSubType_, USHORT usFileNumber_)
+{
+   return ANTFS_FindFileIndexCtx(&stDefaultContext, ucFileDataType_, ucFileSubType_, usFileNumber_);
+}
+
+extern "C" EXPORT
+UCHAR ANTFS_ReadDirectoryAbsoluteCtx(ANTContext* pstContext_, ULONG ulOffset_, UCHAR ucSize_, UCHAR* pucBuffer_)
+{
+   return (pstContext_->pclMessageObject->ReadDirectoryAbsolute(ulOffset_, ucSize_, pucBuffer_,3000));
+}
+
+extern "C" EXPORT
+UCHAR ANTFS_ReadDirectoryAbsolute(ULONG ulOffset_, UCHAR ucSize_, UCHAR* pucBuffer_)
+{
+   return ANTFS_ReadDirectoryAbsoluteCtx(&stDefaultContext, ulOffset_, ucSize_, pucBuffer_);
+}
+
+extern "C" EXPORT
+UCHAR ANTFS_DirectoryReadEntryCtx(ANTContext* pstContext_, USHORT usFileIndex_, UCHAR* ucFileDirectoryBuffer_)
+{
+   return (pstContext_->pclMessageObject->DirectoryReadEntry (usFileIndex_, ucFileDirectoryBuffer_, 3000));
+}
+
+extern "C" EXPORT
+UCHAR ANTFS_DirectoryReadEntry (USHORT usFileIndex_, UCHAR* ucFileDirectoryBuffer_)
+{
+   return ANTFS_DirectoryReadEntryCtx(&stDefaultContext, usFileIndex_, ucFileDirectoryBuffer_);
+}
+
+extern "C" EXPORT
+ULONG  ANTFS_DirectoryGetSizeCtx(ANTContext* pstContext_)
+{
+   return (pstContext_->pclMessageObject->DirectoryGetSize(3000));
+}
+
+extern "C" EXPORT
+ULONG  ANTFS_DirectoryGetSize()
+{
+   return ANTFS_DirectoryGetSizeCtx(&stDefaultContext);
+}
+
+extern "C" EXPORT
+USHORT ANTFS_FileCreateCtx(ANTContext* pstContext_, USHORT usFileIndex_, UCHAR ucFileDataType_, ULONG ulFileIdentifier_, UCHAR ucFileDataTypeSpecificFlags_, UCHAR ucGeneralFlags)
+{
+   return (pstContext_->pclMessageObject->FileCreate(usFileIndex_, ucFileDataType_, ulFileIdentifier_, ucFileDataTypeSpecificFlags_, ucGeneralFlags, 3000));
+}
+
+extern "C" EXPORT
+USHORT ANTFS_FileCreate(USHORT usFileIndex_, UCHAR ucFileDataType_, ULONG ulFileIdentifier_, UCHAR ucFileDataTypeSpecificFlags_, UCHAR ucGeneralFlags)
+{
+   return ANTFS_FileCreateCtx(&stDefaultContext, usFileIndex_, ucFileDataType_, ulFileIdentifier_, ucFileDataTypeSpecificFlags_, ucGeneralFlags);
+}
+
+extern "C" EXPORT
+UCHAR ANTFS_FileOpenCtx(ANTContext* pstContext_, USHORT usFileIndex_, UCHAR ucOpenFlags_)
+{
+   return (pstContext_->pclMessageObject->FileOpen(usFileIndex_, ucOpenFlags_, 3000));
+}
+
+extern "C" EXPORT
+UCHAR ANTFS_FileOpen(USHORT usFileIndex_, UCHAR ucOpenFlags_)
+{
+   return ANTFS_FileOpenCtx(&stDefaultContext, usFileIndex_, ucOpenFlags_);
+}
+
+
+extern "C" EXPORT
+UCHAR ANTFS_FileReadAbsoluteCtx(ANTContext* pstContext_, UCHAR ucFileHandle_, ULONG ulOffset_, UCHAR ucReadSize_, UCHAR* pucReadBuffer_)
+{
+   return (pstContext_->pclMessageObject->FileReadAbsolute(ucFileHandle_, ulOffset_, ucReadSize_, pucReadBuffer_, 3000));
+}
+
+extern "C" EXPORT
+UCHAR ANTFS_FileReadAbsolute(UCHAR ucFileHandle_, ULONG ulOffset_, UCHAR ucReadSize_, UCHAR* pucReadBuffer_)
+{
+   return ANTFS_FileReadAbsoluteCtx(&stDefaultContext, ucFileHandle_, ulOffset_, ucReadSize_, pucReadBuffer_);
+}
+
+
+extern "C" EXPORT
+UCHAR ANTFS_FileReadRelativeCtx(ANTContext* pstContext_, UCHAR ucFileHandle_, UCHAR ucReadSize_, UCHAR* pucReadBuffer_)
+{
+   return (pstContext_->pclMessageObject->FileReadRelative(ucFileHandle_, ucReadSize_, pucReadBuffer_, 3000));
+}
+
+extern "C" EXPORT
+UCHAR ANTFS_FileReadRelative(UCHAR ucFileHandle_, UCHAR ucReadSize_, UCHAR* pucReadBuffer_)
 {
-   if(pclMessageObject)
-   {
-      return(pclMessageObject->GetDeviceUSBVID(*pusVID_));
-   }
-   return (FALSE);
+   return ANTFS_FileReadRelativeCtx(&stDefaultContext, ucFileHandle_, ucReadSize_, pucReadBuffer_);
 }
 
 
-
-////////////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////////////
-// The following are the Integrated ANTFS_Client functions
-////////////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////////////
-
-//Memory Device Commands/////////////
 extern "C" EXPORT
-BOOL ANTFS_InitEEPROMDevice(USHORT usPageSize_, UCHAR ucAddressConfig_)
+UCHAR ANTFS_FileWriteAbsoluteCtx(ANTContext* pstContext_, UCHAR ucFileHandle_, ULONG ulFileOffset_, UCHAR ucWriteSize_, const UCHAR* pucWriteBuffer_, UCHAR* ucBytesWritten_)
 {
-   return (pclMessageObject->InitEEPROMDevice(usPageSize_, ucAddressConfig_, 3000));
+   return (pstContext_->pclMessageObject->FileWriteAbsolute(ucFileHandle_, ulFileOffset_, ucWriteSize_, pucWriteBuffer_, ucBytesWritten_, 3000));
 }
 
-//File System Commands//////////////
 extern "C" EXPORT
-BOOL ANTFS_InitFSMemory()
+UCHAR ANTFS_FileWriteAbsolute(UCHAR ucFileHandle_, ULONG ulFileOffset_, UCHAR ucWriteSize_, const UCHAR* pucWriteBuffer_, UCHAR* ucBytesWritten_)
 {
-   return (pclMessageObject->InitFSMemory(3000));
+   return ANTFS_FileWriteAbsoluteCtx(&stDefaultContext, ucFileHandle_, ulFileOffset_, ucWriteSize_, pucWriteBuffer_, ucBytesWritten_);
 }
 
 extern "C" EXPORT
-BOOL ANTFS_FormatFSMemory(USHORT usNumberOfSectors_, USHORT usPagesPerSector_)
+UCHAR ANTFS_FileWriteRelativeCtx(ANTContext* pstContext_, UCHAR ucFileHandle_, UCHAR ucWriteSize_, const UCHAR* pucWriteBuffer_, UCHAR* ucBytesWritten_)
 {
-   return (pclMessageObject->FormatFSMemory(usNumberOfSectors_, usPagesPerSector_, 3000));
+   return (pstContext_->pclMessageObject->FileWriteRelative(ucFileHandle_, ucWriteSize_, pucWriteBuffer_, ucBytesWritten_, 3000));
 }
 
 extern "C" EXPORT
-BOOL ANTFS_SaveDirectory()
+UCHAR ANTFS_FileWriteRelative(UCHAR ucFileHandle_, UCHAR ucWriteSize_, const UCHAR* pucWriteBuffer_, UCHAR* ucBytesWritten_)
 {
-   return (pclMessageObject->SaveDirectory(3000));
+   return ANTFS_FileWriteRelativeCtx(&stDefaultContext, ucFileHandle_, ucWriteSize_, pucWriteBuffer_, ucBytesWritten_);
 }
 
 extern "C" EXPORT
-BOOL ANTFS_DirectoryRebuild()
+ULONG ANTFS_FileGetSizeCtx(ANTContext* pstContext_, UCHAR ucFileHandle_)
 {
-   return (pclMessageObject->DirectoryRebuild(3000));
+   return (pstContext_->pclMessageObject->FileGetSize(ucFileHandle_, 3000));
 }
 
 extern "C" EXPORT
-BOOL ANTFS_FileDelete(UCHAR ucFileHandle_)
+ULONG ANTFS_FileGetSize(UCHAR ucFileHandle_)
 {
-   return (pclMessageObject->FileDelete(ucFileHandle_, 3000));
+   return ANTFS_FileGetSizeCtx(&stDefaultContext, ucFileHandle_);
 }
 
 extern "C" EXPORT
-BOOL ANTFS_FileClose(UCHAR ucFileHandle_)
+ULONG ANTFS_FileGetSizeInMemCtx(ANTContext* pstContext_, UCHAR ucFileHandle_)
 {
-   return (pclMessageObject->FileClose(ucFileHandle_, 3000));
+   return (pstContext_->pclMessageObject->FileGetSizeInMem(ucFileHandle_, 3000));
 }
 
 extern "C" EXPORT
-BOOL ANTFS_SetFileSpecificFlags(UCHAR ucFileHandle_, UCHAR ucFlags_)
+ULONG ANTFS_FileGetSizeInMem(UCHAR ucFileHandle_)
 {
-   return (pclMessageObject->SetFileSpecificFlags(ucFileHandle_, ucFlags_, 3000));
+   return ANTFS_FileGetSizeInMemCtx(&stDefaultContext, ucFileHandle_);
 }
 
 extern "C" EXPORT
-UCHAR ANTFS_DirectoryReadLock(BOOL bLock_)
+UCHAR ANTFS_FileGetSpecificFlagsCtx(ANTContext* pstContext_, UCHAR ucFileHandle_)
 {
-   return (pclMessageObject->DirectoryReadLock(bLock_, 3000));
+   return (pstContext_->pclMessageObject->FileGetSpecificFlags(ucFileHandle_, 3000));
 }
 
 extern "C" EXPORT
-BOOL ANTFS_SetSystemTime(ULONG ulTime_)
+UCHAR ANTFS_FileGetSpecificFlags(UCHAR ucFileHandle_)
 {
-   return (pclMessageObject->SetSystemTime(ulTime_, 3000));
+   return ANTFS_FileGetSpecificFlagsCtx(&stDefaultContext, ucFileHandle_);
 }
 
-
-
-//File System Requests////////////
 extern "C" EXPORT
-ULONG ANTFS_GetUsedSpace()
+ULONG ANTFS_FileGetSystemTimeCtx(ANTContext* pstContext_)
 {
-   return (pclMessageObject->GetUsedSpace(3000));
+   return (pstContext_->pclMessageObject->FileGetSystemTime(3000));
 }
 
 extern "C" EXPORT
-ULONG ANTFS_GetFreeSpace()
+ULONG ANTFS_FileGetSystemTime()
 {
-   return (pclMessageObject->GetFreeFSSpace(3000));
+   return ANTFS_FileGetSystemTimeCtx(&stDefaultContext);
 }
 
+
+//FS-Crypto Commands/////////////
 extern "C" EXPORT
-USHORT ANTFS_FindFileIndex(UCHAR ucFileDataType_, UCHAR ucFileSubType_, USHORT usFileNumber_)
+UCHAR ANTFS_CryptoAddUserKeyIndexCtx(ANTContext* pstContext_, UCHAR ucIndex_,  UCHAR* pucKey_)
 {
-   return (pclMessageObject->FindFileIndex(ucFileDataType_, ucFileSubType_, usFileNumber_, 3000));
+   return (pstContext_->pclMessageObject->CryptoAddUserKeyIndex(ucIndex_, pucKey_, 3000));
 }
 
 extern "C" EXPORT
-UCHAR ANTFS_ReadDirectoryAbsolute(ULONG ulOffset_, UCHAR ucSize_, UCHAR* pucBuffer_)
+UCHAR ANTFS_CryptoAddUserKeyIndex(UCHAR ucIndex_,  UCHAR* pucKey_)
 {
-   return (pclMessageObject->ReadDirectoryAbsolute(ulOffset_, ucSize_, pucBuffer_,3000));
+   return ANTFS_CryptoAddUserKeyIndexCtx(&stDefaultContext, ucIndex_, pucKey_);
 }
 
 extern "C" EXPORT
-UCHAR ANTFS_DirectoryReadEntry (USHORT usFileIndex_, UCHAR* ucFileDirectoryBuffer_)
+UCHAR ANTFS_CryptoSetUserKeyIndexCtx(ANTContext* pstContext_, UCHAR ucIndex_)
 {
-   return (pclMessageObject->DirectoryReadEntry (usFileIndex_, ucFileDirectoryBuffer_, 3000));
+   return (pstContext_->pclMessageObject->CryptoSetUserKeyIndex(ucIndex_, 3000));
 }
 
 extern "C" EXPORT
-ULONG  ANTFS_DirectoryGetSize()
+UCHAR ANTFS_CryptoSetUserKeyIndex(UCHAR ucIndex_)
 {
-   return (pclMessageObject->DirectoryGetSize(3000));
+   return ANTFS_CryptoSetUserKeyIndexCtx(&stDefaultContext, ucIndex_);
 }
 
 extern "C" EXPORT
-USHORT ANTFS_FileCreate(USHORT usFileIndex_, UCHAR ucFileDataType_, ULONG ulFileIdentifier_, UCHAR ucFileDataTypeSpecificFlags_, UCHAR ucGeneralFlags)
+UCHAR ANTFS_CryptoSetUserKeyValCtx(ANTContext* pstContext_, UCHAR* pucKey_)
 {
-   return (pclMessageObject->FileCreate(usFileIndex_, ucFileDataType_, ulFileIdentifier_, ucFileDataTypeSpecificFlags_, ucGeneralFlags, 3000));
+   return (pstContext_->pclMessageObject->CryptoSetUserKeyVal(pucKey_, 3000));
 }
 
 extern "C" EXPORT
-UCHAR ANTFS_FileOpen(USHORT usFileIndex_, UCHAR ucOpenFlags_)
+UCHAR ANTFS_CryptoSetUserKeyVal(UCHAR* pucKey_)
 {
-   return (pclMessageObject->FileOpen(usFileIndex_, ucOpenFlags_, 3000));
+   return ANTFS_CryptoSetUserKeyValCtx(&stDefaultContext, pucKey_);
 }
 
 
+//FIT Commands///////////////////////
 extern "C" EXPORT
-UCHAR ANTFS_FileReadAbsolute(UCHAR ucFileHandle_, ULONG ulOffset_, UCHAR ucReadSize_, UCHAR* pucReadBuffer_)
+UCHAR ANTFS_FitFileIntegrityCheckCtx(ANTContext* pstContext_, UCHAR ucFileHandle_)
 {
-   return (pclMessageObject->FileReadAbsolute(ucFileHandle_, ulOffset_, ucReadSize_, pucReadBuffer_, 3000));
+   return (pstContext_->pclMessageObject->FitFileIntegrityCheck(ucFileHandle_, 3000));
 }
 
-
 extern "C" EXPORT
-UCHAR ANTFS_FileReadRelative(UCHAR ucFileHandle_, UCHAR ucReadSize_, UCHAR* pucReadBuffer_)
+UCHAR ANTFS_FitFileIntegrityCheck(UCHAR ucFileHandle_)
 {
-   return (pclMessageObject->FileReadRelative(ucFileHandle_, ucReadSize_, pucReadBuffer_, 3000));
+   return ANTFS_FitFileIntegrityCheckCtx(&stDefaultContext, ucFileHandle_);
 }
 
 
+//ANT-FS Commands////////////////////
 extern "C" EXPORT
-UCHAR ANTFS_FileWriteAbsolute(UCHAR ucFileHandle_, ULONG ulFileOffset_, UCHAR ucWriteSize_, const UCHAR* pucWriteBuffer_, UCHAR* ucBytesWritten_)
+UCHAR ANTFS_OpenBeaconCtx(ANTContext* pstContext_)
 {
-   return (pclMessageObject->FileWriteAbsolute(ucFileHandle_, ulFileOffset_, ucWriteSize_, pucWriteBuffer_, ucBytesWritten_, 3000));
+   return (pstContext_->pclMessageObject->OpenBeacon(3000));
 }
 
 extern "C" EXPORT
-UCHAR ANTFS_FileWriteRelative(UCHAR ucFileHandle_, UCHAR ucWriteSize_, const UCHAR* pucWriteBuffer_, UCHAR* ucBytesWritten_)
+UCHAR ANTFS_OpenBeacon()
 {
-   return (pclMessageObject->FileWriteRelative(ucFileHandle_, ucWriteSize_, pucWriteBuffer_, ucBytesWritten_, 3000));
+   return ANTFS_OpenBeaconCtx(&stDefaultContext);
 }
 
 extern "C" EXPORT
-ULONG ANTFS_FileGetSize(UCHAR ucFileHandle_)
+UCHAR ANTFS_CloseBeaconCtx(ANTContext* pstContext_)
 {
-   return (pclMessageObject->FileGetSize(ucFileHandle_, 3000));
+   return (pstContext_->pclMessageObject->CloseBeacon(3000));
 }
 
 extern "C" EXPORT
-ULONG ANTFS_FileGetSizeInMem(UCHAR ucFileHandle_)
+UCHAR ANTFS_CloseBeacon()
 {
-   return (pclMessageObject->FileGetSizeInMem(ucFileHandle_, 3000));
+   return ANTFS_CloseBeaconCtx(&stDefaultContext);
 }
 
 extern "C" EXPORT
-UCHAR ANTFS_FileGetSpecificFlags(UCHAR ucFileHandle_)
+UCHAR ANTFS_ConfigBeaconCtx(ANTContext* pstContext_, USHORT usDeviceType_, USHORT usManufacturer_, UCHAR ucAuthType_, UCHAR ucBeaconStatus_)
 {
-   return (pclMessageObject->FileGetSpecificFlags(ucFileHandle_, 3000));
+   return (pstContext_->pclMessageObject->ConfigBeacon(usDeviceType_, usManufacturer_, ucAuthType_, ucBeaconStatus_, 3000));
 }
 
 extern "C" EXPORT
-ULONG ANTFS_FileGetSystemTime()
+UCHAR ANTFS_ConfigBeacon(USHORT usDeviceType_, USHORT usManufacturer_, UCHAR ucAuthType_, UCHAR ucBeaconStatus_)
 {
-   return (pclMessageObject->FileGetSystemTime(3000));
+   return ANTFS_ConfigBeaconCtx(&stDefaultContext, usDeviceType_, usManufacturer_, ucAuthType_, ucBeaconStatus_);
 }
 
-
-//FS-Crypto Commands/////////////
 extern "C" EXPORT
-UCHAR ANTFS_CryptoAddUserKeyIndex(UCHAR ucIndex_,  UCHAR* pucKey_)
+UCHAR ANTFS_SetFriendlyNameCtx(ANTContext* pstContext_, UCHAR ucLength_, const UCHAR* pucString_)
 {
-   return (pclMessageObject->CryptoAddUserKeyIndex(ucIndex_, pucKey_, 3000));
+   return (pstContext_->pclMessageObject->SetFriendlyName(ucLength_, pucString_, 3000));
 }
 
 extern "C" EXPORT
-UCHAR ANTFS_CryptoSetUserKeyIndex(UCHAR ucIndex_)
+UCHAR ANTFS_SetFriendlyName(UCHAR ucLength_, const UCHAR* pucString_)
 {
-   return (pclMessageObject->CryptoSetUserKeyIndex(ucIndex_, 3000));
+   return ANTFS_SetFriendlyNameCtx(&stDefaultContext, ucLength_, pucString_);
 }
 
 extern "C" EXPORT
-UCHAR ANTFS_CryptoSetUserKeyVal(UCHAR* pucKey_)
+UCHAR ANTFS_SetPasskeyCtx(ANTContext* pstContext_, UCHAR ucLength_, const UCHAR* pucString_)
 {
-   return (pclMessageObject->CryptoSetUserKeyVal(pucKey_, 3000));
+   return (pstContext_->pclMessageObject->SetPasskey(ucLength_, pucString_, 3000));
 }
 
-
-//FIT Commands///////////////////////
 extern "C" EXPORT
-UCHAR ANTFS_FitFileIntegrityCheck(UCHAR ucFileHandle_)
+UCHAR ANTFS_SetPasskey(UCHAR ucLength_, const UCHAR* pucString_)
 {
-   return (pclMessageObject->FitFileIntegrityCheck(ucFileHandle_, 3000));
+   return ANTFS_SetPasskeyCtx(&stDefaultContext, ucLength_, pucString_);
 }
 
-
-//ANT-FS Commands////////////////////
 extern "C" EXPORT
-UCHAR ANTFS_OpenBeacon()
+UCHAR ANTFS_SetBeaconStateCtx(ANTContext* pstContext_, UCHAR ucBeaconStatus_)
 {
-   return (pclMessageObject->OpenBeacon(3000));
+   return (pstContext_->pclMessageObject->SetBeaconState(ucBeaconStatus_, 3000));
 }
 
 extern "C" EXPORT
-UCHAR ANTFS_CloseBeacon()
+UCHAR ANTFS_SetBeaconState(UCHAR ucBeaconStatus_)
 {
-   return (pclMessageObject->CloseBeacon(3000));
+   return ANTFS_SetBeaconStateCtx(&stDefaultContext, ucBeaconStatus_);
 }
 
 extern "C" EXPORT
-UCHAR ANTFS_ConfigBeacon(USHORT usDeviceType_, USHORT usManufacturer_, UCHAR ucAuthType_, UCHAR ucBeaconStatus_)
+UCHAR ANTFS_PairResponseCtx(ANTContext* pstContext_, BOOL bAccept_)
 {
-   return (pclMessageObject->ConfigBeacon(usDeviceType_, usManufacturer_, ucAuthType_, ucBeaconStatus_, 3000));
+   return (pstContext_->pclMessageObject->PairResponse(bAccept_, 3000));
 }
 
 extern "C" EXPORT
-UCHAR ANTFS_SetFriendlyName(UCHAR ucLength_, const UCHAR* pucString_)
+UCHAR ANTFS_PairResponse(BOOL bAccept_)
 {
-   return (pclMessageObject->SetFriendlyName(ucLength_, pucString_, 3000));
+   return ANTFS_PairResponseCtx(&stDefaultContext, bAccept_);
 }
 
 extern "C" EXPORT
-UCHAR ANTFS_SetPasskey(UCHAR ucLength_, const UCHAR* pucString_)
+UCHAR ANTFS_SetLinkFrequencyCtx(ANTContext* pstContext_, UCHAR ucChannelNumber_, UCHAR ucFrequency_)
 {
-   return (pclMessageObject->SetPasskey(ucLength_, pucString_, 3000));
+   return (pstContext_->pclMessageObject->SetLinkFrequency(ucChannelNumber_, ucFrequency_, 3000));
 }
 
 extern "C" EXPORT
-UCHAR ANTFS_SetBeaconState(UCHAR ucBeaconStatus_)
+UCHAR ANTFS_SetLinkFrequency(UCHAR ucChannelNumber_, UCHAR ucFrequency_)
 {
-   return (pclMessageObject->SetBeaconState(ucBeaconStatus_, 3000));
+   return ANTFS_SetLinkFrequencyCtx(&stDefaultContext, ucChannelNumber_, ucFrequency_);
 }
 
 extern "C" EXPORT
-UCHAR ANTFS_PairResponse(BOOL bAccept_)
+UCHAR ANTFS_SetBeaconTimeoutCtx(ANTContext* pstContext_, UCHAR ucTimeout_)
 {
-   return (pclMessageObject->PairResponse(bAccept_, 3000));
+   return (pstContext_->pclMessageObject->SetBeaconTimeout(ucTimeout_, 3000));
 }
 
 extern "C" EXPORT
-UCHAR ANTFS_SetLinkFrequency(UCHAR ucChannelNumber_, UCHAR ucFrequency_)
+UCHAR ANTFS_SetBeaconTimeout(UCHAR ucTimeout_)
 {
-   return (pclMessageObject->SetLinkFrequency(ucChannelNumber_, ucFrequency_, 3000));
+   return ANTFS_SetBeaconTimeoutCtx(&stDefaultContext, ucTimeout_);
 }
 
 extern "C" EXPORT
-UCHAR ANTFS_SetBeaconTimeout(UCHAR ucTimeout_)
+UCHAR ANTFS_SetPairingTimeoutCtx(ANTContext* pstContext_, UCHAR ucTimeout_)
 {
-   return (pclMessageObject->SetBeaconTimeout(ucTimeout_, 3000));
+   return (pstContext_->pclMessageObject->SetPairingTimeout(ucTimeout_, 3000));
 }
 
 extern "C" EXPORT
 UCHAR ANTFS_SetPairingTimeout(UCHAR ucTimeout_)
 {
-   return (pclMessageObject->SetPairingTimeout(ucTimeout_, 3000));
+   return ANTFS_SetPairingTimeoutCtx(&stDefaultContext, ucTimeout_);
+}
+
+extern "C" EXPORT
+UCHAR ANTFS_EnableRemoteFileCreateCtx(ANTContext* pstContext_, BOOL bEnable_)
+{
+   return (pstContext_->pclMessageObject->EnableRemoteFileCreate(bEnable_, 3000));
 }
 
 extern "C" EXPORT
 UCHAR ANTFS_EnableRemoteFileCreate(BOOL bEnable_)
 {
-   return (pclMessageObject->EnableRemoteFileCreate(bEnable_, 3000));
+   return ANTFS_EnableRemoteFileCreateCtx(&stDefaultContext, bEnable_);
 }
 
 
 //ANT-FS Responses////////////////////
+extern "C" EXPORT
+UCHAR ANTFS_GetCmdPipeCtx(ANTContext* pstContext_, UCHAR ucOffset_, UCHAR ucReadSize_, UCHAR* pucReadBuffer_)
+{
+   return (pstContext_->pclMessageObject->GetCmdPipe(ucOffset_, ucReadSize_, pucReadBuffer_, 3000));
+}
+
 extern "C" EXPORT
 UCHAR ANTFS_GetCmdPipe(UCHAR ucOffset_, UCHAR ucReadSize_, UCHAR* pucReadBuffer_)
 {
-   return (pclMessageObject->GetCmdPipe(ucOffset_, ucReadSize_, pucReadBuffer_, 3000));
+   return ANTFS_GetCmdPipeCtx(&stDefaultContext, ucOffset_, ucReadSize_, pucReadBuffer_);
+}
+
+extern "C" EXPORT
+UCHAR ANTFS_SetCmdPipeCtx(ANTContext* pstContext_, UCHAR ucOffset_, UCHAR ucWriteSize_, const UCHAR* pucWriteBuffer_)
+{
+   return (pstContext_->pclMessageObject->SetCmdPipe(ucOffset_, ucWriteSize_, pucWriteBuffer_, 3000));
 }
 
 extern "C" EXPORT
 UCHAR ANTFS_SetCmdPipe(UCHAR ucOffset_, UCHAR ucWriteSize_, const UCHAR* pucWriteBuffer_)
 {
-   return (pclMessageObject->SetCmdPipe(ucOffset_, ucWriteSize_, pucWriteBuffer_, 3000));
+   return ANTFS_SetCmdPipeCtx(&stDefaultContext, ucOffset_, ucWriteSize_, pucWriteBuffer_);
 }
 
 
 //GetFSResponse/////////////////////////
+extern "C" EXPORT
+UCHAR ANTFS_GetLastErrorCtx(ANTContext* pstContext_)
+{
+   return (pstContext_->pclMessageObject->GetLastError());
+}
+
 extern "C" EXPORT
 UCHAR ANTFS_GetLastError()
 {
-   return (pclMessageObject->GetLastError());
+   return ANTFS_GetLastErrorCtx(&stDefaultContext);
 }
 
 
@@ -1916,51 +3566,191 @@ static DSI_THREAD_RETURN MessageThread(void *pvParameter_)
    ANT_MESSAGE stMessage;
    USHORT usSize;
 
-   eTheThread = DSIThread_GetCurrentThreadIDNum();
+   ANTContext* pstContext = (ANTContext*)pvParameter_;
+   pstContext->eTheThread = DSIThread_GetCurrentThreadIDNum();
 
-   while(bGoThread)
+   while(pstContext->bGoThread)
    {
-      if(pclMessageObject->WaitForMessage(1000/*DSI_THREAD_INFINITE*/))
+      if(pstContext->pclMessageObject->WaitForMessage(1000/*DSI_THREAD_INFINITE*/))
       {
-         usSize = pclMessageObject->GetMessage(&stMessage);
+         usSize = pstContext->pclMessageObject->GetMessage(&stMessage);
 
          if(usSize == DSI_FRAMER_ERROR)
          {
+            DSI_STATS_INC(&pstContext->stStats, ulFramerErrors);
+
             // Get the message to clear the error
-            usSize = pclMessageObject->GetMessage(&stMessage, MESG_MAX_SIZE_VALUE);
+            usSize = pstContext->pclMessageObject->GetMessage(&stMessage, MESG_MAX_SIZE_VALUE);
             continue;
          }
 
          if(usSize != 0 && usSize != DSI_FRAMER_ERROR && usSize != DSI_FRAMER_TIMEDOUT)
          {
-            SerialHaveMessage(stMessage, usSize);
+            SerialHaveMessage(pstContext, stMessage, usSize);
          }
       }
    }
 
-   DSIThread_MutexLock(&mutexTestDone);
-   UCHAR ucCondResult = DSIThread_CondSignal(&condTestDone);
+   DSIThread_MutexLock(&pstContext->mutexTestDone);
+   UCHAR ucCondResult = DSIThread_CondSignal(&pstContext->condTestDone);
    assert(ucCondResult == DSI_THREAD_ENONE);
-   DSIThread_MutexUnlock(&mutexTestDone);
+   DSIThread_MutexUnlock(&pstContext->mutexTestDone);
+
+   return(NULL);
+}
+
+//TRUE for channel events and data received on a channel, FALSE for command responses and module messages
+static BOOL IsChannelEvent(ANT_MESSAGE& stMessage_)
+{
+   switch (stMessage_.ucMessageID)
+   {
+      case MESG_RESPONSE_EVENT_ID:
+         return (stMessage_.aucData[MESG_EVENT_ID_OFFSET] == MESG_EVENT_ID);
+      case MESG_BROADCAST_DATA_ID:
+      case MESG_ACKNOWLEDGED_DATA_ID:
+      case MESG_BURST_DATA_ID:
+      case MESG_ADV_BURST_DATA_ID:
+      case MESG_EXT_BROADCAST_DATA_ID:
+      case MESG_EXT_ACKNOWLEDGED_DATA_ID:
+      case MESG_EXT_BURST_DATA_ID:
+      case MESG_RSSI_BROADCAST_DATA_ID:
+      case MESG_RSSI_ACKNOWLEDGED_DATA_ID:
+      case MESG_RSSI_BURST_DATA_ID:
+         return TRUE;
+      default:
+         return FALSE;
+   }
+}
+
+//Message callback used by FRAMER_TYPE_DIRECT, runs in the serial receive thread
+static void DirectHaveMessage(ANT_MESSAGE* pstMessage_, USHORT usSize_, void* pvParameter_)
+{
+   ANTContext* pstContext = (ANTContext*)pvParameter_;
+   pstContext->eTheThread = DSIThread_GetCurrentThreadIDNum();
+   SerialHaveMessage(pstContext, *pstMessage_, usSize_);
+}
+
+//Framer error callback, runs in the serial receive context so it only wakes the reconnect thread
+static void SerialError(UCHAR ucSerialError_, void* pvParameter_)
+{
+   ANTContext* pstContext = (ANTContext*)pvParameter_;
+
+   //a failed read stops the receive thread, the stick is as good as gone
+   if(ucSerialError_ != DSI_SERIAL_DEVICE_GONE && ucSerialError_ != DSI_SERIAL_EREAD)
+      return;
+
+   DSIThread_MutexLock(&pstContext->mutexReconnect);
+   pstContext->bStickGone = TRUE;
+   DSIThread_CondBroadcast(&pstContext->condReconnect);
+   DSIThread_MutexUnlock(&pstContext->mutexReconnect);
+}
+
+//Tells the application, then closes and reopens the stick once SerialError says it is gone
+static DSI_THREAD_RETURN ReconnectThread(void *pvParameter_)
+{
+   ANTContext* pstContext = (ANTContext*)pvParameter_;
+
+   DSIThread_MutexLock(&pstContext->mutexReconnect);
+   while(pstContext->bGoReconnect)
+   {
+      if(!pstContext->bStickGone)
+      {
+         DSIThread_CondTimedWait(&pstContext->condReconnect, &pstContext->mutexReconnect, DSI_THREAD_INFINITE);
+         continue;
+      }
+      DSIThread_MutexUnlock(&pstContext->mutexReconnect);
+
+      STICK_CALLBACK pfStick = pstContext->pfStickCallback;
+      if(pfStick)
+         pfStick(pstContext->pvStickContext, ANT_STICK_GONE);
+
+      //out of the application's event loop first, it is polling a port about to go
+      if(pstContext->bDirectDispatch)
+      {
+         DSIThread_MutexLock(&pstContext->mutexEventLoop);
+         pstContext->bEventLoop = FALSE;
+         pstContext->pclSerialObject->Close();
+         DSIThread_MutexUnlock(&pstContext->mutexEventLoop);
+      }
+      else
+      {
+         pstContext->pclSerialObject->Close();
+      }
+
+      //errors from closing it are not news
+      DSIThread_MutexLock(&pstContext->mutexReconnect);
+      pstContext->bStickGone = FALSE;
+      DSIThread_MutexUnlock(&pstContext->mutexReconnect);
+
+      BOOL bOpen = FALSE;
+      UCHAR ucSettleTries = 0;
+      while(pstContext->bGoReconnect && !(bOpen = pstContext->pclSerialObject->Open()))
+      {
+         if(ucSettleTries > 0)
+         {
+            ucSettleTries--;
+            DSIThread_Sleep(RECONNECT_SETTLE_MS);
+         }
+         else if(pstContext->pclSerialObject->WaitForDevice(RECONNECT_POLL_MS))
+         {
+            ucSettleTries = RECONNECT_SETTLE_TRIES;
+         }
+      }
+
+      if(bOpen)
+      {
+         DSI_STATS_INC(&pstContext->stStats, ulReconnects);
+         pfStick = pstContext->pfStickCallback;
+         if(pfStick)
+            pfStick(pstContext->pvStickContext, ANT_STICK_BACK);
+      }
+
+      DSIThread_MutexLock(&pstContext->mutexReconnect);
+   }
+   pstContext->bReconnectRunning = FALSE;
+   DSIThread_CondBroadcast(&pstContext->condReconnect);
+   DSIThread_MutexUnlock(&pstContext->mutexReconnect);
 
    return(NULL);
 }
 
+//Stops the reconnect thread of the selected context, if it has one
+static void StopReconnect(ANTContext* pstContext_)
+{
+   if(!pstContext_->uiReconnectThread)
+      return;
+
+   pstContext_->pclMessageObject->SetErrorCallback(NULL, NULL);
+
+   DSIThread_MutexLock(&pstContext_->mutexReconnect);
+   pstContext_->bGoReconnect = FALSE;
+   DSIThread_CondBroadcast(&pstContext_->condReconnect);
+   while(pstContext_->bReconnectRunning)
+      DSIThread_CondTimedWait(&pstContext_->condReconnect, &pstContext_->mutexReconnect, DSI_THREAD_INFINITE);
+   DSIThread_MutexUnlock(&pstContext_->mutexReconnect);
+
+   DSIThread_ReleaseThreadID(pstContext_->uiReconnectThread);
+   pstContext_->uiReconnectThread = 0;
+   DSIThread_CondDestroy(&pstContext_->condReconnect);
+   DSIThread_MutexDestroy(&pstContext_->mutexReconnect);
+}
+
 //Called internally to delete objects from memory
-static void MemoryCleanup(void)
+static void MemoryCleanup(ANTContext* pstContext_)
 {
-   if(pclSerialObject)
+   if(pstContext_->pclSerialObject)
    {
       //Close all stuff
-      pclSerialObject->Close();
-      delete pclSerialObject;
-      pclSerialObject = NULL;
+      pstContext_->pclSerialObject->Close();
+      delete pstContext_->pclSerialObject;
+      pstContext_->pclSerialObject = NULL;
+      pstContext_->pclEmulatorObject = NULL;
    }
 
-   if(pclMessageObject)
+   if(pstContext_->pclMessageObject)
    {
-      delete pclMessageObject;
-      pclMessageObject = NULL;
+      delete pstContext_->pclMessageObject;
+      pstContext_->pclMessageObject = NULL;
    }
 }
 
@@ -1970,18 +3760,23 @@ static void MemoryCleanup(void)
 // called by the serial message driver code, to be defined by the user,
 // when a serial message is received from the ANT module.
 ///////////////////////////////////////////////////////////////////////
-static void SerialHaveMessage(ANT_MESSAGE& stMessage_, USHORT usSize_)
+static void SerialHaveMessage(ANTContext* pstContext_, ANT_MESSAGE& stMessage_, USHORT usSize_)
 {
    UCHAR ucANTChannel;
+   USHORT usDataSize;
+
+   ucANTChannel = stMessage_.aucData[MESG_CHANNEL_OFFSET] & CHANNEL_NUMBER_MASK;
+
+   if (IsChannelEvent(stMessage_) && ucANTChannel < ANT_STATS_CHANNELS)
+      DSI_STATS_INC(&pstContext_->stStats, aulEventsReceived[ucANTChannel]);
 
    //If no response function has been assigned, ignore the message and unlock
    //the receive buffer
-   if (pfResponseFunc == NULL)
+   if (pstContext_->pfResponseFunc == NULL && pstContext_->pfResponseCallback == NULL)
       return;
 
-
-   ucANTChannel = stMessage_.aucData[MESG_CHANNEL_OFFSET] & CHANNEL_NUMBER_MASK;
-
+   //Size copied for a standard data message, the flagged ones are copied whole
+   usDataSize = (usSize_ > MESG_DATA_SIZE) ? usSize_ : ANT_STANDARD_DATA_PAYLOAD_SIZE + MESG_CHANNEL_NUM_SIZE;
 
    //Process the message to determine whether it is a response event or one
    //of the channel events and call the appropriate event function.
@@ -1991,181 +3786,99 @@ static void SerialHaveMessage(ANT_MESSAGE& stMessage_, USHORT usSize_)
       {
          if (stMessage_.aucData[MESG_EVENT_ID_OFFSET] != MESG_EVENT_ID) // this is a response
          {
-            if (pucResponseBuffer)
-            {
-               memcpy(pucResponseBuffer, stMessage_.aucData, MESG_RESPONSE_EVENT_SIZE);
-               pfResponseFunc(ucANTChannel, MESG_RESPONSE_EVENT_ID);
-            }
+            HaveResponse(pstContext_, ucANTChannel, MESG_RESPONSE_EVENT_ID, stMessage_, usSize_, MESG_RESPONSE_EVENT_SIZE);
          }
          else // this is an event
          {
             // If we are in auto transfer mode, stop sending packets
-            if ((stMessage_.aucData[MESG_EVENT_CODE_OFFSET] == EVENT_TRANSFER_TX_FAILED) && (ucAutoTransferChannel == ucANTChannel))
-               usNumDataPackets = 0;
+            if ((stMessage_.aucData[MESG_EVENT_CODE_OFFSET] == EVENT_TRANSFER_TX_FAILED) && (pstContext_->ucAutoTransferChannel == ucANTChannel))
+               pstContext_->usNumDataPackets = 0;
 
-            if (sLink[ucANTChannel].pfLinkEvent == NULL)
-               break;
-
-            memcpy(sLink[ucANTChannel].pucRxBuffer, stMessage_.aucData, usSize_);
-            sLink[ucANTChannel].pfLinkEvent(ucANTChannel, stMessage_.aucData[MESG_EVENT_CODE_OFFSET]); // pass through any events not handled here
+            HaveChannelEvent(pstContext_, ucANTChannel, stMessage_.aucData[MESG_EVENT_CODE_OFFSET], stMessage_, usSize_, usSize_); // pass through any events not handled here
          }
          break;
       }
+      // If size is greater than the standard data message size, then assume
+      // that this is a data message with a flag at the end. Set the event accordingly.
       case MESG_BROADCAST_DATA_ID:
-      {
-         if (  sLink[ucANTChannel].pfLinkEvent == NULL ||
-               sLink[ucANTChannel].pucRxBuffer == NULL)
-         {
-            break;
-         }
-
-         // If size is greater than the standard data message size, then assume
-         // that this is a data message with a flag at the end. Set the event accordingly.
-         if(usSize_ > MESG_DATA_SIZE)
-         {
-            //Call channel event function with Broadcast message code
-            memcpy(sLink[ucANTChannel].pucRxBuffer, stMessage_.aucData, usSize_);
-            sLink[ucANTChannel].pfLinkEvent(ucANTChannel, EVENT_RX_FLAG_BROADCAST);                 // process the event
-         }
-         else
-         {
-            //Call channel event function with Broadcast message code
-            memcpy(sLink[ucANTChannel].pucRxBuffer, stMessage_.aucData, ANT_STANDARD_DATA_PAYLOAD_SIZE + MESG_CHANNEL_NUM_SIZE);
-            sLink[ucANTChannel].pfLinkEvent(ucANTChannel, EVENT_RX_BROADCAST);                 // process the event
-         }
+         HaveChannelEvent(pstContext_, ucANTChannel, (usSize_ > MESG_DATA_SIZE) ? EVENT_RX_FLAG_BROADCAST : EVENT_RX_BROADCAST, stMessage_, usSize_, usDataSize);
          break;
-
-      }
-
       case MESG_ACKNOWLEDGED_DATA_ID:
-      {
-         if (sLink[ucANTChannel].pfLinkEvent == NULL)
-            break;
-
-
-         if(usSize_ > MESG_DATA_SIZE)
-         {
-            //Call channel event function with Broadcast message code
-            memcpy(sLink[ucANTChannel].pucRxBuffer, stMessage_.aucData, usSize_);
-            sLink[ucANTChannel].pfLinkEvent(ucANTChannel, EVENT_RX_FLAG_ACKNOWLEDGED);                 // process the event
-         }
-         else
-         {
-            //Call channel event function with Acknowledged message code
-            memcpy(sLink[ucANTChannel].pucRxBuffer, stMessage_.aucData, ANT_STANDARD_DATA_PAYLOAD_SIZE + MESG_CHANNEL_NUM_SIZE);
-            sLink[ucANTChannel].pfLinkEvent(ucANTChannel, EVENT_RX_ACKNOWLEDGED);                 // process the message
-         }
+         HaveChannelEvent(pstContext_, ucANTChannel, (usSize_ > MESG_DATA_SIZE) ? EVENT_RX_FLAG_ACKNOWLEDGED : EVENT_RX_ACKNOWLEDGED, stMessage_, usSize_, usDataSize);
          break;
-      }
       case MESG_BURST_DATA_ID:
-      {
-         if (sLink[ucANTChannel].pfLinkEvent == NULL)
-            break;
-
-         if(usSize_ > MESG_DATA_SIZE)
-         {
-            //Call channel event function with Broadcast message code
-            memcpy(sLink[ucANTChannel].pucRxBuffer, stMessage_.aucData, usSize_);
-            sLink[ucANTChannel].pfLinkEvent(ucANTChannel, EVENT_RX_FLAG_BURST_PACKET);                 // process the event
-         }
-         else
-         {
-            //Call channel event function with Burst message code
-            memcpy(sLink[ucANTChannel].pucRxBuffer, stMessage_.aucData, ANT_STANDARD_DATA_PAYLOAD_SIZE + MESG_CHANNEL_NUM_SIZE);
-            sLink[ucANTChannel].pfLinkEvent(ucANTChannel, EVENT_RX_BURST_PACKET);                 // process the message
-         }
+         HaveChannelEvent(pstContext_, ucANTChannel, (usSize_ > MESG_DATA_SIZE) ? EVENT_RX_FLAG_BURST_PACKET : EVENT_RX_BURST_PACKET, stMessage_, usSize_, usDataSize);
          break;
-      }
       case MESG_EXT_BROADCAST_DATA_ID:
-      {
-         if (sLink[ucANTChannel].pfLinkEvent == NULL)
-            break;
-
-         //Call channel event function with Broadcast message code
-         memcpy(sLink[ucANTChannel].pucRxBuffer, stMessage_.aucData, MESG_EXT_DATA_SIZE);
-         sLink[ucANTChannel].pfLinkEvent(ucANTChannel, EVENT_RX_EXT_BROADCAST);                 // process the event
+         HaveChannelEvent(pstContext_, ucANTChannel, EVENT_RX_EXT_BROADCAST, stMessage_, usSize_, MESG_EXT_DATA_SIZE);
          break;
-      }
       case MESG_EXT_ACKNOWLEDGED_DATA_ID:
-      {
-         if (sLink[ucANTChannel].pfLinkEvent == NULL)
-            break;
-
-         //Call channel event function with Acknowledged message code
-         memcpy(sLink[ucANTChannel].pucRxBuffer, stMessage_.aucData, MESG_EXT_DATA_SIZE);
-         sLink[ucANTChannel].pfLinkEvent(ucANTChannel, EVENT_RX_EXT_ACKNOWLEDGED);              // process the message
+         HaveChannelEvent(pstContext_, ucANTChannel, EVENT_RX_EXT_ACKNOWLEDGED, stMessage_, usSize_, MESG_EXT_DATA_SIZE);
          break;
-      }
       case MESG_EXT_BURST_DATA_ID:
-      {
-         if (sLink[ucANTChannel].pfLinkEvent == NULL)
-            break;
-
-         //Call channel event function with Burst message code
-         memcpy(sLink[ucANTChannel].pucRxBuffer, stMessage_.aucData, MESG_EXT_DATA_SIZE);
-         sLink[ucANTChannel].pfLinkEvent(ucANTChannel, EVENT_RX_EXT_BURST_PACKET);                 // process the message
+         HaveChannelEvent(pstContext_, ucANTChannel, EVENT_RX_EXT_BURST_PACKET, stMessage_, usSize_, MESG_EXT_DATA_SIZE);
          break;
-      }
       case MESG_RSSI_BROADCAST_DATA_ID:
-      {
-         if (sLink[ucANTChannel].pfLinkEvent == NULL)
-            break;
-
-         //Call channel event function with Broadcast message code
-         memcpy(sLink[ucANTChannel].pucRxBuffer, stMessage_.aucData, MESG_RSSI_DATA_SIZE);
-         sLink[ucANTChannel].pfLinkEvent(ucANTChannel, EVENT_RX_RSSI_BROADCAST);                 // process the event
+         HaveChannelEvent(pstContext_, ucANTChannel, EVENT_RX_RSSI_BROADCAST, stMessage_, usSize_, MESG_RSSI_DATA_SIZE);
          break;
-      }
       case MESG_RSSI_ACKNOWLEDGED_DATA_ID:
-      {
-         if (sLink[ucANTChannel].pfLinkEvent == NULL)
-            break;
-
-         //Call channel event function with Acknowledged message code
-         memcpy(sLink[ucANTChannel].pucRxBuffer, stMessage_.aucData, MESG_RSSI_DATA_SIZE);
-         sLink[ucANTChannel].pfLinkEvent(ucANTChannel, EVENT_RX_RSSI_ACKNOWLEDGED);                 // process the message
+         HaveChannelEvent(pstContext_, ucANTChannel, EVENT_RX_RSSI_ACKNOWLEDGED, stMessage_, usSize_, MESG_RSSI_DATA_SIZE);
          break;
-      }
       case MESG_RSSI_BURST_DATA_ID:
-      {
-         if (sLink[ucANTChannel].pfLinkEvent == NULL)
-            break;
-
-         //Call channel event function with Burst message code
-         memcpy(sLink[ucANTChannel].pucRxBuffer, stMessage_.aucData, MESG_RSSI_DATA_SIZE);
-         sLink[ucANTChannel].pfLinkEvent(ucANTChannel, EVENT_RX_RSSI_BURST_PACKET);                 // process the message
+         HaveChannelEvent(pstContext_, ucANTChannel, EVENT_RX_RSSI_BURST_PACKET, stMessage_, usSize_, MESG_RSSI_DATA_SIZE);
          break;
-      }
 
-      case MESG_SCRIPT_DATA_ID:
-      {
-         if (pucResponseBuffer)
-         {
-            memcpy(pucResponseBuffer, stMessage_.aucData, usSize_);
-            pucResponseBuffer[10] = (UCHAR)usSize_;
-            pfResponseFunc(ucANTChannel, MESG_SCRIPT_DATA_ID);
-         }
-         break;
-      }
       case MESG_SCRIPT_CMD_ID:
-      {
-         if (pucResponseBuffer)
-         {
-            memcpy(pucResponseBuffer, stMessage_.aucData, MESG_SCRIPT_CMD_SIZE);
-            pfResponseFunc(ucANTChannel, MESG_SCRIPT_CMD_ID);
-         }
+         HaveResponse(pstContext_, ucANTChannel, MESG_SCRIPT_CMD_ID, stMessage_, usSize_, MESG_SCRIPT_CMD_SIZE);
          break;
-      }
-      default:
-      {
-         if (pucResponseBuffer)                     // can we process this link
-         {
-            memcpy(pucResponseBuffer, stMessage_.aucData, usSize_);
-            pfResponseFunc(ucANTChannel, stMessage_.ucMessageID );
-         }
+      default: // including MESG_SCRIPT_DATA_ID
+         HaveResponse(pstContext_, ucANTChannel, stMessage_.ucMessageID, stMessage_, usSize_, usSize_);
          break;
-      }
    }
 
    return;
 }
+
+///////////////////////////////////////////////////////////////////////
+// Hands a channel event to the channel's callback, straight out of the
+// framer's buffer, or copies usCopySize_ bytes to the channel's receive
+// buffer for an event function.
+///////////////////////////////////////////////////////////////////////
+static void HaveChannelEvent(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR ucEvent_, ANT_MESSAGE& stMessage_, USHORT usSize_, USHORT usCopySize_)
+{
+   CHANNEL_LINK* psLink;
+
+   if (ucANTChannel_ >= MAX_CHANNELS)
+      return;
+   psLink = &pstContext_->sLink[ucANTChannel_];
+
+   if (psLink->pfLinkCallback)
+   {
+      psLink->pfLinkCallback(psLink->pvLinkContext, ucANTChannel_, ucEvent_, stMessage_.aucData, usSize_);
+      return;
+   }
+   if (psLink->pfLinkEvent == NULL || psLink->pucRxBuffer == NULL)
+      return;
+
+   memcpy(psLink->pucRxBuffer, stMessage_.aucData, usCopySize_);
+   psLink->pfLinkEvent(ucANTChannel_, ucEvent_);
+}
+
+///////////////////////////////////////////////////////////////////////
+// The same for responses and module messages.
+///////////////////////////////////////////////////////////////////////
+static void HaveResponse(ANTContext* pstContext_, UCHAR ucANTChannel_, UCHAR ucMessageID_, ANT_MESSAGE& stMessage_, USHORT usSize_, USHORT usCopySize_)
+{
+   if (pstContext_->pfResponseCallback)
+   {
+      pstContext_->pfResponseCallback(pstContext_->pvResponseContext, ucANTChannel_, ucMessageID_, stMessage_.aucData, usSize_);
+      return;
+   }
+   if (pstContext_->pfResponseFunc == NULL || pstContext_->pucResponseBuffer == NULL)
+      return;
+
+   memcpy(pstContext_->pucResponseBuffer, stMessage_.aucData, usCopySize_);
+   if (ucMessageID_ == MESG_SCRIPT_DATA_ID)
+      pstContext_->pucResponseBuffer[10] = (UCHAR)usSize_;
+   pstContext_->pfResponseFunc(ucANTChannel_, ucMessageID_);
+}
@@ -12,14 +12,17 @@ All rights reserved.
 #include "types.h"
 #include "antdefines.h"
 #include "antmessage.h"
+#include "dsi_stats.h"
 
 
 //Port Types: these defines are used to decide what type of connection to connect over
 #define PORT_TYPE_USB      0
 #define PORT_TYPE_COM      1
+#define PORT_TYPE_EMULATOR 2   // In-process stick emulator, no hardware needed
 
 //Framer Types: These are used to define which framing type to use
 #define FRAMER_TYPE_BASIC            0
+#define FRAMER_TYPE_DIRECT           1   // Basic framing, but callbacks are made straight from the USB receive thread
 
 #if defined(DSI_TYPES_WINDOWS)
    #define EXPORT __declspec(dllexport)
@@ -32,6 +35,28 @@ All rights reserved.
 typedef BOOL (*RESPONSE_FUNC)(UCHAR ucANTChannel, UCHAR ucResponseMsgID);
 typedef BOOL (*CHANNEL_EVENT_FUNC)(UCHAR ucANTChannel, UCHAR ucEvent);
 
+// Zero copy application callbacks.  pucMessage is the message payload, channel
+// number first, in the framer's receive buffer and only valid until the callback
+// returns.  pvContext is the pointer given when the callback was assigned.
+typedef BOOL (*RESPONSE_CALLBACK)(void* pvContext, UCHAR ucANTChannel, UCHAR ucResponseMsgID, const UCHAR* pucMessage, USHORT usSize);
+typedef BOOL (*CHANNEL_EVENT_CALLBACK)(void* pvContext, UCHAR ucANTChannel, UCHAR ucEvent, const UCHAR* pucMessage, USHORT usSize);
+
+// One stick, see ANT_CreateContext
+typedef struct ANTContext ANTContext;
+
+// Stick events, see ANT_AssignStickCallback
+#define ANT_STICK_GONE     1   // About to be closed, stop writing to it
+#define ANT_STICK_BACK     2   // Open again, reset, its channels need setting up
+typedef void (*STICK_CALLBACK)(void* pvContext, UCHAR ucEvent);
+
+// A descriptor to wait on, see ANT_EventLoopAttach
+#define ANT_EVENT_LOOP_MAX_FDS   16
+typedef struct
+{
+   int iFd;
+   short sEvents;   // as for poll()
+} ANT_POLLFD;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -45,6 +70,12 @@ EXPORT BOOL ANT_GetDeviceUSBPID(USHORT* pusPID_);
 EXPORT BOOL ANT_GetDeviceUSBVID(USHORT* pusVID_);
 EXPORT ULONG ANT_GetDeviceSerialNumber();
 
+// Each further stick gets its own context.  The ANT_ functions below work on
+// the default context, the ANT_*Ctx ones further down on the one they are
+// given.
+EXPORT ANTContext* ANT_CreateContext(void);
+EXPORT void ANT_DestroyContext(ANTContext* pstContext);   // Closes it first if need be
+
 EXPORT BOOL ANT_Init(UCHAR ucUSBDeviceNum, ULONG ulBaudrate);
 EXPORT BOOL ANT_InitExt(UCHAR ucUSBDeviceNum, ULONG ulBaudrate, UCHAR ucPortType, UCHAR ucSerialFrameType);  //Initializes and opens USB connection to the module
 EXPORT void ANT_Close();   //Closes the USB connection to the module
@@ -52,7 +83,10 @@ EXPORT const char* ANT_LibVersion(void); // Obtains the version number of the dy
 
 EXPORT void ANT_AssignResponseFunction(RESPONSE_FUNC pfResponse, UCHAR* pucResponseBuffer); // pucResponse buffer should be of size MESG_RESPONSE_EVENT_SIZE
 EXPORT void ANT_AssignChannelEventFunction(UCHAR ucANTChannel,CHANNEL_EVENT_FUNC pfChannelEvent, UCHAR *pucRxBuffer);
-EXPORT void ANT_UnassignAllResponseFunctions(); //Unassigns all response functions
+EXPORT void ANT_AssignResponseCallback(RESPONSE_CALLBACK pfResponse, void* pvContext); // used instead of the response function while assigned
+EXPORT void ANT_AssignChannelEventCallback(UCHAR ucANTChannel, CHANNEL_EVENT_CALLBACK pfChannelEvent, void* pvContext); // used instead of the channel event function while assigned
+EXPORT BOOL ANT_AssignStickCallback(STICK_CALLBACK pfStick, void* pvContext); // reopens the stick when it goes away and comes back, NULL stops it
+EXPORT void ANT_UnassignAllResponseFunctions(); //Unassigns all response functions and callbacks
 
 
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -130,6 +164,50 @@ EXPORT BOOL ANT_CloseChannel_RTO(UCHAR ucANTChannel_, ULONG ulResponseTime_);
 EXPORT BOOL ANT_RequestMessage(UCHAR ucANTChannel, UCHAR ucMessageID);
 EXPORT BOOL ANT_WriteMessage(UCHAR ucMessageID, UCHAR* aucData, USHORT usMessageSize);
 
+////////////////////////////////////////////////////////////////////////////////////////
+// Command groups: config/control calls made between ANT_BeginCommandGroup() and
+// ANT_SubmitCommandGroup() on the same thread are queued, written together and
+// their responses collected under one handle.
+////////////////////////////////////////////////////////////////////////////////////////
+EXPORT UCHAR ANT_BeginCommandGroup(void);   // Returns a group handle, 0 on failure
+EXPORT BOOL ANT_SubmitCommandGroup(UCHAR ucGroup);   // Writes the queued commands, does not wait
+EXPORT BOOL ANT_CommandGroupDone(UCHAR ucGroup);   // TRUE once every command in the group has a response
+EXPORT BOOL ANT_WaitCommandGroup(UCHAR ucGroup, ULONG ulResponseTime_);   // TRUE if every command passed, releases the handle; 0 only checks a submitted group and always keeps the handle
+
+////////////////////////////////////////////////////////////////////////////////////////
+// External event loop, FRAMER_TYPE_DIRECT only.  Once attached the receive thread is
+// gone: the application waits on the descriptors from ANT_EventLoopGetFds() itself
+// and calls ANT_EventLoopHandle() when one is ready, and after writing, which can
+// take a completion the descriptors then never show.  Callbacks run in
+// ANT_EventLoopHandle().  Calls that wait for a response would wait for ever, detach
+// around them.  A stick that goes away comes back detached, attach again after
+// ANT_STICK_BACK and get the descriptors again.
+////////////////////////////////////////////////////////////////////////////////////////
+EXPORT BOOL ANT_EventLoopAttach(void);   // FALSE if the port cannot be polled
+EXPORT UCHAR ANT_EventLoopGetFds(ANT_POLLFD* pastFds, UCHAR ucMax);   // Returns how many were filled in
+EXPORT void ANT_EventLoopHandle(void);   // Never waits
+EXPORT void ANT_EventLoopDetach(void);   // The receive thread takes over again
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Counters kept by the USB, framer and message layers of the stick, see dsi_stats.h
+////////////////////////////////////////////////////////////////////////////////////////
+EXPORT BOOL ANT_GetStats(ANT_STATS* pstStats);   // Copies the counters, they keep running
+EXPORT void ANT_ResetStats(void);
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Stick emulator control, only valid after ANT_InitExt() with PORT_TYPE_EMULATOR
+////////////////////////////////////////////////////////////////////////////////////////
+EXPORT BOOL ANT_EmulatorInjectAcknowledged(UCHAR ucANTChannel, UCHAR* pucData);   // 8 bytes from the remote device, delivered after the next channel period
+EXPORT BOOL ANT_EmulatorInjectBytes(UCHAR* pucData, USHORT usSize);   // Raw received bytes, FALSE if the emulator's buffer is full
+EXPORT BOOL ANT_EmulatorInjectNoise(USHORT usBytes);   // Random bytes in front of the next received frame
+EXPORT BOOL ANT_EmulatorInjectChecksumError(void);   // Corrupts the next received frame
+EXPORT BOOL ANT_EmulatorInjectOverrun(USHORT usFrames);   // Loses the next received frames as a buffer overflow would
+EXPORT BOOL ANT_EmulatorDropTxEvents(USHORT usEvents);   // Leaves out the next EVENT_TX, the periods still go out
+EXPORT BOOL ANT_EmulatorUnplug(ULONG ulMilliseconds);   // Device gone for a while, comes back powered on with no channels
+EXPORT BOOL ANT_EmulatorGetFaultsPending(ULONG* pulFaults);   // Injected faults not over yet
+EXPORT BOOL ANT_EmulatorGetCounts(UCHAR ucANTChannel, ULONG* pulBroadcasts, ULONG* pulTxEvents);   // Broadcasts written by the host and channel periods elapsed
+EXPORT BOOL ANT_EmulatorGetFreshSlots(UCHAR ucANTChannel, ULONG* pulFreshSlots);   // Channel periods that carried new data from the host
+
 ////////////////////////////////////////////////////////////////////////////////////////
 // The following are the synchronous RF event functions used to update the synchronous data sent over a channel
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -196,6 +274,8 @@ EXPORT USHORT ANT_SendExtBurstTransfer_RTO(UCHAR ucANTChannel_, UCHAR *pucData_,
 
 EXPORT BOOL ANT_RxExtMesgsEnable(UCHAR ucEnable);
 EXPORT BOOL ANT_RxExtMesgsEnable_RTO(UCHAR ucEnable_, ULONG ulResponseTimeout_);
+EXPORT BOOL ANT_SetLibConfig(UCHAR ucLibConfigFlags);   // ANT_LIB_CONFIG_MESG_OUT_INC_xxx, fields added to every received data message
+EXPORT BOOL ANT_SetLibConfig_RTO(UCHAR ucLibConfigFlags_, ULONG ulResponseTime_);
 EXPORT BOOL ANT_SetLowPriorityChannelSearchTimeout(UCHAR ucANTChannel, UCHAR ucSearchTimeout);
 EXPORT BOOL ANT_SetLowPriorityChannelSearchTimeout_RTO(UCHAR ucANTChannel_, UCHAR ucSearchTimeout_, ULONG ulResponseTime_);
 
@@ -284,6 +364,201 @@ EXPORT UCHAR ANTFS_GetLastError();
 
 
 
+////////////////////////////////////////////////////////////////////////////////////////
+// The same calls on a context from ANT_CreateContext, its first argument.  The
+// functions above are these on the default context.
+////////////////////////////////////////////////////////////////////////////////////////
+EXPORT BOOL ANT_GetDeviceUSBInfoCtx(ANTContext* pstContext, UCHAR ucUSBDeviceNum, UCHAR* pucProductString, UCHAR* pucSerialString);
+EXPORT BOOL ANT_GetDeviceUSBPIDCtx(ANTContext* pstContext, USHORT* pusPID_);
+EXPORT BOOL ANT_GetDeviceUSBVIDCtx(ANTContext* pstContext, USHORT* pusVID_);
+EXPORT BOOL ANT_InitCtx(ANTContext* pstContext, UCHAR ucUSBDeviceNum, ULONG ulBaudrate);
+EXPORT BOOL ANT_InitExtCtx(ANTContext* pstContext, UCHAR ucUSBDeviceNum, ULONG ulBaudrate, UCHAR ucPortType, UCHAR ucSerialFrameType);
+EXPORT void ANT_CloseCtx(ANTContext* pstContext);
+EXPORT void ANT_AssignResponseFunctionCtx(ANTContext* pstContext, RESPONSE_FUNC pfResponse, UCHAR* pucResponseBuffer);
+EXPORT void ANT_AssignChannelEventFunctionCtx(ANTContext* pstContext, UCHAR ucANTChannel,CHANNEL_EVENT_FUNC pfChannelEvent, UCHAR *pucRxBuffer);
+EXPORT void ANT_AssignResponseCallbackCtx(ANTContext* pstContext, RESPONSE_CALLBACK pfResponse, void* pvContext);
+EXPORT void ANT_AssignChannelEventCallbackCtx(ANTContext* pstContext, UCHAR ucANTChannel, CHANNEL_EVENT_CALLBACK pfChannelEvent, void* pvContext);
+EXPORT BOOL ANT_AssignStickCallbackCtx(ANTContext* pstContext, STICK_CALLBACK pfStick, void* pvContext);
+EXPORT void ANT_UnassignAllResponseFunctionsCtx(ANTContext* pstContext);
+
+EXPORT BOOL ANT_UnAssignChannelCtx(ANTContext* pstContext, UCHAR ucANTChannel);
+EXPORT BOOL ANT_UnAssignChannelCtx_RTO(ANTContext* pstContext, UCHAR ucANTChannel, ULONG ulResponseTime_);
+EXPORT BOOL ANT_AssignChannelCtx(ANTContext* pstContext, UCHAR ucANTChannel, UCHAR ucChanType, UCHAR ucNetNumber);
+EXPORT BOOL ANT_AssignChannelCtx_RTO(ANTContext* pstContext, UCHAR ucANTChannel, UCHAR ucChannelType_, UCHAR ucNetNumber, ULONG ulResponseTime_);
+EXPORT BOOL ANT_AssignChannelExtCtx(ANTContext* pstContext, UCHAR ucANTChannel, UCHAR ucChannelType_, UCHAR ucNetNumber, UCHAR ucExtFlags_);
+EXPORT BOOL ANT_AssignChannelExtCtx_RTO(ANTContext* pstContext, UCHAR ucANTChannel, UCHAR ucChannelType_, UCHAR ucNetNumber, UCHAR ucExtFlags_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_SetChannelIdCtx(ANTContext* pstContext, UCHAR ucANTChannel, USHORT usDeviceNumber, UCHAR ucDeviceType, UCHAR ucTransmissionType_);
+EXPORT BOOL ANT_SetChannelIdCtx_RTO(ANTContext* pstContext, UCHAR ucANTChannel_, USHORT usDeviceNumber_, UCHAR ucDeviceType_, UCHAR ucTransmissionType_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_SetChannelPeriodCtx(ANTContext* pstContext, UCHAR ucANTChannel, USHORT usMesgPeriod);
+EXPORT BOOL ANT_SetChannelPeriodCtx_RTO(ANTContext* pstContext, UCHAR ucANTChannel_, USHORT usMesgPeriod_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_SetChannelSearchTimeoutCtx(ANTContext* pstContext, UCHAR ucANTChannel, UCHAR ucSearchTimeout);
+EXPORT BOOL ANT_SetChannelSearchTimeoutCtx_RTO(ANTContext* pstContext, UCHAR ucANTChannel_, UCHAR ucSearchTimeout_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_SetChannelRFFreqCtx(ANTContext* pstContext, UCHAR ucANTChannel, UCHAR ucRFFreq);
+EXPORT BOOL ANT_SetChannelRFFreqCtx_RTO(ANTContext* pstContext, UCHAR ucANTChannel_, UCHAR ucRFFreq_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_SetNetworkKeyCtx(ANTContext* pstContext, UCHAR ucNetNumber, UCHAR *pucKey);
+EXPORT BOOL ANT_SetNetworkKeyCtx_RTO(ANTContext* pstContext, UCHAR ucNetNumber, UCHAR *pucKey, ULONG ulResponseTime_);
+EXPORT BOOL ANT_SetTransmitPowerCtx(ANTContext* pstContext, UCHAR ucTransmitPower);
+EXPORT BOOL ANT_SetTransmitPowerCtx_RTO(ANTContext* pstContext, UCHAR ucTransmitPower_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_ConfigureAdvancedBurstCtx(ANTContext* pstContext, BOOL bEnable_, UCHAR ucMaxPacketLength_, ULONG ulRequiredFields_, ULONG ulOptionalFields_);
+EXPORT BOOL ANT_ConfigureAdvancedBurstCtx_RTO(ANTContext* pstContext, BOOL bEnable_, UCHAR ucMaxPacketLength_, ULONG ulRequiredFields_, ULONG ulOptionalFields_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_ConfigureAdvancedBurst_extCtx(ANTContext* pstContext, BOOL bEnable_, UCHAR ucMaxPacketLength_, ULONG ulRequiredFields_, ULONG ulOptionalFields_, USHORT usStallCount_, UCHAR ucRetryCount_);
+EXPORT BOOL ANT_ConfigureAdvancedBurst_extCtx_RTO(ANTContext* pstContext, BOOL bEnable_, UCHAR ucMaxPacketLength_, ULONG ulRequiredFields_, ULONG ulOptionalFields_, USHORT usStallCount_, UCHAR ucRetryCount_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_ConfigEventFilterCtx(ANTContext* pstContext, USHORT usEventFilter_);
+EXPORT BOOL ANT_ConfigEventFilterCtx_RTO(ANTContext* pstContext, USHORT usEventFilter_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_ConfigEventBufferCtx(ANTContext* pstContext, UCHAR ucConfig_, USHORT usSize_, USHORT usTime_);
+EXPORT BOOL ANT_ConfigEventBufferCtx_RTO(ANTContext* pstContext, UCHAR ucConfig_, USHORT usSize_, USHORT usTime_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_ConfigHighDutySearchCtx(ANTContext* pstContext, UCHAR ucEnable_, UCHAR ucSuppressionCycles_);
+EXPORT BOOL ANT_ConfigHighDutySearchCtx_RTO(ANTContext* pstContext, UCHAR ucEnable_, UCHAR ucSuppressionCycles_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_ConfigSelectiveDataUpdateCtx(ANTContext* pstContext, UCHAR ucChannel_, UCHAR ucSduConfig_);
+EXPORT BOOL ANT_ConfigSelectiveDataUpdateCtx_RTO(ANTContext* pstContext, UCHAR ucChannel_, UCHAR ucSduConfig_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_SetSelectiveDataUpdateMaskCtx(ANTContext* pstContext, UCHAR ucMaskNumber_, UCHAR* pucSduMask_);
+EXPORT BOOL ANT_SetSelectiveDataUpdateMaskCtx_RTO(ANTContext* pstContext, UCHAR ucMaskNumber_, UCHAR* pucSduMask_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_ConfigUserNVMCtx(ANTContext* pstContext, USHORT usAddress_, UCHAR* pucData_, UCHAR ucSize_);
+EXPORT BOOL ANT_ConfigUserNVMCtx_RTO(ANTContext* pstContext, USHORT usAddress_, UCHAR* pucData_, UCHAR ucSize_, ULONG ulResponseTime_);
+
+EXPORT BOOL ANT_InitCWTestModeCtx(ANTContext* pstContext);
+EXPORT BOOL ANT_InitCWTestModeCtx_RTO(ANTContext* pstContext, ULONG ulResponseTime_);
+EXPORT BOOL ANT_SetCWTestModeCtx(ANTContext* pstContext, UCHAR ucTransmitPower, UCHAR ucRFChannel);
+EXPORT BOOL ANT_SetCWTestModeCtx_RTO(ANTContext* pstContext, UCHAR ucTransmitPower_, UCHAR ucRFChannel_, ULONG ulResponseTime_);
+
+EXPORT BOOL ANT_ResetSystemCtx(ANTContext* pstContext);
+EXPORT BOOL ANT_OpenChannelCtx(ANTContext* pstContext, UCHAR ucANTChannel);
+EXPORT BOOL ANT_OpenChannelCtx_RTO(ANTContext* pstContext, UCHAR ucANTChannel_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_CloseChannelCtx(ANTContext* pstContext, UCHAR ucANTChannel);
+EXPORT BOOL ANT_CloseChannelCtx_RTO(ANTContext* pstContext, UCHAR ucANTChannel_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_RequestMessageCtx(ANTContext* pstContext, UCHAR ucANTChannel, UCHAR ucMessageID);
+EXPORT BOOL ANT_WriteMessageCtx(ANTContext* pstContext, UCHAR ucMessageID, UCHAR* aucData, USHORT usMessageSize);
+
+EXPORT UCHAR ANT_BeginCommandGroupCtx(ANTContext* pstContext);
+EXPORT BOOL ANT_SubmitCommandGroupCtx(ANTContext* pstContext, UCHAR ucGroup);
+EXPORT BOOL ANT_CommandGroupDoneCtx(ANTContext* pstContext, UCHAR ucGroup);
+EXPORT BOOL ANT_WaitCommandGroupCtx(ANTContext* pstContext, UCHAR ucGroup, ULONG ulResponseTime_);
+
+EXPORT BOOL ANT_EventLoopAttachCtx(ANTContext* pstContext);
+EXPORT UCHAR ANT_EventLoopGetFdsCtx(ANTContext* pstContext, ANT_POLLFD* pastFds, UCHAR ucMax);
+EXPORT void ANT_EventLoopHandleCtx(ANTContext* pstContext);
+EXPORT void ANT_EventLoopDetachCtx(ANTContext* pstContext);
+
+EXPORT BOOL ANT_GetStatsCtx(ANTContext* pstContext, ANT_STATS* pstStats);
+EXPORT void ANT_ResetStatsCtx(ANTContext* pstContext);
+
+EXPORT BOOL ANT_EmulatorInjectAcknowledgedCtx(ANTContext* pstContext, UCHAR ucANTChannel, UCHAR* pucData);
+EXPORT BOOL ANT_EmulatorInjectBytesCtx(ANTContext* pstContext, UCHAR* pucData, USHORT usSize);
+EXPORT BOOL ANT_EmulatorInjectNoiseCtx(ANTContext* pstContext, USHORT usBytes);
+EXPORT BOOL ANT_EmulatorInjectChecksumErrorCtx(ANTContext* pstContext);
+EXPORT BOOL ANT_EmulatorInjectOverrunCtx(ANTContext* pstContext, USHORT usFrames);
+EXPORT BOOL ANT_EmulatorDropTxEventsCtx(ANTContext* pstContext, USHORT usEvents);
+EXPORT BOOL ANT_EmulatorUnplugCtx(ANTContext* pstContext, ULONG ulMilliseconds);
+EXPORT BOOL ANT_EmulatorGetFaultsPendingCtx(ANTContext* pstContext, ULONG* pulFaults);
+EXPORT BOOL ANT_EmulatorGetCountsCtx(ANTContext* pstContext, UCHAR ucANTChannel, ULONG* pulBroadcasts, ULONG* pulTxEvents);
+EXPORT BOOL ANT_EmulatorGetFreshSlotsCtx(ANTContext* pstContext, UCHAR ucANTChannel, ULONG* pulFreshSlots);
+
+EXPORT BOOL ANT_SendBroadcastDataCtx(ANTContext* pstContext, UCHAR ucANTChannel, UCHAR* pucData);
+EXPORT BOOL ANT_SendAcknowledgedDataCtx(ANTContext* pstContext, UCHAR ucANTChannel, UCHAR* pucData);
+EXPORT BOOL ANT_SendAcknowledgedDataCtx_RTO(ANTContext* pstContext, UCHAR ucANTChannel_, UCHAR *pucData_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_SendBurstTransferCtx(ANTContext* pstContext, UCHAR ucANTChannel, UCHAR *pucData, USHORT usNumDataPackets);
+EXPORT BOOL ANT_SendBurstTransferCtx_RTO(ANTContext* pstContext, UCHAR ucANTChannel_, UCHAR *pucData_, USHORT usNumDataPackets_, ULONG ulResponseTime_);
+
+EXPORT BOOL ANT_AddChannelIDCtx(ANTContext* pstContext, UCHAR ucANTChannel, USHORT usDeviceNumber, UCHAR ucDeviceType, UCHAR ucTranmissionType_, UCHAR ucIndex);
+EXPORT BOOL ANT_AddChannelIDCtx_RTO(ANTContext* pstContext, UCHAR ucANTChannel_, USHORT usDeviceNumber_, UCHAR ucDeviceType_, UCHAR ucTransmissionType_, UCHAR ucListIndex_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_ConfigListCtx(ANTContext* pstContext, UCHAR ucANTChannel, UCHAR ucListSize, UCHAR ucExclude);
+EXPORT BOOL ANT_ConfigListCtx_RTO(ANTContext* pstContext, UCHAR ucANTChannel_, UCHAR ucListSize_, UCHAR ucExclude_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_OpenRxScanModeCtx(ANTContext* pstContext);
+EXPORT BOOL ANT_OpenRxScanModeCtx_RTO(ANTContext* pstContext, ULONG ulResponseTime_);
+
+EXPORT BOOL ANT_ConfigFrequencyAgilityCtx(ANTContext* pstContext, UCHAR ucANTChannel_, UCHAR ucFreq1_, UCHAR ucFreq2_, UCHAR ucFreq3_);
+EXPORT BOOL ANT_ConfigFrequencyAgilityCtx_RTO(ANTContext* pstContext, UCHAR ucANTChannel_, UCHAR ucFreq1_, UCHAR ucFreq2_, UCHAR ucFreq3_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_SetProximitySearchCtx(ANTContext* pstContext, UCHAR ucANTChannel_, UCHAR ucSearchThreshold_);
+EXPORT BOOL ANT_SetProximitySearchCtx_RTO(ANTContext* pstContext, UCHAR ucANTChannel_, UCHAR ucSearchThreshold_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_SleepMessageCtx(ANTContext* pstContext);
+EXPORT BOOL ANT_SleepMessageCtx_RTO(ANTContext* pstContext, ULONG ulResponseTime_);
+EXPORT BOOL ANT_CrystalEnableCtx(ANTContext* pstContext);
+EXPORT BOOL ANT_CrystalEnableCtx_RTO(ANTContext* pstContext, ULONG ulResponseTime_);
+
+EXPORT BOOL ANT_NVM_WriteCtx(ANTContext* pstContext, UCHAR ucSize, UCHAR *pucData);
+EXPORT BOOL ANT_NVM_WriteCtx_RTO(ANTContext* pstContext, UCHAR ucSize_, UCHAR *pucData_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_NVM_ClearCtx(ANTContext* pstContext, UCHAR ucSectNumber);
+EXPORT BOOL ANT_NVM_ClearCtx_RTO(ANTContext* pstContext, UCHAR ucSectNumber_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_NVM_DumpCtx(ANTContext* pstContext);
+EXPORT BOOL ANT_NVM_DumpCtx_RTO(ANTContext* pstContext, ULONG ulResponseTime_);
+EXPORT BOOL ANT_NVM_SetDefaultSectorCtx(ANTContext* pstContext, UCHAR ucSectNumber);
+EXPORT BOOL ANT_NVM_SetDefaultSectorCtx_RTO(ANTContext* pstContext, UCHAR ucSectNumber_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_NVM_EndSectorCtx(ANTContext* pstContext);
+EXPORT BOOL ANT_NVM_EndSectorCtx_RTO(ANTContext* pstContext, ULONG ulResponseTime_);
+EXPORT BOOL ANT_NVM_LockCtx(ANTContext* pstContext);
+EXPORT BOOL ANT_NVM_LockCtx_RTO(ANTContext* pstContext, ULONG ulResponseTimeout_);
+
+EXPORT BOOL ANT_SendExtBroadcastDataCtx(ANTContext* pstContext, UCHAR ucANTChannel, UCHAR* pucData);
+EXPORT BOOL ANT_SendExtAcknowledgedDataCtx(ANTContext* pstContext, UCHAR ucANTChannel, UCHAR* pucData);
+EXPORT BOOL ANT_SendExtAcknowledgedDataCtx_RTO(ANTContext* pstContext, UCHAR ucANTChannel_, UCHAR *pucData_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_SendExtBurstTransferPacketCtx(ANTContext* pstContext, UCHAR ucANTChannelSeq, UCHAR* pucData);
+EXPORT USHORT ANT_SendExtBurstTransferCtx(ANTContext* pstContext, UCHAR ucANTChannel, UCHAR *pucData, USHORT usNumDataPackets);
+EXPORT USHORT ANT_SendExtBurstTransferCtx_RTO(ANTContext* pstContext, UCHAR ucANTChannel_, UCHAR *pucData_, USHORT usDataPackets_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_RxExtMesgsEnableCtx(ANTContext* pstContext, UCHAR ucEnable);
+EXPORT BOOL ANT_RxExtMesgsEnableCtx_RTO(ANTContext* pstContext, UCHAR ucEnable_, ULONG ulResponseTimeout_);
+EXPORT BOOL ANT_SetLibConfigCtx(ANTContext* pstContext, UCHAR ucLibConfigFlags);
+EXPORT BOOL ANT_SetLibConfigCtx_RTO(ANTContext* pstContext, UCHAR ucLibConfigFlags_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_SetLowPriorityChannelSearchTimeoutCtx(ANTContext* pstContext, UCHAR ucANTChannel, UCHAR ucSearchTimeout);
+EXPORT BOOL ANT_SetLowPriorityChannelSearchTimeoutCtx_RTO(ANTContext* pstContext, UCHAR ucANTChannel_, UCHAR ucSearchTimeout_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_SetSerialNumChannelIdCtx(ANTContext* pstContext, UCHAR ucANTChannel, UCHAR ucDeviceType, UCHAR ucTransmissionType);
+EXPORT BOOL ANT_SetSerialNumChannelIdCtx_RTO(ANTContext* pstContext, UCHAR ucANTChannel_, UCHAR ucDeviceType_, UCHAR ucTransmissionType_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_EnableLEDCtx(ANTContext* pstContext, UCHAR ucEnable);
+EXPORT BOOL ANT_EnableLEDCtx_RTO(ANTContext* pstContext, UCHAR ucEnable_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_SetChannelTxPowerCtx(ANTContext* pstContext, UCHAR ucANTChannel, UCHAR ucTransmitPower);
+EXPORT BOOL ANT_SetChannelTxPowerCtx_RTO(ANTContext* pstContext, UCHAR ucANTChannel_, UCHAR ucTransmitPower_, ULONG ulResponseTime_);
+EXPORT BOOL ANT_RSSI_SetSearchThresholdCtx(ANTContext* pstContext, UCHAR ucANTChannel_, UCHAR ucThreshold_);
+EXPORT BOOL ANT_RSSI_SetSearchThresholdCtx_RTO(ANTContext* pstContext, UCHAR ucANTChannel_, UCHAR ucThreshold_, ULONG ulResponseTime_);
+
+EXPORT BOOL FIT_SetFEStateCtx(ANTContext* pstContext, UCHAR ucFEState_);
+EXPORT BOOL FIT_SetFEStateCtx_RTO(ANTContext* pstContext, UCHAR ucFEState_, ULONG ulResponseTime_);
+EXPORT BOOL FIT_AdjustPairingSettingsCtx(ANTContext* pstContext, UCHAR ucSearchLv_, UCHAR ucPairLv_, UCHAR ucTrackLv_);
+EXPORT BOOL FIT_AdjustPairingSettingsCtx_RTO(ANTContext* pstContext, UCHAR ucSearchLv_, UCHAR ucPairLv_, UCHAR ucTrackLv_, ULONG ulResponseTime_);
+
+EXPORT BOOL ANTFS_InitEEPROMDeviceCtx(ANTContext* pstContext, USHORT usPageSize_, UCHAR ucAddressConfig_);
+EXPORT BOOL ANTFS_InitFSMemoryCtx(ANTContext* pstContext);
+EXPORT BOOL ANTFS_FormatFSMemoryCtx(ANTContext* pstContext, USHORT usNumberOfSectors_, USHORT usPagesPerSector_);
+EXPORT BOOL ANTFS_SaveDirectoryCtx(ANTContext* pstContext);
+EXPORT BOOL ANTFS_DirectoryRebuildCtx(ANTContext* pstContext);
+EXPORT BOOL ANTFS_FileDeleteCtx(ANTContext* pstContext, UCHAR ucFileHandle_);
+EXPORT BOOL ANTFS_FileCloseCtx(ANTContext* pstContext, UCHAR ucFileHandle_);
+EXPORT BOOL ANTFS_SetFileSpecificFlagsCtx(ANTContext* pstContext, UCHAR ucFileHandle_, UCHAR ucFlags_);
+EXPORT UCHAR ANTFS_DirectoryReadLockCtx(ANTContext* pstContext, BOOL bLock_);
+EXPORT BOOL ANTFS_SetSystemTimeCtx(ANTContext* pstContext, ULONG ulTime_);
+EXPORT ULONG ANTFS_GetUsedSpaceCtx(ANTContext* pstContext);
+EXPORT ULONG ANTFS_GetFreeSpaceCtx(ANTContext* pstContext);
+EXPORT USHORT ANTFS_FindFileIndexCtx(ANTContext* pstContext, UCHAR ucFileDataType_, UCHAR ucFileSubType_, USHORT usFileNumber_);
+EXPORT UCHAR ANTFS_ReadDirectoryAbsoluteCtx(ANTContext* pstContext, ULONG ulOffset_, UCHAR ucSize_, UCHAR* pucBuffer_);
+EXPORT UCHAR ANTFS_DirectoryReadEntryCtx(ANTContext* pstContext, USHORT usFileIndex_, UCHAR* ucFileDirectoryBuffer_);
+EXPORT ULONG ANTFS_DirectoryGetSizeCtx(ANTContext* pstContext);
+EXPORT USHORT ANTFS_FileCreateCtx(ANTContext* pstContext, USHORT usFileIndex_, UCHAR ucFileDataType_, ULONG ulFileIdentifier_, UCHAR ucFileDataTypeSpecificFlags_, UCHAR ucGeneralFlags);
+EXPORT UCHAR ANTFS_FileOpenCtx(ANTContext* pstContext, USHORT usFileIndex_, UCHAR ucOpenFlags_);
+EXPORT UCHAR ANTFS_FileReadAbsoluteCtx(ANTContext* pstContext, UCHAR ucFileHandle_, ULONG ulOffset_, UCHAR ucReadSize_, UCHAR* pucReadBuffer_);
+EXPORT UCHAR ANTFS_FileReadRelativeCtx(ANTContext* pstContext, UCHAR ucFileHandle_, UCHAR ucReadSize_, UCHAR* pucReadBuffer_);
+EXPORT UCHAR ANTFS_FileWriteAbsoluteCtx(ANTContext* pstContext, UCHAR ucFileHandle_, ULONG ulFileOffset_, UCHAR ucWriteSize_, const UCHAR* pucWriteBuffer_, UCHAR* ucBytesWritten_);
+EXPORT UCHAR ANTFS_FileWriteRelativeCtx(ANTContext* pstContext, UCHAR ucFileHandle_, UCHAR ucWriteSize_, const UCHAR* pucWriteBuffer_, UCHAR* ucBytesWritten_);
+EXPORT ULONG ANTFS_FileGetSizeCtx(ANTContext* pstContext, UCHAR ucFileHandle_);
+EXPORT ULONG ANTFS_FileGetSizeInMemCtx(ANTContext* pstContext, UCHAR ucFileHandle_);
+EXPORT UCHAR ANTFS_FileGetSpecificFlagsCtx(ANTContext* pstContext, UCHAR ucFileHandle_);
+EXPORT ULONG ANTFS_FileGetSystemTimeCtx(ANTContext* pstContext);
+EXPORT UCHAR ANTFS_CryptoAddUserKeyIndexCtx(ANTContext* pstContext, UCHAR ucIndex_,  UCHAR* pucKey_);
+EXPORT UCHAR ANTFS_CryptoSetUserKeyIndexCtx(ANTContext* pstContext, UCHAR ucIndex_);
+EXPORT UCHAR ANTFS_CryptoSetUserKeyValCtx(ANTContext* pstContext, UCHAR* pucKey_);
+EXPORT UCHAR ANTFS_FitFileIntegrityCheckCtx(ANTContext* pstContext, UCHAR ucFileHandle_);
+EXPORT UCHAR ANTFS_OpenBeaconCtx(ANTContext* pstContext);
+EXPORT UCHAR ANTFS_CloseBeaconCtx(ANTContext* pstContext);
+EXPORT UCHAR ANTFS_ConfigBeaconCtx(ANTContext* pstContext, USHORT usDeviceType_, USHORT usManufacturer_, UCHAR ucAuthType_, UCHAR ucBeaconStatus_);
+EXPORT UCHAR ANTFS_SetFriendlyNameCtx(ANTContext* pstContext, UCHAR ucLength_, const UCHAR* pucString_);
+EXPORT UCHAR ANTFS_SetPasskeyCtx(ANTContext* pstContext, UCHAR ucLength_, const UCHAR* pucString_);
+EXPORT UCHAR ANTFS_SetBeaconStateCtx(ANTContext* pstContext, UCHAR ucBeaconStatus_);
+EXPORT UCHAR ANTFS_PairResponseCtx(ANTContext* pstContext, BOOL bAccept_);
+EXPORT UCHAR ANTFS_SetLinkFrequencyCtx(ANTContext* pstContext, UCHAR ucChannelNumber_, UCHAR ucFrequency_);
+EXPORT UCHAR ANTFS_SetBeaconTimeoutCtx(ANTContext* pstContext, UCHAR ucTimeout_);
+EXPORT UCHAR ANTFS_SetPairingTimeoutCtx(ANTContext* pstContext, UCHAR ucTimeout_);
+EXPORT UCHAR ANTFS_EnableRemoteFileCreateCtx(ANTContext* pstContext, BOOL bEnable_);
+EXPORT UCHAR ANTFS_GetCmdPipeCtx(ANTContext* pstContext, UCHAR ucOffset_, UCHAR ucReadSize_, UCHAR* pucReadBuffer_);
+EXPORT UCHAR ANTFS_SetCmdPipeCtx(ANTContext* pstContext, UCHAR ucOffset_, UCHAR ucWriteSize_, const UCHAR* pucWriteBuffer_);
+EXPORT UCHAR ANTFS_GetLastErrorCtx(ANTContext* pstContext);
+
 ////////////////////////////////////////////////////////////////////////////////////////
 // Threading
 ////////////////////////////////////////////////////////////////////////////////////////
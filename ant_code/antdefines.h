@@ -30,6 +30,10 @@ All rights reserved.
 // ANT Extended Data Message Bifield Definitions
 //////////////////////////////////////////////
 #define ANT_EXT_MESG_BITFIELD_DEVICE_ID            ((UCHAR)0x80)           // first field after bitfield
+#define ANT_EXT_MESG_BITFIELD_RSSI                 ((UCHAR)0x40)           // after the device ID
+#define ANT_EXT_MESG_BITFIELD_TIME_STAMP           ((UCHAR)0x20)           // after the RSSI
+#define ANT_EXT_MESG_RSSI_FIELD_SIZE               ((UCHAR)3)              // measurement type, value, threshold
+#define ANT_EXT_MESG_TIME_STAMP_FIELD_SIZE         ((UCHAR)2)              // 1/32768 s, rolls over every 2 s
 
 // 4 bits free reserved set to 0
 #define ANT_EXT_MESG_BIFIELD_EXTENSION             ((UCHAR)0x01)
@@ -144,6 +148,28 @@ All rights reserved.
 #define CAPABILITIES_ENCRYPTED_CHANNEL_ENABLED           ((UCHAR)0x80)
 
 
+//////////////////////////////////////////////
+// Event Filter defines, a set bit keeps that
+// channel event from the host
+//////////////////////////////////////////////
+#define EVENT_FILTER_RX_SEARCH_TIMEOUT             ((USHORT)0x0001)
+#define EVENT_FILTER_RX_FAIL                       ((USHORT)0x0002)
+#define EVENT_FILTER_TX                            ((USHORT)0x0004)
+#define EVENT_FILTER_TRANSFER_RX_FAILED            ((USHORT)0x0008)
+#define EVENT_FILTER_TRANSFER_TX_COMPLETED         ((USHORT)0x0010)
+#define EVENT_FILTER_TRANSFER_TX_FAILED            ((USHORT)0x0020)
+#define EVENT_FILTER_CHANNEL_CLOSED                ((USHORT)0x0040)
+#define EVENT_FILTER_RX_FAIL_GO_TO_SEARCH          ((USHORT)0x0080)
+#define EVENT_FILTER_CHANNEL_COLLISION             ((USHORT)0x0100)
+#define EVENT_FILTER_TRANSFER_TX_START             ((USHORT)0x0200)
+
+//////////////////////////////////////////////
+// Event Buffering defines
+//////////////////////////////////////////////
+#define EVENT_BUFFER_LOW_PRIORITY                  ((UCHAR)0x00)           // EVENT_TX, EVENT_RX_FAIL and broadcast data wait, everything else flushes
+#define EVENT_BUFFER_ALL                           ((UCHAR)0x01)
+#define EVENT_BUFFER_TIME_UNIT_MS                  ((USHORT)10)            // buffer time is in these
+
 //////////////////////////////////////////////
 // Burst Message Sequence
 //////////////////////////////////////////////
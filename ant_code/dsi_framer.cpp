@@ -20,6 +20,7 @@ All rights reserved.
 DSIFramer::DSIFramer()
 {
    pclSerial = (DSISerial*)NULL;
+   pstStats = &stDSIStats;
 }
 
 /////////////////////////////////////////////////////////////////
@@ -28,6 +29,7 @@ DSIFramer::DSIFramer()
 DSIFramer::DSIFramer(DSISerial *pclSerial_)
 {
    pclSerial = pclSerial_;
+   pstStats = &stDSIStats;
 }
 
 /////////////////////////////////////////////////////////////////
@@ -37,6 +39,12 @@ DSIFramer::~DSIFramer()
 {
 }
 
+/////////////////////////////////////////////////////////////////
+void DSIFramer::SetStats(ANT_STATS *pstStats_)
+{
+   pstStats = pstStats_;
+}
+
 #if 0
 /////////////////////////////////////////////////////////////////
 BOOL DSIFramer::WriteMessage(void *pvData_, USHORT usMessageSize_)
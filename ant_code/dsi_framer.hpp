@@ -29,6 +29,7 @@ class DSIFramer : public DSISerialCallback
 {
    protected:
       DSISerial *pclSerial;                                 // Local pointer to a DSISerial object.
+      ANT_STATS *pstStats;                                  // The stick's counters, stDSIStats until SetStats().
 
    public:
       // Constuctor and Destructor
@@ -41,6 +42,12 @@ class DSIFramer : public DSISerialCallback
 
       virtual ~DSIFramer();
 
+      void SetStats(ANT_STATS *pstStats_);
+      /////////////////////////////////////////////////////////////////
+      // Counts into *pstStats_ from then on.  Must be called before
+      // the serial port is opened.
+      /////////////////////////////////////////////////////////////////
+
       virtual BOOL WriteMessage(void *pvData_, USHORT usSize_) = 0;
       /////////////////////////////////////////////////////////////////
       // Writes bytes to the device.
@@ -13,6 +13,7 @@ All rights reserved.
 #include "checksum.h"
 #include "dsi_thread.h"
 #include "dsi_framer_ant.hpp"
+#include "dsi_stats.h"
 
 #include <string.h>
 
@@ -36,6 +37,9 @@ All rights reserved.
 
 #define ANT_BASIC_CAPABILITIES_SIZE           4
 
+#define RESPONSE_ANY_FIRST_BYTE               ((UCHAR) 0xFF) // Hash key used for responses that don't match on data.
+#define RESPONSE_TABLE_SLOT(id, first)        ((UCHAR) (((id) ^ ((first) * 7)) & (RESPONSE_TABLE_SIZE - 1)))
+
 //////////////////////////////////////////////////////////////////////////////////
 // Public Class Functions
 //////////////////////////////////////////////////////////////////////////////////
@@ -57,7 +61,11 @@ DSIFramerANT::DSIFramerANT()
    if (DSIThread_MutexInit(&stMutexResponseRequest) != DSI_THREAD_ENONE)
       bInitOkay = FALSE;
 
-   pclResponseListStart = (ANTMessageResponse*)NULL;
+   InitResponseTable();
+   pfMessageCallback = (ANT_MESSAGE_CALLBACK)NULL;
+   pvMessageCallbackParameter = NULL;
+   pfErrorCallback = (ANT_ERROR_CALLBACK)NULL;
+   pvErrorCallbackParameter = NULL;
 
    Init((DSISerial*)NULL);
 }
@@ -78,24 +86,124 @@ DSIFramerANT::DSIFramerANT(DSISerial *pclSerial_) : DSIFramer(pclSerial_)
    if (DSIThread_MutexInit(&stMutexResponseRequest) != DSI_THREAD_ENONE)
       bInitOkay = FALSE;
 
-   pclResponseListStart = (ANTMessageResponse*)NULL;
+   InitResponseTable();
+   pfMessageCallback = (ANT_MESSAGE_CALLBACK)NULL;
+   pvMessageCallbackParameter = NULL;
+   pfErrorCallback = (ANT_ERROR_CALLBACK)NULL;
+   pvErrorCallbackParameter = NULL;
 
    Init(pclSerial_);
 }
 ///////////////////////////////////////////////////////////////////////
 DSIFramerANT::~DSIFramerANT()
 {
+   for (UCHAR i = 0; i < COMMAND_GROUP_COUNT; i++)
+      DSIThread_CondDestroy(&astCommandGroups[i].stCondResponseReady);
+   delete[] pclResponsePool;
    DSIThread_CondDestroy(&stCondMessageReady);
    DSIThread_MutexDestroy(&stMutexCriticalSection);
    DSIThread_MutexDestroy(&stMutexResponseRequest);
 }
 
+///////////////////////////////////////////////////////////////////////
+void DSIFramerANT::InitResponseTable(void)
+{
+   for (USHORT i = 0; i < RESPONSE_TABLE_SIZE; i++)
+      apclResponseTable[i] = (ANTMessageResponse*)NULL;
+   usResponsesAttached = 0;
+
+   // Chain the pool into the free list.
+   pclResponsePool = new ANTMessageResponse[RESPONSE_POOL_SIZE];
+   pclResponseFreeList = (ANTMessageResponse*)NULL;
+   for (USHORT i = 0; i < RESPONSE_POOL_SIZE; i++)
+   {
+      pclResponsePool[i].bPooled = TRUE;
+      pclResponsePool[i].pclNext = pclResponseFreeList;
+      pclResponseFreeList = &pclResponsePool[i];
+   }
+
+   for (UCHAR i = 0; i < COMMAND_GROUP_COUNT; i++)
+   {
+      astCommandGroups[i].bInUse = FALSE;
+      astCommandGroups[i].bSubmitted = FALSE;
+      astCommandGroups[i].ucCount = 0;
+      if (DSIThread_CondInit(&astCommandGroups[i].stCondResponseReady) != DSI_THREAD_ENONE)
+         bInitOkay = FALSE;
+   }
+   ucOpenGroup = COMMAND_GROUP_NONE;
+   usGroupTxSize = 0;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Takes a response object from the pool, only allocating if the pool
+// has run dry.
+///////////////////////////////////////////////////////////////////////
+ANTMessageResponse* DSIFramerANT::AllocResponse(void)
+{
+   ANTMessageResponse *pclResponse;
+
+   DSIThread_MutexLock(&stMutexResponseRequest);
+   pclResponse = pclResponseFreeList;
+   if (pclResponse != NULL)
+      pclResponseFreeList = pclResponse->pclNext;
+   DSIThread_MutexUnlock(&stMutexResponseRequest);
+
+   if (pclResponse == NULL)
+      return new ANTMessageResponse();
+
+   pclResponse->pclNext = (ANTMessageResponse*)NULL;
+   pclResponse->pstCondResponseReady = &(pclResponse->stCondResponseReady);
+   pclResponse->bResponseReady = FALSE;
+   pclResponse->bConsume = FALSE;
+   return pclResponse;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Detaches the response and gives it back to the pool.
+///////////////////////////////////////////////////////////////////////
+void DSIFramerANT::FreeResponse(ANTMessageResponse *pclResponse_)
+{
+   if (pclResponse_ == NULL)
+      return;
+
+   if (!pclResponse_->bPooled)
+   {
+      delete pclResponse_;
+      return;
+   }
+
+   pclResponse_->Remove();
+
+   DSIThread_MutexLock(&stMutexResponseRequest);
+   pclResponse_->pclNext = pclResponseFreeList;
+   pclResponseFreeList = pclResponse_;
+   DSIThread_MutexUnlock(&stMutexResponseRequest);
+}
+
 ///////////////////////////////////////////////////////////////////////
 void DSIFramerANT::SetSplitAdvBursts(BOOL bSplitAdvBursts_)
 {
    bSplitAdvancedBursts = bSplitAdvBursts_;
 }
 
+///////////////////////////////////////////////////////////////////////
+void DSIFramerANT::SetMessageCallback(ANT_MESSAGE_CALLBACK pfMessageCallback_, void* pvParameter_)
+{
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   pfMessageCallback = pfMessageCallback_;
+   pvMessageCallbackParameter = pvParameter_;
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSIFramerANT::SetErrorCallback(ANT_ERROR_CALLBACK pfErrorCallback_, void* pvParameter_)
+{
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   pfErrorCallback = pfErrorCallback_;
+   pvErrorCallbackParameter = pvParameter_;
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+}
+
 ///////////////////////////////////////////////////////////////////////
 void DSIFramerANT::SetCancelParameter(volatile BOOL *pbCancel_)
 {
@@ -126,35 +234,51 @@ BOOL DSIFramerANT::Init(DSISerial *pclSerial_)
 }
 
 ///////////////////////////////////////////////////////////////////////
-BOOL DSIFramerANT::WriteMessage(void *pvData_, USHORT usMessageSize_)
+// Builds the serial frame for an ANT_MESSAGE into pucFrame_, which must
+// hold at least MESG_MAX_SIZE_VALUE + MESG_FRAME_SIZE + 2 bytes.
+// Returns the frame size, or 0 if the message is too big.
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIFramerANT::FrameMessage(void *pvData_, USHORT usMessageSize_, UCHAR *pucFrame_)
 {
-   UCHAR aucTxFifo[TX_FIFO_SIZE];
    UCHAR ucTotalSize;
 
    if (usMessageSize_ > MESG_MAX_SIZE_VALUE)
-   {
-      #if defined(DEBUG_FILE)
-         DSIDebug::ThreadWrite("Framer->WriteMessage(): Failed, Msg Size > MESG_MAX_SIZE_VALUE.");
-      #endif
-      return FALSE;
-   }
+      return 0;
 
    ucTotalSize = (UCHAR) usMessageSize_ + MESG_HEADER_SIZE;
-   aucTxFifo[0] = MESG_TX_SYNC;
-   aucTxFifo[MESG_SIZE_OFFSET] = (UCHAR) usMessageSize_;
-   aucTxFifo[MESG_ID_OFFSET] = ((ANT_MESSAGE *) pvData_)->ucMessageID;
-   memcpy(&aucTxFifo[MESG_DATA_OFFSET], ((ANT_MESSAGE *) pvData_)->aucData, usMessageSize_);
-   aucTxFifo[ucTotalSize] = CheckSum_Calc8(aucTxFifo, ucTotalSize);
+   pucFrame_[0] = MESG_TX_SYNC;
+   pucFrame_[MESG_SIZE_OFFSET] = (UCHAR) usMessageSize_;
+   pucFrame_[MESG_ID_OFFSET] = ((ANT_MESSAGE *) pvData_)->ucMessageID;
+   memcpy(&pucFrame_[MESG_DATA_OFFSET], ((ANT_MESSAGE *) pvData_)->aucData, usMessageSize_);
+   pucFrame_[ucTotalSize] = CheckSum_Calc8(pucFrame_, ucTotalSize);
 
    ++ucTotalSize;
 
    // Pad with two zeros.
-   aucTxFifo[ucTotalSize++] = 0;
-   aucTxFifo[ucTotalSize++] = 0;
+   pucFrame_[ucTotalSize++] = 0;
+   pucFrame_[ucTotalSize++] = 0;
 
+   return ucTotalSize;
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSIFramerANT::WriteMessage(void *pvData_, USHORT usMessageSize_)
+{
+   UCHAR aucTxFifo[TX_FIFO_SIZE];
+   UCHAR ucTotalSize;
+
+   ucTotalSize = FrameMessage(pvData_, usMessageSize_, aucTxFifo);
+   if (ucTotalSize == 0)
+   {
+      #if defined(DEBUG_FILE)
+         DSIDebug::ThreadWrite("Framer->WriteMessage(): Failed, Msg Size > MESG_MAX_SIZE_VALUE.");
+      #endif
+      return FALSE;
+   }
 
    if (pclSerial->WriteBytes(aucTxFifo, ucTotalSize))
    {
+      DSI_STATS_INC(pstStats, ulFramesOut);
       #if defined(SERIAL_DEBUG)
          if (aucTxFifo[MESG_ID_OFFSET] == 0x46)
             memset(&aucTxFifo[MESG_DATA_OFFSET+1],0x00,8);
@@ -181,7 +305,7 @@ USHORT DSIFramerANT::WaitForMessage(ULONG ulMilliseconds_)
 
    usMessageSize = GetMessageSize();
 
-   if ((usMessageSize == DSI_FRAMER_TIMEDOUT) && (ulMilliseconds_ != 0))
+   if ((usMessageSize == DSI_FRAMER_TIMEDOUT) && (ulMilliseconds_ != 0) && !bClosing)
    {
       UCHAR ucStatus = DSIThread_CondTimedWait(&stCondMessageReady, &stMutexCriticalSection, ulMilliseconds_);
       if(ucStatus == DSI_THREAD_ENONE)
@@ -204,6 +328,15 @@ USHORT DSIFramerANT::WaitForMessage(ULONG ulMilliseconds_)
    return usMessageSize;
 }
 
+///////////////////////////////////////////////////////////////////////
+void DSIFramerANT::CancelWait()
+{
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   bClosing = TRUE;
+   DSIThread_CondBroadcast(&stCondMessageReady);
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+}
+
 ///////////////////////////////////////////////////////////////////////
 USHORT DSIFramerANT::GetMessage(void *pvData_, USHORT usSize_)
 {
@@ -291,7 +424,26 @@ UCHAR DSIFramerANT::GetChannelNumber(ANT_MESSAGE* pstMessage)
 void DSIFramerANT::ProcessByte(UCHAR ucByte_)
 {
    DSIThread_MutexLock(&stMutexCriticalSection);
+   ParseByte(ucByte_);
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Takes the lock once for the whole block rather than once per byte.
+///////////////////////////////////////////////////////////////////////
+void DSIFramerANT::ProcessBytes(const UCHAR* pucBytes_, ULONG ulSize_)
+{
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   for (ULONG i = 0; i < ulSize_; i++)
+      ParseByte(pucBytes_[i]);
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+}
 
+///////////////////////////////////////////////////////////////////////
+// stMutexCriticalSection must be locked before calling this function.
+///////////////////////////////////////////////////////////////////////
+void DSIFramerANT::ParseByte(UCHAR ucByte_)
+{
    if (ucRxIndex == 0)                                      // If we are looking for the start of a message.
    {
       if (ucByte_ == MESG_TX_SYNC)                          // If it is a valid first byte.
@@ -309,6 +461,7 @@ void DSIFramerANT::ProcessByte(UCHAR ucByte_)
 
       if ((USHORT)ucRxSize > RX_FIFO_SIZE)                          // If our buffer can't handle this message, turf it.
       {
+         DSI_STATS_INC(pstStats, ulOversizeFrames);
          #if defined(SERIAL_DEBUG)
             DSIDebug::SerialWrite(pclSerial->GetDeviceNumber(), "ERROR: size > RX_FIFO_SIZE", aucRxFifo, ucRxIndex);
          #endif
@@ -335,10 +488,12 @@ void DSIFramerANT::ProcessByte(UCHAR ucByte_)
       {
          if (ucCheckSum == 0)                               // The CRC passed.
          {
+            DSI_STATS_INC(pstStats, ulFramesIn);
             ProcessMessage();                               // Process the ANT message.
          }
          else
          {
+            DSI_STATS_INC(pstStats, ulCRCErrors);
             // Set a serial error for the bad crc.
             ucSerialError = DSI_FRAMER_ANT_CRC_ERROR;
             ucError = DSI_FRAMER_ANT_ESERIAL;
@@ -354,13 +509,15 @@ void DSIFramerANT::ProcessByte(UCHAR ucByte_)
          ucRxIndex++;
       }
    }
-
-   DSIThread_MutexUnlock(&stMutexCriticalSection);
 }
 
 ///////////////////////////////////////////////////////////////////////
 void DSIFramerANT::Error(UCHAR ucError_)
 {
+   DSI_STATS_INC(pstStats, ulSerialErrors);
+   if (ucError_ == DSI_SERIAL_DEVICE_GONE)
+      DSI_STATS_INC(pstStats, ulDeviceGone);
+
    DSIThread_MutexLock(&stMutexCriticalSection);
 
    ucSerialError = ucError_;
@@ -368,7 +525,13 @@ void DSIFramerANT::Error(UCHAR ucError_)
 
    DSIThread_CondSignal(&stCondMessageReady);
 
+   ANT_ERROR_CALLBACK pfCallback = pfErrorCallback;
+   void* pvParameter = pvErrorCallbackParameter;
+
    DSIThread_MutexUnlock(&stMutexCriticalSection);
+
+   if (pfCallback)
+      pfCallback(ucError_, pvParameter);
 }
 
 ///////////////////////////////////////////////////////////////////////
@@ -1284,7 +1447,7 @@ BOOL DSIFramerANT::ResetSystem(ULONG ulResponseTime_)
    // If we are going to be waiting for a response setup the Response object
    if (ulResponseTime_ != 0)
    {
-      pclCommandResponse = new ANTMessageResponse();
+      pclCommandResponse = AllocResponse();
       pclCommandResponse->Attach(MESG_STARTUP_MESG_ID, (UCHAR*)NULL, 0, this);
    }
 
@@ -1297,7 +1460,7 @@ BOOL DSIFramerANT::ResetSystem(ULONG ulResponseTime_)
 
       if(pclCommandResponse != NULL)
       {
-         delete pclCommandResponse;
+         FreeResponse(pclCommandResponse);
          pclCommandResponse = (ANTMessageResponse*)NULL;
       }
 
@@ -1321,11 +1484,11 @@ BOOL DSIFramerANT::ResetSystem(ULONG ulResponseTime_)
          DSIDebug::ThreadWrite("Framer->ResetSystem():  Timeout.");
       #endif
 
-      delete pclCommandResponse;
+      FreeResponse(pclCommandResponse);
       return FALSE;
    }
 
-   delete pclCommandResponse;
+   FreeResponse(pclCommandResponse);
    return TRUE;
 }
 
@@ -1371,7 +1534,7 @@ BOOL DSIFramerANT::CloseChannel(UCHAR ucANTChannel_, ULONG ulResponseTime_)
       aucDesiredData[ANT_DATA_EVENT_ID_OFFSET] = MESG_EVENT_ID;
       aucDesiredData[ANT_DATA_EVENT_CODE_OFFSET] = EVENT_CHANNEL_CLOSED;
 
-      pclEventResponse = new ANTMessageResponse();
+      pclEventResponse = AllocResponse();
       pclEventResponse->Attach(MESG_RESPONSE_EVENT_ID, aucDesiredData, sizeof(aucDesiredData), this);
    }
 
@@ -1387,7 +1550,7 @@ BOOL DSIFramerANT::CloseChannel(UCHAR ucANTChannel_, ULONG ulResponseTime_)
    }
 
    pclEventResponse->Remove();                                               //detach from list
-   delete pclEventResponse;
+   FreeResponse(pclEventResponse);
 
    return bReturn;
 }
@@ -1481,20 +1644,20 @@ ANTFRAMER_RETURN DSIFramerANT::SetupAckDataTransfer(UCHAR ucMessageID_, UCHAR uc
      aucDesiredData[ANT_DATA_EVENT_ID_OFFSET] = MESG_EVENT_ID;
      aucDesiredData[ANT_DATA_EVENT_CODE_OFFSET] = EVENT_TRANSFER_TX_COMPLETED;
 
-     pclPassResponse = new ANTMessageResponse();
+     pclPassResponse = AllocResponse();
      pclPassResponse->Attach(MESG_RESPONSE_EVENT_ID, aucDesiredData, sizeof(aucDesiredData), this);
 
      aucDesiredData[ANT_DATA_CHANNEL_NUM_OFFSET] = ucANTChannel_;   //Setup response to catch tx fail
      aucDesiredData[ANT_DATA_EVENT_ID_OFFSET] = MESG_EVENT_ID;
      aucDesiredData[ANT_DATA_EVENT_CODE_OFFSET] = EVENT_TRANSFER_TX_FAILED;
 
-     pclFailResponse = new ANTMessageResponse();
+     pclFailResponse = AllocResponse();
      pclFailResponse->Attach(MESG_RESPONSE_EVENT_ID, aucDesiredData, sizeof(aucDesiredData), this, pclPassResponse->pstCondResponseReady);
 
      aucDesiredData[ANT_DATA_CHANNEL_NUM_OFFSET] = ucANTChannel_;   //Setup response to catch any errors like transfer in progress.
      aucDesiredData[ANT_DATA_EVENT_ID_OFFSET] = ucMessageID_;
 
-     pclErrorResponse = new ANTMessageResponse();
+     pclErrorResponse = AllocResponse();
      pclErrorResponse->Attach(MESG_RESPONSE_EVENT_ID, aucDesiredData, 2, this, pclPassResponse->pstCondResponseReady);
    }
 
@@ -1526,7 +1689,10 @@ ANTFRAMER_RETURN DSIFramerANT::SetupAckDataTransfer(UCHAR ucMessageID_, UCHAR uc
          else if (*pbCancel_ == TRUE)
             eReturn = ANTFRAMER_CANCELLED;
          else
+         {
+            DSI_STATS_INC(pstStats, ulResponseTimeouts);
             eReturn = ANTFRAMER_TIMEOUT;
+         }
       }
    }
 
@@ -1536,9 +1702,9 @@ ANTFRAMER_RETURN DSIFramerANT::SetupAckDataTransfer(UCHAR ucMessageID_, UCHAR uc
 
    DSIThread_MutexUnlock(&stMutexResponseRequest);
 
-   delete pclPassResponse;
-   delete pclFailResponse;
-   delete pclErrorResponse;
+   FreeResponse(pclPassResponse);
+   FreeResponse(pclFailResponse);
+   FreeResponse(pclErrorResponse);
 
    return eReturn;
 }
@@ -1578,20 +1744,20 @@ ANTFRAMER_RETURN DSIFramerANT::SetupBurstDataTransfer(UCHAR ucMessageID_, UCHAR
    aucDesiredData[ANT_DATA_EVENT_ID_OFFSET] = MESG_EVENT_ID;
    aucDesiredData[ANT_DATA_EVENT_CODE_OFFSET] = EVENT_TRANSFER_TX_COMPLETED;
 
-   pclPassResponse = new ANTMessageResponse();
+   pclPassResponse = AllocResponse();
    pclPassResponse->Attach(MESG_RESPONSE_EVENT_ID, aucDesiredData, sizeof(aucDesiredData), this);
 
    aucDesiredData[ANT_DATA_CHANNEL_NUM_OFFSET] = ucANTChannel_; //Setup response to catch tx fail
    aucDesiredData[ANT_DATA_EVENT_ID_OFFSET] = MESG_EVENT_ID;
    aucDesiredData[ANT_DATA_EVENT_CODE_OFFSET] = EVENT_TRANSFER_TX_FAILED;
 
-   pclFailResponse = new ANTMessageResponse();
+   pclFailResponse = AllocResponse();
    pclFailResponse->Attach(MESG_RESPONSE_EVENT_ID, aucDesiredData, sizeof(aucDesiredData), this, pclPassResponse->pstCondResponseReady);
 
    aucDesiredData[ANT_DATA_CHANNEL_NUM_OFFSET] = ucANTChannel_; //Setup response to catch any errors like transfer in progress.
    aucDesiredData[ANT_DATA_EVENT_ID_OFFSET] = ucMessageID_;
 
-   pclErrorResponse = new ANTMessageResponse();
+   pclErrorResponse = AllocResponse();
    pclErrorResponse->Attach(MESG_RESPONSE_EVENT_ID, aucDesiredData, 2, this, pclPassResponse->pstCondResponseReady);
 
    //getting error Rx will also effectively lose the transfer, but only on an AP1
@@ -1637,7 +1803,10 @@ ANTFRAMER_RETURN DSIFramerANT::SetupBurstDataTransfer(UCHAR ucMessageID_, UCHAR
      if (ulResponseTime_ != 0)                                                                         //Check for errors
      {
        if ((DSIThread_GetSystemTime() - ulStartTime) > ulResponseTime_)
+       {
+           DSI_STATS_INC(pstStats, ulResponseTimeouts);
            eReturn = ANTFRAMER_TIMEOUT;
+       }
      }
    }
 
@@ -1663,7 +1832,10 @@ ANTFRAMER_RETURN DSIFramerANT::SetupBurstDataTransfer(UCHAR ucMessageID_, UCHAR
             else if (*pbCancel_ == TRUE)
                eReturn = ANTFRAMER_CANCELLED;
             else
+            {
+               DSI_STATS_INC(pstStats, ulResponseTimeouts);
                eReturn = ANTFRAMER_TIMEOUT;
+            }
          }
       }
    }
@@ -1674,9 +1846,9 @@ ANTFRAMER_RETURN DSIFramerANT::SetupBurstDataTransfer(UCHAR ucMessageID_, UCHAR
 
    DSIThread_MutexUnlock(&stMutexResponseRequest);
 
-   delete pclPassResponse;
-   delete pclFailResponse;
-   delete pclErrorResponse;
+   FreeResponse(pclPassResponse);
+   FreeResponse(pclFailResponse);
+   FreeResponse(pclErrorResponse);
    delete[] stMessage;
 
    //Always return true with no timeout, so nobody relies on this return value
@@ -1772,30 +1944,30 @@ ANTFRAMER_RETURN DSIFramerANT::SendANTFSTransfer(UCHAR ucANTChannel_, UCHAR* puc
      aucDesiredData[ANT_DATA_EVENT_ID_OFFSET] = MESG_EVENT_ID;
      aucDesiredData[ANT_DATA_EVENT_CODE_OFFSET] = EVENT_TRANSFER_TX_COMPLETED;
 
-     pclPassResponse = new ANTMessageResponse();
+     pclPassResponse = AllocResponse();
      pclPassResponse->Attach(MESG_RESPONSE_EVENT_ID, aucDesiredData, sizeof(aucDesiredData), this);
 
      aucDesiredData[ANT_DATA_CHANNEL_NUM_OFFSET] = ucANTChannel_;   //Setup response to catch tx fail
      aucDesiredData[ANT_DATA_EVENT_ID_OFFSET] = MESG_EVENT_ID;
      aucDesiredData[ANT_DATA_EVENT_CODE_OFFSET] = EVENT_TRANSFER_TX_FAILED;
 
-     pclFailResponse = new ANTMessageResponse();
+     pclFailResponse = AllocResponse();
      pclFailResponse->Attach(MESG_RESPONSE_EVENT_ID, aucDesiredData, sizeof(aucDesiredData), this, pclPassResponse->pstCondResponseReady);
 
      aucDesiredData[ANT_DATA_CHANNEL_NUM_OFFSET] = ucANTChannel_;   //Setup response to catch any errors like transfer in progress.
      aucDesiredData[ANT_DATA_EVENT_ID_OFFSET] = MESG_BURST_DATA_ID;
 
-     pclErrorResponse = new ANTMessageResponse();
+     pclErrorResponse = AllocResponse();
      pclErrorResponse->Attach(MESG_RESPONSE_EVENT_ID, aucDesiredData, 2, this, pclPassResponse->pstCondResponseReady);
 
      //getting error Rx will also effectively lose the transfer, but only on an AP1
 #if defined(WAIT_TO_FEED_TRANSFER)
      aucDesiredData[ANT_DATA_CHANNEL_NUM_OFFSET] = ucANTChannel_;   //Setup response to catch only broadcast/acknowledged messages for this channel
 
-     pclBroadcastResponse = new ANTMessageResponse();
+     pclBroadcastResponse = AllocResponse();
      pclBroadcastResponse->Attach(MESG_BROADCAST_DATA_ID, aucDesiredData, 1, this, pclPassResponse->pstCondResponseReady);
 
-     pclAcknowledgeResponse = new ANTMessageResponse();
+     pclAcknowledgeResponse = AllocResponse();
      pclAcknowledgeResponse->Attach(MESG_ACKNOWLEDGED_DATA_ID, aucDesiredData, 1, this, pclPassResponse->pstCondResponseReady);
 #endif
    }
@@ -1890,7 +2062,10 @@ ANTFRAMER_RETURN DSIFramerANT::SendANTFSTransfer(UCHAR ucANTChannel_, UCHAR* puc
           eReturn = ANTFRAMER_FAIL;
 
        if ((DSIThread_GetSystemTime() - ulStartTime) > ulResponseTime_)
+       {
+           DSI_STATS_INC(pstStats, ulResponseTimeouts);
            eReturn = ANTFRAMER_TIMEOUT;
+       }
      }
    }
 
@@ -1941,7 +2116,10 @@ ANTFRAMER_RETURN DSIFramerANT::SendANTFSTransfer(UCHAR ucANTChannel_, UCHAR* puc
             else if (*pbCancel_ == TRUE)
                eReturn = ANTFRAMER_CANCELLED;
             else
+            {
+               DSI_STATS_INC(pstStats, ulResponseTimeouts);
                eReturn = ANTFRAMER_TIMEOUT;
+            }
          }
      }
 
@@ -1955,12 +2133,12 @@ ANTFRAMER_RETURN DSIFramerANT::SendANTFSTransfer(UCHAR ucANTChannel_, UCHAR* puc
 
       DSIThread_MutexUnlock(&stMutexResponseRequest);
 
-      delete pclPassResponse;
-      delete pclFailResponse;
-      delete pclErrorResponse;
+      FreeResponse(pclPassResponse);
+      FreeResponse(pclFailResponse);
+      FreeResponse(pclErrorResponse);
    #if defined(WAIT_TO_FEED_TRANSFER)
-      delete pclBroadcastResponse;
-      delete pclAcknowledgeResponse;
+      FreeResponse(pclBroadcastResponse);
+      FreeResponse(pclAcknowledgeResponse);
    #endif
    }
 
@@ -2015,20 +2193,20 @@ ANTFRAMER_RETURN DSIFramerANT::SendANTFSClientTransfer(UCHAR ucANTChannel_, ANTF
      aucDesiredData[ANT_DATA_EVENT_ID_OFFSET] = MESG_EVENT_ID;
      aucDesiredData[ANT_DATA_EVENT_CODE_OFFSET] = EVENT_TRANSFER_TX_COMPLETED;
 
-     pclPassResponse = new ANTMessageResponse();
+     pclPassResponse = AllocResponse();
      pclPassResponse->Attach(MESG_RESPONSE_EVENT_ID, aucDesiredData, sizeof(aucDesiredData), this);
 
      aucDesiredData[ANT_DATA_CHANNEL_NUM_OFFSET] = ucANTChannel_;   //Setup response to catch tx fail
      aucDesiredData[ANT_DATA_EVENT_ID_OFFSET] = MESG_EVENT_ID;
      aucDesiredData[ANT_DATA_EVENT_CODE_OFFSET] = EVENT_TRANSFER_TX_FAILED;
 
-     pclFailResponse = new ANTMessageResponse();
+     pclFailResponse = AllocResponse();
      pclFailResponse->Attach(MESG_RESPONSE_EVENT_ID, aucDesiredData, sizeof(aucDesiredData), this, pclPassResponse->pstCondResponseReady);
 
      aucDesiredData[ANT_DATA_CHANNEL_NUM_OFFSET] = ucANTChannel_;   //Setup response to catch any errors like transfer in progress.
      aucDesiredData[ANT_DATA_EVENT_ID_OFFSET] = MESG_BURST_DATA_ID;
 
-     pclErrorResponse = new ANTMessageResponse();
+     pclErrorResponse = AllocResponse();
      pclErrorResponse->Attach(MESG_RESPONSE_EVENT_ID, aucDesiredData, 2, this, pclPassResponse->pstCondResponseReady);
    }
 
@@ -2113,7 +2291,10 @@ ANTFRAMER_RETURN DSIFramerANT::SendANTFSClientTransfer(UCHAR ucANTChannel_, ANTF
           eReturn = ANTFRAMER_FAIL;
 
        if ((DSIThread_GetSystemTime() - ulStartTime) > ulResponseTime_)
+       {
+           DSI_STATS_INC(pstStats, ulResponseTimeouts);
            eReturn = ANTFRAMER_TIMEOUT;
+       }
      }
    } // while loop
 
@@ -2140,7 +2321,10 @@ ANTFRAMER_RETURN DSIFramerANT::SendANTFSClientTransfer(UCHAR ucANTChannel_, ANTF
             else if (*pbCancel_ == TRUE)
                eReturn = ANTFRAMER_CANCELLED;
             else
+            {
+               DSI_STATS_INC(pstStats, ulResponseTimeouts);
                eReturn = ANTFRAMER_TIMEOUT;
+            }
          }
      }
 
@@ -2150,9 +2334,9 @@ ANTFRAMER_RETURN DSIFramerANT::SendANTFSClientTransfer(UCHAR ucANTChannel_, ANTF
 
       DSIThread_MutexUnlock(&stMutexResponseRequest);
 
-      delete pclPassResponse;
-      delete pclFailResponse;
-      delete pclErrorResponse;
+      FreeResponse(pclPassResponse);
+      FreeResponse(pclFailResponse);
+      FreeResponse(pclErrorResponse);
    }
 
    return eReturn;
@@ -2221,43 +2405,22 @@ void DSIFramerANT::ProcessMessage(void)
          ucPrevSequenceNum += SEQUENCE_NUMBER_INC;
          if((aucRxFifo[MESG_DATA_OFFSET] & SEQUENCE_LAST_MESSAGE) != 0 && (i+1)*8 == ucSize - 1) //If the last packet.
             ucPrevSequenceNum |= SEQUENCE_LAST_MESSAGE;
-         // Add message to the queue.
-         if ((USHORT)(usMessageHead - usMessageTail) < (USHORT)(sizeof(astMessageBuffer) / sizeof(ANT_MESSAGE_ITEM) - 1))
-         {
-            astMessageBuffer[usMessageHead].ucSize = 9;
-            astMessageBuffer[usMessageHead].stANTMessage.ucMessageID = MESG_BURST_DATA_ID;
-            astMessageBuffer[usMessageHead].stANTMessage.aucData[0] = ucPrevSequenceNum | (aucRxFifo[MESG_DATA_OFFSET] & CHANNEL_NUMBER_MASK);
-            memcpy(astMessageBuffer[usMessageHead].stANTMessage.aucData + 1, &aucRxFifo[MESG_DATA_OFFSET + 1 + i*8], 8);
-            usMessageHead++;                                   // Rollover of usMessageHead happens automagically because our buffer size is MAX_USHORT + 1.
-         }
-         else
-         {
-            ucError = DSI_FRAMER_ANT_EQUEUE_OVERFLOW;
-         }
 
-         DSIThread_CondSignal(&stCondMessageReady);
+         ANT_MESSAGE stBurstMessage;
+         stBurstMessage.ucMessageID = MESG_BURST_DATA_ID;
+         stBurstMessage.aucData[0] = ucPrevSequenceNum | (aucRxFifo[MESG_DATA_OFFSET] & CHANNEL_NUMBER_MASK);
+         memcpy(stBurstMessage.aucData + 1, &aucRxFifo[MESG_DATA_OFFSET + 1 + i*8], 8);
+         DeliverMessage(&stBurstMessage, 9);
 
          #if defined(SERIAL_DEBUG)
-            DSIDebug::SerialWrite(pclSerial->GetDeviceNumber(), "Simulated Rx", astMessageBuffer[usMessageHead-1].stANTMessage.aucData, astMessageBuffer[usMessageHead-1].ucSize);
+            DSIDebug::SerialWrite(pclSerial->GetDeviceNumber(), "Simulated Rx", stBurstMessage.aucData, 9);
          #endif
       }
    }
    else
    {
-      // Add message to the queue.
-      if ((USHORT)(usMessageHead - usMessageTail) < (USHORT)(sizeof(astMessageBuffer) / sizeof(ANT_MESSAGE_ITEM) - 1))
-      {
-         astMessageBuffer[usMessageHead].ucSize = ucSize;
-         astMessageBuffer[usMessageHead].stANTMessage.ucMessageID = ucMessageID;
-         memcpy(astMessageBuffer[usMessageHead].stANTMessage.aucData, &aucRxFifo[MESG_DATA_OFFSET], ucSize);
-         usMessageHead++;                                   // Rollover of usMessageHead happens automagically because our buffer size is MAX_USHORT + 1.
-      }
-      else
-      {
-         ucError = DSI_FRAMER_ANT_EQUEUE_OVERFLOW;
-      }
-
-      DSIThread_CondSignal(&stCondMessageReady);
+      // The frame already has the ANT_MESSAGE layout starting at the message ID.
+      DeliverMessage((ANT_MESSAGE*)&aucRxFifo[MESG_ID_OFFSET], ucSize);
 
       #if defined(SERIAL_DEBUG)
          DSIDebug::SerialWrite(pclSerial->GetDeviceNumber(), "Rx", aucRxFifo, ucSize + 4);
@@ -2265,79 +2428,377 @@ void DSIFramerANT::ProcessMessage(void)
    }
 }
 
+///////////////////////////////////////////////////////////////////////
+// Passes a framed message to the message callback, or adds it to the
+// queue for GetMessage() if there is none.
+// stMutexCriticalSection must be locked before calling this function.
+///////////////////////////////////////////////////////////////////////
+void DSIFramerANT::DeliverMessage(ANT_MESSAGE* pstANTMessage_, UCHAR ucSize_)
+{
+   if (pfMessageCallback)
+   {
+      pfMessageCallback(pstANTMessage_, ucSize_, pvMessageCallbackParameter);
+      return;
+   }
+
+   // Add message to the queue.
+   if ((USHORT)(usMessageHead - usMessageTail) < (USHORT)(sizeof(astMessageBuffer) / sizeof(ANT_MESSAGE_ITEM) - 1))
+   {
+      astMessageBuffer[usMessageHead].ucSize = ucSize_;
+      astMessageBuffer[usMessageHead].stANTMessage.ucMessageID = pstANTMessage_->ucMessageID;
+      memcpy(astMessageBuffer[usMessageHead].stANTMessage.aucData, pstANTMessage_->aucData, ucSize_);
+      usMessageHead++;                                   // Rollover of usMessageHead happens automagically because our buffer size is MAX_USHORT + 1.
+      DSI_STATS_MAX(pstStats, ulQueueHighWater, (USHORT)(usMessageHead - usMessageTail));
+   }
+   else
+   {
+      DSI_STATS_INC(pstStats, ulQueueOverflows);
+      ucError = DSI_FRAMER_ANT_EQUEUE_OVERFLOW;
+   }
+
+   DSIThread_CondSignal(&stCondMessageReady);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Only the two table slots a response to this message could have been
+// attached under are checked; responses matching on data are keyed by
+// the first data byte, those that don't by RESPONSE_ANY_FIRST_BYTE.
 ///////////////////////////////////////////////////////////////////////
 void DSIFramerANT::CheckResponseList(void)
 {
    ANTMessageResponse *pclResponseList;
    BOOL bMatch;
+   UCHAR aucSlots[2];
 
-   DSIThread_MutexLock(&stMutexResponseRequest);
+   if (usResponsesAttached == 0)                                                            // Nothing is waiting, don't bother locking.
+      return;
 
-   pclResponseList = pclResponseListStart;
+   aucSlots[0] = RESPONSE_TABLE_SLOT(aucRxFifo[MESG_ID_OFFSET], aucRxFifo[MESG_DATA_OFFSET]);
+   aucSlots[1] = RESPONSE_TABLE_SLOT(aucRxFifo[MESG_ID_OFFSET], RESPONSE_ANY_FIRST_BYTE);
 
-   while (pclResponseList != NULL)
+   DSIThread_MutexLock(&stMutexResponseRequest);
+
+   for (UCHAR ucSlot = 0; ucSlot < 2; ucSlot++)
    {
-      bMatch = TRUE;
+      if (ucSlot == 1 && aucSlots[1] == aucSlots[0])
+         break;
+
+      pclResponseList = apclResponseTable[aucSlots[ucSlot]];
 
-      if (pclResponseList->bResponseReady == FALSE && pclResponseList->stMessageItem.stANTMessage.ucMessageID == aucRxFifo[MESG_ID_OFFSET])
+      while (pclResponseList != NULL)
       {
-         for(int i=0; i < pclResponseList->ucBytesToMatch; i++)
+         bMatch = TRUE;
+
+         if (pclResponseList->bResponseReady == FALSE && pclResponseList->stMessageItem.stANTMessage.ucMessageID == aucRxFifo[MESG_ID_OFFSET])
          {
-            if (pclResponseList->stMessageItem.stANTMessage.aucData[i] != aucRxFifo[MESG_DATA_OFFSET + i])
+            for(int i=0; i < pclResponseList->ucBytesToMatch; i++)
             {
-               bMatch = FALSE;                                                             // Data byte did not match
+               if (pclResponseList->stMessageItem.stANTMessage.aucData[i] != aucRxFifo[MESG_DATA_OFFSET + i])
+               {
+                  bMatch = FALSE;                                                          // Data byte did not match
+                  break;
+               }
             }
          }
+         else
+         {
+            bMatch = FALSE;                                                                  // Mesg ID did not match
+         }
+
+         if (bMatch)
+         {
+           int i = pclResponseList->ucBytesToMatch;
+           pclResponseList->stMessageItem.ucSize = aucRxFifo[MESG_SIZE_OFFSET];
+           memcpy(&(pclResponseList->stMessageItem.stANTMessage.aucData[i]), &(aucRxFifo[MESG_DATA_OFFSET + i]), MESG_MAX_SIZE_VALUE - i);   // Copy the rest of the message
+
+           pclResponseList->bResponseReady = TRUE;
+           DSIThread_CondSignal(pclResponseList->pstCondResponseReady);
+
+           if (pclResponseList->bConsume)                                                   // Nobody else gets this one.
+              break;
+         }
+
+         pclResponseList = pclResponseList->pclNext;
       }
-      else
+
+      if (pclResponseList != NULL)                                                          // Stopped early on a consumed response.
+         break;
+   }
+
+   DSIThread_MutexUnlock(&stMutexResponseRequest);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Fills in the response event bytes that answer the given command.
+// Returns the number of bytes to match.
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIFramerANT::GetCommandResponseKey(ANT_MESSAGE *pstANTMessage_, UCHAR *pucDesiredData_)
+{
+   UCHAR bytesToMatch = 2;
+
+   pucDesiredData_[ANT_DATA_CHANNEL_NUM_OFFSET] = pstANTMessage_->aucData[ANT_DATA_CHANNEL_NUM_OFFSET];
+   pucDesiredData_[ANT_DATA_EVENT_ID_OFFSET] = pstANTMessage_->ucMessageID;
+
+   //Script dump success can be determined by looking for the script cmd 0x04 dump complete code
+   if(pstANTMessage_->ucMessageID == MESG_SCRIPT_CMD_ID && pstANTMessage_->aucData[ANT_DATA_EVENT_ID_OFFSET] == SCRIPT_CMD_DUMP)
+   {
+      pucDesiredData_[ANT_DATA_CHANNEL_NUM_OFFSET] = SCRIPT_CMD_END_DUMP;
+      bytesToMatch = 1; //The second byte is the number of commands returned, which we can't guess so only match the first byte
+   }
+   else if(pstANTMessage_->ucMessageID == MESG_SCRIPT_DATA_ID)
+   {
+      //The first byte of script write is the id of the message being written, not the channel, and it is not overwritten but it is returned with the burst mask, so we need to ensure that is what we are looking for
+      pucDesiredData_[ANT_DATA_CHANNEL_NUM_OFFSET] &= 0x1F;
+   }
+
+   return bytesToMatch;
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIFramerANT::BeginCommandGroup(void)
+{
+   UCHAR ucGroup = COMMAND_GROUP_NONE;
+
+   DSIThread_MutexLock(&stMutexResponseRequest);
+
+   if (ucOpenGroup == COMMAND_GROUP_NONE)
+   {
+      for (UCHAR i = 0; i < COMMAND_GROUP_COUNT; i++)
       {
-         bMatch = FALSE;                                                                     // Mesg ID did not match
+         if (!astCommandGroups[i].bInUse)
+         {
+            astCommandGroups[i].bInUse = TRUE;
+            astCommandGroups[i].bSubmitted = FALSE;
+            astCommandGroups[i].ucCount = 0;
+            usGroupTxSize = 0;
+            eOpenGroupThread = DSIThread_GetCurrentThreadIDNum();
+            ucGroup = i + 1;                                // Handles start at 1 so COMMAND_GROUP_NONE stays invalid.
+            ucOpenGroup = ucGroup;
+            break;
+         }
       }
+   }
+
+   DSIThread_MutexUnlock(&stMutexResponseRequest);
+
+   return ucGroup;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Attaches a response for the command and appends its frame to the
+// group's transmit buffer.
+///////////////////////////////////////////////////////////////////////
+BOOL DSIFramerANT::AddToCommandGroup(ANT_MESSAGE *pstANTMessage_, USHORT usMessageSize_)
+{
+   ANT_COMMAND_GROUP *pstGroup;
+   ANTMessageResponse *pclResponse;
+   UCHAR aucDesiredData[2];
+   UCHAR ucBytesToMatch;
+   UCHAR ucFrameSize;
+
+   if (ucOpenGroup == COMMAND_GROUP_NONE)
+      return FALSE;
+
+   pstGroup = &astCommandGroups[ucOpenGroup - 1];
+   if (pstGroup->ucCount >= COMMAND_GROUP_SIZE)
+   {
+      #if defined(DEBUG_FILE)
+         DSIDebug::ThreadWrite("Framer->AddToCommandGroup():  Group full.");
+      #endif
+      return FALSE;
+   }
+
+   ucFrameSize = FrameMessage(pstANTMessage_, usMessageSize_, &aucGroupTxFifo[usGroupTxSize]);
+   if (ucFrameSize == 0)
+      return FALSE;
+
+   ucBytesToMatch = GetCommandResponseKey(pstANTMessage_, aucDesiredData);
+   pclResponse = AllocResponse();
+   pclResponse->bConsume = TRUE;                            // Responses come back in order, each one answers only the oldest waiter.
+   pclResponse->Attach(MESG_RESPONSE_EVENT_ID, aucDesiredData, ucBytesToMatch, this, &pstGroup->stCondResponseReady);
+
+   pstGroup->apclResponses[pstGroup->ucCount++] = pclResponse;
+   usGroupTxSize += ucFrameSize;
+
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSIFramerANT::SubmitCommandGroup(UCHAR ucGroup_)
+{
+   ANT_COMMAND_GROUP *pstGroup;
+
+   if (ucGroup_ == COMMAND_GROUP_NONE || ucGroup_ > COMMAND_GROUP_COUNT)
+      return FALSE;
+
+   pstGroup = &astCommandGroups[ucGroup_ - 1];
+
+   DSIThread_MutexLock(&stMutexResponseRequest);
+   if (!pstGroup->bInUse || ucOpenGroup != ucGroup_)
+   {
+      DSIThread_MutexUnlock(&stMutexResponseRequest);
+      return FALSE;
+   }
+   ucOpenGroup = COMMAND_GROUP_NONE;
+   pstGroup->bSubmitted = TRUE;
+   DSIThread_MutexUnlock(&stMutexResponseRequest);
+
+   if (usGroupTxSize == 0)
+      return TRUE;
+
+   if (!pclSerial->WriteBytes(aucGroupTxFifo, usGroupTxSize))
+   {
+      #if defined(DEBUG_FILE)
+         DSIDebug::ThreadWrite("Framer->SubmitCommandGroup():  WriteBytes Failed.");
+      #endif
+      ReleaseCommandGroup(pstGroup);
+      return FALSE;
+   }
+   DSI_STATS_ADD(pstStats, ulFramesOut, pstGroup->ucCount);
+
+   #if defined(SERIAL_DEBUG)
+      DSIDebug::SerialWrite(pclSerial->GetDeviceNumber(), "Tx Group", aucGroupTxFifo, usGroupTxSize);
+   #endif
+
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSIFramerANT::IsCommandGroupDone(UCHAR ucGroup_)
+{
+   ANT_COMMAND_GROUP *pstGroup;
+   BOOL bDone = TRUE;
+
+   if (ucGroup_ == COMMAND_GROUP_NONE || ucGroup_ > COMMAND_GROUP_COUNT)
+      return FALSE;
+
+   pstGroup = &astCommandGroups[ucGroup_ - 1];
 
-      if (bMatch)
+   DSIThread_MutexLock(&stMutexResponseRequest);
+   if (!pstGroup->bInUse || !pstGroup->bSubmitted)
+      bDone = FALSE;
+   for (UCHAR i = 0; bDone && i < pstGroup->ucCount; i++)
+      bDone = pstGroup->apclResponses[i]->bResponseReady;
+   DSIThread_MutexUnlock(&stMutexResponseRequest);
+
+   return bDone;
+}
+
+///////////////////////////////////////////////////////////////////////
+ANTFRAMER_RETURN DSIFramerANT::WaitForCommandGroup(UCHAR ucGroup_, ULONG ulResponseTime_)
+{
+   ANT_COMMAND_GROUP *pstGroup;
+   ANTFRAMER_RETURN eResult = ANTFRAMER_PASS;
+   ULONG ulStartTime = DSIThread_GetSystemTime();
+   UCHAR ucReady;
+   BOOL bInUse;
+   BOOL bSubmitted;
+
+   if (ucGroup_ == COMMAND_GROUP_NONE || ucGroup_ > COMMAND_GROUP_COUNT)
+      return ANTFRAMER_INVALIDPARAM;
+
+   pstGroup = &astCommandGroups[ucGroup_ - 1];
+
+   DSIThread_MutexLock(&stMutexResponseRequest);
+   bInUse = pstGroup->bInUse;
+   bSubmitted = pstGroup->bSubmitted;
+   DSIThread_MutexUnlock(&stMutexResponseRequest);
+
+   if (!bInUse || (!bSubmitted && ulResponseTime_ == 0))   // A check never writes, a failed write would release it.
+      return ANTFRAMER_INVALIDPARAM;
+
+   if (!bSubmitted && !SubmitCommandGroup(ucGroup_))
+      return ANTFRAMER_FAIL;
+
+   DSIThread_MutexLock(&stMutexResponseRequest);
+
+   while (TRUE)
+   {
+      ucReady = 0;
+      for (UCHAR i = 0; i < pstGroup->ucCount; i++)
+      {
+         if (pstGroup->apclResponses[i]->bResponseReady)
+            ucReady++;
+      }
+
+      if (ucReady == pstGroup->ucCount)
+         break;
+
+      if (ulResponseTime_ == 0)                             // Only a check, the group stays in flight.
       {
-        int i = pclResponseList->ucBytesToMatch;
-        pclResponseList->stMessageItem.ucSize = aucRxFifo[MESG_SIZE_OFFSET];
-        memcpy(&(pclResponseList->stMessageItem.stANTMessage.aucData[i]), &(aucRxFifo[MESG_DATA_OFFSET + i]), MESG_MAX_SIZE_VALUE - i);   // Copy the rest of the message
+         eResult = ANTFRAMER_TIMEOUT;
+         break;
+      }
 
-        pclResponseList->bResponseReady = TRUE;
-        DSIThread_CondSignal(pclResponseList->pstCondResponseReady);
+      ULONG ulElapsed = DSIThread_GetSystemTime() - ulStartTime;
+      if (ulElapsed >= ulResponseTime_ || (pbCancel != NULL && *pbCancel == TRUE))
+      {
+         if (ulElapsed >= ulResponseTime_)
+            DSI_STATS_INC(pstStats, ulResponseTimeouts);
+         eResult = ANTFRAMER_TIMEOUT;
+         break;
       }
 
-      pclResponseList = pclResponseList->pclNext;
+      DSIThread_CondTimedWait(&pstGroup->stCondResponseReady, &stMutexResponseRequest, ulResponseTime_ - ulElapsed);
    }
 
+   if (eResult == ANTFRAMER_PASS)
+   {
+      for (UCHAR i = 0; i < pstGroup->ucCount; i++)
+      {
+         if (pstGroup->apclResponses[i]->stMessageItem.stANTMessage.aucData[ANT_DATA_EVENT_CODE_OFFSET] != RESPONSE_NO_ERROR)
+         {
+            #if defined(DEBUG_FILE)
+               DSIDebug::ThreadWrite("Framer->WaitForCommandGroup():  Response != RESPONSE_NO_ERROR.");
+            #endif
+            eResult = ANTFRAMER_FAIL;
+            break;
+         }
+      }
+   }
+   #if defined(DEBUG_FILE)
+   else
+   {
+      DSIDebug::ThreadWrite("Framer->WaitForCommandGroup():  Timeout.");
+   }
+   #endif
+
    DSIThread_MutexUnlock(&stMutexResponseRequest);
+
+   if (ulResponseTime_ != 0)                                // A check keeps the group whatever it found.
+      ReleaseCommandGroup(pstGroup);
+   return eResult;
 }
 
+///////////////////////////////////////////////////////////////////////
+void DSIFramerANT::ReleaseCommandGroup(ANT_COMMAND_GROUP *pstGroup_)
+{
+   for (UCHAR i = 0; i < pstGroup_->ucCount; i++)
+      FreeResponse(pstGroup_->apclResponses[i]);
+
+   DSIThread_MutexLock(&stMutexResponseRequest);
+   pstGroup_->ucCount = 0;
+   pstGroup_->bSubmitted = FALSE;
+   pstGroup_->bInUse = FALSE;
+   DSIThread_MutexUnlock(&stMutexResponseRequest);
+}
 
 ///////////////////////////////////////////////////////////////////////
 BOOL DSIFramerANT::SendCommand(ANT_MESSAGE *pstANTMessage_, USHORT usMessageSize_, ULONG ulResponseTime_)
 {
    ANTMessageResponse *pclCommandResponse = (ANTMessageResponse*)NULL;
 
+   // Commands sent while building a group are queued rather than written.
+   if (ucOpenGroup != COMMAND_GROUP_NONE && DSIThread_CompareThreads(eOpenGroupThread, DSIThread_GetCurrentThreadIDNum()))
+      return AddToCommandGroup(pstANTMessage_, usMessageSize_);
+
    // If we are going to be waiting for a response setup the Response object
    if (ulResponseTime_ != 0)
    {
       UCHAR aucDesiredData[2];
-      UCHAR bytesToMatch = 2;
+      UCHAR bytesToMatch = GetCommandResponseKey(pstANTMessage_, aucDesiredData);
 
-      aucDesiredData[ANT_DATA_CHANNEL_NUM_OFFSET] = pstANTMessage_->aucData[ANT_DATA_CHANNEL_NUM_OFFSET];
-      aucDesiredData[ANT_DATA_EVENT_ID_OFFSET] = pstANTMessage_->ucMessageID;
-
-      //Script dump success can be determined by looking for the script cmd 0x04 dump complete code
-      if(pstANTMessage_->ucMessageID == MESG_SCRIPT_CMD_ID && pstANTMessage_->aucData[ANT_DATA_EVENT_ID_OFFSET] == SCRIPT_CMD_DUMP)
-      {
-         aucDesiredData[ANT_DATA_CHANNEL_NUM_OFFSET] = SCRIPT_CMD_END_DUMP;
-         bytesToMatch = 1; //The second byte is the number of commands returned, which we can't guess so only match the first byte
-      }
-      else if(pstANTMessage_->ucMessageID == MESG_SCRIPT_DATA_ID)
-      {
-         //The first byte of script write is the id of the message being written, not the channel, and it is not overwritten but it is returned with the burst mask, so we need to ensure that is what we are looking for
-         aucDesiredData[ANT_DATA_CHANNEL_NUM_OFFSET] &= 0x1F;
-      }
-
-      pclCommandResponse = new ANTMessageResponse();
+      pclCommandResponse = AllocResponse();
       pclCommandResponse->Attach(MESG_RESPONSE_EVENT_ID, aucDesiredData, bytesToMatch, this);
    }
 
@@ -2350,7 +2811,7 @@ BOOL DSIFramerANT::SendCommand(ANT_MESSAGE *pstANTMessage_, USHORT usMessageSize
 
       if(pclCommandResponse != NULL)
       {
-         delete pclCommandResponse;
+         FreeResponse(pclCommandResponse);
          pclCommandResponse = (ANTMessageResponse*)NULL;
       }
 
@@ -2370,7 +2831,7 @@ BOOL DSIFramerANT::SendCommand(ANT_MESSAGE *pstANTMessage_, USHORT usMessageSize
    //if (pclCommandResponse->stMessageItem.ucSize == 0)
    if (pclCommandResponse->bResponseReady == FALSE)
    {
-      delete pclCommandResponse;
+      FreeResponse(pclCommandResponse);
       #if defined(DEBUG_FILE)
          DSIDebug::ThreadWrite("Framer->SendCommand():  Timeout.");
       #endif
@@ -2380,14 +2841,14 @@ BOOL DSIFramerANT::SendCommand(ANT_MESSAGE *pstANTMessage_, USHORT usMessageSize
    // Check the response.
    if (pclCommandResponse->stMessageItem.stANTMessage.aucData[ANT_DATA_EVENT_CODE_OFFSET] != RESPONSE_NO_ERROR)
    {
-      delete pclCommandResponse;
+      FreeResponse(pclCommandResponse);
       #if defined(DEBUG_FILE)
          DSIDebug::ThreadWrite("Framer->SendCommand():  Response != RESPONSE_NO_ERROR.");
       #endif
       return FALSE;
    }
 
-   delete pclCommandResponse;
+   FreeResponse(pclCommandResponse);
    return TRUE;
 }
 
@@ -2405,7 +2866,7 @@ BOOL DSIFramerANT::SendRequest(UCHAR ucRequestedMesgID_, UCHAR ucANTChannel_ , A
    // If we are going to be waiting for a response setup the Response object
    if ((ulResponseTime_ != 0) && (pstANTResponse_ != NULL))
    {
-      pclRequestResponse = new ANTMessageResponse();
+      pclRequestResponse = AllocResponse();
      pclRequestResponse->Attach(ucRequestedMesgID_, (UCHAR*)NULL, 0, this);
    }
 
@@ -2414,7 +2875,7 @@ BOOL DSIFramerANT::SendRequest(UCHAR ucRequestedMesgID_, UCHAR ucANTChannel_ , A
    {
       if(pclRequestResponse != NULL)
       {
-         delete pclRequestResponse;
+         FreeResponse(pclRequestResponse);
          pclRequestResponse = (ANTMessageResponse*)NULL;
       }
       return FALSE;
@@ -2432,7 +2893,7 @@ BOOL DSIFramerANT::SendRequest(UCHAR ucRequestedMesgID_, UCHAR ucANTChannel_ , A
    // We haven't received a response in the allotted time.
    if (pclRequestResponse->bResponseReady == FALSE)
    {
-      delete pclRequestResponse;
+      FreeResponse(pclRequestResponse);
       return FALSE;
    }
 
@@ -2441,7 +2902,7 @@ BOOL DSIFramerANT::SendRequest(UCHAR ucRequestedMesgID_, UCHAR ucANTChannel_ , A
    pstANTResponse_->stANTMessage.ucMessageID = pclRequestResponse->stMessageItem.stANTMessage.ucMessageID;
    memcpy (pstANTResponse_->stANTMessage.aucData, pclRequestResponse->stMessageItem.stANTMessage.aucData, pclRequestResponse->stMessageItem.ucSize);
 
-   delete pclRequestResponse;
+   FreeResponse(pclRequestResponse);
    return TRUE;
 }
 
@@ -2462,7 +2923,7 @@ BOOL DSIFramerANT::SendUserNvmRequest(UCHAR ucRequestedMesgID_, UCHAR ucANTChann
    // If we are going to be waiting for a response setup the Response object
    if ((ulResponseTime_ != 0) && (pstANTResponse_ != NULL))
    {
-      pclRequestResponse = new ANTMessageResponse();
+      pclRequestResponse = AllocResponse();
       pclRequestResponse->Attach(ucRequestedMesgID_, (UCHAR*)NULL, 0, this);
    }
 
@@ -2471,7 +2932,7 @@ BOOL DSIFramerANT::SendUserNvmRequest(UCHAR ucRequestedMesgID_, UCHAR ucANTChann
    {
       if(pclRequestResponse != NULL)
       {
-         delete pclRequestResponse;
+         FreeResponse(pclRequestResponse);
          pclRequestResponse = (ANTMessageResponse*)NULL;
       }
       return FALSE;
@@ -2489,7 +2950,7 @@ BOOL DSIFramerANT::SendUserNvmRequest(UCHAR ucRequestedMesgID_, UCHAR ucANTChann
    // We haven't received a response in the allotted time.
    if (pclRequestResponse->bResponseReady == FALSE)
    {
-      delete pclRequestResponse;
+      FreeResponse(pclRequestResponse);
       return FALSE;
    }
 
@@ -2498,7 +2959,7 @@ BOOL DSIFramerANT::SendUserNvmRequest(UCHAR ucRequestedMesgID_, UCHAR ucANTChann
    pstANTResponse_->stANTMessage.ucMessageID = pclRequestResponse->stMessageItem.stANTMessage.ucMessageID;
    memcpy (pstANTResponse_->stANTMessage.aucData, pclRequestResponse->stMessageItem.stANTMessage.aucData, pclRequestResponse->stMessageItem.ucSize);
 
-   delete pclRequestResponse;
+   FreeResponse(pclRequestResponse);
    return TRUE;
 }
 
@@ -2580,6 +3041,10 @@ ANTMessageResponse::ANTMessageResponse()
    bResponseReady = FALSE;
    pclNext = (ANTMessageResponse*)NULL;
    pclFramer = (DSIFramerANT*)NULL;
+   ucTableSlot = 0;
+   bAttached = FALSE;
+   bConsume = FALSE;
+   bPooled = FALSE;
    if (DSIThread_CondInit(pstCondResponseReady) != DSI_THREAD_ENONE)                       //Init the wait object
       return; //need to think of a different way to handle the failure
 }
@@ -2594,7 +3059,7 @@ ANTMessageResponse::~ANTMessageResponse()
 ///////////////////////////////////////////////////////////////////////
 BOOL ANTMessageResponse::Attach(UCHAR ucMessageID_, UCHAR *pucData_, UCHAR ucBytesToMatch_, DSIFramerANT * pclFramer_, DSI_CONDITION_VAR *pstCondResponseReady_)
 {
-   ANTMessageResponse *pclResponse;
+   ANTMessageResponse **ppclResponse;
 
    bResponseReady = FALSE;                                                                 //Init ResponseReady
    stMessageItem.stANTMessage.ucMessageID = ucMessageID_;                                  //Set mesg ID to look for
@@ -2613,23 +3078,20 @@ BOOL ANTMessageResponse::Attach(UCHAR ucMessageID_, UCHAR *pucData_, UCHAR ucByt
    if (pclFramer == NULL)
       return FALSE;
 
-   DSIThread_MutexLock(&(pclFramer->stMutexResponseRequest));                              // Lock the mutex and begin list manipulation
+   if (bAttached)                                                                          // Don't link ourself in twice
+      Remove();
 
-   pclResponse = pclFramer->pclResponseListStart;
+   ucTableSlot = RESPONSE_TABLE_SLOT(ucMessageID_, (ucBytesToMatch_ != 0) ? pucData_[0] : RESPONSE_ANY_FIRST_BYTE);
 
-   if (pclFramer->pclResponseListStart == NULL)                                            // Check if the list is empty
-   {
-      pclFramer->pclResponseListStart = this;                                              // Add this reponse object to the list
-   }
-   else
-   {
-      pclResponse = pclFramer->pclResponseListStart;                                       // If the list is not empty, walk through the list
-     while (pclResponse->pclNext != NULL)
-      {
-         pclResponse = pclResponse->pclNext;
-      }
-     pclResponse->pclNext = this;                                                          // Add ourself to the end of the list
-   }
+   DSIThread_MutexLock(&(pclFramer->stMutexResponseRequest));                              // Lock the mutex and begin list manipulation
+
+   ppclResponse = &(pclFramer->apclResponseTable[ucTableSlot]);                            // Add this response object to the end of its slot, so older waiters match first
+   while (*ppclResponse != NULL)
+      ppclResponse = &((*ppclResponse)->pclNext);
+   pclNext = (ANTMessageResponse*)NULL;
+   *ppclResponse = this;
+   pclFramer->usResponsesAttached++;
+   bAttached = TRUE;
 
    DSIThread_MutexUnlock(&(pclFramer->stMutexResponseRequest));                            // Unlock mutex when we're done
 
@@ -2647,21 +3109,23 @@ void ANTMessageResponse::Remove()
 
    DSIThread_MutexLock(&(pclFramer->stMutexResponseRequest));                              // Lock the mutex and begin list manipulation
 
-   ppclResponse = &(pclFramer->pclResponseListStart);                                      // Set the ppointer to point to pclResponseListStart
-
-   while (*ppclResponse != NULL)                                                           // While the pclNext is not NULL
+   if (bAttached)
    {
-      if (*ppclResponse == this)                                                           // Check if pclNext is pointing to us
-     {
-        *ppclResponse = pclNext;                                                       // Remove this object from the List by changing the pointer to point to the element behind us
+      ppclResponse = &(pclFramer->apclResponseTable[ucTableSlot]);                          // Set the ppointer to point to the start of our slot
 
-       if (pclNext == NULL)                                                              // If we are at the end of the list, then break because we are done.
-           break;
-     }
-     else
-     {
-        ppclResponse = &((*ppclResponse)->pclNext);                                       // Advance the ppointer to point to the pclNext element of the next object in the list
-     }
+      while (*ppclResponse != NULL)
+      {
+         if (*ppclResponse == this)                                                        // Check if pclNext is pointing to us
+         {
+            *ppclResponse = pclNext;                                                       // Remove this object from the slot by changing the pointer to point to the element behind us
+            break;
+         }
+         ppclResponse = &((*ppclResponse)->pclNext);                                       // Advance the ppointer to point to the pclNext element of the next object in the slot
+      }
+
+      pclNext = (ANTMessageResponse*)NULL;
+      pclFramer->usResponsesAttached--;
+      bAttached = FALSE;
    }
 
    DSIThread_MutexUnlock(&(pclFramer->stMutexResponseRequest));                            // Unlock mutex when we're done
@@ -2675,6 +3139,8 @@ BOOL ANTMessageResponse::WaitForResponse(ULONG ulMilliseconds_)
    if ((bResponseReady == FALSE) && (ulMilliseconds_ != 0))
    {
       DSIThread_CondTimedWait(pstCondResponseReady, &(pclFramer->stMutexResponseRequest), ulMilliseconds_);
+      if (bResponseReady == FALSE)
+         DSI_STATS_INC(pclFramer->pstStats, ulResponseTimeouts);
    }
 
    DSIThread_MutexUnlock(&(pclFramer->stMutexResponseRequest));
@@ -30,6 +30,14 @@ All rights reserved.
 
 #define RX_FIFO_SIZE                   ((USHORT) 256)
 
+#define RESPONSE_TABLE_SIZE            ((USHORT) 64)        // Must be a power of 2.
+
+#define COMMAND_GROUP_NONE             ((UCHAR) 0)
+#define COMMAND_GROUP_COUNT            ((UCHAR) 4)          // Number of groups that can be in flight at once.
+#define COMMAND_GROUP_SIZE             ((UCHAR) 64)         // Most commands one group can hold.
+
+#define RESPONSE_POOL_SIZE             ((USHORT) COMMAND_GROUP_SIZE)   // Pooled responses, a full group's worth, more come from the heap.
+
 typedef struct ANT_MESSAGE
 {
    UCHAR ucMessageID;
@@ -64,8 +72,20 @@ typedef struct
    UCHAR aucData[MESG_MAX_SIZE_VALUE];
 } FS_MESSAGE;
 
+typedef void (*ANT_MESSAGE_CALLBACK)(ANT_MESSAGE* pstANTMessage_, USHORT usMessageSize_, void* pvParameter_);
+typedef void (*ANT_ERROR_CALLBACK)(UCHAR ucSerialError_, void* pvParameter_);
+
 class ANTMessageResponse;
 
+typedef struct
+{
+   BOOL bInUse;
+   BOOL bSubmitted;
+   UCHAR ucCount;
+   ANTMessageResponse *apclResponses[COMMAND_GROUP_SIZE];
+   DSI_CONDITION_VAR stCondResponseReady;                   // Shared by every response in the group.
+} ANT_COMMAND_GROUP;
+
 //////////////////////////////////////////////////////////////////////////////////
 // Public Class Prototypes
 //////////////////////////////////////////////////////////////////////////////////
@@ -97,10 +117,34 @@ class DSIFramerANT : public DSIFramer
       DSI_CONDITION_VAR stCondMessageReady;
       DSI_CONDITION_VAR stCondResponseReady;
 
-      ANTMessageResponse *pclResponseListStart;
+      ANTMessageResponse *apclResponseTable[RESPONSE_TABLE_SIZE];  // Pending responses, hashed on message ID and first data byte.
+      volatile USHORT usResponsesAttached;                          // Lets CheckResponseList() skip the lock when nothing is pending.
+      ANTMessageResponse *pclResponsePool;
+      ANTMessageResponse *pclResponseFreeList;
+
+      ANT_COMMAND_GROUP astCommandGroups[COMMAND_GROUP_COUNT];
+      UCHAR ucOpenGroup;                                    // Group collecting commands, COMMAND_GROUP_NONE if none.
+      DSI_THREAD_IDNUM eOpenGroupThread;                    // Only commands sent from this thread join the open group.
+      UCHAR aucGroupTxFifo[COMMAND_GROUP_SIZE * (MESG_MAX_SIZE_VALUE + MESG_FRAME_SIZE + 2)];
+      USHORT usGroupTxSize;
+
+      ANT_MESSAGE_CALLBACK pfMessageCallback;
+      void* pvMessageCallbackParameter;
+      ANT_ERROR_CALLBACK pfErrorCallback;
+      void* pvErrorCallbackParameter;
+
+      void InitResponseTable(void);
+      ANTMessageResponse* AllocResponse(void);
+      void FreeResponse(ANTMessageResponse *pclResponse_);
+      UCHAR GetCommandResponseKey(ANT_MESSAGE *pstANTMessage_, UCHAR *pucDesiredData_);
+      BOOL AddToCommandGroup(ANT_MESSAGE *pstANTMessage_, USHORT usMessageSize_);
+      void ReleaseCommandGroup(ANT_COMMAND_GROUP *pstGroup_);
+      UCHAR FrameMessage(void *pvData_, USHORT usMessageSize_, UCHAR *pucFrame_);
 
       USHORT GetMessageSize(void);
+      void ParseByte(UCHAR ucByte_);
       void ProcessMessage(void);
+      void DeliverMessage(ANT_MESSAGE* pstANTMessage_, UCHAR ucSize_);
       void CheckResponseList(void);
       BOOL SendCommand(ANT_MESSAGE *pstANTMessage_, USHORT usMessageSize_, ULONG ulResponseTime_ = 0);
       BOOL SendFSCommand(FS_MESSAGE *pstFSMessage_, USHORT usMessageSize_, UCHAR* pucFSResponse, ULONG ulResponseTime_ = 0);
@@ -128,8 +172,28 @@ class DSIFramerANT : public DSIFramer
 
       // Inherited methods.
       void ProcessByte(UCHAR ucByte_);
+      void ProcessBytes(const UCHAR* pucBytes_, ULONG ulSize_);
       void Error(UCHAR ucError_);
 
+      void SetMessageCallback(ANT_MESSAGE_CALLBACK pfMessageCallback_, void* pvParameter_ = NULL);
+      /////////////////////////////////////////////////////////////////
+      // Hands each received message to pfMessageCallback_ as soon as
+      // it is framed, instead of queueing it for GetMessage().
+      // The message points into the receive buffer and is only valid
+      // for the duration of the call.  The callback runs in the serial
+      // receive context with the framer locked, so it must not wait
+      // for a response (ulResponseTime_ != 0) from inside the callback.
+      // Pass NULL to go back to queued messages.
+      /////////////////////////////////////////////////////////////////
+
+      void SetErrorCallback(ANT_ERROR_CALLBACK pfErrorCallback_, void* pvParameter_ = NULL);
+      /////////////////////////////////////////////////////////////////
+      // Tells pfErrorCallback_ about each serial error (DSI_SERIAL_xxx)
+      // as the serial layer reports it, besides queueing it for
+      // GetMessage().  The callback runs in the serial receive context,
+      // so it must not close or reopen the serial port itself.
+      /////////////////////////////////////////////////////////////////
+
       BOOL WriteMessage(void *pstANTMessage_, USHORT usMessageSize_);
       /////////////////////////////////////////////////////////////////
       // As per the notes in dsi_framer.h.
@@ -140,11 +204,54 @@ class DSIFramerANT : public DSIFramer
       //                      pointed to by *pstANTMessage_ parameter.
       /////////////////////////////////////////////////////////////////
 
+      UCHAR BeginCommandGroup(void);
+      /////////////////////////////////////////////////////////////////
+      // Starts collecting commands into a group.  Until the group is
+      // submitted, every command the calling thread sends through
+      // SendCommand() (any of the configuration functions) is queued
+      // instead of written, and returns TRUE straight away.
+      // Returns a handle to the group, or COMMAND_GROUP_NONE if a
+      // group is already being collected or all groups are in flight.
+      /////////////////////////////////////////////////////////////////
+
+      BOOL SubmitCommandGroup(UCHAR ucGroup_);
+      /////////////////////////////////////////////////////////////////
+      // Writes all queued commands of the group in one go, without
+      // waiting for their responses.  If the write fails the group is
+      // released and the handle is no longer valid.
+      /////////////////////////////////////////////////////////////////
+
+      BOOL IsCommandGroupDone(UCHAR ucGroup_);
+      /////////////////////////////////////////////////////////////////
+      // Returns TRUE once every command in the group has a response.
+      /////////////////////////////////////////////////////////////////
+
+      ANTFRAMER_RETURN WaitForCommandGroup(UCHAR ucGroup_, ULONG ulResponseTime_);
+      /////////////////////////////////////////////////////////////////
+      // Submits the group if that hasn't been done yet, waits up to
+      // ulResponseTime_ for all its responses and releases the group.
+      // Returns ANTFRAMER_PASS if every command answered
+      // RESPONSE_NO_ERROR, ANTFRAMER_FAIL if any reported an error and
+      // ANTFRAMER_TIMEOUT if any did not answer in time.
+      // A ulResponseTime_ of 0 only checks a submitted group: it
+      // returns the same results, ANTFRAMER_TIMEOUT while a response
+      // is still missing (not counted as a response timeout), and
+      // never releases the group, so the handle stays valid until a
+      // wait that is not 0.
+      // A group must not hold the same command twice for one channel.
+      /////////////////////////////////////////////////////////////////
+
       USHORT WaitForMessage(ULONG ulMilliseconds_);
       /////////////////////////////////////////////////////////////////
       // As per the notes in dsi_framer.h.
       /////////////////////////////////////////////////////////////////
 
+      void CancelWait();
+      /////////////////////////////////////////////////////////////////
+      // Wakes a thread in WaitForMessage(), which from then on returns
+      // without waiting.  For stopping the thread that reads messages.
+      /////////////////////////////////////////////////////////////////
+
       USHORT GetMessage(void *pstANTMessage_, USHORT usMessageSize_ = 0);
       /////////////////////////////////////////////////////////////////
       // As per the notes in dsi_framer.h.
@@ -427,6 +534,10 @@ class ANTMessageResponse
       ///////////////////////////////////////////////////////////////
       DSIFramerANT * pclFramer;
       ANTMessageResponse * pclNext;
+      UCHAR ucTableSlot;
+      BOOL bAttached;
+      BOOL bConsume;                                        // Stop looking for other waiters once this one matched.
+      BOOL bPooled;
       UCHAR ucBytesToMatch;
       ANT_MESSAGE_ITEM stMessageItem;
       DSI_CONDITION_VAR stCondResponseReady;
@@ -63,7 +63,14 @@ LibusbLibrary::LibusbLibrary() //throw(LibusbError::Enum&)
    DetachKernelDriver(NULL),
    AttachKernelDriver(NULL),
    KernelDriverActive(NULL),
-   HandleEventsTimeoutCompleted(NULL)
+   HandleEventsTimeoutCompleted(NULL),
+   HasCapability(NULL),
+   HotplugRegisterCallback(NULL),
+   GetBusNumber(NULL),
+   GetPortNumbers(NULL),
+   GetPollfds(NULL),
+   FreePollfds(NULL),
+   InterruptEventHandler(NULL)
 #endif
 
 {
@@ -163,7 +170,7 @@ LibusbError::Enum LibusbLibrary::LoadFunctions()
    if(ReferenceDevice == NULL)
       bStatus = FALSE;
 
-   UnreferenceDevice = (UnreferenceDevice_t)&libusb_ref_device;
+   UnreferenceDevice = (UnreferenceDevice_t)&libusb_unref_device;
    if(UnreferenceDevice == NULL)
       bStatus = FALSE;
 
@@ -202,6 +209,35 @@ LibusbError::Enum LibusbLibrary::LoadFunctions()
    HandleEventsTimeoutCompleted = (HandleEventsTimeoutCompleted_t)&libusb_handle_events_timeout_completed;
    if(HandleEventsTimeoutCompleted == NULL)
       bStatus = FALSE;
+
+   HasCapability = (HasCapability_t)&libusb_has_capability;
+   if(HasCapability == NULL)
+      bStatus = FALSE;
+
+   HotplugRegisterCallback = (HotplugRegisterCallback_t)&libusb_hotplug_register_callback;
+   if(HotplugRegisterCallback == NULL)
+      bStatus = FALSE;
+
+   GetBusNumber = (GetBusNumber_t)&libusb_get_bus_number;
+   if(GetBusNumber == NULL)
+      bStatus = FALSE;
+
+   GetPortNumbers = (GetPortNumbers_t)&libusb_get_port_numbers;
+   if(GetPortNumbers == NULL)
+      bStatus = FALSE;
+
+   GetPollfds = (GetPollfds_t)&libusb_get_pollfds;
+   if(GetPollfds == NULL)
+      bStatus = FALSE;
+
+   FreePollfds = (FreePollfds_t)&libusb_free_pollfds;
+   if(FreePollfds == NULL)
+      bStatus = FALSE;
+
+   //Optional, stopping the receive thread waits out its event timeout without it
+#if defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000105)
+   InterruptEventHandler = (InterruptEventHandler_t)&libusb_interrupt_event_handler;
+#endif
 #endif
 
    if(bStatus == FALSE)
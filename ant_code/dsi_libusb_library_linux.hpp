@@ -93,6 +93,13 @@ class LibusbLibrary
    typedef int                                 (*AttachKernelDriver_t)(libusb_device_handle*, int);
    typedef int                                 (*KernelDriverActive_t)(libusb_device_handle*, int);
    typedef int                                 (*HandleEventsTimeoutCompleted_t)(libusb_context*, struct timeval*, int*);
+   typedef int                                 (*HasCapability_t)(uint32_t);
+   typedef int                                 (*HotplugRegisterCallback_t)(libusb_context*, int, int, int, int, int, libusb_hotplug_callback_fn, void*, libusb_hotplug_callback_handle*);
+   typedef uint8_t                             (*GetBusNumber_t)(libusb_device*);
+   typedef int                                 (*GetPortNumbers_t)(libusb_device*, uint8_t*, int);
+   typedef const struct libusb_pollfd**        (*GetPollfds_t)(libusb_context*);
+   typedef void                                (*FreePollfds_t)(const struct libusb_pollfd**);
+   typedef void                                (*InterruptEventHandler_t)(libusb_context*);
 
 #endif
 
@@ -122,6 +129,13 @@ class LibusbLibrary
    AttachKernelDriver_t AttachKernelDriver;
    KernelDriverActive_t KernelDriverActive;
    HandleEventsTimeoutCompleted_t HandleEventsTimeoutCompleted;
+   HasCapability_t HasCapability;
+   HotplugRegisterCallback_t HotplugRegisterCallback;
+   GetBusNumber_t GetBusNumber;
+   GetPortNumbers_t GetPortNumbers;
+   GetPollfds_t GetPollfds;
+   FreePollfds_t FreePollfds;
+   InterruptEventHandler_t InterruptEventHandler;   //NULL before libusb 1.0.21
 #endif
 
   private:
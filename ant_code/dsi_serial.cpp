@@ -8,6 +8,7 @@ All rights reserved.
 */
 #include "types.h"
 #include "dsi_serial.hpp"
+#include "dsi_thread.h"
 
 
 //////////////////////////////////////////////////////////////////////////////////
@@ -20,6 +21,7 @@ All rights reserved.
 DSISerial::DSISerial()
 {
    pclCallback = (DSISerialCallback*)NULL;
+   pstStats = &stDSIStats;
 }
 
 /////////////////////////////////////////////////////////////////
@@ -35,3 +37,15 @@ void DSISerial::SetCallback(DSISerialCallback *pclCallback_)
    pclCallback = pclCallback_;
 }
 
+/////////////////////////////////////////////////////////////////
+void DSISerial::SetStats(ANT_STATS *pstStats_)
+{
+   pstStats = pstStats_;
+}
+
+/////////////////////////////////////////////////////////////////
+BOOL DSISerial::WaitForDevice(ULONG ulMilliseconds_)
+{
+   DSIThread_Sleep(ulMilliseconds_);
+   return FALSE;
+}
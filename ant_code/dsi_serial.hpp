@@ -11,6 +11,7 @@ All rights reserved.
 
 #include "types.h"
 #include "dsi_serial_callback.hpp"
+#include "dsi_stats.h"
 
 
 //////////////////////////////////////////////////////////////////////////////////
@@ -24,6 +25,13 @@ All rights reserved.
 #define DSI_SERIAL_EREAD            ((UCHAR) 0x03)
 #define DSI_SERIAL_EOTHER           ((UCHAR) 0xFF)
 
+// A descriptor an external event loop waits on, events as for poll().
+typedef struct
+{
+   int iFd;
+   short sEvents;
+} DSI_POLLFD;
+
 
 //////////////////////////////////////////////////////////////////////////////////
 // Public Class Prototypes
@@ -33,6 +41,7 @@ class DSISerial
 {
    protected:
       DSISerialCallback *pclCallback;                       // Local pointer to a DSISerialCallback object.
+      ANT_STATS *pstStats;                                  // The stick's counters, stDSIStats until SetStats().
 
    public:
       // Constructor and Destructor
@@ -58,6 +67,42 @@ class DSISerial
       //    *pclCallback_:    A pointer to a DSISerialCallback object.
       /////////////////////////////////////////////////////////////////
 
+      void SetStats(ANT_STATS *pstStats_);
+      /////////////////////////////////////////////////////////////////
+      // Counts into *pstStats_ from then on.  Must be called before
+      // Open().
+      /////////////////////////////////////////////////////////////////
+
+      virtual BOOL SetDirectReceive(BOOL /*bEnable_*/) { return FALSE; }
+      /////////////////////////////////////////////////////////////////
+      // Requests that received bytes be passed to the callback from
+      // the lowest receive context available, skipping any internal
+      // receive thread.  Must be called before Open().
+      // Returns TRUE if the implementation supports it.
+      /////////////////////////////////////////////////////////////////
+
+      virtual BOOL SetExternalReceive(BOOL /*bEnable_*/) { return FALSE; }
+      /////////////////////////////////////////////////////////////////
+      // With direct receive open, stops the receive context and leaves
+      // waiting for the device to the caller: it waits on the
+      // descriptors from GetPollFds() and calls ReceivePoll() when one
+      // is ready.  FALSE hands receiving back to the receive context.
+      // Undone by Close().
+      // Returns TRUE if the implementation supports it.
+      /////////////////////////////////////////////////////////////////
+
+      virtual UCHAR GetPollFds(DSI_POLLFD* /*pastFds_*/, UCHAR /*ucMax_*/) { return 0; }
+      /////////////////////////////////////////////////////////////////
+      // Fills in up to ucMax_ descriptors to wait on for received
+      // data.  Returns the number filled in.
+      /////////////////////////////////////////////////////////////////
+
+      virtual void ReceivePoll(void) {}
+      /////////////////////////////////////////////////////////////////
+      // Passes whatever has been received to the callback, without
+      // waiting, on the calling thread.
+      /////////////////////////////////////////////////////////////////
+
       virtual BOOL Open(void) = 0;
       /////////////////////////////////////////////////////////////////
       // Opens up the communication channel with the serial module.
@@ -84,6 +129,14 @@ class DSISerial
       /////////////////////////////////////////////////////////////////
       // Returns the port number communication is on.
       /////////////////////////////////////////////////////////////////
+
+      virtual BOOL WaitForDevice(ULONG ulMilliseconds_);
+      /////////////////////////////////////////////////////////////////
+      // Waits, with the port closed, for a device to be plugged in.
+      // Returns TRUE as soon as one arrives, FALSE once
+      // ulMilliseconds_ is up.  Implementations that cannot tell just
+      // sleep, so Open() gets tried at that interval.
+      /////////////////////////////////////////////////////////////////
 };
 
 #endif // !defined(DSI_SERIAL_HPP)
@@ -28,6 +28,19 @@ class DSISerialCallback
       //    ucByte_:          The byte to process.
       /////////////////////////////////////////////////////////////////
 
+      virtual void ProcessBytes(const UCHAR* pucBytes_, ULONG ulSize_)
+      {
+         for(ULONG i=0; i<ulSize_; i++)
+            ProcessByte(pucBytes_[i]);
+      }
+      /////////////////////////////////////////////////////////////////
+      // Processes a block of received bytes.  Implementations may
+      // override this to avoid per-byte locking.
+      // Parameters:
+      //    *pucBytes_:       A pointer to the received bytes.
+      //    ulSize_:          The number of bytes to process.
+      /////////////////////////////////////////////////////////////////
+
       virtual void Error(UCHAR ucError_) = 0;
       /////////////////////////////////////////////////////////////////
       // Signals an error.
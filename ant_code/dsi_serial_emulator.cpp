@@ -0,0 +1,1222 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except
+in compliance with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2016
+All rights reserved.
+*/
+
+#include "dsi_serial_emulator.hpp"
+
+#include "types.h"
+#include "defines.h"
+#include "antdefines.h"
+#include "antmessage.h"
+#include "checksum.h"
+#include "dsi_stats.h"
+
+#include <string.h>
+#if defined(DSI_TYPES_LINUX)
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Private Definitions
+//////////////////////////////////////////////////////////////////////////////////
+
+#define EMULATOR_IDLE_WAIT_MS          ((ULONG) 1000)       // Longest the thread sleeps with nothing to do
+#define EMULATOR_PERIOD_TICKS_PER_SEC  ((ULLONG) 32768)
+#define EMULATOR_DEFAULT_PERIOD        ((USHORT) 8192)      // 4Hz, the module default
+
+// Channel events the host receives as MESG_RESPONSE_EVENT_ID [channel, 1, event]
+#define EMULATOR_IS_MASTER(type)       (((type) & PARAMETER_TX_NOT_RX) != 0)
+
+// EVENT_FILTER_xxx bit of the channel events from EVENT_RX_SEARCH_TIMEOUT to EVENT_TRANSFER_TX_START
+#define EMULATOR_FILTER_BIT(event)     ((USHORT)(1 << ((event) - EVENT_RX_SEARCH_TIMEOUT)))
+#define EMULATOR_RSSI_TYPE_DBM         ((UCHAR) 0x20)
+#define EMULATOR_RSSI_DBM              ((UCHAR) -60)        // Remote device a couple of metres away
+#define EMULATOR_RSSI_NO_THRESHOLD     ((UCHAR) 0x80)
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Methods
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+// Constructor
+///////////////////////////////////////////////////////////////////////
+DSISerialEmulator::DSISerialEmulator()
+{
+   hEmulatorThread = (DSI_THREAD_ID)NULL;
+   bStopEmulatorThread = TRUE;
+   bOpen = FALSE;
+   usOutputHead = 0;
+   usOutputCount = 0;
+   ulOutputOverruns = 0;
+   usNoiseBytes = 0;
+   bCorruptNext = FALSE;
+   usDropFrames = 0;
+   usDropTxEvents = 0;
+   ulBufferStart = 0;
+   bUnplugged = FALSE;
+   bReportGone = FALSE;
+   ulReplugTime = 0;
+   ulRandomState = 0x2545F491;
+   ucDeviceNumber = 0;
+   bExternalReceive = FALSE;
+   bOutputSignalled = FALSE;
+   iExternalFd = -1;
+
+   memset(astChannels, 0, sizeof(astChannels));
+   ResetChannels();
+}
+
+///////////////////////////////////////////////////////////////////////
+// Destructor
+///////////////////////////////////////////////////////////////////////
+DSISerialEmulator::~DSISerialEmulator()
+{
+   Close();
+}
+
+///////////////////////////////////////////////////////////////////////
+// There is always exactly one emulated device.
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialEmulator::AutoInit()
+{
+   return Init(50000, 0);
+}
+
+///////////////////////////////////////////////////////////////////////
+// The baud rate has no meaning here; the device number only changes
+// the serial number reported.
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialEmulator::Init(ULONG /*ulBaud_*/, UCHAR ucDeviceNumber_)
+{
+   Close();
+   ucDeviceNumber = ucDeviceNumber_;
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+ULONG DSISerialEmulator::GetDeviceSerialNumber()
+{
+   return EMULATOR_SERIAL_NUMBER + ucDeviceNumber;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Output is always delivered straight from the emulator thread, so
+// there is nothing to switch.
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialEmulator::SetDirectReceive(BOOL /*bEnable_*/)
+{
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Powers up the emulated module and starts the emulator thread.
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialEmulator::Open(void)
+{
+   // Make sure all handles are reset before opening again.
+   Close();
+
+   if (pclCallback == NULL)
+      return FALSE;
+
+   // An unplugged device stays away until its time is up, as a real one would.
+   if(bUnplugged && (SLONG)(DSIThread_GetSystemTime() - ulReplugTime) < 0)
+      return FALSE;
+
+   if(DSIThread_MutexInit(&stMutexCriticalSection) != DSI_THREAD_ENONE)
+      return FALSE;
+
+   if(DSIThread_CondInit(&stCondWakeup) != DSI_THREAD_ENONE)
+   {
+      DSIThread_MutexDestroy(&stMutexCriticalSection);
+      return FALSE;
+   }
+
+   if(DSIThread_CondInit(&stEventEmulatorThreadExit) != DSI_THREAD_ENONE)
+   {
+      DSIThread_CondDestroy(&stCondWakeup);
+      DSIThread_MutexDestroy(&stMutexCriticalSection);
+      return FALSE;
+   }
+
+   ResetChannels();
+   usOutputHead = 0;
+   usOutputCount = 0;
+   usNoiseBytes = 0;
+   bCorruptNext = FALSE;
+   usDropFrames = 0;
+   usDropTxEvents = 0;
+   bUnplugged = FALSE;
+   bReportGone = FALSE;
+
+   bOpen = TRUE;
+   bStopEmulatorThread = FALSE;
+   hEmulatorThread = DSIThread_CreateThread(&DSISerialEmulator::ProcessThread, this);
+   if(hEmulatorThread == 0)
+   {
+      bOpen = FALSE;
+      bStopEmulatorThread = TRUE;
+      DSIThread_CondDestroy(&stEventEmulatorThreadExit);
+      DSIThread_CondDestroy(&stCondWakeup);
+      DSIThread_MutexDestroy(&stMutexCriticalSection);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Stops the emulator thread.  Channel state is lost, as it would be
+// when a stick is unplugged.
+///////////////////////////////////////////////////////////////////////
+void DSISerialEmulator::Close(BOOL /*bReset_*/)
+{
+   if(!bOpen)
+      return;
+
+   if(hEmulatorThread)
+   {
+      DSIThread_MutexLock(&stMutexCriticalSection);
+      if(bStopEmulatorThread == FALSE)
+      {
+         bStopEmulatorThread = TRUE;
+         DSIThread_CondSignal(&stCondWakeup);
+
+         if (DSIThread_CondTimedWait(&stEventEmulatorThreadExit, &stMutexCriticalSection, 3000) != DSI_THREAD_ENONE)
+         {
+            // We were unable to stop the thread normally.
+            DSIThread_DestroyThread(hEmulatorThread);
+         }
+      }
+      DSIThread_MutexUnlock(&stMutexCriticalSection);
+
+      DSIThread_ReleaseThreadID(hEmulatorThread);
+      hEmulatorThread = (DSI_THREAD_ID)NULL;
+   }
+
+   DSIThread_CondDestroy(&stEventEmulatorThreadExit);
+   DSIThread_CondDestroy(&stCondWakeup);
+   DSIThread_MutexDestroy(&stMutexCriticalSection);
+   bOpen = FALSE;
+
+#if defined(DSI_TYPES_LINUX)
+   if(iExternalFd >= 0)
+      close(iExternalFd);
+#endif
+   iExternalFd = -1;
+   bExternalReceive = FALSE;
+   bOutputSignalled = FALSE;
+}
+
+///////////////////////////////////////////////////////////////////////
+// The thread goes on running the channels, it only stops handing
+// output over and makes an eventfd readable instead.
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialEmulator::SetExternalReceive(BOOL bEnable_)
+{
+#if defined(DSI_TYPES_LINUX)
+   if(!bOpen)
+      return FALSE;
+
+   if(bEnable_ && iExternalFd < 0)
+   {
+      iExternalFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if(iExternalFd < 0)
+         return FALSE;
+   }
+
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   bExternalReceive = bEnable_;
+   bOutputSignalled = FALSE;
+   DSIThread_CondSignal(&stCondWakeup);
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+
+   //whatever came in during the switch
+   if(bEnable_)
+      ReceivePoll();
+   return TRUE;
+#else
+   (void)bEnable_;
+   return FALSE;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSISerialEmulator::GetPollFds(DSI_POLLFD* pastFds_, UCHAR ucMax_)
+{
+#if defined(DSI_TYPES_LINUX)
+   if(iExternalFd < 0 || ucMax_ == 0)
+      return 0;
+
+   pastFds_[0].iFd = iExternalFd;
+   pastFds_[0].sEvents = POLLIN;
+   return 1;
+#else
+   (void)pastFds_;
+   (void)ucMax_;
+   return 0;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////
+// Takes what the thread said was ready, buffering still applies to
+// a host that polls early.
+///////////////////////////////////////////////////////////////////////
+void DSISerialEmulator::ReceivePoll()
+{
+#if defined(DSI_TYPES_LINUX)
+   ULLONG ullSignals;
+   ULONG ulWait = EMULATOR_IDLE_WAIT_MS;
+   USHORT usCount = 0;
+   BOOL bGone;
+
+   if(!bOpen || !bExternalReceive)
+      return;
+
+   if(read(iExternalFd, &ullSignals, sizeof(ullSignals)) < 0) {}  //nothing pending is fine
+
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   bOutputSignalled = FALSE;
+   bGone = bUnplugged;
+   if(!bGone && usOutputCount != 0 && !HoldOutput(DSIThread_GetSystemTime(), ulWait))
+      usCount = TakeOutput(aucPolled);
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+
+   if(usCount == 0)
+      return;
+
+   DSI_STATS_INC(pstStats, ulUSBTransfersIn);
+   DSI_STATS_ADD(pstStats, ulUSBBytesIn, usCount);
+   pclCallback->ProcessBytes(aucPolled, usCount);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////
+// Takes framed messages from the host, as the module's serial port
+// would.  Bytes between frames (the framer's padding) are skipped.
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialEmulator::WriteBytes(void *pvData_, USHORT usSize_)
+{
+   UCHAR *pucData = (UCHAR*)pvData_;
+   USHORT usIndex = 0;
+
+   if(!bOpen || pvData_ == NULL)
+      return FALSE;
+
+   DSIThread_MutexLock(&stMutexCriticalSection);
+
+   if(bUnplugged)
+   {
+      DSIThread_MutexUnlock(&stMutexCriticalSection);
+      DSI_STATS_INC(pstStats, ulUSBWriteErrors);
+      return FALSE;
+   }
+
+   DSI_STATS_INC(pstStats, ulUSBTransfersOut);
+   DSI_STATS_ADD(pstStats, ulUSBBytesOut, usSize_);
+
+   while((USHORT)(usIndex + MESG_HEADER_SIZE) < usSize_)
+   {
+      if(pucData[usIndex] != MESG_TX_SYNC)
+      {
+         usIndex++;
+         continue;
+      }
+
+      UCHAR ucSize = pucData[usIndex + MESG_SIZE_OFFSET];
+      USHORT usFrameSize = (USHORT)(ucSize + MESG_FRAME_SIZE);
+
+      if((ucSize > MESG_MAX_SIZE_VALUE) || ((USHORT)(usIndex + usFrameSize) > usSize_))
+      {
+         // A broken frame; the module drops it and reports a serial error.
+         UCHAR ucError = 0;
+         QueueMessage(MESG_SERIAL_ERROR_ID, &ucError, 1);
+         break;
+      }
+
+      if(CheckSum_Calc8(&pucData[usIndex], usFrameSize - 1) != pucData[usIndex + usFrameSize - 1])
+      {
+         UCHAR ucError = 2;
+         QueueMessage(MESG_SERIAL_ERROR_ID, &ucError, 1);
+      }
+      else
+      {
+         ProcessCommand(pucData[usIndex + MESG_ID_OFFSET], &pucData[usIndex + MESG_DATA_OFFSET], ucSize);
+      }
+
+      usIndex += usFrameSize;
+   }
+
+   DSIThread_CondSignal(&stCondWakeup);
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSISerialEmulator::GetDeviceNumber()
+{
+   return ucDeviceNumber;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Called with the port closed, so nothing else touches the unplug
+// state.  Returns at the moment the device comes back.
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialEmulator::WaitForDevice(ULONG ulMilliseconds_)
+{
+   SLONG slUntil = (SLONG)(ulReplugTime - DSIThread_GetSystemTime());
+
+   if(!bUnplugged || slUntil <= 0)
+      return TRUE;
+
+   if((ULONG)slUntil > ulMilliseconds_)
+   {
+      DSIThread_Sleep(ulMilliseconds_);
+      return FALSE;
+   }
+
+   DSIThread_Sleep((ULONG)slUntil);
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialEmulator::InjectAcknowledgedData(UCHAR ucChannel_, const UCHAR *pucData_)
+{
+   BOOL bReturn = FALSE;
+
+   if(!bOpen || ucChannel_ >= EMULATOR_MAX_CHANNELS || pucData_ == NULL)
+      return FALSE;
+
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   EMULATOR_CHANNEL *pstChannel = &astChannels[ucChannel_];
+   if(pstChannel->ucState > STATUS_ASSIGNED_CHANNEL && pstChannel->ucInjectCount < EMULATOR_INJECT_DEPTH)
+   {
+      UCHAR ucSlot = (UCHAR)((pstChannel->ucInjectHead + pstChannel->ucInjectCount) % EMULATOR_INJECT_DEPTH);
+      memcpy(pstChannel->aaucInject[ucSlot], pucData_, 8);
+      pstChannel->ucInjectCount++;
+      bReturn = TRUE;
+   }
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+
+   return bReturn;
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialEmulator::InjectTargetPower(UCHAR ucChannel_, USHORT usQuarterWatts_)
+{
+   UCHAR aucPage[8] = {EMULATOR_PAGE_TARGET_POWER, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0, 0};
+
+   aucPage[6] = (UCHAR)(usQuarterWatts_ & 0xFF);
+   aucPage[7] = (UCHAR)(usQuarterWatts_ >> 8);
+
+   return InjectAcknowledgedData(ucChannel_, aucPage);
+}
+
+///////////////////////////////////////////////////////////////////////
+// The page carries the grade offset by 200%.
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialEmulator::InjectTrackResistance(UCHAR ucChannel_, SSHORT ssSlope_, UCHAR ucRollingResistance_)
+{
+   UCHAR aucPage[8] = {EMULATOR_PAGE_TRACK_RESISTANCE, 0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0};
+   USHORT usRaw = (USHORT)(ssSlope_ + 20000);
+
+   aucPage[5] = (UCHAR)(usRaw & 0xFF);
+   aucPage[6] = (UCHAR)(usRaw >> 8);
+   aucPage[7] = ucRollingResistance_;
+
+   return InjectAcknowledgedData(ucChannel_, aucPage);
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialEmulator::InjectPageRequest(UCHAR ucChannel_, UCHAR ucPage_, UCHAR ucTimes_)
+{
+   UCHAR aucPage[8] = {EMULATOR_PAGE_REQUEST, 0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0x01};   // command type: request data page
+
+   aucPage[5] = (UCHAR)(ucTimes_ & 0x7F);
+   aucPage[6] = ucPage_;
+
+   return InjectAcknowledgedData(ucChannel_, aucPage);
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialEmulator::InjectBytes(const UCHAR *pucData_, USHORT usSize_)
+{
+   BOOL bReturn = FALSE;
+
+   if(!bOpen || pucData_ == NULL)
+      return FALSE;
+
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   if((USHORT)(EMULATOR_OUTPUT_SIZE - usOutputCount) >= usSize_)
+   {
+      QueueBytes(pucData_, usSize_);
+      DSIThread_CondSignal(&stCondWakeup);
+      bReturn = TRUE;
+   }
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+
+   return bReturn;
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSISerialEmulator::InjectNoise(USHORT usBytes_)
+{
+   if(!bOpen)
+      return;
+
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   usNoiseBytes += usBytes_;
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSISerialEmulator::InjectChecksumError()
+{
+   if(!bOpen)
+      return;
+
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   bCorruptNext = TRUE;
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSISerialEmulator::InjectOverrun(USHORT usFrames_)
+{
+   if(!bOpen)
+      return;
+
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   usDropFrames += usFrames_;
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSISerialEmulator::DropTxEvents(USHORT usEvents_)
+{
+   if(!bOpen)
+      return;
+
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   usDropTxEvents += usEvents_;
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+}
+
+///////////////////////////////////////////////////////////////////////
+// The emulator thread tells the host, a callback must not be made
+// from the caller's thread.
+///////////////////////////////////////////////////////////////////////
+void DSISerialEmulator::Unplug(ULONG ulMilliseconds_)
+{
+   if(!bOpen)
+      return;
+
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   bUnplugged = TRUE;
+   bReportGone = TRUE;
+   ulReplugTime = DSIThread_GetSystemTime() + ulMilliseconds_;
+   usOutputCount = 0;
+   ResetChannels();
+   DSIThread_CondSignal(&stCondWakeup);
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+}
+
+///////////////////////////////////////////////////////////////////////
+ULONG DSISerialEmulator::GetFaultsPending()
+{
+   ULONG ulFaults;
+
+   if(!bOpen)
+      return 0;
+
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   ulFaults = (ULONG)usNoiseBytes + usDropFrames + usDropTxEvents;
+   if(bCorruptNext)
+      ulFaults++;
+   if(bUnplugged)
+      ulFaults++;
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+
+   return ulFaults;
+}
+
+///////////////////////////////////////////////////////////////////////
+ULONG DSISerialEmulator::GetBroadcastCount(UCHAR ucChannel_)
+{
+   if(ucChannel_ >= EMULATOR_MAX_CHANNELS)
+      return 0;
+
+   return astChannels[ucChannel_].ulBroadcasts;
+}
+
+///////////////////////////////////////////////////////////////////////
+ULONG DSISerialEmulator::GetTxEventCount(UCHAR ucChannel_)
+{
+   if(ucChannel_ >= EMULATOR_MAX_CHANNELS)
+      return 0;
+
+   return astChannels[ucChannel_].ulTxEvents;
+}
+
+///////////////////////////////////////////////////////////////////////
+ULONG DSISerialEmulator::GetFreshSlotCount(UCHAR ucChannel_)
+{
+   if(ucChannel_ >= EMULATOR_MAX_CHANNELS)
+      return 0;
+
+   return astChannels[ucChannel_].ulFreshSlots;
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialEmulator::GetLastBroadcast(UCHAR ucChannel_, UCHAR *pucData_)
+{
+   if(!bOpen || ucChannel_ >= EMULATOR_MAX_CHANNELS || pucData_ == NULL)
+      return FALSE;
+
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   memcpy(pucData_, astChannels[ucChannel_].aucLastData, 8);
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+ULONG DSISerialEmulator::GetOutputOverruns()
+{
+   return ulOutputOverruns;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// Private Methods
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+// Power-on channel state.  The counters survive so benchmarks can take
+// deltas across a reset.
+///////////////////////////////////////////////////////////////////////
+void DSISerialEmulator::ResetChannels()
+{
+   for(UCHAR i = 0; i < EMULATOR_MAX_CHANNELS; i++)
+   {
+      ULONG ulBroadcasts = astChannels[i].ulBroadcasts;
+      ULONG ulTxEvents = astChannels[i].ulTxEvents;
+      ULONG ulFreshSlots = astChannels[i].ulFreshSlots;
+
+      memset(&astChannels[i], 0, sizeof(EMULATOR_CHANNEL));
+      astChannels[i].ulBroadcasts = ulBroadcasts;
+      astChannels[i].ulTxEvents = ulTxEvents;
+      astChannels[i].ulFreshSlots = ulFreshSlots;
+      astChannels[i].ucState = STATUS_UNASSIGNED_CHANNEL;
+      astChannels[i].usPeriod = EMULATOR_DEFAULT_PERIOD;
+      astChannels[i].ucRFFrequency = 66;
+   }
+
+   // A reset module forgets its event filter and buffering too
+   usEventFilter = 0;
+   bBuffering = FALSE;
+   ucBufferConfig = EVENT_BUFFER_LOW_PRIORITY;
+   usBufferSize = 0;
+   ulBufferTime = 0;
+   bFlushOutput = FALSE;
+   ucLibConfig = 0;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Acts on one message from the host.  Must be called with the mutex
+// held.
+///////////////////////////////////////////////////////////////////////
+void DSISerialEmulator::ProcessCommand(UCHAR ucMessageID_, UCHAR *pucData_, UCHAR ucSize_)
+{
+   UCHAR ucChannel = (ucSize_ > 0) ? pucData_[0] : 0;
+   EMULATOR_CHANNEL *pstChannel = (ucChannel < EMULATOR_MAX_CHANNELS) ? &astChannels[ucChannel] : (EMULATOR_CHANNEL*)NULL;
+
+   switch(ucMessageID_)
+   {
+      case MESG_SYSTEM_RESET_ID:
+      {
+         UCHAR ucReason = RESET_CMD;
+
+         ResetChannels();
+         usOutputCount = 0;
+         QueueMessage(MESG_STARTUP_MESG_ID, &ucReason, MESG_STARTUP_MESG_SIZE);
+         return;
+      }
+
+      case MESG_NETWORK_KEY_ID:
+         QueueResponse(ucChannel, ucMessageID_, (ucChannel < EMULATOR_MAX_NETWORKS) ? RESPONSE_NO_ERROR : INVALID_NETWORK_NUMBER);
+         return;
+
+      case MESG_ANTLIB_CONFIG_ID:
+         if(ucSize_ < MESG_ANTLIB_CONFIG_SIZE)
+         {
+            QueueResponse(0, ucMessageID_, INVALID_MESSAGE);
+            return;
+         }
+         ucLibConfig = pucData_[1];
+         QueueResponse(0, ucMessageID_, RESPONSE_NO_ERROR);
+         return;
+
+      case MESG_EVENT_FILTER_CONFIG_ID:
+         if(ucSize_ < MESG_EVENT_FILTER_CONFIG_SIZE)
+         {
+            QueueResponse(0, ucMessageID_, INVALID_MESSAGE);
+            return;
+         }
+         usEventFilter = (USHORT)(pucData_[1] | (pucData_[2] << 8));
+         QueueResponse(0, ucMessageID_, RESPONSE_NO_ERROR);
+         return;
+
+      case MESG_EVENT_BUFFERING_CONFIG_ID:
+         if(ucSize_ < MESG_EVENT_BUFFERING_CONFIG_SIZE)
+         {
+            QueueResponse(0, ucMessageID_, INVALID_MESSAGE);
+            return;
+         }
+         ucBufferConfig = pucData_[1];
+         usBufferSize = (USHORT)(pucData_[2] | (pucData_[3] << 8));
+         ulBufferTime = (ULONG)(pucData_[4] | (pucData_[5] << 8)) * EVENT_BUFFER_TIME_UNIT_MS;
+         bBuffering = (usBufferSize != 0 || ulBufferTime != 0);
+         QueueResponse(0, ucMessageID_, RESPONSE_NO_ERROR);
+         return;
+
+      case MESG_REQUEST_ID:
+      {
+         UCHAR aucReply[MESG_MAX_SIZE_VALUE];
+         UCHAR ucRequested = (ucSize_ > 1) ? pucData_[1] : 0;
+
+         switch(ucRequested)
+         {
+            case MESG_CHANNEL_STATUS_ID:
+               if(pstChannel == NULL)
+                  break;
+               aucReply[0] = ucChannel;
+               aucReply[1] = (UCHAR)(pstChannel->ucState | (pstChannel->ucNetwork << 2));
+               QueueMessage(MESG_CHANNEL_STATUS_ID, aucReply, MESG_CHANNEL_STATUS_SIZE);
+               return;
+
+            case MESG_CHANNEL_ID_ID:
+               if(pstChannel == NULL)
+                  break;
+               aucReply[0] = ucChannel;
+               aucReply[1] = (UCHAR)(pstChannel->usDeviceNumber & 0xFF);
+               aucReply[2] = (UCHAR)(pstChannel->usDeviceNumber >> 8);
+               aucReply[3] = pstChannel->ucDeviceType;
+               aucReply[4] = pstChannel->ucTransmissionType;
+               QueueMessage(MESG_CHANNEL_ID_ID, aucReply, MESG_CHANNEL_ID_SIZE);
+               return;
+
+            case MESG_CAPABILITIES_ID:
+               memset(aucReply, 0, MESG_CAPABILITIES_SIZE);
+               aucReply[0] = EMULATOR_MAX_CHANNELS;
+               aucReply[1] = EMULATOR_MAX_NETWORKS;
+               aucReply[3] = CAPABILITIES_EXT_MESSAGE_ENABLED;
+               aucReply[6] = CAPABILITIES_EVENT_BUFFERING_ENABLED | CAPABILITIES_EVENT_FILTERING_ENABLED;
+               QueueMessage(MESG_CAPABILITIES_ID, aucReply, MESG_CAPABILITIES_SIZE);
+               return;
+
+            case MESG_GET_SERIAL_NUM_ID:
+            {
+               ULONG ulSerial = GetDeviceSerialNumber();
+               aucReply[0] = (UCHAR)(ulSerial & 0xFF);
+               aucReply[1] = (UCHAR)((ulSerial >> 8) & 0xFF);
+               aucReply[2] = (UCHAR)((ulSerial >> 16) & 0xFF);
+               aucReply[3] = (UCHAR)((ulSerial >> 24) & 0xFF);
+               QueueMessage(MESG_GET_SERIAL_NUM_ID, aucReply, MESG_GET_SERIAL_NUM_SIZE);
+               return;
+            }
+
+            default:
+               break;
+         }
+         QueueResponse(ucChannel, ucMessageID_, INVALID_MESSAGE);
+         return;
+      }
+
+      default:
+         break;
+   }
+
+   // Everything else is a channel message.
+   if(pstChannel == NULL)
+   {
+      QueueResponse(ucChannel, ucMessageID_, INVALID_MESSAGE);
+      return;
+   }
+
+   switch(ucMessageID_)
+   {
+      case MESG_ASSIGN_CHANNEL_ID:
+         if(pstChannel->ucState != STATUS_UNASSIGNED_CHANNEL)
+         {
+            QueueResponse(ucChannel, ucMessageID_, CHANNEL_IN_WRONG_STATE);
+            return;
+         }
+         pstChannel->ucType = (ucSize_ > 1) ? pucData_[1] : 0;
+         pstChannel->ucNetwork = (ucSize_ > 2) ? pucData_[2] : 0;
+         pstChannel->ucState = STATUS_ASSIGNED_CHANNEL;
+         break;
+
+      case MESG_UNASSIGN_CHANNEL_ID:
+         if(pstChannel->ucState != STATUS_ASSIGNED_CHANNEL)
+         {
+            QueueResponse(ucChannel, ucMessageID_, CHANNEL_IN_WRONG_STATE);
+            return;
+         }
+         pstChannel->ucState = STATUS_UNASSIGNED_CHANNEL;
+         break;
+
+      case MESG_CHANNEL_ID_ID:
+         if(ucSize_ < MESG_CHANNEL_ID_SIZE)
+         {
+            QueueResponse(ucChannel, ucMessageID_, INVALID_MESSAGE);
+            return;
+         }
+         pstChannel->usDeviceNumber = (USHORT)(pucData_[1] | (pucData_[2] << 8));
+         pstChannel->ucDeviceType = pucData_[3];
+         pstChannel->ucTransmissionType = pucData_[4];
+         break;
+
+      case MESG_CHANNEL_MESG_PERIOD_ID:
+         if(ucSize_ < 3)
+         {
+            QueueResponse(ucChannel, ucMessageID_, INVALID_MESSAGE);
+            return;
+         }
+         pstChannel->usPeriod = (USHORT)(pucData_[1] | (pucData_[2] << 8));
+         if(pstChannel->usPeriod == 0)
+            pstChannel->usPeriod = EMULATOR_DEFAULT_PERIOD;
+         // Re-phase an open channel so the new period applies from now.
+         pstChannel->ulOpenTime = DSIThread_GetSystemTime();
+         pstChannel->ulEvents = 0;
+         break;
+
+      case MESG_CHANNEL_RADIO_FREQ_ID:
+         pstChannel->ucRFFrequency = (ucSize_ > 1) ? pucData_[1] : pstChannel->ucRFFrequency;
+         break;
+
+      case MESG_OPEN_CHANNEL_ID:
+         if(pstChannel->ucState != STATUS_ASSIGNED_CHANNEL)
+         {
+            QueueResponse(ucChannel, ucMessageID_, CHANNEL_IN_WRONG_STATE);
+            return;
+         }
+         pstChannel->ucState = EMULATOR_IS_MASTER(pstChannel->ucType) ? STATUS_TRACKING_CHANNEL : STATUS_SEARCHING_CHANNEL;
+         pstChannel->ulOpenTime = DSIThread_GetSystemTime();
+         pstChannel->ulEvents = 0;
+         pstChannel->bAckPending = FALSE;
+         pstChannel->ucInjectHead = 0;
+         pstChannel->ucInjectCount = 0;
+         break;
+
+      case MESG_CLOSE_CHANNEL_ID:
+      {
+         if(pstChannel->ucState <= STATUS_ASSIGNED_CHANNEL)
+         {
+            QueueResponse(ucChannel, ucMessageID_, CHANNEL_IN_WRONG_STATE);
+            return;
+         }
+         pstChannel->ucState = STATUS_ASSIGNED_CHANNEL;
+         QueueResponse(ucChannel, ucMessageID_, RESPONSE_NO_ERROR);
+
+         UCHAR aucEvent[MESG_RESPONSE_EVENT_SIZE] = {ucChannel, MESG_EVENT_ID, EVENT_CHANNEL_CLOSED};
+         if(!Filtered(EVENT_CHANNEL_CLOSED))
+            QueueMessage(MESG_RESPONSE_EVENT_ID, aucEvent, MESG_RESPONSE_EVENT_SIZE);
+         return;
+      }
+
+      case MESG_BROADCAST_DATA_ID:
+      case MESG_ACKNOWLEDGED_DATA_ID:
+         // Data messages are not answered; the next EVENT_TX (or transfer result) is the answer.
+         if(ucSize_ < MESG_DATA_SIZE)
+            return;
+         memcpy(pstChannel->aucLastData, &pucData_[1], 8);
+         pstChannel->ulBroadcasts++;
+         pstChannel->bFresh = TRUE;
+         if(ucMessageID_ == MESG_ACKNOWLEDGED_DATA_ID && pstChannel->ucState > STATUS_ASSIGNED_CHANNEL)
+            pstChannel->bAckPending = TRUE;
+         return;
+
+      case MESG_BURST_DATA_ID:
+         return;
+
+      case MESG_CHANNEL_SEARCH_TIMEOUT_ID:
+      case MESG_RADIO_TX_POWER_ID:
+      case MESG_CHANNEL_RADIO_TX_POWER_ID:
+      case MESG_SET_LP_SEARCH_TIMEOUT_ID:
+      case MESG_RX_EXT_MESGS_ENABLE_ID:
+      case MESG_ENABLE_LED_FLASH_ID:
+      case MESG_SERIAL_NUM_SET_CHANNEL_ID_ID:
+         // Accepted, but nothing about them is emulated.
+         break;
+
+      default:
+         QueueResponse(ucChannel, ucMessageID_, INVALID_MESSAGE);
+         return;
+   }
+
+   QueueResponse(ucChannel, ucMessageID_, RESPONSE_NO_ERROR);
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSISerialEmulator::QueueResponse(UCHAR ucChannel_, UCHAR ucMessageID_, UCHAR ucCode_)
+{
+   UCHAR aucData[MESG_RESPONSE_EVENT_SIZE];
+
+   aucData[0] = ucChannel_;
+   aucData[1] = ucMessageID_;
+   aucData[2] = ucCode_;
+   QueueMessage(MESG_RESPONSE_EVENT_ID, aucData, MESG_RESPONSE_EVENT_SIZE);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Frames a message for the host, applying any pending noise or
+// checksum fault.  Must be called with the mutex held.
+///////////////////////////////////////////////////////////////////////
+void DSISerialEmulator::QueueMessage(UCHAR ucMessageID_, const UCHAR *pucData_, UCHAR ucSize_)
+{
+   UCHAR aucFrame[MESG_MAX_SIZE_VALUE + MESG_FRAME_SIZE];
+
+   if(usDropFrames)
+   {
+      usDropFrames--;
+      ulOutputOverruns++;
+      return;
+   }
+
+   while(usNoiseBytes)
+   {
+      UCHAR aucNoise[32];
+      USHORT usCount = (usNoiseBytes < sizeof(aucNoise)) ? usNoiseBytes : (USHORT)sizeof(aucNoise);
+
+      for(USHORT i = 0; i < usCount; i++)
+      {
+         // xorshift, enough to look like line noise
+         ulRandomState ^= ulRandomState << 13;
+         ulRandomState ^= ulRandomState >> 17;
+         ulRandomState ^= ulRandomState << 5;
+         aucNoise[i] = (UCHAR)ulRandomState;
+      }
+      QueueBytes(aucNoise, usCount);
+      usNoiseBytes -= usCount;
+   }
+
+   aucFrame[0] = MESG_TX_SYNC;
+   aucFrame[MESG_SIZE_OFFSET] = ucSize_;
+   aucFrame[MESG_ID_OFFSET] = ucMessageID_;
+   memcpy(&aucFrame[MESG_DATA_OFFSET], pucData_, ucSize_);
+   aucFrame[MESG_DATA_OFFSET + ucSize_] = CheckSum_Calc8(aucFrame, MESG_DATA_OFFSET + ucSize_);
+
+   if(bCorruptNext)
+   {
+      aucFrame[MESG_DATA_OFFSET + ucSize_] ^= 0xFF;
+      bCorruptNext = FALSE;
+   }
+
+   if(bBuffering && usOutputCount == 0)
+      ulBufferStart = DSIThread_GetSystemTime();
+
+   QueueBytes(aucFrame, (USHORT)(ucSize_ + MESG_FRAME_SIZE));
+
+   if(ucBufferConfig == EVENT_BUFFER_ALL || ucMessageID_ == MESG_BROADCAST_DATA_ID)
+      return;
+   if(ucMessageID_ == MESG_RESPONSE_EVENT_ID && pucData_[1] == MESG_EVENT_ID && (pucData_[2] == EVENT_TX || pucData_[2] == EVENT_RX_FAIL))
+      return;
+   bFlushOutput = TRUE;  //high priority, goes now with everything before it
+}
+
+///////////////////////////////////////////////////////////////////////
+// Must be called with the mutex held.
+///////////////////////////////////////////////////////////////////////
+void DSISerialEmulator::QueueBytes(const UCHAR *pucData_, USHORT usSize_)
+{
+   if((USHORT)(EMULATOR_OUTPUT_SIZE - usOutputCount) < usSize_)
+   {
+      ulOutputOverruns++;
+      return;
+   }
+
+   for(USHORT i = 0; i < usSize_; i++)
+      aucOutput[(usOutputHead + usOutputCount + i) % EMULATOR_OUTPUT_SIZE] = pucData_[i];
+
+   usOutputCount += usSize_;
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialEmulator::Filtered(UCHAR ucEvent_)
+{
+   if(ucEvent_ < EVENT_RX_SEARCH_TIMEOUT || ucEvent_ > EVENT_TRANSFER_TX_START)
+      return FALSE;
+
+   return (usEventFilter & EMULATOR_FILTER_BIT(ucEvent_)) != 0;
+}
+
+///////////////////////////////////////////////////////////////////////
+// With event buffering on, low priority output waits until there is
+// usBufferSize of it or the oldest has waited ulBufferTime.  Returns
+// TRUE to keep waiting and lowers ulWait_ to when that ends.  Must be
+// called with the mutex held.
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialEmulator::HoldOutput(ULONG ulNow_, ULONG& ulWait_)
+{
+   if(!bBuffering || bFlushOutput)
+      return FALSE;
+
+   if(usBufferSize != 0 && usOutputCount >= usBufferSize)
+      return FALSE;
+
+   if(ulBufferTime != 0)
+   {
+      ULONG ulHeld = ulNow_ - ulBufferStart;
+
+      if(ulHeld >= ulBufferTime)
+         return FALSE;
+      if(ulBufferTime - ulHeld < ulWait_)
+         ulWait_ = ulBufferTime - ulHeld;
+   }
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Empties the output ring into pucData_, returns how much there was.
+// Must be called with the mutex held.
+///////////////////////////////////////////////////////////////////////
+USHORT DSISerialEmulator::TakeOutput(UCHAR *pucData_)
+{
+   USHORT usCount = usOutputCount;
+
+   for(USHORT i = 0; i < usCount; i++)
+      pucData_[i] = aucOutput[(usOutputHead + i) % EMULATOR_OUTPUT_SIZE];
+   usOutputHead = (USHORT)((usOutputHead + usCount) % EMULATOR_OUTPUT_SIZE);
+   usOutputCount = 0;
+   bFlushOutput = FALSE;
+   return usCount;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Time the next channel period ends, computed from the open time so
+// the rounding to ms does not drift.
+///////////////////////////////////////////////////////////////////////
+ULONG DSISerialEmulator::NextEventTime(UCHAR ucChannel_)
+{
+   EMULATOR_CHANNEL *pstChannel = &astChannels[ucChannel_];
+   ULLONG ullOffset = ((ULLONG)(pstChannel->ulEvents + 1) * pstChannel->usPeriod * 1000) / EMULATOR_PERIOD_TICKS_PER_SEC;
+
+   return pstChannel->ulOpenTime + (ULONG)ullOffset;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Appends what the library config asks for to a data message received
+// in the last period of the channel, flag byte first.  The time stamp is
+// the start of that period.  Returns the new message size.  Must be
+// called with the mutex held.
+///////////////////////////////////////////////////////////////////////
+UCHAR DSISerialEmulator::AddFlaggedFields(UCHAR ucChannel_, UCHAR *pucData_)
+{
+   EMULATOR_CHANNEL *pstChannel = &astChannels[ucChannel_];
+   UCHAR ucSize = MESG_DATA_SIZE;
+   UCHAR ucFlags = 0;
+
+   pucData_[ucSize++] = 0;
+   if(ucLibConfig & ANT_LIB_CONFIG_MESG_OUT_INC_DEVICE_ID)
+   {
+      // The channel ID is the master's, the remote device uses ours
+      ucFlags |= ANT_EXT_MESG_BITFIELD_DEVICE_ID;
+      pucData_[ucSize++] = (UCHAR)(pstChannel->usDeviceNumber & 0xFF);
+      pucData_[ucSize++] = (UCHAR)((pstChannel->usDeviceNumber >> 8) & 0xFF);
+      pucData_[ucSize++] = pstChannel->ucDeviceType;
+      pucData_[ucSize++] = pstChannel->ucTransmissionType;
+   }
+   if(ucLibConfig & ANT_LIB_CONFIG_MESG_OUT_INC_RSSI)
+   {
+      ucFlags |= ANT_EXT_MESG_BITFIELD_RSSI;
+      pucData_[ucSize++] = EMULATOR_RSSI_TYPE_DBM;
+      pucData_[ucSize++] = EMULATOR_RSSI_DBM;
+      pucData_[ucSize++] = EMULATOR_RSSI_NO_THRESHOLD;
+   }
+   if(ucLibConfig & ANT_LIB_CONFIG_MESG_OUT_INC_TIME_STAMP)
+   {
+      ULLONG ullOffset = ((ULLONG)pstChannel->ulEvents * pstChannel->usPeriod * 1000) / EMULATOR_PERIOD_TICKS_PER_SEC;
+      USHORT usStamp = (USHORT)(((ULLONG)(pstChannel->ulOpenTime + ullOffset) * EMULATOR_PERIOD_TICKS_PER_SEC) / 1000);
+
+      ucFlags |= ANT_EXT_MESG_BITFIELD_TIME_STAMP;
+      pucData_[ucSize++] = (UCHAR)(usStamp & 0xFF);
+      pucData_[ucSize++] = (UCHAR)((usStamp >> 8) & 0xFF);
+   }
+   pucData_[MESG_DATA_SIZE] = ucFlags;
+
+   return ucSize;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Queues the events of every channel period that has ended and
+// returns how long until the next one.  Must be called with the mutex
+// held.
+///////////////////////////////////////////////////////////////////////
+ULONG DSISerialEmulator::RunChannels(ULONG ulNow_)
+{
+   ULONG ulWait = EMULATOR_IDLE_WAIT_MS;
+
+   for(UCHAR i = 0; i < EMULATOR_MAX_CHANNELS; i++)
+   {
+      EMULATOR_CHANNEL *pstChannel = &astChannels[i];
+
+      if(pstChannel->ucState <= STATUS_ASSIGNED_CHANNEL)
+         continue;
+
+      if((SLONG)(ulNow_ - NextEventTime(i)) >= 0)
+      {
+         // One event per period even if the host fell behind; skip the periods it missed.
+         do
+         {
+            pstChannel->ulEvents++;
+         } while((SLONG)(ulNow_ - NextEventTime(i)) >= 0);
+
+         if(EMULATOR_IS_MASTER(pstChannel->ucType))
+         {
+            UCHAR aucEvent[MESG_RESPONSE_EVENT_SIZE] = {i, MESG_EVENT_ID, EVENT_TX};
+
+            if(pstChannel->bAckPending)
+            {
+               aucEvent[2] = EVENT_TRANSFER_TX_COMPLETED;
+               pstChannel->bAckPending = FALSE;
+            }
+            if(pstChannel->bFresh)
+            {
+               pstChannel->ulFreshSlots++;
+               pstChannel->bFresh = FALSE;
+            }
+
+            if(usDropTxEvents)
+               usDropTxEvents--;
+            else if(!Filtered(aucEvent[2]))
+               QueueMessage(MESG_RESPONSE_EVENT_ID, aucEvent, MESG_RESPONSE_EVENT_SIZE);
+            pstChannel->ulTxEvents++;
+         }
+
+         // The remote device answers in the receive window after our transmission.
+         if(pstChannel->ucInjectCount)
+         {
+            UCHAR aucData[MESG_MAX_SIZE_VALUE];
+            UCHAR ucSize = MESG_DATA_SIZE;
+
+            aucData[0] = i;
+            memcpy(&aucData[1], pstChannel->aaucInject[pstChannel->ucInjectHead], 8);
+            pstChannel->ucInjectHead = (UCHAR)((pstChannel->ucInjectHead + 1) % EMULATOR_INJECT_DEPTH);
+            pstChannel->ucInjectCount--;
+            if(ucLibConfig & (ANT_LIB_CONFIG_MESG_OUT_INC_DEVICE_ID | ANT_LIB_CONFIG_MESG_OUT_INC_RSSI | ANT_LIB_CONFIG_MESG_OUT_INC_TIME_STAMP))
+               ucSize = AddFlaggedFields(i, aucData);
+            QueueMessage(MESG_ACKNOWLEDGED_DATA_ID, aucData, ucSize);
+         }
+      }
+
+      ULONG ulUntil = NextEventTime(i) - ulNow_;
+      if(ulUntil < ulWait)
+         ulWait = ulUntil;
+   }
+
+   return ulWait;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Brings an unplugged device back once its time is up, as a freshly
+// powered stick.  Returns TRUE while it is still gone.  Must be called
+// with the mutex held.
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialEmulator::RunUnplugged(ULONG ulNow_)
+{
+   UCHAR ucReason = RESET_POR;
+
+   if((SLONG)(ulNow_ - ulReplugTime) < 0)
+      return TRUE;
+
+   bUnplugged = FALSE;
+   ResetChannels();
+   QueueMessage(MESG_STARTUP_MESG_ID, &ucReason, MESG_STARTUP_MESG_SIZE);
+   return FALSE;
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSISerialEmulator::EmulatorThread(void)
+{
+   UCHAR aucData[EMULATOR_OUTPUT_SIZE];
+
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   while(!bStopEmulatorThread)
+   {
+      if(bReportGone)
+      {
+         bReportGone = FALSE;
+         DSIThread_MutexUnlock(&stMutexCriticalSection);
+         pclCallback->Error(DSI_SERIAL_DEVICE_GONE);
+         DSIThread_MutexLock(&stMutexCriticalSection);
+         continue;
+      }
+
+      if(bUnplugged)
+      {
+         ULONG ulNow = DSIThread_GetSystemTime();
+
+         if(RunUnplugged(ulNow))
+         {
+            DSIThread_CondTimedWait(&stCondWakeup, &stMutexCriticalSection, ulReplugTime - ulNow);
+            continue;
+         }
+      }
+
+      ULONG ulNow = DSIThread_GetSystemTime();
+      ULONG ulWait = RunChannels(ulNow);
+
+      if(usOutputCount == 0 || HoldOutput(ulNow, ulWait))
+      {
+         DSIThread_CondTimedWait(&stCondWakeup, &stMutexCriticalSection, ulWait ? ulWait : 1);
+         continue;
+      }
+
+      if(bExternalReceive)
+      {
+         // The host's event loop comes for it, once per signal.
+         if(!bOutputSignalled)
+         {
+            ULLONG ullSignal = 1;
+
+            bOutputSignalled = TRUE;
+#if defined(DSI_TYPES_LINUX)
+            if(write(iExternalFd, &ullSignal, sizeof(ullSignal)) < 0) {}  //already readable
+#endif
+         }
+         DSIThread_CondTimedWait(&stCondWakeup, &stMutexCriticalSection, ulWait ? ulWait : 1);
+         continue;
+      }
+
+      // Hand everything pending to the host outside the lock, the callback may write back to us.
+      USHORT usCount = TakeOutput(aucData);
+
+      DSIThread_MutexUnlock(&stMutexCriticalSection);
+      DSI_STATS_INC(pstStats, ulUSBTransfersIn);
+      DSI_STATS_ADD(pstStats, ulUSBBytesIn, usCount);
+      pclCallback->ProcessBytes(aucData, usCount);
+      DSIThread_MutexLock(&stMutexCriticalSection);
+   }
+
+   bStopEmulatorThread = TRUE;
+   DSIThread_CondSignal(&stEventEmulatorThreadExit);                          // Set an event to alert the main process that the emulator thread is finished and can be closed.
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+}
+
+///////////////////////////////////////////////////////////////////////
+DSI_THREAD_RETURN DSISerialEmulator::ProcessThread(void* pvParameter_)
+{
+   DSISerialEmulator* This = (DSISerialEmulator*)pvParameter_;
+   This->EmulatorThread();
+   return 0;
+}
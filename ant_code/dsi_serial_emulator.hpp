@@ -0,0 +1,223 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except
+in compliance with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2016
+All rights reserved.
+*/
+
+#if !defined(DSI_SERIAL_EMULATOR_HPP)
+#define DSI_SERIAL_EMULATOR_HPP
+
+#include "types.h"
+#include "dsi_thread.h"
+#include "dsi_serial.hpp"
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Definitions
+//////////////////////////////////////////////////////////////////////////////////
+
+#define EMULATOR_MAX_CHANNELS          ((UCHAR) 8)
+#define EMULATOR_MAX_NETWORKS          ((UCHAR) 8)
+#define EMULATOR_INJECT_DEPTH          ((UCHAR) 8)          // Acknowledged messages waiting per channel
+#define EMULATOR_OUTPUT_SIZE           ((USHORT) 4096)      // Bytes waiting to be "received" by the host
+#define EMULATOR_SERIAL_NUMBER         ((ULONG) 0xE3000000) // Device number is added to this
+
+// ANT+ FE-C control pages the emulator can play back as a display would send them
+#define EMULATOR_PAGE_TARGET_POWER     ((UCHAR) 0x31)
+#define EMULATOR_PAGE_TRACK_RESISTANCE ((UCHAR) 0x33)
+#define EMULATOR_PAGE_REQUEST          ((UCHAR) 0x46)
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Class Prototypes
+//////////////////////////////////////////////////////////////////////////////////
+
+// In-process stand-in for an ANT USB stick.  Commands written to it are
+// answered the way the module would answer them, open master channels
+// produce EVENT_TX at their message period, and acknowledged data from
+// a "remote" device, line noise and checksum errors can be injected on
+// demand.  Event filtering and event buffering work as on a USB-m stick,
+// and received data carries the channel ID, RSSI and time stamp when the
+// library config asks for them.
+// Everything the host receives is delivered from the
+// emulator's own thread, like a real receive thread would, or from
+// ReceivePoll() once an external event loop has taken over.
+class DSISerialEmulator : public DSISerial
+{
+   private:
+
+      typedef struct
+      {
+         UCHAR ucState;                                     // STATUS_xxx_CHANNEL
+         UCHAR ucType;                                      // Channel type from the assign message
+         UCHAR ucNetwork;
+         USHORT usDeviceNumber;
+         UCHAR ucDeviceType;
+         UCHAR ucTransmissionType;
+         UCHAR ucRFFrequency;
+         USHORT usPeriod;                                   // 1/32768 s
+         ULONG ulOpenTime;                                  // ms, when the channel was opened
+         ULONG ulEvents;                                    // Channel periods elapsed since ulOpenTime
+         BOOL bAckPending;                                  // Host sent acknowledged data, report completion next period
+         UCHAR aucLastData[8];                              // Last broadcast payload from the host
+         BOOL bFresh;                                       // Host wrote data since the last period
+         ULONG ulBroadcasts;                                // Data messages written by the host
+         ULONG ulTxEvents;                                  // Channel periods elapsed, one EVENT_TX each unless dropped
+         ULONG ulFreshSlots;                                // Periods that went out with new data from the host
+         UCHAR aaucInject[EMULATOR_INJECT_DEPTH][8];        // Acknowledged messages waiting for the next period
+         UCHAR ucInjectHead;
+         UCHAR ucInjectCount;
+      } EMULATOR_CHANNEL;
+
+      DSI_THREAD_ID hEmulatorThread;                        // Handle for the emulator thread.
+      DSI_MUTEX stMutexCriticalSection;                     // Protects everything below.
+      DSI_CONDITION_VAR stCondWakeup;                       // Signalled when there is output or the thread should stop.
+      DSI_CONDITION_VAR stEventEmulatorThreadExit;          // Signalled when the emulator thread has ended.
+      BOOL bStopEmulatorThread;
+      BOOL bOpen;
+
+      EMULATOR_CHANNEL astChannels[EMULATOR_MAX_CHANNELS];
+
+      UCHAR aucOutput[EMULATOR_OUTPUT_SIZE];                // Ring of bytes waiting for the host
+      USHORT usOutputHead;
+      USHORT usOutputCount;
+      ULONG ulOutputOverruns;                               // Frames dropped because the ring was full
+
+      USHORT usNoiseBytes;                                  // Garbage to put in front of the next frame
+      BOOL bCorruptNext;                                    // Break the checksum of the next frame
+      USHORT usDropFrames;                                  // Frames to lose as if the receive buffer had overflowed
+      USHORT usDropTxEvents;                                // EVENT_TX to leave out, the periods still go out on air
+      USHORT usEventFilter;                                 // EVENT_FILTER_xxx, events the host is not sent
+      BOOL bBuffering;                                      // Event buffering configured
+      UCHAR ucBufferConfig;                                 // EVENT_BUFFER_xxx
+      USHORT usBufferSize;                                  // Bytes that are sent at once, 0 for no limit
+      ULONG ulBufferTime;                                   // ms the oldest byte waits at most, 0 for no limit
+      ULONG ulBufferStart;                                  // ms, when the output started waiting
+      BOOL bFlushOutput;                                    // The output holds something that does not wait
+      UCHAR ucLibConfig;                                    // ANT_LIB_CONFIG_xxx, fields added to received data
+      BOOL bExternalReceive;                                // The host polls for output, see SetExternalReceive()
+      BOOL bOutputSignalled;                                // iExternalFd written to since the host last polled
+      int iExternalFd;                                      // eventfd, readable while output waits for the host
+      UCHAR aucPolled[EMULATOR_OUTPUT_SIZE];                // Output on its way to the host in ReceivePoll()
+      BOOL bUnplugged;                                      // Device gone, writes fail and nothing is received
+      BOOL bReportGone;                                     // The host has not been told yet
+      ULONG ulReplugTime;                                   // ms, when the device comes back
+      ULONG ulRandomState;
+
+      UCHAR ucDeviceNumber;
+
+      // Private Member Functions
+      void ResetChannels();
+      void ProcessCommand(UCHAR ucMessageID_, UCHAR *pucData_, UCHAR ucSize_);
+      void QueueResponse(UCHAR ucChannel_, UCHAR ucMessageID_, UCHAR ucCode_);
+      void QueueMessage(UCHAR ucMessageID_, const UCHAR *pucData_, UCHAR ucSize_);
+      void QueueBytes(const UCHAR *pucData_, USHORT usSize_);
+      BOOL Filtered(UCHAR ucEvent_);
+      UCHAR AddFlaggedFields(UCHAR ucChannel_, UCHAR *pucData_);
+      BOOL HoldOutput(ULONG ulNow_, ULONG& ulWait_);
+      USHORT TakeOutput(UCHAR *pucData_);
+      ULONG NextEventTime(UCHAR ucChannel_);
+      BOOL RunUnplugged(ULONG ulNow_);
+      ULONG RunChannels(ULONG ulNow_);
+      void EmulatorThread();
+      static DSI_THREAD_RETURN ProcessThread(void *pvParameter_);
+
+   public:
+      DSISerialEmulator();
+      ~DSISerialEmulator();
+
+      // Methods inherited from the base class:
+      BOOL AutoInit();
+      BOOL Init(ULONG ulBaud_, UCHAR ucDeviceNumber_);
+      ULONG GetDeviceSerialNumber();
+      BOOL SetDirectReceive(BOOL bEnable_);
+      BOOL SetExternalReceive(BOOL bEnable_);
+      UCHAR GetPollFds(DSI_POLLFD* pastFds_, UCHAR ucMax_);
+      void ReceivePoll();
+      BOOL Open();
+      void Close(BOOL bReset = FALSE);
+      BOOL WriteBytes(void *pvData_, USHORT usSize_);
+      UCHAR GetDeviceNumber();
+      BOOL WaitForDevice(ULONG ulMilliseconds_);
+
+      BOOL InjectAcknowledgedData(UCHAR ucChannel_, const UCHAR *pucData_);
+      /////////////////////////////////////////////////////////////////
+      // Queues an acknowledged data message from the remote device.
+      // It is delivered to the host after the channel's next period.
+      // Parameters:
+      //    ucChannel_:       An open channel.
+      //    *pucData_:        8 bytes of payload.
+      // Returns FALSE if the channel is not open or its queue is full.
+      /////////////////////////////////////////////////////////////////
+
+      BOOL InjectTargetPower(UCHAR ucChannel_, USHORT usQuarterWatts_);
+      BOOL InjectTrackResistance(UCHAR ucChannel_, SSHORT ssSlope_, UCHAR ucRollingResistance_);
+      BOOL InjectPageRequest(UCHAR ucChannel_, UCHAR ucPage_, UCHAR ucTimes_);
+      /////////////////////////////////////////////////////////////////
+      // Build and queue the FE-C control pages a display sends to a
+      // trainer: target power (0.25 W), track resistance (slope in
+      // 0.01 %, rolling resistance in 5x10^-5) and a common page 70
+      // request for ucPage_, sent back ucTimes_ times.
+      /////////////////////////////////////////////////////////////////
+
+      BOOL InjectBytes(const UCHAR *pucData_, USHORT usSize_);
+      /////////////////////////////////////////////////////////////////
+      // Queues raw bytes for the host as if the module had sent them,
+      // for replaying captured or synthetic streams.
+      // Returns FALSE if they do not fit in the output buffer yet.
+      /////////////////////////////////////////////////////////////////
+
+      void InjectNoise(USHORT usBytes_);
+      /////////////////////////////////////////////////////////////////
+      // Puts usBytes_ random bytes in front of the next frame the host
+      // receives.
+      /////////////////////////////////////////////////////////////////
+
+      void InjectChecksumError();
+      /////////////////////////////////////////////////////////////////
+      // Corrupts the checksum of the next frame the host receives.
+      /////////////////////////////////////////////////////////////////
+
+      void InjectOverrun(USHORT usFrames_);
+      /////////////////////////////////////////////////////////////////
+      // Loses the next usFrames_ frames for the host, as a receive
+      // buffer overflow would.  They are counted as output overruns.
+      /////////////////////////////////////////////////////////////////
+
+      void DropTxEvents(USHORT usEvents_);
+      /////////////////////////////////////////////////////////////////
+      // Leaves the next usEvents_ EVENT_TX out.  The channel periods
+      // still happen and still carry the host's data.
+      /////////////////////////////////////////////////////////////////
+
+      void Unplug(ULONG ulMilliseconds_);
+      /////////////////////////////////////////////////////////////////
+      // Takes the device away for ulMilliseconds_: the host gets
+      // DSI_SERIAL_DEVICE_GONE, writes fail and nothing is received.
+      // It comes back powered on, with every channel unassigned and a
+      // power-on startup message.  Open() fails until then, and
+      // WaitForDevice() returns when it is back.
+      /////////////////////////////////////////////////////////////////
+
+      ULONG GetFaultsPending();
+      /////////////////////////////////////////////////////////////////
+      // Injected faults that have not taken effect or not ended yet,
+      // 0 once the device is back to normal.
+      /////////////////////////////////////////////////////////////////
+
+      ULONG GetBroadcastCount(UCHAR ucChannel_);
+      ULONG GetTxEventCount(UCHAR ucChannel_);
+      ULONG GetFreshSlotCount(UCHAR ucChannel_);
+      BOOL GetLastBroadcast(UCHAR ucChannel_, UCHAR *pucData_);
+      ULONG GetOutputOverruns();
+      /////////////////////////////////////////////////////////////////
+      // Counters for tests and benchmarks, kept across resets and
+      // unplugs.  GetLastBroadcast copies the last 8 byte payload the
+      // host broadcast on the channel.
+      /////////////////////////////////////////////////////////////////
+};
+
+#endif // !defined(DSI_SERIAL_EMULATOR_HPP)
@@ -47,6 +47,7 @@ DSISerialGeneric::DSISerialGeneric()
    pclDevice = NULL;
    hReceiveThread = NULL;
    bStopReceiveThread = TRUE;
+   bDirectReceive = FALSE;
    ucDeviceNumber = 0xFF;
    ulBaud = 0;
 
@@ -229,6 +230,42 @@ BOOL DSISerialGeneric::GetDeviceSerialString(UCHAR* pucSerialString_, USHORT usB
    return TRUE;
 }
 
+///////////////////////////////////////////////////////////////////////
+// Selects direct delivery from the USB handle for the next Open().
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialGeneric::SetDirectReceive(BOOL bEnable_)
+{
+   bDirectReceive = bEnable_;
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Only in direct mode, the handle's receive thread is the one to move.
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialGeneric::SetExternalReceive(BOOL bEnable_)
+{
+   if(pclDeviceHandle == NULL || hReceiveThread != NULL)
+      return FALSE;
+
+   return pclDeviceHandle->SetExternalReceive(bEnable_);
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSISerialGeneric::GetPollFds(DSI_POLLFD* pastFds_, UCHAR ucMax_)
+{
+   if(pclDeviceHandle == NULL)
+      return 0;
+
+   return pclDeviceHandle->GetPollFds(pastFds_, ucMax_);
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSISerialGeneric::ReceivePoll()
+{
+   if(pclDeviceHandle)
+      pclDeviceHandle->ReceivePoll();
+}
+
 ///////////////////////////////////////////////////////////////////////
 // Opens port, starts receive thread.
 ///////////////////////////////////////////////////////////////////////
@@ -252,7 +289,7 @@ BOOL DSISerialGeneric::Open(void)
       pclTempDevice = clDeviceList[ucDeviceNumber];
    }
 
-   if(USBDeviceHandle::Open(*pclTempDevice, pclDeviceHandle, ulBaud) == FALSE)
+   if(USBDeviceHandle::Open(*pclTempDevice, pclDeviceHandle, ulBaud, pstStats) == FALSE)
    {
       pclDeviceHandle = NULL;
       Close();
@@ -260,6 +297,10 @@ BOOL DSISerialGeneric::Open(void)
    }
 
 
+   //In direct mode the handle's receive thread feeds the callback, so we don't need one of our own
+   if(bDirectReceive && pclDeviceHandle->SetReceiveCallback(pclCallback))
+      return TRUE;
+
    if(DSIThread_MutexInit(&stMutexCriticalSection) != DSI_THREAD_ENONE)
    {
       Close();
@@ -298,6 +339,7 @@ void DSISerialGeneric::Close(BOOL bReset_)
       if(bStopReceiveThread == FALSE)
       {
          bStopReceiveThread = TRUE;
+         pclDeviceHandle->CancelRead();   //Its Read() would otherwise wait out the second
 
          if (DSIThread_CondTimedWait(&stEventReceiveThreadExit, &stMutexCriticalSection, 3000) != DSI_THREAD_ENONE)
          {
@@ -354,6 +396,14 @@ UCHAR DSISerialGeneric::GetDeviceNumber()
    return ucDeviceNumber;
 }
 
+///////////////////////////////////////////////////////////////////////
+// Woken by the USB layer's hotplug notification where there is one.
+///////////////////////////////////////////////////////////////////////
+BOOL DSISerialGeneric::WaitForDevice(ULONG ulMilliseconds_)
+{
+   return USBDeviceHandle::WaitForArrival(ulMilliseconds_);
+}
+
 //////////////////////////////////////////////////////////////////////////////////
 // Private Methods
 //////////////////////////////////////////////////////////////////////////////////
@@ -371,8 +421,7 @@ void DSISerialGeneric::ReceiveThread(void)
       switch(eStatus)
       {
          case USBError::NONE:
-            for(ULONG i=0; i<ulRxBytesRead; i++)
-               pclCallback->ProcessByte(aucData[i]);
+            pclCallback->ProcessBytes(aucData, ulRxBytesRead);
             break;
 
          case USBError::DEVICE_GONE:
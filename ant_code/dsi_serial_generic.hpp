@@ -31,6 +31,7 @@ class DSISerialGeneric : public DSISerial
       DSI_MUTEX stMutexCriticalSection;                     // Mutex used with the wait condition
       DSI_CONDITION_VAR stEventReceiveThreadExit;           // Event to signal the receive thread has ended.
       BOOL bStopReceiveThread;                              // Flag to stop the receive thread.
+      BOOL bDirectReceive;                                  // Let the device handle call pclCallback directly.
 
       USBDeviceHandle* pclDeviceHandle;                     // Handle to the USB device.
 
@@ -58,10 +59,15 @@ class DSISerialGeneric : public DSISerial
       BOOL AutoInit();
       ULONG GetDeviceSerialNumber();
 
+      BOOL SetDirectReceive(BOOL bEnable_);
+      BOOL SetExternalReceive(BOOL bEnable_);
+      UCHAR GetPollFds(DSI_POLLFD* pastFds_, UCHAR ucMax_);
+      void ReceivePoll();
       BOOL Open();
       void Close(BOOL bReset = FALSE);
       BOOL WriteBytes(void *pvData_, USHORT usSize_);
       UCHAR GetDeviceNumber();
+      BOOL WaitForDevice(ULONG ulMilliseconds_);
 
       BOOL GetDeviceUSBInfo(UCHAR ucDevice_, UCHAR* pucProductString_, UCHAR* pucSerialString_, USHORT usBufferSize_);
       BOOL GetDevicePID(USHORT& usPid_);
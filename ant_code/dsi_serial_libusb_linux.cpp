@@ -202,7 +202,7 @@ BOOL DSISerialLibusb::Open()
       pclTempDevice = clDeviceList[ucDeviceNumber];
    }
 
-   if(USBDeviceHandleLibusb::Open(*pclTempDevice, pclDeviceHandle) == FALSE)
+   if(USBDeviceHandleLibusb::Open(*pclTempDevice, pclDeviceHandle, pstStats) == FALSE)
    {
       pclDeviceHandle = NULL;
       Close();
@@ -361,8 +361,8 @@ DSI_THREAD_RETURN DSISerialLibusb::ProcessThread(void *pvParameter_)
 ///////////////////////////////////////////////////////////////////////
 BOOL DSISerialLibusb::GetDeviceNumberByVendorId(USHORT usVid_, UCHAR& ucDeviceNumber_)
 {
-
-   const USBDeviceListLibusb clDeviceList = USBDeviceHandleLibusb::GetAvailableDevices();
+   //Numbered as in GetAllDevices(), which is what Open() looks the number up in
+   const USBDeviceListLibusb clDeviceList = USBDeviceHandleLibusb::GetAllDevices();
    ULONG ulNumOfDevices = clDeviceList.GetSize();
    if(ulNumOfDevices == 0)
    {
@@ -379,11 +379,9 @@ BOOL DSISerialLibusb::GetDeviceNumberByVendorId(USHORT usVid_, UCHAR& ucDeviceNu
       if(usVid != usVid_)
          continue;
 
-      USBDeviceHandleLibusb* pclTempHandle;
-      if(USBDeviceHandleLibusb::Open(clDevice, pclTempHandle) == FALSE)
+      if(USBDeviceHandleLibusb::TryOpen(clDevice) == FALSE)
          continue;
 
-      USBDeviceHandleLibusb::Close(pclTempHandle);
       ucDeviceNumber_ = (UCHAR)i;
       bDeviceFound = TRUE;
    }
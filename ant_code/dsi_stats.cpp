@@ -0,0 +1,62 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except
+in compliance with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2016
+All rights reserved.
+*/
+#include "types.h"
+#include "dsi_stats.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Variables
+//////////////////////////////////////////////////////////////////////////////////
+
+ANT_STATS stDSIStats;
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Functions
+//////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////
+// ANT_STATS holds nothing but ULONGs, so it is read as an array of them.
+///////////////////////////////////////////////////////////////////////
+void DSIStats_Get(const ANT_STATS* pstSource_, ANT_STATS* pstStats_)
+{
+   const volatile ULONG* pulSource = (const volatile ULONG*) pstSource_;
+   ULONG* pulDest = (ULONG*) pstStats_;
+
+   for (ULONG i = 0; i < sizeof(ANT_STATS) / sizeof(ULONG); i++)
+      pulDest[i] = pulSource[i];
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSIStats_Reset(ANT_STATS* pstStats_)
+{
+   volatile ULONG* pulCounter = (volatile ULONG*) pstStats_;
+
+   for (ULONG i = 0; i < sizeof(ANT_STATS) / sizeof(ULONG); i++)
+      pulCounter[i] = 0;
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSIStats_Max(ULONG* pulCounter_, ULONG ulValue_)
+{
+#if defined(__GNUC__)
+   ULONG ulCurrent = *(volatile ULONG*) pulCounter_;
+
+   while (ulValue_ > ulCurrent)
+   {
+      ULONG ulSeen = __sync_val_compare_and_swap(pulCounter_, ulCurrent, ulValue_);
+      if (ulSeen == ulCurrent)
+         break;
+      ulCurrent = ulSeen;
+   }
+#else
+   if (ulValue_ > *pulCounter_)
+      *pulCounter_ = ulValue_;
+#endif
+}
@@ -0,0 +1,91 @@
+/*
+This software is subject to the license described in the License.txt file
+included with this software distribution. You may not use this file except
+in compliance with this license.
+
+Copyright (c) Dynastream Innovations Inc. 2016
+All rights reserved.
+*/
+#if !defined(DSI_STATS_H)
+#define DSI_STATS_H
+
+#include "types.h"
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Definitions
+//////////////////////////////////////////////////////////////////////////////////
+
+#define ANT_STATS_CHANNELS             8
+
+// Counters kept by each layer of the library for one stick, since its
+// ANT_Init() or ANT_ResetStats().  The emulated stick counts as the USB
+// layer.
+typedef struct
+{
+   // USB
+   ULONG ulUSBBytesIn;
+   ULONG ulUSBTransfersIn;
+   ULONG ulUSBReadErrors;                                   // IN transfers that did not complete
+   ULONG ulUSBTransferRetries;                              // IN transfers submitted again after an error
+   ULONG ulUSBBytesOut;
+   ULONG ulUSBTransfersOut;
+   ULONG ulUSBWriteErrors;
+   ULONG ulUSBRxQueueHighWater;                             // Bytes waiting for the receive thread
+   ULONG ulUSBRxQueueOverruns;                              // Bytes dropped because that queue was full
+   ULONG ulDeviceGone;
+   ULONG ulReconnects;                                      // Stick opened again after it went away, see ANT_AssignStickCallback()
+
+   // Framer
+   ULONG ulFramesIn;                                        // Received frames that passed the checksum
+   ULONG ulFramesOut;
+   ULONG ulCRCErrors;
+   ULONG ulOversizeFrames;                                  // Length byte too big for the receive FIFO
+   ULONG ulQueueOverflows;                                  // Received messages lost because the queue was full
+   ULONG ulQueueHighWater;                                  // Received messages waiting for the message thread
+   ULONG ulSerialErrors;                                    // Read, write and device gone errors from the serial layer
+   ULONG ulResponseTimeouts;                                // Commands, requests and command groups not answered in time
+
+   // Message thread
+   ULONG ulFramerErrors;                                    // DSI_FRAMER_ERROR reports drained by the message thread
+
+   // Per channel
+   ULONG aulBroadcastsSent[ANT_STATS_CHANNELS];
+   ULONG aulEventsReceived[ANT_STATS_CHANNELS];             // Channel events and data messages
+} ANT_STATS;
+
+
+//////////////////////////////////////////////////////////////////////////////////
+// Public Function Prototypes
+//////////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern ANT_STATS stDSIStats;
+   // Counts for the objects that were never given a stick's counters.
+
+void DSIStats_Get(const ANT_STATS* pstSource_, ANT_STATS* pstStats_);
+   // Copies the counters.  Each counter is read atomically, the set
+   // as a whole is not a snapshot.
+
+void DSIStats_Reset(ANT_STATS* pstStats_);
+
+void DSIStats_Max(ULONG* pulCounter_, ULONG ulValue_);
+   // Raises *pulCounter_ to ulValue_ if it is lower.
+
+#ifdef __cplusplus
+}
+#endif
+
+// Cheap enough for the receive path: one locked add, no lock.
+#if defined(__GNUC__)
+   #define DSI_STATS_ADD(stats, field, value)    ((void) __sync_fetch_and_add(&(stats)->field, (ULONG)(value)))
+#else
+   #define DSI_STATS_ADD(stats, field, value)    ((void) ((stats)->field += (ULONG)(value)))
+#endif
+#define DSI_STATS_INC(stats, field)              DSI_STATS_ADD(stats, field, 1)
+#define DSI_STATS_MAX(stats, field, value)       DSIStats_Max(&(stats)->field, (ULONG)(value))
+
+#endif // !defined(DSI_STATS_H)
@@ -58,6 +58,14 @@ typedef void *                         DSI_THREAD_RETURN;
    typedef pthread_t                   DSI_THREAD_ID;
    typedef pthread_t             DSI_THREAD_IDNUM;
 
+   typedef struct
+   {
+      // All members are for internal use only.  Do not modify!
+      volatile BOOL bCancelled;
+      int iReadFd;                                          // An eventfd on Linux, both ends are the same
+      int iWriteFd;
+   }                                   DSI_CANCEL_TOKEN;
+
 #endif
 
 
@@ -266,6 +274,89 @@ void DSIThread_Sleep(ULONG ulMilliseconds);
    //    ulMilliseconds:      Number of milliseconds to sleep.
    ////////////////////////////////////////////////////////////////////
 
+#if defined(DSI_TYPES_MACINTOSH) || defined(DSI_TYPES_LINUX)
+
+UCHAR DSIThread_CancelInit(DSI_CANCEL_TOKEN *pstToken_);
+   ////////////////////////////////////////////////////////////////////
+   // Initializes a cancellation token, not cancelled.  A token is a
+   // stop request any number of threads can wait on at once, in
+   // DSIThread_SleepCancellable() or by polling its descriptor.
+   // Returns DSI_THREAD_ENONE if successful, DSI_THREAD_EOTHER if the
+   // descriptor could not be made.
+   ////////////////////////////////////////////////////////////////////
+
+UCHAR DSIThread_CancelDestroy(DSI_CANCEL_TOKEN *pstToken_);
+   ////////////////////////////////////////////////////////////////////
+   // Closes the token's descriptor.  Nothing may be waiting on it.
+   ////////////////////////////////////////////////////////////////////
+
+void DSIThread_Cancel(DSI_CANCEL_TOKEN *pstToken_);
+   ////////////////////////////////////////////////////////////////////
+   // Cancels the token and wakes everything waiting on it.  It stays
+   // cancelled until DSIThread_CancelReset().  Safe to call from a
+   // signal handler.
+   ////////////////////////////////////////////////////////////////////
+
+void DSIThread_CancelReset(DSI_CANCEL_TOKEN *pstToken_);
+   ////////////////////////////////////////////////////////////////////
+   // Makes a cancelled token usable again, once nothing waits on it.
+   ////////////////////////////////////////////////////////////////////
+
+BOOL DSIThread_IsCancelled(DSI_CANCEL_TOKEN *pstToken_);
+
+int DSIThread_CancelGetFd(DSI_CANCEL_TOKEN *pstToken_);
+   ////////////////////////////////////////////////////////////////////
+   // A descriptor that polls readable once the token is cancelled,
+   // for waits that already poll descriptors of their own.  Do not
+   // read it.
+   ////////////////////////////////////////////////////////////////////
+
+BOOL DSIThread_SleepCancellable(ULONG ulMilliseconds_, DSI_CANCEL_TOKEN *pstToken_);
+   ////////////////////////////////////////////////////////////////////
+   // DSIThread_Sleep() that returns early when the token is cancelled.
+   // A thread attached to virtual time sleeps the whole time, the
+   // clock jumps over it as soon as the other attached threads wait.
+   // Returns FALSE if the token is cancelled.
+   ////////////////////////////////////////////////////////////////////
+
+#endif
+
+BOOL DSIThread_VirtualTimeEnable(ULONG ulStartTime_);
+   ////////////////////////////////////////////////////////////////////
+   // Switches the time functions above from the OS clock to a
+   // simulated one starting at ulStartTime_.  Threads attached to
+   // virtual time run one at a time and the clock only moves when
+   // every one of them is sleeping or waiting, when it jumps straight
+   // to the earliest deadline.  A run then takes as long as the work
+   // in it and, given the same inputs, repeats exactly.
+   // Threads created with DSIThread_CreateThread() while virtual time
+   // is enabled are attached to it.  Threads that are not attached
+   // read virtual time but sleep and wait in real time.
+   // An attached thread must not block on anything but these
+   // functions, or hold a lock another attached thread needs while
+   // it sleeps.
+   // Returns FALSE if virtual time is already enabled.
+   ////////////////////////////////////////////////////////////////////
+
+BOOL DSIThread_VirtualTimeDisable(void);
+   ////////////////////////////////////////////////////////////////////
+   // Goes back to the OS clock.
+   // Returns FALSE if threads are still attached to virtual time.
+   ////////////////////////////////////////////////////////////////////
+
+BOOL DSIThread_VirtualTimeIsEnabled(void);
+
+BOOL DSIThread_VirtualTimeAttach(void);
+void DSIThread_VirtualTimeDetach(void);
+   ////////////////////////////////////////////////////////////////////
+   // Attaches the calling thread to virtual time, for threads not
+   // created with DSIThread_CreateThread(), and detaches it again.
+   // Attach blocks until it is the calling thread's turn to run and
+   // returns FALSE if virtual time is not enabled.  A thread must
+   // detach before it exits or blocks outside these functions, for
+   // example in a join.
+   ////////////////////////////////////////////////////////////////////
+
 
 #endif // !defined(DSI_THREAD_H)
 
@@ -24,6 +24,12 @@ All rights reserved.
 #include <signal.h>
 
 #include <string.h>
+#include <poll.h>
+#include <fcntl.h>
+
+#if defined(DSI_TYPES_LINUX)
+   #include <sys/eventfd.h>
+#endif
 
 //////////////////////////////////////////////////////////////////////////////////
 // Private Definitions
@@ -32,6 +38,41 @@ All rights reserved.
 typedef void *(*PTHREAD_START_ROUTINE)(void *);
 void ExitHandler(int sig);
 
+#define VIRTUAL_TIME_MAX_THREADS       ((UCHAR) 32)
+
+#define VIRTUAL_THREAD_FREE            ((UCHAR) 0)
+#define VIRTUAL_THREAD_READY           ((UCHAR) 1)          // Waiting for its turn to run
+#define VIRTUAL_THREAD_RUNNING         ((UCHAR) 2)          // Has the turn, there is only one
+#define VIRTUAL_THREAD_WAITING         ((UCHAR) 3)          // Sleeping or waiting on a condition variable
+
+typedef struct
+{
+   UCHAR ucState;
+   BOOL bStarted;                                           // hThread is valid
+   pthread_t hThread;
+   BOOL bTimed;                                             // FALSE if only a signal wakes it
+   ULONG ulDeadline;                                        // Virtual time to wake up at
+   DSI_CONDITION_VAR *pstWaitingOn;                         // NULL while sleeping
+   BOOL bSignalled;
+   ULONG ulSequence;                                        // Order of ready threads, and of waiters on a condition variable
+   pthread_cond_t stTurn;                                   // Signalled when the thread is given the turn
+} VIRTUAL_THREAD;
+
+typedef struct
+{
+   DSI_THREAD_RETURN (*fnThreadStart)(void *);
+   void *pvParameter;
+   VIRTUAL_THREAD *pstThread;
+} VIRTUAL_THREAD_START;
+
+static pthread_mutex_t stVirtualMutex = PTHREAD_MUTEX_INITIALIZER;   // Protects everything below
+static volatile BOOL bVirtualTime = FALSE;
+static BOOL bVirtualInitialized = FALSE;
+static ULONG ulVirtualNow;
+static ULONG ulVirtualSequence;
+static VIRTUAL_THREAD *pstVirtualRunning = (VIRTUAL_THREAD*)NULL;
+static VIRTUAL_THREAD astVirtualThreads[VIRTUAL_TIME_MAX_THREADS];
+
 
 //////////////////////////////////////////////////////////////////////////////////
 // Private Functions
@@ -42,6 +83,175 @@ void ExitHandler(int sig)
    pthread_exit(NULL);
 }
 
+// The Virtual* functions are called with stVirtualMutex locked.
+
+///////////////////////////////////////////////////////////////////////
+static VIRTUAL_THREAD* VirtualSelf(void)
+{
+   pthread_t hSelf = pthread_self();
+
+   for (UCHAR i = 0; i < VIRTUAL_TIME_MAX_THREADS; i++)
+   {
+      VIRTUAL_THREAD *pstThread = &astVirtualThreads[i];
+      if (pstThread->ucState != VIRTUAL_THREAD_FREE && pstThread->bStarted && pthread_equal(pstThread->hThread, hSelf))
+         return pstThread;
+   }
+   return (VIRTUAL_THREAD*)NULL;
+}
+
+///////////////////////////////////////////////////////////////////////
+static void VirtualMakeReady(VIRTUAL_THREAD *pstThread_, BOOL bSignalled_)
+{
+   pstThread_->ucState = VIRTUAL_THREAD_READY;
+   pstThread_->bSignalled = bSignalled_;
+   pstThread_->pstWaitingOn = (DSI_CONDITION_VAR*)NULL;
+   pstThread_->ulSequence = ++ulVirtualSequence;
+}
+
+///////////////////////////////////////////////////////////////////////
+static VIRTUAL_THREAD* VirtualAlloc(void)
+{
+   for (UCHAR i = 0; i < VIRTUAL_TIME_MAX_THREADS; i++)
+   {
+      VIRTUAL_THREAD *pstThread = &astVirtualThreads[i];
+      if (pstThread->ucState == VIRTUAL_THREAD_FREE)
+      {
+         pstThread->bStarted = FALSE;
+         VirtualMakeReady(pstThread, FALSE);
+         return pstThread;
+      }
+   }
+   return (VIRTUAL_THREAD*)NULL;
+}
+
+///////////////////////////////////////////////////////////////////////
+static VIRTUAL_THREAD* VirtualNextReady(void)
+{
+   VIRTUAL_THREAD *pstNext = (VIRTUAL_THREAD*)NULL;
+
+   for (UCHAR i = 0; i < VIRTUAL_TIME_MAX_THREADS; i++)
+   {
+      VIRTUAL_THREAD *pstThread = &astVirtualThreads[i];
+      if (pstThread->ucState == VIRTUAL_THREAD_READY && (pstNext == NULL || pstThread->ulSequence < pstNext->ulSequence))
+         pstNext = pstThread;
+   }
+   return pstNext;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Hands the turn to the thread that has been ready longest.  If none
+// is ready every attached thread is waiting, so the clock jumps to the
+// earliest deadline and wakes whoever is due.
+///////////////////////////////////////////////////////////////////////
+static void VirtualDispatch(void)
+{
+   VIRTUAL_THREAD *pstNext;
+
+   if (pstVirtualRunning != NULL)
+      return;
+
+   pstNext = VirtualNextReady();
+   if (pstNext == NULL)
+   {
+      VIRTUAL_THREAD *pstEarliest = (VIRTUAL_THREAD*)NULL;
+
+      for (UCHAR i = 0; i < VIRTUAL_TIME_MAX_THREADS; i++)
+      {
+         VIRTUAL_THREAD *pstThread = &astVirtualThreads[i];
+         if (pstThread->ucState == VIRTUAL_THREAD_WAITING && pstThread->bTimed &&
+            (pstEarliest == NULL || (LONG)(pstThread->ulDeadline - pstEarliest->ulDeadline) < 0))
+            pstEarliest = pstThread;
+      }
+
+      if (pstEarliest == NULL)
+         return;                                            // Idle until a thread outside virtual time signals
+
+      if ((LONG)(pstEarliest->ulDeadline - ulVirtualNow) > 0)
+         ulVirtualNow = pstEarliest->ulDeadline;
+
+      for (UCHAR i = 0; i < VIRTUAL_TIME_MAX_THREADS; i++)
+      {
+         VIRTUAL_THREAD *pstThread = &astVirtualThreads[i];
+         if (pstThread->ucState == VIRTUAL_THREAD_WAITING && pstThread->bTimed && (LONG)(pstThread->ulDeadline - ulVirtualNow) <= 0)
+            VirtualMakeReady(pstThread, FALSE);
+      }
+      pstNext = VirtualNextReady();
+   }
+
+   pstNext->ucState = VIRTUAL_THREAD_RUNNING;
+   pstVirtualRunning = pstNext;
+   pthread_cond_signal(&pstNext->stTurn);
+}
+
+///////////////////////////////////////////////////////////////////////
+static void VirtualWaitForTurn(VIRTUAL_THREAD *pstThread_)
+{
+   if (pstVirtualRunning == pstThread_)
+      pstVirtualRunning = (VIRTUAL_THREAD*)NULL;
+
+   VirtualDispatch();
+   while (pstThread_->ucState != VIRTUAL_THREAD_RUNNING)
+      pthread_cond_wait(&pstThread_->stTurn, &stVirtualMutex);
+}
+
+///////////////////////////////////////////////////////////////////////
+static void VirtualRelease(VIRTUAL_THREAD *pstThread_)
+{
+   pstThread_->ucState = VIRTUAL_THREAD_FREE;
+   if (pstVirtualRunning == pstThread_)
+      pstVirtualRunning = (VIRTUAL_THREAD*)NULL;
+   VirtualDispatch();
+}
+
+///////////////////////////////////////////////////////////////////////
+static void VirtualWake(DSI_CONDITION_VAR *pstConditionVariable_, BOOL bAll_)
+{
+   while (TRUE)
+   {
+      VIRTUAL_THREAD *pstWaiter = (VIRTUAL_THREAD*)NULL;
+
+      for (UCHAR i = 0; i < VIRTUAL_TIME_MAX_THREADS; i++)
+      {
+         VIRTUAL_THREAD *pstThread = &astVirtualThreads[i];
+         if (pstThread->ucState == VIRTUAL_THREAD_WAITING && pstThread->pstWaitingOn == pstConditionVariable_ &&
+            (pstWaiter == NULL || pstThread->ulSequence < pstWaiter->ulSequence))
+            pstWaiter = pstThread;
+      }
+
+      if (pstWaiter == NULL)
+         break;
+
+      VirtualMakeReady(pstWaiter, TRUE);
+      if (!bAll_)
+         break;
+   }
+   VirtualDispatch();
+}
+
+///////////////////////////////////////////////////////////////////////
+static DSI_THREAD_RETURN VirtualThreadStart(void *pvParameter_)
+{
+   VIRTUAL_THREAD_START stStart = *(VIRTUAL_THREAD_START*)pvParameter_;
+   DSI_THREAD_RETURN pvReturn;
+
+   delete (VIRTUAL_THREAD_START*)pvParameter_;
+
+   pthread_mutex_lock(&stVirtualMutex);
+   stStart.pstThread->hThread = pthread_self();
+   stStart.pstThread->bStarted = TRUE;
+   while (stStart.pstThread->ucState != VIRTUAL_THREAD_RUNNING)
+      pthread_cond_wait(&stStart.pstThread->stTurn, &stVirtualMutex);
+   pthread_mutex_unlock(&stVirtualMutex);
+
+   pvReturn = stStart.fnThreadStart(stStart.pvParameter);
+
+   pthread_mutex_lock(&stVirtualMutex);
+   VirtualRelease(stStart.pstThread);
+   pthread_mutex_unlock(&stVirtualMutex);
+
+   return pvReturn;
+}
+
 
 //////////////////////////////////////////////////////////////////////////////////
 // Public Functions
@@ -128,6 +338,33 @@ UCHAR DSIThread_CondDestroy(DSI_CONDITION_VAR *pstConditionVariable_)
 ///////////////////////////////////////////////////////////////////////
 UCHAR DSIThread_CondTimedWait(DSI_CONDITION_VAR *pstConditionVariable_, DSI_MUTEX *pstExternalMutex_, ULONG ulMilliseconds_)
 {
+   if (bVirtualTime)
+   {
+      pthread_mutex_lock(&stVirtualMutex);
+      VIRTUAL_THREAD *pstSelf = VirtualSelf();
+      if (pstSelf != NULL)
+      {
+         UCHAR ucReturn;
+
+         // Register as a waiter before letting go of the external mutex so a signal can't be missed
+         pstSelf->ucState = VIRTUAL_THREAD_WAITING;
+         pstSelf->bTimed = (ulMilliseconds_ != DSI_THREAD_INFINITE);
+         pstSelf->ulDeadline = ulVirtualNow + ulMilliseconds_;
+         pstSelf->pstWaitingOn = pstConditionVariable_;
+         pstSelf->bSignalled = FALSE;
+         pstSelf->ulSequence = ++ulVirtualSequence;
+         pthread_mutex_unlock(pstExternalMutex_);
+
+         VirtualWaitForTurn(pstSelf);
+         ucReturn = pstSelf->bSignalled ? DSI_THREAD_ENONE : DSI_THREAD_ETIMEDOUT;
+         pthread_mutex_unlock(&stVirtualMutex);
+
+         pthread_mutex_lock(pstExternalMutex_);
+         return ucReturn;
+      }
+      pthread_mutex_unlock(&stVirtualMutex);
+   }
+
    if (ulMilliseconds_ == DSI_THREAD_INFINITE)
    {
       if (pthread_cond_wait(pstConditionVariable_, pstExternalMutex_) == 0)
@@ -178,6 +415,13 @@ UCHAR DSIThread_CondTimedWait(DSI_CONDITION_VAR *pstConditionVariable_, DSI_MUTE
 ///////////////////////////////////////////////////////////////////////
 UCHAR DSIThread_CondSignal(DSI_CONDITION_VAR *pstConditionVariable_)
 {
+   if (bVirtualTime)
+   {
+      pthread_mutex_lock(&stVirtualMutex);
+      VirtualWake(pstConditionVariable_, FALSE);
+      pthread_mutex_unlock(&stVirtualMutex);
+   }
+
    if (pthread_cond_signal(pstConditionVariable_) != 0)
       return DSI_THREAD_EOTHER;
 
@@ -187,6 +431,13 @@ UCHAR DSIThread_CondSignal(DSI_CONDITION_VAR *pstConditionVariable_)
 ///////////////////////////////////////////////////////////////////////
 UCHAR DSIThread_CondBroadcast(DSI_CONDITION_VAR *pstConditionVariable_)
 {
+   if (bVirtualTime)
+   {
+      pthread_mutex_lock(&stVirtualMutex);
+      VirtualWake(pstConditionVariable_, TRUE);
+      pthread_mutex_unlock(&stVirtualMutex);
+   }
+
    if (pthread_cond_broadcast(pstConditionVariable_) != 0)
       return DSI_THREAD_EOTHER;
 
@@ -198,6 +449,31 @@ DSI_THREAD_ID DSIThread_CreateThread(DSI_THREAD_RETURN (*fnThreadStart_)(void *)
 {
    pthread_t iThread;
 
+   if (bVirtualTime)
+   {
+      // Reserve the new thread's place in line now, so the order threads run in doesn't depend on the OS
+      VIRTUAL_THREAD_START *pstStart = new VIRTUAL_THREAD_START;
+      pstStart->fnThreadStart = fnThreadStart_;
+      pstStart->pvParameter = pvParameter_;
+
+      pthread_mutex_lock(&stVirtualMutex);
+      pstStart->pstThread = VirtualAlloc();
+      pthread_mutex_unlock(&stVirtualMutex);
+
+      if (pstStart->pstThread != NULL)
+      {
+         if (pthread_create(&iThread, NULL, (PTHREAD_START_ROUTINE) VirtualThreadStart, pstStart) == 0)
+            return iThread;
+
+         pthread_mutex_lock(&stVirtualMutex);
+         VirtualRelease(pstStart->pstThread);
+         pthread_mutex_unlock(&stVirtualMutex);
+         delete pstStart;
+         return (DSI_THREAD_ID) NULL;
+      }
+      delete pstStart;                                      // Out of slots, run it in real time
+   }
+
    if (
    pthread_create(
       &iThread,                                             // Store the thread ID here.
@@ -267,6 +543,15 @@ BOOL DSIThread_CompareThreads(DSI_THREAD_IDNUM hThreadIDNum1, DSI_THREAD_IDNUM h
 ULONG DSIThread_GetSystemTime(void)
 {
    ULONG ulReturn = 0;
+
+   if (bVirtualTime)
+   {
+      pthread_mutex_lock(&stVirtualMutex);
+      ulReturn = ulVirtualNow;
+      pthread_mutex_unlock(&stVirtualMutex);
+      return ulReturn;
+   }
+
 #if defined(DSI_TYPES_MACINTOSH)
    // Mac doesn't support clock_gettime(), so we need to convert
    // from timeval to timespec.
@@ -305,9 +590,236 @@ BOOL DSIThread_GetWorkingDirectory(UCHAR* pucDirectory_, USHORT usLength_)
 ///////////////////////////////////////////////////////////////////////
 void DSIThread_Sleep(ULONG ulMilliseconds_)
 {
+   if (bVirtualTime)
+   {
+      pthread_mutex_lock(&stVirtualMutex);
+      VIRTUAL_THREAD *pstSelf = VirtualSelf();
+      if (pstSelf != NULL)
+      {
+         pstSelf->ucState = VIRTUAL_THREAD_WAITING;
+         pstSelf->bTimed = TRUE;
+         pstSelf->ulDeadline = ulVirtualNow + ulMilliseconds_;
+         pstSelf->pstWaitingOn = (DSI_CONDITION_VAR*)NULL;
+         VirtualWaitForTurn(pstSelf);
+         pthread_mutex_unlock(&stVirtualMutex);
+         return;
+      }
+      pthread_mutex_unlock(&stVirtualMutex);
+   }
+
    usleep(ulMilliseconds_*1000);
    return;
 }
 
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIThread_CancelInit(DSI_CANCEL_TOKEN *pstToken_)
+{
+   pstToken_->bCancelled = FALSE;
+
+#if defined(DSI_TYPES_LINUX)
+   pstToken_->iReadFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   pstToken_->iWriteFd = pstToken_->iReadFd;
+   if (pstToken_->iReadFd < 0)
+      return DSI_THREAD_EOTHER;
+#else
+   int aiFds[2];
+
+   if (pipe(aiFds) != 0)
+   {
+      pstToken_->iReadFd = -1;
+      pstToken_->iWriteFd = -1;
+      return DSI_THREAD_EOTHER;
+   }
+   for (UCHAR i = 0; i < 2; i++)
+   {
+      fcntl(aiFds[i], F_SETFL, fcntl(aiFds[i], F_GETFL) | O_NONBLOCK);
+      fcntl(aiFds[i], F_SETFD, FD_CLOEXEC);
+   }
+   pstToken_->iReadFd = aiFds[0];
+   pstToken_->iWriteFd = aiFds[1];
+#endif
+
+   return DSI_THREAD_ENONE;
+}
+
+///////////////////////////////////////////////////////////////////////
+UCHAR DSIThread_CancelDestroy(DSI_CANCEL_TOKEN *pstToken_)
+{
+   if (pstToken_->iWriteFd >= 0 && pstToken_->iWriteFd != pstToken_->iReadFd)
+      close(pstToken_->iWriteFd);
+   if (pstToken_->iReadFd >= 0)
+      close(pstToken_->iReadFd);
+   pstToken_->iReadFd = -1;
+   pstToken_->iWriteFd = -1;
+
+   return DSI_THREAD_ENONE;
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSIThread_Cancel(DSI_CANCEL_TOKEN *pstToken_)
+{
+   if (pstToken_->bCancelled)
+      return;
+   pstToken_->bCancelled = TRUE;
+
+   // Nobody reads it until a reset, so one write keeps it readable for every poller
+#if defined(DSI_TYPES_LINUX)
+   unsigned long long ullOne = 1;
+   if (write(pstToken_->iWriteFd, &ullOne, sizeof(ullOne)) < 0)
+      return;
+#else
+   UCHAR ucOne = 1;
+   if (write(pstToken_->iWriteFd, &ucOne, sizeof(ucOne)) < 0)
+      return;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSIThread_CancelReset(DSI_CANCEL_TOKEN *pstToken_)
+{
+   UCHAR aucDrain[8];
+
+   while (read(pstToken_->iReadFd, aucDrain, sizeof(aucDrain)) > 0);
+   pstToken_->bCancelled = FALSE;
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSIThread_IsCancelled(DSI_CANCEL_TOKEN *pstToken_)
+{
+   return pstToken_->bCancelled;
+}
+
+///////////////////////////////////////////////////////////////////////
+int DSIThread_CancelGetFd(DSI_CANCEL_TOKEN *pstToken_)
+{
+   return pstToken_->iReadFd;
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSIThread_SleepCancellable(ULONG ulMilliseconds_, DSI_CANCEL_TOKEN *pstToken_)
+{
+   if (bVirtualTime)
+   {
+      pthread_mutex_lock(&stVirtualMutex);
+      BOOL bAttached = (VirtualSelf() != NULL);
+      pthread_mutex_unlock(&stVirtualMutex);
+
+      if (bAttached)
+      {
+         if (!pstToken_->bCancelled)
+            DSIThread_Sleep(ulMilliseconds_);
+         return !pstToken_->bCancelled;
+      }
+   }
+
+   if (!pstToken_->bCancelled)
+   {
+      struct pollfd stPollFd;
+      stPollFd.fd = pstToken_->iReadFd;
+      stPollFd.events = POLLIN;
+      stPollFd.revents = 0;
+
+      // A signal ends it early, as it does usleep() in DSIThread_Sleep()
+      poll(&stPollFd, 1, (ulMilliseconds_ == DSI_THREAD_INFINITE) ? -1 : (int)ulMilliseconds_);
+   }
+
+   return !pstToken_->bCancelled;
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSIThread_VirtualTimeEnable(ULONG ulStartTime_)
+{
+   pthread_mutex_lock(&stVirtualMutex);
+   if (bVirtualTime)
+   {
+      pthread_mutex_unlock(&stVirtualMutex);
+      return FALSE;
+   }
+
+   if (!bVirtualInitialized)
+   {
+      for (UCHAR i = 0; i < VIRTUAL_TIME_MAX_THREADS; i++)
+         pthread_cond_init(&astVirtualThreads[i].stTurn, (const pthread_condattr_t *) NULL);
+      bVirtualInitialized = TRUE;
+   }
+
+   for (UCHAR i = 0; i < VIRTUAL_TIME_MAX_THREADS; i++)
+      astVirtualThreads[i].ucState = VIRTUAL_THREAD_FREE;
+   ulVirtualNow = ulStartTime_;
+   ulVirtualSequence = 0;
+   pstVirtualRunning = (VIRTUAL_THREAD*)NULL;
+   bVirtualTime = TRUE;
+   pthread_mutex_unlock(&stVirtualMutex);
+
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSIThread_VirtualTimeDisable(void)
+{
+   pthread_mutex_lock(&stVirtualMutex);
+   for (UCHAR i = 0; i < VIRTUAL_TIME_MAX_THREADS; i++)
+   {
+      if (astVirtualThreads[i].ucState != VIRTUAL_THREAD_FREE)
+      {
+         pthread_mutex_unlock(&stVirtualMutex);
+         return FALSE;
+      }
+   }
+   bVirtualTime = FALSE;
+   pthread_mutex_unlock(&stVirtualMutex);
+
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSIThread_VirtualTimeIsEnabled(void)
+{
+   return bVirtualTime;
+}
+
+///////////////////////////////////////////////////////////////////////
+BOOL DSIThread_VirtualTimeAttach(void)
+{
+   VIRTUAL_THREAD *pstSelf;
+
+   pthread_mutex_lock(&stVirtualMutex);
+   if (!bVirtualTime)
+   {
+      pthread_mutex_unlock(&stVirtualMutex);
+      return FALSE;
+   }
+
+   pstSelf = VirtualSelf();
+   if (pstSelf == NULL)
+   {
+      pstSelf = VirtualAlloc();
+      if (pstSelf == NULL)
+      {
+         pthread_mutex_unlock(&stVirtualMutex);
+         return FALSE;
+      }
+      pstSelf->hThread = pthread_self();
+      pstSelf->bStarted = TRUE;
+      VirtualWaitForTurn(pstSelf);
+   }
+   pthread_mutex_unlock(&stVirtualMutex);
+
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+void DSIThread_VirtualTimeDetach(void)
+{
+   pthread_mutex_lock(&stVirtualMutex);
+   if (bVirtualTime)
+   {
+      VIRTUAL_THREAD *pstSelf = VirtualSelf();
+      if (pstSelf != NULL)
+         VirtualRelease(pstSelf);
+   }
+   pthread_mutex_unlock(&stVirtualMutex);
+}
+
 
 #endif //defined(DSI_TYPES_MACINTOSH) || defined(DSI_TYPES_LINUX)
@@ -9,13 +9,13 @@ All rights reserved.
 #ifndef DSI_TS_QUEUE_HPP
 #define DSI_TS_QUEUE_HPP
 
-#include <list>
-#include <queue>
-#include <deque>
+#define TS_QUEUE_DEFAULT_SIZE    ((ULONG) 16384)
 
 
 //NOTE: Make sure nobody is still using this queue when it is being destroyed!
-template < class T, class Container = std::deque<T> >
+//Elements live in a fixed ring so nothing is allocated after construction;
+//elements pushed while the ring is full are dropped and counted.
+template < class T, ULONG SIZE = TS_QUEUE_DEFAULT_SIZE >
 class TSQueue  //thread-safe queue
 {
   public:
@@ -23,6 +23,13 @@ class TSQueue  //thread-safe queue
    TSQueue()
    {
       UCHAR ret;
+
+      ulHead = 0;
+      ulCount = 0;
+      ulHighWater = 0;
+      ulOverruns = 0;
+      bReleased = FALSE;
+
       ret = DSIThread_CondInit(&stEventPush);
       if(ret != DSI_THREAD_ENONE)
          throw; //!!Need to throw something!
@@ -49,7 +56,7 @@ class TSQueue  //thread-safe queue
    {
       DSIThread_MutexLock(&stMutex);
       {
-         clQueue.push(tElement_);
+         PushElement(tElement_);
          DSIThread_CondSignal(&stEventPush);
       }
       DSIThread_MutexUnlock(&stMutex);
@@ -63,8 +70,8 @@ class TSQueue  //thread-safe queue
 
       DSIThread_MutexLock(&stMutex);
       {
-         for(ULONG i=0; i<ulSize_; i++)      //!!would it be faster if we assigned or used an iterator instead of pushing?
-            clQueue.push(ptElementArray_[i]);
+         for(ULONG i=0; i<ulSize_; i++)
+            PushElement(ptElementArray_[i]);
          DSIThread_CondSignal(&stEventPush);
       }
       DSIThread_MutexUnlock(&stMutex);
@@ -77,19 +84,19 @@ class TSQueue  //thread-safe queue
    {
       DSIThread_MutexLock(&stMutex);
       {
-         if(clQueue.empty() == TRUE)
+         if(ulCount == 0)
          {
-            UCHAR ret;
-            ret = DSIThread_CondTimedWait(&stEventPush, &stMutex, ulWaitTime_);
-            if(ret != DSI_THREAD_ENONE)
+            UCHAR ret = DSI_THREAD_ETIMEDOUT;
+            if(!bReleased)
+               ret = DSIThread_CondTimedWait(&stEventPush, &stMutex, ulWaitTime_);
+            if(ret != DSI_THREAD_ENONE || ulCount == 0)
             {
                DSIThread_MutexUnlock(&stMutex);
                return FALSE;
             }
          }
 
-         tElement_ = clQueue.front();
-         clQueue.pop();
+         tElement_ = PopElement();
       }
       DSIThread_MutexUnlock(&stMutex);
 
@@ -104,10 +111,11 @@ class TSQueue  //thread-safe queue
 
       DSIThread_MutexLock(&stMutex);
       {
-         if(clQueue.empty() == TRUE)
+         if(ulCount == 0)
          {
-            UCHAR ret;
-            ret = DSIThread_CondTimedWait(&stEventPush, &stMutex, ulWaitTime_);
+            UCHAR ret = DSI_THREAD_ETIMEDOUT;
+            if(!bReleased)
+               ret = DSIThread_CondTimedWait(&stEventPush, &stMutex, ulWaitTime_);
             if(ret != DSI_THREAD_ENONE)
             {
                DSIThread_MutexUnlock(&stMutex);
@@ -115,19 +123,9 @@ class TSQueue  //thread-safe queue
             }
          }
 
-         size_t QueueSize = clQueue.size();
-
-         if (QueueSize > MAX_ULONG)
-            QueueSize = MAX_ULONG;
-
-         ULONG ulQueueSize = (ULONG)QueueSize;
-
-         ULONG ulSize = (ulMaxSize_ < ulQueueSize) ? ulMaxSize_ : ulQueueSize;  //MIN(ulMaxSize_, ulQueueSize);
+         ULONG ulSize = (ulMaxSize_ < ulCount) ? ulMaxSize_ : ulCount;  //MIN(ulMaxSize_, ulCount);
          for(ULONG i=0; i<ulSize; i++)
-         {
-            ptElementArray_[i] = clQueue.front();
-            clQueue.pop();
-         }
+            ptElementArray_[i] = PopElement();
          ulFinalSize = ulSize;
       }
       DSIThread_MutexUnlock(&stMutex);
@@ -136,11 +134,62 @@ class TSQueue  //thread-safe queue
       return ulFinalSize;
    }
 
+   //Wakes the threads waiting in Pop() or PopArray(), from then on they return at once when empty.
+   void Release()
+   {
+      DSIThread_MutexLock(&stMutex);
+      {
+         bReleased = TRUE;
+         DSIThread_CondBroadcast(&stEventPush);
+      }
+      DSIThread_MutexUnlock(&stMutex);
+
+      return;
+   }
+
+   ULONG GetOverruns()
+   {
+      return ulOverruns;
+   }
+
+   ULONG GetHighWater()
+   {
+      return ulHighWater;
+   }
+
   private:
    DSI_CONDITION_VAR stEventPush;
    DSI_MUTEX stMutex;
 
-   std::queue<T, Container> clQueue;
+   T atElements[SIZE];
+   ULONG ulHead;
+   ULONG ulCount;
+   ULONG ulHighWater;
+   ULONG ulOverruns;
+   BOOL bReleased;
+
+   //Must be called with stMutex held.
+   void PushElement(const T& tElement_)
+   {
+      if(ulCount == SIZE)
+      {
+         ulOverruns++;
+         return;
+      }
+      atElements[(ulHead + ulCount) % SIZE] = tElement_;
+      ulCount++;
+      if(ulCount > ulHighWater)
+         ulHighWater = ulCount;
+   }
+
+   //Must be called with stMutex held and ulCount > 0.
+   T& PopElement()
+   {
+      T& tElement = atElements[ulHead];
+      ulHead = (ulHead + 1) % SIZE;
+      ulCount--;
+      return tElement;
+   }
 
 };
 
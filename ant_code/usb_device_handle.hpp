@@ -11,6 +11,7 @@ All rights reserved.
 
 
 #include "types.h"
+#include "dsi_serial.hpp"
 
 #include "usb_device.hpp"
 #include "usb_device_list.hpp"
@@ -36,7 +37,7 @@ typedef USBDeviceList<const USBDevice*> ANTDeviceList;
 
 //NOTE: We assume that there are no devices plugged/unplugged between getting the list and opening a device.
 
-//NOTE: USBDevice instances are invalid once a new device list is requested!  This applies to all derived classes' lists as well.
+//NOTE: USBDevice instances in a list are invalid once their device is unplugged and a new device list is requested!  This applies to all derived classes' lists as well.
 
 //!!Maybe USBDeviceHandle should have a GetDeviceList() function as well, and then USBDeviceList will only have to worry about being a constant container
 //!!Or maybe Device should have GetDeviceList();
@@ -50,9 +51,13 @@ class USBDeviceHandle
    static BOOL CopyANTDevice(const USBDevice*& pclUSBDeviceCopy_, const USBDevice* pclUSBDeviceOrg_);
    static const ANTDeviceList GetAllDevices(ULONG ulDeviceTypeField_ = 0xFFFFFFFF); //!!copy!
    static const ANTDeviceList GetAvailableDevices(ULONG ulDeviceTypeField_ = 0xFFFFFFFF);  //!!copy!
+   static BOOL FindDevice(USHORT usVid_, USHORT usPid_, UCHAR& ucDeviceNumber_);  //device numbers as in GetAllDevices(), found without copying it
+   static BOOL FindDevice(ULONG ulSerialNumber_, UCHAR& ucDeviceNumber_);
+   static BOOL FindDevice(const char* pcPortPath_, UCHAR& ucDeviceNumber_);       //"1-2.3", the stick in that port whichever it is
 
-   static BOOL Open(const USBDevice& clDevice_, USBDeviceHandle*& pclDeviceHandle_, ULONG ulBaudRate_);
+   static BOOL Open(const USBDevice& clDevice_, USBDeviceHandle*& pclDeviceHandle_, ULONG ulBaudRate_, ANT_STATS* pstStats_ = &stDSIStats);  //counts into *pstStats_
    static BOOL Close(USBDeviceHandle*& pclDeviceHandle_, BOOL bReset_ = FALSE);
+   static BOOL WaitForArrival(ULONG ulMilliseconds_);  //TRUE when an ANT device is plugged in within ulMilliseconds_
 
 
    virtual USBError::Enum Write(void* pvData_, ULONG ulSize_, ULONG& ulBytesWritten_) = 0;  //!!Need timeout?
@@ -69,6 +74,28 @@ class USBDeviceHandle
 
    virtual USBError::Enum Read(void* pvData_, ULONG ulSize_, ULONG& ulBytesRead_, ULONG ulWaitTime_) = 0;
 
+   virtual void CancelRead() {}
+   /////////////////////////////////////////////////////////////////
+   // Wakes a thread waiting in Read(), which from then on returns
+   // without waiting.  For stopping the thread that reads.
+   /////////////////////////////////////////////////////////////////
+
+   virtual BOOL SetReceiveCallback(DSISerialCallback* /*pclCallback_*/) { return FALSE; }
+   /////////////////////////////////////////////////////////////////
+   // Delivers received bytes straight to pclCallback_ from the
+   // handle's own receive context instead of queueing them for Read().
+   // Pass NULL to go back to queued reads.
+   // Returns FALSE if the handle does not support direct delivery.
+   /////////////////////////////////////////////////////////////////
+
+   virtual BOOL SetExternalReceive(BOOL /*bEnable_*/) { return FALSE; }
+   virtual UCHAR GetPollFds(DSI_POLLFD* /*pastFds_*/, UCHAR /*ucMax_*/) { return 0; }
+   virtual void ReceivePoll() {}
+   /////////////////////////////////////////////////////////////////
+   // With a receive callback set, moves the receive loop to an
+   // external event loop and back, see DSISerial.
+   /////////////////////////////////////////////////////////////////
+
    virtual const USBDevice& GetDevice() = 0;
 
   protected:
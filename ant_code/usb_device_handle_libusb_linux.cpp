@@ -15,11 +15,16 @@ All rights reserved.
 #include "macros.h"
 #include "usb_device_list.hpp"
 #include "dsi_debug.hpp"
+#include "dsi_serial.hpp"
 #include "antmessage.h"
+#include "dsi_stats.h"
 
 #include <libusb-1.0/libusb.h>
 
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 using namespace std;
 
@@ -27,8 +32,23 @@ using namespace std;
 // Static declarations
 //////////////////////////////////////////////////////////////////////////////////
 
-USBDeviceList<const USBDeviceLibusb> USBDeviceHandleLibusb::clDeviceList;
 libusb_context* USBDeviceHandleLibusb::ctx = 0;
+BOOL USBDeviceHandleLibusb::bHotplug = FALSE;
+
+static pthread_once_t stHotplugOnce = PTHREAD_ONCE_INIT;
+static volatile ULONG ulArrivals = 0;                   // ANT devices plugged in since the start
+static volatile ULONG ulDeviceChanges = 0;              // ANT devices plugged in or pulled out since the start
+
+//The registry, ANT devices in bus order.  Each is built (and opened for its strings) once
+//when it shows up and deleted when it goes.
+static DSI_MUTEX stMutexRegistry = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<const USBDeviceLibusb*> clRegistry;
+static std::unordered_map<libusb_device*, const USBDeviceLibusb*> clRegistryByRaw;
+static std::unordered_map<ULONG, ULONG> clRegistryByVidPid;          // (VID << 16) | PID
+static std::unordered_map<ULONG, ULONG> clRegistryBySerial;
+static std::unordered_map<std::string, ULONG> clRegistryByPortPath;
+static BOOL bRegistryBuilt = FALSE;
+static ULONG ulRegistryChanges = 0;                     // ulDeviceChanges it was built at
 
 //////////////////////////////////////////////////////////////////////////////////
 // Private Definitions
@@ -55,54 +75,144 @@ BOOL CanOpenDevice(const USBDeviceLibusb*const & pclDevice_)  //!!Should we make
    return USBDeviceHandleLibusb::TryOpen(*pclDevice_);
 }
 
-const USBDeviceListLibusb USBDeviceHandleLibusb::GetAllDevices()  //!!List needs to be deleted!
+//Caller holds stMutexRegistry
+void USBDeviceHandleLibusb::RefreshRegistry()
 {
-   USBDeviceListLibusb clList;
-   USBDeviceListLibusb clFilteredList;
    libusb_device **list;
    ssize_t count;
-   int ret;
-
-   clDeviceList = USBDeviceList<const USBDeviceLibusb>();  //clear device list
 
    //Get a reference to library
    auto_ptr<const LibusbLibrary> pclAutoLibusbLibrary(NULL);
    if(LibusbLibrary::Load(pclAutoLibusbLibrary) == FALSE)
-      return clList;
+      return;
    const LibusbLibrary& clLibusbLibrary = *pclAutoLibusbLibrary;
 
    //Initialize libusb
+   pthread_once(&stHotplugOnce, HotplugInit);
    if(ctx == NULL)
    {
       clLibusbLibrary.Init(&ctx);
    }
 
+   if(bHotplug)
+   {
+      //Deliver hotplug events nobody has handled yet, without waiting for any
+      struct timeval stNoWait = { 0, 0 };
+      clLibusbLibrary.HandleEventsTimeoutCompleted(ctx, &stNoWait, NULL);
+      if(bRegistryBuilt && ulRegistryChanges == ulDeviceChanges)
+         return;
+   }
+   ulRegistryChanges = ulDeviceChanges;  //a change from here on is seen next time
+
    #if defined(_DEBUG) && defined(DEBUG_FILE)
      clLibusbLibrary.SetDebug(ctx, 255);
    #endif
 
    count = clLibusbLibrary.GetDeviceList(ctx, &list);
+   if(count < 0)
+      return;  //keep what we had
 
-   struct libusb_device_node *dev = new libusb_device_node;
+   std::vector<const USBDeviceLibusb*> clPresent;
+   struct libusb_device_node stNode;
 
    for(ssize_t index = 0; index < count; index++)
    {
-      dev->device = list[index];
-      clLibusbLibrary.ReferenceDevice(dev->device);
-      ret = clLibusbLibrary.GetDeviceDescriptor(dev->device, &dev->descriptor);
-      if(ret < 0){break;}
-     clDeviceList.Add( USBDeviceLibusb(*dev) );
-     clList.Add( clDeviceList.GetAddress(clDeviceList.GetSize()-1) );
+      stNode.device = list[index];
+      if(clLibusbLibrary.GetDeviceDescriptor(stNode.device, &stNode.descriptor) < 0)
+         continue;
+
+      //Only ANT devices get opened
+      if(stNode.descriptor.idVendor != USB_ANT_VID && stNode.descriptor.idVendor != USB_ANT_VID_TWO)
+         continue;
+
+      std::unordered_map<libusb_device*, const USBDeviceLibusb*>::iterator clKnown = clRegistryByRaw.find(stNode.device);
+      if(clKnown != clRegistryByRaw.end())
+      {
+         clPresent.push_back(clKnown->second);
+         clRegistryByRaw.erase(clKnown);
+         continue;
+      }
+      clPresent.push_back(new USBDeviceLibusb(stNode));  //holds its own reference
    }
 
-    delete dev;
-   clLibusbLibrary.FreeDeviceList(list, 0); //Free the list, do not unref the devices
+   clLibusbLibrary.FreeDeviceList(list, 1);
+
+   //What is left has been unplugged
+   std::unordered_map<libusb_device*, const USBDeviceLibusb*>::iterator clGone;
+   for(clGone = clRegistryByRaw.begin(); clGone != clRegistryByRaw.end(); clGone++)
+      delete clGone->second;
+
+   clRegistry.swap(clPresent);
+   clRegistryByRaw.clear();
+   clRegistryByVidPid.clear();
+   clRegistryBySerial.clear();
+   clRegistryByPortPath.clear();
+   for(ULONG i = 0; i < clRegistry.size(); i++)
+   {
+      const USBDeviceLibusb* pclDevice = clRegistry[i];
+
+      clRegistryByRaw[&pclDevice->GetRawDevice()] = pclDevice;
+      clRegistryByVidPid.insert(std::make_pair(((ULONG)pclDevice->GetVid() << 16) | pclDevice->GetPid(), i));  //insert() keeps the first
+      if(pclDevice->GetSerialNumber() != 0)
+         clRegistryBySerial.insert(std::make_pair(pclDevice->GetSerialNumber(), i));
+      if(pclDevice->GetPortPath()[0] != '\0')
+         clRegistryByPortPath.insert(std::make_pair(std::string(pclDevice->GetPortPath()), i));
+   }
+   bRegistryBuilt = TRUE;
+}
+
+const USBDeviceListLibusb USBDeviceHandleLibusb::GetAllDevices()
+{
+   USBDeviceListLibusb clList;
+
+   DSIThread_MutexLock(&stMutexRegistry);
+   RefreshRegistry();
+   clList.Add(clRegistry.begin(), clRegistry.end());
+   DSIThread_MutexUnlock(&stMutexRegistry);
+
+   return clList;
+}
+
+BOOL USBDeviceHandleLibusb::FindDevice(USHORT usVid_, USHORT usPid_, ULONG& ulDeviceNumber_)
+{
+   DSIThread_MutexLock(&stMutexRegistry);
+   RefreshRegistry();
+   std::unordered_map<ULONG, ULONG>::const_iterator clFound = clRegistryByVidPid.find(((ULONG)usVid_ << 16) | usPid_);
+   BOOL bFound = (clFound != clRegistryByVidPid.end());
+   if(bFound)
+      ulDeviceNumber_ = clFound->second;
+   DSIThread_MutexUnlock(&stMutexRegistry);
+
+   return bFound;
+}
+
+BOOL USBDeviceHandleLibusb::FindDevice(ULONG ulSerialNumber_, ULONG& ulDeviceNumber_)
+{
+   DSIThread_MutexLock(&stMutexRegistry);
+   RefreshRegistry();
+   std::unordered_map<ULONG, ULONG>::const_iterator clFound = clRegistryBySerial.find(ulSerialNumber_);
+   BOOL bFound = (clFound != clRegistryBySerial.end());
+   if(bFound)
+      ulDeviceNumber_ = clFound->second;
+   DSIThread_MutexUnlock(&stMutexRegistry);
+
+   return bFound;
+}
 
-   //Filter list here so that the returned list only contains
-   // Libusb ANT devices regardless of where GetAllDevices is called from
-   clFilteredList.Add(clList.GetSubList(LibusbDeviceMatch));
+BOOL USBDeviceHandleLibusb::FindDevice(const char* pcPortPath_, ULONG& ulDeviceNumber_)
+{
+   if(pcPortPath_ == NULL)
+      return FALSE;
 
-   return clFilteredList;
+   DSIThread_MutexLock(&stMutexRegistry);
+   RefreshRegistry();
+   std::unordered_map<std::string, ULONG>::const_iterator clFound = clRegistryByPortPath.find(pcPortPath_);
+   BOOL bFound = (clFound != clRegistryByPortPath.end());
+   if(bFound)
+      ulDeviceNumber_ = clFound->second;
+   DSIThread_MutexUnlock(&stMutexRegistry);
+
+   return bFound;
 }
 
 
@@ -113,11 +223,11 @@ const USBDeviceListLibusb USBDeviceHandleLibusb::GetAvailableDevices()  //!!List
 }
 
 
-BOOL USBDeviceHandleLibusb::Open(const USBDeviceLibusb& clDevice_, USBDeviceHandleLibusb*& pclDeviceHandle_)
+BOOL USBDeviceHandleLibusb::Open(const USBDeviceLibusb& clDevice_, USBDeviceHandleLibusb*& pclDeviceHandle_, ANT_STATS* pstStats_)
 {
    try
    {
-      pclDeviceHandle_ = new USBDeviceHandleLibusb(clDevice_);
+      pclDeviceHandle_ = new USBDeviceHandleLibusb(clDevice_, pstStats_);
    }
    catch(...)
    {
@@ -156,6 +266,73 @@ BOOL USBDeviceHandleLibusb::Close(USBDeviceHandleLibusb*& pclDeviceHandle_, BOOL
    return TRUE;
 }
 
+static int LIBUSB_CALL HotplugEvent(libusb_context* /*ctx_*/, libusb_device* /*device_*/, libusb_hotplug_event event_, void* /*pvParameter_*/)
+{
+   if(event_ == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED)
+      __sync_fetch_and_add(&ulArrivals, 1);
+   __sync_fetch_and_add(&ulDeviceChanges, 1);
+   return 0;   //stay registered
+}
+
+//Once per process, the callbacks stay registered until libusb goes away
+void USBDeviceHandleLibusb::HotplugInit()
+{
+   const USHORT ausVid[] = { USB_ANT_VID, USB_ANT_VID_TWO };
+
+   auto_ptr<const LibusbLibrary> pclAutoLibusbLibrary(NULL);
+   if(LibusbLibrary::Load(pclAutoLibusbLibrary) == FALSE)
+      return;
+   const LibusbLibrary& clLibusbLibrary = *pclAutoLibusbLibrary;
+
+   if(ctx == NULL)
+   {
+      clLibusbLibrary.Init(&ctx);
+   }
+
+   if(clLibusbLibrary.HasCapability(LIBUSB_CAP_HAS_HOTPLUG) == 0)
+      return;
+
+   bHotplug = TRUE;
+   for(UCHAR i = 0; i < sizeof(ausVid) / sizeof(ausVid[0]); i++)
+   {
+      if(clLibusbLibrary.HotplugRegisterCallback(ctx, LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT, 0, ausVid[i],
+            LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY, HotplugEvent, NULL, NULL) != LIBUSB_SUCCESS)
+         bHotplug = FALSE;
+   }
+}
+
+//Runs libusb's event handling until an ANT device arrives, without hotplug support it just sleeps
+BOOL USBDeviceHandleLibusb::WaitForArrival(ULONG ulMilliseconds_)
+{
+   pthread_once(&stHotplugOnce, HotplugInit);
+   if(!bHotplug)
+   {
+      DSIThread_Sleep(ulMilliseconds_);
+      return FALSE;
+   }
+
+   auto_ptr<const LibusbLibrary> pclAutoLibusbLibrary(NULL);
+   if(LibusbLibrary::Load(pclAutoLibusbLibrary) == FALSE)
+      return FALSE;
+   const LibusbLibrary& clLibusbLibrary = *pclAutoLibusbLibrary;
+
+   ULONG ulSeen = ulArrivals;
+   ULONG ulStart = DSIThread_GetSystemTime();
+   ULONG ulElapsed;
+   while((ulElapsed = DSIThread_GetSystemTime() - ulStart) < ulMilliseconds_)
+   {
+      struct timeval stTimeout;
+      ULONG ulLeft = ulMilliseconds_ - ulElapsed;
+
+      stTimeout.tv_sec = ulLeft / 1000;
+      stTimeout.tv_usec = (ulLeft % 1000) * 1000;
+      clLibusbLibrary.HandleEventsTimeoutCompleted(ctx, &stTimeout, NULL);
+      if(ulArrivals != ulSeen)
+         return TRUE;
+   }
+   return FALSE;
+}
+
 //A more efficient way to test if you can open a device.  For instance, this function won't create a receive loop, etc.)
 BOOL USBDeviceHandleLibusb::TryOpen(const USBDeviceLibusb& clDevice_)
 {
@@ -221,7 +398,7 @@ BOOL USBDeviceHandleLibusb::TryOpen(const USBDeviceLibusb& clDevice_)
 // Constructor
 ///////////////////////////////////////////////////////////////////////
 
-USBDeviceHandleLibusb::USBDeviceHandleLibusb(const USBDeviceLibusb& clDevice_)
+USBDeviceHandleLibusb::USBDeviceHandleLibusb(const USBDeviceLibusb& clDevice_, ANT_STATS* pstStats_)
 try
 :
    USBDeviceHandle(),
@@ -231,6 +408,14 @@ try
    hReceiveThread = NULL;
    bStopReceiveThread = TRUE;
    device_handle = NULL;
+   pclReceiveCallback = (DSISerialCallback*)NULL;
+   pstWriteTransfer = (struct libusb_transfer*)NULL;
+   pstReceiveTransfer = (struct libusb_transfer*)NULL;
+   bExternalReceive = FALSE;
+   pstStats = pstStats_;  //before POpen() starts the receive thread
+
+   if(DSIThread_MutexInit(&stMutexWrite) != DSI_THREAD_ENONE)
+      throw 0; //!!We need something to throw
 
    if(ctx == NULL)
    {
@@ -253,6 +438,7 @@ catch(...)
 USBDeviceHandleLibusb::~USBDeviceHandleLibusb()
 {
    //!!Delete all the elements in the clOverflowQueue!
+   DSIThread_MutexDestroy(&stMutexWrite);
 }
 
 
@@ -310,9 +496,13 @@ BOOL USBDeviceHandleLibusb::POpen()
       return FALSE;
    }
 
-   bStopReceiveThread = FALSE;
-   hReceiveThread = DSIThread_CreateThread(&USBDeviceHandleLibusb::ProcessThread, this);
-   if (hReceiveThread == NULL)
+   pstReceiveTransfer = (struct libusb_transfer*)NULL;
+   iReceiveCompleted = 0;
+   iConsecIoErrors = 0;
+   ulRxOverruns = 0;
+   bSubmitTransfer = TRUE;
+   bExternalReceive = FALSE;
+   if(!StartReceiveThread())
    {
       DSIThread_CondDestroy(&stEventReceiveThreadExit);
       DSIThread_MutexDestroy(&stMutexCriticalSection);
@@ -323,6 +513,41 @@ BOOL USBDeviceHandleLibusb::POpen()
    return TRUE;
 }
 
+///////////////////////////////////////////////////////////////////////
+BOOL USBDeviceHandleLibusb::StartReceiveThread()
+{
+   bStopReceiveThread = FALSE;
+   hReceiveThread = DSIThread_CreateThread(&USBDeviceHandleLibusb::ProcessThread, this);
+   if(hReceiveThread == NULL)
+   {
+      bStopReceiveThread = TRUE;
+      return FALSE;
+   }
+   return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+void USBDeviceHandleLibusb::StopReceiveThread()
+{
+   DSIThread_MutexLock(&stMutexCriticalSection);
+   if(bStopReceiveThread == FALSE)
+   {
+      bStopReceiveThread = TRUE;
+      if(clLibusbLibrary.InterruptEventHandler != NULL)
+         clLibusbLibrary.InterruptEventHandler(NULL);  //Out of the event wait now rather than at its timeout
+
+      if (DSIThread_CondTimedWait(&stEventReceiveThreadExit, &stMutexCriticalSection, 3000) != DSI_THREAD_ENONE)
+      {
+         // We were unable to stop the thread normally.
+         DSIThread_DestroyThread(hReceiveThread);
+      }
+   }
+   DSIThread_MutexUnlock(&stMutexCriticalSection);
+
+   DSIThread_ReleaseThreadID(hReceiveThread);
+   hReceiveThread = NULL;
+}
+
 
 ///////////////////////////////////////////////////////////////////////
 // Closes the USB connection, kills receive thread.
@@ -332,28 +557,26 @@ void USBDeviceHandleLibusb::PClose(BOOL bReset_)
 
    bDeviceGone = TRUE;
 
-   if (hReceiveThread)
+   if (hReceiveThread || bExternalReceive)
    {
-      DSIThread_MutexLock(&stMutexCriticalSection);
-      if(bStopReceiveThread == FALSE)
-      {
-         bStopReceiveThread = TRUE;
-
-         if (DSIThread_CondTimedWait(&stEventReceiveThreadExit, &stMutexCriticalSection, 3000) != DSI_THREAD_ENONE)
-         {
-            // We were unable to stop the thread normally.
-            DSIThread_DestroyThread(hReceiveThread);
-         }
-      }
-      DSIThread_MutexUnlock(&stMutexCriticalSection);
-
-      DSIThread_ReleaseThreadID(hReceiveThread);
-      hReceiveThread = NULL;
+      if(hReceiveThread)
+         StopReceiveThread();
+      else
+         ReceiveEnd();  //the event loop leaves a transfer in flight
+      bExternalReceive = FALSE;
 
       DSIThread_MutexDestroy(&stMutexCriticalSection);
       DSIThread_CondDestroy(&stEventReceiveThreadExit);
    }
 
+    DSIThread_MutexLock(&stMutexWrite);
+    if(pstWriteTransfer != NULL)
+    {
+      clLibusbLibrary.FreeTransfer(pstWriteTransfer);
+      pstWriteTransfer = (struct libusb_transfer*)NULL;
+    }
+    DSIThread_MutexUnlock(&stMutexWrite);
+
     if(device_handle != (libusb_device_handle*)NULL)
     {
 
@@ -388,7 +611,8 @@ static void LIBUSB_CALL Callback(struct libusb_transfer *transfer)
     *completed = 1;
 }
 ///////////////////////////////////////////////////////////////////////
-// Writes usSize_ bytes to USB, returns TRUE if successful.
+// Writes usSize_ bytes to USB, returns TRUE if successful.  The
+// transfer is reused, a write only allocates the first time.
 ///////////////////////////////////////////////////////////////////////
 //!!Return true if we wrote half the bytes successfully?
 USBError::Enum USBDeviceHandleLibusb::Write(void* pvData_, ULONG ulSize_, ULONG& ulBytesWritten_)
@@ -406,31 +630,45 @@ USBError::Enum USBDeviceHandleLibusb::Write(void* pvData_, ULONG ulSize_, ULONG&
 
     int iRet = 0;
     int iCompleted = 0;
-    struct libusb_transfer *asyncTransfer;
     struct timeval tvHandleEventsTimeout;
     tvHandleEventsTimeout.tv_sec = 3;
     tvHandleEventsTimeout.tv_usec = 0;
 
-    asyncTransfer = clLibusbLibrary.AllocTransfer(0);
-    clLibusbLibrary.FillBulkTransfer(asyncTransfer, device_handle, USB_ANT_EP_OUT, (UCHAR*)pvData_, (int)ulSize_, Callback, &iCompleted, 3000);
-    asyncTransfer->type = LIBUSB_TRANSFER_TYPE_BULK;
-    iRet = clLibusbLibrary.SubmitTransfer(asyncTransfer);
+    DSIThread_MutexLock(&stMutexWrite);
+
+    if(pstWriteTransfer == NULL)
+        pstWriteTransfer = clLibusbLibrary.AllocTransfer(0);
+    if(pstWriteTransfer == NULL)
+    {
+        DSIThread_MutexUnlock(&stMutexWrite);
+        return USBError::FAILED;
+    }
+
+    clLibusbLibrary.FillBulkTransfer(pstWriteTransfer, device_handle, USB_ANT_EP_OUT, (UCHAR*)pvData_, (int)ulSize_, Callback, &iCompleted, 3000);
+    pstWriteTransfer->type = LIBUSB_TRANSFER_TYPE_BULK;
+    iRet = clLibusbLibrary.SubmitTransfer(pstWriteTransfer);
     if(iRet < 0)
     {
-        clLibusbLibrary.FreeTransfer(asyncTransfer);
+        DSIThread_MutexUnlock(&stMutexWrite);
+        DSI_STATS_INC(pstStats, ulUSBWriteErrors);
         return USBError::FAILED;
     }
 
     while(!iCompleted)
         clLibusbLibrary.HandleEventsTimeoutCompleted(NULL, &tvHandleEventsTimeout, &iCompleted);
 
-    if(asyncTransfer->status != LIBUSB_TRANSFER_COMPLETED)
+    if(pstWriteTransfer->status != LIBUSB_TRANSFER_COMPLETED)
     {
+        DSIThread_MutexUnlock(&stMutexWrite);
+        DSI_STATS_INC(pstStats, ulUSBWriteErrors);
         return USBError::FAILED;
     }
 
-    ulBytesWritten_ = asyncTransfer->actual_length;
+    ulBytesWritten_ = pstWriteTransfer->actual_length;
+    DSI_STATS_INC(pstStats, ulUSBTransfersOut);
+    DSI_STATS_ADD(pstStats, ulUSBBytesOut, ulBytesWritten_);
 
+    DSIThread_MutexUnlock(&stMutexWrite);
     return USBError::NONE;
 }
 
@@ -444,98 +682,237 @@ USBError::Enum USBDeviceHandleLibusb::Read(void* pvData_, ULONG ulSize_, ULONG&
     return USBError::NONE;
 }
 
-void USBDeviceHandleLibusb::ReceiveThread()
+///////////////////////////////////////////////////////////////////////
+void USBDeviceHandleLibusb::CancelRead()
 {
-    #if defined(DEBUG_FILE)
-    BOOL bRxDebug = DSIDebug::ThreadInit("ao_libusb_receive");
-    DSIDebug::ThreadEnable(TRUE);
-    #endif
+    clRxQueue.Release();
+}
 
-    int iRet = 0;
-    int iConsecIoErrors = 0;
-    int iCompleted = 0;
-    BOOL bSubmitTransfer = TRUE;
-    BOOL bReallocTransfer = TRUE;
-    UCHAR aucData[4096];
-    struct libusb_transfer *asyncTransfer;
-    struct timeval tvHandleEventsTimeout;
-    tvHandleEventsTimeout.tv_sec = 1;
-    tvHandleEventsTimeout.tv_usec = 0;
+///////////////////////////////////////////////////////////////////////
+// Hands completed IN transfers to pclCallback_ on the receive thread.
+///////////////////////////////////////////////////////////////////////
+BOOL USBDeviceHandleLibusb::SetReceiveCallback(DSISerialCallback* pclCallback_)
+{
+    pclReceiveCallback = pclCallback_;
+    return TRUE;
+}
 
-    while(!bStopReceiveThread)
+///////////////////////////////////////////////////////////////////////
+// The external event loop takes over the transfer in flight, if the
+// thread stopped between two there is one submitted for it.
+///////////////////////////////////////////////////////////////////////
+BOOL USBDeviceHandleLibusb::SetExternalReceive(BOOL bEnable_)
+{
+    if(pclReceiveCallback == NULL)
+        return FALSE;
+
+    if(bEnable_)
+    {
+        if(bExternalReceive)
+            return TRUE;
+        if(hReceiveThread == NULL)
+            return FALSE;
+
+        bExternalReceive = TRUE;
+        StopReceiveThread();
+        ReceivePoll();
+        return TRUE;
+    }
+
+    if(!bExternalReceive)
+        return TRUE;
+    if(bDeviceGone)
+        return FALSE;  //nothing left to receive from
+
+    bExternalReceive = FALSE;
+    return StartReceiveThread();
+}
+
+///////////////////////////////////////////////////////////////////////
+// All of libusb's descriptors, they cover the IN transfer along with
+// everything else in flight.
+///////////////////////////////////////////////////////////////////////
+UCHAR USBDeviceHandleLibusb::GetPollFds(DSI_POLLFD* pastFds_, UCHAR ucMax_)
+{
+    UCHAR ucCount = 0;
+    const struct libusb_pollfd** ppstFds = clLibusbLibrary.GetPollfds(NULL);
+
+    if(ppstFds == NULL)
+        return 0;
+
+    while(ucCount < ucMax_ && ppstFds[ucCount] != NULL)
     {
-        if(bSubmitTransfer)
+        pastFds_[ucCount].iFd = ppstFds[ucCount]->fd;
+        pastFds_[ucCount].sEvents = ppstFds[ucCount]->events;
+        ucCount++;
+    }
+    clLibusbLibrary.FreePollfds(ppstFds);
+    return ucCount;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Handles every completion that is in, resubmitting as it goes, so a
+// transfer is in flight again when it returns.
+///////////////////////////////////////////////////////////////////////
+void USBDeviceHandleLibusb::ReceivePoll()
+{
+    struct timeval tvNoWait = { 0, 0 };
+    BOOL bReceived;
+
+    if(!bExternalReceive)
+        return;
+
+    do
+    {
+        if(bDeviceGone)
+            return;
+        if(!ReceiveStep(&tvNoWait, bReceived))
         {
-            bSubmitTransfer = FALSE;
-            if(bReallocTransfer)
+            ReceiveEnd();
+            return;
+        }
+    } while(bReceived || bSubmitTransfer);
+}
+
+///////////////////////////////////////////////////////////////////////
+// One turn of the receive loop: submits the IN transfer if it is not
+// in flight, waits up to ptvTimeout_ for it and hands over what it
+// brought.  Returns FALSE once the device can't be read any more.
+///////////////////////////////////////////////////////////////////////
+BOOL USBDeviceHandleLibusb::ReceiveStep(struct timeval* ptvTimeout_, BOOL& bReceived_)
+{
+    bReceived_ = FALSE;
+    if(bSubmitTransfer)
+    {
+        bSubmitTransfer = FALSE;
+        if(pstReceiveTransfer == NULL)
+        {
+            pstReceiveTransfer = clLibusbLibrary.AllocTransfer(0);
+            if(pstReceiveTransfer == NULL)
+                return FALSE;
+            clLibusbLibrary.FillBulkTransfer(pstReceiveTransfer, device_handle, USB_ANT_EP_IN, aucReceiveData, sizeof(aucReceiveData), Callback, &iReceiveCompleted, 0);
+            pstReceiveTransfer->type = LIBUSB_TRANSFER_TYPE_BULK;
+        }
+        iReceiveCompleted = 0;
+        if(clLibusbLibrary.SubmitTransfer(pstReceiveTransfer) < 0)
+        {
+            clLibusbLibrary.FreeTransfer(pstReceiveTransfer);
+            pstReceiveTransfer = (struct libusb_transfer*)NULL;
+            return FALSE;
+        }
+    }
+
+    clLibusbLibrary.HandleEventsTimeoutCompleted(NULL, ptvTimeout_, &iReceiveCompleted);
+    if(!iReceiveCompleted)
+        return TRUE;
+
+    switch(pstReceiveTransfer->status)
+    {
+        case LIBUSB_TRANSFER_COMPLETED:
+        {
+            DSI_STATS_INC(pstStats, ulUSBTransfersIn);
+            DSI_STATS_ADD(pstStats, ulUSBBytesIn, pstReceiveTransfer->actual_length);
+
+            DSISerialCallback* pclCallback = pclReceiveCallback;
+            if(pclCallback)
+            {
+                pclCallback->ProcessBytes(aucReceiveData, pstReceiveTransfer->actual_length);
+            }
+            else
             {
-                asyncTransfer = clLibusbLibrary.AllocTransfer(0);
-                clLibusbLibrary.FillBulkTransfer(asyncTransfer, device_handle, USB_ANT_EP_IN, aucData, sizeof(aucData), Callback, &iCompleted, 0);
-                asyncTransfer->type = LIBUSB_TRANSFER_TYPE_BULK;
-                bReallocTransfer = FALSE;
+                clRxQueue.PushArray(aucReceiveData, pstReceiveTransfer->actual_length);
+                DSI_STATS_MAX(pstStats, ulUSBRxQueueHighWater, clRxQueue.GetHighWater());
+                DSI_STATS_ADD(pstStats, ulUSBRxQueueOverruns, clRxQueue.GetOverruns() - ulRxOverruns);
+                ulRxOverruns = clRxQueue.GetOverruns();
             }
-            iRet = clLibusbLibrary.SubmitTransfer(asyncTransfer);
-            iCompleted = 0;
-            if(iRet < 0)
+            bReceived_ = TRUE;
+            bSubmitTransfer = TRUE;
+            iConsecIoErrors = 0;
+            #if defined(_DEBUG) && defined(DEBUG_FILE)
             {
-                clLibusbLibrary.FreeTransfer(asyncTransfer);
-                bStopReceiveThread = TRUE;
-                return;
+                char acMesg[255];
+                SNPRINTF(acMesg, 255, "ReceiveThread(): %d Bytes Read From USB", pstReceiveTransfer->actual_length);
+                DSIDebug::ThreadWrite(acMesg);
             }
+            #endif
+            break;
         }
+        default:
+            DSI_STATS_INC(pstStats, ulUSBReadErrors);
+            #if defined(_DEBUG) && defined(DEBUG_FILE)
+            {
+                char acMesg2[255];
+                SNPRINTF(acMesg2, 255, "ReceiveThread(): Transfer Unsuccessful - Error %d", pstReceiveTransfer->status);
+                DSIDebug::ThreadWrite(acMesg2);
+            }
+            #endif
+            clLibusbLibrary.FreeTransfer(pstReceiveTransfer);
+            pstReceiveTransfer = (struct libusb_transfer*)NULL;
+            if(iConsecIoErrors == 10)
+                return FALSE;
+            iConsecIoErrors++;
+            DSI_STATS_INC(pstStats, ulUSBTransferRetries);
+            bSubmitTransfer = TRUE;
+            break;
+    }
+    return TRUE;
+}
 
-        clLibusbLibrary.HandleEventsTimeoutCompleted(NULL, &tvHandleEventsTimeout, &iCompleted);
+///////////////////////////////////////////////////////////////////////
+// Cancels the IN transfer and, unless PClose() is the reason, tells
+// the direct receiver the device is gone.
+///////////////////////////////////////////////////////////////////////
+void USBDeviceHandleLibusb::ReceiveEnd()
+{
+    struct timeval tvHandleEventsTimeout;
+    tvHandleEventsTimeout.tv_sec = 1;
+    tvHandleEventsTimeout.tv_usec = 0;
 
-        if(iCompleted)
+    if(pstReceiveTransfer != NULL)
+    {
+        if(!iReceiveCompleted)
         {
-            switch(asyncTransfer->status)
-            {
-                case LIBUSB_TRANSFER_COMPLETED:
-                    clRxQueue.PushArray(aucData, asyncTransfer->actual_length);
-                    bSubmitTransfer = TRUE;
-                    iConsecIoErrors = 0;
-                    #if defined(_DEBUG) && defined(DEBUG_FILE)
-                    if(bRxDebug)
-                    {
-                        char acMesg[255];
-                        SNPRINTF(acMesg, 255, "ReceiveThread(): %d Bytes Read From USB", asyncTransfer->actual_length);
-                        DSIDebug::ThreadWrite(acMesg);
-                    }
-                    #endif
-                    break;
-                default:
-                    clLibusbLibrary.FreeTransfer(asyncTransfer);
-                    if(iConsecIoErrors == 10)
-                    {
-                        bStopReceiveThread = TRUE;
-                        break;
-                    }
-                    iConsecIoErrors++;
-                    bReallocTransfer = TRUE;
-                    bSubmitTransfer = TRUE;
-                    #if defined(_DEBUG) && defined(DEBUG_FILE)
-                    if(bRxDebug)
-                    {
-                        char acMesg2[255];
-                        SNPRINTF(acMesg2, 255, "ReceiveThread(): Transfer Unsuccessful - Error %d", asyncTransfer->status);
-                        DSIDebug::ThreadWrite(acMesg2);
-                    }
-                    #endif
-                    break;
-            }
+            clLibusbLibrary.CancelTransfer(pstReceiveTransfer);
+            while(!iReceiveCompleted)
+                clLibusbLibrary.HandleEventsTimeoutCompleted(NULL, &tvHandleEventsTimeout, &iReceiveCompleted);
         }
+        clLibusbLibrary.FreeTransfer(pstReceiveTransfer);
+        pstReceiveTransfer = (struct libusb_transfer*)NULL;
     }
 
-    if(!iCompleted)
+    //PClose() marks the device gone before stopping us, so anything else is a lost device the direct receiver must hear about
+    if(pclReceiveCallback && !bDeviceGone)
+        pclReceiveCallback->Error(DSI_SERIAL_DEVICE_GONE);
+
+    bDeviceGone = TRUE;  //The read loop is dead, since we can't get any info, the device might as well be gone
+}
+
+///////////////////////////////////////////////////////////////////////
+void USBDeviceHandleLibusb::ReceiveThread()
+{
+    #if defined(DEBUG_FILE)
+    DSIDebug::ThreadInit("ao_libusb_receive");
+    DSIDebug::ThreadEnable(TRUE);
+    #endif
+
+    BOOL bFailed = FALSE;
+    BOOL bReceived;
+    struct timeval tvHandleEventsTimeout;
+    tvHandleEventsTimeout.tv_sec = 1;
+    tvHandleEventsTimeout.tv_usec = 0;
+
+    while(!bStopReceiveThread)
     {
-        clLibusbLibrary.CancelTransfer(asyncTransfer);
-        while(!iCompleted)
-            clLibusbLibrary.HandleEventsTimeoutCompleted(NULL, &tvHandleEventsTimeout, &iCompleted);
-        clLibusbLibrary.FreeTransfer(asyncTransfer);
-        asyncTransfer = NULL;
+        if(!ReceiveStep(&tvHandleEventsTimeout, bReceived))
+        {
+            bFailed = TRUE;
+            break;
+        }
     }
 
-    bDeviceGone = TRUE;  //The read loop is dead, since we can't get any info, the device might as well be gone
+    //Handed over to ReceivePoll(), the transfer in flight goes with it
+    if(bFailed || !bExternalReceive)
+        ReceiveEnd();
 
     DSIThread_MutexLock(&stMutexCriticalSection);
     bStopReceiveThread = TRUE;
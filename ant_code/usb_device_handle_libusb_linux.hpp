@@ -70,34 +70,72 @@ class USBDeviceHandleLibusb : public USBDeviceHandle
 
    BOOL bDeviceGone;
 
+   DSI_MUTEX stMutexWrite;                               // Writes can come from any thread, they share one transfer.
+   struct libusb_transfer* pstWriteTransfer;             // Allocated by the first write, freed on close.
+
+   DSISerialCallback* volatile pclReceiveCallback;       // When set, received bytes bypass clRxQueue.
+
+   // The IN transfer, kept across a hand over between the receive thread and an external event loop
+   struct libusb_transfer* pstReceiveTransfer;
+   UCHAR aucReceiveData[4096];
+   int iReceiveCompleted;
+   int iConsecIoErrors;
+   ULONG ulRxOverruns;
+   BOOL bSubmitTransfer;
+   BOOL bExternalReceive;                                // ReceivePoll() runs the receive loop, not the thread
+   ANT_STATS* pstStats;                                  // The stick's counters
+
    BOOL POpen();
    void PClose(BOOL bReset_ = FALSE);
+   BOOL StartReceiveThread();
+   void StopReceiveThread();
+   BOOL ReceiveStep(struct timeval* ptvTimeout_, BOOL& bReceived_);
+   void ReceiveEnd();
    void ReceiveThread();
    static DSI_THREAD_RETURN ProcessThread(void* pvParameter_);
 
-   static USBDeviceList<const USBDeviceLibusb> clDeviceList;  //This holds only instances of USBDeviceLibusb (unless someone manually makes their own)
    static libusb_context* ctx;
+   static BOOL bHotplug;                                 // libusb reports ANT devices arriving and leaving
+   static void HotplugInit();
+   static void RefreshRegistry();
 
    //!!Const-correctness!
   public:
 
-   static const USBDeviceListLibusb GetAllDevices();  //!!have static list?
+   static const USBDeviceListLibusb GetAllDevices();
    static const USBDeviceListLibusb GetAvailableDevices();
-
-   static BOOL Open(const USBDeviceLibusb& clDevice_, USBDeviceHandleLibusb*& pclDeviceHandle_);  //should these be member functions?
+   static BOOL FindDevice(USHORT usVid_, USHORT usPid_, ULONG& ulDeviceNumber_);
+   static BOOL FindDevice(ULONG ulSerialNumber_, ULONG& ulDeviceNumber_);
+   static BOOL FindDevice(const char* pcPortPath_, ULONG& ulDeviceNumber_);
+   /////////////////////////////////////////////////////////////////
+   // ANT devices come from a registry that is only enumerated again
+   // after libusb reports one arriving or leaving (on every call if
+   // libusb has no hotplug).  A device stays the same instance, at
+   // the same address, for as long as it is plugged in.
+   // FindDevice() gives the index GetAllDevices() would have it at,
+   // the first if there are more with that VID/PID.
+   /////////////////////////////////////////////////////////////////
+
+   static BOOL Open(const USBDeviceLibusb& clDevice_, USBDeviceHandleLibusb*& pclDeviceHandle_, ANT_STATS* pstStats_ = &stDSIStats);  //should these be member functions?
    static BOOL Close(USBDeviceHandleLibusb*& pclDeviceHandle_, BOOL bReset_ = FALSE);
    static BOOL TryOpen(const USBDeviceLibusb& clDevice_);
+   static BOOL WaitForArrival(ULONG ulMilliseconds_);
 
    //USBDeviceHandle Base Class//
 
    USBError::Enum Write(void* pvData_, ULONG ulSize_, ULONG& ulBytesWritten_);
    USBError::Enum Read(void* pvData_, ULONG ulSize_, ULONG& ulBytesRead_, ULONG ulWaitTime_);
+   void CancelRead();
+   BOOL SetReceiveCallback(DSISerialCallback* pclCallback_);
+   BOOL SetExternalReceive(BOOL bEnable_);
+   UCHAR GetPollFds(DSI_POLLFD* pastFds_, UCHAR ucMax_);
+   void ReceivePoll();
 
    const USBDevice& GetDevice() { return clDevice; }
 
   protected:
 
-   USBDeviceHandleLibusb(const USBDeviceLibusb& clDevice_);
+   USBDeviceHandleLibusb(const USBDeviceLibusb& clDevice_, ANT_STATS* pstStats_);
    virtual ~USBDeviceHandleLibusb();
 
    const USBDeviceHandleLibusb& operator=(const USBDeviceHandleLibusb& clDevicehandle_) { return clDevicehandle_; }  //!!NOP
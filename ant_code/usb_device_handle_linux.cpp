@@ -105,8 +105,41 @@ const ANTDeviceList USBDeviceHandle::GetAvailableDevices(ULONG ulDeviceTypeField
 }
 
 
+//Only libusb devices have a registry, and those are all there is on Linux
+static BOOL DeviceNumber(BOOL bFound_, ULONG ulDeviceNumber_, UCHAR& ucDeviceNumber_)
+{
+   if(!bFound_ || ulDeviceNumber_ >= MAX_UCHAR)  //0xFF is no device
+      return FALSE;
+
+   ucDeviceNumber_ = (UCHAR)ulDeviceNumber_;
+   return TRUE;
+}
+
+BOOL USBDeviceHandle::FindDevice(USHORT usVid_, USHORT usPid_, UCHAR& ucDeviceNumber_)
+{
+   ULONG ulDeviceNumber = 0;
+   return DeviceNumber(USBDeviceHandleLibusb::FindDevice(usVid_, usPid_, ulDeviceNumber), ulDeviceNumber, ucDeviceNumber_);
+}
+
+BOOL USBDeviceHandle::FindDevice(ULONG ulSerialNumber_, UCHAR& ucDeviceNumber_)
+{
+   ULONG ulDeviceNumber = 0;
+   return DeviceNumber(USBDeviceHandleLibusb::FindDevice(ulSerialNumber_, ulDeviceNumber), ulDeviceNumber, ucDeviceNumber_);
+}
+
+BOOL USBDeviceHandle::FindDevice(const char* pcPortPath_, UCHAR& ucDeviceNumber_)
+{
+   ULONG ulDeviceNumber = 0;
+   return DeviceNumber(USBDeviceHandleLibusb::FindDevice(pcPortPath_, ulDeviceNumber), ulDeviceNumber, ucDeviceNumber_);
+}
+
+BOOL USBDeviceHandle::WaitForArrival(ULONG ulMilliseconds_)
+{
+   return USBDeviceHandleLibusb::WaitForArrival(ulMilliseconds_);
+}
+
 //!!Polymorphism would be easier to implement!
-BOOL USBDeviceHandle::Open(const USBDevice& clDevice_, USBDeviceHandle*& pclDeviceHandle_, ULONG ulBaudRate_)
+BOOL USBDeviceHandle::Open(const USBDevice& clDevice_, USBDeviceHandle*& pclDeviceHandle_, ULONG ulBaudRate_, ANT_STATS* pstStats_)
 {
    //dynamic_cast does not handle *& types
 
@@ -130,7 +163,7 @@ BOOL USBDeviceHandle::Open(const USBDevice& clDevice_, USBDeviceHandle*& pclDevi
          const USBDeviceLibusb& clDeviceLibusb = dynamic_cast<const USBDeviceLibusb&>(clDevice_);
 
          USBDeviceHandleLibusb* pclDeviceHandleLibusb;
-         bSuccess = USBDeviceHandleLibusb::Open(clDeviceLibusb, pclDeviceHandleLibusb);
+         bSuccess = USBDeviceHandleLibusb::Open(clDeviceLibusb, pclDeviceHandleLibusb, pstStats_);
 
          //pclDeviceHandle_ = dynamic_cast<USBDeviceHandle*>(pclDeviceHandleLibusb);
          pclDeviceHandle_ = pclDeviceHandleLibusb;
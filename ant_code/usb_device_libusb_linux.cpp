@@ -25,6 +25,21 @@ All rights reserved.
 using namespace std;
 
 
+static void Reference(struct libusb_device* pstDevice_)
+{
+   auto_ptr<const LibusbLibrary> pclAutoLibusbLibrary(NULL);
+   if(pstDevice_ != NULL && LibusbLibrary::Load(pclAutoLibusbLibrary) == TRUE)
+      pclAutoLibusbLibrary->ReferenceDevice(pstDevice_);
+}
+
+static void Unreference(struct libusb_device* pstDevice_)
+{
+   auto_ptr<const LibusbLibrary> pclAutoLibusbLibrary(NULL);
+   if(pstDevice_ != NULL && LibusbLibrary::Load(pclAutoLibusbLibrary) == TRUE)
+      pclAutoLibusbLibrary->UnreferenceDevice(pstDevice_);
+}
+
+
 USBDeviceLibusb::USBDeviceLibusb(struct libusb_device_node& stDevice_)
 :
    pstDevice(stDevice_.device),
@@ -35,6 +50,7 @@ USBDeviceLibusb::USBDeviceLibusb(struct libusb_device_node& stDevice_)
 
    szProductDescription[0] = '\0';
    szSerialString[0] = '\0';
+   szPortPath[0] = '\0';
 
    //Get a reference to library
    auto_ptr<const LibusbLibrary> pclAutoLibusbLibrary(NULL);
@@ -42,6 +58,18 @@ USBDeviceLibusb::USBDeviceLibusb(struct libusb_device_node& stDevice_)
       return;
    const LibusbLibrary& clLibusbLibrary = *pclAutoLibusbLibrary;
 
+   clLibusbLibrary.ReferenceDevice(pstDevice);
+
+   //The port path doesn't need the device opened
+   UCHAR aucPorts[7];
+   int iPorts = clLibusbLibrary.GetPortNumbers(stDevice_.device, aucPorts, sizeof(aucPorts));
+   if(iPorts > 0)
+   {
+      int iLength = SNPRINTF(szPortPath, sizeof(szPortPath), "%u-%u", clLibusbLibrary.GetBusNumber(stDevice_.device), aucPorts[0]);
+      for(int i = 1; i < iPorts; i++)
+         iLength += SNPRINTF(&szPortPath[iLength], sizeof(szPortPath) - iLength, ".%u", aucPorts[i]);
+   }
+
    libusb_device_handle *pstTempDeviceHandle;
    int ret = clLibusbLibrary.Open(stDevice_.device, &pstTempDeviceHandle);  //We can open the device to get the info even if someone else is using it, so this is okay.
    if(ret < 0)
@@ -78,6 +106,14 @@ USBDeviceLibusb::USBDeviceLibusb(const USBDeviceLibusb& clDevice_)
 {
    STRNCPY((char*)szProductDescription, (char*)clDevice_.szProductDescription, sizeof(szProductDescription));
    memcpy(szSerialString, clDevice_.szSerialString, sizeof(szSerialString));
+   memcpy(szPortPath, clDevice_.szPortPath, sizeof(szPortPath));
+   Reference(pstDevice);
+   return;
+}
+
+USBDeviceLibusb::~USBDeviceLibusb()
+{
+   Unreference(pstDevice);
    return;
 }
 
@@ -87,12 +123,15 @@ USBDeviceLibusb& USBDeviceLibusb::operator=(const USBDeviceLibusb& clDevice_)
    if(this == &clDevice_)
       return *this;
 
+   Reference(clDevice_.pstDevice);
+   Unreference(pstDevice);
    pstDevice = clDevice_.pstDevice;
    usVid = clDevice_.usVid;
    usPid = clDevice_.usPid;
    ulSerialNumber = clDevice_.ulSerialNumber;
    STRNCPY((char*)szProductDescription, (char*)clDevice_.szProductDescription, sizeof(szProductDescription));
    memcpy(szSerialString, clDevice_.szSerialString, sizeof(szSerialString));
+   memcpy(szPortPath, clDevice_.szPortPath, sizeof(szPortPath));
 
    return *this;
 }
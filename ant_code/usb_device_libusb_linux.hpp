@@ -18,6 +18,7 @@ All rights reserved.
 //////////////////////////////////////////////////////////////////////////////////
 // Public Definitions
 //////////////////////////////////////////////////////////////////////////////////
+#define USB_MAX_PORT_PATH 32     // "bus-port.port...", seven hub levels at most
 
 
 //!!What happens if we release the list we got this device from?
@@ -26,6 +27,7 @@ class USBDeviceLibusb : public USBDevice
   public:
    USBDeviceLibusb(struct libusb_device_node& stDevice_);
    USBDeviceLibusb(const USBDeviceLibusb& clDevice_);
+   virtual ~USBDeviceLibusb();
 
    USBDeviceLibusb& operator=(const USBDeviceLibusb& clDevice_);
 
@@ -43,6 +45,7 @@ class USBDeviceLibusb : public USBDevice
    ULONG GetSerialNumber() const { return ulSerialNumber; }
    BOOL GetProductDescription(UCHAR* pucProductDescription_, USHORT usBufferSize_) const; //guaranteed to be null-terminated
    BOOL GetSerialString(UCHAR* pucSerialString_, USHORT usBufferSize_) const;
+   const char* GetPortPath() const { return szPortPath; }  //as sysfs names it, "1-2.3", stays the same while the device is in that port
 
    DeviceType::Enum GetDeviceType() const { return DeviceType::LIBUSB; }
 
@@ -54,12 +57,13 @@ class USBDeviceLibusb : public USBDevice
 
    BOOL GetDeviceSerialNumber(ULONG& ulSerialNumber_);
 
-   struct libusb_device* pstDevice; //should we copy instead?
+   struct libusb_device* pstDevice; //every copy holds a libusb reference, so it stays valid after the device is unplugged
    USHORT usVid;
    USHORT usPid;
    ULONG ulSerialNumber;
    UCHAR szProductDescription[USB_MAX_STRLEN];
    UCHAR szSerialString[USB_MAX_STRLEN];
+   char szPortPath[USB_MAX_PORT_PATH];
 
 };
 
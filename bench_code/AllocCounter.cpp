@@ -0,0 +1,58 @@
+/*
+ * AllocCounter.cpp
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "AllocCounter.h"
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+static std::atomic<uint64_t>	alloc_calls(0);
+
+uint64_t alloc_count(void)
+{
+	return alloc_calls.load(std::memory_order_relaxed);
+}
+
+void* operator new(size_t size)
+{
+	void*	ptr;
+
+	alloc_calls.fetch_add(1, std::memory_order_relaxed);
+	ptr = malloc(size ? size : 1);
+	if(ptr == NULL) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	free(ptr);
+}
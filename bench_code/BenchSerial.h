@@ -0,0 +1,39 @@
+/*
+ * BenchSerial.h
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef BENCH_SERIAL_H
+#define BENCH_SERIAL_H
+
+#include "dsi_serial.hpp"
+
+// Serial port that goes nowhere, the benches push the received bytes themselves
+class BenchSerial : public DSISerial
+{
+public:
+	BOOL	AutoInit() { return TRUE; }
+	BOOL	Init(ULONG /*ulBaud_*/, UCHAR /*ucDeviceNumber_*/) { return TRUE; }
+	ULONG	GetDeviceSerialNumber() { return 0; }
+	BOOL	Open(void) { return TRUE; }
+	void	Close(BOOL /*bReset*/ = FALSE) {}
+	BOOL	WriteBytes(void* /*pvData_*/, USHORT /*usSize_*/) { return TRUE; }
+	UCHAR	GetDeviceNumber(void) { return 0; }
+};
+
+#endif // BENCH_SERIAL_H
@@ -0,0 +1,153 @@
+/*
+ * ConfigBench.cpp
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "ConfigBench.h"
+#include "dsi_framer_ant.hpp"
+#include "dsi_serial.hpp"
+#include "checksum.h"
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <iostream>
+
+#define CONFIG_TIMEOUT_MS	2000
+
+// Answers every command frame it is handed with RESPONSE_NO_ERROR, once
+// per write, after the round trip delay
+class StickStub : public DSISerial
+{
+public:
+	uint32_t	m_writes;
+	uint32_t	m_round_trip_us;
+
+	BOOL	AutoInit() { return TRUE; }
+	BOOL	Init(ULONG /*ulBaud_*/, UCHAR /*ucDeviceNumber_*/) { return TRUE; }
+	ULONG	GetDeviceSerialNumber() { return 0; }
+	BOOL	Open(void) { return TRUE; }
+	void	Close(BOOL /*bReset*/ = FALSE) {}
+	UCHAR	GetDeviceNumber(void) { return 0; }
+
+	BOOL	WriteBytes(void* pvData_, USHORT usSize_)
+	{
+		UCHAR*	data = (UCHAR*)pvData_;
+		USHORT	i = 0;
+
+		m_writes++;
+		usleep(m_round_trip_us);
+
+		while(i + MESG_HEADER_SIZE < usSize_) {
+			if(data[i] != MESG_TX_SYNC) {
+				i++;	// skip the padding between frames
+				continue;
+			}
+			UCHAR response[MESG_FRAME_SIZE + MESG_RESPONSE_EVENT_SIZE];
+			response[0] = MESG_TX_SYNC;
+			response[MESG_SIZE_OFFSET] = MESG_RESPONSE_EVENT_SIZE;
+			response[MESG_ID_OFFSET] = MESG_RESPONSE_EVENT_ID;
+			response[MESG_DATA_OFFSET] = data[i + MESG_DATA_OFFSET];	// channel
+			response[MESG_DATA_OFFSET + 1] = data[i + MESG_ID_OFFSET];	// message being answered
+			response[MESG_DATA_OFFSET + 2] = RESPONSE_NO_ERROR;
+			response[MESG_DATA_OFFSET + 3] = CheckSum_Calc8(response, MESG_DATA_OFFSET + 3);
+			pclCallback->ProcessBytes(response, sizeof(response));
+			i += data[i + MESG_SIZE_OFFSET] + MESG_FRAME_SIZE;
+		}
+		return TRUE;
+	}
+};
+
+ConfigBench::ConfigBench(uint8_t channels, uint32_t round_trip_us)
+{
+	m_channels = channels;
+	m_round_trip_us = round_trip_us;
+}
+
+bool ConfigBench::run(int mode, config_result_t* result)
+{
+	UCHAR			network_key[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	StickStub		stick;
+	DSIFramerANT*		framer;
+	struct timespec		start, end;
+	bool			passed = true;
+	ULONG			response_time = (mode == CONFIG_MODE_SEQUENTIAL) ? CONFIG_TIMEOUT_MS : 0;
+	UCHAR			group = COMMAND_GROUP_NONE;
+
+	stick.m_writes = 0;
+	stick.m_round_trip_us = m_round_trip_us;
+	framer = new DSIFramerANT(&stick);
+	if(framer->Init() == FALSE) {
+		delete framer;
+		return false;
+	}
+	stick.SetCallback(framer);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if(mode != CONFIG_MODE_SEQUENTIAL) {
+		group = framer->BeginCommandGroup();
+	}
+	passed &= (TRUE == framer->SetNetworkKey(0, network_key, response_time));
+	for(UCHAR channel = 0; channel < m_channels; channel++) {
+		passed &= (TRUE == framer->AssignChannel(channel, 0x10, 0, response_time));
+		passed &= (TRUE == framer->SetChannelID(channel, 1000 + channel, 0x11, 0x05, response_time));
+		passed &= (TRUE == framer->SetChannelRFFrequency(channel, 0x39, response_time));
+		passed &= (TRUE == framer->SetChannelPeriod(channel, 8182, response_time));
+		passed &= (TRUE == framer->OpenChannel(channel, response_time));
+	}
+	if(mode == CONFIG_MODE_GROUPED) {
+		passed &= (ANTFRAMER_PASS == framer->WaitForCommandGroup(group, CONFIG_TIMEOUT_MS));
+	}
+	if(mode == CONFIG_MODE_POLLED) {
+		ANTFRAMER_RETURN	polled;
+
+		passed &= (TRUE == framer->SubmitCommandGroup(group));
+		while(ANTFRAMER_TIMEOUT == (polled = framer->WaitForCommandGroup(group, 0))) {
+			sched_yield();
+		}
+		// a poll never releases, the handle is still good until the wait that is not 0
+		passed &= (ANTFRAMER_PASS == polled);
+		passed &= (ANTFRAMER_PASS == framer->WaitForCommandGroup(group, 0));
+		passed &= (ANTFRAMER_PASS == framer->WaitForCommandGroup(group, CONFIG_TIMEOUT_MS));
+		passed &= (ANTFRAMER_INVALIDPARAM == framer->WaitForCommandGroup(group, 0));
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	result->mode = mode;
+	result->channels = m_channels;
+	result->commands = 1 + 5 * m_channels;
+	result->writes = stick.m_writes;
+	result->passed = passed;
+	result->elapsed_ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+
+	delete framer;
+	return true;
+}
+
+void ConfigBench::print(config_result_t* result)
+{
+	std::cout << "config"
+		<< " mode=" << (result->mode == CONFIG_MODE_POLLED ? "polled" : result->mode == CONFIG_MODE_GROUPED ? "grouped" : "sequential")
+		<< " channels=" << (int)result->channels
+		<< " commands=" << result->commands
+		<< " writes=" << result->writes
+		<< " passed=" << (result->passed ? 1 : 0)
+		<< " elapsed_ms=" << result->elapsed_ms
+		<< std::endl;
+}
@@ -0,0 +1,54 @@
+/*
+ * ConfigBench.h
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CONFIG_BENCH_H
+#define CONFIG_BENCH_H
+
+#include <stdint.h>
+
+#define CONFIG_MODE_SEQUENTIAL	0	// one _RTO call per command
+#define CONFIG_MODE_GROUPED	1	// one command group for everything
+#define CONFIG_MODE_POLLED	2	// the same group, polled with 0 waits until it is done
+
+typedef struct config_result_s {
+	int		mode;
+	uint8_t		channels;
+	uint32_t	commands;
+	uint32_t	writes;
+	bool		passed;
+	double		elapsed_ms;
+} config_result_t;
+
+// Opens a number of master channels against a stick stub that answers
+// every command after a fixed USB round trip, and counts the writes it
+// takes to get there.
+class ConfigBench
+{
+public:
+			ConfigBench(uint8_t channels, uint32_t round_trip_us);
+	bool		run(int mode, config_result_t* result);
+	static void	print(config_result_t* result);
+
+private:
+	uint8_t		m_channels;
+	uint32_t	m_round_trip_us;
+};
+
+#endif // CONFIG_BENCH_H
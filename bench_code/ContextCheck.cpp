@@ -0,0 +1,202 @@
+/*
+ * ContextCheck.cpp
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "ContextCheck.h"
+#include "ant.h"
+#include "checksum.h"
+#include <poll.h>
+#include <time.h>
+#include <sched.h>
+#include <iostream>
+
+#define CONTEXT_STICKS		2	// on the event loop, the default context is one more
+#define CONTEXT_ROUNDS		50	// broadcasts to each stick
+#define CONTEXT_TIMEOUT_MS	2000	// for one to come through
+
+typedef struct context_stick_s {
+	ANTContext*		context;	// NULL for the default one
+	UCHAR			tag;		// first data byte of everything sent to it
+	volatile uint32_t	own;
+	volatile uint32_t	wrong;
+} context_stick_t;
+
+static uint64_t now_ms()
+{
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000ULL + now.tv_nsec / 1000000;
+}
+
+static BOOL channel_event(void* pvContext, UCHAR ucANTChannel, UCHAR ucEvent, const UCHAR* pucMessage, USHORT usSize)
+{
+	context_stick_t*	stick = (context_stick_t*)pvContext;
+
+	(void)ucANTChannel;
+	(void)ucEvent;
+	if(usSize > 1 && pucMessage[1] == stick->tag) {
+		stick->own++;
+	} else {
+		stick->wrong++;
+	}
+	return TRUE;
+}
+
+// the library drops everything while a context has no response callback
+static BOOL response(void* pvContext, UCHAR ucANTChannel, UCHAR ucResponseMsgID, const UCHAR* pucMessage, USHORT usSize)
+{
+	(void)pvContext;
+	(void)ucANTChannel;
+	(void)ucResponseMsgID;
+	(void)pucMessage;
+	(void)usSize;
+	return TRUE;
+}
+
+// a broadcast on channel 0 as the stick would send it
+static BOOL inject_broadcast(context_stick_t* stick)
+{
+	UCHAR	frame[MESG_FRAME_SIZE + MESG_DATA_SIZE];
+
+	frame[0] = MESG_TX_SYNC;
+	frame[MESG_SIZE_OFFSET] = MESG_DATA_SIZE;
+	frame[MESG_ID_OFFSET] = MESG_BROADCAST_DATA_ID;
+	frame[MESG_DATA_OFFSET] = 0;
+	for(int j = 1; j < MESG_DATA_SIZE; j++) {
+		frame[MESG_DATA_OFFSET + j] = stick->tag;
+	}
+	frame[MESG_DATA_OFFSET + MESG_DATA_SIZE] = CheckSum_Calc8(frame, MESG_DATA_OFFSET + MESG_DATA_SIZE);
+
+	if(stick->context == NULL) {
+		return ANT_EmulatorInjectBytes(frame, sizeof(frame));
+	}
+	return ANT_EmulatorInjectBytesCtx(stick->context, frame, sizeof(frame));
+}
+
+// handles the event loop sticks until each has count of its own, false on a timeout
+static bool handle_until(context_stick_t* sticks, ANT_POLLFD* fds, UCHAR* fd_counts, uint32_t count)
+{
+	uint64_t	deadline_ms = now_ms() + CONTEXT_TIMEOUT_MS;
+	struct pollfd	polled[CONTEXT_STICKS * ANT_EVENT_LOOP_MAX_FDS];
+
+	for(;;) {
+		uint32_t	done = 0;
+		int		polled_count = 0;
+
+		for(uint32_t s = 0; s < CONTEXT_STICKS; s++) {
+			done += (sticks[s].own >= count);
+		}
+		if(done == CONTEXT_STICKS) {
+			return true;
+		}
+		if(now_ms() >= deadline_ms) {
+			return false;
+		}
+		for(uint32_t s = 0; s < CONTEXT_STICKS; s++) {
+			for(UCHAR i = 0; i < fd_counts[s]; i++) {
+				polled[polled_count].fd = fds[s * ANT_EVENT_LOOP_MAX_FDS + i].iFd;
+				polled[polled_count].events = fds[s * ANT_EVENT_LOOP_MAX_FDS + i].sEvents;
+				polled[polled_count].revents = 0;
+				polled_count++;
+			}
+		}
+		if(poll(polled, polled_count, 100) < 0) {
+			return false;
+		}
+		// no telling whose descriptor it was without the bookkeeping, handling both is cheap
+		for(uint32_t s = 0; s < CONTEXT_STICKS; s++) {
+			ANT_EventLoopHandleCtx(sticks[s].context);
+		}
+	}
+}
+
+bool context_check()
+{
+	context_stick_t		sticks[CONTEXT_STICKS] = {};
+	context_stick_t		default_stick = {};
+	ANT_POLLFD		fds[CONTEXT_STICKS * ANT_EVENT_LOOP_MAX_FDS];
+	UCHAR			fd_counts[CONTEXT_STICKS] = {};
+	uint64_t		deadline_ms;
+	ANT_STATS		stats;
+	bool			ok;
+
+	default_stick.tag = 0xD0;
+	ok = (FALSE != ANT_InitExt(0, 57600, PORT_TYPE_EMULATOR, FRAMER_TYPE_DIRECT));
+	ANT_AssignResponseCallback(response, NULL);
+	ANT_AssignChannelEventCallback(0, channel_event, &default_stick);
+
+	for(uint32_t s = 0; s < CONTEXT_STICKS && ok; s++) {
+		sticks[s].tag = (UCHAR)(0xA0 + s);
+		sticks[s].context = ANT_CreateContext();
+		ok = (FALSE != ANT_InitExtCtx(sticks[s].context, 0, 57600, PORT_TYPE_EMULATOR, FRAMER_TYPE_DIRECT))
+			&& (FALSE != ANT_EventLoopAttachCtx(sticks[s].context));
+		if(ok) {
+			ANT_AssignResponseCallbackCtx(sticks[s].context, response, NULL);
+			ANT_AssignChannelEventCallbackCtx(sticks[s].context, 0, channel_event, &sticks[s]);
+			fd_counts[s] = ANT_EventLoopGetFdsCtx(sticks[s].context, &fds[s * ANT_EVENT_LOOP_MAX_FDS], ANT_EVENT_LOOP_MAX_FDS);
+			ok = (fd_counts[s] != 0);
+		}
+	}
+	if(!ok) {
+		std::cout << "Failed to open the emulated sticks" << std::endl;
+	}
+
+	for(uint32_t round = 1; round <= CONTEXT_ROUNDS && ok; round++) {
+		for(uint32_t s = 0; s < CONTEXT_STICKS && ok; s++) {
+			ok = (FALSE != inject_broadcast(&sticks[s]));
+		}
+		ok = ok && handle_until(sticks, fds, fd_counts, round);
+	}
+
+	// callbacks of the other contexts ran on this thread, the calls without one still go to the default
+	if(ok) {
+		ok = (FALSE != inject_broadcast(&default_stick));
+		deadline_ms = now_ms() + CONTEXT_TIMEOUT_MS;
+		while(ok && default_stick.own == 0 && now_ms() < deadline_ms) {
+			sched_yield();
+		}
+		for(uint32_t s = 0; s < CONTEXT_STICKS; s++) {
+			ANT_EventLoopHandleCtx(sticks[s].context);
+		}
+	}
+
+	// each stick counts only its own, opening the others after it reset nothing
+	ok = ok && default_stick.own == 1 && default_stick.wrong == 0
+		&& ANT_GetStats(&stats) && stats.aulEventsReceived[0] == 1;
+	for(uint32_t s = 0; s < CONTEXT_STICKS; s++) {
+		ok = ok && sticks[s].own == CONTEXT_ROUNDS && sticks[s].wrong == 0
+			&& ANT_GetStatsCtx(sticks[s].context, &stats) && stats.aulEventsReceived[0] == CONTEXT_ROUNDS;
+	}
+
+	std::cout << "context_check sticks=" << CONTEXT_STICKS
+		<< " rounds=" << CONTEXT_ROUNDS;
+	for(uint32_t s = 0; s < CONTEXT_STICKS; s++) {
+		std::cout << " stick" << s << "=" << sticks[s].own << "/" << sticks[s].wrong;
+	}
+	std::cout << " default=" << default_stick.own << "/" << default_stick.wrong
+		<< (ok ? " ok" : " FAILED") << std::endl;
+
+	for(uint32_t s = 0; s < CONTEXT_STICKS; s++) {
+		ANT_DestroyContext(sticks[s].context);
+	}
+	ANT_UnassignAllResponseFunctions();
+	ANT_Close();
+	return ok;
+}
@@ -0,0 +1,32 @@
+/*
+ * ContextCheck.h
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CONTEXT_CHECK_H
+#define CONTEXT_CHECK_H
+
+// Runs two emulated sticks, an ANT context each, on one event loop in this
+// thread and then the default context on its receive thread.  Checks every
+// callback gets its own stick's messages, the calls without a context still
+// go to the default one after the others were handled, and each stick's
+// counters hold only its own.  Prints a line, false if anything went to or
+// was counted for the wrong stick.
+bool	context_check();
+
+#endif // CONTEXT_CHECK_H
@@ -0,0 +1,254 @@
+/*
+ * DispatchBench.cpp
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "DispatchBench.h"
+#include "BenchSerial.h"
+#include "checksum.h"
+#include <time.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <iostream>
+
+static BenchSerial	bench_serial;
+
+DispatchBench::DispatchBench(uint32_t messages, uint32_t rate_hz)
+{
+	m_messages = messages;
+	m_rate_hz = rate_hz;
+	m_mode = DISPATCH_MODE_LAYERED;
+	m_exit_flag = false;
+	m_framer = NULL;
+	m_rx_queue = NULL;
+	m_received = 0;
+	pthread_mutex_init(&m_done_mutex, NULL);
+	pthread_cond_init(&m_done_cond, NULL);
+}
+
+DispatchBench::~DispatchBench()
+{
+	pthread_mutex_destroy(&m_done_mutex);
+	pthread_cond_destroy(&m_done_cond);
+}
+
+uint64_t DispatchBench::now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void* DispatchBench::serial_thread_helper(void* context)
+{
+	return ((DispatchBench*)context)->serial_thread();
+}
+
+// same job as DSISerialGeneric::ReceiveThread
+void* DispatchBench::serial_thread(void)
+{
+	UCHAR	data[255];
+
+	while(!m_exit_flag) {
+		ULONG bytes_read = m_rx_queue->PopArray(data, sizeof(data), 100);
+		if(bytes_read) {
+			m_framer->ProcessBytes(data, bytes_read);
+		}
+	}
+	return NULL;
+}
+
+void* DispatchBench::message_thread_helper(void* context)
+{
+	return ((DispatchBench*)context)->message_thread();
+}
+
+// same job as the MessageThread in ant.cpp
+void* DispatchBench::message_thread(void)
+{
+	ANT_MESSAGE	message;
+	USHORT		size;
+
+	while(!m_exit_flag) {
+		if(m_framer->WaitForMessage(100)) {
+			size = m_framer->GetMessage(&message);
+			if(size == DSI_FRAMER_ERROR) {
+				m_framer->GetMessage(&message, MESG_MAX_SIZE_VALUE);
+				continue;
+			}
+			if(size != 0 && size != DSI_FRAMER_TIMEDOUT) {
+				have_message(&message, size);
+			}
+		}
+	}
+	return NULL;
+}
+
+void DispatchBench::direct_callback(ANT_MESSAGE* message, USHORT size, void* context)
+{
+	((DispatchBench*)context)->have_message(message, size);
+}
+
+void DispatchBench::have_message(ANT_MESSAGE* message, USHORT /*size*/)
+{
+	uint64_t	sent_ns;
+
+	if(message->ucMessageID != MESG_BROADCAST_DATA_ID) {
+		return;
+	}
+	memcpy(&sent_ns, &message->aucData[1], sizeof(sent_ns));
+	if(m_received < m_latency_ns.size()) {
+		m_latency_ns[m_received] = (uint32_t)std::min<uint64_t>(now_ns() - sent_ns, UINT32_MAX);
+	}
+	m_received = m_received + 1;
+
+	if(m_received >= m_messages) {
+		pthread_mutex_lock(&m_done_mutex);
+		pthread_cond_signal(&m_done_cond);
+		pthread_mutex_unlock(&m_done_mutex);
+	}
+}
+
+// what the usb receive thread does with a completed transfer
+void DispatchBench::feed(UCHAR* data, uint32_t size)
+{
+	if(m_mode == DISPATCH_MODE_DIRECT) {
+		m_framer->ProcessBytes(data, size);
+	} else {
+		m_rx_queue->PushArray(data, size);
+	}
+}
+
+bool DispatchBench::run(int mode, dispatch_result_t* result)
+{
+	UCHAR			frame[MESG_FRAME_SIZE + 9];
+	struct timespec		next;
+	struct timespec		cpu_start, cpu_end;
+	struct rusage		usage_start, usage_end;
+	uint64_t		period_ns = 1000000000ULL / (m_rate_hz ? m_rate_hz : 1);
+
+	m_mode = mode;
+	m_exit_flag = false;
+	m_received = 0;
+	m_latency_ns.assign(m_messages, 0);
+
+	m_framer = new DSIFramerANT(&bench_serial);
+	if(m_framer->Init() == FALSE) {
+		delete m_framer;
+		m_framer = NULL;
+		return false;
+	}
+	bench_serial.SetCallback(m_framer);
+
+	if(mode == DISPATCH_MODE_DIRECT) {
+		m_framer->SetMessageCallback(DispatchBench::direct_callback, this);
+	} else {
+		m_rx_queue = new TSQueue<UCHAR>();
+		pthread_create(&m_serial_pthread, NULL, &DispatchBench::serial_thread_helper, this);
+		pthread_create(&m_message_pthread, NULL, &DispatchBench::message_thread_helper, this);
+	}
+
+	getrusage(RUSAGE_SELF, &usage_start);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_start);
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	for(uint32_t i = 0; i < m_messages; i++) {
+		uint64_t sent_ns;
+
+		next.tv_nsec += period_ns;
+		while(next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+		// broadcast on channel 0, the 8 data bytes carry the send time
+		frame[0] = MESG_TX_SYNC;
+		frame[1] = 9;
+		frame[2] = MESG_BROADCAST_DATA_ID;
+		frame[3] = 0;
+		sent_ns = now_ns();
+		memcpy(&frame[4], &sent_ns, sizeof(sent_ns));
+		frame[12] = CheckSum_Calc8(frame, 12);
+		feed(frame, 13);
+	}
+
+	// give the layered path a moment to drain
+	pthread_mutex_lock(&m_done_mutex);
+	if(m_received < m_messages) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += 2;
+		while(m_received < m_messages) {
+			if(pthread_cond_timedwait(&m_done_cond, &m_done_mutex, &deadline) != 0) {
+				break;
+			}
+		}
+	}
+	pthread_mutex_unlock(&m_done_mutex);
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end);
+	getrusage(RUSAGE_SELF, &usage_end);
+
+	m_exit_flag = true;
+	if(mode != DISPATCH_MODE_DIRECT) {
+		pthread_join(m_serial_pthread, NULL);
+		pthread_join(m_message_pthread, NULL);
+		delete m_rx_queue;
+		m_rx_queue = NULL;
+	}
+	delete m_framer;
+	m_framer = NULL;
+
+	uint32_t received = m_received;
+	if(received > m_messages) {
+		received = m_messages;
+	}
+	std::vector<uint32_t> sorted(m_latency_ns.begin(), m_latency_ns.begin() + received);
+	std::sort(sorted.begin(), sorted.end());
+
+	memset(result, 0, sizeof(*result));
+	result->mode = mode;
+	result->messages = received;
+	result->lost = m_messages - received;
+	if(received) {
+		result->latency_p50_us = sorted[received / 2] / 1000.0;
+		result->latency_p99_us = sorted[(uint32_t)((received - 1) * 0.99)] / 1000.0;
+		result->latency_max_us = sorted[received - 1] / 1000.0;
+	}
+	result->cpu_ns_per_msg = ((cpu_end.tv_sec - cpu_start.tv_sec) * 1e9 + (cpu_end.tv_nsec - cpu_start.tv_nsec)) / (m_messages ? m_messages : 1);
+	result->context_switches = (usage_end.ru_nvcsw - usage_start.ru_nvcsw) + (usage_end.ru_nivcsw - usage_start.ru_nivcsw);
+
+	return true;
+}
+
+void DispatchBench::print(dispatch_result_t* result)
+{
+	std::cout << "dispatch"
+		<< " mode=" << (result->mode == DISPATCH_MODE_DIRECT ? "direct" : "layered")
+		<< " msgs=" << result->messages
+		<< " lost=" << result->lost
+		<< " p50_us=" << result->latency_p50_us
+		<< " p99_us=" << result->latency_p99_us
+		<< " max_us=" << result->latency_max_us
+		<< " cpu_ns_per_msg=" << result->cpu_ns_per_msg
+		<< " ctx_switches=" << result->context_switches
+		<< std::endl;
+}
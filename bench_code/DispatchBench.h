@@ -0,0 +1,83 @@
+/*
+ * DispatchBench.h
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef DISPATCH_BENCH_H
+#define DISPATCH_BENCH_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <vector>
+
+#include "dsi_framer_ant.hpp"
+#include "dsi_ts_queue.hpp"
+
+#define DISPATCH_MODE_LAYERED	0	// usb thread -> byte queue -> serial thread -> message queue -> message thread
+#define DISPATCH_MODE_DIRECT	1	// usb thread -> framer -> callback
+
+typedef struct dispatch_result_s {
+	int		mode;
+	uint32_t	messages;
+	uint32_t	lost;
+	double		latency_p50_us;
+	double		latency_p99_us;
+	double		latency_max_us;
+	double		cpu_ns_per_msg;
+	long		context_switches;
+} dispatch_result_t;
+
+// Feeds timestamped broadcast frames through the ANT receive path the way
+// the USB receive thread would, and measures how long each one takes to
+// reach the application callback.
+class DispatchBench
+{
+public:
+			DispatchBench(uint32_t messages, uint32_t rate_hz);
+			~DispatchBench();
+	bool		run(int mode, dispatch_result_t* result);
+	static void	print(dispatch_result_t* result);
+
+private:
+	static void*	serial_thread_helper(void* context);
+	void*		serial_thread(void);
+	static void*	message_thread_helper(void* context);
+	void*		message_thread(void);
+	static void	direct_callback(ANT_MESSAGE* message, USHORT size, void* context);
+
+	void		have_message(ANT_MESSAGE* message, USHORT size);
+	void		feed(UCHAR* data, uint32_t size);
+	uint64_t	now_ns();
+
+	uint32_t		m_messages;
+	uint32_t		m_rate_hz;
+	int			m_mode;
+	volatile bool		m_exit_flag;
+
+	DSIFramerANT*		m_framer;
+	TSQueue<UCHAR>*		m_rx_queue;
+	pthread_t		m_serial_pthread;
+	pthread_t		m_message_pthread;
+
+	std::vector<uint32_t>	m_latency_ns;
+	volatile uint32_t	m_received;
+	pthread_mutex_t		m_done_mutex;
+	pthread_cond_t		m_done_cond;
+};
+
+#endif // DISPATCH_BENCH_H
@@ -0,0 +1,189 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+
+#include "DispatchBench.h"
+#include "ConfigBench.h"
+#include "MicroBench.h"
+#include "ReprocessCheck.h"
+#include "ContextCheck.h"
+#include "cxxopts.hpp"
+
+int main(int argc, char* argv[])
+{
+	uint32_t	messages = 5000;
+	uint32_t	rate_hz = 1000;
+	bool		run_layered = true;
+	bool		run_direct = true;
+	bool		run_dispatch = true;
+	bool		run_config = true;
+	bool		run_micro = true;
+	bool		run_reprocess = true;
+	bool		run_context = true;
+	int		channels = 8;
+	int		round_trip_us = 1000;
+	micro_stream_t	stream = {0, 20, 70, 10, 10, 10, 0, 1};
+
+	try {
+		cxxopts::Options options(argv [0], "Benchmarks for the ANT library");
+
+		options.add_options ("Basic")
+			("n,messages", "Messages per run", cxxopts::value<int>(), "COUNT")
+			("r,rate", "Messages per second", cxxopts::value<int>(), "HZ")
+			("m,mode", "Dispatch mode to run: layered, direct or both", cxxopts::value<std::string>(), "MODE")
+			("t,test", "Benchmark to run: dispatch, config, micro, reprocess, context or all", cxxopts::value<std::string>(), "TEST")
+			("c,channels", "Channels to open in the config benchmark", cxxopts::value<int>(), "COUNT")
+			("rtt", "Simulated USB round trip for the config benchmark in [us]", cxxopts::value<int>(), "US")
+			("mix", "Micro benchmark stream weights: broadcast,acknowledged,burst,event", cxxopts::value<std::string>(), "B,A,U,E")
+			("corrupt", "Micro benchmark frames with a bad checksum, per mille", cxxopts::value<int>(), "PERMILLE")
+			("passes", "Micro benchmark stream replays per case", cxxopts::value<int>(), "COUNT")
+			("seed", "Micro benchmark stream seed", cxxopts::value<int>(), "SEED")
+			("h,help", "Print help")
+		;
+
+		auto result = options.parse(argc, argv);
+
+		if (result.count("h")) {
+			std::cout << options.help({"", "Basic"}) << std::endl;
+			exit(0);
+		};
+
+		if (result.count("n")) {
+			if (result["n"].as<int>() <= 0) {
+				std::cout << "Invalid message count" << std::endl;
+				exit (1);
+			}
+			messages = result["n"].as<int>();
+		};
+
+		if (result.count("r")) {
+			if ((result["r"].as<int>() <= 0) || (result["r"].as<int>() > 1000000)) {
+				std::cout << "Invalid rate" << std::endl;
+				exit (1);
+			}
+			rate_hz = result["r"].as<int>();
+		};
+
+		if (result.count("m")) {
+			std::string mode = result["m"].as<std::string>();
+			run_layered = (mode == "layered" || mode == "both");
+			run_direct = (mode == "direct" || mode == "both");
+			if (!run_layered && !run_direct) {
+				std::cout << "Invalid mode" << std::endl;
+				exit (1);
+			}
+		};
+
+		if (result.count("t")) {
+			std::string test = result["t"].as<std::string>();
+			run_dispatch = (test == "dispatch" || test == "all");
+			run_config = (test == "config" || test == "all");
+			run_micro = (test == "micro" || test == "all");
+			run_reprocess = (test == "reprocess" || test == "all");
+			run_context = (test == "context" || test == "all");
+			if (!run_dispatch && !run_config && !run_micro && !run_reprocess && !run_context) {
+				std::cout << "Invalid test" << std::endl;
+				exit (1);
+			}
+		};
+
+		if (result.count("c")) {
+			channels = result["c"].as<int>();
+			if ((channels < 1) || (channels > 8)) {
+				std::cout << "Invalid channel count" << std::endl;
+				exit (1);
+			}
+		};
+
+		if (result.count("rtt")) {
+			round_trip_us = result["rtt"].as<int>();
+			if (round_trip_us < 0) {
+				std::cout << "Invalid round trip" << std::endl;
+				exit (1);
+			}
+		};
+
+		if (result.count("mix")) {
+			if (4 != sscanf(result["mix"].as<std::string>().c_str(), "%u,%u,%u,%u",
+					&stream.broadcast_share, &stream.acknowledged_share, &stream.burst_share, &stream.event_share)) {
+				std::cout << "Invalid mix" << std::endl;
+				exit (1);
+			}
+		};
+
+		if (result.count("corrupt")) {
+			if ((result["corrupt"].as<int>() < 0) || (result["corrupt"].as<int>() > 1000)) {
+				std::cout << "Invalid corrupt rate" << std::endl;
+				exit (1);
+			}
+			stream.corrupt_per_mille = result["corrupt"].as<int>();
+		};
+
+		if (result.count("passes")) {
+			if (result["passes"].as<int>() <= 0) {
+				std::cout << "Invalid pass count" << std::endl;
+				exit (1);
+			}
+			stream.passes = result["passes"].as<int>();
+		};
+
+		if (result.count("seed")) {
+			stream.seed = result["seed"].as<int>();
+		};
+
+	} catch (const cxxopts::OptionException& e) {
+		std::cout << "error parsing options: " << e.what() << std::endl;
+		exit(1);
+	}
+
+	DispatchBench		bench(messages, rate_hz);
+	dispatch_result_t	result;
+
+	if (run_dispatch && run_layered) {
+		if (!bench.run(DISPATCH_MODE_LAYERED, &result)) {
+			std::cout << "Layered run failed" << std::endl;
+			exit (1);
+		}
+		DispatchBench::print(&result);
+	}
+	if (run_dispatch && run_direct) {
+		if (!bench.run(DISPATCH_MODE_DIRECT, &result)) {
+			std::cout << "Direct run failed" << std::endl;
+			exit (1);
+		}
+		DispatchBench::print(&result);
+	}
+
+	if (run_config) {
+		ConfigBench		config(channels, round_trip_us);
+		config_result_t		config_result;
+
+		config.run(CONFIG_MODE_SEQUENTIAL, &config_result);
+		ConfigBench::print(&config_result);
+		config.run(CONFIG_MODE_GROUPED, &config_result);
+		ConfigBench::print(&config_result);
+		config.run(CONFIG_MODE_POLLED, &config_result);
+		ConfigBench::print(&config_result);
+	}
+
+	if (run_micro) {
+		stream.messages = messages;
+		MicroBench		micro(&stream);
+
+		micro.run_all();
+	}
+
+	if (run_reprocess && !reprocess_check()) {
+		std::cout << "Reprocess check failed" << std::endl;
+		exit (1);
+	}
+
+	if (run_context && !context_check()) {
+		std::cout << "Context check failed" << std::endl;
+		exit (1);
+	}
+
+	return 0;
+}
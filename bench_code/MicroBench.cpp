@@ -0,0 +1,482 @@
+/*
+ * MicroBench.cpp
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "MicroBench.h"
+#include "BenchSerial.h"
+#include "AllocCounter.h"
+#include "ant.h"
+#include "checksum.h"
+#include <time.h>
+#include <sched.h>
+#include <string.h>
+#include <iostream>
+
+#define MICRO_CHANNELS		8
+#define MICRO_QUEUE_MESSAGES	4096	// messages parsed before the queue is drained, well under the framer's ring
+#define MICRO_INJECT_BYTES	2048	// emulator replay chunk, half its output buffer
+#define MICRO_DRAIN_TIMEOUT_MS	5000
+#define MICRO_STICKS		2	// emulated sticks, an ANT context each, in the dispatch_sticks case
+
+static BenchSerial		micro_serial;
+
+// the copying ant.cpp callbacks carry no context, so the dispatch cases count here
+static volatile uint64_t	dispatch_delivered;
+static UCHAR			dispatch_response[MESG_MAX_SIZE_VALUE];
+static UCHAR			dispatch_buffers[MICRO_CHANNELS][MESG_MAX_SIZE_VALUE];
+
+static BOOL dispatch_response_callback(UCHAR /*channel*/, UCHAR /*message_id*/)
+{
+	dispatch_delivered = dispatch_delivered + 1;
+	return TRUE;
+}
+
+static BOOL dispatch_channel_callback(UCHAR /*channel*/, UCHAR /*event*/)
+{
+	dispatch_delivered = dispatch_delivered + 1;
+	return TRUE;
+}
+
+static BOOL dispatch_response_zero_copy(void* context, UCHAR /*channel*/, UCHAR /*message_id*/, const UCHAR* /*message*/, USHORT /*size*/)
+{
+	*(volatile uint64_t*)context = *(volatile uint64_t*)context + 1;
+	return TRUE;
+}
+
+static BOOL dispatch_channel_zero_copy(void* context, UCHAR /*channel*/, UCHAR /*event*/, const UCHAR* /*message*/, USHORT /*size*/)
+{
+	*(volatile uint64_t*)context = *(volatile uint64_t*)context + 1;
+	return TRUE;
+}
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+MicroBench::MicroBench(const micro_stream_t* stream)
+{
+	m_config = *stream;
+	if(m_config.passes == 0) {
+		m_config.passes = 1;
+	}
+	m_valid = 0;
+	m_delivered = 0;
+	m_start_ns = 0;
+	m_start_allocs = 0;
+	build_stream();
+}
+
+// the same pseudo random stream every run for a given seed
+void MicroBench::build_stream()
+{
+	uint32_t	state = m_config.seed ? m_config.seed : 1;
+	uint32_t	total = m_config.broadcast_share + m_config.acknowledged_share + m_config.burst_share + m_config.event_share;
+	uint8_t		burst_sequence = 0;
+
+	if(total == 0) {
+		m_config.broadcast_share = total = 1;
+	}
+
+	m_stream.clear();
+	m_frames.clear();
+	m_valid = 0;
+
+	for(uint32_t i = 0; i < m_config.messages; i++) {
+		UCHAR		frame[MESG_FRAME_SIZE + MESG_DATA_SIZE];
+		UCHAR		channel = i % MICRO_CHANNELS;
+		uint32_t	pick;
+		UCHAR		size = MESG_DATA_SIZE;
+
+		// xorshift
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		pick = state % total;
+
+		frame[0] = MESG_TX_SYNC;
+		frame[MESG_DATA_OFFSET] = channel;
+		for(int j = 1; j < MESG_DATA_SIZE; j++) {
+			frame[MESG_DATA_OFFSET + j] = (UCHAR)(i + j);
+		}
+
+		if(pick < m_config.broadcast_share) {
+			frame[MESG_ID_OFFSET] = MESG_BROADCAST_DATA_ID;
+		} else if(pick < m_config.broadcast_share + m_config.acknowledged_share) {
+			frame[MESG_ID_OFFSET] = MESG_ACKNOWLEDGED_DATA_ID;
+		} else if(pick < m_config.broadcast_share + m_config.acknowledged_share + m_config.burst_share) {
+			frame[MESG_ID_OFFSET] = MESG_BURST_DATA_ID;
+			frame[MESG_DATA_OFFSET] = (UCHAR)(((burst_sequence & 0x03) << 5) | channel);
+			burst_sequence++;
+		} else {
+			frame[MESG_ID_OFFSET] = MESG_RESPONSE_EVENT_ID;
+			size = MESG_RESPONSE_EVENT_SIZE;
+			frame[MESG_DATA_OFFSET + 1] = MESG_EVENT_ID;
+			frame[MESG_DATA_OFFSET + 2] = EVENT_TX;
+		}
+		frame[MESG_SIZE_OFFSET] = size;
+		frame[MESG_DATA_OFFSET + size] = CheckSum_Calc8(frame, MESG_DATA_OFFSET + size);
+
+		if((state >> 8) % 1000 < m_config.corrupt_per_mille) {
+			frame[MESG_DATA_OFFSET + size] ^= 0xFF;
+		} else {
+			m_valid++;
+		}
+
+		m_frames.push_back(m_stream.size());
+		m_stream.insert(m_stream.end(), frame, frame + MESG_FRAME_SIZE + size);
+	}
+	m_frames.push_back(m_stream.size());
+}
+
+DSIFramerANT* MicroBench::new_framer(bool direct)
+{
+	DSIFramerANT*	framer = new DSIFramerANT(&micro_serial);
+
+	if(framer->Init() == FALSE) {
+		delete framer;
+		return NULL;
+	}
+	micro_serial.SetCallback(framer);
+	if(direct) {
+		framer->SetMessageCallback(MicroBench::count_callback, this);
+	}
+	return framer;
+}
+
+void MicroBench::count_callback(ANT_MESSAGE* /*message*/, USHORT /*size*/, void* context)
+{
+	((MicroBench*)context)->m_delivered++;
+}
+
+void MicroBench::start(micro_result_t* result, const char* name)
+{
+	memset(result, 0, sizeof(*result));
+	result->name = name;
+	m_delivered = 0;
+	m_start_allocs = alloc_count();
+	m_start_ns = now_ns();
+}
+
+void MicroBench::stop(micro_result_t* result)
+{
+	uint64_t	elapsed_ns = now_ns() - m_start_ns;
+	uint64_t	allocs = alloc_count() - m_start_allocs;
+
+	result->messages = (uint64_t)m_config.messages * m_config.passes;
+	result->delivered = m_delivered;
+	if(result->messages) {
+		result->ns_per_msg = (double)elapsed_ns / result->messages;
+		result->allocs_per_msg = (double)allocs / result->messages;
+	}
+	if(elapsed_ns) {
+		result->msgs_per_sec = result->messages * 1e9 / elapsed_ns;
+	}
+}
+
+// CheckSum_Calc8 over every frame, as the framer would have to per message
+bool MicroBench::checksum(micro_result_t* result)
+{
+	start(result, "checksum");
+	for(uint32_t pass = 0; pass < m_config.passes; pass++) {
+		for(uint32_t i = 0; i + 1 < m_frames.size(); i++) {
+			uint32_t size = m_frames[i + 1] - m_frames[i];
+			if(CheckSum_Calc8(&m_stream[m_frames[i]], size - 1) == m_stream[m_frames[i] + size - 1]) {
+				m_delivered++;
+			}
+		}
+	}
+	stop(result);
+	return true;
+}
+
+// one ProcessByte call, and one lock, per received byte
+bool MicroBench::process_byte(micro_result_t* result)
+{
+	DSIFramerANT*	framer = new_framer(true);
+
+	if(framer == NULL) {
+		return false;
+	}
+	start(result, "process_byte");
+	for(uint32_t pass = 0; pass < m_config.passes; pass++) {
+		for(uint32_t i = 0; i < m_stream.size(); i++) {
+			framer->ProcessByte(m_stream[i]);
+		}
+	}
+	stop(result);
+	delete framer;
+	return true;
+}
+
+// ProcessBytes in 64 byte blocks, the size of a full-speed USB packet
+bool MicroBench::process_bytes(micro_result_t* result)
+{
+	DSIFramerANT*	framer = new_framer(true);
+
+	if(framer == NULL) {
+		return false;
+	}
+	start(result, "process_bytes");
+	for(uint32_t pass = 0; pass < m_config.passes; pass++) {
+		for(uint32_t i = 0; i < m_stream.size(); i += 64) {
+			uint32_t size = (m_stream.size() - i < 64) ? m_stream.size() - i : 64;
+			framer->ProcessBytes(&m_stream[i], size);
+		}
+	}
+	stop(result);
+	delete framer;
+	return true;
+}
+
+// parse into the framer's message queue and drain it with GetMessage, the layered path without the threads
+bool MicroBench::get_message(micro_result_t* result)
+{
+	DSIFramerANT*	framer = new_framer(false);
+	ANT_MESSAGE	message;
+
+	if(framer == NULL) {
+		return false;
+	}
+	start(result, "get_message");
+	for(uint32_t pass = 0; pass < m_config.passes; pass++) {
+		for(uint32_t first = 0; first + 1 < m_frames.size(); first += MICRO_QUEUE_MESSAGES) {
+			uint32_t last = first + MICRO_QUEUE_MESSAGES;
+			if(last > m_frames.size() - 1) {
+				last = m_frames.size() - 1;
+			}
+			framer->ProcessBytes(&m_stream[m_frames[first]], m_frames[last] - m_frames[first]);
+			for(;;) {
+				USHORT size = framer->GetMessage(&message);
+				if(size == DSI_FRAMER_TIMEDOUT) {
+					break;
+				}
+				if(size != DSI_FRAMER_ERROR) {
+					m_delivered++;
+				}
+			}
+		}
+	}
+	stop(result);
+	delete framer;
+	return true;
+}
+
+// the byte path again, with a command group's worth of responses waiting on the channels in the stream
+bool MicroBench::response_list(uint32_t attached, micro_result_t* result)
+{
+	DSIFramerANT*	framer = new_framer(true);
+	UCHAR		group = COMMAND_GROUP_NONE;
+
+	if(framer == NULL) {
+		return false;
+	}
+	if(attached > COMMAND_GROUP_SIZE) {
+		attached = COMMAND_GROUP_SIZE;
+	}
+	if(attached) {
+		group = framer->BeginCommandGroup();
+		for(uint32_t i = 0; i < attached; i++) {
+			framer->SetChannelPeriod(i % MICRO_CHANNELS, 8192, 0);
+		}
+		framer->SubmitCommandGroup(group);
+	}
+
+	start(result, "response_list");
+	for(uint32_t pass = 0; pass < m_config.passes; pass++) {
+		for(uint32_t i = 0; i < m_stream.size(); i += 64) {
+			uint32_t size = (m_stream.size() - i < 64) ? m_stream.size() - i : 64;
+			framer->ProcessBytes(&m_stream[i], size);
+		}
+	}
+	stop(result);
+	result->attached = attached;
+
+	if(attached) {
+		framer->WaitForCommandGroup(group, 1);	// nothing answers, this just releases them
+	}
+	delete framer;
+	return true;
+}
+
+// the whole receive path through ant.cpp: emulated stick thread, framer and SerialHaveMessage in direct mode,
+// copying into the receive buffers or handing the callbacks the framer's message
+bool MicroBench::dispatch(bool zero_copy, micro_result_t* result)
+{
+	uint64_t	deadline_ns;
+
+	if(FALSE == ANT_InitExt(0, 57600, PORT_TYPE_EMULATOR, FRAMER_TYPE_DIRECT)) {
+		return false;
+	}
+	if(zero_copy) {
+		ANT_AssignResponseCallback(dispatch_response_zero_copy, (void*)&dispatch_delivered);
+	} else {
+		ANT_AssignResponseFunction(dispatch_response_callback, dispatch_response);
+	}
+	for(UCHAR channel = 0; channel < MICRO_CHANNELS; channel++) {
+		if(zero_copy) {
+			ANT_AssignChannelEventCallback(channel, dispatch_channel_zero_copy, (void*)&dispatch_delivered);
+		} else {
+			ANT_AssignChannelEventFunction(channel, dispatch_channel_callback, dispatch_buffers[channel]);
+		}
+	}
+	dispatch_delivered = 0;
+
+	start(result, zero_copy ? "dispatch_zero_copy" : "dispatch");
+	for(uint32_t pass = 0; pass < m_config.passes; pass++) {
+		uint32_t first = 0;
+		while(first + 1 < m_frames.size()) {
+			uint32_t last = first;
+			while(last + 1 < m_frames.size() && m_frames[last + 1] - m_frames[first] <= MICRO_INJECT_BYTES) {
+				last++;
+			}
+			while(FALSE == ANT_EmulatorInjectBytes(&m_stream[m_frames[first]], m_frames[last] - m_frames[first])) {
+				sched_yield();
+			}
+			first = last;
+		}
+	}
+	deadline_ns = now_ns() + MICRO_DRAIN_TIMEOUT_MS * 1000000ULL;
+	while(dispatch_delivered < (uint64_t)m_valid * m_config.passes && now_ns() < deadline_ns) {
+		sched_yield();
+	}
+	m_delivered = dispatch_delivered;
+	stop(result);
+
+	ANT_UnassignAllResponseFunctions();
+	ANT_Close();
+	return true;
+}
+
+// dispatch with zero copy callbacks over several sticks in one process, each its own ANT context
+bool MicroBench::dispatch_sticks(micro_result_t* result)
+{
+	ANTContext*		contexts[MICRO_STICKS] = {};
+	volatile uint64_t	delivered[MICRO_STICKS] = {};
+	uint64_t		total;
+	uint64_t		deadline_ns;
+	bool			opened = true;
+
+	for(uint32_t s = 0; s < MICRO_STICKS && opened; s++) {
+		contexts[s] = ANT_CreateContext();
+		opened = (FALSE != ANT_InitExtCtx(contexts[s], 0, 57600, PORT_TYPE_EMULATOR, FRAMER_TYPE_DIRECT));
+		ANT_AssignResponseCallbackCtx(contexts[s], dispatch_response_zero_copy, (void*)&delivered[s]);
+		for(UCHAR channel = 0; channel < MICRO_CHANNELS; channel++) {
+			ANT_AssignChannelEventCallbackCtx(contexts[s], channel, dispatch_channel_zero_copy, (void*)&delivered[s]);
+		}
+	}
+
+	if(opened) {
+		start(result, "dispatch_sticks");
+		for(uint32_t pass = 0; pass < m_config.passes; pass++) {
+			uint32_t first = 0;
+			while(first + 1 < m_frames.size()) {
+				uint32_t last = first;
+				while(last + 1 < m_frames.size() && m_frames[last + 1] - m_frames[first] <= MICRO_INJECT_BYTES) {
+					last++;
+				}
+				for(uint32_t s = 0; s < MICRO_STICKS; s++) {
+					while(FALSE == ANT_EmulatorInjectBytesCtx(contexts[s], &m_stream[m_frames[first]], m_frames[last] - m_frames[first])) {
+						sched_yield();
+					}
+				}
+				first = last;
+			}
+		}
+		deadline_ns = now_ns() + MICRO_DRAIN_TIMEOUT_MS * 1000000ULL;
+		do {
+			total = 0;
+			for(uint32_t s = 0; s < MICRO_STICKS; s++) {
+				total += delivered[s];
+			}
+			if(total >= (uint64_t)m_valid * m_config.passes * MICRO_STICKS) {
+				break;
+			}
+			sched_yield();
+		} while(now_ns() < deadline_ns);
+		m_delivered = total;
+		stop(result);
+
+		// every stick got the whole stream
+		result->messages *= MICRO_STICKS;
+		result->msgs_per_sec *= MICRO_STICKS;
+		result->ns_per_msg /= MICRO_STICKS;
+		result->allocs_per_msg /= MICRO_STICKS;
+	}
+
+	for(uint32_t s = 0; s < MICRO_STICKS; s++) {
+		ANT_DestroyContext(contexts[s]);
+	}
+	return opened;
+}
+
+void MicroBench::run_all()
+{
+	micro_result_t	result;
+
+	if(checksum(&result)) {
+		print(&result);
+	}
+	if(process_byte(&result)) {
+		print(&result);
+	}
+	if(process_bytes(&result)) {
+		print(&result);
+	}
+	if(get_message(&result)) {
+		print(&result);
+	}
+	if(response_list(0, &result)) {
+		print(&result);
+	}
+	if(response_list(COMMAND_GROUP_SIZE, &result)) {
+		print(&result);
+	}
+	if(dispatch(false, &result)) {
+		print(&result);
+	} else {
+		std::cout << "micro case=dispatch failed=1" << std::endl;
+	}
+	if(dispatch(true, &result)) {
+		print(&result);
+	} else {
+		std::cout << "micro case=dispatch_zero_copy failed=1" << std::endl;
+	}
+	if(dispatch_sticks(&result)) {
+		print(&result);
+	} else {
+		std::cout << "micro case=dispatch_sticks failed=1" << std::endl;
+	}
+}
+
+void MicroBench::print(micro_result_t* result)
+{
+	std::cout << "micro"
+		<< " case=" << result->name
+		<< " attached=" << result->attached
+		<< " msgs=" << result->messages
+		<< " delivered=" << result->delivered
+		<< " msgs_per_sec=" << (uint64_t)result->msgs_per_sec
+		<< " ns_per_msg=" << result->ns_per_msg
+		<< " allocs_per_msg=" << result->allocs_per_msg
+		<< std::endl;
+}
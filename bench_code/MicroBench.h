@@ -0,0 +1,85 @@
+/*
+ * MicroBench.h
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MICRO_BENCH_H
+#define MICRO_BENCH_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "dsi_framer_ant.hpp"
+
+// what the synthetic receive stream is made of, the shares are relative weights
+typedef struct micro_stream_s {
+	uint32_t	messages;		// messages per pass
+	uint32_t	passes;			// times the stream is replayed per case
+	uint32_t	broadcast_share;	// broadcast data
+	uint32_t	acknowledged_share;	// acknowledged data
+	uint32_t	burst_share;		// burst packets, sequence number cycling
+	uint32_t	event_share;		// EVENT_TX channel events
+	uint32_t	corrupt_per_mille;	// frames sent with a bad checksum
+	uint32_t	seed;
+} micro_stream_t;
+
+typedef struct micro_result_s {
+	const char*	name;
+	uint32_t	attached;		// responses waiting while the case ran
+	uint64_t	messages;
+	uint64_t	delivered;		// messages that reached the end of the layer
+	double		msgs_per_sec;
+	double		ns_per_msg;
+	double		allocs_per_msg;
+} micro_result_t;
+
+// Replays a synthetic ANT receive stream through one layer of the stack at
+// a time: the checksum, the byte parser, the message queue, the response
+// list and the ant.cpp dispatch, with one stick or several.
+class MicroBench
+{
+public:
+			MicroBench(const micro_stream_t* stream);
+	bool		checksum(micro_result_t* result);
+	bool		process_byte(micro_result_t* result);
+	bool		process_bytes(micro_result_t* result);
+	bool		get_message(micro_result_t* result);
+	bool		response_list(uint32_t attached, micro_result_t* result);
+	bool		dispatch(bool zero_copy, micro_result_t* result);
+	bool		dispatch_sticks(micro_result_t* result);
+	void		run_all();
+	static void	print(micro_result_t* result);
+
+private:
+	void		build_stream();
+	DSIFramerANT*	new_framer(bool direct);
+	void		start(micro_result_t* result, const char* name);
+	void		stop(micro_result_t* result);
+	static void	count_callback(ANT_MESSAGE* message, USHORT size, void* context);
+
+	micro_stream_t		m_config;
+	std::vector<UCHAR>	m_stream;
+	std::vector<uint32_t>	m_frames;		// offset of every frame in m_stream
+	uint32_t		m_valid;		// frames with a good checksum
+	uint64_t		m_delivered;
+
+	uint64_t		m_start_ns;
+	uint64_t		m_start_allocs;
+};
+
+#endif // MICRO_BENCH_H
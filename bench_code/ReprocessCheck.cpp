@@ -0,0 +1,154 @@
+/*
+ * ReprocessCheck.cpp
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "ReprocessCheck.h"
+#include "Reprocess.h"
+#include "SessionLog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+#include <vector>
+
+#define CHECK_ROWS		3
+#define CHECK_NONE		-1
+
+typedef struct check_block_s {
+	int		columns;		// sample columns written, from the first
+	int		short_column;		// written a row short, or CHECK_NONE
+} check_block_t;
+
+typedef struct check_case_s {
+	const char*	name;
+	check_block_t	blocks[2];
+	int		block_count;
+	uint64_t	frames;			// what reprocess_log() should find
+	uint64_t	bad_blocks;
+} check_case_t;
+
+static const check_case_t	cases[] = {
+	{ "whole", { { SESSION_LOG_SAMPLE_COLUMNS, CHECK_NONE }, { SESSION_LOG_SAMPLE_COLUMNS, CHECK_NONE } }, 2, 2 * CHECK_ROWS, 0 },
+	{ "short_speed", { { SESSION_LOG_SAMPLE_COLUMNS, SESSION_LOG_S_RAW_SPEED }, { SESSION_LOG_SAMPLE_COLUMNS, CHECK_NONE } }, 2, 2 * CHECK_ROWS - 1, 1 },
+	{ "short_raw", { { SESSION_LOG_SAMPLE_COLUMNS, SESSION_LOG_S_RAW_POWER } }, 1, CHECK_ROWS - 1, 1 },
+	{ "short_power", { { SESSION_LOG_SAMPLE_COLUMNS, SESSION_LOG_S_POWER } }, 1, CHECK_ROWS - 1, 1 },
+	{ "missing_raw", { { SESSION_LOG_S_RAW_SPEED, CHECK_NONE }, { SESSION_LOG_SAMPLE_COLUMNS, CHECK_NONE } }, 2, CHECK_ROWS, 1 },
+};
+
+static void put_varint(std::vector<uint8_t>* out, int64_t difference)
+{
+	uint64_t	zigzag = ((uint64_t)difference << 1) ^ (uint64_t)(difference >> 63);
+
+	while(zigzag >= 0x80) {
+		out->push_back((uint8_t)(zigzag | 0x80));
+		zigzag >>= 7;
+	}
+	out->push_back((uint8_t)zigzag);
+}
+
+static void put_block(std::vector<uint8_t>* log, const check_block_t* check)
+{
+	session_log_block_t		block;
+	std::vector<uint32_t>		sizes;
+	std::vector<uint8_t>		data;
+
+	for(int c = 0; c < check->columns; c++) {
+		int		rows = (c == check->short_column) ? CHECK_ROWS - 1 : CHECK_ROWS;
+		size_t		start = data.size();
+
+		for(int r = 0; r < rows; r++) {
+			// 100 + c, then up by one a row
+			put_varint(&data, r == 0 ? 100 + c : 1);
+		}
+		sizes.push_back(data.size() - start);
+	}
+
+	memset(&block, 0, sizeof(block));
+	block.magic = SESSION_LOG_BLOCK_MAGIC;
+	block.type = SESSION_LOG_SAMPLE;
+	block.columns = check->columns;
+	block.count = CHECK_ROWS;
+	block.size = sizes.size() * sizeof(uint32_t) + data.size();
+
+	log->insert(log->end(), (uint8_t*)&block, (uint8_t*)(&block + 1));
+	log->insert(log->end(), (uint8_t*)sizes.data(), (uint8_t*)(sizes.data() + sizes.size()));
+	log->insert(log->end(), data.begin(), data.end());
+	log->resize((log->size() + 7) & ~(size_t)7);
+}
+
+// no index, the reader walks the blocks as for a log cut short
+static bool write_log(const char* path, const check_case_t* check)
+{
+	session_log_header_t		header;
+	std::vector<uint8_t>		log;
+	FILE*				file;
+	bool				written;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = SESSION_LOG_MAGIC;
+	header.version = SESSION_LOG_VERSION;
+	header.header_size = sizeof(header);
+	header.block_records = SESSION_LOG_BLOCK_RECORDS;
+	log.insert(log.end(), (uint8_t*)&header, (uint8_t*)(&header + 1));
+	for(int b = 0; b < check->block_count; b++) {
+		put_block(&log, &check->blocks[b]);
+	}
+
+	file = fopen(path, "wb");
+	if(file == NULL) {
+		return false;
+	}
+	written = fwrite(log.data(), 1, log.size(), file) == log.size();
+	return fclose(file) == 0 && written;
+}
+
+bool reprocess_check()
+{
+	reprocess_config_t	config = { 1.0 };
+	bool			passed = true;
+
+	for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		char			path[] = "/tmp/ant_bench_log_XXXXXX";
+		reprocess_result_t	result;
+		bool			ok;
+		int			fd;
+
+		fd = mkstemp(path);
+		if(fd < 0) {
+			std::cout << "Failed to create a session log to reprocess" << std::endl;
+			return false;
+		}
+		close(fd);
+
+		memset(&result, 0, sizeof(result));
+		ok = write_log(path, &cases[i])
+			&& reprocess_log(path, &config, NULL, &result)
+			&& result.frames == cases[i].frames
+			&& result.bad_blocks == cases[i].bad_blocks;
+		unlink(path);
+
+		std::cout << "reprocess_check case=" << cases[i].name
+			<< " frames=" << result.frames
+			<< " bad_blocks=" << result.bad_blocks
+			<< (ok ? " ok" : " FAILED") << std::endl;
+		passed &= ok;
+	}
+	return passed;
+}
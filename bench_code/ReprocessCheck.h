@@ -0,0 +1,29 @@
+/*
+ * ReprocessCheck.h
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef REPROCESS_CHECK_H
+#define REPROCESS_CHECK_H
+
+// Writes small session logs by hand, whole and with a sample column cut
+// short or left out, and checks what reprocess_log() makes of each.
+// Prints a line per case, false if any of them is wrong.
+bool	reprocess_check();
+
+#endif // REPROCESS_CHECK_H
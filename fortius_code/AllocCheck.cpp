@@ -0,0 +1,161 @@
+/*
+ * AllocCheck.cpp
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "AllocCheck.h"
+
+#if defined(ALLOC_CHECK)
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <execinfo.h>
+#include <atomic>
+#include <new>
+
+// glibc's own entry points, so the counting versions below can hand over to them
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+
+static std::atomic<bool>	armed(false);
+static std::atomic<uint64_t>	allocs(0);
+static void*			callers[ALLOC_CHECK_CALLERS];
+
+// lock free, it runs inside the allocator
+static inline void count(void* caller)
+{
+	uint64_t	n;
+
+	if(!armed.load(std::memory_order_relaxed)) {
+		return;
+	}
+	n = allocs.fetch_add(1, std::memory_order_relaxed);
+	if(n < ALLOC_CHECK_CALLERS) {
+		callers[n] = caller;
+	}
+}
+
+extern "C" void* malloc(size_t size)
+{
+	count(__builtin_return_address(0));
+	return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count_, size_t size)
+{
+	count(__builtin_return_address(0));
+	return __libc_calloc(count_, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size)
+{
+	count(__builtin_return_address(0));
+	return __libc_realloc(ptr, size);
+}
+
+void* operator new(size_t size)
+{
+	void*	ptr;
+
+	count(__builtin_return_address(0));
+	ptr = __libc_malloc(size ? size : 1);
+	if(ptr == NULL) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void* operator new[](size_t size)
+{
+	void*	ptr;
+
+	count(__builtin_return_address(0));
+	ptr = __libc_malloc(size ? size : 1);
+	if(ptr == NULL) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	count(__builtin_return_address(0));
+	return __libc_malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	count(__builtin_return_address(0));
+	return __libc_malloc(size ? size : 1);
+}
+
+bool alloc_check_enabled()
+{
+	return true;
+}
+
+void alloc_check_arm()
+{
+	allocs.store(0, std::memory_order_relaxed);
+	armed.store(true, std::memory_order_seq_cst);
+}
+
+void alloc_check_disarm()
+{
+	armed.store(false, std::memory_order_seq_cst);
+}
+
+uint64_t alloc_check_count()
+{
+	return allocs.load(std::memory_order_relaxed);
+}
+
+void alloc_check_print_callers()
+{
+	uint64_t	n = alloc_check_count();
+
+	// backtrace_symbols_fd() writes straight to the fd without allocating
+	backtrace_symbols_fd(callers, n < ALLOC_CHECK_CALLERS ? (int)n : ALLOC_CHECK_CALLERS, STDOUT_FILENO);
+}
+
+#else // ALLOC_CHECK
+
+bool alloc_check_enabled()
+{
+	return false;
+}
+
+void alloc_check_arm()
+{
+}
+
+void alloc_check_disarm()
+{
+}
+
+uint64_t alloc_check_count()
+{
+	return 0;
+}
+
+void alloc_check_print_callers()
+{
+}
+
+#endif // ALLOC_CHECK
@@ -0,0 +1,38 @@
+/*
+ * AllocCheck.h
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ALLOC_CHECK_H
+#define ALLOC_CHECK_H
+
+#include <stdint.h>
+
+#define ALLOC_CHECK_CALLERS	16	// first offending call sites kept for the report
+
+// In a build with ALLOC_CHECK defined (make alloccheck) malloc, calloc,
+// realloc and operator new are interposed, and every call made on any
+// thread while the check is armed is counted.  Otherwise the calls below do
+// nothing and alloc_check_enabled() is false.
+bool		alloc_check_enabled();
+void		alloc_check_arm();
+void		alloc_check_disarm();
+uint64_t	alloc_check_count();		// allocations while armed
+void		alloc_check_print_callers();	// symbolised return addresses of the first ones
+
+#endif // ALLOC_CHECK_H
@@ -0,0 +1,346 @@
+/*
+ * BridgeBench.cpp
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "BridgeBench.h"
+#include "AllocCheck.h"
+#include "dsi_thread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <iostream>
+#include <glog/logging.h>
+
+#define CHANNEL_OPEN_TIMEOUT_S	10
+#define WARMUP_MS		1000	// let the trainer report a speed before the first step
+
+#define STEP_TARGET_POWER	0	// value in watts
+#define STEP_SLOPE		1	// value in 0.01 %
+#define STEP_PAGE_REQUEST	2	// value is the page
+#define STEP_BUTTON		3	// value is the FT_xxx mask
+
+typedef struct workout_step_s {
+	int		type;
+	int		value;
+} workout_step_t;
+
+// Every step but the page request moves the brake, so each one can be
+// matched to the next brake command.  The button presses come right after
+// an erg step because they only change the load in erg mode.
+static const workout_step_t workout[] = {
+	{STEP_TARGET_POWER,	150},
+	{STEP_BUTTON,		FT_PLUS},
+	{STEP_SLOPE,		300},
+	{STEP_PAGE_REQUEST,	PAGE_FE_CAPABILITIES},
+	{STEP_SLOPE,		-100},
+	{STEP_TARGET_POWER,	250},
+	{STEP_BUTTON,		FT_MINUS},
+};
+
+BridgeBench::BridgeBench(FortiusSim* fortius, CANTMaster* ant_master, uint32_t seconds)
+{
+	m_fortius = fortius;
+	m_channel_number = ant_master->get_channel_number();
+	m_seconds = seconds;
+}
+
+double BridgeBench::now_seconds()
+{
+	return DSIThread_GetSystemTime() / 1000.0;
+}
+
+double BridgeBench::wall_seconds()
+{
+	timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+void BridgeBench::sleep_until(double time, bool* abort)
+{
+	double		remaining;
+
+	// short naps so ctrl-c is noticed
+	while(!*abort && (remaining = time - now_seconds()) > 0) {
+		DSIThread_Sleep(remaining > 0.1 ? 100 : (ULONG)(remaining * 1000.0 + 0.5));
+	}
+}
+
+bool BridgeBench::wait_for_channel(uint8_t channel_number, bool* abort)
+{
+	ULONG		tx_events = 0;
+	double		deadline = now_seconds() + CHANNEL_OPEN_TIMEOUT_S;
+
+	// the emulator only counts transmit slots once the master channel is open
+	while(tx_events == 0) {
+		if(*abort || now_seconds() > deadline) {
+			return false;
+		}
+		DSIThread_Sleep(100);
+		ANT_EmulatorGetCounts(channel_number, NULL, &tx_events);
+	}
+	DSIThread_Sleep(WARMUP_MS);
+	return true;
+}
+
+bool BridgeBench::play_step(uint32_t step)
+{
+	const workout_step_t*	s = &workout[step % (sizeof(workout) / sizeof(workout[0]))];
+	target_power_t		target_power;
+	track_resistance_t	track_resistance;
+	request_t		request;
+
+	switch(s->type) {
+	case STEP_TARGET_POWER:
+		memset(&target_power, 0xFF, sizeof(target_power));
+		target_power.data_page_number = PAGE_TARGET_POWER;
+		target_power.target_power_quarter_watts = s->value * 4;
+		return (TRUE == ANT_EmulatorInjectAcknowledged(m_channel_number, (UCHAR*)&target_power));
+
+	case STEP_SLOPE:
+		memset(&track_resistance, 0xFF, sizeof(track_resistance));
+		track_resistance.data_page_number = PAGE_TRACK_RESISTANCE;
+		track_resistance.slope = s->value + 20000;	// offset by 200 %
+		return (TRUE == ANT_EmulatorInjectAcknowledged(m_channel_number, (UCHAR*)&track_resistance));
+
+	case STEP_PAGE_REQUEST:
+		memset(&request, 0xFF, sizeof(request));
+		request.data_page_number = PAGE_REQUEST;
+		request.response_cnt = 2;
+		request.response_try = 0;
+		request.requested_page_number = s->value;
+		request.command_type = REQUEST_DATA_PAGE;
+		ANT_EmulatorInjectAcknowledged(m_channel_number, (UCHAR*)&request);
+		return false;
+
+	case STEP_BUTTON:
+		m_fortius->press_buttons(s->value);
+		return true;
+	}
+	return false;
+}
+
+bool BridgeBench::run(bridge_result_t* result, bool* abort)
+{
+	std::vector<double>		step_times;
+	std::vector<bool>		step_moves_brake;
+	std::vector<brake_change_t>	changes;
+	std::vector<double>		latencies;
+	ULONG				broadcasts_start, tx_events_start;
+	ULONG				broadcasts_end, tx_events_end;
+	uint32_t			frames_start;
+	double				start, end, wall_start;
+	struct rusage			usage;
+	uint64_t			switches_start;
+	ANT_STATS			stats_start, stats_end;
+	double				cpu_ms = 0;
+	size_t				change = 0;
+	uint32_t			steps = m_seconds * 1000 / BRIDGE_BENCH_STEP_MS;
+
+	if(false == wait_for_channel(m_channel_number, abort)) {
+		std::cout << "Bench: ANT channel did not open" << std::endl;
+		return false;
+	}
+
+	// the bench's own bookkeeping must not show up in the allocation check
+	step_times.reserve(steps);
+	step_moves_brake.reserve(steps);
+	m_fortius->reserve_brake_changes(steps * 4);
+	alloc_check_arm();
+
+	frames_start = m_fortius->get_reads();
+	ANT_EmulatorGetCounts(m_channel_number, &broadcasts_start, &tx_events_start);
+	ANT_GetStats(&stats_start);
+	getrusage(RUSAGE_SELF, &usage);
+	switches_start = usage.ru_nvcsw + usage.ru_nivcsw;
+	start = now_seconds();
+	wall_start = wall_seconds();
+
+	// only start a step if it has a full step time left to reach the brake
+	for(uint32_t step = 0; (step + 1) * BRIDGE_BENCH_STEP_MS <= m_seconds * 1000 && !*abort; step++) {
+		step_times.push_back(now_seconds());
+		step_moves_brake.push_back(play_step(step));
+		sleep_until(start + (step + 1) * BRIDGE_BENCH_STEP_MS / 1000.0, abort);
+	}
+	sleep_until(start + m_seconds, abort);
+
+	alloc_check_disarm();
+	end = now_seconds();
+	ANT_EmulatorGetCounts(m_channel_number, &broadcasts_end, &tx_events_end);
+	ANT_GetStats(&stats_end);
+	result->frames = m_fortius->get_reads() - frames_start;
+	read_thread_cpu(result->threads);	// before anyone is stopped
+
+	// the first brake command written after a step, and before the next one, answers it
+	changes = m_fortius->get_brake_changes();
+	result->missed = 0;
+	for(size_t i = 0; i < step_times.size(); i++) {
+		double	window_end = (i + 1 < step_times.size()) ? step_times[i + 1] : end;
+
+		while(change < changes.size() && changes[change].time < step_times[i]) {
+			change++;
+		}
+		if(!step_moves_brake[i]) {
+			continue;
+		}
+		if(change < changes.size() && changes[change].time < window_end) {
+			latencies.push_back((changes[change].time - step_times[i]) * 1000.0);
+		} else {
+			result->missed++;
+		}
+	}
+	std::sort(latencies.begin(), latencies.end());
+
+	result->virtual_time = (TRUE == DSIThread_VirtualTimeIsEnabled());
+	result->elapsed_s = end - start;
+	result->wall_s = wall_seconds() - wall_start;
+	result->steps = step_times.size();
+	result->frames_per_sec = result->frames / result->elapsed_s;
+	result->broadcasts = broadcasts_end - broadcasts_start;
+	result->tx_events = tx_events_end - tx_events_start;
+	result->slot_fill = result->tx_events ? (double)result->broadcasts / result->tx_events : 0;
+	result->latencies = latencies.size();
+	result->latency_p50_ms = percentile(latencies, 0.50);
+	result->latency_p90_ms = percentile(latencies, 0.90);
+	result->latency_p99_ms = percentile(latencies, 0.99);
+	result->latency_max_ms = latencies.empty() ? 0 : latencies.back();
+
+	result->usb_wakeups = stats_end.ulUSBTransfersIn - stats_start.ulUSBTransfersIn;
+	result->usb_wakeups_per_sec = result->usb_wakeups / result->elapsed_s;
+	for(size_t i = 0; i < result->threads.size(); i++) {
+		cpu_ms += result->threads[i].cpu_ms;
+	}
+	result->cpu_percent = cpu_ms / 10.0 / result->wall_s;
+
+	getrusage(RUSAGE_SELF, &usage);
+	result->context_switches = usage.ru_nvcsw + usage.ru_nivcsw - switches_start;
+	result->context_switches_per_sec = result->context_switches / result->wall_s;
+	result->peak_rss_kb = usage.ru_maxrss;
+	result->alloc_checked = alloc_check_enabled();
+	result->allocs = alloc_check_count();
+
+	return true;
+}
+
+double BridgeBench::percentile(std::vector<double>& sorted, double p)
+{
+	size_t	index;
+
+	if(sorted.empty()) {
+		return 0;
+	}
+	index = (size_t)(p * sorted.size());
+	if(index >= sorted.size()) {
+		index = sorted.size() - 1;
+	}
+	return sorted[index];
+}
+
+void BridgeBench::read_thread_cpu(std::vector<thread_cpu_t>& threads)
+{
+	DIR*		dir;
+	struct dirent*	entry;
+	char		path[PATH_MAX];
+	char		stat[512];
+	long		ticks_per_second = sysconf(_SC_CLK_TCK);
+
+	threads.clear();
+	dir = opendir("/proc/self/task");
+	if(dir == NULL) {
+		return;
+	}
+	while((entry = readdir(dir)) != NULL) {
+		FILE*			fd;
+		char*			name_end;
+		unsigned long		utime, stime;
+		thread_cpu_t		thread;
+
+		if(entry->d_name[0] < '0' || entry->d_name[0] > '9') {
+			continue;
+		}
+		if(snprintf(path, sizeof(path), "/proc/self/task/%s/stat", entry->d_name) >= (int)sizeof(path)) {
+			continue;
+		}
+		fd = fopen(path, "r");
+		if(fd == NULL) {
+			continue;
+		}
+		if(fgets(stat, sizeof(stat), fd) == NULL) {
+			fclose(fd);
+			continue;
+		}
+		fclose(fd);
+
+		// "tid (comm) state ppid ..." utime and stime are fields 14 and 15, comm may hold spaces
+		name_end = strrchr(stat, ')');
+		if(name_end == NULL || 2 != sscanf(name_end + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime)) {
+			continue;
+		}
+		*name_end = '\0';
+		thread.tid = atoi(stat);
+		thread.name = strchr(stat, '(') + 1;
+		thread.cpu_ms = (utime + stime) * 1000.0 / ticks_per_second;
+		threads.push_back(thread);
+	}
+	closedir(dir);
+}
+
+void BridgeBench::print(bridge_result_t* result)
+{
+	std::cout << "bench"
+		<< " clock=" << (result->virtual_time ? "virtual" : "wall")
+		<< " elapsed_s=" << result->elapsed_s
+		<< " wall_s=" << result->wall_s
+		<< " steps=" << result->steps
+		<< " frames=" << result->frames
+		<< " frames_per_sec=" << result->frames_per_sec
+		<< " broadcasts=" << result->broadcasts
+		<< " tx_events=" << result->tx_events
+		<< " slot_fill=" << result->slot_fill
+		<< " latencies=" << result->latencies
+		<< " missed=" << result->missed
+		<< " latency_p50_ms=" << result->latency_p50_ms
+		<< " latency_p90_ms=" << result->latency_p90_ms
+		<< " latency_p99_ms=" << result->latency_p99_ms
+		<< " latency_max_ms=" << result->latency_max_ms
+		<< " peak_rss_kb=" << result->peak_rss_kb
+		<< " usb_wakeups=" << result->usb_wakeups
+		<< " usb_wakeups_per_sec=" << result->usb_wakeups_per_sec
+		<< " cpu_percent=" << result->cpu_percent
+		<< " context_switches=" << result->context_switches
+		<< " context_switches_per_sec=" << result->context_switches_per_sec;
+	if(result->alloc_checked) {
+		std::cout << " allocs=" << result->allocs;
+	}
+	std::cout << std::endl;
+
+	for(size_t i = 0; i < result->threads.size(); i++) {
+		std::cout << "bench_thread"
+			<< " name=" << result->threads[i].name
+			<< " tid=" << result->threads[i].tid
+			<< " cpu_ms=" << result->threads[i].cpu_ms
+			<< std::endl;
+	}
+}
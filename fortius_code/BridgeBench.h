@@ -0,0 +1,91 @@
+/*
+ * BridgeBench.h
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef BRIDGE_BENCH_H
+#define BRIDGE_BENCH_H
+
+#include "FortiusSim.h"
+#include "CANTMaster.h"
+#include <string>
+#include <vector>
+
+#define BRIDGE_BENCH_STEP_MS	2000	// time between workout steps
+
+typedef struct thread_cpu_s {
+	std::string	name;
+	int		tid;
+	double		cpu_ms;		// user + system
+} thread_cpu_t;
+
+typedef struct bridge_result_s {
+	bool		virtual_time;
+	double		elapsed_s;		// on the bridge clock
+	double		wall_s;			// real time the run took
+	uint32_t	steps;			// workout steps played
+	uint32_t	frames;			// telemetry frames read from the trainer
+	double		frames_per_sec;
+	uint32_t	broadcasts;		// pages the bridge broadcast
+	uint32_t	tx_events;		// channel periods, one transmit slot each
+	double		slot_fill;		// broadcasts per slot
+	uint32_t	latencies;		// setpoint changes that reached the brake
+	uint32_t	missed;			// setpoint changes that did not
+	double		latency_p50_ms;		// display command or button press to brake command
+	double		latency_p90_ms;
+	double		latency_p99_ms;
+	double		latency_max_ms;
+	long		peak_rss_kb;
+	uint32_t	usb_wakeups;		// reads from the stick that brought data, each one wakes the host
+	double		usb_wakeups_per_sec;
+	double		cpu_percent;		// all threads, of one core, on the wall clock
+	uint64_t	context_switches;	// voluntary and not, all threads
+	double		context_switches_per_sec;
+	bool		alloc_checked;		// built with ALLOC_CHECK
+	uint64_t	allocs;			// heap allocations once the bridge was in steady state
+	std::vector<thread_cpu_t>	threads;
+} bridge_result_t;
+
+// Plays a scripted workout against a running bridge made of a simulated
+// trainer and an emulated ANT stick: erg steps, slope changes, page requests
+// and button presses, for a fixed time on the bridge clock, which is the
+// wall clock or virtual time.
+class BridgeBench
+{
+public:
+			BridgeBench(FortiusSim* fortius, CANTMaster* ant_master, uint32_t seconds);
+	bool		run(bridge_result_t* result, bool* abort);	// fortius and ant_master must be started
+	static void	print(bridge_result_t* result);
+
+	// shared with the other harnesses
+	static bool	wait_for_channel(uint8_t channel_number, bool* abort);	// until the emulated channel transmits
+	static double	now_seconds();		// bridge clock
+	static double	wall_seconds();
+	static void	sleep_until(double time, bool* abort);
+	static double	percentile(std::vector<double>& sorted, double p);
+
+private:
+	bool		play_step(uint32_t step);	// returns true if the step should move the brake
+	static void	read_thread_cpu(std::vector<thread_cpu_t>& threads);
+
+	FortiusSim*	m_fortius;
+	uint8_t		m_channel_number;
+	uint32_t	m_seconds;
+};
+
+#endif // BRIDGE_BENCH_H
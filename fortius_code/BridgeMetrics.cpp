@@ -0,0 +1,420 @@
+/*
+ * BridgeMetrics.cpp
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "BridgeMetrics.h"
+#include "LatencyStats.h"
+#include "Fortius.h"
+#include "ant.h"
+#include "dsi_thread.h"
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <iostream>
+#include <glog/logging.h>
+
+#define METRICS_PAGE_SIZE	32768
+#define METRICS_IO_TIMEOUT_S	1		// a stuck client gives up its connection after this
+
+static const struct {
+	const char*	name;
+	const char*	help;
+} counter_info[METRIC_COUNTERS] = {
+	{ "antbridge_trainer_reads_total",	"Telemetry messages read from the trainer" },
+	{ "antbridge_trainer_writes_total",	"Brake commands written to the trainer" },
+	{ "antbridge_trainer_reconnects_total",	"Trainer USB port reopened after an error" },
+	{ "antbridge_trainer_overruns_total",	"Trainer reads and writes that started after their delay had passed" },
+	{ "antbridge_pages_sent_total",		"FE-C pages handed to the ANT stick" },
+	{ "antbridge_pages_failed_total",	"FE-C pages the ANT stick would not take" },
+	{ "antbridge_commands_total",		"FE-C control pages received" },
+	{ "antbridge_local_commands_total",	"Local control datagrams taken" },
+	{ "antbridge_local_dropped_total",	"Local control datagrams dropped as malformed, out of range or out of sequence" },
+	{ "antbridge_local_timeouts_total",	"Times local control went quiet and the FE-C display got the brake back" },
+};
+
+static const struct {
+	const char*	name;
+	const char*	type;
+	size_t		offset;
+	const char*	help;
+} ant_info[] = {
+	{ "antbridge_ant_usb_bytes_in_total",		"counter",	offsetof(ANT_STATS, ulUSBBytesIn),		"Bytes read from the ANT stick" },
+	{ "antbridge_ant_usb_transfers_in_total",	"counter",	offsetof(ANT_STATS, ulUSBTransfersIn),		"USB transfers read from the ANT stick" },
+	{ "antbridge_ant_usb_read_errors_total",	"counter",	offsetof(ANT_STATS, ulUSBReadErrors),		"USB reads from the ANT stick that failed" },
+	{ "antbridge_ant_usb_retries_total",		"counter",	offsetof(ANT_STATS, ulUSBTransferRetries),	"USB reads submitted again after an error" },
+	{ "antbridge_ant_usb_bytes_out_total",		"counter",	offsetof(ANT_STATS, ulUSBBytesOut),		"Bytes written to the ANT stick" },
+	{ "antbridge_ant_usb_transfers_out_total",	"counter",	offsetof(ANT_STATS, ulUSBTransfersOut),		"USB transfers written to the ANT stick" },
+	{ "antbridge_ant_usb_write_errors_total",	"counter",	offsetof(ANT_STATS, ulUSBWriteErrors),		"USB writes to the ANT stick that failed" },
+	{ "antbridge_ant_usb_rx_queue_high",		"gauge",	offsetof(ANT_STATS, ulUSBRxQueueHighWater),	"Most bytes waiting in the USB receive queue" },
+	{ "antbridge_ant_usb_rx_queue_overruns_total",	"counter",	offsetof(ANT_STATS, ulUSBRxQueueOverruns),	"Bytes dropped because the USB receive queue was full" },
+	{ "antbridge_ant_device_gone_total",		"counter",	offsetof(ANT_STATS, ulDeviceGone),		"Times the ANT stick went away" },
+	{ "antbridge_ant_reconnects_total",		"counter",	offsetof(ANT_STATS, ulReconnects),		"Times the ANT stick was opened again after going away" },
+	{ "antbridge_ant_frames_in_total",		"counter",	offsetof(ANT_STATS, ulFramesIn),		"ANT frames received" },
+	{ "antbridge_ant_frames_out_total",		"counter",	offsetof(ANT_STATS, ulFramesOut),		"ANT frames sent" },
+	{ "antbridge_ant_crc_errors_total",		"counter",	offsetof(ANT_STATS, ulCRCErrors),		"ANT frames with a bad checksum" },
+	{ "antbridge_ant_oversize_frames_total",	"counter",	offsetof(ANT_STATS, ulOversizeFrames),		"ANT frames too long to receive" },
+	{ "antbridge_ant_queue_overflows_total",	"counter",	offsetof(ANT_STATS, ulQueueOverflows),		"ANT messages lost because the framer queue was full" },
+	{ "antbridge_ant_queue_high",			"gauge",	offsetof(ANT_STATS, ulQueueHighWater),		"Most ANT messages waiting in the framer queue" },
+	{ "antbridge_ant_serial_errors_total",		"counter",	offsetof(ANT_STATS, ulSerialErrors),		"Errors reported by the ANT serial layer" },
+	{ "antbridge_ant_response_timeouts_total",	"counter",	offsetof(ANT_STATS, ulResponseTimeouts),	"ANT commands not answered in time" },
+	{ "antbridge_ant_framer_errors_total",		"counter",	offsetof(ANT_STATS, ulFramerErrors),		"Framer errors seen by the ANT message thread" },
+};
+
+static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+static std::atomic<uint64_t>	counters[METRIC_COUNTERS];
+
+// seqlock, the CANTMaster thread is the only writer
+static struct {
+	std::atomic<uint32_t>	seq;
+	std::atomic<uint32_t>	device_id;
+	std::atomic<int>	mode;
+	std::atomic<double>	target_power_watts;
+	std::atomic<double>	power_watts;
+	std::atomic<double>	speed_kph;
+	std::atomic<double>	cadence_rpm;
+	std::atomic<double>	heartrate_bpm;
+} published;
+
+static int		listen_fd = -1;
+static struct sockaddr_un	unix_address;
+static pthread_t	server_thread;
+static DSI_CANCEL_TOKEN	server_stop;		// metrics_server_stop() wakes the poll with it
+
+// only the server thread renders
+static char		page[METRICS_PAGE_SIZE];
+static int		page_length;
+
+void metrics_count(int counter)
+{
+	counters[counter].fetch_add(1, std::memory_order_relaxed);
+}
+
+void metrics_publish_trainer(const metrics_trainer_t* trainer)
+{
+	uint32_t	seq = published.seq.load(std::memory_order_relaxed);
+
+	published.seq.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	published.device_id.store(trainer->device_id, std::memory_order_relaxed);
+	published.mode.store(trainer->mode, std::memory_order_relaxed);
+	published.target_power_watts.store(trainer->target_power_watts, std::memory_order_relaxed);
+	published.power_watts.store(trainer->power_watts, std::memory_order_relaxed);
+	published.speed_kph.store(trainer->speed_kph, std::memory_order_relaxed);
+	published.cadence_rpm.store(trainer->cadence_rpm, std::memory_order_relaxed);
+	published.heartrate_bpm.store(trainer->heartrate_bpm, std::memory_order_relaxed);
+	published.seq.store(seq + 2, std::memory_order_release);
+}
+
+// false if nothing has been published yet
+static bool read_trainer(metrics_trainer_t* trainer)
+{
+	uint32_t	before;
+	uint32_t	after;
+
+	do {
+		before = published.seq.load(std::memory_order_acquire);
+		if(before == 0) {
+			return false;
+		}
+		trainer->device_id = published.device_id.load(std::memory_order_relaxed);
+		trainer->mode = published.mode.load(std::memory_order_relaxed);
+		trainer->target_power_watts = published.target_power_watts.load(std::memory_order_relaxed);
+		trainer->power_watts = published.power_watts.load(std::memory_order_relaxed);
+		trainer->speed_kph = published.speed_kph.load(std::memory_order_relaxed);
+		trainer->cadence_rpm = published.cadence_rpm.load(std::memory_order_relaxed);
+		trainer->heartrate_bpm = published.heartrate_bpm.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		after = published.seq.load(std::memory_order_relaxed);
+	} while((before & 1) || before != after);
+	return true;
+}
+
+static void add(const char* format, ...)
+{
+	va_list		args;
+	int		n;
+
+	if(page_length >= METRICS_PAGE_SIZE - 1) {
+		return;
+	}
+	va_start(args, format);
+	n = vsnprintf(page + page_length, METRICS_PAGE_SIZE - page_length, format, args);
+	va_end(args);
+	if(n > 0) {
+		page_length += n;
+		if(page_length > METRICS_PAGE_SIZE - 1) {
+			page_length = METRICS_PAGE_SIZE - 1;
+		}
+	}
+}
+
+static void add_family(const char* name, const char* type, const char* help)
+{
+	add("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static const char* mode_name(int mode)
+{
+	switch(mode) {
+		case FT_IDLE:		return "idle";
+		case FT_ERGOMODE:	return "erg";
+		case FT_SSMODE:		return "slope";
+		case FT_CALIBRATE:	return "calibrate";
+	}
+	return "unknown";
+}
+
+static void render()
+{
+	metrics_trainer_t	trainer;
+	ANT_STATS		stats;
+
+	page_length = 0;
+
+	for(int i = 0; i < METRIC_COUNTERS; i++) {
+		add_family(counter_info[i].name, "counter", counter_info[i].help);
+		add("%s %llu\n", counter_info[i].name, (unsigned long long)counters[i].load(std::memory_order_relaxed));
+	}
+
+	if(read_trainer(&trainer)) {
+		add_family("antbridge_trainer_mode", "gauge", "Current trainer mode, 1 for the mode label in use");
+		add("antbridge_trainer_mode{trainer=\"%u\",mode=\"%s\"} 1\n", trainer.device_id, mode_name(trainer.mode));
+		add_family("antbridge_trainer_target_power_watts", "gauge", "Load asked of the brake");
+		add("antbridge_trainer_target_power_watts{trainer=\"%u\"} %.1f\n", trainer.device_id, trainer.target_power_watts);
+		add_family("antbridge_trainer_power_watts", "gauge", "Measured power");
+		add("antbridge_trainer_power_watts{trainer=\"%u\"} %.1f\n", trainer.device_id, trainer.power_watts);
+		add_family("antbridge_trainer_speed_kph", "gauge", "Measured speed");
+		add("antbridge_trainer_speed_kph{trainer=\"%u\"} %.2f\n", trainer.device_id, trainer.speed_kph);
+		add_family("antbridge_trainer_cadence_rpm", "gauge", "Measured cadence");
+		add("antbridge_trainer_cadence_rpm{trainer=\"%u\"} %.0f\n", trainer.device_id, trainer.cadence_rpm);
+		add_family("antbridge_trainer_heartrate_bpm", "gauge", "Heart rate from the trainer");
+		add("antbridge_trainer_heartrate_bpm{trainer=\"%u\"} %.0f\n", trainer.device_id, trainer.heartrate_bpm);
+	}
+
+	if(ANT_GetStats(&stats)) {
+		for(size_t i = 0; i < sizeof(ant_info) / sizeof(ant_info[0]); i++) {
+			add_family(ant_info[i].name, ant_info[i].type, ant_info[i].help);
+			add("%s %lu\n", ant_info[i].name, (unsigned long)*(ULONG*)((uint8_t*)&stats + ant_info[i].offset));
+		}
+		add_family("antbridge_ant_broadcasts_sent_total", "counter", "Broadcast pages sent per ANT channel");
+		for(int channel = 0; channel < ANT_STATS_CHANNELS; channel++) {
+			if(stats.aulBroadcastsSent[channel] != 0) {
+				add("antbridge_ant_broadcasts_sent_total{channel=\"%d\"} %lu\n", channel, (unsigned long)stats.aulBroadcastsSent[channel]);
+			}
+		}
+		add_family("antbridge_ant_events_received_total", "counter", "Channel events and data messages received per ANT channel");
+		for(int channel = 0; channel < ANT_STATS_CHANNELS; channel++) {
+			if(stats.aulEventsReceived[channel] != 0) {
+				add("antbridge_ant_events_received_total{channel=\"%d\"} %lu\n", channel, (unsigned long)stats.aulEventsReceived[channel]);
+			}
+		}
+	}
+
+	add_family("antbridge_latency_seconds", "summary", "Latency per stage, trainer to air and display to brake");
+	for(int stage = 0; stage < LATENCY_STAGES; stage++) {
+		const char*	name = latency_stage_name(stage);
+
+		for(size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+			add("antbridge_latency_seconds{stage=\"%s\",quantile=\"%g\"} %.6f\n", name, quantiles[q], latency_percentile_ms(stage, quantiles[q]) / 1000.0);
+		}
+		add("antbridge_latency_seconds_sum{stage=\"%s\"} %.6f\n", name, latency_sum_us(stage) / 1000000.0);
+		add("antbridge_latency_seconds_count{stage=\"%s\"} %llu\n", name, (unsigned long long)latency_count(stage));
+	}
+}
+
+static bool send_all(int fd, const char* data, int size)
+{
+	while(size > 0) {
+		ssize_t		n = send(fd, data, size, MSG_NOSIGNAL);
+
+		if(n <= 0) {
+			return false;
+		}
+		data += n;
+		size -= n;
+	}
+	return true;
+}
+
+static void serve(int fd)
+{
+	char		request[1024];
+	char		header[160];
+	int		length = 0;
+	int		header_length;
+	ssize_t		n;
+	struct timeval	timeout = { METRICS_IO_TIMEOUT_S, 0 };
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	// only the request line matters, read until the end of the headers
+	while(length < (int)sizeof(request) - 1) {
+		n = recv(fd, request + length, sizeof(request) - 1 - length, 0);
+		if(n <= 0) {
+			break;
+		}
+		length += n;
+		request[length] = 0;
+		if(strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) {
+			break;
+		}
+	}
+	request[length] = 0;
+
+	if(strncmp(request, "GET /metrics", 12) != 0 && strncmp(request, "GET / ", 6) != 0) {
+		static const char	not_found[] = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+		send_all(fd, not_found, sizeof(not_found) - 1);
+		return;
+	}
+
+	render();
+	header_length = snprintf(header, sizeof(header),
+		"HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %d\r\nConnection: close\r\n\r\n",
+		page_length);
+	if(send_all(fd, header, header_length)) {
+		send_all(fd, page, page_length);
+	}
+}
+
+static void* server_loop(void*)
+{
+	struct pollfd	pfd[2];
+	int		fd;
+
+	VLOG (1) << "Metrics server running";
+	pfd[0].fd = listen_fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = DSIThread_CancelGetFd(&server_stop);
+	pfd[1].events = POLLIN;
+	while(false == DSIThread_IsCancelled(&server_stop)) {
+		if(poll(pfd, 2, -1) <= 0 || !(pfd[0].revents & POLLIN)) {
+			continue;
+		}
+		fd = accept(listen_fd, NULL, NULL);
+		if(fd < 0) {
+			continue;
+		}
+		serve(fd);
+		close(fd);
+	}
+	return NULL;
+}
+
+bool metrics_server_start(const char* address)
+{
+	unix_address.sun_family = AF_UNSPEC;
+
+	if(address[0] == '/') {
+		struct stat	path_stat;
+
+		if(strlen(address) >= sizeof(unix_address.sun_path)) {
+			std::cout << "Metrics socket path too long" << std::endl;
+			return false;
+		}
+		memset(&unix_address, 0, sizeof(unix_address));
+		unix_address.sun_family = AF_UNIX;
+		strcpy(unix_address.sun_path, address);
+		// left behind by an earlier run, but never remove anything that is not a socket
+		if(lstat(address, &path_stat) == 0) {
+			if(!S_ISSOCK(path_stat.st_mode)) {
+				std::cout << "Metrics socket path " << address << " exists and is not a socket" << std::endl;
+				return false;
+			}
+			unlink(address);
+		}
+
+		listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(listen_fd < 0 || bind(listen_fd, (struct sockaddr*)&unix_address, sizeof(unix_address)) != 0) {
+			std::cout << "Failed to bind metrics socket " << address << ": " << strerror(errno) << std::endl;
+			goto failed;
+		}
+	} else {
+		struct sockaddr_in	inet_address;
+		int			port = atoi(address);
+		int			reuse = 1;
+
+		if(port <= 0 || port > 65535) {
+			std::cout << "Invalid metrics port " << address << std::endl;
+			return false;
+		}
+		memset(&inet_address, 0, sizeof(inet_address));
+		inet_address.sin_family = AF_INET;
+		inet_address.sin_port = htons(port);
+		inet_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+		if(listen_fd >= 0) {
+			setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+		}
+		if(listen_fd < 0 || bind(listen_fd, (struct sockaddr*)&inet_address, sizeof(inet_address)) != 0) {
+			std::cout << "Failed to bind metrics port " << port << ": " << strerror(errno) << std::endl;
+			goto failed;
+		}
+	}
+
+	if(listen(listen_fd, 4) != 0) {
+		std::cout << "Failed to listen for metrics: " << strerror(errno) << std::endl;
+		goto failed;
+	}
+
+	if(DSIThread_CancelInit(&server_stop) != DSI_THREAD_ENONE) {
+		std::cout << "Failed to create metrics stop eventfd: " << strerror(errno) << std::endl;
+		goto failed;
+	}
+	if(pthread_create(&server_thread, NULL, server_loop, NULL) != 0) {
+		std::cout << "Failed to start metrics thread" << std::endl;
+		DSIThread_CancelDestroy(&server_stop);
+		goto failed;
+	}
+	return true;
+
+failed:
+	if(listen_fd >= 0) {
+		close(listen_fd);
+		listen_fd = -1;
+	}
+	return false;
+}
+
+void metrics_server_stop()
+{
+	if(listen_fd < 0) {
+		return;
+	}
+	DSIThread_Cancel(&server_stop);
+	pthread_join(server_thread, NULL);
+	DSIThread_CancelDestroy(&server_stop);
+	close(listen_fd);
+	listen_fd = -1;
+	if(unix_address.sun_family == AF_UNIX) {
+		unlink(unix_address.sun_path);
+	}
+}
@@ -0,0 +1,61 @@
+/*
+ * BridgeMetrics.h
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef BRIDGE_METRICS_H
+#define BRIDGE_METRICS_H
+
+#include <stdint.h>
+
+// counters, bumped by the Fortius and CANTMaster threads
+#define METRIC_TRAINER_READS		0	// telemetry messages read from the Fortius
+#define METRIC_TRAINER_WRITES		1	// brake commands written to the Fortius
+#define METRIC_TRAINER_RECONNECTS	2	// Fortius USB port closed and reopened after an error
+#define METRIC_TRAINER_OVERRUNS		3	// Fortius read or write started late, its delay had already passed
+#define METRIC_PAGES_SENT		4	// pages handed to the ANT stick
+#define METRIC_PAGES_FAILED		5	// pages the stick would not take
+#define METRIC_COMMANDS			6	// FE-C control pages received
+#define METRIC_LOCAL_COMMANDS		7	// LocalControl datagrams taken
+#define METRIC_LOCAL_DROPPED		8	// LocalControl datagrams malformed, out of range or out of sequence
+#define METRIC_LOCAL_TIMEOUTS		9	// LocalControl went quiet and the FE-C display got the brake back
+#define METRIC_COUNTERS			10
+
+// what the bridge is doing right now, published once per CANTMaster loop
+typedef struct metrics_trainer_s {
+	uint16_t	device_id;		// ANT device number, the trainer label
+	int		mode;			// FT_ERGOMODE, FT_SSMODE or FT_CALIBRATE
+	double		target_power_watts;	// load asked of the brake
+	double		power_watts;		// measured
+	double		speed_kph;
+	double		cadence_rpm;
+	double		heartrate_bpm;
+} metrics_trainer_t;
+
+// Counting and publishing never block and never allocate, a scrape only
+// ever reads, so the control loops run the same with or without one.
+void	metrics_count(int counter);
+void	metrics_publish_trainer(const metrics_trainer_t* trainer);
+
+// Serves GET /metrics in the Prometheus text format from its own thread.
+// address is a TCP port on 127.0.0.1, or a Unix socket path if it starts
+// with '/'.  false if it could not listen.
+bool	metrics_server_start(const char* address);
+void	metrics_server_stop();
+
+#endif // BRIDGE_METRICS_H
@@ -19,6 +19,7 @@
  * limitations under the License.
  */
 #include "ant.h"
+#include "dsi_thread.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <iostream>
@@ -28,6 +29,9 @@
 #include <math.h>
 
 #include "CANTMaster.h"
+#include "LatencyStats.h"
+#include "BridgeMetrics.h"
+#include "TelemetryBus.h"
 
 #define USER_ANTCHANNEL 0
 #define DEVICE_ID	1147
@@ -50,6 +54,18 @@
 #define FEC_DEVICETYPE   0x11	// 0x11 with top bit set to turn on pairing
 #define HRM_RFFREQUENCY  0x39   //Set the RF frequency to channel 57 - 2.457GHz
 #define HRM_MESSAGEPERIOD  8070    //Set the message period to 8070 counts specific for the HRM
+#define FEC_MESSAGEPERIOD  8182    //4Hz
+#define FEC_INIT_TIMEOUT_MS	2000	// time allowed for the whole channel setup to be answered
+#define FEC_INIT_RETRIES	5
+// --low-power: events nothing here acts on stay on the stick, the rest come in batches
+#define FEC_EVENT_FILTER	(EVENT_FILTER_RX_SEARCH_TIMEOUT | EVENT_FILTER_RX_FAIL | EVENT_FILTER_TX \
+				| EVENT_FILTER_TRANSFER_TX_COMPLETED | EVENT_FILTER_TRANSFER_TX_FAILED \
+				| EVENT_FILTER_CHANNEL_COLLISION | EVENT_FILTER_RX_FAIL_GO_TO_SEARCH \
+				| EVENT_FILTER_TRANSFER_TX_START)
+#define FEC_EVENT_BUFFER_BYTES	64	// one full USB packet
+#define FEC_EVENT_BUFFER_MS	1000	// longest a page from the display waits on the stick
+// --rx-timestamps: fields the stick adds to pages from the display
+#define FEC_LIB_CONFIG		(ANT_LIB_CONFIG_MESG_OUT_INC_DEVICE_ID | ANT_LIB_CONFIG_MESG_OUT_INC_TIME_STAMP)
 
 #define GRAVITY 9.80665
 
@@ -151,7 +167,6 @@ bool CANTMaster::send_general_fe()
 	double		speed_kph;
 	double		distance_meters;
 	general_fe_t	general_fe;
-	timespec	current_time;
 
 	pthread_mutex_lock(&m_vars_mutex);
 	heartrate_bpm = m_heartrate_bpm;
@@ -159,9 +174,7 @@ bool CANTMaster::send_general_fe()
 	distance_meters = m_distance_meters;
 	pthread_mutex_unlock(&m_vars_mutex);
 
-	clock_gettime(CLOCK_MONOTONIC, &current_time);
-	uint32_t current_seconds = to_seconds(&current_time);
-	uint32_t elapsed_time_seconds = (current_seconds-m_start_seconds);
+	uint32_t elapsed_time_seconds = (DSIThread_GetSystemTime() - m_start_time_ms) / 1000;
 
 	general_fe.data_page_number = 0x10;
 	general_fe.equipment_type_bitfield = 25; // 0x19 trainer
@@ -321,10 +334,11 @@ bool CANTMaster::send_command_status(){
 
 // received pages
 
-bool CANTMaster::process_basic_resistance(basic_resistance_t*	basic_resistance)
+bool CANTMaster::process_basic_resistance(const basic_resistance_t*	basic_resistance)
 {
 	double		target_resistance_percentage;
 	double		target_power_watts;
+	command_block_t*	command;
 
 	if(PAGE_BASIC_RESISTANCE != basic_resistance->data_page_number) {
 		return false;
@@ -333,16 +347,21 @@ bool CANTMaster::process_basic_resistance(basic_resistance_t*	basic_resistance)
 	target_resistance_percentage /= 2;		// resistance comes in 0.5% increments so div by 2
 	target_power_watts = 1000 * (target_resistance_percentage/100);
 
-	VLOG (1) << "SET: Resistance based load: target_power_watts " << target_power_watts;
-
-	m_fortius->setLoad(target_power_watts);
+	// like target power, held back while local control has the brake
+	pthread_mutex_lock(&m_vars_mutex);
+	command = fec_command();
+	command->target_power_watts = target_power_watts;
+	command->requested_mode = FT_ERGOMODE;
+	pthread_mutex_unlock(&m_vars_mutex);
 
+	VLOG (1) << "SET: Resistance based load: target_power_watts " << target_power_watts;
 	return true;
 }
 
-bool CANTMaster::process_target_power(target_power_t*	target_power)
+bool CANTMaster::process_target_power(const target_power_t*	target_power)
 {
 	double 		target_power_watts;
+	command_block_t*	command;
 
 	if(PAGE_TARGET_POWER != target_power->data_page_number) {
 		return false;
@@ -352,8 +371,9 @@ bool CANTMaster::process_target_power(target_power_t*	target_power)
 
 
 	pthread_mutex_lock(&m_vars_mutex);
-	m_target_power_watts = target_power_watts;
-	m_requested_mode = FT_ERGOMODE;
+	command = fec_command();
+	command->target_power_watts = target_power_watts;
+	command->requested_mode = FT_ERGOMODE;
 	pthread_mutex_unlock(&m_vars_mutex);
 
 	//printf("\nSET: target_power_watts %f\n", target_power_watts);
@@ -362,11 +382,12 @@ bool CANTMaster::process_target_power(target_power_t*	target_power)
 
 }
 
-bool CANTMaster::process_wind_resistance(wind_resistance_t* wind_resistance)
+bool CANTMaster::process_wind_resistance(const wind_resistance_t* wind_resistance)
 {
 	double wind_speed_kph;
 	double drafting_factor;
 	double wind_resistance_coef;
+	command_block_t* command;
 
 	if(PAGE_WIND_RESISTANCE != wind_resistance->data_page_number) {
 		return false;
@@ -393,19 +414,21 @@ bool CANTMaster::process_wind_resistance(wind_resistance_t* wind_resistance)
 	}
 
 	pthread_mutex_lock(&m_vars_mutex);
-	m_wind_resistance_coef = wind_resistance_coef;
-	m_wind_speed_kph = wind_speed_kph;
-	m_drafting_factor = drafting_factor;
+	command = fec_command();
+	command->wind_resistance_coef = wind_resistance_coef;
+	command->wind_speed_kph = wind_speed_kph;
+	command->drafting_factor = drafting_factor;
 	pthread_mutex_unlock(&m_vars_mutex);
 //	printf("\nSET: wind resistance coef %f wind speed %f drafting factor %f\n", wind_resistance_coef, wind_speed_kph, drafting_factor);
 	VLOG (1) << "SET: wind res coef " << wind_resistance_coef << ", wind speed " << wind_speed_kph << ", draft fact " << drafting_factor;
 	return true;
 }
 
-bool CANTMaster::process_track_resistance(track_resistance_t* track_resistance)
+bool CANTMaster::process_track_resistance(const track_resistance_t* track_resistance)
 {
 	double slope;
 	double crr;
+	command_block_t* command;
 
 	if(PAGE_TRACK_RESISTANCE != track_resistance->data_page_number) {
 		return false;
@@ -428,9 +451,10 @@ bool CANTMaster::process_track_resistance(track_resistance_t* track_resistance)
 	}
 
 	pthread_mutex_lock(&m_vars_mutex);
-	m_slope = slope;
-	m_crr = crr;
-	m_requested_mode = FT_SSMODE;	// we will calculate power
+	command = fec_command();
+	command->slope = slope;
+	command->crr = crr;
+	command->requested_mode = FT_SSMODE;	// we will calculate power
 	pthread_mutex_unlock(&m_vars_mutex);
 
 	/* TODO: resolve the Slope mode issue
@@ -442,7 +466,7 @@ bool CANTMaster::process_track_resistance(track_resistance_t* track_resistance)
 	return true;
 }
 
-bool CANTMaster::process_user_configuration(user_configuration_t* user_configuration)
+bool CANTMaster::process_user_configuration(const user_configuration_t* user_configuration)
 {
 	double wheel_diameter_mm;
 	double wheel_circumference_mm;
@@ -497,7 +521,7 @@ bool CANTMaster::process_user_configuration(user_configuration_t* user_configura
 	VLOG (1) << "SET: user weight " << user_weight_kg << " [kg], bike weight " << bike_weight_kg << " [kg], wheel circ " << wheel_circumference_mm << " [mm]";
 	return true;
 }
-bool CANTMaster::process_request(request_t* request)
+bool CANTMaster::process_request(const request_t* request)
 {
 	if(PAGE_REQUEST != request->data_page_number) {
 		return false;
@@ -564,14 +588,14 @@ double CANTMaster::calc_power_required_watts(){
 	double drafting_factor;
 
 	// my user specs...get them
-	VLOG (2) <<"User weight: " << m_user_weight_kg << ", Bike weight: " << m_bike_weight_kg << ", Drafting factor: " << m_drafting_factor << ", Speed: " << m_speed_kph << ", Wind Speed: " << m_wind_speed_kph << ", Slope: " << m_slope;
+	VLOG (2) <<"User weight: " << m_user_weight_kg << ", Bike weight: " << m_bike_weight_kg << ", Drafting factor: " << m_command.drafting_factor << ", Speed: " << m_speed_kph << ", Wind Speed: " << m_command.wind_speed_kph << ", Slope: " << m_command.slope;
 	pthread_mutex_lock(&m_vars_mutex);
 	weight_kg = m_user_weight_kg + m_bike_weight_kg;
-	wind_resistance_coef = m_wind_resistance_coef;
-	crr = m_crr;
-	drafting_factor = m_drafting_factor;
-	speed_kph = m_speed_kph + m_wind_speed_kph;
-	slope = m_slope/100;				// slope is a percent...change it to a range  -1..1
+	wind_resistance_coef = m_command.wind_resistance_coef;
+	crr = m_command.crr;
+	drafting_factor = m_command.drafting_factor;
+	speed_kph = m_speed_kph + m_command.wind_speed_kph;
+	slope = m_command.slope/100;				// slope is a percent...change it to a range  -1..1
 	pthread_mutex_unlock(&m_vars_mutex);
 
 	f_gravity = GRAVITY * sin(atan(slope)) * weight_kg;
@@ -589,7 +613,7 @@ double CANTMaster::calc_power_required_watts(){
 }
 
 
-void CANTMaster::hex_dump(uint8_t* data, int data_size)
+void CANTMaster::hex_dump(const uint8_t* data, int data_size)
 {
 	int cnt;
 
@@ -601,12 +625,180 @@ void CANTMaster::hex_dump(uint8_t* data, int data_size)
 	}
 }
 
-CANTMaster* CANTMaster::this_ptr = NULL;
 
 bool CANTMaster::send(uint8_t* data){
+	uint64_t	now = latency_now_us();
+	uint64_t	sample_time = 0;
+	uint64_t	copy_time = 0;
+
 	m_sequence_number++;
 
-	return ANT_SendBroadcastData(m_channel_number, data);
+	pthread_mutex_lock(&m_vars_mutex);
+	if(PAGE_GENERAL_FE == data[0] || PAGE_SPECIFIC_TRAINER == data[0]) {
+		sample_time = m_sample_time_us;
+		copy_time = m_copy_time_us;
+	}
+	// the stick sends whatever it was given last in the next slot
+	m_tx_send_time_us = now;
+	m_tx_sample_time_us = sample_time;
+	pthread_mutex_unlock(&m_vars_mutex);
+	latency_record(LATENCY_COPY_TO_SEND, copy_time, now);
+
+	// the stick may be closed and reopened under us otherwise
+	pthread_mutex_lock(&m_stick_mutex);
+	if(m_stick_gone || FALSE == ANT_SendBroadcastData(m_channel_number, data)) {
+		pthread_mutex_unlock(&m_stick_mutex);
+		metrics_count(METRIC_PAGES_FAILED);
+		return false;
+	}
+	pthread_mutex_unlock(&m_stick_mutex);
+	metrics_count(METRIC_PAGES_SENT);
+	return true;
+}
+
+void CANTMaster::mark_command(uint64_t rx_time_us, uint64_t air_time_us)
+{
+	metrics_count(METRIC_COMMANDS);
+	pthread_mutex_lock(&m_vars_mutex);
+	// a page held back for later does not reach the brake now
+	if(0 == m_command_time_us && 0 == m_local_deadline_ms) {
+		m_command_time_us = rx_time_us;
+		m_command_air_time_us = air_time_us;
+	}
+	pthread_mutex_unlock(&m_vars_mutex);
+}
+
+command_block_t* CANTMaster::fec_command()
+{
+	return (0 == m_local_deadline_ms) ? &m_command : &m_ant_command;
+}
+
+void CANTMaster::local_control(const local_control_t* message, uint64_t rx_time_us, uint32_t timeout_ms)
+{
+	uint8_t		requested_mode;
+	double		target_power_watts;
+
+	pthread_mutex_lock(&m_vars_mutex);
+	if(0 == m_local_deadline_ms) {
+		// FE-C control pages wait in m_ant_command from here on
+		m_ant_command = m_command;
+		std::cout << "Local control has the brake" << std::endl;
+	}
+	m_local_deadline_ms = DSIThread_GetSystemTime() + timeout_ms;
+	if(0 == m_local_deadline_ms) {
+		m_local_deadline_ms = 1;
+	}
+	if(message->fields & LOCAL_CONTROL_WIND) {
+		m_command.wind_resistance_coef = message->wind_resistance_coef;
+		m_command.wind_speed_kph = message->wind_speed_kph;
+		m_command.drafting_factor = message->drafting_factor;
+	}
+	if(message->fields & LOCAL_CONTROL_TRACK) {
+		m_command.slope = message->slope_percent;
+		m_command.crr = message->crr;
+		m_command.requested_mode = FT_SSMODE;
+	}
+	if(message->fields & LOCAL_CONTROL_TARGET_POWER) {
+		m_command.target_power_watts = message->target_power_watts;
+		m_command.requested_mode = FT_ERGOMODE;
+	}
+	requested_mode = m_command.requested_mode;
+	target_power_watts = m_command.target_power_watts;
+	pthread_mutex_unlock(&m_vars_mutex);
+
+	if(0 == (message->fields & (LOCAL_CONTROL_TARGET_POWER | LOCAL_CONTROL_TRACK | LOCAL_CONTROL_WIND))) {
+		// keep alive
+		return;
+	}
+
+	// straight to the Fortius, the main loop would take up to a page period
+	if(FT_ERGOMODE == requested_mode) {
+		m_fortius->setMode(FT_ERGOMODE);
+		m_fortius->setLoad(target_power_watts);
+	} else if(FT_SSMODE == requested_mode) {
+		m_fortius->setMode(FT_ERGOMODE);
+		m_fortius->setLoad(calc_power_required_watts());
+	} else {
+		// calibrating, the main loop picks the command up once that is done
+		return;
+	}
+	m_fortius->markCommand(rx_time_us);
+}
+
+void CANTMaster::release_locked()
+{
+	m_command = m_ant_command;
+	m_local_deadline_ms = 0;
+}
+
+void CANTMaster::local_release()
+{
+	pthread_mutex_lock(&m_vars_mutex);
+	if(0 != m_local_deadline_ms) {
+		release_locked();
+		std::cout << "FE-C display has the brake" << std::endl;
+	}
+	pthread_mutex_unlock(&m_vars_mutex);
+}
+
+bool CANTMaster::local_watchdog()
+{
+	bool		expired = false;
+
+	pthread_mutex_lock(&m_vars_mutex);
+	// unsigned difference survives the millisecond clock wrapping
+	if(0 != m_local_deadline_ms && (int32_t)(DSIThread_GetSystemTime() - m_local_deadline_ms) >= 0) {
+		release_locked();
+		expired = true;
+	}
+	pthread_mutex_unlock(&m_vars_mutex);
+	if(expired) {
+		std::cout << "Local control timed out, FE-C display has the brake" << std::endl;
+	}
+	return expired;
+}
+
+void CANTMaster::print_ant_stats()
+{
+	ANT_STATS	stats;
+
+	if(FALSE == ANT_GetStats(&stats)) {
+		return;
+	}
+	std::cout << "ant_stats"
+		<< " usb_bytes_in=" << stats.ulUSBBytesIn
+		<< " usb_transfers_in=" << stats.ulUSBTransfersIn
+		<< " usb_read_errors=" << stats.ulUSBReadErrors
+		<< " usb_retries=" << stats.ulUSBTransferRetries
+		<< " usb_bytes_out=" << stats.ulUSBBytesOut
+		<< " usb_transfers_out=" << stats.ulUSBTransfersOut
+		<< " usb_write_errors=" << stats.ulUSBWriteErrors
+		<< " usb_rx_queue_high=" << stats.ulUSBRxQueueHighWater
+		<< " usb_rx_queue_overruns=" << stats.ulUSBRxQueueOverruns
+		<< " device_gone=" << stats.ulDeviceGone
+		<< " reconnects=" << stats.ulReconnects
+		<< std::endl;
+	std::cout << "ant_stats"
+		<< " frames_in=" << stats.ulFramesIn
+		<< " frames_out=" << stats.ulFramesOut
+		<< " crc_errors=" << stats.ulCRCErrors
+		<< " oversize_frames=" << stats.ulOversizeFrames
+		<< " queue_overflows=" << stats.ulQueueOverflows
+		<< " queue_high=" << stats.ulQueueHighWater
+		<< " serial_errors=" << stats.ulSerialErrors
+		<< " response_timeouts=" << stats.ulResponseTimeouts
+		<< " framer_errors=" << stats.ulFramerErrors
+		<< std::endl;
+	for(int channel = 0; channel < ANT_STATS_CHANNELS; channel++) {
+		if(stats.aulBroadcastsSent[channel] == 0 && stats.aulEventsReceived[channel] == 0) {
+			continue;
+		}
+		std::cout << "ant_stats"
+			<< " channel=" << channel
+			<< " broadcasts_sent=" << stats.aulBroadcastsSent[channel]
+			<< " events_received=" << stats.aulEventsReceived[channel]
+			<< std::endl;
+	}
 }
 
 void* CANTMaster::mainloop_helper(void *context)
@@ -620,40 +812,63 @@ CANTMaster::CANTMaster()
 	m_last_rx_command_id = 0xFF;	// no control page received yet
 	m_sequence_number = 0xFF;	// no control page rx
 	m_command_status = 0xFF;	// no control page rx
-	m_exit_flag = false;
-	this_ptr = this;
+	m_stop_token_valid = (DSIThread_CancelInit(&m_stop_token) == DSI_THREAD_ENONE);
 	m_channel_open = false;
 	m_retry_count = 0;
+	m_pthread = 0;
 	m_fortius = NULL;
 	m_channel_number = USER_ANTCHANNEL;
 	m_device_id = DEVICE_ID;
-	m_slope = 0;
+	m_command.slope = 0;
 	m_speed_kph = 0;
-	m_requested_mode = FT_ERGOMODE;
+	m_command.requested_mode = FT_ERGOMODE;
+	m_sample_time_us = 0;
+	m_copy_time_us = 0;
+	m_command_time_us = 0;
+	m_command_air_time_us = 0;
+	m_tx_send_time_us = 0;
+	m_tx_sample_time_us = 0;
 	pthread_mutex_init(&m_vars_mutex, NULL);
+	pthread_mutex_init(&m_stick_mutex, NULL);
+	m_stick_gone = false;
+	m_low_power = false;
+	m_rx_timestamps = false;
+	stick_clock_reset(&m_stick_clock);
 	// set some defaults
-	m_target_power_watts = 100;	// watts
+	m_command.target_power_watts = 100;	// watts
 	m_user_weight_kg = 93;	// 205 lbs
 	m_bike_weight_kg = 8.6;	// 19 lbs
 	m_wheel_circumference_mm = 2105;	// 700x25
 	m_user_config_state = USER_CONFIG_STATE_EMPTY;	// no data in user config
 
-	m_wind_resistance_coef = 0.51;// road  bike hoods
-	m_wind_speed_kph = 0;
-	m_drafting_factor = 1.0;
+	m_command.wind_resistance_coef = 0.51;// road  bike hoods
+	m_command.wind_speed_kph = 0;
+	m_command.drafting_factor = 1.0;
+	m_command.crr = 0.004;
+	m_ant_command = m_command;
+	m_local_deadline_ms = 0;
+	m_reactor = NULL;
+	m_tick_source = -1;
+	m_stick_source_count = 0;
 
 }
 
 CANTMaster::~CANTMaster()
 {
 	ANT_UnassignAllResponseFunctions();
-	ANT_Nap(2000);
 	ANT_Close();
+	DSIThread_CancelDestroy(&m_stop_token);
 }
-bool CANTMaster::init(Fortius* fortius)
+bool CANTMaster::init(Fortius* fortius, bool direct_dispatch, bool emulated_stick, bool low_power, bool rx_timestamps)
 {
 	m_fortius = fortius;
+	m_low_power = low_power;
+	m_rx_timestamps = rx_timestamps;
 
+	if(false == m_stop_token_valid) {
+		std::cout << "Failed to create ANT master stop eventfd" << std::endl;
+		return FALSE;
+	}
 	// set default load
 
 	//*
@@ -664,15 +879,20 @@ bool CANTMaster::init(Fortius* fortius)
 	m_fortius->setGradient(1);
 	//*/
 	m_retry_count=0;
-	if(false == ANT_Init(0,57600)) {
+	// direct dispatch runs our callbacks on the USB receive thread instead of the ANT message thread
+	// the emulated stick answers like a real one, so everything above the serial port runs unchanged
+	if(false == ANT_InitExt(0, 57600, emulated_stick ? PORT_TYPE_EMULATOR : PORT_TYPE_USB, direct_dispatch ? FRAMER_TYPE_DIRECT : FRAMER_TYPE_BASIC)) {
 		std::cout << "Failed ANT init" << std::endl;
 		return FALSE;
 	}
-	VLOG(1) << "ANT Assign Response Function";
-	ANT_AssignResponseFunction(CANTMaster::response_callback, m_response_buffer);
+	VLOG(1) << "ANT Assign Response Callback";
+	ANT_AssignResponseCallback(CANTMaster::response_callback, this);
+
+	VLOG(1) << "ANT Assign Event Callback";
+	ANT_AssignChannelEventCallback(m_channel_number, CANTMaster::channel_callback, this);
 
-	VLOG(1) << "ANT Assign Event Funcion";
-	ANT_AssignChannelEventFunction(m_channel_number,CANTMaster::channel_callback, m_channel_buffer);
+	// reopened as soon as it is plugged back in, see stick_handler()
+	ANT_AssignStickCallback(CANTMaster::stick_callback, this);
 
 	VLOG (1) << "Reset System";
 	if(ANT_ResetSystem()  == false) {
@@ -689,7 +909,9 @@ bool CANTMaster::init(Fortius* fortius)
 bool CANTMaster::start()
 {
 
-	pthread_create(&m_pthread,NULL,&CANTMaster::mainloop_helper,this);
+	// a DSIThread so a simulation can run the main loop on virtual time
+	m_pthread = DSIThread_CreateThread(&CANTMaster::mainloop_helper, this);
+	pthread_setname_np(m_pthread, "ant_master");
 
 	return TRUE;
 }
@@ -697,32 +919,124 @@ bool CANTMaster::join()
 {
 	void *    pthread_return;
 
+	if(0 == m_pthread) {
+		return TRUE;	// attached to a reactor instead
+	}
 	pthread_join(m_pthread, &pthread_return);
 	return TRUE;
 }
-bool CANTMaster::kill()
+
+bool CANTMaster::attach(Reactor* reactor)
 {
-	pthread_cancel(m_pthread);
+	m_reactor = reactor;
+	if(false == open_channel()) {
+		m_reactor = NULL;
+		return FALSE;
+	}
+	m_tick_source = m_reactor->add_timer(REACTOR_PRIORITY_BROADCAST, &CANTMaster::tick_callback, this);
+	if(m_tick_source < 0 || false == m_reactor->arm_timer(m_tick_source, 0, 250)) {
+		std::cout << "Failed to start the ANT broadcast timer" << std::endl;
+		m_reactor->remove(m_tick_source);
+		m_tick_source = -1;
+		m_reactor = NULL;
+		return FALSE;
+	}
+	stick_attach();
 	return TRUE;
 }
 
-double CANTMaster::to_seconds(struct timespec* ts)
+void CANTMaster::detach()
+{
+	if(NULL == m_reactor) {
+		return;
+	}
+	for(int i = 0; i < m_stick_source_count; i++) {
+		m_reactor->remove(m_stick_sources[i]);
+	}
+	m_stick_source_count = 0;
+	m_reactor->remove(m_tick_source);
+	m_tick_source = -1;
+	// the ANT calls in stop() wait on their responses
+	ANT_EventLoopDetach();
+	m_reactor = NULL;
+}
+
+void CANTMaster::tick_callback(void* context)
+{
+	CANTMaster*	me = (CANTMaster*)context;
+
+	if(DSIThread_IsCancelled(&me->m_stop_token) || false == me->tick()) {
+		me->m_reactor->remove(me->m_tick_source);
+		me->m_tick_source = -1;
+	}
+}
+
+void CANTMaster::stick_ready_callback(void*)
+{
+	ANT_EventLoopHandle();
+}
+
+void CANTMaster::stick_attach_callback(void* context)
+{
+	((CANTMaster*)context)->stick_attach();
+}
+
+// Without --direct the stick stays on its receive thread, which is fine,
+// only the broadcasts need the reactor.
+void CANTMaster::stick_attach()
 {
+	ANT_POLLFD	fds[ANT_EVENT_LOOP_MAX_FDS];
+	uint8_t		count;
 
-	return (double)ts->tv_sec + (double)ts->tv_nsec / 1000000000.0;
+	if(NULL == m_reactor) {
+		return;
+	}
+	// descriptors of a stick that went away are gone from the reactor already, but not their sources
+	for(int i = 0; i < m_stick_source_count; i++) {
+		m_reactor->remove(m_stick_sources[i]);
+	}
+	m_stick_source_count = 0;
+	if(false == ANT_EventLoopAttach()) {
+		VLOG (1) << "ANT stick stays on its receive thread";
+		return;
+	}
+	count = ANT_EventLoopGetFds(fds, ANT_EVENT_LOOP_MAX_FDS);
+	for(int i = 0; i < count; i++) {
+		// poll() and epoll events share their bits
+		int	source = m_reactor->add_fd(fds[i].iFd, fds[i].sEvents, REACTOR_PRIORITY_ANT, &CANTMaster::stick_ready_callback, this);
+
+		if(source < 0) {
+			std::cout << "Failed to add ANT stick descriptor to the reactor, back to its receive thread" << std::endl;
+			for(int j = 0; j < m_stick_source_count; j++) {
+				m_reactor->remove(m_stick_sources[j]);
+			}
+			m_stick_source_count = 0;
+			ANT_EventLoopDetach();
+			return;
+		}
+		m_stick_sources[m_stick_source_count++] = source;
+	}
+	// anything that came in before the descriptors were watched
+	ANT_EventLoopHandle();
 }
 
 bool CANTMaster::stop()
 {
+	// the main loop leaves its sleep before the channel goes
+	DSIThread_Cancel(&m_stop_token);
 	ANT_CloseChannel(m_channel_number);
 	ANT_UnassignAllResponseFunctions();
 	ANT_UnAssignChannel(m_channel_number);
-	m_exit_flag = true;
 	ANT_Close();
 
 	return TRUE;
 }
 
+uint8_t CANTMaster::get_channel_number()
+{
+	return m_channel_number;
+}
+
 bool CANTMaster::set_defaults (double init_user_weight, double init_bike_weight, double init_wheel_circumference_mm)
 {
 	pthread_mutex_lock(&m_vars_mutex);
@@ -735,13 +1049,46 @@ bool CANTMaster::set_defaults (double init_user_weight, double init_bike_weight,
 }
 
 void* CANTMaster::mainloop(void)
+{
+	if(false == open_channel()) {
+		return NULL;
+	}
+	while(false == DSIThread_IsCancelled(&m_stop_token) && tick()) {
+		// Sleep 250 msec, or until stop()
+		DSIThread_SleepCancellable(250, &m_stop_token);
+	}
+	return NULL;
+}
+
+bool CANTMaster::open_channel()
+{
+	m_channel_open = FALSE;
+	while(false == fec_init() && false == DSIThread_IsCancelled(&m_stop_token)) {
+		VLOG (1) << "Retry ANT channel open";
+		m_retry_count++;
+		if(FEC_INIT_RETRIES==m_retry_count) {
+			std::cout << "Failed to open ANT channel" << std::endl;
+			stop();
+			return false;
+		}
+	}
+
+	VLOG (1) << "ANT Channel open";
+
+	// start time
+	m_start_time_ms = DSIThread_GetSystemTime();
+	m_enter_button_state = EBS_UP;
+	m_common_pages_count = 0;
+	m_page_count = 0;
+	m_calibrate_count = 0;
+	m_power_required_watts = 0;
+	memset(&m_last_control, 0, sizeof(m_last_control));
+	return true;
+}
+
+bool CANTMaster::tick()
 {
 	uint32_t		count_mod_8;
-	uint8_t		enter_button_state = EBS_UP;
-//	bool			toggle = true;
-	uint32_t		common_pages_count = 0;
-	uint32_t	count = 0;
-	uint8_t		network_key[8] = ANTPLUS_NETWORK_KEY;
 	uint8_t		requested_mode;
 	double		target_power_watts;
 	double		power_produced_watts;
@@ -750,284 +1097,307 @@ void* CANTMaster::mainloop(void)
 	double		cadence_rpm;
 	double		distance_meters;
 	double		slope;
-	double		power_required_watts;
 	int				buttons;
 	int				steering;
 	int				status;
-	timespec	start_time;
-	int				calibrate_count;
+	uint64_t	sample_time_us;
+	uint64_t	copy_time_us;
+	uint64_t	command_time_us;
+	uint64_t	command_air_time_us;
+	metrics_trainer_t	trainer_metrics;
+	telemetry_bus_control_t	control;
+
+	if(m_channel_open == FALSE) {
+		stop();
+		return false;
+	}
+	memset(&control, 0, sizeof(control));
 
+	// read stats from the Fortius
+	m_fortius->getTelemetry(power_produced_watts, heartrate_bpm, cadence_rpm, speed_kph, distance_meters, buttons, steering, status, &sample_time_us);
+	copy_time_us = latency_now_us();
 
 
-	m_channel_open = FALSE;
-	//STEP1 ANT_SetNetworkKey
-	if(false == ANT_SetNetworkKey(0, network_key)) {
-		std::cout << "Failed to set ANT network key" << std::endl;
-		return NULL;
+	// slope was sent in on track_resistance page
+	pthread_mutex_lock(&m_vars_mutex);
+	// get mode and requested load
+	target_power_watts = m_command.target_power_watts;
+	requested_mode = m_command.requested_mode;
+	slope = m_command.slope;
+	command_time_us = m_command_time_us;
+	command_air_time_us = m_command_air_time_us;
+	m_command_time_us = 0;
+	m_command_air_time_us = 0;
+	control.slope_percent = m_command.slope;
+	control.crr = m_command.crr;
+	control.wind_resistance_coef = m_command.wind_resistance_coef;
+	control.wind_speed_kph = m_command.wind_speed_kph;
+	control.drafting_factor = m_command.drafting_factor;
+	control.user_weight_kg = m_user_weight_kg;
+	control.bike_weight_kg = m_bike_weight_kg;
+
+	// set everything else
+	m_power_produced_watts = power_produced_watts;
+	m_heartrate_bpm = heartrate_bpm;
+	m_cadence_rpm = cadence_rpm;
+	m_speed_kph = speed_kph;
+	m_distance_meters = distance_meters;
+	m_buttons = buttons;
+	if(sample_time_us != m_sample_time_us) {
+		// first copy of this sample
+		latency_record(LATENCY_READ_TO_COPY, sample_time_us, copy_time_us);
+		m_sample_time_us = sample_time_us;
+		m_copy_time_us = copy_time_us;
 	}
+	pthread_mutex_unlock(&m_vars_mutex);
 
-	while(FALSE == m_channel_open && false == m_exit_flag) {
-		VLOG (1) << "Wait for ANT channel open";
-		usleep(25000);	// wait 250ms (1/4 second)
-		m_retry_count++;
-		if(25==m_retry_count) {	// 10 seconds
-			stop();
-			return NULL;
-		}
+	// read buttons and adjust things as needed
+	if((buttons & (FT_PLUS | FT_MINUS)) == (FT_PLUS | FT_MINUS)){
+		requested_mode = FT_CALIBRATE;
+
+		pthread_mutex_lock(&m_vars_mutex);
+		m_command.requested_mode = requested_mode;
+		pthread_mutex_unlock(&m_vars_mutex);
+		m_calibrate_count = 40;
+	}else if((buttons & FT_PLUS) == FT_PLUS){
+		target_power_watts+=10;		// add 10 watts
+		std::cout << "New load: " << target_power_watts << "[W]" << std::endl;
+		pthread_mutex_lock(&m_vars_mutex);
+		m_command.target_power_watts = target_power_watts;
+		pthread_mutex_unlock(&m_vars_mutex);
+
+	}else if((buttons & FT_MINUS) == FT_MINUS){
+		target_power_watts-=10;		// -10 watts
+		std::cout << "New load: " << target_power_watts << "[W]" << std::endl;
+		pthread_mutex_lock(&m_vars_mutex);
+		m_command.target_power_watts = target_power_watts;
+		pthread_mutex_unlock(&m_vars_mutex);
 	}
 
-	VLOG (1) << "ANT Channel open";
+	// figure out which mode we are in and do something
+	if(requested_mode == FT_ERGOMODE){
+		m_power_required_watts = target_power_watts;
+		m_fortius->setMode(FT_ERGOMODE);
+		m_fortius->setLoad(m_power_required_watts);
+	}else if(requested_mode == FT_SSMODE){
+		m_power_required_watts = calc_power_required_watts();
+		m_fortius->setMode(FT_ERGOMODE);
+		m_fortius->setLoad(m_power_required_watts);
+	}else if(requested_mode == FT_CALIBRATE){
+		m_fortius->setMode(FT_CALIBRATE);
+		// if we are calibrating....average in calibration value
+		// do an exponential moving average
+		// on the raw power numbers from the machine
+		if(0 >= m_calibrate_count--){
+			requested_mode = FT_ERGOMODE;
+			pthread_mutex_lock(&m_vars_mutex);
+			m_command.requested_mode = requested_mode;
+			pthread_mutex_unlock(&m_vars_mutex);
+			std::cout << "Final calibration value: " << m_fortius->getBrakeCalibrationLoadRaw() << std::endl;
 
-	// start time
-	clock_gettime(CLOCK_MONOTONIC, &start_time);
-	m_start_seconds = to_seconds(&start_time);
-	while(false == m_exit_flag) {
-		if(m_channel_open == FALSE) {
-			stop();
-			return NULL;
+//				printf("\n final calibration value %f\n", m_fortius->getBrakeCalibrationLoadRaw());
 		}
+		std::cout << m_calibrate_count << " Calibration value: " << m_fortius->getBrakeCalibrationLoadRaw() << std::endl;
 
-		// read stats from the Fortius
-		m_fortius->getTelemetry(power_produced_watts, heartrate_bpm, cadence_rpm, speed_kph, distance_meters, buttons, steering, status);
+//			printf("\n %d calibration value %f\n",m_calibrate_count, m_fortius->getBrakeCalibrationLoadRaw());
+	} else {
+		std::cout << "Error: unknown mode" << std::endl;
+		requested_mode = FT_ERGOMODE;
 
-
-		// slope was sent in on track_resistance page
 		pthread_mutex_lock(&m_vars_mutex);
-		// get mode and requested load
-		target_power_watts = m_target_power_watts;
-		requested_mode = m_requested_mode;
-		slope = m_slope;
-
-		// set everything else
-		m_power_produced_watts = power_produced_watts;
-		m_heartrate_bpm = heartrate_bpm;
-		m_cadence_rpm = cadence_rpm;
-		m_speed_kph = speed_kph;
-		m_distance_meters = distance_meters;
-		m_buttons = buttons;
+		m_command.requested_mode = requested_mode;
 		pthread_mutex_unlock(&m_vars_mutex);
+	}
+	if(0 != command_time_us) {
+		m_fortius->markCommand(command_time_us, command_air_time_us);
+	}
 
-		// read buttons and adjust things as needed
-		if((buttons & (FT_PLUS | FT_MINUS)) == (FT_PLUS | FT_MINUS)){
-			requested_mode = FT_CALIBRATE;
-
-			pthread_mutex_lock(&m_vars_mutex);
-			m_requested_mode = requested_mode;
-			pthread_mutex_unlock(&m_vars_mutex);
-			calibrate_count = 40;
-		}else if((buttons & FT_PLUS) == FT_PLUS){
-			target_power_watts+=10;		// add 10 watts
-			std::cout << "New load: " << target_power_watts << "[W]" << std::endl;
-			pthread_mutex_lock(&m_vars_mutex);
-			m_target_power_watts = target_power_watts;
-			pthread_mutex_unlock(&m_vars_mutex);
+	// local readers get every control change, not just what the next page carries
+	control.mode = requested_mode;
+	control.target_power_watts = target_power_watts;
+	if(0 != memcmp(&control, &m_last_control, sizeof(control))) {
+		telemetry_bus_publish_control(copy_time_us, &control);
+		m_last_control = control;
+	}
 
-		}else if((buttons & FT_MINUS) == FT_MINUS){
-			target_power_watts-=10;		// -10 watts
-			std::cout << "New load: " << target_power_watts << "[W]" << std::endl;
-			pthread_mutex_lock(&m_vars_mutex);
-			m_target_power_watts = target_power_watts;
-			pthread_mutex_unlock(&m_vars_mutex);
-		}
+	trainer_metrics.device_id = m_device_id;
+	trainer_metrics.mode = requested_mode;
+	trainer_metrics.target_power_watts = m_power_required_watts;
+	trainer_metrics.power_watts = power_produced_watts;
+	trainer_metrics.speed_kph = speed_kph;
+	trainer_metrics.cadence_rpm = cadence_rpm;
+	trainer_metrics.heartrate_bpm = heartrate_bpm;
+	metrics_publish_trainer(&trainer_metrics);
+
+	/*printf("\rpower mk %fw, cadence %f, speed %fmph, power nd %fw power raw %f speed raw %f",
+		   power_produced_watts,
+		   cadence_rpm,
+		   m_speed_kph*0.62137100000000001,
+		   m_power_required_watts,
+		   m_fortius->rawPower,
+		   m_fortius->rawSpeed);
+
+	fflush(stdout);
+	*/
 
-		// figure out which mode we are in and do something
-		if(requested_mode == FT_ERGOMODE){
-			power_required_watts = target_power_watts;
-			m_fortius->setMode(FT_ERGOMODE);
-			m_fortius->setLoad(power_required_watts);
-		}else if(requested_mode == FT_SSMODE){
-			power_required_watts = calc_power_required_watts();
-			m_fortius->setMode(FT_ERGOMODE);
-			m_fortius->setLoad(power_required_watts);
-		}else if(requested_mode == FT_CALIBRATE){
-			m_fortius->setMode(FT_CALIBRATE);
-			// if we are calibrating....average in calibration value
-			// do an exponential moving average
-			// on the raw power numbers from the machine
-			if(0 >= calibrate_count--){
-				requested_mode = FT_ERGOMODE;
-				pthread_mutex_lock(&m_vars_mutex);
-				m_requested_mode = requested_mode;
-				pthread_mutex_unlock(&m_vars_mutex);
-				std::cout << "Final calibration value: " << m_fortius->getBrakeCalibrationLoadRaw() << std::endl;
+	VLOG_IF (2, requested_mode == FT_IDLE) << "MODE: FT_IDLE";
+	VLOG_IF (2, requested_mode == FT_ERGOMODE) << "MODE: FT_ERGOMODE";
+	VLOG_IF (2, requested_mode == FT_SSMODE) << "MODE: FT_SSMODE";
+	VLOG (2) << "power mk: " << power_produced_watts << "[W], cadence: " << cadence_rpm << "[rpm], speed: " << m_speed_kph << "[kmh]";
 
-//				printf("\n final calibration value %f\n", m_fortius->getBrakeCalibrationLoadRaw());
-			}
-			std::cout << calibrate_count << " Calibration value: " << m_fortius->getBrakeCalibrationLoadRaw() << std::endl;
+	std::cout << "Speed: " << m_speed_kph << " [kmh], Cadence: " << cadence_rpm << " [rpm], Power: " << power_produced_watts << " [W]\r"  << std::flush;
 
-//			printf("\n %d calibration value %f\n",calibrate_count, m_fortius->getBrakeCalibrationLoadRaw());
-		} else {
-			std::cout << "Error: unknown mode" << std::endl;
-			requested_mode = FT_ERGOMODE;
+	/* debug
+	power_produced_watts = 403;
+	cadence_rpm = 96;
+	m_speed_kph = 21;
+	distance_meters += 23;	// 23 meters every 1/4 second
+	*/
 
-			pthread_mutex_lock(&m_vars_mutex);
-			m_requested_mode = requested_mode;
-			pthread_mutex_unlock(&m_vars_mutex);
+	// enter button is lap button
+	if(m_enter_button_state == EBS_UP) {
+		if(0 != (buttons & FT_ENTER)) {
+			m_enter_button_state = EBS_DOWN;
 		}
-
-		/*printf("\rpower mk %fw, cadence %f, speed %fmph, power nd %fw power raw %f speed raw %f",
-			   power_produced_watts,
-			   cadence_rpm,
-			   m_speed_kph*0.62137100000000001,
-			   power_required_watts,
-			   m_fortius->rawPower,
-			   m_fortius->rawSpeed);
-
-		fflush(stdout);
-		*/
-
-		VLOG_IF (2, requested_mode == FT_IDLE) << "MODE: FT_IDLE";
-		VLOG_IF (2, requested_mode == FT_ERGOMODE) << "MODE: FT_ERGOMODE";
-		VLOG_IF (2, requested_mode == FT_SSMODE) << "MODE: FT_SSMODE";
-		VLOG (2) << "power mk: " << power_produced_watts << "[W], cadence: " << cadence_rpm << "[rpm], speed: " << m_speed_kph << "[kmh]";
-
-		std::cout << "Speed: " << m_speed_kph << " [kmh], Cadence: " << cadence_rpm << " [rpm], Power: " << power_produced_watts << " [W]\r"  << std::flush;
-
-		/* debug
-		power_produced_watts = 403;
-		cadence_rpm = 96;
-		m_speed_kph = 21;
-		distance_meters += 23;	// 23 meters every 1/4 second
-		*/
-
-		// enter button is lap button
-		if(enter_button_state == EBS_UP) {
-			if(0 != (buttons & FT_ENTER)) {
-				enter_button_state = EBS_DOWN;
-			}
-		} else if(enter_button_state == EBS_DOWN) {
-			if(0 == (buttons & FT_ENTER)) {
-				enter_button_state = EBS_LAP;
-			}
+	} else if(m_enter_button_state == EBS_DOWN) {
+		if(0 == (buttons & FT_ENTER)) {
+			m_enter_button_state = EBS_LAP;
 		}
+	}
 
-		count_mod_8 = count%8;
-		VLOG (2) << "page " << count << ", common page " << common_pages_count << ", intra 8 pages count " << count_mod_8;
-
-		// 66 pages
-		switch (count) {
-				// Common pages 80 and 81 are transmitted alternatively after every 64 pages
-				// Both are sent 2x consecutively
-				case 64:
-				case 65:
-					if ((common_pages_count == 0) || (common_pages_count == 1)) {
-						// Transmit common pages 80 2x consecutively after 64 pages
-						if(send_manufacturer_information() != true) {
-							std::cout << "Failed to send common data page 80" << std::endl;
-							// TODO: reset connection?
+	count_mod_8 = m_page_count%8;
+	VLOG (2) << "page " << m_page_count << ", common page " << m_common_pages_count << ", intra 8 pages m_page_count " << count_mod_8;
+
+	// 66 pages
+	switch (m_page_count) {
+			// Common pages 80 and 81 are transmitted alternatively after every 64 pages
+			// Both are sent 2x consecutively
+			case 64:
+			case 65:
+				if ((m_common_pages_count == 0) || (m_common_pages_count == 1)) {
+					// Transmit common pages 80 2x consecutively after 64 pages
+					if(send_manufacturer_information() != true) {
+						std::cout << "Failed to send common data page 80" << std::endl;
+						// TODO: reset connection?
+					};
+				} else {
+					// Transmit common pages 80 2x consecutively after 130 pages
+					if(send_product_information() != true) {
+						std::cout << "Failed to send common data page 81" << std::endl;
+						// TODO: reset
+					};
+				};
+				m_common_pages_count = (m_common_pages_count+1)%4;
+				break;
+
+			default:
+				// 8 pages
+				// 0, 1, 4, 5	: 0x10 (16) General FE Data
+				// 2, 6				: 0x19 (25) Specific Trainer Data
+				// 3					: 0x11 (17) General Settings Page
+				// 7					: 0x12 (18) General FE Metabolic Data (OPTIONAL)
+				//
+
+				switch (count_mod_8) {
+					case 0:
+					case 1:
+					case 4:
+					case 5:
+						// send page 0x10 (16) General FE Data
+						if (send_general_fe () != true) {
+							std::cout << "Failed to send general fe (0x10-16)" << std::endl;
+							// TODO reset
 						};
-					} else {
-						// Transmit common pages 80 2x consecutively after 130 pages
-						if(send_product_information() != true) {
-							std::cout << "Failed to send common data page 81" << std::endl;
+						break;
+
+					case 2:
+					case 6:
+						// send page 0x19 (25) Specific Trainer Data
+						if (send_specific_trainer () != true) {
+							std::cout << "Failed to send specific trainer (0x19-25)" << std::endl;
 							// TODO: reset
 						};
-					};
-					common_pages_count = (common_pages_count+1)%4;
-					break;
-
-				default:
-					// 8 pages
-					// 0, 1, 4, 5	: 0x10 (16) General FE Data
-					// 2, 6				: 0x19 (25) Specific Trainer Data
-					// 3					: 0x11 (17) General Settings Page
-					// 7					: 0x12 (18) General FE Metabolic Data (OPTIONAL)
-					//
-
-					switch (count_mod_8) {
-						case 0:
-						case 1:
-						case 4:
-						case 5:
-							// send page 0x10 (16) General FE Data
-							if (send_general_fe () != true) {
-								std::cout << "Failed to send general fe (0x10-16)" << std::endl;
-								// TODO reset
-							};
-							break;
-
-						case 2:
-						case 6:
-							// send page 0x19 (25) Specific Trainer Data
-							if (send_specific_trainer () != true) {
-								std::cout << "Failed to send specific trainer (0x19-25)" << std::endl;
-								// TODO: reset
-							};
-							break;
-
-						case 3:
-							// send page 0x11 (17) General Settings Page
-							if (send_general_settings () != true) {
-								std::cout << "Failed to send general settings (0x11-17)" << std::endl;
-								// TODO: reset
-							};
-							break;
-
-						case 7:
-							// send page 0x12 (18) General FE Metabolic Data (OPtIONAL)
-							break;
-					};
-		};
-		// Send 64+2 consecutive pages each time
-		count = (count+1)%66;
-		// Sleep 250 msec
-		usleep(250000);
-
-
-		/*
-		if(count == 64 || count == 65) {
-			if(toggle == true) {
-				// send common page 80
-				if(false == send_manufacturer_information()) {
-					printf("\nfailed to send common data page 80\n");
-					// TODO: reset connection?
-				}
-				toggle = false;
-			} else {
-				// send common page 81
-				if(false == send_product_information()) {
-					printf("\nfailed to send common data page 81\n");
-					// TODO: reset
-				}
-				toggle = true;
-			}
-		} else if((count_mod_8 == 0) || (count_mod_8 == 1) || (count_mod_8 == 4) || (count_mod_8 == 5)) {
-			// send page 0x10 16
-			if(false == send_general_fe()) {
-				printf("\nfailed to send general fe 0x10 (16)\n");
-				// TODO reset
-			}
-		} else if( (count_mod_8 == 2) || (count_mod_8 == 6)) {
-			// send FE specific page
-			if(false == send_specific_trainer()) {	//uint8_t cadence, uint16_t power)){
-				printf("\nfailed to send specifi trainer \n");
-				// TODO: reset
+						break;
+
+					case 3:
+						// send page 0x11 (17) General Settings Page
+						if (send_general_settings () != true) {
+							std::cout << "Failed to send general settings (0x11-17)" << std::endl;
+							// TODO: reset
+						};
+						break;
+
+					case 7:
+						// send page 0x12 (18) General FE Metabolic Data (OPtIONAL)
+						break;
+				};
+	};
+	// Send 64+2 consecutive pages each time
+	m_page_count = (m_page_count+1)%66;
+
+	// replies to what just went out, rather than on the next timer
+	if(m_reactor != NULL) {
+		ANT_EventLoopHandle();
+	}
+
+
+	/*
+	if(count == 64 || count == 65) {
+		if(toggle == true) {
+			// send common page 80
+			if(false == send_manufacturer_information()) {
+				printf("\nfailed to send common data page 80\n");
+				// TODO: reset connection?
 			}
-		} else if((count_mod_8 == 3) || (count_mod_8 == 7)) {
-			// send page 17
-			if(false == send_general_settings()) {	//  (int16_t incline_percent, uint8_t resistance)
-				printf("\nfailed to send general settings 0x11 (17)\n");
+			toggle = false;
+		} else {
+			// send common page 81
+			if(false == send_product_information()) {
+				printf("\nfailed to send common data page 81\n");
 				// TODO: reset
 			}
-		} else {
-			printf("\nunaccounted for count %d countmod8 %d\n", count,  count%8);
+			toggle = true;
+		}
+	} else if((count_mod_8 == 0) || (count_mod_8 == 1) || (count_mod_8 == 4) || (count_mod_8 == 5)) {
+		// send page 0x10 16
+		if(false == send_general_fe()) {
+			printf("\nfailed to send general fe 0x10 (16)\n");
+			// TODO reset
+		}
+	} else if( (count_mod_8 == 2) || (count_mod_8 == 6)) {
+		// send FE specific page
+		if(false == send_specific_trainer()) {	//uint8_t cadence, uint16_t power)){
+			printf("\nfailed to send specifi trainer \n");
+			// TODO: reset
 		}
+	} else if((count_mod_8 == 3) || (count_mod_8 == 7)) {
+		// send page 17
+		if(false == send_general_settings()) {	//  (int16_t incline_percent, uint8_t resistance)
+			printf("\nfailed to send general settings 0x11 (17)\n");
+			// TODO: reset
+		}
+	} else {
+		printf("\nunaccounted for count %d countmod8 %d\n", count,  count%8);
+	}
 
-		count = (count+1)%66;	// inc and loop back every 66
+	count = (count+1)%66;	// inc and loop back every 66
 
-		usleep(250000);	// sleep 1/4 second
+	usleep(250000);	// sleep 1/4 second
 */
-	}
-	return NULL;
+	return true;
 }
 
-int8_t CANTMaster::channel_callback(uint8_t channel_number, uint8_t event)
+int8_t CANTMaster::channel_callback(void* context, uint8_t channel_number, uint8_t event, const uint8_t* message, uint16_t size)
 {
-	return this_ptr->channel_handler(channel_number, event);
+	return ((CANTMaster*)context)->channel_handler(channel_number, event, message, size);
 }
 
-int8_t CANTMaster::channel_handler(uint8_t channel_number, uint8_t event)
+int8_t CANTMaster::channel_handler(uint8_t channel_number, uint8_t event, const uint8_t* message, uint16_t size)
 {
+	uint64_t	rx_time_us = latency_now_us();
+	uint64_t	air_time_us = 0;
+	uint64_t	send_time_us;
+	uint64_t	sample_time_us;
 	//printf("\nRx Channel Event:"<<(int)event<<",channel:"<<(int)channel_number;
 
 	switch(event) {
@@ -1035,47 +1405,62 @@ int8_t CANTMaster::channel_handler(uint8_t channel_number, uint8_t event)
 	case EVENT_RX_FLAG_BURST_PACKET:
 	case EVENT_RX_FLAG_BROADCAST:
 		VLOG (1) << "Rx Channel Flag " << channel_number << ", event " << event;
-		break;
-
+		if(size <= FEC_PAGE_MESSAGE_SIZE) {
+			break;
+		}
+		air_time_us = flagged_air_time(message, size, rx_time_us);
+		// the page is where it is without the flag
+		/* fall through */
 	case EVENT_RX_ACKNOWLEDGED:
 	case EVENT_RX_BURST_PACKET:
 	case EVENT_RX_BROADCAST:
-		VLOG (1) << "Rx Channel Event " << channel_number << ", command " << m_channel_buffer [1];
-		switch(m_channel_buffer[1]) {
-		m_last_rx_command_id = m_channel_buffer[1];
+		if(size < FEC_PAGE_MESSAGE_SIZE) {
+			break;
+		}
+		VLOG (1) << "Rx Channel Event " << channel_number << ", command " << message [1];
+		switch(message[1]) {
+		m_last_rx_command_id = message[1];
 		m_command_status = COMMAND_STATUS_PASS;			// default to this, then switch to an error if needed
 		case(PAGE_BASIC_RESISTANCE):
-			if(false == process_basic_resistance((basic_resistance_t*)&m_channel_buffer[1])) {
+			if(false == process_basic_resistance((const basic_resistance_t*)&message[1])) {
 				m_command_status = COMMAND_STATUS_FAILED;
 				std::cout << "Failed to process basic resistance message" << std::endl;
+			} else {
+				mark_command(rx_time_us, air_time_us);
 			}
 			break;
 		case(PAGE_TARGET_POWER):
-			if(false == process_target_power((target_power_t*)&m_channel_buffer[1])) {
+			if(false == process_target_power((const target_power_t*)&message[1])) {
 				m_command_status = COMMAND_STATUS_FAILED;
 				std::cout << "Failed to process target power message" << std::endl;
+			} else {
+				mark_command(rx_time_us, air_time_us);
 			}
 			break;
 		case(PAGE_WIND_RESISTANCE):
-			if(false == process_wind_resistance((wind_resistance_t*)&m_channel_buffer[1])) {
+			if(false == process_wind_resistance((const wind_resistance_t*)&message[1])) {
 				m_command_status = COMMAND_STATUS_FAILED;
 				std::cout << "Failed to process wind resistance message" << std::endl;
+			} else {
+				mark_command(rx_time_us, air_time_us);
 			}
 			break;
 		case(PAGE_TRACK_RESISTANCE):
-			if(false == process_track_resistance((track_resistance_t*)&m_channel_buffer[1])) {
+			if(false == process_track_resistance((const track_resistance_t*)&message[1])) {
 				m_command_status = COMMAND_STATUS_FAILED;
 				std::cout << "Failed to process track resistance message" << std::endl;
+			} else {
+				mark_command(rx_time_us, air_time_us);
 			}
 			break;
 		case(PAGE_USER_CONFIGURATION):
-			if(false == process_user_configuration((user_configuration_t*)&m_channel_buffer[1])) {
+			if(false == process_user_configuration((const user_configuration_t*)&message[1])) {
 				m_command_status = COMMAND_STATUS_FAILED;
 				std::cout << "Failed to process user configuration message" << std::endl;
 			}
 			break;
 		case(PAGE_REQUEST):
-			if(false == process_request((request_t*)&m_channel_buffer[1])) {
+			if(false == process_request((const request_t*)&message[1])) {
 				m_command_status = COMMAND_STATUS_FAILED;
 				std::cout << "Failed to process page request message" << std::endl;
 			}
@@ -1083,7 +1468,7 @@ int8_t CANTMaster::channel_handler(uint8_t channel_number, uint8_t event)
 		default:
 			std::cout << "Unknown message" << std::endl;
 			m_command_status = COMMAND_STATUS_NOT_SUPPORTED;
-			hex_dump((uint8_t*)&m_channel_buffer[0], sizeof(m_channel_buffer));
+			hex_dump(message, size);
 			break;
 		}
 
@@ -1096,7 +1481,15 @@ int8_t CANTMaster::channel_handler(uint8_t channel_number, uint8_t event)
 //		printf("\nRx Channel EXT %d, event %d\n", channel_number, event);
 		break;
 	case EVENT_TX:
-		// ignore tx events
+		// the slot the last page went out in
+		pthread_mutex_lock(&m_vars_mutex);
+		send_time_us = m_tx_send_time_us;
+		sample_time_us = m_tx_sample_time_us;
+		m_tx_send_time_us = 0;
+		m_tx_sample_time_us = 0;
+		pthread_mutex_unlock(&m_vars_mutex);
+		latency_record(LATENCY_SEND_TO_TX, send_time_us, rx_time_us);
+		latency_record(LATENCY_READ_TO_TX, sample_time_us, rx_time_us);
 		break;
 	default:
 //		printf("\nRx Channel %d, event %d unknown\n", channel_number, event);
@@ -1106,11 +1499,11 @@ int8_t CANTMaster::channel_handler(uint8_t channel_number, uint8_t event)
 
 	return TRUE;
 }
-int8_t CANTMaster::response_callback(uint8_t channel_number, uint8_t message_id)
+int8_t CANTMaster::response_callback(void* context, uint8_t channel_number, uint8_t message_id, const uint8_t* message, uint16_t size)
 {
-	return this_ptr->response_handler(channel_number, message_id);
+	return ((CANTMaster*)context)->response_handler(channel_number, message_id, message, size);
 }
-int8_t CANTMaster::response_handler(uint8_t channel_number, uint8_t message_id)
+int8_t CANTMaster::response_handler(uint8_t channel_number, uint8_t message_id, const uint8_t* message, uint16_t size)
 {
 	if(channel_number != m_channel_number) {
 		std::cout << "Invalid channel message received: " << channel_number << " iso " << m_channel_number << std::endl;
@@ -1119,7 +1512,10 @@ int8_t CANTMaster::response_handler(uint8_t channel_number, uint8_t message_id)
 
 	switch(message_id) {
 	case MESG_RESPONSE_EVENT_ID: {
-		fec_init(m_response_buffer[MESSAGE_ID_INDEX],m_response_buffer[MESSAGE_RESULT_INDEX]);
+		// channel setup waits on its own responses in fec_init, just log failures here
+		if(size > MESSAGE_RESULT_INDEX && RESPONSE_NO_ERROR != message[MESSAGE_RESULT_INDEX]) {
+			VLOG (1) << "ANT message " << (int)message[MESSAGE_ID_INDEX] << " failed with " << (int)message[MESSAGE_RESULT_INDEX];
+		}
 		break;
 	}
 	default:
@@ -1128,58 +1524,121 @@ int8_t CANTMaster::response_handler(uint8_t channel_number, uint8_t message_id)
 	return TRUE;
 }
 
-bool CANTMaster::fec_init(uint8_t message_id,uint8_t result)
+void CANTMaster::stick_callback(void* context, uint8_t event)
 {
-	uint8_t network_key[8] = ANTPLUS_NETWORK_KEY;
-
-	if(RESPONSE_NO_ERROR!=result) {
-		return FALSE;
-	}
+	((CANTMaster*)context)->stick_handler(event);
+}
+void CANTMaster::stick_handler(uint8_t event)
+{
+	int	retries = 0;
 
-	switch(message_id) {
-	//step 1 setneworkkey
-	case MESG_NETWORK_KEY_ID:
-		if(false == ANT_AssignChannel(0/*channel*/, 0x10/*master*/, 0/*network_num*/)) {
-			std::cout << "Failed ANT assign channel" << std::endl;
+	switch(event) {
+	case ANT_STICK_GONE:
+		std::cout << "ANT stick gone, waiting for it to come back" << std::endl;
+		pthread_mutex_lock(&m_stick_mutex);
+		m_stick_gone = true;
+		pthread_mutex_unlock(&m_stick_mutex);
+		break;
+	case ANT_STICK_BACK:
+		// it comes back reset, the channel setup goes out again in one command group
+		while(false == fec_init()) {
+			if(++retries == FEC_INIT_RETRIES || DSIThread_IsCancelled(&m_stop_token)) {
+				std::cout << "Failed to open ANT channel on the stick that came back" << std::endl;
+				m_channel_open = FALSE;	// mainloop gives up as it does at startup
+				return;
+			}
+		}
+		pthread_mutex_lock(&m_stick_mutex);
+		m_stick_gone = false;
+		pthread_mutex_unlock(&m_stick_mutex);
+		if(NULL != m_reactor) {
+			m_reactor->post(&CANTMaster::stick_attach_callback, this);
 		}
+		std::cout << "ANT stick back, channel open" << std::endl;
 		break;
+	}
+}
 
-	//step2 assignchannelid
-	case MESG_ASSIGN_CHANNEL_ID:
-		ANT_SetChannelId(0, m_device_id, FEC_DEVICETYPE, 0x05);
-		break;
+bool CANTMaster::fec_init()
+{
+	uint8_t network_key[8] = ANTPLUS_NETWORK_KEY;
+	uint8_t group;
 
-	//step3 ANT_SetChannelId
-	case MESG_CHANNEL_ID_ID:
-		ANT_SetChannelRFFreq(0, HRM_RFFREQUENCY/*USER_RADIOFREQ*/);
-		break;
+	// queue the whole channel setup, it goes out in one write and we wait once for all the responses
+	group = ANT_BeginCommandGroup();
+	if(0 == group) {
+		std::cout << "Failed to start ANT command group" << std::endl;
+		return FALSE;
+	}
+	ANT_SetNetworkKey(0, network_key);
+	ANT_AssignChannel(m_channel_number, 0x10/*master*/, 0/*network_num*/);
+	ANT_SetChannelId(m_channel_number, m_device_id, FEC_DEVICETYPE, 0x05);
+	ANT_SetChannelRFFreq(m_channel_number, HRM_RFFREQUENCY/*USER_RADIOFREQ*/);
+	ANT_SetChannelPeriod(m_channel_number, FEC_MESSAGEPERIOD);
+	ANT_OpenChannel(m_channel_number);
+
+	if(false == ANT_WaitCommandGroup(group, FEC_INIT_TIMEOUT_MS)) {
+		std::cout << "Failed ANT channel setup" << std::endl;
+		// start from scratch on the retry
+		ANT_UnAssignChannel_RTO(m_channel_number, FEC_INIT_TIMEOUT_MS);
+		return FALSE;
+	}
 
-	//step4 ANT_SetChannelRFFreq
-	case MESG_CHANNEL_RADIO_FREQ_ID:
-		ANT_SetChannelPeriod(0, 8182);//HRM_MESSAGEPERIOD);
-		break;
+	stick_options_init();
 
-	//step5 ANT_SetChannelPeriod
-	case  MESG_CHANNEL_MESG_PERIOD_ID:
-		ANT_OpenChannel(0);
-		break;
+	//we success do it!
+	m_channel_open = TRUE;
+	return TRUE;
+}
 
-	//step6 ANT_OpenChannel
-	case MESG_OPEN_CHANNEL_ID:
-		//we success do it!
-		m_channel_open = TRUE;
-		break;
+// Older sticks reject some of these, the bridge then runs as it would
+// without the option.
+void CANTMaster::stick_options_init()
+{
+	if(m_low_power) {
+		if(FALSE == ANT_ConfigEventFilter_RTO(FEC_EVENT_FILTER, FEC_INIT_TIMEOUT_MS)) {
+			std::cout << "ANT stick has no event filtering, every EVENT_TX still reaches the host" << std::endl;
+		}
+		if(FALSE == ANT_ConfigEventBuffer_RTO(EVENT_BUFFER_LOW_PRIORITY, FEC_EVENT_BUFFER_BYTES, FEC_EVENT_BUFFER_MS / EVENT_BUFFER_TIME_UNIT_MS, FEC_INIT_TIMEOUT_MS)) {
+			std::cout << "ANT stick has no event buffering" << std::endl;
+		}
+	}
+	if(m_rx_timestamps) {
+		// a stick that came back has its own clock
+		pthread_mutex_lock(&m_vars_mutex);
+		stick_clock_reset(&m_stick_clock);
+		pthread_mutex_unlock(&m_vars_mutex);
+		if(FALSE == ANT_SetLibConfig_RTO(FEC_LIB_CONFIG, FEC_INIT_TIMEOUT_MS)) {
+			std::cout << "ANT stick has no receive time stamps" << std::endl;
+		}
+	}
+}
 
-	default:
-		std::cout << "Unknown MESG type: " << message_id << std::endl;
-		m_retry_count++;
-		if(m_retry_count>=10) {
-			std::cout << "Retry failed" << std::endl;
-			stop();
-		} else {
-			ANT_SetNetworkKey(0, network_key);
+// The flag byte follows the page, then the fields it flags in a fixed order.
+uint64_t CANTMaster::flagged_air_time(const uint8_t* message, uint16_t size, uint64_t rx_time_us)
+{
+	uint8_t		flags = message[FEC_PAGE_MESSAGE_SIZE];
+	uint16_t	offset = FEC_PAGE_MESSAGE_SIZE + 1;
+	uint16_t	stamp;
+	uint64_t	air_time_us;
+
+	if(flags & ANT_EXT_MESG_BITFIELD_DEVICE_ID) {
+		if(offset + ANT_EXT_MESG_DEVICE_ID_FIELD_SIZE <= size) {
+			VLOG (2) << "Rx from device " << (message[offset] | (message[offset + 1] << 8)) << " type " << (int)message[offset + 2];
 		}
-		break;
+		offset += ANT_EXT_MESG_DEVICE_ID_FIELD_SIZE;
 	}
-	return TRUE;
+	if(flags & ANT_EXT_MESG_BITFIELD_RSSI) {
+		offset += ANT_EXT_MESG_RSSI_FIELD_SIZE;
+	}
+	if(0 == (flags & ANT_EXT_MESG_BITFIELD_TIME_STAMP) || offset + ANT_EXT_MESG_TIME_STAMP_FIELD_SIZE > size) {
+		return 0;
+	}
+	stamp = message[offset] | (message[offset + 1] << 8);
+
+	pthread_mutex_lock(&m_vars_mutex);
+	air_time_us = stick_clock_air_time_us(&m_stick_clock, stamp, rx_time_us);
+	pthread_mutex_unlock(&m_vars_mutex);
+	latency_record(LATENCY_AIR_TO_RX, air_time_us, rx_time_us);
+	return air_time_us;
 }
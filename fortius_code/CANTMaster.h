@@ -18,9 +18,16 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#ifndef CANTMASTER_H
+#define CANTMASTER_H
+
 #include "Fortius.h"
 #include "ant.h"
 #include "ManufacturersList.h"
+#include "LocalControl.h"
+#include "StickClock.h"
+#include "TelemetryBus.h"
+#include "Reactor.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -28,8 +35,7 @@
 #include <glog/logging.h>
 
 
-#define MAX_CHANNEL_EVENT_SIZE   (MESG_MAX_SIZE_VALUE)     // Channel event buffer size, assumes worst case extended message size
-#define MAX_RESPONSE_SIZE        (MESG_MAX_SIZE_VALUE)     // Protocol response buffer size
+#define FEC_PAGE_MESSAGE_SIZE    (MESG_CHANNEL_NUM_SIZE + ANT_STANDARD_DATA_PAYLOAD_SIZE)     // channel number, then the page
 
 #define PAGE_BASIC_RESISTANCE	0x30
 #define PAGE_TARGET_POWER	0x31
@@ -109,30 +115,76 @@ typedef struct common_page_71_s{
 
 #pragma pack(pop)
 
+// load the brake is driven to, set by the FE-C control pages or by LocalControl
+typedef struct command_block_s {
+	uint8_t		requested_mode;		// FT_ERGOMODE, FT_SSMODE or FT_CALIBRATE
+	// from set target power page 49
+	double		target_power_watts;
+	// from wind_resistance page 50
+	double		wind_resistance_coef;
+	double		wind_speed_kph;
+	double		drafting_factor;
+	// from track_resistance page 51
+	double		slope;
+	double		crr;
+} command_block_t;
+
 //this class for ANT+ Master
 class CANTMaster
 {
 public:
 		CANTMaster();
 		~CANTMaster();
-	bool	init(Fortius* fortius);
+	// low_power leaves EVENT_TX and the other events nothing here acts on
+	// on the stick and has it hold broadcast pages from the display until a
+	// USB packet is full or FEC_EVENT_BUFFER_MS has passed.  Commands and
+	// acknowledged pages still come straight through.  The send to air
+	// latency stats stop, they are timed from EVENT_TX.
+	// rx_timestamps has the stick add the channel ID and its receive time
+	// stamp to every page from the display, so command latency can be
+	// timed from the air and late deliveries from the stick are seen.
+	bool	init(Fortius* fortius, bool direct_dispatch = false, bool emulated_stick = false, bool low_power = false, bool rx_timestamps = false);
 	bool	start();
+	// --reactor instead of start(): opens the channel here, then the
+	// broadcasts run off a timer on the reactor and, with direct_dispatch,
+	// the stick is read from it instead of its receive thread.  Channel
+	// setup after a reconnect still waits on the receive thread, the stick
+	// is handed back to the reactor once it is done.
+	bool	attach(Reactor* reactor);
+	void	detach();		// on the reactor thread, once it has stopped, before stop()
 	bool	join();
 	bool	stop();
-	bool	kill();
 	bool  set_defaults (double init_user_weight, double init_bike_weight, double init_wheel_circumference_mm);
+	uint8_t	get_channel_number();
+
+	// see LocalControl.h
+	void	local_control(const local_control_t* message, uint64_t rx_time_us, uint32_t timeout_ms);
+	void	local_release();	// the FE-C display gets the brake back
+	bool	local_watchdog();	// true if local control just timed out
+
+	static void	print_ant_stats();	// counters from every layer of the ANT library, see ANT_GetStats()
 
 	static void*	mainloop_helper(void *context);
 	void*		mainloop(void);
+	bool		open_channel();	// fec_init() with retries, then the page counters start
+	bool		tick();		// one 250 ms round of mainloop(), false once the channel is closed
 private:
 
-	void		hex_dump(uint8_t* data, int data_size);
-	double	to_seconds(struct timespec* ts);
-	static int8_t	channel_callback(uint8_t channel_number, uint8_t event);
-	int8_t		channel_handler(uint8_t channel_number, uint8_t event);
-	static int8_t	response_callback(uint8_t channel_number, uint8_t message_id);
-	int8_t		response_handler(uint8_t channel_number, uint8_t message_id);
-	bool		fec_init(uint8_t message_id,uint8_t result);//called by response_callback
+	void		hex_dump(const uint8_t* data, int data_size);
+	// the ANT library calls these with the CANTMaster as context, message is only valid during the call
+	static int8_t	channel_callback(void* context, uint8_t channel_number, uint8_t event, const uint8_t* message, uint16_t size);
+	int8_t		channel_handler(uint8_t channel_number, uint8_t event, const uint8_t* message, uint16_t size);
+	static int8_t	response_callback(void* context, uint8_t channel_number, uint8_t message_id, const uint8_t* message, uint16_t size);
+	int8_t		response_handler(uint8_t channel_number, uint8_t message_id, const uint8_t* message, uint16_t size);
+	static void	stick_callback(void* context, uint8_t event);
+	void		stick_handler(uint8_t event);	// ANT_STICK_GONE or ANT_STICK_BACK, on the ANT reconnect thread
+	static void	tick_callback(void* context);	// reactor callbacks
+	static void	stick_ready_callback(void* context);
+	static void	stick_attach_callback(void* context);
+	void		stick_attach();	// the stick's descriptors into the reactor, again after each reconnect
+	bool		fec_init();//opens the FE-C channel, called from mainloop and again when the stick comes back
+	void		stick_options_init();	// --low-power and --rx-timestamps setup, after each fec_init
+	uint64_t	flagged_air_time(const uint8_t* message, uint16_t size, uint64_t rx_time_us);	// 0 without a time stamp
 	double		calc_power_required_watts();
 
 	bool		send_request_page(uint8_t request_page);
@@ -145,21 +197,22 @@ private:
 	bool		send_product_information();
 	bool		send_command_status();
 
+	command_block_t*	fec_command();	// where FE-C control pages go, with m_vars_mutex held
+	void		release_locked();
+
 	bool		send(uint8_t* data);
+	void		mark_command(uint64_t rx_time_us, uint64_t air_time_us);	// a control page arrived, for the command latency
 
-	bool		process_basic_resistance(basic_resistance_t* basic_resistance);
-	bool		process_target_power(target_power_t* target_power);
-	bool		process_wind_resistance(wind_resistance_t* wind_resistance);
-	bool		process_track_resistance(track_resistance_t* track_resistance);
-	bool		process_user_configuration(user_configuration_t*);
-	bool		process_request(request_t* request);
+	bool		process_basic_resistance(const basic_resistance_t* basic_resistance);
+	bool		process_target_power(const target_power_t* target_power);
+	bool		process_wind_resistance(const wind_resistance_t* wind_resistance);
+	bool		process_track_resistance(const track_resistance_t* track_resistance);
+	bool		process_user_configuration(const user_configuration_t*);
+	bool		process_request(const request_t* request);
 
-public:
-	static CANTMaster*	this_ptr;
 private:
-	uint8_t			m_channel_buffer[MAX_CHANNEL_EVENT_SIZE];
-	uint8_t 		m_response_buffer[MAX_RESPONSE_SIZE];
-	bool	 		m_exit_flag;
+	DSI_CANCEL_TOKEN	m_stop_token;		// stop() cancels it, mainloop() wakes from its sleep
+	bool			m_stop_token_valid;	// init() fails without it
 	bool	 		m_channel_open;
 	pthread_t		m_pthread;
 	int			m_retry_count;
@@ -169,10 +222,27 @@ private:
 	uint16_t		m_device_id;
 
 	pthread_mutex_t		m_vars_mutex;
+	pthread_mutex_t		m_stick_mutex;		// held around each write to the stick
+	bool			m_stick_gone;		// between ANT_STICK_GONE and the channel being set up again
+	bool			m_low_power;		// see init()
+	bool			m_rx_timestamps;
+	stick_clock_t		m_stick_clock;		// message thread, reset with the channel
 
 	uint8_t			m_last_rx_command_id;
 	uint8_t			m_sequence_number;
-	uint32_t		m_start_seconds;
+	uint32_t		m_start_time_ms;
+	// page schedule, kept between tick()s
+	uint32_t		m_page_count;			// 0 to 65
+	uint32_t		m_common_pages_count;
+	uint8_t			m_enter_button_state;
+	int			m_calibrate_count;
+	double			m_power_required_watts;
+	telemetry_bus_control_t	m_last_control;
+	// see attach()
+	Reactor*		m_reactor;
+	int			m_tick_source;
+	int			m_stick_sources[ANT_EVENT_LOOP_MAX_FDS];
+	int			m_stick_source_count;
 	uint8_t			m_command_status;
 	// read from fortius
 	double			m_speed_kph;
@@ -181,19 +251,21 @@ private:
 	double			m_cadence_rpm;
 	double			m_distance_meters;
 	uint8_t			m_buttons;
+	// latency stamps, latency_now_us()
+	uint64_t		m_sample_time_us;		// when the values above were read from the Fortius
+	uint64_t		m_copy_time_us;			// when they were copied here
+	uint64_t		m_command_time_us;		// oldest control page not yet handed to the Fortius, 0 if none
+	uint64_t		m_command_air_time_us;		// when it was on air, 0 if not known
+	uint64_t		m_tx_send_time_us;		// last page handed to the stick and not yet transmitted, 0 if none
+	uint64_t		m_tx_sample_time_us;		// sample time of the telemetry in it, 0 if it carries none
 
-	uint8_t			m_requested_mode;
-	// from set target power
-	double			m_target_power_watts;
-	// from wind_resistance page 50
-	double			m_wind_resistance_coef;
-	double			m_wind_speed_kph;
-	double			m_drafting_factor;
-	// from track_resistance page 51
-	double			m_slope;
-	double			m_crr;
+	command_block_t		m_command;			// what the brake is driven to
+	command_block_t		m_ant_command;			// FE-C control pages held back while local control has the brake
+	uint32_t		m_local_deadline_ms;		// local control has the brake until then, 0 if ANT has it
 	// from user config
 	double			m_user_weight_kg;
 	double			m_bike_weight_kg;
 	double			m_wheel_circumference_mm;
 };
+
+#endif // CANTMASTER_H
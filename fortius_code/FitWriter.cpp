@@ -0,0 +1,513 @@
+/*
+ * FitWriter.cpp
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "FitWriter.h"
+#include "LatencyStats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+#include <glog/logging.h>
+
+// base types
+#define FIT_ENUM		0x00
+#define FIT_UINT8		0x02
+#define FIT_UINT16		0x84
+#define FIT_UINT32		0x86
+#define FIT_UINT32Z		0x8C
+
+// global message numbers
+#define FIT_MESG_FILE_ID	0
+#define FIT_MESG_SESSION	18
+#define FIT_MESG_LAP		19
+#define FIT_MESG_RECORD		20
+#define FIT_MESG_EVENT		21
+#define FIT_MESG_ACTIVITY	34
+
+// local message types, one per message written
+#define LOCAL_FILE_ID		0
+#define LOCAL_RECORD		1
+#define LOCAL_EVENT		2
+#define LOCAL_LAP		3
+#define LOCAL_SESSION		4
+#define LOCAL_ACTIVITY		5
+
+// enums
+#define FIT_FILE_ACTIVITY	4
+#define FIT_EVENT_TIMER		0
+#define FIT_EVENT_SESSION	8
+#define FIT_EVENT_LAP		9
+#define FIT_EVENT_ACTIVITY	26
+#define FIT_EVENT_TYPE_START	0
+#define FIT_EVENT_TYPE_STOP	1
+#define FIT_EVENT_TYPE_STOP_ALL	4
+#define FIT_SPORT_CYCLING	2
+#define FIT_SUB_SPORT_INDOOR_CYCLING	6
+#define FIT_ACTIVITY_MANUAL	0
+
+#define FIT_TIMESTAMP		253
+#define FIT_INVALID_UINT8	0xFF
+
+// field number, size, base type
+static const uint8_t file_id_fields[] = {
+	0, 1, FIT_ENUM,		// type
+	1, 2, FIT_UINT16,	// manufacturer
+	2, 2, FIT_UINT16,	// product
+	3, 4, FIT_UINT32Z,	// serial_number
+	4, 4, FIT_UINT32,	// time_created
+};
+static const uint8_t record_fields[] = {
+	FIT_TIMESTAMP, 4, FIT_UINT32,
+	7, 2, FIT_UINT16,	// power, W
+	3, 1, FIT_UINT8,	// heart_rate, bpm
+	4, 1, FIT_UINT8,	// cadence, rpm
+	6, 2, FIT_UINT16,	// speed, mm/s
+	5, 4, FIT_UINT32,	// distance, cm
+};
+static const uint8_t event_fields[] = {
+	FIT_TIMESTAMP, 4, FIT_UINT32,
+	0, 1, FIT_ENUM,		// event
+	1, 1, FIT_ENUM,		// event_type
+};
+static const uint8_t lap_fields[] = {
+	FIT_TIMESTAMP, 4, FIT_UINT32,
+	2, 4, FIT_UINT32,	// start_time
+	7, 4, FIT_UINT32,	// total_elapsed_time, ms
+	8, 4, FIT_UINT32,	// total_timer_time, ms
+	9, 4, FIT_UINT32,	// total_distance, cm
+	0, 1, FIT_ENUM,		// event
+	1, 1, FIT_ENUM,		// event_type
+};
+static const uint8_t session_fields[] = {
+	FIT_TIMESTAMP, 4, FIT_UINT32,
+	2, 4, FIT_UINT32,	// start_time
+	7, 4, FIT_UINT32,	// total_elapsed_time, ms
+	8, 4, FIT_UINT32,	// total_timer_time, ms
+	9, 4, FIT_UINT32,	// total_distance, cm
+	20, 2, FIT_UINT16,	// avg_power
+	21, 2, FIT_UINT16,	// max_power
+	16, 1, FIT_UINT8,	// avg_heart_rate
+	17, 1, FIT_UINT8,	// max_heart_rate
+	18, 1, FIT_UINT8,	// avg_cadence
+	19, 1, FIT_UINT8,	// max_cadence
+	5, 1, FIT_ENUM,		// sport
+	6, 1, FIT_ENUM,		// sub_sport
+	0, 1, FIT_ENUM,		// event
+	1, 1, FIT_ENUM,		// event_type
+	25, 2, FIT_UINT16,	// first_lap_index
+	26, 2, FIT_UINT16,	// num_laps
+};
+static const uint8_t activity_fields[] = {
+	FIT_TIMESTAMP, 4, FIT_UINT32,
+	0, 4, FIT_UINT32,	// total_timer_time, ms
+	1, 2, FIT_UINT16,	// num_sessions
+	2, 1, FIT_ENUM,		// type
+	3, 1, FIT_ENUM,		// event
+	4, 1, FIT_ENUM,		// event_type
+};
+
+#define FIELDS(fields)	fields, (int)(sizeof(fields) / 3)
+
+static uint16_t fit_crc(uint16_t crc, const uint8_t* data, int size)
+{
+	static const uint16_t	table[16] = {
+		0x0000, 0xCC01, 0xD801, 0x1400, 0xF001, 0x3C00, 0x2800, 0xE401,
+		0xA001, 0x6C00, 0x7800, 0xB401, 0x5000, 0x9C01, 0x8801, 0x4400
+	};
+	uint16_t		tmp;
+
+	for(int i = 0; i < size; i++) {
+		tmp = table[crc & 0xF];
+		crc = (crc >> 4) & 0x0FFF;
+		crc = crc ^ tmp ^ table[data[i] & 0xF];
+		tmp = table[crc & 0xF];
+		crc = (crc >> 4) & 0x0FFF;
+		crc = crc ^ tmp ^ table[(data[i] >> 4) & 0xF];
+	}
+	return crc;
+}
+
+static void fit_header(uint8_t* header, uint32_t data_size)
+{
+	uint16_t		crc;
+
+	header[0] = FIT_HEADER_SIZE;
+	header[1] = 0x10;		// protocol 1.0
+	header[2] = 2100 & 0xFF;	// profile 21.00
+	header[3] = 2100 >> 8;
+	header[4] = data_size;
+	header[5] = data_size >> 8;
+	header[6] = data_size >> 16;
+	header[7] = data_size >> 24;
+	memcpy(&header[8], ".FIT", 4);
+	crc = fit_crc(0, header, 12);
+	header[12] = crc;
+	header[13] = crc >> 8;
+}
+
+FitWriter::FitWriter()
+{
+	m_fd = -1;
+	m_stop_token_valid = (DSIThread_CancelInit(&m_stop_token) == DSI_THREAD_ENONE);
+	m_error = false;
+	m_cursor = 0;
+	m_buffered = 0;
+	m_data_size = 0;
+	m_last_flush_ms = 0;
+	m_wall_start = 0;
+	m_clock_start_us = 0;
+	m_second = 0;
+	m_samples = 0;
+	m_power_sum = 0;
+	m_cadence_sum = 0;
+	m_heartrate_sum = 0;
+	m_speed_sum = 0;
+	m_distance_m = 0;
+	m_start_time = 0;
+	m_records = 0;
+	m_total_power = 0;
+	m_total_cadence = 0;
+	m_total_heartrate = 0;
+	m_heartrate_records = 0;
+	m_max_power = 0;
+	m_max_cadence = 0;
+	m_max_heartrate = 0;
+	m_start_distance_m = 0;
+}
+
+FitWriter::~FitWriter()
+{
+	stop();
+	DSIThread_CancelDestroy(&m_stop_token);
+}
+
+bool FitWriter::start(const char* path)
+{
+	const telemetry_bus_header_t*	bus = telemetry_bus_get();
+	uint8_t				header[FIT_HEADER_SIZE];
+
+	if(bus == NULL) {
+		std::cout << "FIT writer needs the telemetry bus" << std::endl;
+		return false;
+	}
+	if(!m_stop_token_valid) {
+		std::cout << "Failed to create FIT writer stop eventfd" << std::endl;
+		return false;
+	}
+	m_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(m_fd < 0) {
+		std::cout << "Failed to create FIT file " << path << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+	m_wall_start = time(NULL);
+	m_clock_start_us = latency_now_us();
+	m_cursor = __atomic_load_n(&bus->write_index, __ATOMIC_ACQUIRE);
+	m_last_flush_ms = latency_now_us() / 1000;
+
+	// data size 0 until finish()
+	fit_header(header, 0);
+	if(write(m_fd, header, sizeof(header)) != sizeof(header)) {
+		std::cout << "Failed to write FIT file " << path << ": " << strerror(errno) << std::endl;
+		close(m_fd);
+		m_fd = -1;
+		return false;
+	}
+
+	define(LOCAL_FILE_ID, FIT_MESG_FILE_ID, FIELDS(file_id_fields));
+	put8(LOCAL_FILE_ID);
+	put8(FIT_FILE_ACTIVITY);
+	put16(FIT_MANUFACTURER_TACX);
+	put16(0);
+	put32(0);
+	put32(fit_time(m_clock_start_us));
+	define(LOCAL_RECORD, FIT_MESG_RECORD, FIELDS(record_fields));
+	define(LOCAL_EVENT, FIT_MESG_EVENT, FIELDS(event_fields));
+
+	DSIThread_CancelReset(&m_stop_token);
+	if(pthread_create(&m_pthread, NULL, &FitWriter::run_helper, this) != 0) {
+		std::cout << "Failed to start FIT writer thread" << std::endl;
+		close(m_fd);
+		m_fd = -1;
+		return false;
+	}
+	pthread_setname_np(m_pthread, "fit_writer");
+	return true;
+}
+
+void FitWriter::stop()
+{
+	if(m_fd < 0) {
+		return;
+	}
+	DSIThread_Cancel(&m_stop_token);
+	pthread_join(m_pthread, NULL);
+	close(m_fd);
+	m_fd = -1;
+}
+
+void* FitWriter::run_helper(void* context)
+{
+	((FitWriter*)context)->run();
+	return NULL;
+}
+
+void FitWriter::run()
+{
+	const telemetry_bus_header_t*	bus = telemetry_bus_get();
+	telemetry_bus_record_t		record;
+	bool				exiting;
+
+	VLOG (1) << "FIT writer running";
+	do {
+		// read once more after stop(), the threads publishing have stopped by then
+		exiting = DSIThread_IsCancelled(&m_stop_token);
+		while(telemetry_bus_read(bus, &m_cursor, &record)) {
+			if(record.type == TELEMETRY_BUS_SAMPLE) {
+				take(&record);
+			}
+		}
+		if(!exiting && latency_now_us() / 1000 - m_last_flush_ms >= FIT_FLUSH_MS) {
+			flush();
+		}
+		if(!exiting) {
+			DSIThread_SleepCancellable(FIT_POLL_MS, &m_stop_token);
+		}
+	} while(!exiting);
+
+	finish();
+}
+
+void FitWriter::take(const telemetry_bus_record_t* record)
+{
+	uint32_t	second = fit_time(record->time_us);
+
+	if(m_second == 0) {
+		m_start_time = second;
+		m_start_distance_m = record->sample.distance_m;
+		put8(LOCAL_EVENT);
+		put32(second);
+		put8(FIT_EVENT_TIMER);
+		put8(FIT_EVENT_TYPE_START);
+	} else if(second != m_second) {
+		write_record();
+	}
+	m_second = second;
+	m_samples++;
+	m_power_sum += record->sample.power_watts;
+	m_cadence_sum += record->sample.cadence_rpm;
+	m_heartrate_sum += record->sample.heartrate_bpm;
+	m_speed_sum += record->sample.speed_kph;
+	m_distance_m = record->sample.distance_m - m_start_distance_m;
+}
+
+void FitWriter::write_record()
+{
+	uint16_t	power;
+	uint8_t		cadence;
+	uint8_t		heartrate;
+
+	if(m_samples == 0) {
+		return;
+	}
+	power = (uint16_t)(m_power_sum / m_samples + 0.5);
+	cadence = (uint8_t)(m_cadence_sum / m_samples + 0.5);
+	heartrate = (uint8_t)(m_heartrate_sum / m_samples + 0.5);
+
+	put8(LOCAL_RECORD);
+	put32(m_second);
+	put16(power);
+	// no strap reads as 0
+	put8(heartrate ? heartrate : FIT_INVALID_UINT8);
+	put8(cadence);
+	put16((uint16_t)(m_speed_sum / m_samples / 3.6 * 1000 + 0.5));
+	put32(m_distance_m > 0 ? (uint32_t)(m_distance_m * 100 + 0.5) : 0);
+
+	m_records++;
+	m_total_power += power;
+	m_total_cadence += cadence;
+	if(heartrate) {
+		m_total_heartrate += heartrate;
+		m_heartrate_records++;
+	}
+	if(power > m_max_power) {
+		m_max_power = power;
+	}
+	if(cadence > m_max_cadence) {
+		m_max_cadence = cadence;
+	}
+	if(heartrate > m_max_heartrate) {
+		m_max_heartrate = heartrate;
+	}
+
+	m_samples = 0;
+	m_power_sum = 0;
+	m_cadence_sum = 0;
+	m_heartrate_sum = 0;
+	m_speed_sum = 0;
+}
+
+void FitWriter::finish()
+{
+	uint32_t	end_time;
+	uint32_t	elapsed_ms;
+	uint32_t	distance_cm;
+	uint8_t		header[FIT_HEADER_SIZE];
+	uint16_t	crc = 0;
+	ssize_t		n;
+	off_t		offset = 0;
+
+	write_record();
+	if(m_second == 0) {
+		// nothing was ridden, a file with only the file_id in it
+		m_start_time = end_time = fit_time(latency_now_us());
+	} else {
+		end_time = m_second;
+		put8(LOCAL_EVENT);
+		put32(end_time);
+		put8(FIT_EVENT_TIMER);
+		put8(FIT_EVENT_TYPE_STOP_ALL);
+	}
+	elapsed_ms = (end_time - m_start_time) * 1000;
+	distance_cm = m_distance_m > 0 ? (uint32_t)(m_distance_m * 100 + 0.5) : 0;
+
+	define(LOCAL_LAP, FIT_MESG_LAP, FIELDS(lap_fields));
+	put8(LOCAL_LAP);
+	put32(end_time);
+	put32(m_start_time);
+	put32(elapsed_ms);
+	put32(elapsed_ms);
+	put32(distance_cm);
+	put8(FIT_EVENT_LAP);
+	put8(FIT_EVENT_TYPE_STOP);
+
+	define(LOCAL_SESSION, FIT_MESG_SESSION, FIELDS(session_fields));
+	put8(LOCAL_SESSION);
+	put32(end_time);
+	put32(m_start_time);
+	put32(elapsed_ms);
+	put32(elapsed_ms);
+	put32(distance_cm);
+	put16(m_records ? (uint16_t)(m_total_power / m_records + 0.5) : 0);
+	put16(m_max_power);
+	put8(m_heartrate_records ? (uint8_t)(m_total_heartrate / m_heartrate_records + 0.5) : FIT_INVALID_UINT8);
+	put8(m_heartrate_records ? m_max_heartrate : FIT_INVALID_UINT8);
+	put8(m_records ? (uint8_t)(m_total_cadence / m_records + 0.5) : 0);
+	put8(m_max_cadence);
+	put8(FIT_SPORT_CYCLING);
+	put8(FIT_SUB_SPORT_INDOOR_CYCLING);
+	put8(FIT_EVENT_SESSION);
+	put8(FIT_EVENT_TYPE_STOP);
+	put16(0);
+	put16(1);
+
+	define(LOCAL_ACTIVITY, FIT_MESG_ACTIVITY, FIELDS(activity_fields));
+	put8(LOCAL_ACTIVITY);
+	put32(end_time);
+	put32(elapsed_ms);
+	put16(1);
+	put8(FIT_ACTIVITY_MANUAL);
+	put8(FIT_EVENT_ACTIVITY);
+	put8(FIT_EVENT_TYPE_STOP);
+
+	flush();
+	if(m_error) {
+		return;
+	}
+
+	// now the size is known, then the CRC over everything, read back in m_buffer sized pieces
+	fit_header(header, m_data_size);
+	if(pwrite(m_fd, header, sizeof(header), 0) != sizeof(header)) {
+		std::cout << "Failed to finish FIT file: " << strerror(errno) << std::endl;
+		return;
+	}
+	while((n = pread(m_fd, m_buffer, sizeof(m_buffer), offset)) > 0) {
+		crc = fit_crc(crc, m_buffer, n);
+		offset += n;
+	}
+	m_buffer[0] = crc;
+	m_buffer[1] = crc >> 8;
+	if(n < 0 || pwrite(m_fd, m_buffer, 2, offset) != 2) {
+		std::cout << "Failed to finish FIT file: " << strerror(errno) << std::endl;
+		return;
+	}
+	fsync(m_fd);
+	std::cout << "FIT file written, " << m_records << " records" << std::endl;
+}
+
+void FitWriter::define(uint8_t local, uint16_t global, const uint8_t* fields, int count)
+{
+	put8(0x40 | local);
+	put8(0);		// reserved
+	put8(0);		// little endian
+	put16(global);
+	put8(count);
+	for(int i = 0; i < count * 3; i++) {
+		put8(fields[i]);
+	}
+}
+
+void FitWriter::put8(uint8_t value)
+{
+	if(m_buffered == FIT_BUFFER_SIZE) {
+		flush();
+	}
+	m_buffer[m_buffered++] = value;
+	m_data_size++;
+}
+
+void FitWriter::put16(uint16_t value)
+{
+	put8(value);
+	put8(value >> 8);
+}
+
+void FitWriter::put32(uint32_t value)
+{
+	put16(value);
+	put16(value >> 16);
+}
+
+void FitWriter::flush()
+{
+	int		done = 0;
+	ssize_t		n;
+
+	m_last_flush_ms = latency_now_us() / 1000;
+	while(!m_error && done < m_buffered) {
+		n = write(m_fd, m_buffer + done, m_buffered - done);
+		if(n < 0 && errno == EINTR) {
+			continue;
+		}
+		if(n <= 0) {
+			// keep the ride going, just stop writing
+			std::cout << "FIT file write failed: " << strerror(errno) << std::endl;
+			m_error = true;
+			break;
+		}
+		done += n;
+	}
+	m_buffered = 0;
+}
+
+uint32_t FitWriter::fit_time(uint64_t time_us)
+{
+	return (uint32_t)(m_wall_start + (int64_t)(time_us - m_clock_start_us) / 1000000 - FIT_EPOCH_OFFSET);
+}
@@ -0,0 +1,103 @@
+/*
+ * FitWriter.h
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef FIT_WRITER_H
+#define FIT_WRITER_H
+
+#include "TelemetryBus.h"
+#include "dsi_thread.h"
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+#define FIT_BUFFER_SIZE		4096		// encoded bytes held before a write()
+#define FIT_FLUSH_MS		10000		// written out at least this often
+#define FIT_POLL_MS		500		// how often the telemetry bus is read
+#define FIT_HEADER_SIZE		14
+
+// FIT profile numbers used here
+#define FIT_MANUFACTURER_TACX	89
+#define FIT_EPOCH_OFFSET	631065600	// unix time of 1989-12-31 00:00:00 UTC
+
+// Writes a FIT activity file of the ride from the telemetry bus: one record
+// a second with power, cadence, speed, distance and heart rate averaged over
+// the samples in it, then a lap, a session and an activity summary when it
+// stops.  It is one more reader of the ring, so a slow disk only ever holds
+// up this thread.  The header data size and the file CRC are fixed up at
+// the end, a file cut short by a crash has neither.
+class FitWriter
+{
+public:
+			FitWriter();
+			~FitWriter();
+	bool		start(const char* path);	// the telemetry bus must be open
+	void		stop();				// drains the bus and finishes the file
+
+private:
+	static void*	run_helper(void* context);
+	void		run();
+	void		take(const telemetry_bus_record_t* record);
+	void		write_record();
+	void		finish();
+
+	void		define(uint8_t local, uint16_t global, const uint8_t* fields, int count);
+	void		put8(uint8_t value);
+	void		put16(uint16_t value);
+	void		put32(uint32_t value);
+	void		flush();
+	uint32_t	fit_time(uint64_t time_us);
+
+	int		m_fd;
+	pthread_t	m_pthread;
+	DSI_CANCEL_TOKEN	m_stop_token;
+	bool		m_stop_token_valid;		// start() fails without it
+	bool		m_error;
+	uint64_t	m_cursor;			// telemetry bus read position
+	uint8_t		m_buffer[FIT_BUFFER_SIZE];
+	int		m_buffered;
+	uint32_t	m_data_size;			// bytes after the header
+	uint64_t	m_last_flush_ms;
+	// bridge clock to UTC
+	time_t		m_wall_start;
+	uint64_t	m_clock_start_us;
+
+	// samples in the second being collected
+	uint32_t	m_second;			// FIT time, 0 before the first sample
+	uint32_t	m_samples;
+	double		m_power_sum;
+	double		m_cadence_sum;
+	double		m_heartrate_sum;
+	double		m_speed_sum;
+	double		m_distance_m;
+
+	// for the summaries
+	uint32_t	m_start_time;
+	uint32_t	m_records;
+	double		m_total_power;
+	double		m_total_cadence;
+	double		m_total_heartrate;
+	uint32_t	m_heartrate_records;
+	uint16_t	m_max_power;
+	uint8_t		m_max_cadence;
+	uint8_t		m_max_heartrate;
+	double		m_start_distance_m;
+};
+
+#endif // FIT_WRITER_H
@@ -21,6 +21,11 @@
 
 #include "Fortius.h"
 #include "EndianSwap.h"
+#include "dsi_thread.h"
+#include "LatencyStats.h"
+#include "BridgeMetrics.h"
+#include "TelemetryBus.h"
+#include "PowerModel.h"
 #include <glog/logging.h>
 
 
@@ -74,6 +79,10 @@ Fortius::Fortius()
 	brakeCalibrationLoadRaw = DEFAULT_CALIBRATION_LOAD_RAW;			//	650  			// 0-1300 seems reasonable
 	powerScaleFactor = DEFAULT_SCALING;
 	deviceStatus = 0;
+	deviceSampleTime = 0;
+	commandReceivedTime = commandSetTime = commandAirTime = 0;
+	stepState = FT_STEP_OPEN;
+	threaded = false;
 
 
 	/* 12 byte control sequence, composed of 8 command packets
@@ -92,10 +101,12 @@ Fortius::Fortius()
 
  	VLOG(1) << "Fortius::Fortius: pthread_mutex_init";
 	pthread_mutex_init(&pvars, NULL);
+	stopTokenValid = (DSIThread_CancelInit(&stopToken) == DSI_THREAD_ENONE);
 }
 
 Fortius::~Fortius()
 {
+	DSIThread_CancelDestroy(&stopToken);
 	pthread_mutex_destroy(&pvars);
 }
 
@@ -218,10 +229,28 @@ void Fortius::setGradient(double gradient)
 }
 
 
+// Stamps the next brake command with the command that caused it.  The oldest
+// one still waiting is kept, later ones are folded into the same write.
+void Fortius::markCommand(uint64_t receivedUs, uint64_t airUs)
+{
+	uint64_t now = latency_now_us();
+
+	pthread_mutex_lock(&pvars);
+	if (commandReceivedTime == 0) {
+		commandReceivedTime = receivedUs;
+		commandSetTime = now;
+		commandAirTime = airUs;
+	}
+	pthread_mutex_unlock(&pvars);
+
+	latency_record(LATENCY_COMMAND_TO_SET, receivedUs, now);
+}
+
+
 /* ----------------------------------------------------------------------
  * GET
  * ---------------------------------------------------------------------- */
-void Fortius::getTelemetry(double& powerWatts, double& heartrateBPM, double& cadenceRPM, double& speedKPH, double& distanceM, int& buttons, int& steering, int& status)
+void Fortius::getTelemetry(double& powerWatts, double& heartrateBPM, double& cadenceRPM, double& speedKPH, double& distanceM, int& buttons, int& steering, int& status, uint64_t* sampleTimeUs)
 {
 
 	pthread_mutex_lock(&pvars);
@@ -233,6 +262,9 @@ void Fortius::getTelemetry(double& powerWatts, double& heartrateBPM, double& cad
 	buttons = deviceButtons;
 	steering = deviceSteering;
 	status = deviceStatus;
+	if (sampleTimeUs) {
+		*sampleTimeUs = deviceSampleTime;
+	}
 
 	// work around to ensure controller doesn't miss button press.
 	// The run thread will only set the button bits, they don't get
@@ -296,20 +328,36 @@ double Fortius::getPowerScaleFactor()
 }
 
 int
-Fortius::start()
+Fortius::start(bool thread)
 {
+	if (!stopTokenValid) {
+		std::cout << "Fortius::start: failed to create the stop eventfd" << std::endl;
+		return -1;
+	}
 	pthread_mutex_lock(&pvars);
 	this->deviceStatus = FT_RUNNING;
 	pthread_mutex_unlock(&pvars);
+	DSIThread_CancelReset(&stopToken);
+	stepState = FT_STEP_OPEN;
+	threaded = thread;
+	if (!threaded) {
+		return 0;	// the caller runs step()
+	}
 
 	VLOG(1) << "Fortius::start: pthread_create";
-	pthread_create(&thread_handle, NULL, Fortius::run_helper, this);
+	// through the ANT thread layer so the thread follows virtual time in simulations
+	thread_handle = DSIThread_CreateThread(Fortius::run_helper, this);
+	pthread_setname_np(thread_handle, "fortius");
 	return 0;
 }
 
 int
 Fortius::join()
 {
+	if (!threaded) {
+		run();		// to the close command, after stop()
+		return 0;
+	}
 	pthread_join(thread_handle, NULL);
 	return 0;
 }
@@ -330,6 +378,7 @@ Fortius::join()
  * run() - bg thread continuosly reading/writing the device port
  *         it is kicked off by start and then examines status to check
  *         when it is time to pause or stop altogether.
+ * step() - one read or write of run(), for callers with their own loop
  * ---------------------------------------------------------------------- */
 int Fortius::restart()
 {
@@ -356,6 +405,7 @@ int Fortius::stop()
 	pthread_mutex_lock(&pvars);
 	deviceStatus = 0; // Terminate it!
 	pthread_mutex_unlock(&pvars);
+	DSIThread_Cancel(&stopToken);
 	return 0;
 }
 
@@ -428,28 +478,10 @@ void Fortius::hex_dump(uint8_t* data, int data_size)
 }
 
 double Fortius::calculateWattageFromRaw(double curRawPower, double curRawSpeed){
-	double curBrakeCalibrationLoadRaw;
-	double slopeCalc;
-	double offsetCalc;
-	double powerCalcWatts;
-
-	pthread_mutex_lock(&pvars);
-	curBrakeCalibrationLoadRaw = brakeCalibrationLoadRaw;	// get member
-	pthread_mutex_unlock(&pvars);
-
-	// old slopeCalc = 0.001366 * curDeviceSpeed + 0.0308;
-	// newer slopeCalc = 0.191 * curDeviceSpeed + 0.076;
-	slopeCalc = 0.00000670 * (curRawSpeed) + 0.002;
-
-	//offsetCalc = -0.03526 * curBrakeCalibrationLoadRaw + 1.708;
-	offsetCalc = 0;
-
-	//printf("\n slope %f offset %f\n", slopeCalc, offsetCalc);
-	powerCalcWatts = (slopeCalc * curRawPower) + offsetCalc;
-
-	return powerCalcWatts;
-
+	// the calibration load is not part of the model yet, see PowerModel.h
+	return power_model_watts(curRawPower, curRawSpeed);
 }
+
 double Fortius::calculateRawLoadFromWattage(double requiredWatts){
 	double curBrakeCalibrationLoadRaw;
 	double slopeCalc;
@@ -484,231 +516,265 @@ double Fortius::calculateRawLoadFromWattage(double requiredWatts){
  *----------------------------------------------------------------------*/
 void Fortius::run()
 {
+	int delay_msec;
+
 	VLOG (1) << "Fortius::run: starting";
 
-	// newly read values - compared against cached values
-	bool isDeviceOpen = false;
+	while ((delay_msec = step()) >= 0) {
+		if (delay_msec > 0) {
+			DSIThread_SleepCancellable (delay_msec, &stopToken);
+		}
+	}
+}
 
+int Fortius::step()
+{
 	// ui controller state
 	int curstatus;
 
-	// variables for telemetry, copied to fields on each brake update
-	double curPower;                      // current output power in Watts
 	double nextPower;                     // used for exponential moving average of power
-	double curHeartRate;                  // current heartrate in BPM
-	double curCadence;                    // current cadence in RPM
-	double curSpeed;                      // current speed in KPH
-	double curDistance;                    // odometer?
-	uint32_t	startDistanceDoubleRevs; // every revolution of the roller counts twice for these two variaboueles
 	uint32_t	curDistanceDoubleRevs;	// nu
-	int curButtons;                       // Button status
-	int curSteering;                    // Angle of steering controller
-	//int curStatus;
-	uint8_t pedalSensor;                // 1 when using is cycling else 0, fed back to brake although appears unnecessary
 	double next_calibration_load_raw;
 	double cur_calibration_load_raw;
-	double curRawSpeed;
-	double curRawPower;			// read the raw power number from 48 byte message...THIS IS NOT WATTS? is it TORQUE?
-	timespec last_measured_time;
+	telemetry_bus_sample_t busSample;	// every decoded message goes out on the telemetry bus
 
-	// initialise local cache & main vars
-	pthread_mutex_lock(&pvars);
-	//curStatus = this->deviceStatus;
-	curPower = this->devicePower = 0;
-	curHeartRate = this->deviceHeartRate = 0;
-	curCadence = this->deviceCadence = 0;
-	curSpeed = this->deviceSpeed = 0;
-	curDistance = this->deviceDistance = 0;
-	curSteering = this->deviceSteering = 0;
-	curButtons = this->deviceButtons = 0;
-	pedalSensor = 0;
-	pthread_mutex_unlock(&pvars);
+	// stopped mid cycle, straight to the close command below
+	if (DSIThread_IsCancelled(&stopToken) && (stepState == FT_STEP_WRITE || stepState == FT_STEP_READ)) {
+		stepState = FT_STEP_PAUSED;
+	}
 
+	switch (stepState) {
+	case FT_STEP_OPEN:
+		// initialise local cache & main vars
+		pthread_mutex_lock(&pvars);
+		curPower = this->devicePower = 0;
+		curHeartRate = this->deviceHeartRate = 0;
+		curCadence = this->deviceCadence = 0;
+		curSpeed = this->deviceSpeed = 0;
+		curDistance = this->deviceDistance = 0;
+		curSteering = this->deviceSteering = 0;
+		curButtons = this->deviceButtons = 0;
+		pedalSensor = 0;
+		startDistanceDoubleRevs = 0;
+		curRawSpeed = 0;
+		curRawPower = 0;
+		pthread_mutex_unlock(&pvars);
 
-	// open the device
-	if (openPort()) {
-		std::cout<<"\nFortius::run: openPort failed with "<<strerror(errno)<<"\n";
-		quit(2);
-		return; // open failed!
-	} else {
+		// open the device
+		if (openPort()) {
+			std::cout<<"\nFortius::run: openPort failed with "<<strerror(errno)<<"\n";
+			quit(2);
+			stepState = FT_STEP_DONE;
+			return -1; // open failed!
+		}
 		isDeviceOpen = true;
 		sendOpenCommand();
-	}
 
-	// Store currrent time
-	clock_gettime (CLOCK_MONOTONIC, &last_measured_time);
-
-	while(1) {
-		//printf("*");
-		if (isDeviceOpen == true) {
-			// Sleep for 250 msec after read before writing
-			go_sleep (&last_measured_time, FT_READ_DELAY);
-			// do calibration mode
-			int rc = sendRunCommand(pedalSensor);
-
-			// Store currrent time
-			clock_gettime (CLOCK_MONOTONIC, &last_measured_time);
-
-			if (rc < 0) {
-				std::cout << "Fortius::run: usb write error" << rc;
-				// send failed - ouch!
-				closePort(); // need to release that file handle!!
-				if(openPort()){
-					std::cout << "Fortius::run: failed attempt to close and reopen port";
-					quit(2);
-					return;
-				}
-				continue;	// ignore this error?
-			}
-			// Sleep for 70 msec after write before reading again
-			go_sleep (&last_measured_time, FT_WRITE_DELAY);
-			int actualLength = readMessage();
-			VLOG (2) << actualLength;
-
-			// Store currrent time
-			clock_gettime (CLOCK_MONOTONIC, &last_measured_time);
-
-			if (actualLength < 0) {
-				std::cout << "Fortius::run: usb read error " << actualLength;
-				closePort(); // need to release that file handle!!
-				if(openPort()){
-					std::cout << "Fortius::run: failed attempt to close and reopen port";
-					quit(2);
-					return;
-				}
-				continue;	// ignore this error?
-			}
-			else {
-		    if (actualLength >= 24) {
-
-					//----------------------------------------------------------------
-					// UPDATE BASIC TELEMETRY (HR, CAD, SPD et al)
-					// The data structure is very simple, no bit twiddling needed here
-					//----------------------------------------------------------------
-
-					// buf[14] changes from time to time (controller status?)
-
-					// buttons
-					curButtons = buf[13];
-
-					// steering angle
-					curSteering = buf[18] | (buf[19] << 8);
-
-					// update public fields
-					pthread_mutex_lock(&pvars);
-					deviceButtons |= curButtons;    // workaround to ensure controller doesn't miss button pushes
-					deviceSteering = curSteering;
-					pthread_mutex_unlock(&pvars);
-			  }
-
-			  if (actualLength >= 48) {
-				//printf("+");
-				// brake status status&0x04 == stopping wheel
-				//              status&0x01 == brake on
-				//curBrakeStatus = buf[42];
-
-					// pedal sensor is 0x01 when cycling
-					pedalSensor = buf[46];
-
-					// current distance
-					curDistanceDoubleRevs = (buf[28] | (buf[29] << 8) | (buf[30] << 16) | (buf[31] << 24));
-					if (startDistanceDoubleRevs == 0 || startDistanceDoubleRevs == 4100){
-						startDistanceDoubleRevs = curDistance;
-					}
-					curDistance = ((double)curDistanceDoubleRevs) * HALF_ROLLER_CIRCUMFERENCE_M ;	//0.06264880952;
-
-					// cadence - confirmed correct
-					curCadence = buf[44];
-
-					// speed
-					curRawSpeed =  (double)(FromLittleEndian<uint16_t>((uint16_t*)&buf[32]));
-					curSpeed = 1.3f * curRawSpeed / (3.6f * 100.00f);
-
-					// power
-					curRawPower = FromLittleEndian<int16_t>((int16_t*)&buf[38]);
-					if(FT_CALIBRATE == mode){
-						next_calibration_load_raw = curRawPower;
-						next_calibration_load_raw *= 0.9;
-						cur_calibration_load_raw = getBrakeCalibrationLoadRaw();
-						cur_calibration_load_raw *= 0.1;
-						cur_calibration_load_raw += next_calibration_load_raw;
-						setBrakeCalibrationLoadRaw(cur_calibration_load_raw);
-					}
-
-					nextPower = calculateWattageFromRaw(curRawPower, curRawSpeed);
-					if (nextPower < 0.0) {
-						nextPower = 0.0;    // brake power can be -ve when coasting.
-					}
-
-					// EMA power
-					nextPower *= 0.25;
-					curPower *= 0.75;
-					curPower += nextPower;
-
-					curPower *= powerScaleFactor; // apply scale factor
-
-					// heartrate - confirmed correct
-					curHeartRate = buf[12];
-
-					// update public fields
-					pthread_mutex_lock(&pvars);
-					deviceSpeed = curSpeed;
-					deviceDistance = curDistance;
-					deviceCadence = curCadence;
-					deviceHeartRate = curHeartRate;
-					devicePower = curPower;
-
-					rawPower = curRawPower;
-					rawSpeed = curRawSpeed;
-					pthread_mutex_unlock(&pvars);
-
-			  }
-
-			  if(actualLength != 24 && actualLength != 48) {
-					std::cout << "Fortius::run: error, got a length of " << actualLength << std::endl;
-			   }
-			}
-		}
+		// Store currrent time
+		last_measured_time = DSIThread_GetSystemTime();
 
-		//----------------------------------------------------------------
-		// LISTEN TO GUI CONTROL COMMANDS
-		//----------------------------------------------------------------
-		pthread_mutex_lock(&pvars);
-		curstatus = this->deviceStatus;
-		pthread_mutex_unlock(&pvars);
+		// Sleep for 250 msec after read before writing
+		stepState = FT_STEP_WRITE;
+		return delayLeft (FT_READ_DELAY);
 
-		/* time to shut up shop */
-		if (!(curstatus & FT_RUNNING)) {
-			// time to stop!
+	case FT_STEP_WRITE: {
+		// do calibration mode
+		int rc = sendRunCommand(pedalSensor);
 
-			sendCloseCommand();
+		// Store currrent time
+		last_measured_time = DSIThread_GetSystemTime();
 
+		if (rc < 0) {
+			std::cout << "Fortius::run: usb write error" << rc;
+			// send failed - ouch!
 			closePort(); // need to release that file handle!!
-			quit(0);
-			return;
+			if(openPort()){
+				std::cout << "Fortius::run: failed attempt to close and reopen port";
+				quit(2);
+				stepState = FT_STEP_DONE;
+				return -1;
+			}
+			metrics_count(METRIC_TRAINER_RECONNECTS);
+			return delayLeft (FT_READ_DELAY);	// ignore this error?
 		}
+		// Sleep for 70 msec after write before reading again
+		stepState = FT_STEP_READ;
+		return delayLeft (FT_WRITE_DELAY);
+	}
 
-		if ((curstatus & FT_PAUSED) && isDeviceOpen == true) {
-
-			closePort();
-			isDeviceOpen = false;
+	case FT_STEP_READ: {
+		int actualLength = readMessage();
+		uint64_t readTime = latency_now_us();
+		VLOG (2) << actualLength;
 
-		} else if (!(curstatus & FT_PAUSED) && (curstatus & FT_RUNNING) && isDeviceOpen == false) {
+		// Store currrent time
+		last_measured_time = DSIThread_GetSystemTime();
 
-			if (openPort()) {
+		if (actualLength < 0) {
+			std::cout << "Fortius::run: usb read error " << actualLength;
+			closePort(); // need to release that file handle!!
+			if(openPort()){
+				std::cout << "Fortius::run: failed attempt to close and reopen port";
 				quit(2);
-				return; // open failed!
+				stepState = FT_STEP_DONE;
+				return -1;
 			}
-			isDeviceOpen = true;
-			sendOpenCommand();
+			metrics_count(METRIC_TRAINER_RECONNECTS);
+			stepState = FT_STEP_WRITE;
+			return delayLeft (FT_READ_DELAY);	// ignore this error?
+		}
+	    if (actualLength >= 24) {
+				metrics_count(METRIC_TRAINER_READS);
+
+				//----------------------------------------------------------------
+				// UPDATE BASIC TELEMETRY (HR, CAD, SPD et al)
+				// The data structure is very simple, no bit twiddling needed here
+				//----------------------------------------------------------------
+
+				// buf[14] changes from time to time (controller status?)
+
+				// buttons
+				curButtons = buf[13];
+
+				// steering angle
+				curSteering = buf[18] | (buf[19] << 8);
+
+				// update public fields
+				pthread_mutex_lock(&pvars);
+				deviceButtons |= curButtons;    // workaround to ensure controller doesn't miss button pushes
+				deviceSteering = curSteering;
+				pthread_mutex_unlock(&pvars);
+		  }
+
+		  if (actualLength >= 48) {
+			//printf("+");
+			// brake status status&0x04 == stopping wheel
+			//              status&0x01 == brake on
+			//curBrakeStatus = buf[42];
+
+				// pedal sensor is 0x01 when cycling
+				pedalSensor = buf[46];
+
+				// current distance
+				curDistanceDoubleRevs = (buf[28] | (buf[29] << 8) | (buf[30] << 16) | (buf[31] << 24));
+				if (startDistanceDoubleRevs == 0 || startDistanceDoubleRevs == 4100){
+					startDistanceDoubleRevs = curDistance;
+				}
+				curDistance = ((double)curDistanceDoubleRevs) * HALF_ROLLER_CIRCUMFERENCE_M ;	//0.06264880952;
+
+				// cadence - confirmed correct
+				curCadence = buf[44];
+
+				// speed
+				curRawSpeed =  (double)(FromLittleEndian<uint16_t>((uint16_t*)&buf[32]));
+				curSpeed = 1.3f * curRawSpeed / (3.6f * 100.00f);
+
+				// power
+				curRawPower = FromLittleEndian<int16_t>((int16_t*)&buf[38]);
+				if(FT_CALIBRATE == mode){
+					next_calibration_load_raw = curRawPower;
+					next_calibration_load_raw *= 0.9;
+					cur_calibration_load_raw = getBrakeCalibrationLoadRaw();
+					cur_calibration_load_raw *= 0.1;
+					cur_calibration_load_raw += next_calibration_load_raw;
+					setBrakeCalibrationLoadRaw(cur_calibration_load_raw);
+				}
+
+				nextPower = calculateWattageFromRaw(curRawPower, curRawSpeed);
+				curPower = power_model_smooth(curPower, nextPower, powerScaleFactor);
+
+				// heartrate - confirmed correct
+				curHeartRate = buf[12];
+
+				// update public fields
+				pthread_mutex_lock(&pvars);
+				deviceSpeed = curSpeed;
+				deviceDistance = curDistance;
+				deviceCadence = curCadence;
+				deviceHeartRate = curHeartRate;
+				devicePower = curPower;
+
+				rawPower = curRawPower;
+				rawSpeed = curRawSpeed;
+				deviceSampleTime = readTime;
+				pthread_mutex_unlock(&pvars);
+
+		  }
+
+		  if (actualLength >= 24) {
+				busSample.power_watts = curPower;
+				busSample.heartrate_bpm = curHeartRate;
+				busSample.cadence_rpm = curCadence;
+				busSample.speed_kph = curSpeed;
+				busSample.distance_m = curDistance;
+				busSample.raw_power = (int16_t)curRawPower;
+				busSample.raw_speed = (uint16_t)curRawSpeed;
+				busSample.steering = curSteering;
+				busSample.buttons = curButtons;
+				busSample.pedalling = pedalSensor;
+				memset(busSample.reserved, 0, sizeof(busSample.reserved));
+				telemetry_bus_publish_sample(readTime, &busSample);
+		  }
+
+		  if(actualLength != 24 && actualLength != 48) {
+				std::cout << "Fortius::run: error, got a length of " << actualLength << std::endl;
+		   }
+		break;
+	}
+
+	case FT_STEP_PAUSED:
+		break;
+
+	case FT_STEP_DONE:
+		return -1;
+	}
+
+	//----------------------------------------------------------------
+	// LISTEN TO GUI CONTROL COMMANDS
+	//----------------------------------------------------------------
+	pthread_mutex_lock(&pvars);
+	curstatus = this->deviceStatus;
+	pthread_mutex_unlock(&pvars);
+
+	/* time to shut up shop */
+	if (!(curstatus & FT_RUNNING)) {
+		// time to stop!
 
+		sendCloseCommand();
+
+		closePort(); // need to release that file handle!!
+		quit(0);
+		stepState = FT_STEP_DONE;
+		return -1;
+	}
+
+	if ((curstatus & FT_PAUSED) && isDeviceOpen == true) {
+
+		closePort();
+		isDeviceOpen = false;
+
+	} else if (!(curstatus & FT_PAUSED) && (curstatus & FT_RUNNING) && isDeviceOpen == false) {
+
+		if (openPort()) {
+			quit(2);
+			stepState = FT_STEP_DONE;
+			return -1; // open failed!
 		}
+		isDeviceOpen = true;
+		sendOpenCommand();
 
+	}
 
-		// The controller updates faster than the brake. Setting this to a low value (<50ms) increases the frequency of controller
-		// only packages (24byte).
-		//usleep(10000);	// 10ms
+	if (isDeviceOpen == false) {
+		// look again later, nothing to talk to
+		stepState = FT_STEP_PAUSED;
+		return FT_READ_DELAY;
 	}
+
+	// The controller updates faster than the brake. Setting this to a low value (<50ms) increases the frequency of controller
+	// only packages (24byte).
+	stepState = FT_STEP_WRITE;
+	return delayLeft (FT_READ_DELAY);
 }
 
 /* ----------------------------------------------------------------------
@@ -747,6 +813,10 @@ int Fortius::sendRunCommand(int16_t pedalSensor)
 	int16_t load = (int16_t)this->load;
 	unsigned int weight = (unsigned int)this->weight;
 	int16_t brakeCalibrationFactor = (int16_t)this->brakeCalibrationFactor;
+	uint64_t commandReceived = commandReceivedTime;
+	uint64_t commandSet = commandSetTime;
+	uint64_t commandAir = commandAirTime;
+	commandReceivedTime = commandSetTime = commandAirTime = 0;
 	pthread_mutex_unlock(&pvars);
 
 	if (mode == FT_ERGOMODE) {
@@ -779,6 +849,23 @@ int Fortius::sendRunCommand(int16_t pedalSensor)
 		retCode = rawWrite(CALIBRATE_Command, 12);
 	}
 
+	if (retCode >= 0) {
+		uint64_t now = latency_now_us();
+		metrics_count(METRIC_TRAINER_WRITES);
+		latency_record(LATENCY_SET_TO_WRITE, commandSet, now);
+		latency_record(LATENCY_COMMAND_TO_WRITE, commandReceived, now);
+		latency_record(LATENCY_AIR_TO_WRITE, commandAir, now);
+	} else if (commandReceived) {
+		// still waiting for the brake, the retry after reopening counts
+		pthread_mutex_lock(&pvars);
+		if (commandReceivedTime == 0) {
+			commandReceivedTime = commandReceived;
+			commandSetTime = commandSet;
+			commandAirTime = commandAir;
+		}
+		pthread_mutex_unlock(&pvars);
+	}
+
 	//std::cout << "usb status " << retCode;
 	return retCode;
 }
@@ -803,34 +890,19 @@ int Fortius::readMessage()
 	return rc;
 }
 
-void Fortius::go_sleep (timespec *last_measured_time, int delay_msec)
+int Fortius::delayLeft (int delay_msec)
 {
-	timespec 	current_time;
-	timespec	time_passed;
 	int				time_passed_msec;
 
-	clock_gettime (CLOCK_MONOTONIC, &current_time);
-
-	time_passed = timespec_diff (last_measured_time, &current_time);
-	time_passed_msec = (int)time_passed.tv_sec * 1000 + (double)time_passed.tv_nsec/1000000.0;
+	// unsigned difference survives the millisecond clock wrapping
+	time_passed_msec = (int)(DSIThread_GetSystemTime() - last_measured_time);
 	if (delay_msec - time_passed_msec > 0) {
 		VLOG (2) << "Delay: " << delay_msec - time_passed_msec << " [msec]";
-		usleep ((delay_msec - time_passed_msec) * 1000);
+		return delay_msec - time_passed_msec;
+	} else if (delay_msec - time_passed_msec < 0) {
+		metrics_count(METRIC_TRAINER_OVERRUNS);
 	}
-}
-
-timespec Fortius::timespec_diff(timespec *start, timespec *end)
-{
-	timespec temp;
-
-	if ((end->tv_nsec-start->tv_nsec)<0) {
-		temp.tv_sec = end->tv_sec-start->tv_sec-1;
-		temp.tv_nsec = 1000000000+end->tv_nsec-start->tv_nsec;
-	} else {
-		temp.tv_sec = end->tv_sec-start->tv_sec;
-		temp.tv_nsec = end->tv_nsec-start->tv_nsec;
-	}
-	return temp;
+	return 0;
 }
 
 int Fortius::closePort()
@@ -45,6 +45,7 @@
 */
 
 #include "LibUsb.h"
+#include "dsi_thread.h"
 
 #include <stdio.h>
 #include <stdint.h>
@@ -73,6 +74,13 @@
 #define FT_PAUSED      0x02
 #define FT_ERROR       0x04
 
+/* run() states, see step() */
+#define FT_STEP_OPEN   0
+#define FT_STEP_WRITE  1
+#define FT_STEP_READ   2
+#define FT_STEP_PAUSED 3
+#define FT_STEP_DONE   4
+
 // Delays in msec
 #define FT_READ_DELAY		240
 #define FT_WRITE_DELAY	70
@@ -94,21 +102,22 @@ class Fortius
 
 public:
 	Fortius();
-	~Fortius();
+	virtual ~Fortius();
 
 
 	// HIGH-LEVEL FUNCTIONS
-	int start();                                // Calls pthread to start
+	int start(bool thread = true);              // Calls pthread to start, or without thread the caller runs step()
 	int restart();                              // restart after paused
 	int pause();                                // pauses data collection, inbound telemetry is discarded
 	int stop();                                 // stops data collection thread
 	int quit(int error);                        // called by thread before exiting
-	int join();				    // wait on thread
+	int join();				    // wait on thread, without one run the remaining steps here
 	void hex_dump(uint8_t* data, int data_size);// debug
 	double calculateWattageFromRaw(double powerRaw, double speedKph);	// convert raw power number into a wattage. depends on speed
 	double calculateRawLoadFromWattage(double requiredWatts); // figures out what raw load numbers to put in for a desired wattage load in erg mode
 	void run();                                 // called by start to kick off the CT control thread
 	static void* run_helper(void* This);	    // static version that calls run so pthread can call it
+	int step();                                 // one write or read of run(), then msec until the next, -1 once stopped
 
 
 	bool find();                                // either unconfigured or configured device found
@@ -123,6 +132,7 @@ public:
 	void setMode(int mode);
 	void setWeight(double weight);                 // set the total weight of rider + bike in kg's
 	void setBrakeCalibrationLoadRaw(double load);
+	void markCommand(uint64_t receivedUs, uint64_t airUs = 0);	// the load just set came from a command received then, on air at airUs if known, see LatencyStats.h
 
 	int getMode();
 	double getGradient();
@@ -136,11 +146,14 @@ public:
 	// GET TELEMETRY AND STATUS
 	// direct access to class variables is not allowed because we need to use wait conditions
 	// to sync data read/writes between the run() thread and the main gui thread
-	void getTelemetry(double& powerWatts, double& heartrateBPM, double& cadenceRPM, double& speedKMH, double& distanceM, int& buttons, int& steering, int& status);
+	// sampleTimeUs is when the values were read from the trainer, latency_now_us()
+	void getTelemetry(double& powerWatts, double& heartrateBPM, double& cadenceRPM, double& speedKMH, double& distanceM, int& buttons, int& steering, int& status, uint64_t* sampleTimeUs = NULL);
 
 private:
 	pthread_t           thread_handle;
 	pthread_mutex_t    pvars;
+	DSI_CANCEL_TOKEN   stopToken;              // stop() cancels it, run() wakes from its sleep
+	bool stopTokenValid;                    // start() fails without it
 
 
 	uint8_t ERGO_Command[12],
@@ -148,8 +161,9 @@ private:
 		CALIBRATE_Command[12];
 
 	// Utility and BG Thread functions
-	int openPort();
-	int closePort();
+	// the port functions are virtual so a simulated trainer can stand in for the USB device
+	virtual int openPort();
+	virtual int closePort();
 
 	// Protocol encoding
 	int sendRunCommand(int16_t pedalSensor);
@@ -160,8 +174,7 @@ private:
 	int readMessage();
 	//void unpackTelemetry(int &b1, int &b2, int &b3, int &buttons, int &type, int &value8, int &value12);
 
-	void go_sleep (timespec *last_measured_time, int delay_msec);
-	timespec timespec_diff (timespec *start, timespec *end);
+	int delayLeft (int delay_msec);		// what is left of delay_msec since last_measured_time
 
 
 	// INBOUND TELEMETRY - all volatile since it is updated by the run() thread
@@ -173,6 +186,7 @@ private:
 	volatile int    deviceButtons;          // Button status
 	volatile int    deviceStatus;           // Device status running, paused, disconnected
 	volatile int    deviceSteering;            // Steering angle
+	uint64_t        deviceSampleTime;          // latency_now_us() when the telemetry above was read
 
 	// OUTBOUND COMMANDS - all volatile since it is updated by the GUI thread
 	volatile int mode;
@@ -182,6 +196,26 @@ private:
 	volatile double brakeCalibrationLoadRaw;
 	volatile double powerScaleFactor;
 	volatile double weight;
+	uint64_t commandReceivedTime;           // latency stamps of the command not yet written to the brake, 0 if none
+	uint64_t commandSetTime;
+	uint64_t commandAirTime;
+
+	// run() state, kept between steps
+	int stepState;                          // FT_STEP_OPEN etc.
+	bool threaded;                          // start() made a thread for run()
+	bool isDeviceOpen;
+	uint32_t last_measured_time;            // ms from DSIThread_GetSystemTime() of the last read or write
+	double curPower;                        // current output power in Watts
+	double curHeartRate;                    // current heartrate in BPM
+	double curCadence;                      // current cadence in RPM
+	double curSpeed;                        // current speed in KPH
+	double curDistance;                     // odometer?
+	uint32_t startDistanceDoubleRevs;       // every revolution of the roller counts twice
+	int curButtons;                         // Button status
+	int curSteering;                        // Angle of steering controller
+	uint8_t pedalSensor;                    // 1 when using is cycling else 0, fed back to brake although appears unnecessary
+	double curRawSpeed;
+	double curRawPower;                     // read the raw power number from 48 byte message...THIS IS NOT WATTS? is it TORQUE?
 
 	// i/o message holder
 	uint8_t buf[64];
@@ -190,8 +224,8 @@ private:
 	LibUsb* usb2;                   // used for USB2 support
 
 	// raw device utils
-	int rawWrite(uint8_t* bytes, int size); // unix!!
-	int rawRead(uint8_t* bytes, int size); // unix!!
+	virtual int rawWrite(uint8_t* bytes, int size); // unix!!
+	virtual int rawRead(uint8_t* bytes, int size); // unix!!
 
 public:
 	volatile double rawPower;
@@ -0,0 +1,245 @@
+/*
+ * FortiusSim.cpp
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "FortiusSim.h"
+#include "EndianSwap.h"
+#include "dsi_thread.h"
+#include <string.h>
+#include <errno.h>
+#include <glog/logging.h>
+
+#define SIM_FRAME_SIZE	48
+
+FortiusSim::FortiusSim()
+{
+	pthread_mutex_init(&m_sim_mutex, NULL);
+	m_reads = 0;
+	m_writes = 0;
+	m_buttons = 0;
+	m_mode = FT_IDLE;
+	m_brake_raw = 0;
+	m_distance_double_revs = 0;
+	m_last_read_time = 0;
+	m_write_faults = 0;
+	m_read_faults = 0;
+	m_unplugged_until = 0;
+	m_brake_changes.reserve(1024);
+}
+
+FortiusSim::~FortiusSim()
+{
+	pthread_mutex_destroy(&m_sim_mutex);
+}
+
+double FortiusSim::now_seconds()
+{
+	return DSIThread_GetSystemTime() / 1000.0;	// the bridge clock, virtual in a simulation
+}
+
+void FortiusSim::press_buttons(int buttons)
+{
+	pthread_mutex_lock(&m_sim_mutex);
+	m_buttons |= buttons;
+	pthread_mutex_unlock(&m_sim_mutex);
+}
+
+uint32_t FortiusSim::get_reads()
+{
+	uint32_t	reads;
+
+	pthread_mutex_lock(&m_sim_mutex);
+	reads = m_reads;
+	pthread_mutex_unlock(&m_sim_mutex);
+	return reads;
+}
+
+uint32_t FortiusSim::get_writes()
+{
+	uint32_t	writes;
+
+	pthread_mutex_lock(&m_sim_mutex);
+	writes = m_writes;
+	pthread_mutex_unlock(&m_sim_mutex);
+	return writes;
+}
+
+std::vector<brake_change_t> FortiusSim::get_brake_changes()
+{
+	std::vector<brake_change_t>	changes;
+
+	pthread_mutex_lock(&m_sim_mutex);
+	changes = m_brake_changes;
+	pthread_mutex_unlock(&m_sim_mutex);
+	return changes;
+}
+
+void FortiusSim::reserve_brake_changes(size_t count)
+{
+	pthread_mutex_lock(&m_sim_mutex);
+	m_brake_changes.reserve(m_brake_changes.size() + count);
+	pthread_mutex_unlock(&m_sim_mutex);
+}
+
+void FortiusSim::fail_writes(int count)
+{
+	pthread_mutex_lock(&m_sim_mutex);
+	m_write_faults += count;
+	pthread_mutex_unlock(&m_sim_mutex);
+}
+
+void FortiusSim::fail_reads(int count)
+{
+	pthread_mutex_lock(&m_sim_mutex);
+	m_read_faults += count;
+	pthread_mutex_unlock(&m_sim_mutex);
+}
+
+void FortiusSim::unplug(uint32_t msec)
+{
+	pthread_mutex_lock(&m_sim_mutex);
+	m_unplugged_until = now_seconds() + msec / 1000.0;
+	pthread_mutex_unlock(&m_sim_mutex);
+}
+
+int FortiusSim::get_faults_pending()
+{
+	int		faults;
+
+	pthread_mutex_lock(&m_sim_mutex);
+	faults = m_write_faults + m_read_faults;
+	if(now_seconds() < m_unplugged_until) {
+		faults++;
+	}
+	pthread_mutex_unlock(&m_sim_mutex);
+	return faults;
+}
+
+int FortiusSim::openPort()
+{
+	VLOG(1) << "FortiusSim::openPort";
+	pthread_mutex_lock(&m_sim_mutex);
+	if(now_seconds() < m_unplugged_until) {
+		pthread_mutex_unlock(&m_sim_mutex);
+		errno = ENODEV;
+		return -1;
+	}
+	m_last_read_time = now_seconds();
+	pthread_mutex_unlock(&m_sim_mutex);
+	return 0;
+}
+
+int FortiusSim::closePort()
+{
+	VLOG(1) << "FortiusSim::closePort";
+	return 0;
+}
+
+int FortiusSim::rawWrite(uint8_t* bytes, int size)
+{
+	int		mode = FT_IDLE;
+	int16_t		brake_raw = 0;
+	brake_change_t	change;
+
+	// 12 byte run commands carry the brake, see the layout at the top of Fortius.cpp.
+	// The 4 byte open command and the close command leave the brake idle
+	if(size == 12 && bytes[8] != 0) {
+		if(bytes[8] == 0x03) {
+			mode = FT_CALIBRATE;
+		} else if(bytes[9] == 0x0a) {
+			mode = FT_ERGOMODE;
+		} else {
+			mode = FT_SSMODE;
+		}
+		brake_raw = FromLittleEndian<int16_t>((int16_t*)&bytes[4]);
+	}
+
+	pthread_mutex_lock(&m_sim_mutex);
+	if(m_write_faults > 0 || now_seconds() < m_unplugged_until) {
+		if(m_write_faults > 0) {
+			m_write_faults--;
+		}
+		pthread_mutex_unlock(&m_sim_mutex);
+		return -1;
+	}
+	m_writes++;
+	if(mode != m_mode || brake_raw != m_brake_raw) {
+		m_mode = mode;
+		m_brake_raw = brake_raw;
+		change.time = now_seconds();
+		change.mode = mode;
+		change.brake_raw = brake_raw;
+		m_brake_changes.push_back(change);
+		VLOG(2) << "FortiusSim: mode " << mode << ", brake " << brake_raw;
+	}
+	pthread_mutex_unlock(&m_sim_mutex);
+
+	return size;
+}
+
+int FortiusSim::rawRead(uint8_t* bytes, int size)
+{
+	double		now = now_seconds();
+	double		raw_speed = FORTIUS_SIM_SPEED_KPH * 3.6 * 100.0 / 1.3;	// inverse of Fortius::run()
+	int16_t		raw_power;
+	uint32_t	distance;
+
+	if(size < SIM_FRAME_SIZE) {
+		return -1;
+	}
+	memset(bytes, 0, SIM_FRAME_SIZE);
+
+	pthread_mutex_lock(&m_sim_mutex);
+	if(m_read_faults > 0 || now < m_unplugged_until) {
+		if(m_read_faults > 0) {
+			m_read_faults--;
+		}
+		pthread_mutex_unlock(&m_sim_mutex);
+		return -1;
+	}
+	m_reads++;
+	m_distance_double_revs += (now - m_last_read_time) * (FORTIUS_SIM_SPEED_KPH / 3.6) / HALF_ROLLER_CIRCUMFERENCE_M;
+	m_last_read_time = now;
+	distance = (uint32_t)m_distance_double_revs;
+
+	// the rider matches whatever the brake asks for
+	if(m_mode == FT_CALIBRATE) {
+		raw_power = DEFAULT_CALIBRATION_LOAD_RAW;
+	} else if(m_mode == FT_IDLE) {
+		raw_power = 0;
+	} else {
+		raw_power = m_brake_raw;
+	}
+
+	bytes[12] = FORTIUS_SIM_HEARTRATE_BPM;
+	bytes[13] = m_buttons;
+	m_buttons = 0;
+	pthread_mutex_unlock(&m_sim_mutex);
+
+	bytes[28] = distance & 0xFF;
+	bytes[29] = (distance >> 8) & 0xFF;
+	bytes[30] = (distance >> 16) & 0xFF;
+	bytes[31] = (distance >> 24) & 0xFF;
+	ToLittleEndian<uint16_t>((uint16_t)raw_speed, (uint16_t*)&bytes[32]);
+	ToLittleEndian<int16_t>(raw_power, (int16_t*)&bytes[38]);
+	bytes[44] = FORTIUS_SIM_CADENCE_RPM;
+	bytes[46] = 0x01;	// pedalling
+
+	return SIM_FRAME_SIZE;
+}
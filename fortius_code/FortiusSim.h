@@ -0,0 +1,80 @@
+/*
+ * FortiusSim.h
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef FORTIUS_SIM_H
+#define FORTIUS_SIM_H
+
+#include "Fortius.h"
+#include <vector>
+
+#define FORTIUS_SIM_SPEED_KPH	30.0	// rider holds this speed whatever the load
+#define FORTIUS_SIM_CADENCE_RPM	90
+#define FORTIUS_SIM_HEARTRATE_BPM	130
+
+typedef struct brake_change_s {
+	double		time;		// DSIThread_GetSystemTime() in seconds when the command was written
+	int		mode;		// FT_xxx decoded from the command
+	int16_t		brake_raw;	// brake value, bytes 4 and 5
+} brake_change_t;
+
+// Stands in for the trainer behind the USB port.  Every command Fortius::run()
+// writes is decoded and changes of the brake setpoint are time stamped, every
+// read returns a 48 byte telemetry frame of a rider holding a steady speed and
+// matching the brake load.  USB errors and unplugging can be injected.
+class FortiusSim : public Fortius
+{
+public:
+			FortiusSim();
+			~FortiusSim();
+
+	void		press_buttons(int buttons);	// reported once, in the next frame
+	uint32_t	get_reads();
+	uint32_t	get_writes();
+	std::vector<brake_change_t>	get_brake_changes();
+	void		reserve_brake_changes(size_t count);	// so recording them does not allocate
+
+	void		fail_writes(int count);		// the next count writes fail
+	void		fail_reads(int count);		// the next count reads fail
+	void		unplug(uint32_t msec);		// open, read and write fail for msec
+	int		get_faults_pending();		// injected faults not over yet
+
+private:
+	int		openPort();
+	int		closePort();
+	int		rawWrite(uint8_t* bytes, int size);
+	int		rawRead(uint8_t* bytes, int size);
+
+	double		now_seconds();
+
+	pthread_mutex_t	m_sim_mutex;
+	uint32_t	m_reads;		// successful reads only
+	uint32_t	m_writes;
+	int		m_buttons;
+	int		m_mode;
+	int16_t		m_brake_raw;
+	double		m_distance_double_revs;
+	double		m_last_read_time;
+	int		m_write_faults;
+	int		m_read_faults;
+	double		m_unplugged_until;
+	std::vector<brake_change_t>	m_brake_changes;
+};
+
+#endif // FORTIUS_SIM_H
@@ -0,0 +1,184 @@
+/*
+ * LatencyStats.cpp
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "LatencyStats.h"
+#include "dsi_thread.h"
+#include <time.h>
+#include <atomic>
+#include <iostream>
+
+#define SUB_BUCKETS		(1 << LATENCY_SUB_BUCKET_BITS)
+
+static const char* stage_names[LATENCY_STAGES] = {
+	"read_to_copy",
+	"copy_to_send",
+	"send_to_tx",
+	"read_to_tx",
+	"command_to_set",
+	"set_to_write",
+	"command_to_write",
+	"air_to_rx",
+	"air_to_write",
+};
+
+typedef struct histogram_s {
+	std::atomic<uint64_t>	buckets[LATENCY_BUCKETS];
+	std::atomic<uint64_t>	count;
+	std::atomic<uint64_t>	sum_us;
+	std::atomic<uint64_t>	max_us;
+} histogram_t;
+
+static histogram_t	histograms[LATENCY_STAGES];
+
+static int bucket_index(uint64_t us)
+{
+	int		shift;
+
+	if(us < 2 * SUB_BUCKETS) {
+		return (int)us;
+	}
+	// keep the top LATENCY_SUB_BUCKET_BITS + 1 bits
+	shift = 63 - __builtin_clzll(us) - LATENCY_SUB_BUCKET_BITS;
+	return 2 * SUB_BUCKETS + (shift - 1) * SUB_BUCKETS + (int)((us >> shift) - SUB_BUCKETS);
+}
+
+// highest value that lands in the bucket, so percentiles never read low
+static uint64_t bucket_value(int index)
+{
+	int		shift;
+	uint64_t	sub;
+
+	if(index < 2 * SUB_BUCKETS) {
+		return index;
+	}
+	shift = (index - 2 * SUB_BUCKETS) / SUB_BUCKETS + 1;
+	sub = (index - 2 * SUB_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS;
+	return ((sub + 1) << shift) - 1;
+}
+
+uint64_t latency_now_us()
+{
+	timespec	ts;
+
+	if(DSIThread_VirtualTimeIsEnabled()) {
+		return (uint64_t)DSIThread_GetSystemTime() * 1000;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void latency_record(int stage, uint64_t start_us, uint64_t end_us)
+{
+	histogram_t*	h;
+	uint64_t	us;
+	uint64_t	max;
+
+	if(start_us == 0 || stage < 0 || stage >= LATENCY_STAGES) {
+		return;
+	}
+	us = end_us > start_us ? end_us - start_us : 0;
+	if(us > LATENCY_MAX_US) {
+		us = LATENCY_MAX_US;
+	}
+
+	h = &histograms[stage];
+	h->buckets[bucket_index(us)].fetch_add(1, std::memory_order_relaxed);
+	h->sum_us.fetch_add(us, std::memory_order_relaxed);
+	max = h->max_us.load(std::memory_order_relaxed);
+	while(us > max && !h->max_us.compare_exchange_weak(max, us, std::memory_order_relaxed));
+	h->count.fetch_add(1, std::memory_order_release);
+}
+
+uint64_t latency_count(int stage)
+{
+	return histograms[stage].count.load(std::memory_order_acquire);
+}
+
+uint64_t latency_sum_us(int stage)
+{
+	return histograms[stage].sum_us.load(std::memory_order_relaxed);
+}
+
+const char* latency_stage_name(int stage)
+{
+	return stage_names[stage];
+}
+
+double latency_percentile_ms(int stage, double p)
+{
+	histogram_t*	h = &histograms[stage];
+	uint64_t	count = latency_count(stage);
+	uint64_t	rank;
+	uint64_t	seen = 0;
+	uint64_t	max;
+
+	if(count == 0) {
+		return 0;
+	}
+	rank = (uint64_t)(p * count + 0.5);
+	if(rank < 1) {
+		rank = 1;
+	}
+	max = h->max_us.load(std::memory_order_relaxed);
+	for(int i = 0; i < LATENCY_BUCKETS; i++) {
+		seen += h->buckets[i].load(std::memory_order_relaxed);
+		if(seen >= rank) {
+			uint64_t	us = bucket_value(i);
+
+			return (us < max ? us : max) / 1000.0;
+		}
+	}
+	return max / 1000.0;
+}
+
+void latency_print()
+{
+	for(int stage = 0; stage < LATENCY_STAGES; stage++) {
+		uint64_t	count = latency_count(stage);
+
+		if(count == 0) {
+			continue;
+		}
+		std::cout << "latency"
+			<< " stage=" << stage_names[stage]
+			<< " count=" << count
+			<< " mean_ms=" << latency_sum_us(stage) / 1000.0 / count
+			<< " p50_ms=" << latency_percentile_ms(stage, 0.50)
+			<< " p90_ms=" << latency_percentile_ms(stage, 0.90)
+			<< " p99_ms=" << latency_percentile_ms(stage, 0.99)
+			<< " p999_ms=" << latency_percentile_ms(stage, 0.999)
+			<< " max_ms=" << histograms[stage].max_us.load(std::memory_order_relaxed) / 1000.0
+			<< std::endl;
+	}
+}
+
+void latency_reset()
+{
+	for(int stage = 0; stage < LATENCY_STAGES; stage++) {
+		histogram_t*	h = &histograms[stage];
+
+		h->count.store(0, std::memory_order_relaxed);
+		for(int i = 0; i < LATENCY_BUCKETS; i++) {
+			h->buckets[i].store(0, std::memory_order_relaxed);
+		}
+		h->sum_us.store(0, std::memory_order_relaxed);
+		h->max_us.store(0, std::memory_order_relaxed);
+	}
+}
@@ -0,0 +1,58 @@
+/*
+ * LatencyStats.h
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+#include <stdint.h>
+
+// telemetry, trainer to air
+#define LATENCY_READ_TO_COPY		0	// Fortius::readMessage() returned to CANTMaster first copying the sample
+#define LATENCY_COPY_TO_SEND		1	// first copied to each page carrying it handed to ANT_SendBroadcastData()
+#define LATENCY_SEND_TO_TX		2	// page handed over to the EVENT_TX of the slot it went out in
+#define LATENCY_READ_TO_TX		3	// age of the telemetry when it went out
+// commands, display to brake
+#define LATENCY_COMMAND_TO_SET		4	// FE-C control page received to the new load set on Fortius
+#define LATENCY_SET_TO_WRITE		5	// load set to the brake command written
+#define LATENCY_COMMAND_TO_WRITE	6	// FE-C control page received to the brake command written
+// with --rx-timestamps, from when the stick says the page was on air, see StickClock.h
+#define LATENCY_AIR_TO_RX		7	// stick to bridge delivery, over the fastest seen
+#define LATENCY_AIR_TO_WRITE		8	// FE-C control page on air to the brake command written
+#define LATENCY_STAGES			9
+
+// HDR style buckets: exact below 64us, then 32 per power of two, so a
+// bucket is within 1/32 of the values in it.  Covers up to ~19 hours.
+#define LATENCY_SUB_BUCKET_BITS		5
+#define LATENCY_BUCKETS			1024
+#define LATENCY_MAX_US			((1ULL << 36) - 1)
+
+// Stamps are microseconds on the bridge clock, so virtual time runs give the
+// same histograms every time.  Recording is lock free and does not allocate,
+// any thread can record while another prints.
+uint64_t	latency_now_us();
+void		latency_record(int stage, uint64_t start_us, uint64_t end_us);	// start_us 0 is not recorded
+uint64_t	latency_count(int stage);
+uint64_t	latency_sum_us(int stage);
+const char*	latency_stage_name(int stage);	// "read_to_copy" ...
+double		latency_percentile_ms(int stage, double p);			// p 0-1, 0 if nothing recorded
+void		latency_print();		// one "latency ..." line per stage that recorded anything
+void		latency_reset();
+
+#endif // LATENCY_STATS_H
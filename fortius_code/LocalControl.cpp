@@ -0,0 +1,217 @@
+/*
+ * LocalControl.cpp
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "LocalControl.h"
+#include "CANTMaster.h"
+#include "BridgeMetrics.h"
+#include "LatencyStats.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <iostream>
+#include <glog/logging.h>
+
+// false for NaN as well
+#define IN_RANGE(value, low, high)	((value) >= (low) && (value) <= (high))
+
+LocalControl::LocalControl(CANTMaster* ant_master)
+{
+	m_ant_master = ant_master;
+	m_fd = -1;
+	m_stop_token_valid = (DSIThread_CancelInit(&m_stop_token) == DSI_THREAD_ENONE);
+	m_timeout_ms = LOCAL_CONTROL_DEFAULT_TIMEOUT_MS;
+	m_active = false;
+	m_last_sequence = 0;
+	memset(&m_unix_address, 0, sizeof(m_unix_address));
+}
+
+LocalControl::~LocalControl()
+{
+	stop();
+	DSIThread_CancelDestroy(&m_stop_token);
+}
+
+bool LocalControl::start(const char* address, uint32_t timeout_ms)
+{
+	m_timeout_ms = timeout_ms;
+
+	if(!m_stop_token_valid) {
+		std::cout << "Failed to create local control stop eventfd" << std::endl;
+		return false;
+	}
+	if(address[0] == '/') {
+		struct stat	path_stat;
+
+		if(strlen(address) >= sizeof(m_unix_address.sun_path)) {
+			std::cout << "Control socket path too long" << std::endl;
+			return false;
+		}
+		m_unix_address.sun_family = AF_UNIX;
+		strcpy(m_unix_address.sun_path, address);
+		// left behind by an earlier run, but never remove anything that is not a socket
+		if(lstat(address, &path_stat) == 0) {
+			if(!S_ISSOCK(path_stat.st_mode)) {
+				std::cout << "Control socket path " << address << " exists and is not a socket" << std::endl;
+				return false;
+			}
+			unlink(address);
+		}
+
+		m_fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+		if(m_fd < 0 || bind(m_fd, (struct sockaddr*)&m_unix_address, sizeof(m_unix_address)) != 0) {
+			std::cout << "Failed to bind control socket " << address << ": " << strerror(errno) << std::endl;
+			goto failed;
+		}
+	} else {
+		struct sockaddr_in	inet_address;
+		int			port = atoi(address);
+
+		if(port <= 0 || port > 65535) {
+			std::cout << "Invalid control port " << address << std::endl;
+			return false;
+		}
+		memset(&inet_address, 0, sizeof(inet_address));
+		inet_address.sin_family = AF_INET;
+		inet_address.sin_port = htons(port);
+		inet_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		m_fd = socket(AF_INET, SOCK_DGRAM, 0);
+		if(m_fd < 0 || bind(m_fd, (struct sockaddr*)&inet_address, sizeof(inet_address)) != 0) {
+			std::cout << "Failed to bind control port " << port << ": " << strerror(errno) << std::endl;
+			goto failed;
+		}
+	}
+
+	DSIThread_CancelReset(&m_stop_token);
+	if(pthread_create(&m_pthread, NULL, &LocalControl::run_helper, this) != 0) {
+		std::cout << "Failed to start local control thread" << std::endl;
+		goto failed;
+	}
+	pthread_setname_np(m_pthread, "local_control");
+	return true;
+
+failed:
+	if(m_fd >= 0) {
+		close(m_fd);
+		m_fd = -1;
+	}
+	return false;
+}
+
+void LocalControl::stop()
+{
+	if(m_fd < 0) {
+		return;
+	}
+	DSIThread_Cancel(&m_stop_token);
+	pthread_join(m_pthread, NULL);
+	close(m_fd);
+	m_fd = -1;
+	if(m_unix_address.sun_family == AF_UNIX) {
+		unlink(m_unix_address.sun_path);
+	}
+	if(m_active) {
+		m_ant_master->local_release();
+		m_active = false;
+	}
+}
+
+void* LocalControl::run_helper(void* context)
+{
+	((LocalControl*)context)->run();
+	return NULL;
+}
+
+bool LocalControl::valid(const local_control_t* message)
+{
+	if(message->magic != LOCAL_CONTROL_MAGIC || message->version != LOCAL_CONTROL_VERSION) {
+		return false;
+	}
+	if((message->fields & LOCAL_CONTROL_TARGET_POWER) && !IN_RANGE(message->target_power_watts, 0, 4000)) {
+		return false;
+	}
+	if((message->fields & LOCAL_CONTROL_TRACK) && (!IN_RANGE(message->slope_percent, -200, 200) || !IN_RANGE(message->crr, 0, 0.0127))) {
+		return false;
+	}
+	if((message->fields & LOCAL_CONTROL_WIND) && (!IN_RANGE(message->wind_resistance_coef, 0, 1.86)
+			|| !IN_RANGE(message->wind_speed_kph, -127, 127) || !IN_RANGE(message->drafting_factor, 0, 1))) {
+		return false;
+	}
+	// a datagram setting both modes has no meaning
+	if((message->fields & LOCAL_CONTROL_TARGET_POWER) && (message->fields & LOCAL_CONTROL_TRACK)) {
+		return false;
+	}
+	// after a restart of the sender or a timeout any sequence starts afresh
+	if(m_active && (int32_t)(message->sequence - m_last_sequence) <= 0) {
+		return false;
+	}
+	return true;
+}
+
+void LocalControl::run()
+{
+	struct pollfd		pfd[2];
+	local_control_t		message;
+	ssize_t			size;
+	uint64_t		rx_time_us;
+	int			ready;
+
+	VLOG (1) << "Local control running";
+	pfd[0].fd = m_fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = DSIThread_CancelGetFd(&m_stop_token);
+	pfd[1].events = POLLIN;
+	while(false == DSIThread_IsCancelled(&m_stop_token)) {
+		ready = poll(pfd, 2, LOCAL_CONTROL_POLL_MS);
+		// datagrams that get dropped do not keep local control alive either
+		if(m_active && m_ant_master->local_watchdog()) {
+			m_active = false;
+			metrics_count(METRIC_LOCAL_TIMEOUTS);
+		}
+		if(ready <= 0 || !(pfd[0].revents & POLLIN)) {
+			continue;
+		}
+
+		size = recv(m_fd, &message, sizeof(message), MSG_TRUNC);
+		rx_time_us = latency_now_us();
+		if(size != sizeof(message) || !valid(&message)) {
+			VLOG (1) << "Local control: dropped a datagram of " << size << " bytes";
+			metrics_count(METRIC_LOCAL_DROPPED);
+			continue;
+		}
+		metrics_count(METRIC_LOCAL_COMMANDS);
+		m_last_sequence = message.sequence;
+
+		if(message.fields & LOCAL_CONTROL_RELEASE) {
+			if(m_active) {
+				m_ant_master->local_release();
+				m_active = false;
+			}
+			continue;
+		}
+		m_ant_master->local_control(&message, rx_time_us, m_timeout_ms);
+		m_active = true;
+	}
+}
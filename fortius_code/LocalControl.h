@@ -0,0 +1,90 @@
+/*
+ * LocalControl.h
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef LOCAL_CONTROL_H
+#define LOCAL_CONTROL_H
+
+#include "dsi_thread.h"
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/un.h>
+
+#define LOCAL_CONTROL_MAGIC		0x4C54434C	// "LCTL"
+#define LOCAL_CONTROL_VERSION		1
+#define LOCAL_CONTROL_DEFAULT_TIMEOUT_MS	1000	// the brake goes back to the FE-C display this long after the last datagram
+#define LOCAL_CONTROL_POLL_MS		50		// watchdog resolution
+
+// fields, the values each datagram carries
+#define LOCAL_CONTROL_TARGET_POWER	0x0001	// target_power_watts, puts the bridge in ERG mode like FE-C page 49
+#define LOCAL_CONTROL_TRACK		0x0002	// slope_percent and crr, puts the bridge in slope mode like FE-C page 51
+#define LOCAL_CONTROL_WIND		0x0004	// wind_resistance_coef, wind_speed_kph and drafting_factor like FE-C page 50
+#define LOCAL_CONTROL_RELEASE		0x8000	// hand the brake back to the FE-C display now
+// no fields at all keeps local control alive without changing anything
+
+// One datagram, little endian, to the UDP port on 127.0.0.1 or the Unix
+// datagram socket given with --control.  Values are in the same units and
+// ranges as the FE-C pages, out of range datagrams are dropped.
+#pragma pack(push, 1)
+typedef struct local_control_s {
+	uint32_t	magic;			// LOCAL_CONTROL_MAGIC
+	uint16_t	version;		// LOCAL_CONTROL_VERSION
+	uint16_t	fields;			// LOCAL_CONTROL_TARGET_POWER ...
+	uint32_t	sequence;		// one more than the last, repeated or older datagrams are dropped
+	float		target_power_watts;	// 0-4000
+	float		slope_percent;		// -200 to 200
+	float		crr;			// 0-0.0127
+	float		wind_resistance_coef;	// 0-1.86 kg/m
+	float		wind_speed_kph;		// -127 to 127
+	float		drafting_factor;	// 0-1
+} local_control_t;
+#pragma pack(pop)
+
+class CANTMaster;
+
+// Drives the brake from local software without an FE-C master, a second
+// stick and the RF hop in between.  Datagrams land in the same command
+// block as the FE-C control pages and go to the Fortius straight away.
+// While local control has the brake FE-C control pages are held back.  When
+// datagrams stop for the timeout, the last ones the display sent take over.
+class LocalControl
+{
+public:
+			LocalControl(CANTMaster* ant_master);
+			~LocalControl();
+	bool		start(const char* address, uint32_t timeout_ms);	// address as for --metrics
+	void		stop();
+
+private:
+	static void*	run_helper(void* context);
+	void		run();
+	bool		valid(const local_control_t* message);
+
+	CANTMaster*	m_ant_master;
+	int		m_fd;
+	pthread_t	m_pthread;
+	DSI_CANCEL_TOKEN	m_stop_token;		// stop() wakes the poll with it
+	bool		m_stop_token_valid;		// start() fails without it
+	uint32_t	m_timeout_ms;
+	bool		m_active;			// our datagrams have the brake
+	uint32_t	m_last_sequence;
+	struct sockaddr_un	m_unix_address;
+};
+
+#endif // LOCAL_CONTROL_H
@@ -1,16 +1,43 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "Fortius.h"
 #include "CANTMaster.h"
+#include "FortiusSim.h"
+#include "BridgeBench.h"
+#include "SoakBench.h"
+#include "AllocCheck.h"
+#include "LatencyStats.h"
+#include "BridgeMetrics.h"
+#include "TelemetryBus.h"
+#include "FitWriter.h"
+#include "SessionLog.h"
+#include "Reprocess.h"
+#include "Reactor.h"
+#include "dsi_thread.h"
 #include "cxxopts.hpp"
 
 bool		exit_main_loop = false;
+DSI_CANCEL_TOKEN	main_stop;		// wakes the main loop for ctrl-c
+volatile uint64_t	stop_requested_ms = 0;	// the shutdown is timed from here
+volatile sig_atomic_t	dump_latency = 0;
 
 CANTMaster*		ant_master=NULL;
 
+// system clock, a shutdown on virtual time still takes real time
+static uint64_t monotonic_ms()
+{
+	timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 void ctrlc_handler(int sig)
 {
 	static bool first_time=true;
@@ -20,13 +47,74 @@ void ctrlc_handler(int sig)
 		first_time = false;
 		printf("first time.\n");
 
+		stop_requested_ms = monotonic_ms();
 		exit_main_loop = true;
+		DSIThread_Cancel(&main_stop);
 	} else {
-		printf("second or later time\n");
-		if(ant_master) {
-			ant_master->kill();
-		}
+		// every wait on the way out is woken, so this only helps with a stuck USB call
+		printf("second or later time, exiting now\n");
+		_exit(1);
+	}
+}
+
+// kill -USR1 prints the latency histograms and ANT counters from the main loop
+void usr1_handler(int)
+{
+	dump_latency = 1;
+}
+
+// --reactor, the trainer and the main loop's checks as reactor callbacks
+typedef struct reactor_main_s {
+	Reactor*	reactor;
+	Fortius*	fortius;
+	int		trainer_source;
+} reactor_main_t;
+
+static void reactor_trainer(void* context)
+{
+	reactor_main_t*	main = (reactor_main_t*)context;
+	int		delay_msec = main->fortius->step();
+
+	// stopped or failed, reactor_housekeeping sees which
+	if (delay_msec >= 0) {
+		main->reactor->arm_timer(main->trainer_source, delay_msec, 0);
+	}
+}
+
+static void reactor_housekeeping(void* context)
+{
+	reactor_main_t*	main = (reactor_main_t*)context;
+	double		value;
+	int		buttons, steering, status;
+
+	main->fortius->getTelemetry(value, value, value, value, value, buttons, steering, status);
+	if (status == FT_ERROR) {
+		std::cout << "Error in Fortius" << std::endl;
+		main->reactor->stop();
+	}
+	if (exit_main_loop) {
+		main->reactor->stop();
+	}
+}
+
+static void reactor_signal(void* context, int sig)
+{
+	reactor_main_t*	main = (reactor_main_t*)context;
+
+	if (sig == SIGUSR1) {
+		std::cout << std::endl;
+		latency_print();
+		CANTMaster::print_ant_stats();
+		return;
 	}
+	ctrlc_handler(sig);
+	main->reactor->stop();
+}
+
+static void* reactor_run_helper(void* context)
+{
+	((Reactor*)context)->run();
+	return NULL;
 }
 
 typedef struct fortius_telemetry_s {
@@ -51,9 +139,44 @@ int main(int argc, char* argv[])
 	double							user_weight	= DEFAULT_WEIGHT;
 	double							bike_weight = 8.6;
 	double 							wheel_circumference_mm = 2105;
+	bool								direct_dispatch = false;
+	bool								emulated_stick = false;
+	bool								low_power = false;
+	bool								rx_timestamps = false;
+	bool								use_reactor = false;
+	Reactor							reactor;
+	reactor_main_t			reactor_main;
+	pthread_t						reactor_thread = 0;	// only under a bench or soak
+	const int						reactor_signals[] = { SIGINT, SIGTERM, SIGUSR1 };
+	int									bench_seconds = 0;
+	int									soak_seconds = 0;
+	uint32_t						soak_faults = SOAK_ALL_FAULTS;
+	int									soak_interval_ms = SOAK_DEFAULT_INTERVAL_MS;
+	int									soak_seed = 0;
+	bool								virtual_time = false;
+	FortiusSim*					fortius_sim = NULL;
+	bridge_result_t			bench_result;
+	soak_result_t				soak_result;
+	bool								bench_passed = false;
+	std::string					metrics_address;
+	std::string					shm_name;
+	std::string					control_address;
+	std::string					fit_path;
+	FitWriter*					fit_writer = NULL;
+	std::string					log_path;
+	SessionLog*					session_log = NULL;
+	std::vector<std::string>	reprocess_logs;
+	int									reprocess_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int									control_timeout_ms = LOCAL_CONTROL_DEFAULT_TIMEOUT_MS;
+	LocalControl*				local_control = NULL;
 
 	// catch ctrl-c
+	if (DSIThread_CancelInit(&main_stop) != DSI_THREAD_ENONE) {
+		std::cout << "Failed to create stop eventfd: " << strerror(errno) << std::endl;
+		exit (1);
+	}
 	signal(SIGINT, ctrlc_handler);
+	signal(SIGUSR1, usr1_handler);
 
 	// Initialize Google Logging
 	google::InitGoogleLogging (argv [0]);
@@ -71,10 +194,30 @@ int main(int argc, char* argv[])
 			("u,userweight", "Set rider weight in [kg]", cxxopts::value<int>(), "WEIGHT")
 			("b,bikeweight", "Set bike weight in [kg]", cxxopts::value<int>(), "WEIGHT")
 			("c,wheelcircum", "Set wheel circumference in [mm]", cxxopts::value<int>(), "CIRCUMFERENCE")
+			("direct", "Dispatch ANT messages from the USB receive thread")
+			("emulator", "Use an emulated ANT stick instead of the USB dongle")
+			("low-power", "Have the ANT stick filter and batch the channel events the bridge does not need")
+			("rx-timestamps", "Have the ANT stick time stamp pages from the display, for latency from when they were on air")
+			("reactor", "Run the trainer, the ANT stick and the broadcasts from one thread, implies --direct")
+			("bench", "Run a scripted workout against a simulated trainer and an emulated ANT stick", cxxopts::value<int>(), "SECONDS")
+			("soak", "Inject USB and ANT faults into a simulated trainer and an emulated ANT stick and measure recovery", cxxopts::value<int>(), "SECONDS")
+			("faults", "Soak fault classes: usb_write, usb_read, trainer_gone, ant_crc, ant_overflow, ant_tx_drop, stick_gone or all", cxxopts::value<std::string>(), "LIST")
+			("fault-every", "Soak time between faults in [ms]", cxxopts::value<int>(), "MSEC")
+			("seed", "Soak in a random order from this seed instead of in turn", cxxopts::value<int>(), "SEED")
+			("virtual", "Run the benchmark or soak on virtual time, as fast as the CPU allows and repeatable")
+			("metrics", "Serve Prometheus metrics on this localhost port, or on this Unix socket if it is a path", cxxopts::value<std::string>(), "PORT|PATH")
+			("control", "Take brake commands as datagrams on this localhost UDP port, or on this Unix socket if it is a path, see LocalControl.h", cxxopts::value<std::string>(), "PORT|PATH")
+			("control-timeout", "Hand the brake back to the FE-C display this long after the last control datagram in [ms]", cxxopts::value<int>(), "MSEC")
+			("shm", "Publish every trainer sample and control change to this POSIX shared memory ring, see TelemetryBus.h", cxxopts::value<std::string>(), "NAME")
+			("fit", "Record the ride to this FIT activity file", cxxopts::value<std::string>(), "PATH")
+			("log", "Record every sample and control change to this session log, see SessionLog.h", cxxopts::value<std::string>(), "PATH")
+			("reprocess", "Recompute the power of these session logs from their raw brake readings and exit", cxxopts::value<std::vector<std::string>>(), "LOG...")
+			("threads", "Session logs reprocessed at once", cxxopts::value<int>(), "COUNT")
 			("h,help", "Print help")
   	;
 
-		// Parse
+		// Parse, any other arguments are more logs to reprocess
+		options.parse_positional("reprocess");
 		auto result = options.parse(argc, argv);
 
 		if (result.count("h")) {
@@ -114,20 +257,192 @@ int main(int argc, char* argv[])
 			}
 		};
 
+		if (result.count("direct")) {
+			direct_dispatch = true;
+		};
+
+		if (result.count("emulator")) {
+			emulated_stick = true;
+		};
+
+		if (result.count("low-power")) {
+			low_power = true;
+		};
+
+		if (result.count("rx-timestamps")) {
+			rx_timestamps = true;
+		};
+
+		if (result.count("reactor")) {
+			use_reactor = true;
+			direct_dispatch = true;
+		};
+
+		if (result.count("bench")) {
+			bench_seconds = result["bench"].as<int>();
+			if (bench_seconds <= 0) {
+				std::cout << "Invalid bench time" << std::endl;
+				exit (1);
+			}
+			// nothing real is attached in a benchmark
+			emulated_stick = true;
+		};
+
+		if (result.count("soak")) {
+			soak_seconds = result["soak"].as<int>();
+			if ((soak_seconds <= 0) || (bench_seconds != 0)) {
+				std::cout << "Invalid soak time" << std::endl;
+				exit (1);
+			}
+			emulated_stick = true;
+		};
+
+		if (result.count("faults")) {
+			if ((soak_seconds == 0) || !SoakBench::parse_faults(result["faults"].as<std::string>(), &soak_faults)) {
+				std::cout << "Invalid fault list" << std::endl;
+				exit (1);
+			}
+		};
+
+		if (result.count("fault-every")) {
+			soak_interval_ms = result["fault-every"].as<int>();
+			if ((soak_seconds == 0) || (soak_interval_ms < 100)) {
+				std::cout << "Invalid fault interval" << std::endl;
+				exit (1);
+			}
+		};
+
+		if (result.count("seed")) {
+			soak_seed = result["seed"].as<int>();
+			if ((soak_seconds == 0) || (soak_seed == 0)) {
+				std::cout << "Invalid seed" << std::endl;
+				exit (1);
+			}
+		};
+
+		if (result.count("virtual")) {
+			if ((bench_seconds == 0) && (soak_seconds == 0)) {
+				std::cout << "Virtual time needs --bench or --soak" << std::endl;
+				exit (1);
+			}
+			if (use_reactor) {
+				// the reactor waits in the kernel, outside the clock
+				std::cout << "Virtual time does not work with --reactor" << std::endl;
+				exit (1);
+			}
+			virtual_time = true;
+		};
+
+		if (result.count("metrics")) {
+			metrics_address = result["metrics"].as<std::string>();
+			if (metrics_address.empty()) {
+				std::cout << "Invalid metrics address" << std::endl;
+				exit (1);
+			}
+		};
+
+		if (result.count("control")) {
+			control_address = result["control"].as<std::string>();
+			if (control_address.empty()) {
+				std::cout << "Invalid control address" << std::endl;
+				exit (1);
+			}
+		};
+
+		if (result.count("control-timeout")) {
+			control_timeout_ms = result["control-timeout"].as<int>();
+			if ((control_address.empty()) || (control_timeout_ms < 100)) {
+				std::cout << "Invalid control timeout" << std::endl;
+				exit (1);
+			}
+		};
+
+		if (result.count("shm")) {
+			shm_name = result["shm"].as<std::string>();
+			if ((shm_name.size() < 2) || (shm_name[0] != '/')) {
+				std::cout << "Invalid shared memory name" << std::endl;
+				exit (1);
+			}
+		};
+
+		if (result.count("fit")) {
+			fit_path = result["fit"].as<std::string>();
+			if (fit_path.empty()) {
+				std::cout << "Invalid FIT file path" << std::endl;
+				exit (1);
+			}
+		};
+
+		if (result.count("log")) {
+			log_path = result["log"].as<std::string>();
+			if (log_path.empty()) {
+				std::cout << "Invalid session log path" << std::endl;
+				exit (1);
+			}
+		};
+
+		if (result.count("reprocess")) {
+			reprocess_logs = result["reprocess"].as<std::vector<std::string>>();
+		};
+
+		if (result.count("threads")) {
+			reprocess_threads = result["threads"].as<int>();
+			if ((reprocess_logs.empty()) || (reprocess_threads < 1)) {
+				std::cout << "Invalid thread count" << std::endl;
+				exit (1);
+			}
+		};
+
 	} catch (const cxxopts::OptionException& e) {
     std::cout << "error parsing options: " << e.what() << std::endl;
     exit(1);
   }
 
+	// Offline, no trainer or stick needed
+	if (!reprocess_logs.empty()) {
+		reprocess_config_t		reprocess_config;
+
+		reprocess_config.power_scale = DEFAULT_SCALING;
+		exit (reprocess_files(reprocess_logs, &reprocess_config, reprocess_threads) == 0 ? 0 : 1);
+	}
+
 	// Print intial Settings
 	std::cout << "Initial settings\n";
 	std::cout << "----------------\n";
 	std::cout << "User weight         : " << user_weight << " [kg]\n";
 	std::cout << "Bike weight         : " << bike_weight << " [kg]\n";
-	std::cout << "Wheel circumference : " << wheel_circumference_mm << " [mm]\n" << std::endl;
+	std::cout << "Wheel circumference : " << wheel_circumference_mm << " [mm]\n";
+	std::cout << "ANT dispatch        : " << (direct_dispatch ? "direct" : "message thread") << "\n";
+	std::cout << "ANT stick           : " << (emulated_stick ? "emulated" : "USB") << "\n";
+	std::cout << "ANT low power       : " << (low_power ? "on" : "off") << "\n";
+	std::cout << "ANT rx time stamps  : " << (rx_timestamps ? "on" : "off") << "\n";
+	std::cout << "Reactor             : " << (use_reactor ? "on" : "off") << "\n";
+	std::cout << "Trainer             : " << ((bench_seconds || soak_seconds) ? "simulated" : "USB") << "\n";
+	std::cout << "Clock               : " << (virtual_time ? "virtual" : "system") << "\n";
+	std::cout << "Metrics             : " << (metrics_address.empty() ? "off" : metrics_address) << "\n";
+	std::cout << "Telemetry bus       : " << (shm_name.empty() ? "off" : shm_name) << "\n";
+	std::cout << "Local control       : " << (control_address.empty() ? "off" : control_address) << "\n";
+	std::cout << "FIT file            : " << (fit_path.empty() ? "off" : fit_path) << "\n";
+	std::cout << "Session log         : " << (log_path.empty() ? "off" : log_path) << "\n" << std::endl;
+
+	// Before any thread starts, they all inherit the blocked signals
+	if (use_reactor && !reactor.open(reactor_signals, sizeof(reactor_signals) / sizeof(reactor_signals[0]))) {
+		exit (1);
+	}
+
+	// Everything started from here on, and this thread, run on the simulated clock
+	if (virtual_time) {
+		DSIThread_VirtualTimeEnable(0);
+		DSIThread_VirtualTimeAttach();
+	}
 
 	// Initialize Tacx Fortius
-	fortius = new Fortius();
+	if (bench_seconds || soak_seconds) {
+		fortius_sim = new FortiusSim();
+		fortius = fortius_sim;
+	} else {
+		fortius = new Fortius();
+	}
 	if(fortius) {
 		std::cout << "Fortius initialized" << std::endl;
 	} else {
@@ -140,7 +455,7 @@ int main(int argc, char* argv[])
 	ant_master = new CANTMaster();
 	if (ant_master) {
 		std::cout << "ANT+ dongle initialized" << std::endl;
-		if (ant_master->init (fortius) == FALSE) {
+		if (ant_master->init (fortius, direct_dispatch, emulated_stick, low_power, rx_timestamps) == FALSE) {
 			std::cout << "Failed to init ANT+ dongle" << std::endl;
 			fortius->stop ();
 			ant_master->stop ();
@@ -153,15 +468,118 @@ int main(int argc, char* argv[])
 		exit (1);
 	}
 
+	// Scrapes are served from their own thread
+	if (!metrics_address.empty() && !metrics_server_start(metrics_address.c_str())) {
+		fortius->stop ();
+		ant_master->stop ();
+		exit (1);
+	}
+
+	// Before the threads that publish to it start
+	if (!shm_name.empty() && !telemetry_bus_open(shm_name.c_str())) {
+		fortius->stop ();
+		ant_master->stop ();
+		exit (1);
+	}
+
+	// The FIT writer reads the bus, a private one will do without --shm
+	if (!fit_path.empty()) {
+		fit_writer = new FitWriter();
+		if (!telemetry_bus_open(NULL) || !fit_writer->start(fit_path.c_str())) {
+			fortius->stop ();
+			ant_master->stop ();
+			exit (1);
+		}
+	}
+
+	if (!log_path.empty()) {
+		session_log = new SessionLog();
+		if (!telemetry_bus_open(NULL) || !session_log->start(log_path.c_str())) {
+			fortius->stop ();
+			ant_master->stop ();
+			exit (1);
+		}
+	}
+
 	// Start reading from Fortius
-	fortius->start();
+	if (fortius->start(!use_reactor) != 0) {
+		ant_master->stop ();
+		exit (1);
+	}
 	fortius->setWeight (user_weight);
 
 	// Start reading from ANT+ module
-	ant_master->start();
+	if (use_reactor) {
+		if (!ant_master->attach(&reactor)) {
+			exit_main_loop = true;
+		}
+	} else {
+		ant_master->start();
+	}
 	ant_master->set_defaults (user_weight, bike_weight, wheel_circumference_mm);
 
-	do {
+	if (use_reactor) {
+		reactor_main.reactor = &reactor;
+		reactor_main.fortius = fortius;
+		reactor_main.trainer_source = reactor.add_timer(REACTOR_PRIORITY_TRAINER, reactor_trainer, &reactor_main);
+		reactor.arm_timer(reactor_main.trainer_source, 0, 0);
+		reactor.arm_timer(reactor.add_timer(REACTOR_PRIORITY_HOUSEKEEPING, reactor_housekeeping, &reactor_main), 1000, 1000);
+		reactor.on_signal(reactor_signal, &reactor_main);
+		if (reactor_main.trainer_source < 0) {
+			exit_main_loop = true;
+		}
+		// the harness below keeps this thread
+		if ((bench_seconds || soak_seconds) && !exit_main_loop) {
+			if (pthread_create(&reactor_thread, NULL, reactor_run_helper, &reactor) == 0) {
+				pthread_setname_np(reactor_thread, "reactor");
+			} else {
+				reactor_thread = 0;
+				exit_main_loop = true;
+			}
+		}
+	}
+
+	if (!control_address.empty()) {
+		local_control = new LocalControl(ant_master);
+		if (!local_control->start(control_address.c_str(), control_timeout_ms)) {
+			delete local_control;
+			local_control = NULL;
+			exit_main_loop = true;
+		}
+	}
+
+	if (bench_seconds) {
+		BridgeBench		bench(fortius_sim, ant_master, bench_seconds);
+
+		bench_passed = bench.run(&bench_result, &exit_main_loop);
+		exit_main_loop = true;
+	}
+
+	if (soak_seconds) {
+		SoakBench		soak(fortius_sim, ant_master, soak_seconds, soak_faults, soak_interval_ms, soak_seed);
+
+		bench_passed = soak.run(&soak_result, &exit_main_loop);
+		exit_main_loop = true;
+	}
+
+	if (use_reactor) {
+		if (reactor_thread) {
+			reactor.stop();
+			pthread_join(reactor_thread, NULL);
+		} else if (!exit_main_loop) {
+			reactor.run();
+		}
+		ant_master->detach();
+		reactor.close();
+		exit_main_loop = true;
+	}
+
+	// the joins below block outside the clock
+	if (virtual_time) {
+		DSIThread_VirtualTimeDetach();
+	}
+
+	while (exit_main_loop == FALSE) {
 		// check on  Fortius
 		fortius->getTelemetry(	fortius_telemetry.power, fortius_telemetry.heartrate,
 														fortius_telemetry.cadence, fortius_telemetry.speed,
@@ -172,9 +590,24 @@ int main(int argc, char* argv[])
 			std::cout << "Error in Fortius" << std::endl;
 			break;
 		}
-		// Wait for a second
-		sleep(1);
-	} while (exit_main_loop == FALSE);
+		if (dump_latency) {
+			dump_latency = 0;
+			std::cout << std::endl;
+			latency_print();
+			CANTMaster::print_ant_stats();
+		}
+		// Wait for a second, or ctrl-c
+		DSIThread_SleepCancellable(1000, &main_stop);
+	}
+	if (stop_requested_ms == 0) {
+		stop_requested_ms = monotonic_ms();
+	}
+
+	if (local_control) {
+		local_control->stop();
+		delete local_control;
+		local_control = NULL;
+	}
 
 	if (fortius) {
 		std::cout << "Stopping Fortius" << std::endl;
@@ -201,4 +634,46 @@ int main(int argc, char* argv[])
 		ant_master = NULL;
 		std::cout << "ANT+ module closed" << std::endl;
 	}
+
+	if (fit_writer) {
+		fit_writer->stop();
+		delete fit_writer;
+		fit_writer = NULL;
+	}
+
+	if (session_log) {
+		session_log->stop();
+		delete session_log;
+		session_log = NULL;
+	}
+
+	metrics_server_stop();
+	telemetry_bus_close();
+	std::cout << "Stopped in " << (monotonic_ms() - stop_requested_ms) << " ms" << std::endl;
+	latency_print();
+	CANTMaster::print_ant_stats();
+
+	if (bench_seconds) {
+		if (bench_passed == false) {
+			std::cout << "Bench failed" << std::endl;
+			exit (1);
+		}
+		BridgeBench::print(&bench_result);
+		if (bench_result.alloc_checked && bench_result.allocs != 0) {
+			std::cout << "Bench failed: " << bench_result.allocs << " allocations in steady state, first from" << std::endl;
+			alloc_check_print_callers();
+			exit (1);
+		}
+	}
+
+	if (soak_seconds) {
+		if (bench_passed == false) {
+			std::cout << "Soak failed" << std::endl;
+			exit (1);
+		}
+		SoakBench::print(&soak_result);
+		if (soak_result.survived == false) {
+			exit (1);
+		}
+	}
 }
@@ -0,0 +1,60 @@
+/*
+ * PowerModel.h
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef POWER_MODEL_H
+#define POWER_MODEL_H
+
+// How the brake's raw power and speed become watts.  Fortius::run() and
+// the offline reprocessing in Reprocess.h both use these, a change here
+// is a change to both, and recorded rides can be recomputed with it.
+
+// Watts at the roller, negative when coasting.
+static inline double power_model_watts(double raw_power, double raw_speed)
+{
+	double slopeCalc;
+	double offsetCalc;
+
+	// old slopeCalc = 0.001366 * curDeviceSpeed + 0.0308;
+	// newer slopeCalc = 0.191 * curDeviceSpeed + 0.076;
+	slopeCalc = 0.00000670 * raw_speed + 0.002;
+
+	//offsetCalc = -0.03526 * curBrakeCalibrationLoadRaw + 1.708;
+	offsetCalc = 0;
+
+	return (slopeCalc * raw_power) + offsetCalc;
+}
+
+// One step of the power smoothing, from the last reported power and the
+// watts of the newest frame.
+static inline double power_model_smooth(double power, double watts, double scale)
+{
+	if (watts < 0.0) {
+		watts = 0.0;    // brake power can be -ve when coasting.
+	}
+
+	// EMA power
+	watts *= 0.25;
+	power *= 0.75;
+	power += watts;
+
+	return power * scale;	// apply scale factor
+}
+
+#endif // POWER_MODEL_H
@@ -0,0 +1,342 @@
+/*
+ * Reactor.cpp
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Reactor.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <iostream>
+
+#define SOURCE_FD	0
+#define SOURCE_TIMER	1	// the timerfd is ours, closed on remove()
+#define SOURCE_SIGNAL	2
+#define SOURCE_WAKE	3
+
+// source index in the low half, its generation in the high half
+#define EVENT_DATA(index, generation)	(((uint64_t)(generation) << 32) | (uint32_t)(index))
+
+Reactor::Reactor()
+{
+	m_epoll_fd = -1;
+	m_signal_fd = -1;
+	m_wake_fd = -1;
+	sigemptyset(&m_signals);
+	for(int i = 0; i < REACTOR_MAX_SOURCES; i++) {
+		m_sources[i].fd = -1;
+		m_sources[i].generation = 0;
+	}
+	m_signal_callback = NULL;
+	m_signal_context = NULL;
+	pthread_mutex_init(&m_post_mutex, NULL);
+	m_post_head = 0;
+	m_post_count = 0;
+	m_exit_flag = false;
+}
+
+Reactor::~Reactor()
+{
+	close();
+	pthread_mutex_destroy(&m_post_mutex);
+}
+
+bool Reactor::open(const int* signals, int count)
+{
+	close();
+	sigemptyset(&m_signals);
+	for(int i = 0; i < count; i++) {
+		sigaddset(&m_signals, signals[i]);
+	}
+
+	m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if(m_epoll_fd < 0) {
+		std::cout << "Failed to create epoll set: " << strerror(errno) << std::endl;
+		return false;
+	}
+	m_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(m_wake_fd < 0 || add_source(m_wake_fd, SOURCE_WAKE, EPOLLIN, REACTOR_PRIORITY_POST, NULL, NULL) < 0) {
+		std::cout << "Failed to create reactor eventfd: " << strerror(errno) << std::endl;
+		close();
+		return false;
+	}
+	if(count == 0) {
+		return true;
+	}
+
+	// threads started from here on inherit the mask
+	pthread_sigmask(SIG_BLOCK, &m_signals, NULL);
+	m_signal_fd = signalfd(-1, &m_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+	if(m_signal_fd < 0 || add_source(m_signal_fd, SOURCE_SIGNAL, EPOLLIN, REACTOR_PRIORITY_SIGNAL, NULL, NULL) < 0) {
+		std::cout << "Failed to create signalfd: " << strerror(errno) << std::endl;
+		close();
+		return false;
+	}
+	return true;
+}
+
+void Reactor::close()
+{
+	for(int i = 0; i < REACTOR_MAX_SOURCES; i++) {
+		if(m_sources[i].fd >= 0) {
+			remove(i);
+		}
+	}
+	if(m_signal_fd >= 0) {
+		::close(m_signal_fd);
+		m_signal_fd = -1;
+	}
+	if(m_wake_fd >= 0) {
+		::close(m_wake_fd);
+		m_wake_fd = -1;
+	}
+	if(m_epoll_fd >= 0) {
+		::close(m_epoll_fd);
+		m_epoll_fd = -1;
+	}
+	// a second ctrl-c reaches the handlers again
+	pthread_sigmask(SIG_UNBLOCK, &m_signals, NULL);
+	sigemptyset(&m_signals);
+}
+
+int Reactor::add_source(int fd, int kind, uint32_t events, int priority, reactor_callback_t callback, void* context)
+{
+	struct epoll_event	event;
+
+	for(int i = 0; i < REACTOR_MAX_SOURCES; i++) {
+		source_t*	source = &m_sources[i];
+
+		if(source->fd >= 0) {
+			continue;
+		}
+		source->generation++;
+		memset(&event, 0, sizeof(event));
+		event.events = events;
+		event.data.u64 = EVENT_DATA(i, source->generation);
+		if(epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+			return -1;
+		}
+		source->fd = fd;
+		source->kind = kind;
+		source->priority = priority;
+		source->callback = callback;
+		source->context = context;
+		return i;
+	}
+	errno = ENOSPC;
+	return -1;
+}
+
+int Reactor::add_fd(int fd, uint32_t events, int priority, reactor_callback_t callback, void* context)
+{
+	return add_source(fd, SOURCE_FD, events, priority, callback, context);
+}
+
+int Reactor::add_timer(int priority, reactor_callback_t callback, void* context)
+{
+	int	fd;
+	int	source;
+
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if(fd < 0) {
+		std::cout << "Failed to create timerfd: " << strerror(errno) << std::endl;
+		return -1;
+	}
+	source = add_source(fd, SOURCE_TIMER, EPOLLIN, priority, callback, context);
+	if(source < 0) {
+		::close(fd);
+	}
+	return source;
+}
+
+bool Reactor::arm_timer(int source, uint32_t delay_ms, uint32_t period_ms)
+{
+	struct itimerspec	timer;
+
+	if(source < 0 || source >= REACTOR_MAX_SOURCES || m_sources[source].kind != SOURCE_TIMER) {
+		return false;
+	}
+	timer.it_value.tv_sec = delay_ms / 1000;
+	timer.it_value.tv_nsec = (delay_ms % 1000) * 1000000L;
+	if(delay_ms == 0) {
+		timer.it_value.tv_nsec = 1;	// 0 would disarm it
+	}
+	timer.it_interval.tv_sec = period_ms / 1000;
+	timer.it_interval.tv_nsec = (period_ms % 1000) * 1000000L;
+	return timerfd_settime(m_sources[source].fd, 0, &timer, NULL) == 0;
+}
+
+// The fd may be closed already, it left the set when it was.
+void Reactor::remove(int source)
+{
+	source_t*	s;
+
+	if(source < 0 || source >= REACTOR_MAX_SOURCES || m_sources[source].fd < 0) {
+		return;
+	}
+	s = &m_sources[source];
+	epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, s->fd, NULL);
+	if(s->kind == SOURCE_TIMER) {
+		::close(s->fd);
+	}
+	s->fd = -1;
+}
+
+void Reactor::on_signal(reactor_signal_callback_t callback, void* context)
+{
+	m_signal_callback = callback;
+	m_signal_context = context;
+}
+
+bool Reactor::post(reactor_callback_t callback, void* context)
+{
+	bool	queued = false;
+
+	pthread_mutex_lock(&m_post_mutex);
+	if(m_post_count < REACTOR_MAX_POSTS) {
+		post_t*	post = &m_posts[(m_post_head + m_post_count) % REACTOR_MAX_POSTS];
+
+		post->callback = callback;
+		post->context = context;
+		m_post_count++;
+		queued = true;
+	}
+	pthread_mutex_unlock(&m_post_mutex);
+	if(queued) {
+		wake();
+	}
+	return queued;
+}
+
+void Reactor::stop()
+{
+	m_exit_flag = true;
+	wake();
+}
+
+void Reactor::wake()
+{
+	uint64_t	one = 1;
+
+	if(write(m_wake_fd, &one, sizeof(one)) < 0) {
+		// the counter is full, it is readable anyway
+	}
+}
+
+void Reactor::run()
+{
+	struct epoll_event	events[REACTOR_MAX_SOURCES];
+	int			order[REACTOR_MAX_SOURCES];
+	int			ready;
+
+	while(!m_exit_flag) {
+		ready = epoll_wait(m_epoll_fd, events, REACTOR_MAX_SOURCES, -1);
+		if(ready < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			std::cout << "Reactor wait failed: " << strerror(errno) << std::endl;
+			break;
+		}
+
+		// by priority then slot, not in the order the kernel noticed them
+		for(int i = 0; i < ready; i++) {
+			int	index = (uint32_t)events[i].data.u64;
+			int	j = i;
+
+			while(j > 0 && (m_sources[order[j - 1]].priority > m_sources[index].priority
+					|| (m_sources[order[j - 1]].priority == m_sources[index].priority && order[j - 1] > index))) {
+				order[j] = order[j - 1];
+				j--;
+			}
+			order[j] = index;
+		}
+		for(int i = 0; i < ready && !m_exit_flag; i++) {
+			// an earlier callback may have removed it, or put another in its slot
+			for(int e = 0; e < ready; e++) {
+				if((int)(uint32_t)events[e].data.u64 == order[i]) {
+					if(m_sources[order[i]].fd >= 0 && (uint32_t)(events[e].data.u64 >> 32) == m_sources[order[i]].generation) {
+						dispatch(order[i]);
+					}
+					break;
+				}
+			}
+		}
+	}
+}
+
+void Reactor::dispatch(int index)
+{
+	source_t*	source = &m_sources[index];
+	uint64_t	count;
+
+	switch(source->kind) {
+	case SOURCE_SIGNAL:
+		read_signals();
+		break;
+	case SOURCE_WAKE:
+		if(read(source->fd, &count, sizeof(count)) < 0) {
+			// another wake got it
+		}
+		run_posts();
+		break;
+	case SOURCE_TIMER:
+		// expirations missed while a callback ran are not made up
+		if(read(source->fd, &count, sizeof(count)) < 0) {
+			break;		// disarmed or re-armed since it fired
+		}
+		source->callback(source->context);
+		break;
+	default:
+		source->callback(source->context);
+		break;
+	}
+}
+
+void Reactor::read_signals()
+{
+	struct signalfd_siginfo	info;
+
+	while(read(m_signal_fd, &info, sizeof(info)) == sizeof(info)) {
+		if(m_signal_callback) {
+			m_signal_callback(m_signal_context, info.ssi_signo);
+		}
+	}
+}
+
+void Reactor::run_posts()
+{
+	post_t		post;
+
+	for(;;) {
+		pthread_mutex_lock(&m_post_mutex);
+		if(m_post_count == 0) {
+			pthread_mutex_unlock(&m_post_mutex);
+			return;
+		}
+		post = m_posts[m_post_head];
+		m_post_head = (m_post_head + 1) % REACTOR_MAX_POSTS;
+		m_post_count--;
+		pthread_mutex_unlock(&m_post_mutex);
+		post.callback(post.context);
+	}
+}
@@ -0,0 +1,102 @@
+/*
+ * Reactor.h
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <signal.h>
+
+#define REACTOR_MAX_SOURCES	32
+#define REACTOR_MAX_POSTS	16	// calls from other threads waiting for the reactor
+
+// When several are ready at once they run lowest first, in the order they
+// were added within a priority.
+#define REACTOR_PRIORITY_SIGNAL		0
+#define REACTOR_PRIORITY_POST		1
+#define REACTOR_PRIORITY_ANT		2	// received pages before the broadcast that answers them
+#define REACTOR_PRIORITY_TRAINER	3	// a fresh frame before the broadcast that carries it
+#define REACTOR_PRIORITY_BROADCAST	4
+#define REACTOR_PRIORITY_HOUSEKEEPING	5
+
+typedef void (*reactor_callback_t)(void* context);
+typedef void (*reactor_signal_callback_t)(void* context, int sig);
+
+// --reactor: the bridge on one thread.  Descriptors, timerfds and a
+// signalfd go into one epoll set and their callbacks run one after the
+// other on the thread in run(), so nothing they share needs waking
+// another thread.  Callbacks must not block for long, the rest waits.
+// Everything but post() and stop() belongs to the reactor thread once
+// run() is going.
+class Reactor
+{
+public:
+			Reactor();
+			~Reactor();
+	bool		open(const int* signals, int count);	// blocks the signals, before any other thread starts so none of them takes one
+	void		close();				// the signals go back to this thread
+
+	int		add_fd(int fd, uint32_t events, int priority, reactor_callback_t callback, void* context);	// events as for epoll, returns the source or -1
+	int		add_timer(int priority, reactor_callback_t callback, void* context);	// disarmed
+	bool		arm_timer(int source, uint32_t delay_ms, uint32_t period_ms);	// period 0 for once
+	void		remove(int source);
+	void		on_signal(reactor_signal_callback_t callback, void* context);
+
+	bool		post(reactor_callback_t callback, void* context);	// any thread, callback runs on the reactor's, false if the queue is full
+	void		run();			// until stop()
+	void		stop();			// any thread
+
+private:
+	typedef struct source_s {
+		int			fd;		// -1 when free
+		int			kind;
+		int			priority;
+		uint32_t		generation;	// stale events of an earlier source in the slot are dropped
+		reactor_callback_t	callback;
+		void*			context;
+	} source_t;
+
+	typedef struct post_s {
+		reactor_callback_t	callback;
+		void*			context;
+	} post_t;
+
+	int		add_source(int fd, int kind, uint32_t events, int priority, reactor_callback_t callback, void* context);
+	void		dispatch(int source);
+	void		read_signals();
+	void		run_posts();
+	void		wake();
+
+	int		m_epoll_fd;
+	int		m_signal_fd;
+	int		m_wake_fd;		// eventfd for post() and stop()
+	sigset_t	m_signals;
+	source_t	m_sources[REACTOR_MAX_SOURCES];
+	reactor_signal_callback_t	m_signal_callback;
+	void*		m_signal_context;
+	pthread_mutex_t	m_post_mutex;
+	post_t		m_posts[REACTOR_MAX_POSTS];
+	int		m_post_head;
+	int		m_post_count;
+	volatile bool	m_exit_flag;
+};
+
+#endif // REACTOR_H
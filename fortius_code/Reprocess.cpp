@@ -0,0 +1,211 @@
+/*
+ * Reprocess.cpp
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Reprocess.h"
+#include "PowerModel.h"
+#include "SessionLogReader.h"
+#include "LatencyStats.h"
+#include <math.h>
+#include <pthread.h>
+#include <iostream>
+
+// one array per field
+typedef struct batch_s {
+	double		raw_power[REPROCESS_BATCH];
+	double		raw_speed[REPROCESS_BATCH];
+	double		recorded[REPROCESS_BATCH];
+	double		watts[REPROCESS_BATCH];
+	int		count;
+	double		power;			// smoothing carried from batch to batch
+	double		recorded_sum;
+	double		corrected_sum;
+	double		max_difference;
+} batch_t;
+
+typedef struct worker_s {
+	const std::vector<std::string>*	paths;
+	const reprocess_config_t*	config;
+	std::vector<reprocess_result_t>*	results;
+	std::vector<char>*		failed;
+	volatile uint32_t*		next;
+} worker_t;
+
+static void run_batch(batch_t* batch, double scale, std::vector<float>* power)
+{
+	const double* __restrict	raw_power = batch->raw_power;
+	const double* __restrict	raw_speed = batch->raw_speed;
+	const double* __restrict	recorded = batch->recorded;
+	double* __restrict		watts = batch->watts;
+	int				n = batch->count;
+	double				recorded_sum = 0;
+	double				corrected_sum = 0;
+	double				max_difference = batch->max_difference;
+
+	for(int i = 0; i < n; i++) {
+		watts[i] = power_model_watts(raw_power[i], raw_speed[i]);
+	}
+	// each step needs the one before
+	for(int i = 0; i < n; i++) {
+		batch->power = power_model_smooth(batch->power, watts[i], scale);
+		watts[i] = batch->power;
+	}
+	for(int i = 0; i < n; i++) {
+		recorded_sum += recorded[i];
+		corrected_sum += watts[i];
+		max_difference = fmax(max_difference, fabs(watts[i] - recorded[i]));
+	}
+
+	if(power != NULL) {
+		power->insert(power->end(), watts, watts + n);
+	}
+	batch->recorded_sum += recorded_sum;
+	batch->corrected_sum += corrected_sum;
+	batch->max_difference = max_difference;
+	batch->count = 0;
+}
+
+bool reprocess_log(const char* path, const reprocess_config_t* config, std::vector<float>* power, reprocess_result_t* result)
+{
+	SessionLogReader		reader;
+	session_log_column_t		raw_power;
+	session_log_column_t		raw_speed;
+	session_log_column_t		recorded;
+	const double			power_scale = session_log_sample_scale[SESSION_LOG_S_POWER];
+	batch_t*			batch;
+	int64_t				value;
+	uint64_t			frames = 0;
+	uint64_t			bad_blocks = 0;
+
+	if(!reader.open(path)) {
+		return false;
+	}
+	batch = new batch_t();
+
+	for(size_t b = 0; b < reader.block_count(); b++) {
+		uint32_t	rows = 0;
+
+		if(reader.block(b)->type != SESSION_LOG_SAMPLE) {
+			continue;
+		}
+		if(!reader.column(b, SESSION_LOG_S_RAW_POWER, &raw_power)
+				|| !reader.column(b, SESSION_LOG_S_RAW_SPEED, &raw_speed)
+				|| !reader.column(b, SESSION_LOG_S_POWER, &recorded)) {
+			bad_blocks++;
+			continue;
+		}
+		while(session_log_next(&raw_power, &value)) {
+			int	i = batch->count;
+
+			// a row is only used with all three values
+			batch->raw_power[i] = value;
+			if(!session_log_next(&raw_speed, &value)) {
+				break;
+			}
+			batch->raw_speed[i] = value;
+			if(!session_log_next(&recorded, &value)) {
+				break;
+			}
+			batch->recorded[i] = value * power_scale;
+			if(++batch->count == REPROCESS_BATCH) {
+				run_batch(batch, config->power_scale, power);
+			}
+			frames++;
+			rows++;
+		}
+		if(rows != reader.block(b)->count) {
+			bad_blocks++;
+		}
+	}
+	run_batch(batch, config->power_scale, power);
+
+	result->frames = frames;
+	result->bad_blocks = bad_blocks;
+	result->recorded_avg_watts = frames ? batch->recorded_sum / frames : 0;
+	result->corrected_avg_watts = frames ? batch->corrected_sum / frames : 0;
+	result->max_difference_watts = batch->max_difference;
+	delete batch;
+	return true;
+}
+
+static void* worker_run(void* context)
+{
+	worker_t*	worker = (worker_t*)context;
+	uint32_t	i;
+
+	while((i = __atomic_fetch_add(worker->next, 1, __ATOMIC_RELAXED)) < worker->paths->size()) {
+		(*worker->failed)[i] = !reprocess_log((*worker->paths)[i].c_str(), worker->config, NULL, &(*worker->results)[i]);
+	}
+	return NULL;
+}
+
+int reprocess_files(const std::vector<std::string>& paths, const reprocess_config_t* config, int threads)
+{
+	std::vector<reprocess_result_t>	results(paths.size());
+	std::vector<char>		failed(paths.size());
+	std::vector<pthread_t>		pthreads;
+	volatile uint32_t		next = 0;
+	worker_t			worker = { &paths, config, &results, &failed, &next };
+	uint64_t			start_us;
+	double				wall_s;
+	uint64_t			frames = 0;
+	int				failures = 0;
+	pthread_t			pthread;
+
+	if(threads > (int)paths.size()) {
+		threads = paths.size();
+	}
+	start_us = latency_now_us();
+	for(int t = 0; t < threads; t++) {
+		if(pthread_create(&pthread, NULL, worker_run, &worker) != 0) {
+			break;
+		}
+		pthreads.push_back(pthread);
+	}
+	if(pthreads.empty()) {
+		// do it here then
+		worker_run(&worker);
+	}
+	for(size_t t = 0; t < pthreads.size(); t++) {
+		pthread_join(pthreads[t], NULL);
+	}
+	wall_s = (latency_now_us() - start_us) / 1000000.0;
+
+	for(size_t i = 0; i < paths.size(); i++) {
+		if(failed[i]) {
+			std::cout << "reprocess_file path=" << paths[i] << " failed" << std::endl;
+			failures++;
+			continue;
+		}
+		std::cout << "reprocess_file path=" << paths[i]
+			<< " frames=" << results[i].frames
+			<< " bad_blocks=" << results[i].bad_blocks
+			<< " recorded_avg_w=" << results[i].recorded_avg_watts
+			<< " corrected_avg_w=" << results[i].corrected_avg_watts
+			<< " max_diff_w=" << results[i].max_difference_watts << std::endl;
+		frames += results[i].frames;
+	}
+	std::cout << "reprocess files=" << paths.size()
+		<< " failed=" << failures
+		<< " frames=" << frames
+		<< " threads=" << (pthreads.empty() ? 1 : pthreads.size())
+		<< " wall_s=" << wall_s
+		<< " frames_per_sec=" << (wall_s > 0 ? frames / wall_s : 0) << std::endl;
+	return failures;
+}
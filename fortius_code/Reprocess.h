@@ -0,0 +1,58 @@
+/*
+ * Reprocess.h
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef REPROCESS_H
+#define REPROCESS_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define REPROCESS_BATCH		4096	// frames decoded and modelled at a time
+
+typedef struct reprocess_config_s {
+	double		power_scale;		// as Fortius::setPowerScaleFactor()
+} reprocess_config_t;
+
+typedef struct reprocess_result_s {
+	uint64_t	frames;
+	uint64_t	bad_blocks;		// sample blocks missing a column or with one cut short
+	double		recorded_avg_watts;	// as the bridge reported them
+	double		corrected_avg_watts;	// from the current PowerModel.h
+	double		max_difference_watts;
+} reprocess_result_t;
+
+// Recomputes the power series of one session log from the raw brake power
+// and speed it recorded, with PowerModel.h as it is now.  Frames are
+// decoded a batch at a time into arrays per field, the model runs over
+// each array in one loop the compiler can vectorise, only the smoothing
+// goes frame by frame.  power gets the corrected series if not NULL.
+// The smoothing starts from 0 at the start of the log, as the bridge does
+// when it starts.  A sample block without one of the columns is skipped,
+// one with a column shorter than the others is used up to where it ends,
+// both count in bad_blocks.
+bool	reprocess_log(const char* path, const reprocess_config_t* config, std::vector<float>* power, reprocess_result_t* result);
+
+// --reprocess: reprocess_log() over paths, a file per thread at a time,
+// then prints a line per file and the total throughput.  The number of
+// files that failed.
+int	reprocess_files(const std::vector<std::string>& paths, const reprocess_config_t* config, int threads);
+
+#endif // REPROCESS_H
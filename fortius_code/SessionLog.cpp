@@ -0,0 +1,314 @@
+/*
+ * SessionLog.cpp
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "SessionLog.h"
+#include "LatencyStats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <iostream>
+#include <glog/logging.h>
+
+static_assert(sizeof(session_log_header_t) == 64, "session log header layout changed");
+static_assert(sizeof(session_log_block_t) == 32, "session log block layout changed");
+static_assert(sizeof(session_log_index_t) == 32, "session log index layout changed");
+static_assert(sizeof(session_log_trailer_t) == 16, "session log trailer layout changed");
+
+// the stored integer for value in units of 1 / scale
+#define FIXED(value, scale)	((int64_t)llround((double)(value) / (scale)))
+
+static int put_varint(uint8_t* p, int64_t delta)
+{
+	uint64_t	zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+	int		n = 0;
+
+	while(zigzag >= 0x80) {
+		p[n++] = (uint8_t)(zigzag | 0x80);
+		zigzag >>= 7;
+	}
+	p[n++] = (uint8_t)zigzag;
+	return n;
+}
+
+SessionLog::SessionLog()
+{
+	m_fd = -1;
+	m_stop_token_valid = (DSIThread_CancelInit(&m_stop_token) == DSI_THREAD_ENONE);
+	m_error = false;
+	m_cursor = 0;
+	m_offset = 0;
+	m_last_flush_ms = 0;
+	m_index_count = 0;
+	memset(&m_samples, 0, sizeof(m_samples));
+	m_samples.type = SESSION_LOG_SAMPLE;
+	m_samples.columns = SESSION_LOG_SAMPLE_COLUMNS;
+	memset(&m_controls, 0, sizeof(m_controls));
+	m_controls.type = SESSION_LOG_CONTROL;
+	m_controls.columns = SESSION_LOG_CONTROL_COLUMNS;
+}
+
+SessionLog::~SessionLog()
+{
+	stop();
+	DSIThread_CancelDestroy(&m_stop_token);
+}
+
+bool SessionLog::start(const char* path)
+{
+	const telemetry_bus_header_t*	bus = telemetry_bus_get();
+	session_log_header_t		header;
+	struct timespec			now;
+
+	if(bus == NULL) {
+		std::cout << "Session log needs the telemetry bus" << std::endl;
+		return false;
+	}
+	if(!m_stop_token_valid) {
+		std::cout << "Failed to create session log stop eventfd" << std::endl;
+		return false;
+	}
+	m_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(m_fd < 0) {
+		std::cout << "Failed to create session log " << path << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic = SESSION_LOG_MAGIC;
+	header.version = SESSION_LOG_VERSION;
+	header.header_size = sizeof(header);
+	header.block_records = SESSION_LOG_BLOCK_RECORDS;
+	header.start_time_us = latency_now_us();
+	clock_gettime(CLOCK_REALTIME, &now);
+	header.wall_start_us = (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+	m_offset = 0;
+	if(!write_out(&header, sizeof(header))) {
+		close(m_fd);
+		m_fd = -1;
+		return false;
+	}
+	m_cursor = __atomic_load_n(&bus->write_index, __ATOMIC_ACQUIRE);
+	m_last_flush_ms = latency_now_us() / 1000;
+
+	DSIThread_CancelReset(&m_stop_token);
+	if(pthread_create(&m_pthread, NULL, &SessionLog::run_helper, this) != 0) {
+		std::cout << "Failed to start session log thread" << std::endl;
+		close(m_fd);
+		m_fd = -1;
+		return false;
+	}
+	pthread_setname_np(m_pthread, "session_log");
+	return true;
+}
+
+void SessionLog::stop()
+{
+	if(m_fd < 0) {
+		return;
+	}
+	DSIThread_Cancel(&m_stop_token);
+	pthread_join(m_pthread, NULL);
+	close(m_fd);
+	m_fd = -1;
+}
+
+void* SessionLog::run_helper(void* context)
+{
+	((SessionLog*)context)->run();
+	return NULL;
+}
+
+void SessionLog::run()
+{
+	const telemetry_bus_header_t*	bus = telemetry_bus_get();
+	telemetry_bus_record_t		record;
+	bool				exiting;
+
+	VLOG (1) << "Session log running";
+	do {
+		// one more pass after stop(), the publishers have stopped by then
+		exiting = DSIThread_IsCancelled(&m_stop_token);
+		while(telemetry_bus_read(bus, &m_cursor, &record)) {
+			take(&record);
+		}
+		if(!exiting && latency_now_us() / 1000 - m_last_flush_ms >= SESSION_LOG_FLUSH_MS) {
+			write_block(&m_samples);
+			write_block(&m_controls);
+			m_last_flush_ms = latency_now_us() / 1000;
+		}
+		if(!exiting) {
+			DSIThread_SleepCancellable(SESSION_LOG_POLL_MS, &m_stop_token);
+		}
+	} while(!exiting);
+
+	finish();
+}
+
+void SessionLog::take(const telemetry_bus_record_t* record)
+{
+	staging_t*	staging;
+	uint32_t	n;
+
+	if(record->type == TELEMETRY_BUS_SAMPLE) {
+		const telemetry_bus_sample_t*	sample = &record->sample;
+		const double*			scale = session_log_sample_scale;
+
+		staging = &m_samples;
+		n = staging->count;
+		staging->values[SESSION_LOG_S_TIME][n] = record->time_us;
+		staging->values[SESSION_LOG_S_POWER][n] = FIXED(sample->power_watts, scale[SESSION_LOG_S_POWER]);
+		staging->values[SESSION_LOG_S_HEARTRATE][n] = FIXED(sample->heartrate_bpm, scale[SESSION_LOG_S_HEARTRATE]);
+		staging->values[SESSION_LOG_S_CADENCE][n] = FIXED(sample->cadence_rpm, scale[SESSION_LOG_S_CADENCE]);
+		staging->values[SESSION_LOG_S_SPEED][n] = FIXED(sample->speed_kph, scale[SESSION_LOG_S_SPEED]);
+		staging->values[SESSION_LOG_S_DISTANCE][n] = FIXED(sample->distance_m, scale[SESSION_LOG_S_DISTANCE]);
+		staging->values[SESSION_LOG_S_RAW_POWER][n] = sample->raw_power;
+		staging->values[SESSION_LOG_S_RAW_SPEED][n] = sample->raw_speed;
+		staging->values[SESSION_LOG_S_STEERING][n] = sample->steering;
+		staging->values[SESSION_LOG_S_BUTTONS][n] = sample->buttons;
+		staging->values[SESSION_LOG_S_PEDALLING][n] = sample->pedalling;
+	} else if(record->type == TELEMETRY_BUS_CONTROL) {
+		const telemetry_bus_control_t*	control = &record->control;
+		const double*			scale = session_log_control_scale;
+
+		staging = &m_controls;
+		n = staging->count;
+		staging->values[SESSION_LOG_C_TIME][n] = record->time_us;
+		staging->values[SESSION_LOG_C_MODE][n] = control->mode;
+		staging->values[SESSION_LOG_C_TARGET_POWER][n] = FIXED(control->target_power_watts, scale[SESSION_LOG_C_TARGET_POWER]);
+		staging->values[SESSION_LOG_C_SLOPE][n] = FIXED(control->slope_percent, scale[SESSION_LOG_C_SLOPE]);
+		staging->values[SESSION_LOG_C_CRR][n] = FIXED(control->crr, scale[SESSION_LOG_C_CRR]);
+		staging->values[SESSION_LOG_C_WIND_COEF][n] = FIXED(control->wind_resistance_coef, scale[SESSION_LOG_C_WIND_COEF]);
+		staging->values[SESSION_LOG_C_WIND_SPEED][n] = FIXED(control->wind_speed_kph, scale[SESSION_LOG_C_WIND_SPEED]);
+		staging->values[SESSION_LOG_C_DRAFTING][n] = FIXED(control->drafting_factor, scale[SESSION_LOG_C_DRAFTING]);
+		staging->values[SESSION_LOG_C_USER_WEIGHT][n] = FIXED(control->user_weight_kg, scale[SESSION_LOG_C_USER_WEIGHT]);
+		staging->values[SESSION_LOG_C_BIKE_WEIGHT][n] = FIXED(control->bike_weight_kg, scale[SESSION_LOG_C_BIKE_WEIGHT]);
+	} else {
+		return;
+	}
+
+	staging->count = n + 1;
+	if(staging->count == SESSION_LOG_BLOCK_RECORDS) {
+		write_block(staging);
+	}
+}
+
+void SessionLog::write_block(staging_t* staging)
+{
+	session_log_block_t*	block = (session_log_block_t*)m_encoded;
+	uint32_t*		column_size = (uint32_t*)(m_encoded + sizeof(*block));
+	uint8_t*		p = (uint8_t*)&column_size[staging->columns];
+	uint8_t*		column_start;
+	uint32_t		count = staging->count;
+	size_t			padded;
+	int64_t			previous;
+
+	if(count == 0) {
+		return;
+	}
+	for(int c = 0; c < staging->columns; c++) {
+		const int64_t*	values = staging->values[c];
+
+		column_start = p;
+		previous = 0;
+		for(uint32_t i = 0; i < count; i++) {
+			p += put_varint(p, values[i] - previous);
+			previous = values[i];
+		}
+		column_size[c] = p - column_start;
+	}
+
+	block->magic = SESSION_LOG_BLOCK_MAGIC;
+	block->type = staging->type;
+	block->columns = staging->columns;
+	block->count = count;
+	block->size = p - (m_encoded + sizeof(*block));
+	block->first_time_us = staging->values[0][0];
+	block->last_time_us = staging->values[0][count - 1];
+	// the next block header lands aligned
+	while((p - m_encoded) % 8) {
+		*p++ = 0;
+	}
+	padded = p - m_encoded;
+
+	if(m_index_count < SESSION_LOG_MAX_BLOCKS) {
+		session_log_index_t*	entry = &m_index[m_index_count];
+
+		entry->offset = m_offset;
+		entry->first_time_us = block->first_time_us;
+		entry->last_time_us = block->last_time_us;
+		entry->type = block->type;
+		entry->reserved = 0;
+		entry->count = count;
+	}
+	// counted past the end too, so finish() knows the index is short
+	m_index_count++;
+	staging->count = 0;
+	write_out(m_encoded, padded);
+}
+
+void SessionLog::finish()
+{
+	session_log_trailer_t	trailer;
+
+	write_block(&m_samples);
+	write_block(&m_controls);
+	if(m_error) {
+		return;
+	}
+	if(m_index_count > SESSION_LOG_MAX_BLOCKS) {
+		// readers walk the blocks of a log without an index
+		std::cout << "Session log has " << m_index_count << " blocks, too many to index" << std::endl;
+	} else {
+		trailer.index_offset = m_offset;
+		trailer.index_count = m_index_count;
+		trailer.magic = SESSION_LOG_INDEX_MAGIC;
+		if(!write_out(m_index, m_index_count * sizeof(m_index[0])) || !write_out(&trailer, sizeof(trailer))) {
+			return;
+		}
+	}
+	fsync(m_fd);
+	std::cout << "Session log written, " << m_offset << " bytes in " << m_index_count << " blocks" << std::endl;
+}
+
+bool SessionLog::write_out(const void* data, size_t size)
+{
+	const uint8_t*	p = (const uint8_t*)data;
+	size_t		done = 0;
+	ssize_t		n;
+
+	while(!m_error && done < size) {
+		n = write(m_fd, p + done, size - done);
+		if(n < 0 && errno == EINTR) {
+			continue;
+		}
+		if(n <= 0) {
+			// the ride goes on without a log
+			std::cout << "Session log write failed: " << strerror(errno) << std::endl;
+			m_error = true;
+			break;
+		}
+		done += n;
+	}
+	m_offset += done;
+	return !m_error;
+}
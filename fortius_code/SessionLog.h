@@ -0,0 +1,180 @@
+/*
+ * SessionLog.h
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SESSION_LOG_H
+#define SESSION_LOG_H
+
+// Layout of the session log fortius_ant_bridge --log PATH writes, every
+// sample and control change of a ride in a few bytes each.
+//
+//	offset 0		session_log_header_t
+//	offset header_size	blocks, each starting on an 8 byte boundary
+//	index_offset		index_count session_log_index_t
+//	end - 16		session_log_trailer_t
+//
+// A block holds up to block_records records of one type stored column by
+// column: a session_log_block_t, a uint32_t byte size per column, then the
+// columns one after the other.  A column is count values, each the zigzag
+// varint of its difference from the value before it, the first from 0.
+// Values are integers in the units of the session_log_*_scale tables.
+//
+// The index and trailer are written when the log is closed.  A log cut
+// short has neither, its blocks are found by walking them from the header
+// instead.  All fields are little endian, times are CLOCK_MONOTONIC
+// microseconds of the bridge.  SessionLogReader.h reads them.
+
+#include "TelemetryBus.h"
+#include <stdint.h>
+
+#define SESSION_LOG_MAGIC		0x474F4C53	// "SLOG"
+#define SESSION_LOG_BLOCK_MAGIC		0x4B424C53	// "SLBK"
+#define SESSION_LOG_INDEX_MAGIC		0x58494C53	// "SLIX"
+#define SESSION_LOG_VERSION		1
+
+// block types, the same numbers as on the telemetry bus
+#define SESSION_LOG_SAMPLE		TELEMETRY_BUS_SAMPLE
+#define SESSION_LOG_CONTROL		TELEMETRY_BUS_CONTROL
+
+// sample columns
+#define SESSION_LOG_S_TIME		0	// us
+#define SESSION_LOG_S_POWER		1	// 0.1 W
+#define SESSION_LOG_S_HEARTRATE		2	// 0.1 bpm
+#define SESSION_LOG_S_CADENCE		3	// 0.1 rpm
+#define SESSION_LOG_S_SPEED		4	// 0.01 km/h
+#define SESSION_LOG_S_DISTANCE		5	// mm
+#define SESSION_LOG_S_RAW_POWER		6	// as read from the brake
+#define SESSION_LOG_S_RAW_SPEED		7
+#define SESSION_LOG_S_STEERING		8
+#define SESSION_LOG_S_BUTTONS		9
+#define SESSION_LOG_S_PEDALLING		10
+#define SESSION_LOG_SAMPLE_COLUMNS	11
+
+// control columns
+#define SESSION_LOG_C_TIME		0	// us
+#define SESSION_LOG_C_MODE		1	// FT_ERGOMODE, FT_SSMODE or FT_CALIBRATE
+#define SESSION_LOG_C_TARGET_POWER	2	// 0.1 W
+#define SESSION_LOG_C_SLOPE		3	// 0.01 %
+#define SESSION_LOG_C_CRR		4	// 0.000001
+#define SESSION_LOG_C_WIND_COEF		5	// 0.001 kg/m
+#define SESSION_LOG_C_WIND_SPEED	6	// 0.01 km/h
+#define SESSION_LOG_C_DRAFTING		7	// 0.001
+#define SESSION_LOG_C_USER_WEIGHT	8	// 0.01 kg
+#define SESSION_LOG_C_BIKE_WEIGHT	9	// 0.01 kg
+#define SESSION_LOG_CONTROL_COLUMNS	10
+
+#define SESSION_LOG_MAX_COLUMNS		11
+
+// multiply a stored value by these for the value in the units of the telemetry bus
+static const double session_log_sample_scale[SESSION_LOG_SAMPLE_COLUMNS] = {
+	1, 0.1, 0.1, 0.1, 0.01, 0.001, 1, 1, 1, 1, 1
+};
+static const double session_log_control_scale[SESSION_LOG_CONTROL_COLUMNS] = {
+	1, 1, 0.1, 0.01, 0.000001, 0.001, 0.01, 0.001, 0.01, 0.01
+};
+
+typedef struct session_log_header_s {
+	uint32_t	magic;			// SESSION_LOG_MAGIC
+	uint32_t	version;		// SESSION_LOG_VERSION
+	uint32_t	header_size;		// offset of the first block
+	uint32_t	block_records;		// most records in one block
+	uint64_t	start_time_us;		// bridge clock when the log was started
+	int64_t		wall_start_us;		// unix time at start_time_us
+	uint8_t		reserved[32];
+} session_log_header_t;			// 64 bytes
+
+typedef struct session_log_block_s {
+	uint32_t	magic;			// SESSION_LOG_BLOCK_MAGIC
+	uint16_t	type;			// SESSION_LOG_SAMPLE or SESSION_LOG_CONTROL
+	uint16_t	columns;
+	uint32_t	count;			// records
+	uint32_t	size;			// bytes after this header, column sizes and columns, not the padding
+	uint64_t	first_time_us;
+	uint64_t	last_time_us;
+} session_log_block_t;			// 32 bytes
+
+typedef struct session_log_index_s {
+	uint64_t	offset;			// of the session_log_block_t
+	uint64_t	first_time_us;
+	uint64_t	last_time_us;
+	uint16_t	type;
+	uint16_t	reserved;
+	uint32_t	count;
+} session_log_index_t;			// 32 bytes
+
+typedef struct session_log_trailer_s {
+	uint64_t	index_offset;
+	uint32_t	index_count;
+	uint32_t	magic;			// SESSION_LOG_INDEX_MAGIC, written last
+} session_log_trailer_t;		// 16 bytes
+
+#ifdef __cplusplus
+#include "dsi_thread.h"
+#include <pthread.h>
+
+#define SESSION_LOG_BLOCK_RECORDS	1024		// about 4 minutes of samples
+#define SESSION_LOG_FLUSH_MS		60000		// a crash loses at most this much
+#define SESSION_LOG_POLL_MS		500		// how often the telemetry bus is read
+#define SESSION_LOG_MAX_BLOCKS		4096		// indexed, a longer log is walked instead
+#define SESSION_LOG_ENCODED_SIZE	(sizeof(session_log_block_t) + SESSION_LOG_MAX_COLUMNS * (4 + SESSION_LOG_BLOCK_RECORDS * 10) + 8)
+
+// Another reader of the telemetry bus, on its own thread.  Records are
+// collected column by column and a block is written when one fills up or
+// SESSION_LOG_FLUSH_MS after the last one, so the disk is touched every
+// few minutes.  Everything is sized up front.
+class SessionLog
+{
+public:
+			SessionLog();
+			~SessionLog();
+	bool		start(const char* path);	// the telemetry bus must be open
+	void		stop();				// drains the bus, writes the last blocks and the index
+
+private:
+	typedef struct {
+		int		type;
+		int		columns;
+		uint32_t	count;
+		int64_t		values[SESSION_LOG_MAX_COLUMNS][SESSION_LOG_BLOCK_RECORDS];
+	} staging_t;
+
+	static void*	run_helper(void* context);
+	void		run();
+	void		take(const telemetry_bus_record_t* record);
+	void		write_block(staging_t* staging);
+	void		finish();
+	bool		write_out(const void* data, size_t size);
+
+	int		m_fd;
+	pthread_t	m_pthread;
+	DSI_CANCEL_TOKEN	m_stop_token;
+	bool		m_stop_token_valid;		// start() fails without it
+	bool		m_error;
+	uint64_t	m_cursor;			// telemetry bus read position
+	uint64_t	m_offset;			// where the next block goes
+	uint64_t	m_last_flush_ms;
+	staging_t	m_samples;
+	staging_t	m_controls;
+	uint8_t		m_encoded[SESSION_LOG_ENCODED_SIZE];
+	session_log_index_t	m_index[SESSION_LOG_MAX_BLOCKS];
+	uint32_t	m_index_count;
+};
+#endif
+
+#endif // SESSION_LOG_H
@@ -0,0 +1,180 @@
+/*
+ * SessionLogReader.cpp
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "SessionLogReader.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <iostream>
+
+#define PADDED(size)	(((size) + 7) & ~(uint64_t)7)
+
+SessionLogReader::SessionLogReader()
+{
+	m_map = NULL;
+	m_size = 0;
+	m_indexed = false;
+}
+
+SessionLogReader::~SessionLogReader()
+{
+	close();
+}
+
+bool SessionLogReader::open(const char* path)
+{
+	const session_log_header_t*	log_header;
+	struct stat			st;
+	void*				map;
+	int				fd;
+
+	close();
+	fd = ::open(path, O_RDONLY);
+	if(fd < 0) {
+		std::cout << "Failed to open session log " << path << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+	if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(session_log_header_t)) {
+		std::cout << "Not a session log: " << path << std::endl;
+		::close(fd);
+		return false;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(map == MAP_FAILED) {
+		std::cout << "Failed to map session log " << path << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+	// read front to back, once
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	m_map = (const uint8_t*)map;
+	m_size = st.st_size;
+
+	log_header = header();
+	if(log_header->magic != SESSION_LOG_MAGIC || log_header->version != SESSION_LOG_VERSION
+			|| log_header->header_size < sizeof(session_log_header_t) || log_header->header_size > m_size) {
+		std::cout << "Not a session log, or a newer version: " << path << std::endl;
+		close();
+		return false;
+	}
+
+	m_indexed = load_index();
+	if(!m_indexed) {
+		walk_blocks();
+	}
+	return true;
+}
+
+void SessionLogReader::close()
+{
+	if(m_map != NULL) {
+		munmap((void*)m_map, m_size);
+	}
+	m_map = NULL;
+	m_size = 0;
+	m_indexed = false;
+	m_blocks.clear();
+}
+
+// a whole block within the file, with column sizes that add up
+bool SessionLogReader::check_block(uint64_t offset)
+{
+	const session_log_block_t*	b;
+	const uint32_t*			column_size;
+	uint64_t			total = 0;
+
+	if(offset % 8 || offset + sizeof(session_log_block_t) > m_size) {
+		return false;
+	}
+	b = (const session_log_block_t*)(m_map + offset);
+	if(b->magic != SESSION_LOG_BLOCK_MAGIC || b->columns == 0 || b->columns > SESSION_LOG_MAX_COLUMNS
+			|| offset + sizeof(*b) + b->size > m_size || b->size < b->columns * sizeof(uint32_t)) {
+		return false;
+	}
+	column_size = (const uint32_t*)(b + 1);
+	for(int c = 0; c < b->columns; c++) {
+		total += column_size[c];
+	}
+	return total == b->size - b->columns * sizeof(uint32_t);
+}
+
+bool SessionLogReader::load_index()
+{
+	const session_log_trailer_t*	trailer;
+	const session_log_index_t*	index;
+
+	if(m_size < header()->header_size + sizeof(*trailer)) {
+		return false;
+	}
+	trailer = (const session_log_trailer_t*)(m_map + m_size - sizeof(*trailer));
+	if(trailer->magic != SESSION_LOG_INDEX_MAGIC || trailer->index_offset % 8
+			|| trailer->index_offset + (uint64_t)trailer->index_count * sizeof(*index) + sizeof(*trailer) != m_size) {
+		return false;
+	}
+	index = (const session_log_index_t*)(m_map + trailer->index_offset);
+	m_blocks.reserve(trailer->index_count);
+	for(uint32_t i = 0; i < trailer->index_count; i++) {
+		if(!check_block(index[i].offset)) {
+			m_blocks.clear();
+			return false;
+		}
+		m_blocks.push_back(index[i].offset);
+	}
+	return true;
+}
+
+void SessionLogReader::walk_blocks()
+{
+	uint64_t	offset = header()->header_size;
+
+	// up to the first torn or missing block
+	while(check_block(offset)) {
+		m_blocks.push_back(offset);
+		offset += PADDED(sizeof(session_log_block_t) + block(m_blocks.size() - 1)->size);
+	}
+}
+
+bool SessionLogReader::column(size_t index, int column, session_log_column_t* iterator)
+{
+	const session_log_block_t*	b;
+	const uint32_t*			column_size;
+	const uint8_t*			p;
+
+	if(index >= m_blocks.size()) {
+		return false;
+	}
+	b = block(index);
+	if(column < 0 || column >= b->columns) {
+		return false;
+	}
+	column_size = (const uint32_t*)(b + 1);
+	p = (const uint8_t*)&column_size[b->columns];
+	for(int c = 0; c < column; c++) {
+		p += column_size[c];
+	}
+	iterator->pos = p;
+	iterator->end = p + column_size[column];
+	iterator->remaining = b->count;
+	iterator->value = 0;
+	return true;
+}
@@ -0,0 +1,92 @@
+/*
+ * SessionLogReader.h
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SESSION_LOG_READER_H
+#define SESSION_LOG_READER_H
+
+#include "SessionLog.h"
+#include <stddef.h>
+#include <vector>
+
+// Walks one column of a block straight out of the mapped file.
+typedef struct session_log_column_s {
+	const uint8_t*	pos;
+	const uint8_t*	end;
+	uint32_t	remaining;
+	int64_t		value;
+} session_log_column_t;
+
+// The next value of the column in its stored units.  false once the
+// column is done, or if it is shorter than its block says.
+static inline bool session_log_next(session_log_column_t* column, int64_t* value)
+{
+	uint64_t	zigzag = 0;
+	int		shift = 0;
+	uint8_t		byte;
+
+	if(column->remaining == 0) {
+		return false;
+	}
+	do {
+		if(column->pos == column->end || shift > 63) {
+			column->remaining = 0;
+			return false;
+		}
+		byte = *column->pos++;
+		zigzag |= (uint64_t)(byte & 0x7F) << shift;
+		shift += 7;
+	} while(byte & 0x80);
+
+	column->value += (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+	column->remaining--;
+	*value = column->value;
+	return true;
+}
+
+// Maps a session log read only and finds its blocks, from the index if
+// the log was closed properly, by walking them otherwise.  Nothing is
+// copied out of the map, a scan over many logs costs about what reading
+// them does.
+class SessionLogReader
+{
+public:
+				SessionLogReader();
+				~SessionLogReader();
+	bool			open(const char* path);
+	void			close();
+
+	const session_log_header_t*	header() { return (const session_log_header_t*)m_map; }
+	bool			indexed() { return m_indexed; }	// false for a log cut short
+	size_t			block_count() { return m_blocks.size(); }
+	const session_log_block_t*	block(size_t index) { return (const session_log_block_t*)(m_map + m_blocks[index]); }
+	bool			column(size_t index, int column, session_log_column_t* iterator);
+
+private:
+	bool			check_block(uint64_t offset);
+	bool			load_index();
+	void			walk_blocks();
+
+	const uint8_t*		m_map;
+	size_t			m_size;
+	bool			m_indexed;
+	std::vector<uint64_t>	m_blocks;		// offsets
+};
+
+#endif // SESSION_LOG_READER_H
@@ -0,0 +1,298 @@
+/*
+ * SoakBench.cpp
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "SoakBench.h"
+#include "BridgeBench.h"
+#include "dsi_thread.h"
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <glog/logging.h>
+
+#define SOAK_POLL_MS		10
+
+static const char* fault_names[SOAK_FAULT_CLASSES] = {
+	"usb_write",
+	"usb_read",
+	"trainer_gone",
+	"ant_crc",
+	"ant_overflow",
+	"ant_tx_drop",
+	"stick_gone",
+};
+
+SoakBench::SoakBench(FortiusSim* fortius, CANTMaster* ant_master, uint32_t seconds, uint32_t fault_mask, uint32_t interval_ms, uint32_t seed)
+{
+	m_fortius = fortius;
+	m_channel_number = ant_master->get_channel_number();
+	m_seconds = seconds;
+	m_fault_mask = fault_mask & SOAK_ALL_FAULTS;
+	m_interval_ms = interval_ms;
+	m_random_state = seed;
+	m_last_fault = -1;
+}
+
+bool SoakBench::parse_faults(const std::string& list, uint32_t* fault_mask)
+{
+	uint32_t	mask = 0;
+	size_t		start = 0;
+	size_t		end;
+
+	while(start <= list.size()) {
+		std::string	name;
+		int		fault;
+
+		end = list.find(',', start);
+		if(end == std::string::npos) {
+			end = list.size();
+		}
+		name = list.substr(start, end - start);
+		start = end + 1;
+
+		if(name == "all") {
+			mask |= SOAK_ALL_FAULTS;
+			continue;
+		}
+		for(fault = 0; fault < SOAK_FAULT_CLASSES && name != fault_names[fault]; fault++);
+		if(fault == SOAK_FAULT_CLASSES) {
+			return false;
+		}
+		mask |= (1 << fault);
+	}
+
+	if(mask == 0) {
+		return false;
+	}
+	*fault_mask = mask;
+	return true;
+}
+
+int SoakBench::next_fault()
+{
+	int	fault = m_last_fault;
+
+	if(m_fault_mask == 0) {
+		return -1;
+	}
+	do {
+		if(m_random_state) {
+			// xorshift, seeded so a schedule that broke the bridge can be played again
+			m_random_state ^= m_random_state << 13;
+			m_random_state ^= m_random_state >> 17;
+			m_random_state ^= m_random_state << 5;
+			fault = m_random_state % SOAK_FAULT_CLASSES;
+		} else {
+			fault = (fault + 1) % SOAK_FAULT_CLASSES;
+		}
+	} while(0 == (m_fault_mask & (1 << fault)));
+
+	m_last_fault = fault;
+	return fault;
+}
+
+void SoakBench::inject(int fault)
+{
+	VLOG(1) << "Soak: injecting " << fault_names[fault];
+
+	switch(fault) {
+	case SOAK_USB_WRITE:
+		m_fortius->fail_writes(1);
+		break;
+	case SOAK_USB_READ:
+		m_fortius->fail_reads(1);
+		break;
+	case SOAK_TRAINER_GONE:
+		m_fortius->unplug(SOAK_GONE_MS);
+		break;
+	case SOAK_ANT_CRC:
+		ANT_EmulatorInjectChecksumError();
+		break;
+	case SOAK_ANT_OVERFLOW:
+		ANT_EmulatorInjectOverrun(SOAK_OVERFLOW_FRAMES);
+		break;
+	case SOAK_ANT_TX_DROP:
+		ANT_EmulatorDropTxEvents(SOAK_TX_DROPS);
+		break;
+	case SOAK_STICK_GONE:
+		ANT_EmulatorUnplug(SOAK_GONE_MS);
+		break;
+	}
+}
+
+uint32_t SoakBench::faults_pending()
+{
+	ULONG	stick_faults = 0;
+
+	ANT_EmulatorGetFaultsPending(&stick_faults);
+	return m_fortius->get_faults_pending() + stick_faults;
+}
+
+ULONG SoakBench::fresh_slots()
+{
+	ULONG	slots = 0;
+
+	ANT_EmulatorGetFreshSlots(m_channel_number, &slots);
+	return slots;
+}
+
+bool SoakBench::run(soak_result_t* result, bool* abort)
+{
+	std::vector<double>	recover_ms[SOAK_FAULT_CLASSES];
+	double			start, end_time, wall_start;
+	double			next_time;
+	ULONG			fresh_start;
+
+	memset(result->classes, 0, sizeof(result->classes));
+	result->fault_mask = m_fault_mask;
+	result->fresh_slots_per_sec = 0;
+	result->faults = 0;
+	result->survived = true;
+	result->lost_to = -1;
+	result->lost_at_s = 0;
+
+	if(false == BridgeBench::wait_for_channel(m_channel_number, abort)) {
+		std::cout << "Soak: ANT channel did not open" << std::endl;
+		return false;
+	}
+
+	start = BridgeBench::now_seconds();
+	wall_start = BridgeBench::wall_seconds();
+	end_time = start + m_seconds;
+	fresh_start = fresh_slots();
+	next_time = start + m_interval_ms / 1000.0;
+
+	while(!*abort) {
+		double		fault_time, now;
+		double		lost;
+		uint32_t	reads_base = 0;
+		ULONG		fresh_base = 0;
+		ULONG		fresh_at_fault;
+		bool		cleared = false;
+		bool		recovered = false;
+		uint32_t	interval_ms;
+		int		fault;
+
+		BridgeBench::sleep_until(next_time, abort);
+		now = BridgeBench::now_seconds();
+		if(*abort || now >= end_time) {
+			break;
+		}
+
+		// the quiet lead in sets the rate the bridge normally fills slots at
+		if(result->faults == 0 && now > start) {
+			result->fresh_slots_per_sec = (fresh_slots() - fresh_start) / (now - start);
+		}
+
+		fault = next_fault();
+		fault_time = now;
+		fresh_at_fault = fresh_slots();
+		inject(fault);
+
+		// recovered once the fault is over and both the trainer and the stick have worked since
+		while(!*abort) {
+			DSIThread_Sleep(SOAK_POLL_MS);
+			now = BridgeBench::now_seconds();
+			if(!cleared) {
+				if(faults_pending() == 0) {
+					cleared = true;
+					reads_base = m_fortius->get_reads();
+					fresh_base = fresh_slots();
+				}
+			} else if(m_fortius->get_reads() != reads_base && fresh_slots() != fresh_base) {
+				recovered = true;
+				break;
+			}
+			if((now - fault_time) * 1000.0 >= SOAK_RECOVERY_TIMEOUT_MS) {
+				break;
+			}
+		}
+		if(*abort && !recovered) {
+			break;	// cut short, neither recovered nor lost
+		}
+
+		result->faults++;
+		result->classes[fault].injected++;
+		lost = (now - fault_time) * result->fresh_slots_per_sec - (fresh_slots() - fresh_at_fault);
+		if(lost > 0) {
+			result->classes[fault].lost_slots += (uint32_t)(lost + 0.5);
+		}
+
+		if(!recovered) {
+			std::cout << "Soak: no recovery from " << fault_names[fault] << std::endl;
+			result->survived = false;
+			result->lost_to = fault;
+			result->lost_at_s = fault_time - start;
+			break;
+		}
+		result->classes[fault].recovered++;
+		recover_ms[fault].push_back((now - fault_time) * 1000.0);
+
+		// spread the faults out when they are random too
+		interval_ms = m_random_state ? m_interval_ms / 2 + m_random_state % m_interval_ms : m_interval_ms;
+		next_time = fault_time + interval_ms / 1000.0;
+	}
+
+	result->virtual_time = (TRUE == DSIThread_VirtualTimeIsEnabled());
+	result->elapsed_s = BridgeBench::now_seconds() - start;
+	result->wall_s = BridgeBench::wall_seconds() - wall_start;
+
+	for(int fault = 0; fault < SOAK_FAULT_CLASSES; fault++) {
+		std::sort(recover_ms[fault].begin(), recover_ms[fault].end());
+		result->classes[fault].recover_p50_ms = BridgeBench::percentile(recover_ms[fault], 0.50);
+		result->classes[fault].recover_max_ms = recover_ms[fault].empty() ? 0 : recover_ms[fault].back();
+	}
+
+	return true;
+}
+
+void SoakBench::print(soak_result_t* result)
+{
+	std::cout << "soak"
+		<< " clock=" << (result->virtual_time ? "virtual" : "wall")
+		<< " elapsed_s=" << result->elapsed_s
+		<< " wall_s=" << result->wall_s
+		<< " faults=" << result->faults
+		<< " fresh_slots_per_sec=" << result->fresh_slots_per_sec
+		<< " session=" << (result->survived ? "survived" : "lost");
+	if(!result->survived) {
+		std::cout
+			<< " lost_to=" << fault_names[result->lost_to]
+			<< " lost_at_s=" << result->lost_at_s;
+	}
+	std::cout << std::endl;
+
+	for(int fault = 0; fault < SOAK_FAULT_CLASSES; fault++) {
+		soak_class_result_t*	c = &result->classes[fault];
+
+		if(0 == (result->fault_mask & (1 << fault))) {
+			continue;
+		}
+		std::cout << "soak_fault"
+			<< " class=" << fault_names[fault]
+			<< " injected=" << c->injected
+			<< " recovered=" << c->recovered
+			<< " recover_p50_ms=" << c->recover_p50_ms
+			<< " recover_max_ms=" << c->recover_max_ms
+			<< " lost_slots=" << c->lost_slots
+			<< " survived=" << (c->injected == 0 ? "untested" : (c->injected == c->recovered ? "yes" : "no"))
+			<< std::endl;
+	}
+}
@@ -0,0 +1,94 @@
+/*
+ * SoakBench.h
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SOAK_BENCH_H
+#define SOAK_BENCH_H
+
+#include "FortiusSim.h"
+#include "CANTMaster.h"
+#include <string>
+
+// fault classes, bit n of a fault mask enables class n
+#define SOAK_USB_WRITE		0	// one failed write to the trainer
+#define SOAK_USB_READ		1	// one failed read from the trainer
+#define SOAK_TRAINER_GONE	2	// trainer unplugged for SOAK_GONE_MS
+#define SOAK_ANT_CRC		3	// one frame from the stick with a bad checksum
+#define SOAK_ANT_OVERFLOW	4	// SOAK_OVERFLOW_FRAMES frames from the stick lost
+#define SOAK_ANT_TX_DROP	5	// SOAK_TX_DROPS EVENT_TX not reported
+#define SOAK_STICK_GONE		6	// stick unplugged for SOAK_GONE_MS
+#define SOAK_FAULT_CLASSES	7
+#define SOAK_ALL_FAULTS		((1 << SOAK_FAULT_CLASSES) - 1)
+
+#define SOAK_GONE_MS		2000
+#define SOAK_OVERFLOW_FRAMES	16
+#define SOAK_TX_DROPS		8
+#define SOAK_RECOVERY_TIMEOUT_MS	15000	// the session counts as lost after this
+#define SOAK_DEFAULT_INTERVAL_MS	5000
+
+typedef struct soak_class_result_s {
+	uint32_t	injected;
+	uint32_t	recovered;
+	double		recover_p50_ms;		// fault injected to a good telemetry frame and a fresh broadcast slot
+	double		recover_max_ms;
+	uint32_t	lost_slots;		// broadcast slots short of the normal rate until recovery
+} soak_class_result_t;
+
+typedef struct soak_result_s {
+	bool		virtual_time;
+	double		elapsed_s;		// on the bridge clock
+	double		wall_s;
+	uint32_t	fault_mask;
+	double		fresh_slots_per_sec;	// normal rate, measured before the first fault
+	uint32_t	faults;
+	bool		survived;
+	int		lost_to;		// class of the fault the session did not recover from
+	double		lost_at_s;
+	soak_class_result_t	classes[SOAK_FAULT_CLASSES];
+} soak_result_t;
+
+// Injects USB and ANT faults into a running bridge made of a simulated
+// trainer and an emulated ANT stick, one at a time, either in turn or in a
+// seeded random order, and measures how long the bridge takes to get back to
+// reading telemetry and filling broadcast slots.  Runs until the time is up
+// or a fault is not recovered from.
+class SoakBench
+{
+public:
+			SoakBench(FortiusSim* fortius, CANTMaster* ant_master, uint32_t seconds, uint32_t fault_mask, uint32_t interval_ms, uint32_t seed);
+	bool		run(soak_result_t* result, bool* abort);	// fortius and ant_master must be started
+	static void	print(soak_result_t* result);
+	static bool	parse_faults(const std::string& list, uint32_t* fault_mask);	// comma separated class names or "all"
+
+private:
+	int		next_fault();
+	void		inject(int fault);
+	uint32_t	faults_pending();
+	ULONG		fresh_slots();
+
+	FortiusSim*	m_fortius;
+	uint8_t		m_channel_number;
+	uint32_t	m_seconds;
+	uint32_t	m_fault_mask;
+	uint32_t	m_interval_ms;
+	uint32_t	m_random_state;		// 0 plays the classes in turn
+	int		m_last_fault;
+};
+
+#endif // SOAK_BENCH_H
@@ -0,0 +1,76 @@
+/*
+ * StickClock.h
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef STICK_CLOCK_H
+#define STICK_CLOCK_H
+
+#include <stdint.h>
+
+#define STICK_CLOCK_TICKS_PER_SEC	32768		// ANT receive time stamps, 16 bits, so they roll over every 2 s
+#define STICK_CLOCK_WINDOW_US		60000000ULL	// the fastest delivery is looked for over one to two of these
+
+// Puts the stick's receive time stamps on the bridge clock.  There is no
+// shared clock, so the fastest a page was ever delivered, the lowest
+// host minus stick offset over the last window or two, is taken as no
+// delay, and every page slower than that was held up between the air and
+// the host by that much.  Fixed USB and driver latency is not seen, the
+// stick being slow to deliver now and then is.  Windows let the minimum
+// follow the two crystals drifting apart, a few ms a minute at most.
+typedef struct stick_clock_s {
+	bool		valid;
+	uint16_t	min_offset;		// stick ticks, this window
+	uint16_t	last_min_offset;	// and the one before
+	uint64_t	window_start_us;
+} stick_clock_t;
+
+// A new stick, or the old one reset.
+static inline void stick_clock_reset(stick_clock_t* clock)
+{
+	clock->valid = false;
+}
+
+// When a page stamped stamp and received at rx_time_us (latency_now_us())
+// was on air, on the bridge clock.  Offsets are compared as signed 16 bit
+// differences, fine while delivery jitters by less than a second.
+static inline uint64_t stick_clock_air_time_us(stick_clock_t* clock, uint16_t stamp, uint64_t rx_time_us)
+{
+	uint16_t	offset = (uint16_t)(rx_time_us * STICK_CLOCK_TICKS_PER_SEC / 1000000 - stamp);
+	uint16_t	base;
+	uint64_t	delay_us;
+
+	if(!clock->valid) {
+		clock->valid = true;
+		clock->min_offset = offset;
+		clock->last_min_offset = offset;
+		clock->window_start_us = rx_time_us;
+	} else if(rx_time_us - clock->window_start_us > STICK_CLOCK_WINDOW_US) {
+		clock->last_min_offset = clock->min_offset;
+		clock->min_offset = offset;
+		clock->window_start_us = rx_time_us;
+	} else if((int16_t)(offset - clock->min_offset) < 0) {
+		clock->min_offset = offset;
+	}
+	base = ((int16_t)(clock->last_min_offset - clock->min_offset) < 0) ? clock->last_min_offset : clock->min_offset;
+
+	delay_us = (uint64_t)(uint16_t)(offset - base) * 1000000 / STICK_CLOCK_TICKS_PER_SEC;
+	return delay_us < rx_time_us ? rx_time_us - delay_us : rx_time_us;
+}
+
+#endif // STICK_CLOCK_H
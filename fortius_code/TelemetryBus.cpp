@@ -0,0 +1,157 @@
+/*
+ * TelemetryBus.cpp
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "TelemetryBus.h"
+#include "LatencyStats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <glog/logging.h>
+
+#define BUS_SIZE	(sizeof(telemetry_bus_header_t) + TELEMETRY_BUS_CAPACITY * sizeof(telemetry_bus_record_t))
+
+static_assert(sizeof(telemetry_bus_header_t) == 64, "telemetry bus header layout changed");
+static_assert(sizeof(telemetry_bus_record_t) == 64, "telemetry bus record layout changed");
+static_assert((TELEMETRY_BUS_CAPACITY & (TELEMETRY_BUS_CAPACITY - 1)) == 0, "telemetry bus capacity must be a power of two");
+
+static telemetry_bus_header_t*	bus = NULL;
+static telemetry_bus_record_t*	records;
+static char			bus_name[256];
+
+bool telemetry_bus_open(const char* name)
+{
+	int		fd;
+	void*		map;
+
+	if(bus != NULL) {
+		return true;
+	}
+	if(name == NULL) {
+		// in process readers only
+		map = mmap(NULL, BUS_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(map == MAP_FAILED) {
+			std::cout << "Failed to map telemetry bus: " << strerror(errno) << std::endl;
+			return false;
+		}
+		bus_name[0] = 0;
+		name = "(private)";
+	} else {
+		if(name[0] != '/' || strlen(name) >= sizeof(bus_name)) {
+			std::cout << "Invalid shared memory name " << name << ", it needs a leading /" << std::endl;
+			return false;
+		}
+
+		// a fresh object, readers still mapping one from an earlier run see it closed
+		shm_unlink(name);
+		fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+		if(fd < 0) {
+			std::cout << "Failed to create shared memory " << name << ": " << strerror(errno) << std::endl;
+			return false;
+		}
+		if(ftruncate(fd, BUS_SIZE) != 0) {
+			std::cout << "Failed to size shared memory " << name << ": " << strerror(errno) << std::endl;
+			close(fd);
+			shm_unlink(name);
+			return false;
+		}
+		map = mmap(NULL, BUS_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if(map == MAP_FAILED) {
+			std::cout << "Failed to map shared memory " << name << ": " << strerror(errno) << std::endl;
+			shm_unlink(name);
+			return false;
+		}
+		strcpy(bus_name, name);
+	}
+	// touch every page now, not from the Fortius thread
+	memset(map, 0, BUS_SIZE);
+
+	telemetry_bus_header_t*	header = (telemetry_bus_header_t*)map;
+
+	header->version = TELEMETRY_BUS_VERSION;
+	header->header_size = sizeof(telemetry_bus_header_t);
+	header->record_size = sizeof(telemetry_bus_record_t);
+	header->capacity = TELEMETRY_BUS_CAPACITY;
+	header->writer_pid = getpid();
+	header->start_time_us = latency_now_us();
+	// readers check the magic last
+	__atomic_store_n(&header->magic, TELEMETRY_BUS_MAGIC, __ATOMIC_RELEASE);
+
+	records = (telemetry_bus_record_t*)((uint8_t*)map + header->header_size);
+	__atomic_store_n(&bus, header, __ATOMIC_RELEASE);
+	VLOG (1) << "Telemetry bus " << name << " open, " << BUS_SIZE << " bytes";
+	return true;
+}
+
+void telemetry_bus_close()
+{
+	telemetry_bus_header_t*		header = bus;
+
+	if(header == NULL) {
+		return;
+	}
+	__atomic_store_n(&bus, (telemetry_bus_header_t*)NULL, __ATOMIC_RELEASE);
+	__atomic_store_n(&header->closed, 1, __ATOMIC_RELEASE);
+	munmap(header, BUS_SIZE);
+	// readers that have it mapped keep it until they let go
+	if(bus_name[0] != 0) {
+		shm_unlink(bus_name);
+	}
+}
+
+const telemetry_bus_header_t* telemetry_bus_get()
+{
+	return __atomic_load_n(&bus, __ATOMIC_ACQUIRE);
+}
+
+// two threads publish, the index is claimed with one atomic add
+static void publish(uint64_t time_us, uint32_t type, const void* payload, size_t size)
+{
+	telemetry_bus_header_t*	header = __atomic_load_n(&bus, __ATOMIC_ACQUIRE);
+	telemetry_bus_record_t*	record;
+	uint64_t		index;
+
+	if(header == NULL) {
+		return;
+	}
+	index = __atomic_fetch_add(&header->write_index, 1, __ATOMIC_ACQ_REL);
+	record = &records[index & (TELEMETRY_BUS_CAPACITY - 1)];
+
+	__atomic_store_n(&record->seq, 2 * index + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	record->time_us = time_us;
+	record->type = type;
+	record->reserved = 0;
+	memcpy(record->bytes, payload, size);
+	__atomic_store_n(&record->seq, 2 * index + 2, __ATOMIC_RELEASE);
+}
+
+void telemetry_bus_publish_sample(uint64_t time_us, const telemetry_bus_sample_t* sample)
+{
+	publish(time_us, TELEMETRY_BUS_SAMPLE, sample, sizeof(*sample));
+}
+
+void telemetry_bus_publish_control(uint64_t time_us, const telemetry_bus_control_t* control)
+{
+	publish(time_us, TELEMETRY_BUS_CONTROL, control, sizeof(*control));
+}
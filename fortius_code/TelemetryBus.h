@@ -0,0 +1,161 @@
+/*
+ * TelemetryBus.h
+ *
+ * Copyright 2017 Douglas Pepelko pepelkod@mega-mouse.net
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef TELEMETRY_BUS_H
+#define TELEMETRY_BUS_H
+
+// Layout of the POSIX shared memory ring fortius_ant_bridge --shm NAME
+// publishes into.  This header is all a reader needs: shm_open(NAME,
+// O_RDONLY), mmap the whole object PROT_READ, check magic and version,
+// then call telemetry_bus_read() in a loop.  Readers never make a system
+// call or take a lock on the data path and the bridge never waits for them.
+//
+//	offset 0		telemetry_bus_header_t, header_size bytes
+//	offset header_size	capacity records of record_size bytes
+//
+// Record n lives in slot n % capacity.  Its seq is 2n + 1 while it is
+// being written and 2n + 2 once it is complete, so a reader can tell a
+// finished record from one being written or one already overwritten.
+// All fields are little endian.  Times are microseconds on the bridge
+// clock, latency_now_us(): CLOCK_MONOTONIC, or simulated time when the
+// bridge runs with --virtual, so compare them with start_time_us and each
+// other, not with the reader's own clock.
+//
+// The version goes up when a field changes meaning or moves.  Fields
+// added in the reserved space keep the version, readers must ignore
+// record types they do not know.
+
+#include <stdint.h>
+#include <string.h>
+
+#define TELEMETRY_BUS_MAGIC		0x53554254	// "TBUS"
+#define TELEMETRY_BUS_VERSION		1
+#define TELEMETRY_BUS_CAPACITY		4096		// records, a power of two
+
+#define TELEMETRY_BUS_SAMPLE		1		// telemetry_bus_sample_t, every message decoded from the Fortius
+#define TELEMETRY_BUS_CONTROL		2		// telemetry_bus_control_t, the control state whenever it changes
+
+// every field is naturally aligned, no packing needed
+typedef struct telemetry_bus_header_s {
+	uint32_t	magic;			// TELEMETRY_BUS_MAGIC
+	uint32_t	version;		// TELEMETRY_BUS_VERSION
+	uint32_t	header_size;		// offset of the first record
+	uint32_t	record_size;		// sizeof(telemetry_bus_record_t)
+	uint32_t	capacity;		// number of record slots, a power of two
+	uint32_t	writer_pid;
+	uint64_t	start_time_us;		// when the bridge created the bus
+	uint64_t	write_index;		// records claimed so far, read with an acquire load
+	uint32_t	closed;			// 1 once the bridge has shut down, reopen to follow the next one
+	uint8_t		reserved[20];
+} telemetry_bus_header_t;		// 64 bytes
+
+typedef struct telemetry_bus_sample_s {
+	float		power_watts;		// after smoothing and the power scale factor
+	float		heartrate_bpm;
+	float		cadence_rpm;
+	float		speed_kph;
+	double		distance_m;
+	int16_t		raw_power;		// as read from the brake
+	uint16_t	raw_speed;
+	int16_t		steering;
+	uint8_t		buttons;		// FT_PLUS, FT_MINUS, FT_CANCEL, FT_ENTER
+	uint8_t		pedalling;		// 1 while the pedal sensor sees pedalling
+	uint8_t		reserved[8];
+} telemetry_bus_sample_t;		// 40 bytes
+
+typedef struct telemetry_bus_control_s {
+	uint8_t		mode;			// FT_ERGOMODE, FT_SSMODE or FT_CALIBRATE, as requested over FE-C
+	uint8_t		reserved1[3];
+	float		target_power_watts;	// from FE-C page 49, or the +/- buttons
+	float		slope_percent;		// from FE-C page 51
+	float		crr;
+	float		wind_resistance_coef;	// kg/m, from FE-C page 50
+	float		wind_speed_kph;
+	float		drafting_factor;
+	float		user_weight_kg;		// from FE-C page 55
+	float		bike_weight_kg;
+	uint8_t		reserved2[4];
+} telemetry_bus_control_t;		// 40 bytes
+
+typedef struct telemetry_bus_record_s {
+	uint64_t	seq;			// 2n + 2 when record n is complete
+	uint64_t	time_us;		// when the sample was read, or the control state changed
+	uint32_t	type;			// TELEMETRY_BUS_SAMPLE or TELEMETRY_BUS_CONTROL
+	uint32_t	reserved;
+	union {
+		telemetry_bus_sample_t	sample;
+		telemetry_bus_control_t	control;
+		uint8_t			bytes[40];
+	};
+} telemetry_bus_record_t;		// 64 bytes, one cache line
+
+// Copies the record at *cursor and moves the cursor past it.  Returns 1
+// for a record, 0 if there is nothing new yet.  A reader that fell more
+// than capacity records behind has its cursor moved forward to the oldest
+// record still there, so a cursor that jumps by more than one means
+// records were lost.  Start with *cursor 0 for everything still in the
+// ring, or write_index for new records only.
+static inline int telemetry_bus_read(const telemetry_bus_header_t* bus, uint64_t* cursor, telemetry_bus_record_t* record)
+{
+	const telemetry_bus_record_t*	records = (const telemetry_bus_record_t*)((const uint8_t*)bus + bus->header_size);
+	uint64_t			head;
+	uint64_t			seq;
+
+	for(;;) {
+		head = __atomic_load_n(&bus->write_index, __ATOMIC_ACQUIRE);
+		if(*cursor >= head) {
+			return 0;
+		}
+		if(head - *cursor > bus->capacity) {
+			*cursor = head - bus->capacity;
+		}
+
+		const telemetry_bus_record_t*	slot = &records[*cursor & (bus->capacity - 1)];
+
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if(seq < 2 * *cursor + 2) {
+			// claimed, still being written
+			return 0;
+		}
+		if(seq == 2 * *cursor + 2) {
+			memcpy(record, (const void*)slot, sizeof(*record));
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if(__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq) {
+				(*cursor)++;
+				return 1;
+			}
+		}
+		// overwritten underneath us, catch up
+		*cursor = *cursor + 1;
+	}
+}
+
+#ifdef __cplusplus
+// The bridge side.  Publishing never blocks and never allocates, and does
+// nothing until telemetry_bus_open() succeeds.  Close only once the
+// Fortius and CANTMaster threads and every in process reader have stopped.
+bool	telemetry_bus_open(const char* name);		// NULL for a ring only readers in this process see
+void	telemetry_bus_close();
+const telemetry_bus_header_t*	telemetry_bus_get();	// for in process readers, NULL if not open
+void	telemetry_bus_publish_sample(uint64_t time_us, const telemetry_bus_sample_t* sample);
+void	telemetry_bus_publish_control(uint64_t time_us, const telemetry_bus_control_t* control);
+#endif
+
+#endif // TELEMETRY_BUS_H